@@ -753,14 +753,6 @@ UserSession *IsSessionValid( struct AuthMod *l, Http *r, const char *sessionId )
 	// to see if the session has lastupdated date less then 2 hours old
 	UserSession *users = sb->sl_UserSessionManagerInterface.USMGetSessionBySessionID( sb->sl_USM, sessionId );
 	time_t timestamp = time ( NULL );
-	
-	
-	MYSQLLibrary *sqlLib = sb->LibraryMYSQLGet( sb );
-	if( sqlLib == NULL )
-	{
-		FERROR("Cannot get mysql.library slot!\n");
-		return NULL;
-	}
 
 	if( users == NULL )
 	{
@@ -776,19 +768,9 @@ UserSession *IsSessionValid( struct AuthMod *l, Http *r, const char *sessionId )
 		if( strcmp( users->us_SessionID, sessionId ) == 0 )
 		{
 			DEBUG( "IsSessionValid: Session is valid! %s\n", sessionId );
-			char tmpQuery[ 512 ];
 			
-			sqlLib->SNPrintF( sqlLib, tmpQuery, sizeof(tmpQuery), "UPDATE FUserSession SET `LoggedTime` = '%ld' WHERE `SessionID` = '%s'", timestamp, sessionId );
-			//sprintf( tmpQuery, "UPDATE FUserSession SET `LoggedTime` = '%ld' WHERE `SessionID` = '%s'", timestamp, sessionId );
-
-			MYSQL_RES *res = sqlLib->Query( sqlLib, tmpQuery );
-			if( res != NULL )
-			{
-			//users->us_User->u_Error = FUP_AUTHERR_UPDATE;
-				sqlLib->FreeResult( sqlLib, res );
-				sb->LibraryMYSQLDrop( sb, sqlLib );
-				return users;
-			}
+			// LoggedTime is stored in database by session manager in batches
+			sb->sl_UserSessionManagerInterface.USMSessionTouch( sb->sl_USM, users );
 		}
 		else
 		{
@@ -796,18 +778,13 @@ UserSession *IsSessionValid( struct AuthMod *l, Http *r, const char *sessionId )
 			
 			// same session, update loggedtime
 			//user->u_Error = FUP_AUTHERR_WRONGSESID;
-			sb->LibraryMYSQLDrop( sb, sqlLib );
-			return users;
 		}
 	}
 	else
 	{
 		DEBUG( "IsSessionValid: Session has timed out! %s\n", sessionId );
 		//user->u_Error = FUP_AUTHERR_TIMEOUT;
-		sb->LibraryMYSQLDrop( sb, sqlLib );
-		return users;
 	}
-	sb->LibraryMYSQLDrop( sb, sqlLib );
 	return users;
 }
 
@@ -32,6 +32,17 @@
 #ifndef PROFILING_H_
 #define PROFILING_H_
 
+#include <core/metrics.h>
 
+//
+// Measure block of code as one of METRIC_STAGE_* stages
+//
+// PROFILE_START( t );
+// ...
+// PROFILE_END( METRIC_STAGE_SQL_QUERY, t );
+//
+
+#define PROFILE_START( VAR ) FUQUAD VAR = MetricsTime()
+#define PROFILE_END( STAGE, VAR ) MetricsRecordSince( STAGE, VAR )
 
 #endif
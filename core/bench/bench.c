@@ -0,0 +1,176 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ *
+ *  Microbenchmark runner
+ *
+ *  @date created 10/2026
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_TIME_MS		500
+#define BENCH_MAX_ITERATIONS		1000000000LL
+
+static FQUAD benchMinTimeNs = BENCH_DEFAULT_TIME_MS * 1000000LL;
+static const char *benchFilter = NULL;
+
+static FQUAD benchAllocs = 0;
+static FQUAD benchAllocBytes = 0;
+
+//
+// Allocation counters, linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+//
+
+void *__real_malloc( size_t size );
+void *__real_calloc( size_t nmemb, size_t size );
+void *__real_realloc( void *ptr, size_t size );
+
+void *__wrap_malloc( size_t size )
+{
+	__sync_add_and_fetch( &benchAllocs, 1 );
+	__sync_add_and_fetch( &benchAllocBytes, (FQUAD)size );
+	return __real_malloc( size );
+}
+
+void *__wrap_calloc( size_t nmemb, size_t size )
+{
+	__sync_add_and_fetch( &benchAllocs, 1 );
+	__sync_add_and_fetch( &benchAllocBytes, (FQUAD)( nmemb * size ) );
+	return __real_calloc( nmemb, size );
+}
+
+void *__wrap_realloc( void *ptr, size_t size )
+{
+	__sync_add_and_fetch( &benchAllocs, 1 );
+	__sync_add_and_fetch( &benchAllocBytes, (FQUAD)size );
+	return __real_realloc( ptr, size );
+}
+
+/**
+ * Get monotonic time in nanoseconds
+ *
+ * @return time in nanoseconds
+ */
+
+static inline FQUAD BenchNow( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (FQUAD)ts.tv_sec * 1000000000LL + (FQUAD)ts.tv_nsec;
+}
+
+/**
+ * Parse benchmark command line
+ *
+ * -t <ms>      minimal time of every benchmark, default 500
+ * -f <string>  run only benchmarks which name contains string
+ *
+ * @param argc number of arguments
+ * @param argv arguments
+ */
+
+void BenchInit( int argc, char **argv )
+{
+	int i;
+	for( i = 1 ; i < argc ; i++ )
+	{
+		if( strcmp( argv[ i ], "-t" ) == 0 && i + 1 < argc )
+		{
+			FQUAD ms = strtoll( argv[ ++i ], NULL, 10 );
+			if( ms > 0 )
+			{
+				benchMinTimeNs = ms * 1000000LL;
+			}
+		}
+		else if( strcmp( argv[ i ], "-f" ) == 0 && i + 1 < argc )
+		{
+			benchFilter = argv[ ++i ];
+		}
+		else
+		{
+			fprintf( stderr, "Usage: %s [-t min_time_ms] [-f name_filter]\n", argv[ 0 ] );
+			exit( 1 );
+		}
+	}
+}
+
+/**
+ * Run benchmark and print result as JSON line
+ *
+ * @param name benchmark name
+ * @param fn benchmark function
+ * @param data pointer passed to benchmark function
+ */
+
+void BenchRun( const char *name, BenchFunc fn, void *data )
+{
+	if( benchFilter != NULL && strstr( name, benchFilter ) == NULL )
+	{
+		return;
+	}
+
+	// warm up caches and lazy initialisation
+	fn( data, 1 );
+
+	FQUAD iterations = 1;
+	FQUAD elapsed = 0, allocs = 0, bytes = 0;
+
+	while( TRUE )
+	{
+		FQUAD allocsStart = benchAllocs;
+		FQUAD bytesStart = benchAllocBytes;
+		FQUAD start = BenchNow();
+
+		fn( data, iterations );
+
+		elapsed = BenchNow() - start;
+		allocs = benchAllocs - allocsStart;
+		bytes = benchAllocBytes - bytesStart;
+
+		if( elapsed >= benchMinTimeNs || iterations >= BENCH_MAX_ITERATIONS )
+		{
+			break;
+		}
+
+		// predict number of iterations needed, grow at most 100 times
+		FQUAD next = elapsed > 0 ? ( benchMinTimeNs * iterations / elapsed ) * 6 / 5 : iterations * 100;
+		if( next > iterations * 100 )
+		{
+			next = iterations * 100;
+		}
+		if( next <= iterations )
+		{
+			next = iterations + 1;
+		}
+		iterations = next < BENCH_MAX_ITERATIONS ? next : BENCH_MAX_ITERATIONS;
+	}
+
+	printf( "{\"benchmark\":\"%s\",\"iterations\":%lld,\"ns_per_op\":%.2f,\"allocs_per_op\":%.2f,\"bytes_per_op\":%.1f}\n",
+		name, iterations, (double)elapsed / (double)iterations, (double)allocs / (double)iterations, (double)bytes / (double)iterations );
+	fflush( stdout );
+}
@@ -0,0 +1,66 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ *
+ *  Microbenchmark runner
+ *
+ *  Every benchmark is run with growing number of iterations until it takes
+ *  at least minimal time. Result is printed as one JSON object per line:
+ *  {"benchmark":"name","iterations":N,"ns_per_op":X,"allocs_per_op":Y,"bytes_per_op":Z}
+ *
+ *  Allocations are counted by wrapping malloc/calloc/realloc at link time
+ *  (-Wl,--wrap), so only calls made from linked FriendCore objects are seen.
+ *
+ *  @date created 10/2026
+ */
+
+#ifndef __BENCH_BENCH_H__
+#define __BENCH_BENCH_H__
+
+#include <core/types.h>
+
+//
+// Benchmark function, must run its operation iterations times
+//
+
+typedef void (*BenchFunc)( void *data, FQUAD iterations );
+
+//
+//
+//
+
+void BenchInit( int argc, char **argv );
+
+//
+//
+//
+
+void BenchRun( const char *name, BenchFunc fn, void *data );
+
+//
+// Prevent compiler from removing benchmarked code
+//
+
+#define BENCH_USE( PTR ) __asm__ __volatile__( "" : : "r"( PTR ) : "memory" )
+
+#endif // __BENCH_BENCH_H__
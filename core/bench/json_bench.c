@@ -0,0 +1,334 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ *
+ *  Descriptor driven JSON serialization benchmark
+ *
+ *  Compiled plans (GetJSONFromStructure, JSONPlanWriteList) are compared
+ *  with interpreted serializer used before plans (copy is kept in this file)
+ *  on one object and on list built the way application list endpoint did it
+ *  before plans.
+ *
+ *  @date created 10/2026
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <stddef.h>
+#include <util/string.h>
+#include <system/json/json_converter.h>
+
+#define BENCH_LIST_SIZE			200
+
+//
+// Structure with fields of every type supported by serializer
+//
+
+typedef struct BenchEntry
+{
+	FULONG				be_ID;
+	int					be_UserID;
+	char				*be_Name;
+	char				*be_Path;
+	char				*be_Config;
+	struct tm			be_DateModified;
+	MinNode				node;
+}BenchEntry;
+
+static FULONG BenchEntryDesc[] = { SQLT_TABNAME, (FULONG)"FBenchEntry", SQLT_STRUCTSIZE, sizeof( struct BenchEntry ),
+	SQLT_IDINT, (FULONG)"ID", offsetof( struct BenchEntry, be_ID ),
+	SQLT_INT, (FULONG)"UserID", offsetof( struct BenchEntry, be_UserID ),
+	SQLT_STR, (FULONG)"Name", offsetof( struct BenchEntry, be_Name ),
+	SQLT_STR, (FULONG)"InstallPath", offsetof( struct BenchEntry, be_Path ),
+	SQLT_STR, (FULONG)"Config", offsetof( struct BenchEntry, be_Config ),
+	SQLT_TIMESTAMP, (FULONG)"DateModified", offsetof( struct BenchEntry, be_DateModified ),
+	SQLT_NODE, (FULONG)"node", offsetof( struct BenchEntry, node ),
+	SQLT_END };
+
+static BenchEntry *entries;
+
+//
+// Serializer used before plans, baseline for comparison
+//
+
+/**
+ * Convert C structure to JSON by walking description for every object.
+ * This is how GetJSONFromStructure worked before plans were introduced.
+ * Strings are not escaped.
+ *
+ * @param descr pointer to taglist which describe structure
+ * @param data pointer to structure
+ * @return new BufString with JSON or NULL when error will happen
+ */
+static BufString *GetJSONFromStructureInterpreted( FULONG *descr, void *data )
+{
+	BufString *bs = BufStringNew();
+	if( bs == NULL )
+	{
+		FERROR("ERROR: bufstring is null\n");
+		return NULL;
+	}
+	
+	if( descr == NULL || data == NULL )
+	{
+		BufStringDelete( bs );
+		FERROR("Data structure or description was not provided!\n");
+		return 0;
+	}
+	
+	if( descr[ 0 ] != SQLT_TABNAME )
+	{
+		BufStringDelete( bs );
+		FERROR("SQLT_TABNAME was not provided!\n");
+		return 0;
+	}
+	
+	FULONG *dptr = &descr[ SQL_DATA_STRUCT_START ];		// first 2 entries inform about table, rest information provided is about columns
+	unsigned char *strptr = (unsigned char *)data;	// pointer to structure to which will will insert data
+	int opt = 0;
+	
+	BufStringAdd( bs, "{" );
+	
+	while( dptr[0] != SQLT_END )
+	{
+		switch( dptr[ 0 ] )
+		{
+			case SQLT_IDINT:	// primary key
+			case SQLT_INT:
+				{
+					char tmp[ 256 ];
+					int tmpint;
+					memcpy( &tmpint, strptr + dptr[2], sizeof( int ) );
+					
+					if( opt == 0 )
+					{
+						sprintf( tmp, "\"%s\": %d ", (char *)dptr[ 1 ], tmpint );
+						BufStringAdd( bs, tmp );
+					}
+					else
+					{
+						sprintf( tmp, ", \"%s\": %d ", (char *)dptr[ 1 ], tmpint );
+						BufStringAdd( bs, tmp );
+					}
+					
+					opt++;
+				}
+				break;
+				
+			case SQLT_STR:
+				{
+					char tmp[ 512 ];
+					char *tmpchar;
+					memcpy( &tmpchar, strptr+dptr[2], sizeof( char *) );
+					
+					if( tmpchar != NULL )
+					{
+						if( opt == 0 )
+						{
+							sprintf( tmp, "\"%s\": \"%s\" ", (char *)dptr[ 1 ], tmpchar );
+							BufStringAdd( bs, tmp );
+						}
+						else
+						{
+							sprintf( tmp, ", \"%s\": \"%s\" ", (char *)dptr[ 1 ], tmpchar );
+							BufStringAdd( bs, tmp );
+						}
+					}
+					
+					opt++;
+				}
+				break;
+				
+			case SQLT_TIMESTAMP:
+				{
+					// '2015-08-10 16:28:31'
+					char date[ 512 ];
+
+					struct tm *tp = (struct tm *)( strptr+dptr[2]);
+					if( opt == 0 )
+					{
+						sprintf( date, "\"%s\": \"%4d-%2d-%2d %2d:%2d:%2d\" ", (char *)dptr[ 1 ], tp->tm_year, tp->tm_mon, tp->tm_mday, tp->tm_hour, tp->tm_min, tp->tm_sec );
+						BufStringAdd( bs, date );
+					}
+					else
+					{
+						sprintf( date, ", \"%s\": \"%4d-%2d-%2d %2d:%2d:%2d\" ", (char *)dptr[ 1 ], tp->tm_year, tp->tm_mon, tp->tm_mday, tp->tm_hour, tp->tm_min, tp->tm_sec );
+						BufStringAdd( bs, date );
+					}
+					
+					opt++;
+				}
+			break;
+		}
+		
+		dptr += 3;
+	}
+	
+	BufStringAdd( bs, "}" );
+	
+	return bs;
+}
+
+//
+// One object
+//
+
+static void BenchObjectInterpreted( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		BufString *bs = GetJSONFromStructureInterpreted( BenchEntryDesc, entries );
+		BENCH_USE( bs->bs_Buffer );
+		BufStringDelete( bs );
+	}
+}
+
+static void BenchObjectPlan( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		BufString *bs = GetJSONFromStructure( BenchEntryDesc, entries );
+		BENCH_USE( bs->bs_Buffer );
+		BufStringDelete( bs );
+	}
+}
+
+//
+// List, interpreted version is loop used by application list before plans
+//
+
+static void BenchListInterpreted( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		BufString *bs = BufStringNew();
+		BenchEntry *be = entries;
+		int pos = 0;
+
+		BufStringAdd( bs, " { \"Application\": [" );
+		while( be != NULL )
+		{
+			if( pos > 0 )
+			{
+				BufStringAdd( bs, ", " );
+			}
+
+			BufString *lbs = GetJSONFromStructureInterpreted( BenchEntryDesc, be );
+			if( lbs != NULL )
+			{
+				BufStringAddSize( bs, lbs->bs_Buffer, lbs->bs_Size );
+				BufStringDelete( lbs );
+			}
+
+			be = (BenchEntry *)be->node.mln_Succ;
+			pos++;
+		}
+		BufStringAdd( bs, "  ]}" );
+
+		BENCH_USE( bs->bs_Buffer );
+		BufStringDelete( bs );
+	}
+}
+
+static void BenchListPlan( void *data, FQUAD iterations )
+{
+	JSONPlan *jp = JSONPlanGet( BenchEntryDesc );
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		BufString *bs = BufStringNew();
+
+		BufStringAdd( bs, " { \"Application\": " );
+		JSONPlanWriteList( jp, bs, entries );
+		BufStringAdd( bs, "}" );
+
+		BENCH_USE( bs->bs_Buffer );
+		BufStringDelete( bs );
+	}
+}
+
+/**
+ * JSON benchmark entry
+ *
+ * @param argc number of arguments
+ * @param argv arguments
+ * @return 0 when success, otherwise error number
+ */
+
+int main( int argc, char **argv )
+{
+	int i;
+
+	BenchInit( argc, argv );
+
+	BenchEntry *last = NULL;
+	for( i = 0 ; i < BENCH_LIST_SIZE ; i++ )
+	{
+		char tmp[ 256 ];
+		BenchEntry *be = FCalloc( 1, sizeof( BenchEntry ) );
+		if( be == NULL )
+		{
+			fprintf( stderr, "Cannot allocate memory\n" );
+			return 1;
+		}
+
+		be->be_ID = i + 1;
+		be->be_UserID = 1000 + ( i % 17 );
+		snprintf( tmp, sizeof( tmp ), "Application%d", i );
+		be->be_Name = StringDuplicate( tmp );
+		snprintf( tmp, sizeof( tmp ), "resources/webclient/apps/Application%d/", i );
+		be->be_Path = StringDuplicate( tmp );
+		be->be_Config = StringDuplicate( "{'Name':'Application','API':'v1','Version':'0.1','Permissions':['Module System']}" );
+		be->be_DateModified.tm_year = 2026;
+		be->be_DateModified.tm_mon = 10;
+		be->be_DateModified.tm_mday = 19;
+		be->be_DateModified.tm_hour = 12;
+		be->be_DateModified.tm_min = i % 60;
+		be->be_DateModified.tm_sec = 5;
+
+		if( last == NULL )
+		{
+			entries = be;
+		}
+		else
+		{
+			last->node.mln_Succ = (MinNode *)be;
+			be->node.mln_Pred = (MinNode *)last;
+		}
+		last = be;
+	}
+
+	BenchRun( "JSONObject/Interpreted", BenchObjectInterpreted, NULL );
+	BenchRun( "JSONObject/Plan", BenchObjectPlan, NULL );
+	BenchRun( "JSONList/200/Interpreted", BenchListInterpreted, NULL );
+	BenchRun( "JSONList/200/Plan", BenchListPlan, NULL );
+
+	JSONPlanDeleteAll();
+
+	return 0;
+}
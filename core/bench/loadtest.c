@@ -0,0 +1,1567 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ *
+ *  End-to-end load test driver
+ *
+ *  Every synthetic user logs in, opens websocket connection and then
+ *  calls random routes from mix: system.library calls over HTTP, static
+ *  files, websocket requests and file read/write on Local and INRAM doors.
+ *  Admin user sends server messages which are broadcasted to all
+ *  websocket connections. Throughput and latency percentiles of every
+ *  route are printed as JSON lines. FriendCore and database are prepared
+ *  by loadtest.sh.
+ *
+ *  @date created 10/2026
+ */
+
+#include <core/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <util/buffered_string.h>
+#include <util/sha256.h>
+#include <util/base64.h>
+
+#define LT_STREAM_BUFFER_SIZE		16384
+#define LT_REQUEST_TIMEOUT_S		10
+#define LT_SESSION_ID_SIZE			256
+#define LT_REQUEST_ID_SIZE			32
+
+//
+// Routes
+//
+
+enum
+{
+	LT_ROUTE_LOGIN = 0,
+	LT_ROUTE_HELP,
+	LT_ROUTE_DEVICE_LIST,
+	LT_ROUTE_APP_LIST,
+	LT_ROUTE_STATIC,
+	LT_ROUTE_WS_REQUEST,
+	LT_ROUTE_WS_BROADCAST,
+	LT_ROUTE_SERVER_MESSAGE,
+	LT_ROUTE_LOCAL_WRITE,
+	LT_ROUTE_LOCAL_READ,
+	LT_ROUTE_INRAM_WRITE,
+	LT_ROUTE_INRAM_READ,
+	LT_ROUTE_MAX
+};
+
+typedef struct LTRoute
+{
+	const char				*lr_Name;
+	int						lr_Weight;		// share in random mix, 0 when route is driven separately
+}LTRoute;
+
+static LTRoute ltRoutes[ LT_ROUTE_MAX ] = {
+	{ "http/system.library/login", 0 },
+	{ "http/system.library/help", 10 },
+	{ "http/system.library/device/list", 10 },
+	{ "http/system.library/app/list", 5 },
+	{ "http/static/webclient/index.html", 15 },
+	{ "ws/system.library/help", 20 },
+	{ "ws/broadcast", 0 },
+	{ "http/system.library/admin/servermessage", 0 },
+	{ "http/system.library/file/write/Local", 10 },
+	{ "http/system.library/file/read/Local", 10 },
+	{ "http/system.library/file/write/INRAM", 10 },
+	{ "http/system.library/file/read/INRAM", 10 }
+};
+
+//
+// Latency samples of one route in microseconds
+//
+
+typedef struct LTSamples
+{
+	unsigned int			*ls_Data;
+	FQUAD					ls_Count;
+	FQUAD					ls_Size;
+	FQUAD					ls_Errors;
+}LTSamples;
+
+//
+// Buffered socket reader
+//
+
+typedef struct LTStream
+{
+	int						lst_Socket;
+	int						lst_Pos;
+	int						lst_Len;
+	char					lst_Buffer[ LT_STREAM_BUFFER_SIZE ];
+}LTStream;
+
+//
+// Synthetic user
+//
+
+typedef struct LTUser
+{
+	int						lu_Index;
+	char					lu_Name[ 64 ];
+	char					lu_SessionID[ LT_SESSION_ID_SIZE ];
+	unsigned int			lu_Seed;
+	FQUAD					lu_RequestCounter;
+	LTStream				lu_WS;
+	FBOOL					lu_WSConnected;
+	pthread_t				lu_Thread;
+	pthread_t				lu_ReaderThread;
+	FBOOL					lu_ReaderStarted;
+	FBOOL					lu_Ready;			// logged in, connected and files are written
+	pthread_mutex_t			lu_Mutex;			// protects websocket writes and request waiting
+	pthread_cond_t			lu_Cond;
+	char					lu_WaitID[ LT_REQUEST_ID_SIZE ];
+	int						lu_WaitResult;		// 0 waiting, 1 answered, -1 failed
+	LTSamples				lu_Samples[ LT_ROUTE_MAX ];	// broadcast is only written by reader thread
+}LTUser;
+
+//
+// Configuration
+//
+
+static const char *ltHost = "127.0.0.1";
+static int ltHTTPPort = 6502;
+static int ltWSPort = 6500;
+static int ltUsers = 10;
+static const char *ltUserPrefix = "loadtest";
+static const char *ltPassword = "loadtest";
+static int ltDuration = 30;
+static int ltFileSize = 1024;
+static int ltBroadcastMs = 1000;
+static const char *ltAdminName = NULL;
+static const char *ltAdminPassword = NULL;
+static const char *ltMetricsFile = NULL;
+
+static struct sockaddr_storage ltHTTPAddr;
+static struct sockaddr_storage ltWSAddr;
+static socklen_t ltAddrLen;
+
+static volatile int ltRunning = 1;
+static pthread_barrier_t ltStartBarrier;
+static char *ltFileData;
+static int ltRouteWeightSum;
+
+/**
+ * Get monotonic time in nanoseconds
+ *
+ * @return time in nanoseconds
+ */
+
+static inline FQUAD LTNow( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (FQUAD)ts.tv_sec * 1000000000LL + (FQUAD)ts.tv_nsec;
+}
+
+/**
+ * Store latency sample
+ *
+ * @param ls pointer to route samples
+ * @param start time when operation started, from LTNow
+ * @param error TRUE when operation failed
+ */
+
+static void LTRecord( LTSamples *ls, FQUAD start, FBOOL error )
+{
+	if( error == TRUE )
+	{
+		ls->ls_Errors++;
+		return;
+	}
+
+	if( ls->ls_Count >= ls->ls_Size )
+	{
+		FQUAD size = ls->ls_Size > 0 ? ls->ls_Size * 2 : 1024;
+		unsigned int *data = realloc( ls->ls_Data, size * sizeof( unsigned int ) );
+		if( data == NULL )
+		{
+			ls->ls_Errors++;
+			return;
+		}
+		ls->ls_Data = data;
+		ls->ls_Size = size;
+	}
+
+	FQUAD usec = ( LTNow() - start ) / 1000;
+	ls->ls_Data[ ls->ls_Count++ ] = usec > 0xFFFFFFFFLL ? 0xFFFFFFFF : (unsigned int)usec;
+}
+
+/**
+ * Resolve host and port
+ *
+ * @param host host name or address
+ * @param port port number
+ * @param addr pointer to address which will be filled
+ * @param len pointer to address length which will be filled
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTResolve( const char *host, int port, struct sockaddr_storage *addr, socklen_t *len )
+{
+	struct addrinfo hints, *res = NULL;
+	char service[ 16 ];
+
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf( service, sizeof( service ), "%d", port );
+
+	if( getaddrinfo( host, service, &hints, &res ) != 0 || res == NULL )
+	{
+		return 1;
+	}
+	memcpy( addr, res->ai_addr, res->ai_addrlen );
+	*len = res->ai_addrlen;
+	freeaddrinfo( res );
+	return 0;
+}
+
+/**
+ * Open TCP connection
+ *
+ * @param addr server address
+ * @return socket descriptor or -1 when error appear
+ */
+
+static int LTConnect( struct sockaddr_storage *addr )
+{
+	int fd = socket( addr->ss_family, SOCK_STREAM, 0 );
+	if( fd < 0 )
+	{
+		return -1;
+	}
+
+	int one = 1;
+	setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof( one ) );
+
+	struct timeval tv = { LT_REQUEST_TIMEOUT_S, 0 };
+	setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof( tv ) );
+
+	if( connect( fd, (struct sockaddr *)addr, ltAddrLen ) != 0 )
+	{
+		close( fd );
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * Write whole buffer to socket
+ *
+ * @param fd socket descriptor
+ * @param data pointer to data
+ * @param size size of data
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTWriteAll( int fd, const char *data, int size )
+{
+	while( size > 0 )
+	{
+		ssize_t n = send( fd, data, size, MSG_NOSIGNAL );
+		if( n <= 0 )
+		{
+			if( n < 0 && errno == EINTR )
+			{
+				continue;
+			}
+			return 1;
+		}
+		data += n;
+		size -= n;
+	}
+	return 0;
+}
+
+/**
+ * Read exact number of bytes from stream
+ *
+ * @param s pointer to stream
+ * @param dst where data will be stored, can be NULL when data should be skipped
+ * @param size number of bytes
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTStreamRead( LTStream *s, char *dst, FQUAD size )
+{
+	while( size > 0 )
+	{
+		if( s->lst_Pos >= s->lst_Len )
+		{
+			ssize_t n = recv( s->lst_Socket, s->lst_Buffer, LT_STREAM_BUFFER_SIZE, 0 );
+			if( n <= 0 )
+			{
+				if( n < 0 && errno == EINTR )
+				{
+					continue;
+				}
+				return 1;
+			}
+			s->lst_Pos = 0;
+			s->lst_Len = (int)n;
+		}
+
+		int avail = s->lst_Len - s->lst_Pos;
+		int chunk = size < avail ? (int)size : avail;
+		if( dst != NULL )
+		{
+			memcpy( dst, s->lst_Buffer + s->lst_Pos, chunk );
+			dst += chunk;
+		}
+		s->lst_Pos += chunk;
+		size -= chunk;
+	}
+	return 0;
+}
+
+/**
+ * Read line terminated by CRLF from stream
+ *
+ * @param s pointer to stream
+ * @param line where line will be stored without CRLF
+ * @param size size of line buffer
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTStreamReadLine( LTStream *s, char *line, int size )
+{
+	int pos = 0;
+	while( TRUE )
+	{
+		char c;
+		if( LTStreamRead( s, &c, 1 ) != 0 )
+		{
+			return 1;
+		}
+		if( c == '\n' )
+		{
+			break;
+		}
+		if( pos < size - 1 )
+		{
+			line[ pos++ ] = c;
+		}
+	}
+	if( pos > 0 && line[ pos - 1 ] == '\r' )
+	{
+		pos--;
+	}
+	line[ pos ] = 0;
+	return 0;
+}
+
+/**
+ * Read HTTP response headers
+ *
+ * @param s pointer to stream
+ * @param status pointer to integer where status code will be stored
+ * @param contentLength pointer where Content-Length will be stored, -1 when missing
+ * @param chunked pointer where TRUE is stored when body uses chunked encoding
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTReadHeaders( LTStream *s, int *status, FQUAD *contentLength, FBOOL *chunked )
+{
+	char line[ 1024 ];
+
+	*status = 0;
+	*contentLength = -1;
+	*chunked = FALSE;
+
+	if( LTStreamReadLine( s, line, sizeof( line ) ) != 0 || strncmp( line, "HTTP/1.", 7 ) != 0 )
+	{
+		return 1;
+	}
+	*status = atoi( line + 9 );
+
+	while( TRUE )
+	{
+		if( LTStreamReadLine( s, line, sizeof( line ) ) != 0 )
+		{
+			return 1;
+		}
+		if( line[ 0 ] == 0 )
+		{
+			break;
+		}
+		if( strncasecmp( line, "Content-Length:", 15 ) == 0 )
+		{
+			*contentLength = strtoll( line + 15, NULL, 10 );
+		}
+		else if( strncasecmp( line, "Transfer-Encoding:", 18 ) == 0 && strstr( line + 18, "chunked" ) != NULL )
+		{
+			*chunked = TRUE;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Read HTTP response body
+ *
+ * @param s pointer to stream
+ * @param body BufString where body will be added
+ * @param contentLength Content-Length or -1 when body ends with connection
+ * @param chunked TRUE when body uses chunked encoding
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTReadBody( LTStream *s, BufString *body, FQUAD contentLength, FBOOL chunked )
+{
+	char buffer[ 4096 ];
+
+	if( chunked == TRUE )
+	{
+		while( TRUE )
+		{
+			char line[ 128 ];
+			if( LTStreamReadLine( s, line, sizeof( line ) ) != 0 )
+			{
+				return 1;
+			}
+			FQUAD size = strtoll( line, NULL, 16 );
+			if( size == 0 )
+			{
+				// trailer
+				do
+				{
+					if( LTStreamReadLine( s, line, sizeof( line ) ) != 0 )
+					{
+						return 0;
+					}
+				}while( line[ 0 ] != 0 );
+				return 0;
+			}
+			while( size > 0 )
+			{
+				int chunk = size < (FQUAD)sizeof( buffer ) ? (int)size : (int)sizeof( buffer );
+				if( LTStreamRead( s, buffer, chunk ) != 0 )
+				{
+					return 1;
+				}
+				BufStringAddSize( body, buffer, chunk );
+				size -= chunk;
+			}
+			if( LTStreamReadLine( s, line, sizeof( line ) ) != 0 )
+			{
+				return 1;
+			}
+		}
+	}
+	else if( contentLength >= 0 )
+	{
+		while( contentLength > 0 )
+		{
+			int chunk = contentLength < (FQUAD)sizeof( buffer ) ? (int)contentLength : (int)sizeof( buffer );
+			if( LTStreamRead( s, buffer, chunk ) != 0 )
+			{
+				return 1;
+			}
+			BufStringAddSize( body, buffer, chunk );
+			contentLength -= chunk;
+		}
+	}
+	else
+	{
+		// body ends when server close connection
+		if( s->lst_Pos < s->lst_Len )
+		{
+			BufStringAddSize( body, s->lst_Buffer + s->lst_Pos, s->lst_Len - s->lst_Pos );
+			s->lst_Pos = s->lst_Len;
+		}
+		while( TRUE )
+		{
+			ssize_t n = recv( s->lst_Socket, buffer, sizeof( buffer ), 0 );
+			if( n < 0 && errno == EINTR )
+			{
+				continue;
+			}
+			if( n <= 0 )
+			{
+				break;
+			}
+			BufStringAddSize( body, buffer, (int)n );
+		}
+	}
+	return 0;
+}
+
+/**
+ * Make HTTP request, FriendCore closes connection after every response
+ *
+ * @param method HTTP method
+ * @param path request path
+ * @param body form encoded body or NULL
+ * @param response BufString where response body will be added
+ * @return HTTP status or -1 when error appear
+ */
+
+static int LTHttpRequest( const char *method, const char *path, const char *body, BufString *response )
+{
+	LTStream *s = FMalloc( sizeof( LTStream ) );
+	if( s == NULL )
+	{
+		return -1;
+	}
+	s->lst_Pos = s->lst_Len = 0;
+
+	if( ( s->lst_Socket = LTConnect( &ltHTTPAddr ) ) < 0 )
+	{
+		FFree( s );
+		return -1;
+	}
+
+	struct timeval tv = { LT_REQUEST_TIMEOUT_S, 0 };
+	setsockopt( s->lst_Socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+
+	int bodySize = body != NULL ? strlen( body ) : 0;
+	int headerSize = strlen( path ) + strlen( ltHost ) + 256;
+	char *request = FMalloc( headerSize + bodySize );
+	int status = -1;
+
+	if( request != NULL )
+	{
+		int len;
+		if( body != NULL )
+		{
+			len = snprintf( request, headerSize, "%s %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: close\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: %d\r\n\r\n", method, path, ltHost, ltHTTPPort, bodySize );
+			memcpy( request + len, body, bodySize );
+			len += bodySize;
+		}
+		else
+		{
+			len = snprintf( request, headerSize, "%s %s HTTP/1.1\r\nHost: %s:%d\r\nConnection: close\r\n\r\n", method, path, ltHost, ltHTTPPort );
+		}
+
+		if( LTWriteAll( s->lst_Socket, request, len ) == 0 )
+		{
+			FQUAD contentLength;
+			FBOOL chunked;
+			int code;
+
+			if( LTReadHeaders( s, &code, &contentLength, &chunked ) == 0 && LTReadBody( s, response, contentLength, chunked ) == 0 )
+			{
+				status = code;
+			}
+		}
+		FFree( request );
+	}
+
+	close( s->lst_Socket );
+	FFree( s );
+	return status;
+}
+
+/**
+ * Call system.library function over HTTP
+ *
+ * @param sessionID session id, NULL when call is done without session
+ * @param function function path after system.library/
+ * @param args additional form encoded arguments or NULL
+ * @param response BufString where response will be added
+ * @return 0 when call succeeded, otherwise error number
+ */
+
+static int LTSystemCall( const char *sessionID, const char *function, const char *args, BufString *response )
+{
+	char path[ 256 ];
+	int argsSize = args != NULL ? strlen( args ) : 0;
+	char *body = FMalloc( argsSize + LT_SESSION_ID_SIZE + 32 );
+	if( body == NULL )
+	{
+		return 1;
+	}
+
+	snprintf( path, sizeof( path ), "/system.library/%s", function );
+	if( sessionID != NULL )
+	{
+		sprintf( body, "sessionid=%s%s%s", sessionID, args != NULL ? "&" : "", args != NULL ? args : "" );
+	}
+	else
+	{
+		strcpy( body, args != NULL ? args : "" );
+	}
+
+	int status = LTHttpRequest( "POST", path, body, response );
+	FFree( body );
+
+	if( status != 200 || response->bs_Size == 0 || strncmp( response->bs_Buffer, "fail<!--separate-->", 19 ) == 0 )
+	{
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Find string value of JSON key with simple scan, enough for FriendCore answers
+ *
+ * @param json JSON string
+ * @param key key name
+ * @param dst where value will be stored
+ * @param size size of destination buffer
+ * @return 0 when value was found, otherwise error number
+ */
+
+static int LTJSONValue( const char *json, const char *key, char *dst, int size )
+{
+	char pattern[ 64 ];
+	snprintf( pattern, sizeof( pattern ), "\"%s\"", key );
+
+	const char *start = strstr( json, pattern );
+	if( start == NULL )
+	{
+		return 1;
+	}
+	start += strlen( pattern );
+
+	// FriendCore puts spaces around colon in some answers
+	while( *start == ' ' ) start++;
+	if( *start++ != ':' )
+	{
+		return 1;
+	}
+	while( *start == ' ' ) start++;
+	if( *start++ != '"' )
+	{
+		return 1;
+	}
+
+	const char *end = strchr( start, '"' );
+	if( end == NULL || end - start >= size )
+	{
+		return 1;
+	}
+	memcpy( dst, start, end - start );
+	dst[ end - start ] = 0;
+	return 0;
+}
+
+/**
+ * Login user, password is sent hashed in same way as workspace do it
+ *
+ * @param name user name
+ * @param password plain password
+ * @param deviceid device identity
+ * @param sessionID where session id will be stored, LT_SESSION_ID_SIZE bytes
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTLogin( const char *name, const char *password, const char *deviceid, char *sessionID )
+{
+	FCSHA256_CTX ctx;
+	unsigned char hash[ 32 ];
+	char args[ 512 ];
+	int i, pos;
+
+	Sha256Init( &ctx );
+	Sha256Update( &ctx, (unsigned char *)password, (unsigned int)strlen( password ) );
+	Sha256Final( &ctx, hash );
+
+	pos = snprintf( args, sizeof( args ), "username=%s&deviceid=%s&password=HASHED", name, deviceid );
+	for( i = 0 ; i < 32 ; i++ )
+	{
+		pos += sprintf( args + pos, "%02x", hash[ i ] );
+	}
+
+	BufString *bs = BufStringNew();
+	int error = LTSystemCall( NULL, "login", args, bs );
+	if( error == 0 )
+	{
+		char result[ 16 ];
+		if( LTJSONValue( bs->bs_Buffer, "sessionid", sessionID, LT_SESSION_ID_SIZE ) != 0 || sessionID[ 0 ] == 0 ||
+			( LTJSONValue( bs->bs_Buffer, "result", result, sizeof( result ) ) == 0 && atoi( result ) != 0 ) )
+		{
+			error = 2;
+		}
+	}
+	BufStringDelete( bs );
+	return error;
+}
+
+/**
+ * Send websocket text frame, client frames are masked
+ *
+ * @param usr user which connection is used
+ * @param data message
+ * @param size size of message
+ * @param opcode websocket opcode
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTWSSend( LTUser *usr, const char *data, int size, int opcode )
+{
+	char *frame = FMalloc( size + 14 );
+	if( frame == NULL )
+	{
+		return 1;
+	}
+
+	int pos = 0, i;
+	frame[ pos++ ] = (char)( 0x80 | opcode );
+	if( size < 126 )
+	{
+		frame[ pos++ ] = (char)( 0x80 | size );
+	}
+	else if( size < 65536 )
+	{
+		frame[ pos++ ] = (char)( 0x80 | 126 );
+		frame[ pos++ ] = (char)( size >> 8 );
+		frame[ pos++ ] = (char)( size & 0xFF );
+	}
+	else
+	{
+		frame[ pos++ ] = (char)( 0x80 | 127 );
+		for( i = 7 ; i >= 0 ; i-- )
+		{
+			frame[ pos++ ] = (char)( ( (FUQUAD)size >> ( i * 8 ) ) & 0xFF );
+		}
+	}
+
+	unsigned int mask = (unsigned int)rand_r( &usr->lu_Seed );
+	unsigned char *maskBytes = (unsigned char *)( frame + pos );
+	memcpy( frame + pos, &mask, 4 );
+	pos += 4;
+
+	for( i = 0 ; i < size ; i++ )
+	{
+		frame[ pos + i ] = data[ i ] ^ maskBytes[ i & 3 ];
+	}
+
+	pthread_mutex_lock( &usr->lu_Mutex );
+	int error = LTWriteAll( usr->lu_WS.lst_Socket, frame, pos + size );
+	pthread_mutex_unlock( &usr->lu_Mutex );
+
+	FFree( frame );
+	return error;
+}
+
+/**
+ * Read one websocket message, fragments are joined
+ *
+ * @param usr user which connection is used
+ * @param msg BufString where message will be added
+ * @return opcode of message or -1 when connection failed
+ */
+
+static int LTWSRead( LTUser *usr, BufString *msg )
+{
+	int opcode = -1;
+
+	while( TRUE )
+	{
+		unsigned char hdr[ 2 ];
+		if( LTStreamRead( &usr->lu_WS, (char *)hdr, 2 ) != 0 )
+		{
+			return -1;
+		}
+
+		FUQUAD size = hdr[ 1 ] & 0x7F;
+		if( size == 126 || size == 127 )
+		{
+			unsigned char ext[ 8 ];
+			int extSize = size == 126 ? 2 : 8, i;
+			if( LTStreamRead( &usr->lu_WS, (char *)ext, extSize ) != 0 )
+			{
+				return -1;
+			}
+			size = 0;
+			for( i = 0 ; i < extSize ; i++ )
+			{
+				size = ( size << 8 ) | ext[ i ];
+			}
+		}
+
+		unsigned char mask[ 4 ] = { 0, 0, 0, 0 };
+		if( hdr[ 1 ] & 0x80 )
+		{
+			if( LTStreamRead( &usr->lu_WS, (char *)mask, 4 ) != 0 )
+			{
+				return -1;
+			}
+		}
+
+		int frameOpcode = hdr[ 0 ] & 0x0F;
+		int start = msg->bs_Size;
+		FUQUAD left = size;
+		char buffer[ 4096 ];
+
+		while( left > 0 )
+		{
+			int chunk = left < sizeof( buffer ) ? (int)left : (int)sizeof( buffer );
+			if( LTStreamRead( &usr->lu_WS, buffer, chunk ) != 0 )
+			{
+				return -1;
+			}
+			BufStringAddSize( msg, buffer, chunk );
+			left -= chunk;
+		}
+
+		if( hdr[ 1 ] & 0x80 )
+		{
+			FUQUAD i;
+			for( i = 0 ; i < size ; i++ )
+			{
+				msg->bs_Buffer[ start + i ] ^= mask[ i & 3 ];
+			}
+		}
+
+		// control frames can come between fragments
+		if( frameOpcode >= 0x8 )
+		{
+			if( frameOpcode == 0x9 )
+			{
+				LTWSSend( usr, msg->bs_Buffer + start, (int)size, 0xA );
+			}
+			else if( frameOpcode == 0x8 )
+			{
+				return 0x8;
+			}
+			msg->bs_Size = start;
+			continue;
+		}
+
+		if( frameOpcode != 0 )
+		{
+			opcode = frameOpcode;
+		}
+		if( hdr[ 0 ] & 0x80 )
+		{
+			break;
+		}
+	}
+	return opcode;
+}
+
+/**
+ * Open websocket connection and attach it to user session
+ *
+ * @param usr user
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTWSConnect( LTUser *usr )
+{
+	unsigned char key[ 16 ];
+	char request[ 512 ];
+	char line[ 1024 ];
+	int i;
+
+	usr->lu_WS.lst_Pos = usr->lu_WS.lst_Len = 0;
+	if( ( usr->lu_WS.lst_Socket = LTConnect( &ltWSAddr ) ) < 0 )
+	{
+		return 1;
+	}
+	usr->lu_WSConnected = TRUE;
+
+	for( i = 0 ; i < 16 ; i++ )
+	{
+		key[ i ] = (unsigned char)rand_r( &usr->lu_Seed );
+	}
+	char *encodedKey = Base64Encode( key, 16 );
+	if( encodedKey == NULL )
+	{
+		return 2;
+	}
+
+	int len = snprintf( request, sizeof( request ), "GET / HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\nSec-WebSocket-Protocol: FC-protocol\r\n\r\n", ltHost, ltWSPort, encodedKey );
+	FFree( encodedKey );
+
+	if( LTWriteAll( usr->lu_WS.lst_Socket, request, len ) != 0 )
+	{
+		return 3;
+	}
+
+	if( LTStreamReadLine( &usr->lu_WS, line, sizeof( line ) ) != 0 || strstr( line, " 101" ) == NULL )
+	{
+		return 4;
+	}
+	do
+	{
+		if( LTStreamReadLine( &usr->lu_WS, line, sizeof( line ) ) != 0 )
+		{
+			return 5;
+		}
+	}while( line[ 0 ] != 0 );
+
+	// attach connection to session, server answers with pong
+	len = snprintf( request, sizeof( request ), "{\"type\":\"con\",\"data\":{\"sessionId\":\"%s\"}}", usr->lu_SessionID );
+	if( LTWSSend( usr, request, len, 0x1 ) != 0 )
+	{
+		return 6;
+	}
+
+	struct timeval tv = { LT_REQUEST_TIMEOUT_S, 0 };
+	setsockopt( usr->lu_WS.lst_Socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+
+	int error = 7;
+	BufString *msg = BufStringNew();
+	while( LTWSRead( usr, msg ) == 0x1 )
+	{
+		BufStringAddSize( msg, "", 1 );
+		if( strstr( msg->bs_Buffer, "pong" ) != NULL )
+		{
+			error = 0;
+			break;
+		}
+		msg->bs_Size = 0;
+	}
+	BufStringDelete( msg );
+
+	// reader thread waits for broadcasts as long as test runs
+	tv.tv_sec = 0;
+	setsockopt( usr->lu_WS.lst_Socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof( tv ) );
+
+	return error;
+}
+
+/**
+ * Websocket reader thread, wakes up waiting requests and measures broadcasts
+ *
+ * @param arg pointer to LTUser
+ * @return NULL
+ */
+
+static void *LTWSReader( void *arg )
+{
+	LTUser *usr = (LTUser *)arg;
+	BufString *msg = BufStringNew();
+
+	while( TRUE )
+	{
+		msg->bs_Size = 0;
+		int opcode = LTWSRead( usr, msg );
+		if( opcode < 0 || opcode == 0x8 )
+		{
+			break;
+		}
+		BufStringAddSize( msg, "", 1 );
+
+		if( strstr( msg->bs_Buffer, "\"server-notice\"" ) != NULL )
+		{
+			// message is "lt<nanoseconds>" set by broadcast sender
+			char value[ 64 ];
+			if( LTJSONValue( msg->bs_Buffer, "message", value, sizeof( value ) ) == 0 && value[ 0 ] == 'l' && value[ 1 ] == 't' )
+			{
+				LTRecord( &usr->lu_Samples[ LT_ROUTE_WS_BROADCAST ], strtoll( value + 2, NULL, 10 ), FALSE );
+			}
+		}
+		else if( strstr( msg->bs_Buffer, "\"response\"" ) != NULL )
+		{
+			char requestID[ LT_REQUEST_ID_SIZE ];
+			if( LTJSONValue( msg->bs_Buffer, "requestid", requestID, sizeof( requestID ) ) == 0 )
+			{
+				pthread_mutex_lock( &usr->lu_Mutex );
+				if( strcmp( requestID, usr->lu_WaitID ) == 0 && usr->lu_WaitResult == 0 )
+				{
+					usr->lu_WaitResult = strstr( msg->bs_Buffer, "\"data\":\"fail" ) == NULL ? 1 : -1;
+					pthread_cond_signal( &usr->lu_Cond );
+				}
+				pthread_mutex_unlock( &usr->lu_Mutex );
+			}
+		}
+	}
+
+	// wake up request which waits for answer
+	pthread_mutex_lock( &usr->lu_Mutex );
+	if( usr->lu_WaitResult == 0 )
+	{
+		usr->lu_WaitResult = -1;
+		pthread_cond_signal( &usr->lu_Cond );
+	}
+	usr->lu_WSConnected = FALSE;
+	pthread_mutex_unlock( &usr->lu_Mutex );
+
+	BufStringDelete( msg );
+	return NULL;
+}
+
+/**
+ * Call system.library function over websocket and wait for response
+ *
+ * @param usr user
+ * @param function function path after system.library/
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTWSRequest( LTUser *usr, const char *function )
+{
+	char request[ 512 ];
+	struct timespec deadline;
+
+	pthread_mutex_lock( &usr->lu_Mutex );
+	if( usr->lu_WSConnected == FALSE )
+	{
+		pthread_mutex_unlock( &usr->lu_Mutex );
+		return 1;
+	}
+	snprintf( usr->lu_WaitID, sizeof( usr->lu_WaitID ), "lt%d_%lld", usr->lu_Index, usr->lu_RequestCounter++ );
+	usr->lu_WaitResult = 0;
+	pthread_mutex_unlock( &usr->lu_Mutex );
+
+	int len = snprintf( request, sizeof( request ), "{\"type\":\"msg\",\"data\":{\"type\":\"request\",\"requestid\":\"%s\",\"path\":\"system.library/%s\"}}", usr->lu_WaitID, function );
+	if( LTWSSend( usr, request, len, 0x1 ) != 0 )
+	{
+		return 2;
+	}
+
+	clock_gettime( CLOCK_REALTIME, &deadline );
+	deadline.tv_sec += LT_REQUEST_TIMEOUT_S;
+
+	pthread_mutex_lock( &usr->lu_Mutex );
+	while( usr->lu_WaitResult == 0 )
+	{
+		if( pthread_cond_timedwait( &usr->lu_Cond, &usr->lu_Mutex, &deadline ) == ETIMEDOUT )
+		{
+			break;
+		}
+	}
+	int result = usr->lu_WaitResult;
+	usr->lu_WaitID[ 0 ] = 0;
+	pthread_mutex_unlock( &usr->lu_Mutex );
+
+	return result == 1 ? 0 : 3;
+}
+
+/**
+ * Write or read test file on user door
+ *
+ * @param usr user
+ * @param device door name
+ * @param write TRUE when file should be written
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTDoorIO( LTUser *usr, const char *device, FBOOL write )
+{
+	BufString *bs = BufStringNew();
+	char *args = FMalloc( ltFileSize + 256 );
+	int error = 1;
+
+	if( args != NULL )
+	{
+		if( write == TRUE )
+		{
+			sprintf( args, "path=%s%%3Aloadtest.txt&mode=w&data=%s", device, ltFileData );
+			if( ( error = LTSystemCall( usr->lu_SessionID, "file/write", args, bs ) ) == 0 && strstr( bs->bs_Buffer, "FileDataStored" ) == NULL )
+			{
+				error = 2;
+			}
+		}
+		else
+		{
+			sprintf( args, "path=%s%%3Aloadtest.txt&mode=r", device );
+			if( ( error = LTSystemCall( usr->lu_SessionID, "file/read", args, bs ) ) == 0 && bs->bs_Size < ltFileSize )
+			{
+				error = 2;
+			}
+		}
+		FFree( args );
+	}
+
+	BufStringDelete( bs );
+	return error;
+}
+
+/**
+ * Run one route
+ *
+ * @param usr user
+ * @param route route number
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTRunRoute( LTUser *usr, int route )
+{
+	BufString *bs;
+	int error = 0;
+
+	switch( route )
+	{
+		case LT_ROUTE_HELP:
+		case LT_ROUTE_DEVICE_LIST:
+		case LT_ROUTE_APP_LIST:
+			bs = BufStringNew();
+			error = LTSystemCall( usr->lu_SessionID, route == LT_ROUTE_HELP ? "help" : ( route == LT_ROUTE_DEVICE_LIST ? "device/list" : "app/list" ), NULL, bs );
+			BufStringDelete( bs );
+			break;
+
+		case LT_ROUTE_STATIC:
+			bs = BufStringNew();
+			error = LTHttpRequest( "GET", "/webclient/index.html", NULL, bs ) != 200 || bs->bs_Size == 0;
+			BufStringDelete( bs );
+			break;
+
+		case LT_ROUTE_WS_REQUEST:
+			error = LTWSRequest( usr, "help" );
+			break;
+
+		case LT_ROUTE_LOCAL_WRITE:
+		case LT_ROUTE_LOCAL_READ:
+			error = LTDoorIO( usr, "BenchLocal", route == LT_ROUTE_LOCAL_WRITE );
+			break;
+
+		case LT_ROUTE_INRAM_WRITE:
+		case LT_ROUTE_INRAM_READ:
+			error = LTDoorIO( usr, "BenchRAM", route == LT_ROUTE_INRAM_WRITE );
+			break;
+
+		default:
+			error = 1;
+			break;
+	}
+	return error;
+}
+
+/**
+ * Synthetic user thread
+ *
+ * @param arg pointer to LTUser
+ * @return NULL
+ */
+
+static void *LTUserThread( void *arg )
+{
+	LTUser *usr = (LTUser *)arg;
+	char deviceid[ 64 ];
+	FQUAD start;
+	int error;
+
+	snprintf( deviceid, sizeof( deviceid ), "loadtest-%d", usr->lu_Index );
+
+	start = LTNow();
+	error = LTLogin( usr->lu_Name, ltPassword, deviceid, usr->lu_SessionID );
+	LTRecord( &usr->lu_Samples[ LT_ROUTE_LOGIN ], start, error != 0 );
+
+	if( error != 0 )
+	{
+		fprintf( stderr, "User %s cannot login, error %d\n", usr->lu_Name, error );
+	}
+	else if( ( error = LTWSConnect( usr ) ) != 0 )
+	{
+		fprintf( stderr, "User %s cannot open websocket connection, error %d\n", usr->lu_Name, error );
+	}
+	else if( pthread_create( &usr->lu_ReaderThread, NULL, LTWSReader, usr ) == 0 )
+	{
+		usr->lu_ReaderStarted = TRUE;
+
+		// files must exist before they are read
+		if( ( error = LTDoorIO( usr, "BenchLocal", TRUE ) ) != 0 || ( error = LTDoorIO( usr, "BenchRAM", TRUE ) ) != 0 )
+		{
+			fprintf( stderr, "User %s cannot write files on doors, error %d\n", usr->lu_Name, error );
+		}
+		else
+		{
+			usr->lu_Ready = TRUE;
+		}
+	}
+
+	pthread_barrier_wait( &ltStartBarrier );
+
+	while( usr->lu_Ready == TRUE && ltRunning )
+	{
+		int pick = rand_r( &usr->lu_Seed ) % ltRouteWeightSum;
+		int route = 0;
+		while( pick >= ltRoutes[ route ].lr_Weight )
+		{
+			pick -= ltRoutes[ route ].lr_Weight;
+			route++;
+		}
+
+		start = LTNow();
+		error = LTRunRoute( usr, route );
+		if( ltRunning )
+		{
+			LTRecord( &usr->lu_Samples[ route ], start, error != 0 );
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Send broadcasts as admin until test ends
+ *
+ * @param sessionID admin session id
+ * @param end time when test ends, from LTNow
+ * @param samples samples of servermessage route
+ */
+
+static void LTBroadcast( const char *sessionID, FQUAD end, LTSamples *samples )
+{
+	while( LTNow() < end )
+	{
+		char args[ 64 ];
+		FQUAD start = LTNow();
+		BufString *bs = BufStringNew();
+
+		snprintf( args, sizeof( args ), "message=lt%lld", start );
+		int error = LTSystemCall( sessionID, "admin/servermessage", args, bs );
+		LTRecord( samples, start, error != 0 || strstr( bs->bs_Buffer, "access denied" ) != NULL );
+		BufStringDelete( bs );
+
+		FQUAD next = start + (FQUAD)ltBroadcastMs * 1000000LL;
+		FQUAD now = LTNow();
+		if( next > end )
+		{
+			next = end;
+		}
+		if( next > now )
+		{
+			struct timespec ts = { ( next - now ) / 1000000000LL, ( next - now ) % 1000000000LL };
+			nanosleep( &ts, NULL );
+		}
+	}
+}
+
+/**
+ * Store Prometheus metrics of FriendCore to file
+ *
+ * @param sessionID admin session id
+ * @return 0 when success, otherwise error number
+ */
+
+static int LTStoreMetrics( const char *sessionID )
+{
+	BufString *bs = BufStringNew();
+	int error = LTSystemCall( sessionID, "admin/metrics", NULL, bs );
+	if( error == 0 )
+	{
+		FILE *fp = fopen( ltMetricsFile, "w" );
+		if( fp != NULL )
+		{
+			fwrite( bs->bs_Buffer, 1, bs->bs_Size, fp );
+			fclose( fp );
+		}
+		else
+		{
+			error = 2;
+		}
+	}
+	BufStringDelete( bs );
+	return error;
+}
+
+//
+// Sort helper
+//
+
+static int LTCompare( const void *a, const void *b )
+{
+	unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+	return x < y ? -1 : ( x > y ? 1 : 0 );
+}
+
+/**
+ * Get percentile from sorted samples, nearest rank
+ *
+ * @param ls sorted samples
+ * @param p percentile 0..1
+ * @return latency in milliseconds
+ */
+
+static double LTPercentile( LTSamples *ls, double p )
+{
+	if( ls->ls_Count == 0 )
+	{
+		return 0.0;
+	}
+	FQUAD rank = (FQUAD)( p * (double)ls->ls_Count + 0.999999 );
+	if( rank < 1 )
+	{
+		rank = 1;
+	}
+	if( rank > ls->ls_Count )
+	{
+		rank = ls->ls_Count;
+	}
+	return (double)ls->ls_Data[ rank - 1 ] / 1000.0;
+}
+
+/**
+ * Merge samples of all users and print report
+ *
+ * @param users array of users
+ * @param admin samples of admin routes
+ * @param seconds measured time in seconds
+ */
+
+static void LTReport( LTUser *users, LTSamples *admin, double seconds )
+{
+	FQUAD totalRequests = 0, totalErrors = 0;
+	int route, i;
+
+	for( route = 0 ; route < LT_ROUTE_MAX ; route++ )
+	{
+		LTSamples all;
+		memset( &all, 0, sizeof( all ) );
+
+		for( i = 0 ; i <= ltUsers ; i++ )
+		{
+			LTSamples *ls = i < ltUsers ? &users[ i ].lu_Samples[ route ] : &admin[ route ];
+			all.ls_Errors += ls->ls_Errors;
+			if( ls->ls_Count > 0 )
+			{
+				unsigned int *data = realloc( all.ls_Data, ( all.ls_Count + ls->ls_Count ) * sizeof( unsigned int ) );
+				if( data == NULL )
+				{
+					continue;
+				}
+				all.ls_Data = data;
+				memcpy( all.ls_Data + all.ls_Count, ls->ls_Data, ls->ls_Count * sizeof( unsigned int ) );
+				all.ls_Count += ls->ls_Count;
+			}
+		}
+
+		if( all.ls_Count == 0 && all.ls_Errors == 0 )
+		{
+			continue;
+		}
+
+		qsort( all.ls_Data, all.ls_Count, sizeof( unsigned int ), LTCompare );
+
+		// logins are done before measured time
+		printf( "{\"route\":\"%s\",\"requests\":%lld,\"errors\":%lld,\"rps\":%.2f,\"p50_ms\":%.3f,\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}\n",
+			ltRoutes[ route ].lr_Name, all.ls_Count, all.ls_Errors, route == LT_ROUTE_LOGIN ? 0.0 : (double)all.ls_Count / seconds,
+			LTPercentile( &all, 0.50 ), LTPercentile( &all, 0.90 ), LTPercentile( &all, 0.99 ), LTPercentile( &all, 1.0 ) );
+
+		if( route != LT_ROUTE_LOGIN && route != LT_ROUTE_WS_BROADCAST )
+		{
+			totalRequests += all.ls_Count;
+			totalErrors += all.ls_Errors;
+		}
+		FFree( all.ls_Data );
+	}
+
+	printf( "{\"summary\":\"loadtest\",\"users\":%d,\"seconds\":%.1f,\"requests\":%lld,\"errors\":%lld,\"rps\":%.2f}\n",
+		ltUsers, seconds, totalRequests, totalErrors, (double)totalRequests / seconds );
+	fflush( stdout );
+}
+
+/**
+ * Print usage
+ *
+ * @param name program name
+ */
+
+static void LTUsage( const char *name )
+{
+	fprintf( stderr, "Usage: %s [-H host] [-p http_port] [-w ws_port] [-n users] [-u user_prefix] [-P password]\n"
+		"          [-d seconds] [-s file_size] [-b broadcast_ms] [-A admin_name] [-a admin_password] [-M metrics_file]\n", name );
+	exit( 1 );
+}
+
+/**
+ * Load test entry
+ *
+ * @param argc number of arguments
+ * @param argv arguments
+ * @return 0 when success, otherwise error number
+ */
+
+int main( int argc, char **argv )
+{
+	char adminSession[ LT_SESSION_ID_SIZE ];
+	LTSamples adminSamples[ LT_ROUTE_MAX ];
+	int i, opt;
+
+	while( ( opt = getopt( argc, argv, "H:p:w:n:u:P:d:s:b:A:a:M:" ) ) != -1 )
+	{
+		switch( opt )
+		{
+			case 'H': ltHost = optarg; break;
+			case 'p': ltHTTPPort = atoi( optarg ); break;
+			case 'w': ltWSPort = atoi( optarg ); break;
+			case 'n': ltUsers = atoi( optarg ); break;
+			case 'u': ltUserPrefix = optarg; break;
+			case 'P': ltPassword = optarg; break;
+			case 'd': ltDuration = atoi( optarg ); break;
+			case 's': ltFileSize = atoi( optarg ); break;
+			case 'b': ltBroadcastMs = atoi( optarg ); break;
+			case 'A': ltAdminName = optarg; break;
+			case 'a': ltAdminPassword = optarg; break;
+			case 'M': ltMetricsFile = optarg; break;
+			default: LTUsage( argv[ 0 ] );
+		}
+	}
+
+	if( ltUsers <= 0 || ltDuration <= 0 || ltFileSize <= 0 || ltBroadcastMs <= 0 || ( ltAdminName != NULL && ltAdminPassword == NULL ) )
+	{
+		LTUsage( argv[ 0 ] );
+	}
+
+	if( LTResolve( ltHost, ltHTTPPort, &ltHTTPAddr, &ltAddrLen ) != 0 || LTResolve( ltHost, ltWSPort, &ltWSAddr, &ltAddrLen ) != 0 )
+	{
+		fprintf( stderr, "Cannot resolve %s\n", ltHost );
+		return 1;
+	}
+
+	// file content is url safe, so it is sent without encoding
+	if( ( ltFileData = FMalloc( ltFileSize + 1 ) ) == NULL )
+	{
+		return 1;
+	}
+	for( i = 0 ; i < ltFileSize ; i++ )
+	{
+		ltFileData[ i ] = 'a' + ( i % 26 );
+	}
+	ltFileData[ ltFileSize ] = 0;
+
+	for( i = 0 ; i < LT_ROUTE_MAX ; i++ )
+	{
+		ltRouteWeightSum += ltRoutes[ i ].lr_Weight;
+	}
+
+	memset( adminSamples, 0, sizeof( adminSamples ) );
+	adminSession[ 0 ] = 0;
+	if( ltAdminName != NULL )
+	{
+		FQUAD start = LTNow();
+		int error = LTLogin( ltAdminName, ltAdminPassword, "loadtest-admin", adminSession );
+		LTRecord( &adminSamples[ LT_ROUTE_LOGIN ], start, error != 0 );
+		if( error != 0 )
+		{
+			fprintf( stderr, "Admin %s cannot login, error %d\n", ltAdminName, error );
+			return 1;
+		}
+	}
+
+	LTUser *users = FCalloc( ltUsers, sizeof( LTUser ) );
+	if( users == NULL )
+	{
+		return 1;
+	}
+
+	pthread_barrier_init( &ltStartBarrier, NULL, ltUsers + 1 );
+
+	for( i = 0 ; i < ltUsers ; i++ )
+	{
+		LTUser *usr = &users[ i ];
+		usr->lu_Index = i + 1;
+		usr->lu_Seed = (unsigned int)( time( NULL ) ^ ( i * 2654435761U ) );
+		usr->lu_WS.lst_Socket = -1;
+		snprintf( usr->lu_Name, sizeof( usr->lu_Name ), "%s%d", ltUserPrefix, i + 1 );
+		pthread_mutex_init( &usr->lu_Mutex, NULL );
+		pthread_cond_init( &usr->lu_Cond, NULL );
+
+		if( pthread_create( &usr->lu_Thread, NULL, LTUserThread, usr ) != 0 )
+		{
+			fprintf( stderr, "Cannot create thread for user %d\n", i + 1 );
+			return 1;
+		}
+	}
+
+	// all users are logged in and connected
+	pthread_barrier_wait( &ltStartBarrier );
+
+	FQUAD start = LTNow();
+	FQUAD end = start + (FQUAD)ltDuration * 1000000000LL;
+
+	if( adminSession[ 0 ] != 0 )
+	{
+		LTBroadcast( adminSession, end, &adminSamples[ LT_ROUTE_SERVER_MESSAGE ] );
+	}
+	else
+	{
+		struct timespec ts = { ltDuration, 0 };
+		while( nanosleep( &ts, &ts ) != 0 && errno == EINTR );
+	}
+
+	ltRunning = 0;
+	double seconds = (double)( LTNow() - start ) / 1000000000.0;
+
+	for( i = 0 ; i < ltUsers ; i++ )
+	{
+		pthread_join( users[ i ].lu_Thread, NULL );
+	}
+
+	// let last broadcasts arrive, then stop readers
+	usleep( 200000 );
+	for( i = 0 ; i < ltUsers ; i++ )
+	{
+		if( users[ i ].lu_WS.lst_Socket >= 0 )
+		{
+			shutdown( users[ i ].lu_WS.lst_Socket, SHUT_RDWR );
+		}
+		if( users[ i ].lu_ReaderStarted == TRUE )
+		{
+			pthread_join( users[ i ].lu_ReaderThread, NULL );
+		}
+		if( users[ i ].lu_WS.lst_Socket >= 0 )
+		{
+			close( users[ i ].lu_WS.lst_Socket );
+		}
+	}
+
+	LTReport( users, adminSamples, seconds );
+
+	int failed = 0;
+	for( i = 0 ; i < ltUsers ; i++ )
+	{
+		if( users[ i ].lu_Ready == FALSE )
+		{
+			failed++;
+		}
+	}
+	if( failed > 0 )
+	{
+		fprintf( stderr, "%d of %d users could not start\n", failed, ltUsers );
+	}
+
+	if( ltMetricsFile != NULL && adminSession[ 0 ] != 0 && LTStoreMetrics( adminSession ) != 0 )
+	{
+		fprintf( stderr, "Cannot store metrics in %s\n", ltMetricsFile );
+	}
+
+	for( i = 0 ; i < ltUsers ; i++ )
+	{
+		for( opt = 0 ; opt < LT_ROUTE_MAX ; opt++ )
+		{
+			FFree( users[ i ].lu_Samples[ opt ].ls_Data );
+		}
+		pthread_mutex_destroy( &users[ i ].lu_Mutex );
+		pthread_cond_destroy( &users[ i ].lu_Cond );
+	}
+	for( opt = 0 ; opt < LT_ROUTE_MAX ; opt++ )
+	{
+		FFree( adminSamples[ opt ].ls_Data );
+	}
+	FFree( users );
+	FFree( ltFileData );
+	pthread_barrier_destroy( &ltStartBarrier );
+
+	return failed > 0 ? 2 : 0;
+}
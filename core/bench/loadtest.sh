@@ -0,0 +1,271 @@
+#!/bin/bash
+#
+# End-to-end load test of FriendCore
+#
+# Starts throwaway MySQL/MariaDB server with fresh FriendMaster database,
+# creates synthetic users with Local and INRAM doors, starts FriendCore
+# installed in FRIEND_BUILD (make install) and runs bin/loadtest against it.
+# Everything is created in temporary directory which is removed at the end.
+#
+# Results directory is ignored by git, results are published by copying
+# loadtest.json into commit message or report, not by committing it.
+# It contains:
+#   loadtest.json    one JSON line per route (throughput, p50/p90/p99/max)
+#   metrics.prom     FriendCore metrics after the run (admin/metrics)
+#   friendcore.log   FriendCore output
+#   mysqld.log       database server output
+#
+# Settings (environment):
+#   FRIEND_BUILD     installed FriendCore, default ../../build
+#   LT_USERS         number of synthetic users, default 20
+#   LT_DURATION      measured time in seconds, default 30
+#   LT_HTTP_PORT     FriendCore HTTP port, default 16502
+#   LT_WS_PORT       FriendCore websocket port, default 16500
+#   LT_DB_PORT       database port, default 13306
+#   LT_RESULTS       results directory, default core/bench/results/loadtest-<date>
+#   LT_KEEP          1 keeps temporary directory for inspection
+#   LOADTEST_ARGS    additional arguments for bin/loadtest
+#
+
+set -e
+
+BENCH_DIR="$(cd "$(dirname "$0")" && pwd)"
+REPO_DIR="$(cd "$BENCH_DIR/../.." && pwd)"
+
+FRIEND_BUILD="$(cd "${FRIEND_BUILD:-$REPO_DIR/build}" 2>/dev/null && pwd)" || { echo "FRIEND_BUILD directory not found, run make install first"; exit 1; }
+LT_USERS=${LT_USERS:-20}
+LT_DURATION=${LT_DURATION:-30}
+LT_HTTP_PORT=${LT_HTTP_PORT:-16502}
+LT_WS_PORT=${LT_WS_PORT:-16500}
+LT_DB_PORT=${LT_DB_PORT:-13306}
+LT_RESULTS=${LT_RESULTS:-$BENCH_DIR/results/loadtest-$(date +%Y%m%d-%H%M%S)}
+
+LT_USER_PREFIX=loadtest
+LT_USER_PASSWORD=loadtest
+LT_ADMIN=fadmin
+LT_ADMIN_PASSWORD=securefassword		# default admin from FriendCoreDatabase.sql
+LT_DB_USER=friendload
+LT_DB_PASSWORD=friendload
+
+if [ ! -x "$FRIEND_BUILD/FriendCore" ]; then
+	echo "$FRIEND_BUILD/FriendCore not found, run make install first"
+	exit 1
+fi
+
+if [ ! -x "$BENCH_DIR/bin/loadtest" ]; then
+	echo "$BENCH_DIR/bin/loadtest not found, run make loadtest"
+	exit 1
+fi
+
+#
+# database server binaries, MariaDB or MySQL
+#
+
+find_binary()
+{
+	local name
+	for name in "$@"; do
+		if command -v "$name" >/dev/null 2>&1; then
+			command -v "$name"
+			return 0
+		fi
+		if [ -x "/usr/sbin/$name" ]; then
+			echo "/usr/sbin/$name"
+			return 0
+		fi
+	done
+	return 1
+}
+
+MYSQLD=$(find_binary mariadbd mysqld) || { echo "mysqld or mariadbd not found"; exit 1; }
+MYSQL=$(find_binary mariadb mysql) || { echo "mysql client not found"; exit 1; }
+MYSQLADMIN=$(find_binary mariadb-admin mysqladmin) || { echo "mysqladmin not found"; exit 1; }
+
+mkdir -p "$LT_RESULTS"
+LT_RESULTS="$(cd "$LT_RESULTS" && pwd)"
+TMP_DIR=$(mktemp -d "${TMPDIR:-/tmp}/friendloadtest.XXXXXX")
+DATA_DIR="$TMP_DIR/mysql"
+DB_SOCKET="$TMP_DIR/mysql.sock"
+FC_HOME="$TMP_DIR/friend"
+DOORS_DIR="$TMP_DIR/doors"
+MYSQLD_PID=""
+FC_PID=""
+
+cleanup()
+{
+	if [ -n "$FC_PID" ] && kill -0 "$FC_PID" 2>/dev/null; then
+		kill -INT "$FC_PID" 2>/dev/null || true
+		for i in $(seq 1 20); do
+			kill -0 "$FC_PID" 2>/dev/null || break
+			sleep 0.5
+		done
+		kill -9 "$FC_PID" 2>/dev/null || true
+	fi
+	if [ -n "$MYSQLD_PID" ] && kill -0 "$MYSQLD_PID" 2>/dev/null; then
+		"$MYSQLADMIN" --no-defaults --socket="$DB_SOCKET" -uroot shutdown >/dev/null 2>&1 || kill "$MYSQLD_PID" 2>/dev/null || true
+		wait "$MYSQLD_PID" 2>/dev/null || true
+	fi
+	if [ "$LT_KEEP" = "1" ]; then
+		echo "Temporary files kept in $TMP_DIR"
+	else
+		rm -rf "$TMP_DIR"
+	fi
+}
+trap cleanup EXIT
+
+wait_for_port()
+{
+	local port=$1 pid=$2 i
+	for i in $(seq 1 120); do
+		if (exec 3<>"/dev/tcp/127.0.0.1/$port") 2>/dev/null; then
+			return 0
+		fi
+		if ! kill -0 "$pid" 2>/dev/null; then
+			return 1
+		fi
+		sleep 0.5
+	done
+	return 1
+}
+
+#
+# throwaway database server
+#
+
+echo "Starting database server in $DATA_DIR"
+
+MYSQLD_USER=""
+if [ "$(id -u)" = "0" ]; then
+	MYSQLD_USER="--user=root"
+fi
+
+mkdir -p "$DATA_DIR"
+if "$MYSQLD" --version 2>/dev/null | grep -qi mariadb; then
+	INSTALL_DB=$(find_binary mariadb-install-db mysql_install_db) || { echo "mariadb-install-db not found"; exit 1; }
+	"$INSTALL_DB" --no-defaults $MYSQLD_USER --datadir="$DATA_DIR" --auth-root-authentication-method=normal > "$LT_RESULTS/mysqld.log" 2>&1
+	MYSQLD_ARGS=""
+else
+	"$MYSQLD" --no-defaults $MYSQLD_USER --initialize-insecure --datadir="$DATA_DIR" > "$LT_RESULTS/mysqld.log" 2>&1
+	# MySQL 8 writes binary log by default
+	MYSQLD_ARGS="--skip-log-bin"
+fi
+
+# FriendCore queries and schema rely on non strict sql mode
+"$MYSQLD" --no-defaults $MYSQLD_USER --datadir="$DATA_DIR" --socket="$DB_SOCKET" --port="$LT_DB_PORT" \
+	--bind-address=127.0.0.1 --pid-file="$TMP_DIR/mysqld.pid" --sql-mode="" $MYSQLD_ARGS \
+	--max-connections=500 >> "$LT_RESULTS/mysqld.log" 2>&1 &
+MYSQLD_PID=$!
+
+for i in $(seq 1 120); do
+	"$MYSQLADMIN" --no-defaults --socket="$DB_SOCKET" -uroot ping >/dev/null 2>&1 && break
+	if ! kill -0 "$MYSQLD_PID" 2>/dev/null || [ "$i" = "120" ]; then
+		echo "Database server did not start, see $LT_RESULTS/mysqld.log"
+		exit 1
+	fi
+	sleep 0.5
+done
+
+sql()
+{
+	"$MYSQL" --no-defaults --socket="$DB_SOCKET" -uroot "$@"
+}
+
+echo "Creating database and $LT_USERS users"
+
+sql -e "CREATE DATABASE FriendMaster CHARACTER SET utf8;
+	CREATE USER '$LT_DB_USER'@'localhost' IDENTIFIED BY '$LT_DB_PASSWORD';
+	GRANT ALL PRIVILEGES ON FriendMaster.* TO '$LT_DB_USER'@'localhost';"
+sql FriendMaster < "$REPO_DIR/db/FriendCoreDatabase.sql"
+
+{
+	for i in $(seq 1 "$LT_USERS"); do
+		mkdir -p "$DOORS_DIR/$LT_USER_PREFIX$i"
+		echo "INSERT INTO FUser (Name, Password, FullName, Email, LoggedTime, CreatedTime) VALUES ('$LT_USER_PREFIX$i', CONCAT('{S6}', SHA2(CONCAT('HASHED', SHA2('$LT_USER_PASSWORD', 256)), 256)), 'Load Test $i', '', 0, UNIX_TIMESTAMP());"
+		echo "SET @uid = LAST_INSERT_ID();"
+		echo "INSERT INTO FUserToGroup (UserID, UserGroupID) VALUES (@uid, 2);"
+		echo "INSERT INTO Filesystem (UserID, Name, Type, ShortDescription, Path, Username, Password, Config, Mounted) VALUES (@uid, 'BenchLocal', 'Local', '', '$DOORS_DIR/$LT_USER_PREFIX$i/', '', '', '{}', 1), (@uid, 'BenchRAM', 'INRam', '', '', '', '', '{}', 1);"
+	done
+} | sql FriendMaster
+
+#
+# FriendCore home, installed files are linked, configuration and devices are own
+#
+
+echo "Preparing FriendCore in $FC_HOME"
+
+mkdir -p "$FC_HOME/cfg" "$FC_HOME/storage" "$FC_HOME/log"
+for entry in "$FRIEND_BUILD"/*; do
+	case "$(basename "$entry")" in
+		cfg|storage|log|devices) ;;
+		*) ln -s "$entry" "$FC_HOME/$(basename "$entry")" ;;
+	esac
+done
+cp -r "$FRIEND_BUILD/devices" "$FC_HOME/devices" 2>/dev/null || cp -r "$REPO_DIR/devices" "$FC_HOME/devices"
+
+# INRam DOSDriver has no handler configuration in tree
+if [ ! -f "$FC_HOME/devices/DOSDrivers/INRam/dosdriver.ini" ]; then
+	mkdir -p "$FC_HOME/devices/DOSDrivers/INRam"
+	cat > "$FC_HOME/devices/DOSDrivers/INRam/dosdriver.ini" <<EOF
+[DOSDriver]
+
+type = INRam;
+handler = INRAM;
+version = 1;
+mount = login;
+EOF
+fi
+
+cat > "$FC_HOME/cfg/cfg.ini" <<EOF
+[DatabaseUser]
+host = localhost
+login = $LT_DB_USER
+password = $LT_DB_PASSWORD
+dbname = FriendMaster
+port = $LT_DB_PORT
+connections = 20
+
+[FriendCore]
+fchost = localhost
+port = $LT_HTTP_PORT
+fcupload = storage/
+
+[Core]
+port = $LT_HTTP_PORT
+wsport = $LT_WS_PORT
+cport = $((LT_HTTP_PORT + 1))
+cremoteport = $((LT_HTTP_PORT + 2))
+SSLEnable = 0
+WSSSLEnable = 0
+metrics = 1
+usersnapshot = 0
+
+[LoginModules]
+use = fcdb.authmod
+EOF
+
+echo "Starting FriendCore on ports $LT_HTTP_PORT (http) and $LT_WS_PORT (websockets)"
+
+# mysql client library connects to localhost through MYSQL_UNIX_PORT socket
+( cd "$FC_HOME" && MYSQL_UNIX_PORT="$DB_SOCKET" exec ./FriendCore ) > "$LT_RESULTS/friendcore.log" 2>&1 &
+FC_PID=$!
+
+if ! wait_for_port "$LT_HTTP_PORT" "$FC_PID" || ! wait_for_port "$LT_WS_PORT" "$FC_PID"; then
+	echo "FriendCore did not start, see $LT_RESULTS/friendcore.log"
+	exit 1
+fi
+
+#
+# load
+#
+
+echo "Running load test: $LT_USERS users, $LT_DURATION seconds"
+
+set +e
+"$BENCH_DIR/bin/loadtest" -H 127.0.0.1 -p "$LT_HTTP_PORT" -w "$LT_WS_PORT" -n "$LT_USERS" -d "$LT_DURATION" \
+	-u "$LT_USER_PREFIX" -P "$LT_USER_PASSWORD" -A "$LT_ADMIN" -a "$LT_ADMIN_PASSWORD" \
+	-M "$LT_RESULTS/metrics.prom" $LOADTEST_ARGS | tee "$LT_RESULTS/loadtest.json"
+RESULT=${PIPESTATUS[0]}
+set -e
+
+echo "Results stored in $LT_RESULTS"
+exit $RESULT
@@ -0,0 +1,198 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ *
+ *  UserManager lookup benchmark with 100000 users in memory
+ *
+ *  UMUserListScan walks um_Users list and compares names, this is how
+ *  users were found before hash index was added, so it is the baseline.
+ *
+ *  @date created 10/2026
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <string.h>
+#include <util/string.h>
+#include <system/systembase.h>
+#include <system/user/user_manager.h>
+#include <system/user/user.h>
+
+#define BENCH_USERS				100000
+
+//
+// Global normally defined in main.c
+//
+
+FriendCoreManager *coreManager;
+
+static UserManager *um;
+static char *names[ BENCH_USERS ];
+static FULONG nextID = BENCH_USERS + 1;
+
+//
+// Pseudo random index, so lookups are not served from one cache line
+//
+
+static inline int BenchUserIndex( FQUAD i )
+{
+	return (int)( ( (FUQUAD)i * 2654435761ULL ) % BENCH_USERS );
+}
+
+/**
+ * Create user which can be added to UserManager
+ *
+ * @param id user id
+ * @param name user name
+ * @return new User
+ */
+
+static User *BenchUserCreate( FULONG id, const char *name )
+{
+	User *usr = UserNew();
+	if( usr != NULL )
+	{
+		usr->u_ID = id;
+		usr->u_Name = StringDuplicate( name );
+	}
+	return usr;
+}
+
+//
+// Lookups
+//
+
+static void BenchGetUserByNameRef( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		User *usr = UMGetUserByNameRef( um, names[ BenchUserIndex( i ) ] );
+		BENCH_USE( usr );
+		UMReleaseUser( um, usr );
+	}
+}
+
+static void BenchGetUserByIDRef( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		User *usr = UMGetUserByIDRef( um, (FULONG)BenchUserIndex( i ) + 1 );
+		BENCH_USE( usr );
+		UMReleaseUser( um, usr );
+	}
+}
+
+static void BenchGetUserByNameRefMiss( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		User *usr = UMGetUserByNameRef( um, "userwhichdoesnotexist" );
+		BENCH_USE( usr );
+	}
+}
+
+static void BenchUserListScan( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		const char *name = names[ BenchUserIndex( i ) ];
+		User *usr = um->um_Users;
+		while( usr != NULL )
+		{
+			if( usr->u_Name != NULL && strcmp( name, usr->u_Name ) == 0 )
+			{
+				break;
+			}
+			usr = (User *)usr->node.mln_Succ;
+		}
+		BENCH_USE( usr );
+	}
+}
+
+//
+// Remove user found by name, like logout does, and add it again. Removed users
+// are spread over whole list, new users are added at its head.
+//
+
+static void BenchAddRemoveUser( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		const char *name = names[ BenchUserIndex( i ) ];
+		User *usr = UMGetUserByNameRef( um, name );
+		if( usr != NULL )
+		{
+			UMRemoveUser( um, usr );
+			UMReleaseUser( um, usr );
+		}
+
+		UMAddUser( um, BenchUserCreate( nextID++, name ) );
+	}
+}
+
+/**
+ * UserManager benchmark entry
+ *
+ * @param argc number of arguments
+ * @param argv arguments
+ * @return 0 when success, otherwise error number
+ */
+
+int main( int argc, char **argv )
+{
+	int i;
+
+	BenchInit( argc, argv );
+
+	if( ( um = UMNew( NULL ) ) == NULL )
+	{
+		fprintf( stderr, "Cannot create UserManager\n" );
+		return 1;
+	}
+
+	for( i = 0 ; i < BENCH_USERS ; i++ )
+	{
+		char name[ 32 ];
+		snprintf( name, sizeof( name ), "user%06d", i );
+		names[ i ] = StringDuplicate( name );
+
+		if( UMAddUser( um, BenchUserCreate( (FULONG)i + 1, name ) ) != 0 )
+		{
+			fprintf( stderr, "Cannot add user %s\n", name );
+			return 1;
+		}
+	}
+
+	BenchRun( "UMGetUserByNameRef/100000", BenchGetUserByNameRef, NULL );
+	BenchRun( "UMGetUserByIDRef/100000", BenchGetUserByIDRef, NULL );
+	BenchRun( "UMGetUserByNameRefMiss/100000", BenchGetUserByNameRefMiss, NULL );
+	BenchRun( "UMUserListScan/100000", BenchUserListScan, NULL );
+	BenchRun( "UMAddRemoveUser/100000", BenchAddRemoveUser, NULL );
+
+	return 0;
+}
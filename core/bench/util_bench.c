@@ -0,0 +1,316 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ *
+ *  Microbenchmarks of core/util functions used on request path
+ *
+ *  @date created 10/2026
+ */
+
+#include "bench.h"
+#include <stdio.h>
+#include <string.h>
+#include <util/buffered_string.h>
+#include <util/list_string.h>
+#include <util/hashmap.h>
+#include <util/string.h>
+#include <util/base64.h>
+#include <util/sha256.h>
+#include <util/murmurhash3.h>
+
+#define BENCH_KEYS				1024
+#define BENCH_PAYLOAD_SIZE		4096
+
+static char payload[ BENCH_PAYLOAD_SIZE + 1 ];
+static char *base64Payload;
+static char urlEncoded[ 1024 ];
+static char *keys[ BENCH_KEYS ];
+static Hashmap *lookupMap;
+
+//
+// BufString
+//
+
+static void BenchBufStringAdd( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	int j;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		BufString *bs = BufStringNew();
+		for( j = 0 ; j < 256 ; j++ )
+		{
+			BufStringAdd( bs, "{\"name\":\"file\"}," );
+		}
+		BENCH_USE( bs->bs_Buffer );
+		BufStringDelete( bs );
+	}
+}
+
+static void BenchBufStringAddSize( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	int j;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		BufString *bs = BufStringNew();
+		for( j = 0 ; j < 64 ; j++ )
+		{
+			BufStringAddSize( bs, payload, 1024 );
+		}
+		BENCH_USE( bs->bs_Buffer );
+		BufStringDelete( bs );
+	}
+}
+
+//
+// ListString
+//
+
+static void BenchListStringJoin( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	int j;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		ListString *ls = ListStringNew();
+		for( j = 0 ; j < 64 ; j++ )
+		{
+			ListStringAdd( ls, payload, 256 );
+		}
+		ListStringJoin( ls );
+		BENCH_USE( ls->ls_Data );
+		ListStringDelete( ls );
+	}
+}
+
+//
+// Hashmap
+//
+
+static void BenchHashmapPut( void *data, FQUAD iterations )
+{
+	int count = *(int *)data;
+	FQUAD i;
+	int j;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		Hashmap *hm = HashmapNew();
+		for( j = 0 ; j < count ; j++ )
+		{
+			HashmapPut( hm, StringDuplicate( keys[ j ] ), NULL );
+		}
+		HashmapFree( hm );
+	}
+}
+
+static void BenchHashmapGet( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		HashmapElement *e = HashmapGet( lookupMap, keys[ i & ( BENCH_KEYS - 1 ) ] );
+		BENCH_USE( e );
+	}
+}
+
+static void BenchHashmapGetMiss( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		HashmapElement *e = HashmapGet( lookupMap, "missing-parameter" );
+		BENCH_USE( e );
+	}
+}
+
+//
+// Strings
+//
+
+static void BenchStringDuplicate( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		char *s = StringDuplicate( "5f1e7b6ab0e2c3d7f8a9b0c1d2e3f4a5b6c7d8e9" );
+		BENCH_USE( s );
+		FFree( s );
+	}
+}
+
+static void BenchStringDuplicateN( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		char *s = StringDuplicateN( payload, 256 );
+		BENCH_USE( s );
+		FFree( s );
+	}
+}
+
+static void BenchUrlDecode( void *data, FQUAD iterations )
+{
+	char dst[ sizeof( urlEncoded ) ];
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		UrlDecode( dst, urlEncoded );
+		BENCH_USE( dst );
+	}
+}
+
+//
+// Hashes and encoding
+//
+
+static void BenchBase64Encode( void *data, FQUAD iterations )
+{
+	int size = *(int *)data;
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		char *enc = Base64Encode( (const unsigned char *)payload, size );
+		BENCH_USE( enc );
+		FFree( enc );
+	}
+}
+
+static void BenchBase64Decode( void *data, FQUAD iterations )
+{
+	int size = *(int *)data;
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		int len = 0;
+		char *dec = Base64Decode( (const unsigned char *)base64Payload, size, &len );
+		BENCH_USE( dec );
+		FFree( dec );
+	}
+}
+
+static void BenchSha256( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		FCSHA256_CTX ctx;
+		unsigned char hash[ 32 ];
+		Sha256Init( &ctx );
+		Sha256Update( &ctx, (unsigned char *)payload, BENCH_PAYLOAD_SIZE );
+		Sha256Final( &ctx, hash );
+		BENCH_USE( hash );
+	}
+}
+
+static void BenchMurmurHash3x86( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		uint32_t hash;
+		MurmurHash3_x86_32( keys[ i & ( BENCH_KEYS - 1 ) ], 16, 0, &hash );
+		BENCH_USE( &hash );
+	}
+}
+
+static void BenchMurmurHash3x64( void *data, FQUAD iterations )
+{
+	FQUAD i;
+	for( i = 0 ; i < iterations ; i++ )
+	{
+		uint64_t hash[ 2 ];
+		MurmurHash3_x64_128( payload, BENCH_PAYLOAD_SIZE, 0, hash );
+		BENCH_USE( hash );
+	}
+}
+
+/**
+ * Prepare input data shared by benchmarks
+ */
+
+static void BenchPrepare( void )
+{
+	int i;
+	for( i = 0 ; i < BENCH_PAYLOAD_SIZE ; i++ )
+	{
+		payload[ i ] = 'a' + ( ( i * 7 ) % 26 );
+	}
+
+	base64Payload = Base64Encode( (const unsigned char *)payload, BENCH_PAYLOAD_SIZE );
+
+	// typical form encoded POST body
+	char *pos = urlEncoded;
+	while( pos - urlEncoded < (int)sizeof( urlEncoded ) - 32 )
+	{
+		pos += sprintf( pos, "path=Home%%3A%%2FDocuments+%d&", (int)( pos - urlEncoded ) );
+	}
+
+	lookupMap = HashmapNew();
+	for( i = 0 ; i < BENCH_KEYS ; i++ )
+	{
+		char tmp[ 32 ];
+		snprintf( tmp, sizeof( tmp ), "parameter%07d", i );
+		keys[ i ] = StringDuplicate( tmp );
+		HashmapPut( lookupMap, StringDuplicate( tmp ), StringDuplicate( "value" ) );
+	}
+}
+
+/**
+ * Microbenchmark entry
+ *
+ * @param argc number of arguments
+ * @param argv arguments
+ * @return 0
+ */
+
+int main( int argc, char **argv )
+{
+	static int small = 8, large = 1024;
+	static int encodeSmall = 48, encodeLarge = BENCH_PAYLOAD_SIZE;
+	static int decodeSmall = 64, decodeLarge = ( ( BENCH_PAYLOAD_SIZE + 2 ) / 3 ) * 4;
+
+	BenchInit( argc, argv );
+	BenchPrepare();
+
+	BenchRun( "BufStringAdd/256x16", BenchBufStringAdd, NULL );
+	BenchRun( "BufStringAddSize/64x1024", BenchBufStringAddSize, NULL );
+	BenchRun( "ListStringJoin/64x256", BenchListStringJoin, NULL );
+	BenchRun( "HashmapPut/8", BenchHashmapPut, &small );
+	BenchRun( "HashmapPut/1024", BenchHashmapPut, &large );
+	BenchRun( "HashmapGet/1024", BenchHashmapGet, NULL );
+	BenchRun( "HashmapGetMiss/1024", BenchHashmapGetMiss, NULL );
+	BenchRun( "StringDuplicate/40", BenchStringDuplicate, NULL );
+	BenchRun( "StringDuplicateN/256", BenchStringDuplicateN, NULL );
+	BenchRun( "UrlDecode/1024", BenchUrlDecode, NULL );
+	BenchRun( "Base64Encode/48", BenchBase64Encode, &encodeSmall );
+	BenchRun( "Base64Encode/4096", BenchBase64Encode, &encodeLarge );
+	BenchRun( "Base64Decode/64", BenchBase64Decode, &decodeSmall );
+	BenchRun( "Base64Decode/5464", BenchBase64Decode, &decodeLarge );
+	BenchRun( "Sha256/4096", BenchSha256, NULL );
+	BenchRun( "MurmurHash3_x86_32/16", BenchMurmurHash3x86, NULL );
+	BenchRun( "MurmurHash3_x64_128/4096", BenchMurmurHash3x64, NULL );
+
+	return 0;
+}
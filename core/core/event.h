@@ -74,14 +74,20 @@ typedef struct Event
 typedef struct CoreEvent
 {
 	struct MinNode	node;
-	time_t					ce_Time;
-	time_t					ce_TimeDelta;
+	time_t					ce_Time;			// wall clock time of next call (informational)
+	time_t					ce_TimeDelta;		// interval in seconds (informational)
 	int 						ce_RepeatTime;		// -1 repeat everytime, 0 - last repeat, n - number of repeats
 	FUQUAD 				ce_ID;
 	
-	FThread 				*ce_Thread;
 	int						(*ce_Function)( void *sb );
 	void						*ce_Data;
+	
+	FUQUAD				ce_NextCallMS;		// monotonic time of next call in milliseconds
+	FUQUAD				ce_IntervalMS;		// interval between calls in milliseconds
+	int						ce_HeapIndex;		// position in EventManager heap, -1 when not scheduled
+	struct CoreEvent		*ce_HashNext;		// next event in EventManager ID hash bucket
+	FBOOL					ce_Remove;			// event was cancelled, worker must release it
+	FBOOL					ce_LastCall;		// last repeat, event is released after call
 }CoreEvent;
 
 
@@ -26,16 +26,19 @@
  *
  *  Events are the counterpart of workers. They provide a mechanism to send
  *  delayed or repeated messages to Friend Code elements.
- *  This system is not used in the current version of Friend Core.
+ *  Scheduled events are stored in a min-heap ordered by next call time.
+ *  The manager thread sleeps on a monotonic condition variable exactly until
+ *  the nearest deadline (or until a new, earlier event is added) and moves due
+ *  events to a run queue which is served by EVENT_MANAGER_WORKERS threads.
  *
  *  @author PS (Pawel Stefanski)
  *  @date first pushed on 10/02/2015
- *  @todo FL>PS this code is not finished. The thread handling function does nothing.
  */
 #include <core/types.h>
 #include <core/event_manager.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <util/log/log.h>
 #include <unistd.h>
 #include <core/thread.h>
@@ -43,12 +46,202 @@
 #include <unistd.h>
 
 void *EventManagerLoopThread( FThread *ptr );
+void *EventManagerWorkerThread( FThread *ptr );
 
+/**
+ * Get monotonic time in milliseconds
+ *
+ * @return current monotonic time in milliseconds
+ */
+static inline FUQUAD EventGetTimeMS( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ( (FUQUAD)ts.tv_sec * 1000 ) + ( ts.tv_nsec / 1000000 );
+}
+
+//
+// heap helpers, em_Mutex must be locked
+//
+
+static inline void EventHeapSwap( EventManager *em, int a, int b )
+{
+	CoreEvent *tmp = em->em_Heap[ a ];
+	em->em_Heap[ a ] = em->em_Heap[ b ];
+	em->em_Heap[ b ] = tmp;
+	em->em_Heap[ a ]->ce_HeapIndex = a;
+	em->em_Heap[ b ]->ce_HeapIndex = b;
+}
+
+static void EventHeapUp( EventManager *em, int pos )
+{
+	while( pos > 0 )
+	{
+		int parent = ( pos - 1 ) / 2;
+		if( em->em_Heap[ parent ]->ce_NextCallMS <= em->em_Heap[ pos ]->ce_NextCallMS )
+		{
+			break;
+		}
+		EventHeapSwap( em, parent, pos );
+		pos = parent;
+	}
+}
+
+static void EventHeapDown( EventManager *em, int pos )
+{
+	while( TRUE )
+	{
+		int left = pos * 2 + 1;
+		int right = left + 1;
+		int min = pos;
+		
+		if( left < em->em_HeapSize && em->em_Heap[ left ]->ce_NextCallMS < em->em_Heap[ min ]->ce_NextCallMS )
+		{
+			min = left;
+		}
+		if( right < em->em_HeapSize && em->em_Heap[ right ]->ce_NextCallMS < em->em_Heap[ min ]->ce_NextCallMS )
+		{
+			min = right;
+		}
+		if( min == pos )
+		{
+			break;
+		}
+		EventHeapSwap( em, pos, min );
+		pos = min;
+	}
+}
+
+/**
+ * Put event into heap
+ *
+ * @param em pointer to the EventManager structure
+ * @param ev pointer to event
+ * @return 0 when success, otherwise error number
+ */
+static int EventHeapPush( EventManager *em, CoreEvent *ev )
+{
+	if( em->em_HeapSize >= em->em_HeapMax )
+	{
+		int newMax = em->em_HeapMax * 2;
+		CoreEvent **nheap = realloc( em->em_Heap, newMax * sizeof( CoreEvent *) );
+		if( nheap == NULL )
+		{
+			FERROR("Cannot allocate memory for events heap\n");
+			return 1;
+		}
+		em->em_Heap = nheap;
+		em->em_HeapMax = newMax;
+	}
+	
+	ev->ce_HeapIndex = em->em_HeapSize;
+	em->em_Heap[ em->em_HeapSize++ ] = ev;
+	EventHeapUp( em, ev->ce_HeapIndex );
+	return 0;
+}
+
+/**
+ * Remove event from heap
+ *
+ * @param em pointer to the EventManager structure
+ * @param ev pointer to event which is in heap
+ */
+static void EventHeapRemove( EventManager *em, CoreEvent *ev )
+{
+	int pos = ev->ce_HeapIndex;
+	int last = --em->em_HeapSize;
+	
+	ev->ce_HeapIndex = -1;
+	if( pos != last )
+	{
+		em->em_Heap[ pos ] = em->em_Heap[ last ];
+		em->em_Heap[ pos ]->ce_HeapIndex = pos;
+		EventHeapDown( em, pos );
+		EventHeapUp( em, pos );
+	}
+	em->em_Heap[ last ] = NULL;
+}
+
+//
+// ID hash helpers, em_Mutex must be locked. Event stays in hash from EventAdd until it is released.
+//
+
+static inline CoreEvent **EventHashBucket( EventManager *em, FUQUAD id )
+{
+	return &(em->em_IDHash[ id & (FUQUAD)( em->em_IDHashSize - 1 ) ]);
+}
+
+/**
+ * Put event into ID hash, hash grows when it has more events than buckets
+ *
+ * @param em pointer to the EventManager structure
+ * @param ev pointer to event
+ */
+static void EventHashAdd( EventManager *em, CoreEvent *ev )
+{
+	if( em->em_IDHashCount >= em->em_IDHashSize )
+	{
+		int newSize = em->em_IDHashSize * 2;
+		CoreEvent **nhash = FCalloc( newSize, sizeof( CoreEvent *) );
+		if( nhash != NULL )
+		{
+			CoreEvent **ohash = em->em_IDHash;
+			int osize = em->em_IDHashSize;
+			int i;
+			
+			em->em_IDHash = nhash;
+			em->em_IDHashSize = newSize;
+			for( i = 0 ; i < osize ; i++ )
+			{
+				CoreEvent *loc = ohash[ i ];
+				while( loc != NULL )
+				{
+					CoreEvent *next = loc->ce_HashNext;
+					CoreEvent **bucket = EventHashBucket( em, loc->ce_ID );
+					loc->ce_HashNext = *bucket;
+					*bucket = loc;
+					loc = next;
+				}
+			}
+			FFree( ohash );
+		}
+		// when memory is not available longer chains are used
+	}
+	
+	CoreEvent **bucket = EventHashBucket( em, ev->ce_ID );
+	ev->ce_HashNext = *bucket;
+	*bucket = ev;
+	em->em_IDHashCount++;
+}
+
+static CoreEvent *EventHashFind( EventManager *em, FUQUAD id )
+{
+	CoreEvent *ev = *EventHashBucket( em, id );
+	while( ev != NULL && ev->ce_ID != id )
+	{
+		ev = ev->ce_HashNext;
+	}
+	return ev;
+}
 
-static int threadsNo = 0;
+static void EventHashRemove( EventManager *em, CoreEvent *ev )
+{
+	CoreEvent **prev = EventHashBucket( em, ev->ce_ID );
+	while( *prev != NULL )
+	{
+		if( *prev == ev )
+		{
+			*prev = ev->ce_HashNext;
+			ev->ce_HashNext = NULL;
+			em->em_IDHashCount--;
+			break;
+		}
+		prev = &((*prev)->ce_HashNext);
+	}
+}
 
 /**
- * Creates a new Event Manager structure and launches its thread
+ * Creates a new Event Manager structure and launches its threads
  *
  * @return pointer to the newly created event manager
  */
@@ -58,8 +251,40 @@ EventManager *EventManagerNew( void *sb )
 	DEBUG("EventManager start\n");
 	if( em != NULL )
 	{
+		pthread_condattr_t attr;
+		int i;
+		
 		em->lastID = 0xf;
 		em->em_SB = sb;
+		
+		em->em_HeapMax = EVENT_MANAGER_HEAP_SIZE;
+		if( ( em->em_Heap = FCalloc( em->em_HeapMax, sizeof( CoreEvent *) ) ) == NULL )
+		{
+			FFree( em );
+			Log( FLOG_FATAL, "Cannot allocate memory for EventManager heap!\n");
+			return NULL;
+		}
+		
+		em->em_IDHashSize = EVENT_MANAGER_HASH_SIZE;
+		if( ( em->em_IDHash = FCalloc( em->em_IDHashSize, sizeof( CoreEvent *) ) ) == NULL )
+		{
+			FFree( em->em_Heap );
+			FFree( em );
+			Log( FLOG_FATAL, "Cannot allocate memory for EventManager hash!\n");
+			return NULL;
+		}
+		
+		pthread_mutex_init( &(em->em_Mutex), NULL );
+		pthread_condattr_init( &attr );
+		pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+		pthread_cond_init( &(em->em_Cond), &attr );
+		pthread_condattr_destroy( &attr );
+		pthread_cond_init( &(em->em_WorkCond), NULL );
+		
+		for( i = 0 ; i < EVENT_MANAGER_WORKERS ; i++ )
+		{
+			em->em_Workers[ i ] = ThreadNew( EventManagerWorkerThread, em, TRUE );
+		}
 		em->em_EventThread = ThreadNew( EventManagerLoopThread, em, TRUE );
 	}
 	else
@@ -81,15 +306,13 @@ void EventManagerDelete( EventManager *em )
 	// remove long time events
 	if( em != NULL )
 	{
-		em->em_EventThread->t_Quit = TRUE;
-		while( TRUE )
-		{
-			if( em->em_EventThread->t_Launched == FALSE )
-			{
-				break;
-			}
-			usleep( 5000 );
-		}
+		int i;
+		
+		pthread_mutex_lock( &(em->em_Mutex) );
+		em->em_Quit = TRUE;
+		pthread_cond_broadcast( &(em->em_Cond) );
+		pthread_cond_broadcast( &(em->em_WorkCond) );
+		pthread_mutex_unlock( &(em->em_Mutex) );
 		
 		if( em->em_EventThread != NULL )
 		{
@@ -99,52 +322,34 @@ void EventManagerDelete( EventManager *em )
 		
 		// waiting till all functions died
 		
-		while( TRUE )
+		for( i = 0 ; i < EVENT_MANAGER_WORKERS ; i++ )
 		{
-			/*
-			FBOOL allFunctionsQuit = TRUE;
-			CoreEvent *locnce = em->em_EventList;
-			int threadNr = 0;
-			
-			while( locnce != NULL )
-			{
-				DEBUG( "Threadno: %d launched %d  allquit : %d\n", threadNr++, locnce->ce_Thread->t_Launched , allFunctionsQuit );
-				
-				if( locnce->ce_Thread->t_Launched == TRUE )
-				{
-					allFunctionsQuit = FALSE;
-				}
-				
-				locnce = (CoreEvent *) locnce->node.mln_Succ;
-			}
-			
-			if( allFunctionsQuit == TRUE )
+			if( em->em_Workers[ i ] != NULL )
 			{
-				break;
-			}*/
-			if( threadsNo <= 0 )
-			{
-				break;
+				ThreadDelete( em->em_Workers[ i ] );
 			}
-			DEBUG("Not all threads were closed properly, waiting. ThreadsNo: %d\n", threadsNo );
-			usleep( 500 );
 		}
+		DEBUG("EventManager workers removed\n");
+		
+		for( i = 0 ; i < em->em_HeapSize ; i++ )
+		{
+			FFree( em->em_Heap[ i ] );
+		}
+		FFree( em->em_Heap );
+		FFree( em->em_IDHash );
 		
-		CoreEvent *locnce = em->em_EventList;
+		CoreEvent *locnce = em->em_RunQueue;
 		while( locnce != NULL )
 		{
 			CoreEvent *rem = locnce;
 			locnce = (CoreEvent *)locnce->node.mln_Succ;
-
-			DEBUG("Remove thread ptr: %p\n", rem->ce_Thread );
-			if( rem->ce_Thread != NULL )
-			{
-				//ThreadDelete( rem->ce_Thread );
-				rem->ce_Thread = NULL;
-			}
 			FFree( rem );
 		}
 		
+		pthread_cond_destroy( &(em->em_Cond) );
+		pthread_cond_destroy( &(em->em_WorkCond) );
+		pthread_mutex_destroy( &(em->em_Mutex) );
+		
 		FFree( em );
 	}
 	DEBUG("EventManagerDelete end\n");
@@ -163,117 +368,137 @@ FUQUAD EventGetNewID( EventManager *em )
 }
 
 /**
- * Launches a new event
+ * Event Manager worker thread. Takes events from run queue and calls them
  *
- * @param ptr pointer to the FThread structure of the Friend thread to send the event to
+ * @param ptr pointer to the FThread structure of the worker
  */
-void EventLaunch( FThread *ptr )
+void *EventManagerWorkerThread( FThread *ptr )
 {
-	pthread_detach( pthread_self() );
-	ptr->t_Launched = TRUE;
-	threadsNo++;
+	EventManager *em = (EventManager *)ptr->t_Data;
 	
-	CoreEvent *ce = (CoreEvent *) ptr->t_Data;
-	if( ce != NULL )
+	pthread_mutex_lock( &(em->em_Mutex) );
+	while( em->em_Quit != TRUE )
 	{
-		ce->ce_Function( ce->ce_Data );
+		CoreEvent *ev = em->em_RunQueue;
+		if( ev == NULL )
+		{
+			pthread_cond_wait( &(em->em_WorkCond), &(em->em_Mutex) );
+			continue;
+		}
+		
+		em->em_RunQueue = (CoreEvent *)ev->node.mln_Succ;
+		if( em->em_RunQueue == NULL )
+		{
+			em->em_RunQueueLast = NULL;
+		}
+		ev->node.mln_Succ = NULL;
+		
+		if( ev->ce_Remove == FALSE )
+		{
+			// event stays in ID hash while it is called, EventRemove only marks it
+			pthread_mutex_unlock( &(em->em_Mutex) );
+			
+			DEBUG("Call event %lu function %p\n", ev->ce_ID, ev->ce_Function );
+			ev->ce_Function( ev->ce_Data );
+			
+			pthread_mutex_lock( &(em->em_Mutex) );
+		}
+		
+		if( ev->ce_Remove == TRUE || ev->ce_LastCall == TRUE || em->em_Quit == TRUE )
+		{
+			EventHashRemove( em, ev );
+			FFree( ev );
+		}
+		else
+		{
+			// event is scheduled again only when previous call finished, so the same event never runs twice at once
+			
+			FUQUAD now = EventGetTimeMS();
+			if( ev->ce_NextCallMS < now )
+			{
+				ev->ce_NextCallMS = now;
+			}
+			ev->ce_Time = time( NULL ) + (time_t)( ( ev->ce_NextCallMS - now ) / 1000 );
+			
+			if( EventHeapPush( em, ev ) != 0 )
+			{
+				EventHashRemove( em, ev );
+				FFree( ev );
+			}
+			else if( ev->ce_HeapIndex == 0 )
+			{
+				pthread_cond_signal( &(em->em_Cond) );
+			}
+		}
 	}
+	pthread_mutex_unlock( &(em->em_Mutex) );
 	
-	threadsNo--;
 	ptr->t_Launched = FALSE;
-	
-	pthread_exit( 0 );
+	return NULL;
 }
 
-//
-// wait thread
-//
-
-#define WAIT_SECOND 1						 //< Maximum wait time
-#define WAIT_SECOND_1m 1000000 //< one million!
-
 /**
  * Event Manager thread entry function
  *
  * @param ptr pointer to the FThread structure of the event manager
- * @todo This function waits a maximum of 10 seconds for each event to be completed. FL>PS !!!
  */
 void *EventManagerLoopThread( FThread *ptr )
 {
-	EventManager *ce = (EventManager *)ptr->t_Data;
-	//const unsigned long long nano = 1000000000;
-	//unsigned long long t1, t2, lasttime;
-	//struct timespec tm;
+	EventManager *em = (EventManager *)ptr->t_Data;
 	
-	time_t stime = time( NULL );
-	time_t etime = stime;
-
-	do
+	pthread_mutex_lock( &(em->em_Mutex) );
+	while( em->em_Quit != TRUE )
 	{
-		time_t dtime = etime - stime;
-		
-		CoreEvent *locnce = ce->em_EventList;
-		while( locnce != NULL )
+		if( em->em_HeapSize <= 0 )
 		{
-			EventCheck( ce, locnce, stime );
-			
-			locnce = (CoreEvent *) locnce->node.mln_Succ;
+			pthread_cond_wait( &(em->em_Cond), &(em->em_Mutex) );
+			continue;
 		}
 		
-		time_t end_time = WAIT_SECOND_1m - dtime;
-		usleep( end_time );
-		//printf("waiting..... %d\n", end_time );
+		CoreEvent *ev = em->em_Heap[ 0 ];
+		FUQUAD now = EventGetTimeMS();
 		
-		stime = etime;
-		etime = time( NULL );
-	}
-	while( ptr->t_Quit != TRUE );
-	
-	ptr->t_Launched = FALSE;
-	
-	//pthread_exit( 0 );
-	/*
-	clock_t time = clock();
-
-	while( ptr->t_Quit != TRUE )
-	{
-		clock_t dtime = clock() - time;
-		
-		CoreEvent *locnce = em->em_EventList;
-		while( locnce != NULL )
+		if( ev->ce_NextCallMS > now )
 		{
-//			if( locnce->ce_Time.
+			struct timespec ts;
+			ts.tv_sec = (time_t)( ev->ce_NextCallMS / 1000 );
+			ts.tv_nsec = (long)( ev->ce_NextCallMS % 1000 ) * 1000000;
 			
-			locnce = (CoreEvent *) locnce->node.mln_Succ;
+			pthread_cond_timedwait( &(em->em_Cond), &(em->em_Mutex), &ts );
+			continue;
 		}
 		
-		clock_t end_time = (WAIT_SECOND * CLOCKS_PER_SEC  ) - dtime;
-		usleep( end_time );
-		//printf("witing..... %d\n", end_time );
+		// event is due, move it to run queue
 		
-		time = clock();
-	}*/
+		EventHeapRemove( em, ev );
 		
-		/*
-	{
-		//clock_gettime( CLOCK_REALTIME, &tm );
-		t1 = tm.tv_nsec + tm.tv_sec * nano;
-
-		long long tmp = lasttime+20000-now;
-		if( tmp > 0 )
+		ev->ce_NextCallMS += ev->ce_IntervalMS;
+		if( ev->ce_RepeatTime == 0 )		// last call, must be removed after call
 		{
-			usleep( tmp );
+			ev->ce_LastCall = TRUE;
 		}
-
-		//clock_gettime( CLOCK_REALTIME, &tm );
-		t2 = tm.tv_nsec + tm.tv_sec * nano;
+		else if( ev->ce_RepeatTime > 0 )
+		{
+			ev->ce_RepeatTime--;
+		}
+		// -1 never ending loop
 		
-		clock_t start_time = clock();
-	clock_t end_time = sec * 1000 + start_time;
-
-		printf( "delay: %ld\n", ( t2 - t1 ) / 1000 );
-
-	}*/
+		ev->node.mln_Succ = NULL;
+		if( em->em_RunQueueLast != NULL )
+		{
+			em->em_RunQueueLast->node.mln_Succ = (MinNode *)ev;
+		}
+		else
+		{
+			em->em_RunQueue = ev;
+		}
+		em->em_RunQueueLast = ev;
+		
+		pthread_cond_signal( &(em->em_WorkCond) );
+	}
+	pthread_mutex_unlock( &(em->em_Mutex) );
+	
+	ptr->t_Launched = FALSE;
 	return NULL;
 }
 
@@ -283,120 +508,136 @@ void *EventManagerLoopThread( FThread *ptr )
 /**
  * Add a new event to the list of events to handle
  *
+ * One-shot event can be called and released before this function returns,
+ * that is why only its ID is returned.
+ *
  * @param em pointer to the event manager structure
- * @param id ID of the event returned by EventGetNewID
- * @param thread pointer to the thread to send the message to
- * @param nextCall delay before sending the message
- * @param repeat number of repetitions
- * @return pointer to the event created
- * @todo FL>PS no specific value returned in case of error
+ * @param function function which will be called
+ * @param data pointer to data passed to function
+ * @param delayMS delay before first call in milliseconds
+ * @param intervalMS time between calls in milliseconds
+ * @param repeat number of repetitions (-1 - forever)
+ * @return ID of the event created (to be used by EventRemove) or 0 when error appear
  */
-CoreEvent *EventAdd( EventManager *em, void *function, void *data, time_t nextCall, time_t deltaTime, int repeat )
-//CoreEvent *EventAdd( EventManager *em, FThread *thread, time_t nextCall, time_t deltaTime, int repeat )
+FUQUAD EventAddMS( EventManager *em, void *function, void *data, FUQUAD delayMS, FUQUAD intervalMS, int repeat )
 {
+	FUQUAD id = 0;
+	
+	if( em == NULL || function == NULL )
+	{
+		return 0;
+	}
+	
 	CoreEvent *nce = FCalloc( sizeof( CoreEvent ), 1 );
 	if( nce != NULL )
 	{
-		//FThread *nth = ThreadNew( function, em->em_SB, FALSE );
-		//CoreEvent *retEv = NULL;
-		//nce->ce_Thread = thread;
 		nce->ce_Function = function;
-		nce->ce_ID = ++em->em_IDGenerator;
-		nce->ce_Time = nextCall;
 		nce->ce_RepeatTime = repeat;
-		nce->ce_TimeDelta = deltaTime;
 		nce->ce_Data = data;
+		nce->ce_IntervalMS = intervalMS;
+		nce->ce_TimeDelta = (time_t)( intervalMS / 1000 );
+		nce->ce_Time = time( NULL ) + (time_t)( delayMS / 1000 );
+		nce->ce_HeapIndex = -1;
+		
+		pthread_mutex_lock( &(em->em_Mutex) );
+		
+		nce->ce_ID = ++em->em_IDGenerator;
+		nce->ce_NextCallMS = EventGetTimeMS() + delayMS;
+		
+		if( EventHeapPush( em, nce ) != 0 )
+		{
+			pthread_mutex_unlock( &(em->em_Mutex) );
+			FFree( nce );
+			return 0;
+		}
+		EventHashAdd( em, nce );
+		
+		// wake up scheduler only when new event is the nearest one
+		if( nce->ce_HeapIndex == 0 )
+		{
+			pthread_cond_signal( &(em->em_Cond) );
+		}
+		
+		// event cannot be used after unlock, worker can release it
+		id = nce->ce_ID;
+		
+		pthread_mutex_unlock( &(em->em_Mutex) );
 
-		DEBUG("ADD NEW EVENT %ld\n", nce->ce_ID );
-
-		nce->node.mln_Succ = (MinNode *) em->em_EventList;
-		em->em_EventList = nce;
+		DEBUG("ADD NEW EVENT %lu\n", id );
 	}
 	else
 	{
 		Log( FLOG_ERROR, "Cannot allocate memory for new Event\n");
 	}
 
-	return nce;
+	return id;
 }
 
 /**
- * Force call an event
+ * Add a new event to the list of events to handle
  *
  * @param em pointer to the event manager structure
- * @param id ID of the event to call
- * @return NULL
+ * @param function function which will be called
+ * @param data pointer to data passed to function
+ * @param nextCall time of first call
+ * @param deltaTime time between calls in seconds
+ * @param repeat number of repetitions (-1 - forever)
+ * @return ID of the event created (to be used by EventRemove) or 0 when error appear
  */
-CoreEvent *EventCheck( EventManager *em, CoreEvent *ev, time_t ti )
+FUQUAD EventAdd( EventManager *em, void *function, void *data, time_t nextCall, time_t deltaTime, int repeat )
 {
-	FBOOL removeEvent = FALSE;
-	
-	//DEBUG("Check event: time %lu eventTime %lu\n", ti, ev->ce_Time );
+	time_t now = time( NULL );
+	FUQUAD delayMS = 0;
 	
-	if( ti >= ev->ce_Time  )
+	if( nextCall > now )
 	{
-		ev->ce_Time += ev->ce_TimeDelta;		//we increse time amount after which call will be done
-		
-		if( ev->ce_RepeatTime == -1 )		// never ending loop
-		{
-			//ev->ce_Thread->t_Launched = FALSE;
-		}
-		else if( ev->ce_RepeatTime == 0 )	// last call, must be removed
-		{
-			removeEvent = TRUE;
-		}
-		else
-		{
-			//ev->ce_Thread->t_Launched = FALSE;
-			ev->ce_RepeatTime--;
-		}
-		
-		DEBUG("Start thread %p  SB ptr %p\n", ev->ce_Function, em->em_SB );
-		//ThreadStart( ev->ce_Thread );
-		//ev->ce_Data = em->em_SB;
-		ev->ce_Thread = ThreadNew( EventLaunch, ev, TRUE );
-		DEBUG("Thread started\n");
+		delayMS = (FUQUAD)( nextCall - now ) * 1000;
 	}
 	
-	if( removeEvent == TRUE )
+	return EventAddMS( em, function, data, delayMS, (FUQUAD)deltaTime * 1000, repeat );
+}
+
+/**
+ * Remove event. Event which is waiting for worker or currently executed is released by worker.
+ *
+ * @param em pointer to the event manager structure
+ * @param id ID of the event returned by EventAdd
+ * @return 0 when success, otherwise error number
+ */
+int EventRemove( EventManager *em, FUQUAD id )
+{
+	int error = 1;
+	
+	if( em == NULL )
 	{
-		
+		return 1;
 	}
 	
-	/*
-	List *tmp = em->eventTList;
-	CoreEvent *retEv = NULL;
-
-	DEBUG("EVENT: check");
-
-	while( tmp != NULL )
+	pthread_mutex_lock( &(em->em_Mutex) );
+	
+	CoreEvent *ev = EventHashFind( em, id );
+	if( ev != NULL && ev->ce_Remove == FALSE )
 	{
-		CoreEvent *locce = (CoreEvent *) tmp->data;
-		if( locce != NULL && locce->eventId == id )
+		if( ev->ce_HeapIndex >= 0 )
 		{
-			// we found interested position for us
-			retEv = locce;
-
-			break;
+			FBOOL first = ( ev->ce_HeapIndex == 0 );
+			
+			EventHeapRemove( em, ev );
+			EventHashRemove( em, ev );
+			if( first == TRUE )
+			{
+				pthread_cond_signal( &(em->em_Cond) );
+			}
+			FFree( ev );
 		}
-
-		tmp = tmp->next;
-	}
-
-	if( retEv != NULL )
-	{
-		while( retEv != NULL )
+		else
 		{
-			// we call function with interesting arguments for us
-			DEBUG("EVENT: check, calling function %p\n", retEv->hook.h_Function );
-
-			retEv->hook.h_Function( retEv->hook.h_Entry, retEv->hook.h_SubEntry, retEv->hook.h_Data );
-
-			retEv = (CoreEvent *)retEv->node.mln_Succ;
+			ev->ce_Remove = TRUE;
 		}
+		error = 0;
 	}
-	*/
-	//return retEv;
-	return NULL;
+	
+	pthread_mutex_unlock( &(em->em_Mutex) );
+	
+	return error;
 }
-
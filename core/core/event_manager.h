@@ -24,7 +24,9 @@
  *
  *  Definitions used by the Friend Core system of event
  *
- *  This system is not used in the current version of Friend Core.
+ *  Events are kept in a min-heap ordered by deadline. The manager thread
+ *  sleeps until the nearest deadline and passes due events to a small pool
+ *  of worker threads.
  *
  *  @author PS (Pawel Stefanski)
  *  @date first pushed on 10/02/2015
@@ -36,6 +38,11 @@
 #include <core/types.h>
 #include <core/event.h>
 #include <util/list.h>
+#include <pthread.h>
+
+#define EVENT_MANAGER_WORKERS		4		///< number of threads which are calling event functions
+#define EVENT_MANAGER_HEAP_SIZE		64		///< initial size of events heap
+#define EVENT_MANAGER_HASH_SIZE		64		///< initial number of ID hash buckets, power of 2
 
 //
 // EventManager structure
@@ -44,9 +51,20 @@
 typedef struct EventManager
 {
 	FUQUAD lastID;							///< last available event ID
-	//struct List 			*eventTList;	// list of events , by types
-	CoreEvent				*em_EventList;		///< pointer to the list of events
-	FThread 				*em_EventThread;	///< pointer to the list of associated Friend threads
+	CoreEvent				**em_Heap;			///< min-heap of scheduled events (by ce_NextCallMS)
+	int						em_HeapSize;		///< number of events in heap
+	int						em_HeapMax;			///< heap capacity
+	CoreEvent				*em_RunQueue;		///< events waiting for worker (linked by node)
+	CoreEvent				*em_RunQueueLast;	///< last entry in run queue
+	CoreEvent				**em_IDHash;		///< every event which is not released yet, by ce_ID
+	int						em_IDHashSize;		///< number of ID hash buckets, power of 2
+	int						em_IDHashCount;		///< number of events in ID hash
+	FThread 				*em_EventThread;	///< scheduler thread
+	FThread					*em_Workers[ EVENT_MANAGER_WORKERS ];	///< threads which are calling event functions
+	pthread_mutex_t			em_Mutex;			///< lock for heap and run queue
+	pthread_cond_t			em_Cond;			///< scheduler wakeup (CLOCK_MONOTONIC)
+	pthread_cond_t			em_WorkCond;		///< workers wakeup
+	FBOOL					em_Quit;			///< set when manager is closing
 	FUQUAD				em_IDGenerator;		// ID generator
 	void						*em_SB;
 	void						*em_Function;
@@ -72,17 +90,22 @@ void EventManagerDelete( EventManager *e );
 FUQUAD EventGetNewID( EventManager *em );
 
 //
-// add new event
+// add new event, returns event ID or 0 when error appear
+//
+
+FUQUAD EventAdd( EventManager *em, void *function, void *data, time_t nextCall, time_t deltaTime, int repeat );
+
+//
+// add new event, time in milliseconds, returns event ID or 0 when error appear
 //
 
-CoreEvent *EventAdd( EventManager *em, void *function, void *data, time_t nextCall, time_t deltaTime, int repeat );
-//CoreEvent *EventAdd( EventManager *em, FThread *thread, time_t nextCall, time_t deltaTime, int repeat );
+FUQUAD EventAddMS( EventManager *em, void *function, void *data, FUQUAD delayMS, FUQUAD intervalMS, int repeat );
 
 //
-// check event
+// remove event
 //
 
-CoreEvent *EventCheck( EventManager *em, CoreEvent *ev, time_t ti );
+int EventRemove( EventManager *em, FUQUAD id );
 
 
 
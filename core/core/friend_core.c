@@ -61,6 +61,7 @@
 
 #include <system/systembase.h>
 #include <core/friendcore_manager.h>
+#include <core/metrics.h>
 #include <openssl/crypto.h>
 
 //
@@ -301,173 +302,11 @@ void SignalHandler( int signal )
 struct fcThreadInstance 
 { 
 	FriendCoreInstance *fc;
+	FriendCoreReactor *reactor;
 	pthread_t thread;
-	struct epoll_event *event;
 	Socket *sock;
-	
-	// Incoming from accept
-	struct AcceptPair *acceptPair;
 };
 
-/**
- * Accepts a message to a Friend Core instance
- *
- * @param fcv pointer to thread instance of Friend Core
- * @return NULL
- */
-
-void *FriendCoreAccept( void *fcv )
-{
-	pthread_detach( pthread_self() );
-	
-	IncreaseThreads();
-	
-	struct fcThreadInstance *th = ( struct fcThreadInstance *)fcv;
-	
-	FriendCoreInstance *fc = ( FriendCoreInstance * )th->fc;
-
-	int incomingC = 0;
-	
-	// Get incoming
-	Socket *incoming = NULL;
-	int error = 0;
-	
-	// Get incoming socket
-	//DEBUG("Call socketaccept %p sockets %p accept %p\n", SocketAcceptPair,  fc->fci_Sockets, th->acceptPair );
-	incoming = SocketAcceptPair( fc->fci_Sockets, th->acceptPair );
-	//DEBUG( "[FriendCoreAccept] Done with SocketAcceptPair! %p\n", incoming );
-	
-	// We got incoming!
-	if( incoming != NULL )
-	{	
-		// Add instance reference
-		incoming->s_Data = fc;
-	#ifdef USE_SELECT
-	
-	#else
-		pthread_mutex_lock( &incoming->mutex );
-		/// Add to epoll
-		// TODO: Check return of epoll ctl
-		struct epoll_event event;
-		event.data.fd = incoming->fd;
-		event.data.ptr = incoming;
-		event.events = EPOLLIN | EPOLLET; // old way | EPOLLET | EPOLLHUP | EPOLLRDHUP;
-		error = epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_ADD, incoming->fd, &event );
-	
-		DEBUG("[FriendCoreAccept] Event added, shutdown %d error %d fd %d\n", fci->fci_Shutdown, error, incoming->fd  );
-	
-		pthread_mutex_unlock( &incoming->mutex );
-	#endif // USE_SELECT
-	
-		if( fc->fci_Shutdown == TRUE )
-		{
-			DEBUG("[FriendCoreAccept] incomming ptr %p\n", incoming );
-			shutdown( th->acceptPair->fd, SHUT_RDWR );
-			//DEBUG("[FriendCoreAccept] Close fd\n");
-			close( th->acceptPair->fd );
-		}
-	}
-	
-	// Don't need these anymore
-	//DEBUG("[FriendCoreAccept] Closeing acceptance\n");
-	if( th != NULL )
-	{
-		if( th->acceptPair != NULL )
-		{
-			FFree( th->acceptPair );
-			th->acceptPair = NULL;
-		}
-		FFree( th );
-		th = NULL;
-	}
-	
-	//DEBUG("[FriendCoreAccept]  END\n");
-	
-	// This is an in-thread threadcount decreasing, spawned by
-	// code in FriendCoreAcceptPhase1 (further below in this file)
-	DecreaseThreads();
-	
-	pthread_exit( 0 );
-	return NULL;
-}
-
-/**
- * Processes phase 1 of acceptation process.
- *
- * @param d pointer to Friend Core instance
- * @return unintialised pointer to a void
- */
-void *FriendCoreAcceptPhase1( void *d )
-{
-	pthread_detach( pthread_self() );
-	
-	IncreaseThreads();
-
-	struct fcThreadInstance *pre = ( struct fcThreadInstance *)d;
-	
-	// Ready our accept pair
-	struct AcceptPair *p = NULL;
-	
-	// Run accept() and return an accept pair
-	for( ; ( p = DoAccept( pre->fc->fci_Sockets ) ) != NULL ; )
-	{
-		// Shutting down
-		if( pre->fc->fci_Shutdown == TRUE )
-		{
-			shutdown( p->fd, SHUT_RDWR );
-			close( p->fd );
-			FFree( p );
-			DEBUG("[FriendCoreAcceptPhase1] Shutdown on\n");
-			break;
-		}
-		// Not shutting down
-		else
-		{
-			// Add the new SSL accept thread:
-			// We have a notification on the listening socket, which means one or more incoming connections.
-		
-			struct fcThreadInstance *idata = FCalloc( 1, sizeof( struct fcThreadInstance ) );
-			if( idata != NULL )
-			{
-				idata->fc = pre->fc;
-				idata->acceptPair = p;
-				memset( &idata->thread, 0, sizeof( pthread_t ) );
-				DEBUG("Create FriendCoreAccept thread\n");
-			
-				// Multithread mode
-				if( pthread_create( &idata->thread, NULL, &FriendCoreAccept, ( void *)idata ) != 0 )
-				{
-					FFree( idata );
-					// Clean up accept pair
-					shutdown( p->fd, SHUT_RDWR );
-					close( p->fd );
-					FFree( p );
-				}
-				else
-				{
-					//IncreaseThreads();
-				}
-			}
-			else
-			{
-				FERROR("[FriendCoreAcceptPhase1] Cannot allocate memory for Thread\n");
-			}
-		}
-		pthread_yield();
-	}
-	if( pre != NULL )
-	{
-		FFree( pre ); // <- remove thread instance
-		pre = NULL;
-	}
-
-	DecreaseThreads();
-	
-	pthread_exit( 0 );
-	return NULL;
-}
-
-
 /**
  * Processes Friend Core messages
  *
@@ -495,7 +334,8 @@ void *FriendCoreProcess__httponthefly( void *fcv )
 	}
 	
 	// First pass header, second, data
-	int pass = 0, bodyLength = 0, prevBufSize = 0, preroll = 0, stopReading = 0;
+	int pass = 0, preroll = 0, stopReading = 0;
+	FQUAD bodyLength = 0, prevBufSize = 0;
 	
 	// Often used
 	int partialDivider = 0, foundDivider = 0, y = 0, x = 0, yc = 0, yy = 0;
@@ -589,7 +429,7 @@ void *FriendCoreProcess__httponthefly( void *fcv )
 								//bodyLength = atoi( content );
 								int headerLength = divider - resultString->ht_Buffer + 4;
 								
-								DEBUG("[FriendCoreProcess] Body length %d headerLength %d\n", bodyLength, headerLength );
+								DEBUG("[FriendCoreProcess] Body length %lld headerLength %d\n", (long long)bodyLength, headerLength );
 								
 								if( bodyLength == 124 )
 								{
@@ -748,7 +588,8 @@ void *FriendCoreProcess( void *fcv )
 	// Let's go!
 	
 	// First pass header, second, data
-	int pass = 0, bodyLength = 0, prevBufSize = 0, preroll = 0, stopReading = 0;
+	int pass = 0, preroll = 0, stopReading = 0;
+	FQUAD bodyLength = 0, prevBufSize = 0;
 
 	// Often used
 	int partialDivider = 0, foundDivider = 0, y = 0;
@@ -757,6 +598,10 @@ void *FriendCoreProcess( void *fcv )
 	int bufferSize = HTTP_READ_BUFFER_DATA_SIZE;
 	int bufferSizeAlloc = HTTP_READ_BUFFER_DATA_SIZE_ALLOC;
 	
+	// Multipart body, when it is big it goes to file instead of memory
+	SystemBase *lsb = (SystemBase *)th->fc->fci_SB;
+	Http *uploadRequest = NULL;
+	
 	char *locBuffer = FCalloc( bufferSizeAlloc, sizeof( char ) );
 	if( locBuffer != NULL )
 	{
@@ -773,7 +618,9 @@ void *FriendCoreProcess( void *fcv )
 				break;
 			}
 
-			int count = preroll, res = 0, joints = 0, methodGet = 0;
+			// bytes read in this pass, body can be bigger than 2GB
+			FQUAD count = preroll;
+			int res = 0, joints = 0, methodGet = 0;
 
 			//DEBUG( "[FriendCoreProcess] Trying to read headers..\n" );
 
@@ -796,7 +643,24 @@ void *FriendCoreProcess( void *fcv )
 				
 				if( ( res = SocketRead( incoming, locBuffer, bufferSize, pass ) ) > 0 )
 				{
-					BufStringAddSize( resultString, locBuffer, res );
+					if( pass == 1 && uploadRequest != NULL )
+					{
+						uploadRequest->h_ContentReceived += res;
+						__sync_fetch_and_add( &(lsb->sl_UploadBytesReceived), res );
+					}
+					
+					if( pass == 1 && uploadRequest != NULL && uploadRequest->h_ContentFile != NULL )
+					{
+						if( fwrite( locBuffer, 1, res, uploadRequest->h_ContentFile ) != (size_t)res )
+						{
+							FERROR("[FriendCoreProcess] Cannot store uploaded data in temporary file\n");
+							break;
+						}
+					}
+					else
+					{
+						BufStringAddSize( resultString, locBuffer, res );
+					}
 
 					if( pass == 0 && partialDivider != 0 )
 					{
@@ -903,6 +767,27 @@ void *FriendCoreProcess( void *fcv )
 						
 						// We have enough data and are ready for reading the body
 						int headerLength = divider - resultString->bs_Buffer + 4;
+						
+						if( request->h_ContentType == HTTP_CONTENT_TYPE_MULTIPART )
+						{
+							uploadRequest = request;
+							uploadRequest->h_ContentReceived = resultString->bs_Size - headerLength;
+							__sync_fetch_and_add( &(lsb->sl_UploadsActive), 1 );
+							__sync_fetch_and_add( &(lsb->sl_UploadBytesReceived), uploadRequest->h_ContentReceived );
+							
+							// Big uploads are written to disk as they arrive, memory use does not grow with file size
+							if( bodyLength > lsb->sl_UploadMemoryLimit && HttpContentFileOpen( request ) == 0 )
+							{
+								int storedBody = resultString->bs_Size - headerLength;
+								if( storedBody > 0 )
+								{
+									fwrite( resultString->bs_Buffer + headerLength, 1, storedBody, request->h_ContentFile );
+									resultString->bs_Size = headerLength;
+									resultString->bs_Buffer[ headerLength ] = 0;
+								}
+							}
+						}
+						
 						if( count > headerLength )
 						{
 							prevBufSize += count;
@@ -924,6 +809,12 @@ void *FriendCoreProcess( void *fcv )
 				prevBufSize += count;
 			}
 		}	// for pass 0 < 2
+		
+		if( uploadRequest != NULL )
+		{
+			DEBUG( "[FriendCoreProcess] Upload received %lld of %lld bytes\n", (long long)uploadRequest->h_ContentReceived, (long long)uploadRequest->h_ContentLength );
+			__sync_fetch_and_sub( &(lsb->sl_UploadsActive), 1 );
+		}
 	
 		//DEBUG( "[FriendCoreProcess] Exited headers loop. Now freeing up.\n" );
 
@@ -1057,27 +948,23 @@ struct AcceptPair *DoAccept( Socket *sock )
 	if( p != NULL )
 	{
 		p->fd = fd;
+		p->acceptTime = MetricsTime();
 		memcpy( &p->client, &client, sizeof( struct sockaddr_in6 ) );
 	}
 
 	return p;
 }
 
-#ifdef USE_SELECT
 /**
- * Polls all Friend Core messages via Select().
+ * Sets up SIGINT handler used by all reactors
  *
- * This is the main loop of the Friend Core system
- *
- * @param fc pointer to Friend Core instance to poll
+ * @param fc pointer to Friend Core instance
  */
-inline void FriendCoreSelect( FriendCoreInstance* fc )
+static void FriendCoreSignalsSetup( FriendCoreInstance* fc )
 {
-	// add communication ReadCommPipe		
-	//signal(SIGINT, test);
 	// Handle signals and block while going on!
 	struct sigaction setup_action;
-	sigset_t block_mask, curmask; 
+	sigset_t block_mask; 
 	sigemptyset( &block_mask );
 	// Block other terminal-generated signals while handler runs.
 	sigaddset( &block_mask, SIGINT );
@@ -1088,34 +975,41 @@ inline void FriendCoreSelect( FriendCoreInstance* fc )
 	setup_action.sa_mask = block_mask;
 	setup_action.sa_flags = 0;
 	sigaction( SIGINT, &setup_action, NULL );
-	sigprocmask( SIG_SETMASK, NULL, &curmask );
 	fci = fc;
+}
+
+#ifdef USE_SELECT
+/**
+ * Polls all Friend Core messages via Select().
+ *
+ * This is the main loop of the Friend Core system
+ *
+ * @param fc pointer to Friend Core instance to poll
+ */
+inline void FriendCoreSelect( FriendCoreInstance* fc )
+{
+	// select() supports only one reactor
+	FriendCoreReactor *r = &(fc->fci_Reactors[ 0 ]);
 	
-	int pipefds[2] = {};
-	pipe( pipefds );	
-	fc->fci_ReadCorePipe = pipefds[ 0 ]; fc->fci_WriteCorePipe = pipefds[ 1 ];
-	
-	// Read buffer
-	char buffer[ fc->fci_BufferSize ];
-	int maxd = fc->fci_Sockets->fd;
-	if( fc->fci_ReadCorePipe > maxd )
+	int maxd = r->fcr_Socket->fd;
+	if( r->fcr_ReadPipe > maxd )
 	{
-		maxd = fc->fci_ReadCorePipe;
+		maxd = r->fcr_ReadPipe;
 	}
 	
 	fd_set readfds;
 	
-	SocketSetBlocking( fc->fci_Sockets, TRUE );
+	SocketSetBlocking( r->fcr_Socket, TRUE );
 	
 	// All incoming network events go through here
 	while( !fc->fci_Shutdown )
 	{
 		FD_ZERO( &readfds );
 		
-		FD_SET( fc->fci_Sockets->fd, &readfds );
-		FD_SET( fc->fci_ReadCorePipe, &readfds );
+		FD_SET( r->fcr_Socket->fd, &readfds );
+		FD_SET( r->fcr_ReadPipe, &readfds );
 		
-		DEBUG("[FriendCoreSelect] Before select, maxd %d  pipe %d socket %d\n", maxd, fc->fci_ReadCorePipe, fc->fci_Sockets->fd );
+		DEBUG("[FriendCoreSelect] Before select, maxd %d  pipe %d socket %d\n", maxd, r->fcr_ReadPipe, r->fcr_Socket->fd );
 		
 		int activity = select( maxd+1, &readfds, NULL, NULL, NULL );
 		
@@ -1126,7 +1020,7 @@ inline void FriendCoreSelect( FriendCoreInstance* fc )
 			DEBUG("[FriendCoreSelect] Select error\n");
 		}
 		
-		if( FD_ISSET( fc->fci_ReadCorePipe, &readfds ) )
+		if( FD_ISSET( r->fcr_ReadPipe, &readfds ) )
 		{
 			DEBUG("[FriendCoreSelect] Received from PIPE\n");
 			// read all bytes from read end of pipe
@@ -1137,7 +1031,7 @@ inline void FriendCoreSelect( FriendCoreInstance* fc )
 			
 			while( result > 0 )
 			{
-				result = read( fc->fci_ReadCorePipe, &ch, 1 );
+				result = read( r->fcr_ReadPipe, &ch, 1 );
 				DEBUG("[FriendCoreSelect] FC Read from pipe %c\n", ch );
 				if( ch == 'q' )
 				{
@@ -1154,16 +1048,17 @@ inline void FriendCoreSelect( FriendCoreInstance* fc )
 			}
 		}
 		
-		if( FD_ISSET( fc->fci_Sockets->fd, &readfds ) )
+		if( FD_ISSET( r->fcr_Socket->fd, &readfds ) )
 		{
 			DEBUG("[FriendCoreSelect] Sockets received\n");
 			
-			FD_CLR( fc->fci_Sockets->fd, &readfds );
+			FD_CLR( r->fcr_Socket->fd, &readfds );
 			
-			Socket *sock = SocketAccept( fc->fci_Sockets );
+			Socket *sock = SocketAccept( r->fcr_Socket );
 			
 			if( sock != NULL )
 			{
+				MetricsCounterAdd( METRIC_COUNTER_CONNECTIONS, 1 );
 				SocketSetBlocking( sock, TRUE );
 			
 				// go on and accept on the socket
@@ -1171,6 +1066,7 @@ inline void FriendCoreSelect( FriendCoreInstance* fc )
 				if( pre != NULL )
 				{
 					pre->fc = fc;
+					pre->reactor = r;
 					pre->sock = sock;
 					if( pthread_create( &pre->thread, NULL, &FriendCoreProcess, ( void *)pre ) != 0 )
 					{
@@ -1185,50 +1081,165 @@ inline void FriendCoreSelect( FriendCoreInstance* fc )
 }
 #else
 /**
- * Polls all Friend Core messages.
+ * Adds socket to reactor epoll set or modifies its events. Until TLS
+ * handshake is done socket waits for event which handshake needs.
  *
- * This is the main loop of the Friend Core system
+ * @param r pointer to reactor
+ * @param sock pointer to socket
+ * @param op EPOLL_CTL_ADD or EPOLL_CTL_MOD
+ * @return 0 when success, otherwise error number
+ */
+static int FriendCoreWatchSocket( FriendCoreReactor *r, Socket *sock, int op )
+{
+	struct epoll_event event;
+	memset( &event, 0, sizeof( event ) );
+	event.data.ptr = sock;
+	event.events = ( sock->s_HandshakeState == SOCKET_HANDSHAKE_WANT_WRITE ? EPOLLOUT : EPOLLIN ) | EPOLLET;
+	
+	return epoll_ctl( r->fcr_Epollfd, op, sock->fd, &event );
+}
+
+/**
+ * Removes socket from reactor and starts thread which reads and processes request
  *
- * @param fc pointer to Friend Core instance to poll
+ * @param r pointer to reactor
+ * @param sock pointer to socket with incoming data
+ */
+static void FriendCoreDispatch( FriendCoreReactor *r, Socket *sock )
+{
+	FriendCoreInstance *fc = r->fcr_FC;
+	
+	pthread_mutex_lock( &sock->mutex );
+	epoll_ctl( r->fcr_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
+	pthread_mutex_unlock( &sock->mutex );
+	
+	// Process
+	//DEBUG( "Ready for reading, processing %d!!\n", sock->fd );
+	if( !fc->fci_Shutdown )
+	{
+		struct fcThreadInstance *pre = FCalloc( 1, sizeof( struct fcThreadInstance ) );
+		if( pre != NULL )
+		{
+			pre->fc = fc; pre->reactor = r; pre->sock = sock;
+		
+			size_t stacksize = 16777216; //16 * 1024 * 1024;
+			pthread_attr_t attr;
+			pthread_attr_init( &attr );
+			pthread_attr_setstacksize( &attr, stacksize );
+			
+			// Make sure we keep the number of threads under the limit
+			if( pthread_create( &pre->thread, &attr, &FriendCoreProcess, ( void *)pre ) != 0 )
+			{
+				FFree( pre );
+			}
+		}
+	}
+}
+
+/**
+ * Continues TLS handshake of socket when epoll reported event it waited for
+ *
+ * @param r pointer to reactor
+ * @param sock pointer to socket
+ * @param events events reported by epoll
+ */
+static void FriendCoreHandshake( FriendCoreReactor *r, Socket *sock, uint32_t events )
+{
+	int state = -1;
+	
+	if( !( events & ( EPOLLERR | EPOLLHUP ) ) && !r->fcr_FC->fci_Shutdown )
+	{
+		state = SocketAcceptHandshake( sock );
+	}
+	
+	if( state < 0 )
+	{
+		epoll_ctl( r->fcr_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
+		SocketClose( sock );
+	}
+	// request could be already decrypted and buffered during handshake
+	else if( state == SOCKET_HANDSHAKE_DONE && SSL_pending( sock->s_Ssl ) > 0 )
+	{
+		FriendCoreDispatch( r, sock );
+	}
+	// wait for request or for next handshake step
+	else if( FriendCoreWatchSocket( r, sock, EPOLL_CTL_MOD ) != 0 )
+	{
+		epoll_ctl( r->fcr_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
+		SocketClose( sock );
+	}
+}
+
+/**
+ * Accepts all waiting connections on reactor listening socket.
+ * TLS handshake is started here and continued by reactor events,
+ * no thread is created per connection.
+ *
+ * @param r pointer to reactor
+ */
+static void FriendCoreAcceptAll( FriendCoreReactor *r )
+{
+	FriendCoreInstance *fc = r->fcr_FC;
+	struct AcceptPair *p = NULL;
+	
+	// Run accept() until there are no more connections
+	while( ( p = DoAccept( r->fcr_Socket ) ) != NULL )
+	{
+		// Shutting down
+		if( fc->fci_Shutdown == TRUE )
+		{
+			shutdown( p->fd, SHUT_RDWR );
+			close( p->fd );
+			FFree( p );
+			DEBUG("[FriendCoreAcceptAll] Shutdown on\n");
+			break;
+		}
+		
+		Socket *incoming = SocketAcceptPair( r->fcr_Socket, p );
+		if( incoming != NULL )
+		{
+			// Add instance reference
+			incoming->s_Data = fc;
+			
+			MetricsRecordSince( METRIC_STAGE_ACCEPT, p->acceptTime );
+			MetricsCounterAdd( METRIC_COUNTER_CONNECTIONS, 1 );
+			
+			/// Add to epoll of reactor which accepted connection, it stays there until it is closed
+			if( FriendCoreWatchSocket( r, incoming, EPOLL_CTL_ADD ) != 0 )
+			{
+				FERROR("[FriendCoreAcceptAll] Cannot add socket %d to reactor %d\n", incoming->fd, r->fcr_ID );
+				SocketClose( incoming );
+			}
+		}
+		FFree( p );
+	}
+}
+
+/**
+ * Polls all Friend Core messages of one reactor.
+ *
+ * This is the main loop of the Friend Core system, every reactor runs it
+ * on own listening socket and epoll set
+ *
+ * @param r pointer to reactor to poll
  */
-inline void FriendCoreEpoll( FriendCoreInstance* fc )
+void FriendCoreEpoll( FriendCoreReactor* r )
 {
+	FriendCoreInstance *fc = r->fcr_FC;
 	int eventCount = 0;
-	int retval;
-	int i, ii;
+	int i;
 	struct epoll_event *currentEvent;
 	struct epoll_event *events = FCalloc( fc->fci_MaxPoll, sizeof( struct epoll_event ) );
-	ssize_t count;
-	Socket *sock = NULL;
-	
-	// Read buffer
-	char buffer[ fc->fci_BufferSize ];
-	
-	// add communication ReadCommPipe		
-	int pipefds[2] = {}; struct epoll_event piev = { 0 };	
-	pipe( pipefds );	
-	fc->fci_ReadCorePipe = pipefds[ 0 ]; fc->fci_WriteCorePipe = pipefds[ 1 ];
-	// add the read end to the epoll
-	piev.events = EPOLLIN; piev.data.fd = fc->fci_ReadCorePipe;
-	int err = epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_ADD, fc->fci_ReadCorePipe, &piev );
-	if( err != 0 )
+	sigset_t curmask;
+	
+	if( events == NULL )
 	{
-		LOG( FLOG_PANIC,"Cannot add main event %d\n", err );
+		FERROR("[FriendCoreEpoll] Cannot allocate memory for events, reactor %d\n", r->fcr_ID );
+		return;
 	}
-
-	// Handle signals and block while going on!
-	struct sigaction setup_action;
-	sigset_t block_mask, curmask; 
-	sigemptyset( &block_mask );
-	// Block other terminal-generated signals while handler runs.
-	sigaddset( &block_mask, SIGINT );
-	setup_action.sa_handler = SignalHandler;
-	setup_action.sa_restorer = NULL;
-	setup_action.sa_mask = block_mask;
-	setup_action.sa_flags = 0;
-	sigaction( SIGINT, &setup_action, NULL );
-	sigprocmask( SIG_SETMASK, NULL, &curmask );
-	fci = fc;
+	
+	// SIGINT handler was set in FriendCoreRun, every thread has its own mask
+	pthread_sigmask( SIG_SETMASK, NULL, &curmask );
 
 	// All incoming network events go through here
 	while( !fc->fci_Shutdown )
@@ -1236,7 +1247,7 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 		//DEBUG("[FriendCoreEpoll] Before Epoll wait FC\n");
 		// Wait for something to happen on any of the sockets we're listening on
 		
-		eventCount = epoll_pwait( fc->fci_Epollfd, events, fc->fci_MaxPoll, -1, &curmask );
+		eventCount = epoll_pwait( r->fcr_Epollfd, events, fc->fci_MaxPoll, -1, &curmask );
 		
 		//DEBUG("[FriendCoreEpoll] After Epoll wait FC\n");
 
@@ -1245,18 +1256,23 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 			currentEvent = &events[i];
 			Socket *sock = ( Socket *)currentEvent->data.ptr;
 			
+			// TLS handshake in progress, it is continued on reactor
+			if( currentEvent->data.ptr != r && sock != r->fcr_Socket && sock->s_HandshakeState != SOCKET_HANDSHAKE_DONE )
+			{
+				FriendCoreHandshake( r, sock, currentEvent->events );
+			}
 			// Ok, we have a problem with our connection
-			if( 
+			else if( 
 				( ( currentEvent->events & EPOLLERR ) ||
 				( currentEvent->events & EPOLLRDHUP ) ||
 				( currentEvent->events & EPOLLHUP ) ) || 
 				!( currentEvent->events & EPOLLIN ) 
 			)
 			{
-				if( currentEvent->data.fd == fc->fci_Sockets->fd )
+				if( sock == r->fcr_Socket || currentEvent->data.ptr == r )
 				{
 					// Oups! We have gone away!
-					DEBUG( "[FriendCoreEpoll] Socket went away!\n" );
+					DEBUG( "[FriendCoreEpoll] Reactor %d socket went away!\n", r->fcr_ID );
 					break;
 				}
 								
@@ -1265,7 +1281,7 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 				if( sock != NULL )
 				{
 					DEBUG("[FriendCoreEpoll] FD %d\n", sock->fd );
-					epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
+					epoll_ctl( r->fcr_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
 					SocketClose( sock );
 				}
 			}
@@ -1274,17 +1290,17 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 				DEBUG( "[FriendCoreEpoll] Wake up!\n" );
 			}
 			// First handle pipe messages
-			else if( currentEvent->data.fd == fc->fci_ReadCorePipe )
+			else if( currentEvent->data.ptr == r )
 			{
 				// read all bytes from read end of pipe
 				char ch;
 				int result = 1;
 					
-				DEBUG("[FriendCoreEpoll] FC Reads from pipe!\n");
+				DEBUG("[FriendCoreEpoll] FC Reads from pipe, reactor %d!\n", r->fcr_ID );
 				
 				while( result > 0 )
 				{
-					result = read( fc->fci_ReadCorePipe, &ch, 1 );
+					result = read( r->fcr_ReadPipe, &ch, 1 );
 					if( ch == 'q' )
 					{
 						fc->fci_Shutdown = TRUE;
@@ -1295,85 +1311,184 @@ inline void FriendCoreEpoll( FriendCoreInstance* fc )
 				
 				if( fc->fci_Shutdown == TRUE )
 				{
-					LOG( FLOG_INFO, "[FriendCoreEpoll] Core shutdown in porgress\n");
+					LOG( FLOG_INFO, "[FriendCoreEpoll] Core shutdown in porgress, reactor %d\n", r->fcr_ID );
 					break;
 				}
 			}
 			// Accept incoming connections
-			else if( currentEvent->data.fd == fc->fci_Sockets->fd && !fc->fci_Shutdown )
+			else if( sock == r->fcr_Socket && !fc->fci_Shutdown )
 			{	
-				// Setup for reading
-				//DEBUG( "We got an incoming connection.\n" );
-				struct fcThreadInstance *pre = FCalloc( 1, sizeof( struct fcThreadInstance ) );
-				if( pre != NULL )
-				{
-					pre->fc = fc;
-					// TODO: Make sure we keep the number of threads under the limit
-					if( pthread_create( &pre->thread, NULL, &FriendCoreAcceptPhase1, ( void *)pre ) != 0 )
-					{
-						FFree( pre );
-					}
-				}
+				FriendCoreAcceptAll( r );
 			}
 			// Get event that are incoming!
 			else if( currentEvent->events & EPOLLIN )
 			{
-				pthread_mutex_lock( &sock->mutex );
-				epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DEL, sock->fd, NULL );
-				pthread_mutex_unlock( &sock->mutex );
-				
-				// Process
-				//DEBUG( "Ready for reading, processing %d!!\n", sock->fd );
-				if( !fc->fci_Shutdown )
-				{
-					struct fcThreadInstance *pre = FCalloc( 1, sizeof( struct fcThreadInstance ) );
-					if( pre != NULL )
-					{
-						pre->fc = fc; pre->sock = sock;
-					
-						size_t stacksize = 16777216; //16 * 1024 * 1024;
-						pthread_attr_t attr;
-						pthread_attr_init( &attr );
-						pthread_attr_setstacksize( &attr, stacksize );
-						
-						// Make sure we keep the number of threads under the limit
-						if( pthread_create( &pre->thread, &attr, &FriendCoreProcess, ( void *)pre ) != 0 )
-						{
-							FFree( pre );
-						}
-					}
-				}
+				FriendCoreDispatch( r, sock );
 			}
 		}
 	}
 	
-	usleep( 1 );
+	// Free epoll events
+	FFree( events );
 	
-	// check number of working threads
-	while( TRUE )
+	DEBUG( "[FriendCoreEpoll] Done freeing events, reactor %d\n", r->fcr_ID );
+}
+
+/**
+ * Reactor thread
+ *
+ * @param d pointer to reactor
+ * @return NULL
+ */
+static void *FriendCoreReactorThread( void *d )
+{
+	FriendCoreReactor *r = (FriendCoreReactor *)d;
+	
+	DEBUG("[FriendCoreReactorThread] Reactor %d started\n", r->fcr_ID );
+	
+	FriendCoreEpoll( r );
+	
+	DEBUG("[FriendCoreReactorThread] Reactor %d stopped\n", r->fcr_ID );
+	return NULL;
+}
+#endif
+
+/**
+ * Closes reactor listening socket, epoll and wake up pipe
+ *
+ * @param r pointer to reactor
+ */
+static void FriendCoreReactorClose( FriendCoreReactor *r )
+{
+#ifndef USE_SELECT
+	if( r->fcr_Epollfd >= 0 )
 	{
-		if( nothreads <= 0 )
-		{
-			DEBUG("[FriendCoreEpoll] Number of threads %d\n", nothreads );
-			break;
-		}
-		usleep( 5000 );
-		DEBUG("[FriendCoreEpoll] Number of threads %d, waiting .....\n", nothreads );
+		close( r->fcr_Epollfd );
+		r->fcr_Epollfd = -1;
 	}
+#endif
+	if( r->fcr_Socket != NULL )
+	{
+		SocketClose( r->fcr_Socket );
+		r->fcr_Socket = NULL;
+	}
+	if( r->fcr_ReadPipe >= 0 )
+	{
+		close( r->fcr_ReadPipe );
+		r->fcr_ReadPipe = -1;
+	}
+	if( r->fcr_WritePipe >= 0 )
+	{
+		close( r->fcr_WritePipe );
+		r->fcr_WritePipe = -1;
+	}
+}
+
+/**
+ * Opens reactor listening socket, epoll set and wake up pipe
+ *
+ * @param fc pointer to Friend Core instance
+ * @param r pointer to reactor
+ * @param type SOCKET_TYPE_SERVER_REUSEPORT when port is shared with other reactors, otherwise SOCKET_TYPE_SERVER
+ * @return 0 when success, otherwise error number
+ */
+static int FriendCoreReactorOpen( FriendCoreInstance* fc, FriendCoreReactor *r, int type )
+{
+	r->fcr_FC = fc;
+	r->fcr_Epollfd = -1;
+	r->fcr_ReadPipe = -1;
+	r->fcr_WritePipe = -1;
 	
-	// Free epoll events
-	FFree( events );
+	// Open new socket for lisenting
+	r->fcr_Socket = SocketOpen( fc->fci_SB, fc->fci_SSLEnabled, fc->fci_Port, type );
+	if( r->fcr_Socket == NULL )
+	{
+		return -1;
+	}
+	
+	// Non blocking listening!
+	if( SocketSetBlocking( r->fcr_Socket, FALSE ) == -1 )
+	{
+		FriendCoreReactorClose( r );
+		return -2;
+	}
 	
-	DEBUG( "[FriendCoreEpoll] Done freeing events" );
-	events = NULL;
+	if( SocketListen( r->fcr_Socket ) != 0 )
+	{
+		FriendCoreReactorClose( r );
+		return -3;
+	}
 	
-	// Free pipes!
-	close( fc->fci_ReadCorePipe );
-	close( fc->fci_WriteCorePipe );
+	int pipefds[ 2 ] = {};
+	if( pipe( pipefds ) != 0 )
+	{
+		FERROR( "[FriendCore] Cannot create pipe for reactor %d\n", r->fcr_ID );
+		FriendCoreReactorClose( r );
+		return -4;
+	}
+	r->fcr_ReadPipe = pipefds[ 0 ]; r->fcr_WritePipe = pipefds[ 1 ];
 	
-	fc->fci_Closed = TRUE;
-}
+#ifndef USE_SELECT
+	// Create epoll
+	r->fcr_Epollfd = epoll_create1( 0 );
+	if( r->fcr_Epollfd == -1 )
+	{
+		FERROR( "[FriendCore] epoll_create\n" );
+		FriendCoreReactorClose( r );
+		return -5;
+	}
+
+	// Register for events
+	struct epoll_event event;
+	memset( &event, 0, sizeof( event ) );
+	event.data.ptr = r->fcr_Socket;
+	event.events = EPOLLIN | EPOLLET;
+	
+	if( epoll_ctl( r->fcr_Epollfd, EPOLL_CTL_ADD, r->fcr_Socket->fd, &event ) == -1 )
+	{
+		LOG( FLOG_ERROR, "[FriendCore] epoll_ctl\n" );
+		FriendCoreReactorClose( r );
+		return -6;
+	}
+	
+	// add the read end of pipe to the epoll
+	memset( &event, 0, sizeof( event ) );
+	event.data.ptr = r;
+	event.events = EPOLLIN;
+	
+	if( epoll_ctl( r->fcr_Epollfd, EPOLL_CTL_ADD, r->fcr_ReadPipe, &event ) == -1 )
+	{
+		LOG( FLOG_PANIC, "Cannot add main event, reactor %d\n", r->fcr_ID );
+		FriendCoreReactorClose( r );
+		return -7;
+	}
 #endif
+	return 0;
+}
+
+/**
+ * Wakes up all reactors, used to signal shutdown
+ *
+ * @param fc pointer to Friend Core instance
+ */
+void FriendCoreWakeUp( FriendCoreInstance* fc )
+{
+	FriendCoreReactor *reactors = fc->fci_Reactors;
+	int i;
+	
+	if( reactors == NULL )
+	{
+		return;
+	}
+	
+	for( i = 0; i < fc->fci_ReactorsNumber; i++ )
+	{
+		if( reactors[ i ].fcr_WritePipe >= 0 )
+		{
+			write( reactors[ i ].fcr_WritePipe, "q", 1 );
+		}
+	}
+}
 
 /**
  * Launches an instance of Friend Core.
@@ -1415,82 +1530,132 @@ int FriendCoreRun( FriendCoreInstance* fc )
 	//fc->fci_WorkerManager = WorkerManagerNew( MAX_WORKERS );
 	LOG( FLOG_INFO,"[FriendCore] WorkerManager started\n");
 	
-	SystemBase *lsb = (SystemBase *)fc->fci_SB;
-	
-	// Open new socket for lisenting
-	//DEBUG( "We are %s SSL\n", fc->fci_SSLEnabled ? "enabling" : "disabling" );
-	fc->fci_Sockets = SocketOpen( lsb, fc->fci_SSLEnabled, fc->fci_Port, SOCKET_TYPE_SERVER );
+	// One reactor per CPU core by default
+	int i, opened = 0;
+	int reactorsNumber = fc->fci_ReactorsNumber;
+	if( reactorsNumber <= 0 )
+	{
+		reactorsNumber = (int)sysconf( _SC_NPROCESSORS_ONLN );
+	}
+	if( reactorsNumber <= 0 )
+	{
+		reactorsNumber = 1;
+	}
+	else if( reactorsNumber > FRIEND_CORE_MAX_REACTORS )
+	{
+		reactorsNumber = FRIEND_CORE_MAX_REACTORS;
+	}
+#ifdef USE_SELECT
+	reactorsNumber = 1;
+#endif
 	
-	if( fc->fci_Sockets == NULL )
+	FriendCoreReactor *reactors = FCalloc( reactorsNumber, sizeof( FriendCoreReactor ) );
+	if( reactors == NULL )
 	{
+		FERROR("[FriendCore] Cannot allocate memory for reactors\n");
 		fc->fci_Closed = TRUE;
 		return -1;
 	}
 	
-	// Non blocking listening!
-	if( SocketSetBlocking( fc->fci_Sockets, FALSE ) == -1 )
+	for( i = 0; i < reactorsNumber; i++ )
+	{
+		reactors[ i ].fcr_ID = i;
+		if( FriendCoreReactorOpen( fc, &(reactors[ i ]), reactorsNumber > 1 ? SOCKET_TYPE_SERVER_REUSEPORT : SOCKET_TYPE_SERVER ) != 0 )
+		{
+			break;
+		}
+		opened++;
+	}
+	
+	// SO_REUSEPORT is not supported, fallback to one listening socket
+	if( opened == 0 && reactorsNumber > 1 )
 	{
-		SocketClose( fc->fci_Sockets );
+		if( FriendCoreReactorOpen( fc, &(reactors[ 0 ]), SOCKET_TYPE_SERVER ) == 0 )
+		{
+			opened++;
+		}
+	}
+	
+	if( opened == 0 )
+	{
+		FFree( reactors );
 		fc->fci_Closed = TRUE;
 		return -1;
 	}
 	
-	if( SocketListen( fc->fci_Sockets ) != 0 )
+	if( opened < reactorsNumber )
 	{
-		SocketClose( fc->fci_Sockets );
-		fc->fci_Closed= TRUE;
-		return -1;
+		LOG( FLOG_ERROR, "[FriendCore] Only %d of %d reactors could be started\n", opened, reactorsNumber );
 	}
 	
+	fc->fci_ReactorsNumber = opened;
+	fc->fci_Reactors = reactors;
+	
 	pipe2( fc->fci_SendPipe, 0 );
 	pipe2( fc->fci_RecvPipe, 0 );
+	
+	FriendCoreSignalsSetup( fc );
+	
+	LOG( FLOG_INFO, "[FriendCore] Listening on port %d, reactors: %d\n", fc->fci_Port, opened );
 
 #ifdef USE_SELECT
 	
 	FriendCoreSelect( fc );
 	
 #else
-	// Create epoll
-	fc->fci_Epollfd = epoll_create1( 0 );
-	if( fc->fci_Epollfd == -1 )
+	// First reactor runs in this thread, others in own threads
+	for( i = 1; i < opened; i++ )
 	{
-		FERROR( "[FriendCore] epoll_create\n" );
-		SocketClose( fc->fci_Sockets );
-		fc->fci_Closed = TRUE;
-		return -1;
+		if( pthread_create( &(reactors[ i ].fcr_Thread), NULL, &FriendCoreReactorThread, &(reactors[ i ]) ) == 0 )
+		{
+			reactors[ i ].fcr_ThreadStarted = TRUE;
+		}
+		else
+		{
+			// nobody would accept connections which kernel put on its socket
+			FERROR("[FriendCore] Cannot start reactor %d\n", i );
+			FriendCoreReactorClose( &(reactors[ i ]) );
+		}
 	}
-
-	// Register for events
-	struct epoll_event event;
-	memset( &event, 0, sizeof( event ) );
-	event.data.fd = fc->fci_Sockets->fd;
-	event.events = EPOLLIN | EPOLLET;
 	
-	if( epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_ADD, fc->fci_Sockets->fd, &event ) == -1 )
+	FriendCoreEpoll( &(reactors[ 0 ]) );
+	
+	// Make sure all reactors are stopped
+	FriendCoreWakeUp( fc );
+	for( i = 1; i < opened; i++ )
 	{
-		LOG( FLOG_ERROR, "[FriendCore] epoll_ctl\n" );
-		SocketClose( fc->fci_Sockets );
-		fc->fci_Closed = TRUE;
-		return -1;
+		if( reactors[ i ].fcr_ThreadStarted == TRUE )
+		{
+			pthread_join( reactors[ i ].fcr_Thread, NULL );
+			reactors[ i ].fcr_ThreadStarted = FALSE;
+		}
 	}
-
-	DEBUG("[FriendCore] Listening.\n");
-	FriendCoreEpoll( fc );
-
-	if( epoll_ctl( fc->fci_Epollfd, EPOLL_CTL_DEL, fc->fci_Sockets->fd, &event ) == -1 )
+#endif
+	
+	usleep( 1 );
+	
+	// check number of working threads
+	while( TRUE )
 	{
-		LOG( FLOG_ERROR, "[FriendCore] epoll_ctl can not remove connection!\n" );
+		if( nothreads <= 0 )
+		{
+			DEBUG("[FriendCore] Number of threads %d\n", nothreads );
+			break;
+		}
+		usleep( 5000 );
+		DEBUG("[FriendCore] Number of threads %d, waiting .....\n", nothreads );
 	}
-#endif
 	
 	// Server is shutting down
 	DEBUG("[FriendCore] Shutting down.\n");
-	if( fc->fci_Sockets )
+	fc->fci_Reactors = NULL;
+	fc->fci_ReactorsNumber = 0;
+	for( i = 0; i < opened; i++ )
 	{
-		SocketClose( fc->fci_Sockets );
-		fc->fci_Sockets = NULL;
-		fc->fci_Closed = TRUE;
+		FriendCoreReactorClose( &(reactors[ i ]) );
 	}
+	FFree( reactors );
+	fc->fci_Closed = TRUE;
 
 	// Close libraries
 	if( fc->fci_Libraries )
@@ -1519,17 +1684,6 @@ int FriendCoreRun( FriendCoreInstance* fc )
 		WorkerManagerDelete( fc->fci_WorkerManager );
 	}
 	
-#ifdef USE_SELECT
-
-#else
-	// Close this
-	if( fc->fci_Epollfd )
-	{
-		LOG( FLOG_INFO, "Closing Epoll file descriptor\n");
-		close( fc->fci_Epollfd );
-	}
-#endif
-	
 	close( fc->fci_SendPipe[0] );
 	close( fc->fci_SendPipe[1] );
 	close( fc->fci_RecvPipe[0] );
@@ -50,6 +50,28 @@
 #endif
 #include <poll.h>
 
+#define FRIEND_CORE_MAX_REACTORS	64
+
+struct FriendCoreInstance;
+
+/**
+ * Reactor, event loop running in own thread
+ *
+ * Every reactor has own listening socket opened with SO_REUSEPORT and own
+ * epoll set. Kernel balances incoming connections between listening sockets
+ * and connection stays on reactor which accepted it.
+ */
+typedef struct FriendCoreReactor
+{
+	int							fcr_ID;				///< reactor number
+	struct FriendCoreInstance	*fcr_FC;			///< FriendCore instance which reactor belongs to
+	Socket						*fcr_Socket;		///< listening socket
+	int							fcr_Epollfd;		///< File descriptor for epoll
+	int							fcr_ReadPipe, fcr_WritePipe;	///< pipe used to wake up reactor
+	pthread_t					fcr_Thread;			///< reactor thread, not used by first reactor which runs in FriendCoreRun
+	FBOOL						fcr_ThreadStarted;
+} FriendCoreReactor;
+
 /**
  * FriendCore instance data
  *
@@ -63,8 +85,8 @@ typedef struct FriendCoreInstance
 	char 						fci_CoreID[ 32 ];	///< id of the core
 	char							fci_IP[ 256 ]; // ip or hostname of FriendCoreInstance
 	
-	int 							fci_Epollfd;            ///< File descriptor for epoll
-	Socket	 					*fci_Sockets; 	///< Socket for incomming connections (TODO: Make this "socketS": We must be able to listen on multiple interfaces!)
+	FriendCoreReactor			*fci_Reactors;		///< Reactors, each one listens on port and has own epoll
+	int							fci_ReactorsNumber;	///< number of reactors, 0 = one per CPU core
 
 	// "Private"
 	//char                  *fci_Shutdown;      ///< Ends all event loops
@@ -80,7 +102,6 @@ typedef struct FriendCoreInstance
 	
 	int 							fci_SendPipe[ 2 ];	/// pipes used to send messages to FC
 	int 							fci_RecvPipe[ 2 ];	/// pipes used to received messages from FC
-	int							fci_ReadCorePipe, fci_WriteCorePipe; // pointers to read/write pipes
 	
 	FThread					*fci_Thread;		/// FC instance internal thread
 	pthread_mutex_t		fci_ListenMutex;
@@ -110,6 +131,12 @@ void FriendCoreShutdown( FriendCoreInstance* instance );
 
 int  FriendCoreRun( FriendCoreInstance* instance );
 
+/**
+ * Wakes up all reactors, used to signal shutdown
+ */
+
+void FriendCoreWakeUp( FriendCoreInstance* instance );
+
 /**
  * Opens socket, loads libraries and starts subsystems,
  * then enters the even loop pattern until shutdown.
@@ -119,10 +146,10 @@ Library* FriendCoreGetLibrary( FriendCoreInstance* instance, char* libname, FULO
 
 /**
  * The event loop pattern.
- * This waits for stuff to happen on sockets
+ * This waits for stuff to happen on reactor sockets
  */
 
-void FriendCoreEpoll( FriendCoreInstance* instance );
+void FriendCoreEpoll( FriendCoreReactor* reactor );
 
 /**
  * The event loop pattern.
@@ -35,6 +35,7 @@
 #include <properties/propertieslibrary.h>
 #include <system/systembase.h>
 #include <hardware/machine_info.h>
+#include <network/tls_tickets.h>
 
 //
 // currently Friend can create only one core
@@ -128,13 +129,17 @@ FriendCoreManager *FriendCoreManagerNew()
 		int maxpcom =  EPOLL_MAX_EVENTS_COMM;
 		int maxpcomremote = EPOLL_MAX_EVENTS_COMM_REM;
 		int bufsizecom = BUFFER_READ_SIZE_COMM;
+		int reactors = 0;
 
 		FBOOL SSLEnabled = FALSE;
 		FBOOL WSSSLEnabled = FALSE;
 		FBOOL SSLEnabledCommuncation = FALSE;
+		FBOOL userSnapshot = TRUE;
 		SLIB->sl_CacheFiles = TRUE;
 		SLIB->sl_UnMountDevicesInDB =TRUE;
+		SLIB->sl_MountOnDemand = TRUE;
 		SLIB->sl_SocketTimeout = 10000;
+		SLIB->sl_UploadMemoryLimit = HTTP_UPLOAD_MEMORY_LIMIT;
 		
 		if( SLIB->sl_ActiveModuleName )
 		{
@@ -167,6 +172,7 @@ FriendCoreManager *FriendCoreManagerNew()
 				{
 					maxp = plib->ReadInt( prop, "Core:epollevents", EPOLL_MAX_EVENTS );
 					bufsize = plib->ReadInt( prop, "Core:networkbuffer", BUFFER_READ_SIZE );
+					reactors = plib->ReadInt( prop, "Core:reactors", 0 );
 					
 					maxpcom = plib->ReadInt( prop, "Core:epolleventscom", EPOLL_MAX_EVENTS_COMM );
 					bufsizecom = plib->ReadInt( prop, "Core:networkbuffercom", BUFFER_READ_SIZE_COMM );
@@ -184,7 +190,11 @@ FriendCoreManager *FriendCoreManagerNew()
 					
 					SLIB->sl_CacheFiles = plib->ReadInt( prop, "Options:CacheFiles", 1 );
 					SLIB->sl_UnMountDevicesInDB = plib->ReadInt( prop, "Options:UnmountInDB", 1 );
+					SLIB->sl_MountOnDemand = plib->ReadInt( prop, "Options:MountOnDemand", 1 );
 					SLIB->sl_SocketTimeout  = plib->ReadInt( prop, "Core:SSLSocketTimeout", 10000 );
+					SLIB->sl_UploadMemoryLimit = plib->ReadInt( prop, "Core:uploadmemorylimit", HTTP_UPLOAD_MEMORY_LIMIT );
+					userSnapshot = plib->ReadInt( prop, "Core:usersnapshot", 1 );
+					MetricsInit( plib->ReadInt( prop, "Core:metrics", 1 ), plib->ReadInt( prop, "Core:slowrequestms", METRICS_SLOW_REQUEST_MS ) );
 					
 					char *tptr  = plib->ReadString( prop, "Core:Certpath", "cfg/crt/" );
 					if( tptr != NULL )
@@ -205,6 +215,21 @@ FriendCoreManager *FriendCoreManagerNew()
 						}
 					}
 					
+					// session ticket keys, same file should be used by all nodes behind load balancer
+					{
+						char ticketKeyPath[ 1024 ];
+						tptr = plib->ReadString( prop, "Core:SSLTicketKeyFile", "" );
+						if( tptr != NULL && tptr[ 0 ] != 0 )
+						{
+							snprintf( ticketKeyPath, sizeof( ticketKeyPath ), "%s", tptr );
+						}
+						else
+						{
+							snprintf( ticketKeyPath, sizeof( ticketKeyPath ), "%sticket.key", SLIB->RSA_SERVER_CA_PATH );
+						}
+						TLSTicketKeysInit( ticketKeyPath, plib->ReadInt( prop, "Core:SSLTicketLifetime", TLS_TICKET_LIFETIME ) );
+					}
+					
 					if( SLIB->sl_ActiveModuleName != NULL )
 					{
 						FFree( SLIB->sl_ActiveModuleName );
@@ -236,7 +261,26 @@ FriendCoreManager *FriendCoreManagerNew()
 				LibraryClose( ( struct Library *)plib );
 			}
 			
+			// users and sessions snapshot, used on next start instead of database
+			char *home = getenv("FRIEND_HOME");
+			if( userSnapshot == TRUE && home != NULL )
+			{
+				int len = strlen( home ) + strlen( USER_SNAPSHOT_FILE ) + 1;
+				if( ( SLIB->sl_UserSnapshotPath = FCalloc( len, sizeof( char ) ) ) != NULL )
+				{
+					char cachePath[ 1024 ];
+					snprintf( cachePath, sizeof(cachePath), "%scache", home );
+					mkdir( cachePath, 0755 );
+					
+					snprintf( SLIB->sl_UserSnapshotPath, len, "%s%s", home, USER_SNAPSHOT_FILE );
+				}
+			}
+			
 			fcm->fcm_FriendCores = FriendCoreNew( SLIB, SSLEnabled, port, maxp, bufsize, "localhost" );
+			if( fcm->fcm_FriendCores != NULL )
+			{
+				fcm->fcm_FriendCores->fci_ReactorsNumber = reactors;
+			}
 		}
 		
 		if( SSLEnabled == TRUE )
@@ -351,6 +395,8 @@ void FriendCoreManagerDelete( FriendCoreManager *fcm )
 		FriendCoreShutdown( fcm->fcm_FriendCores );
 		DEBUG("FriendCoreManager shutdown finished\n");
 		
+		TLSTicketKeysDelete();
+		
 		DEBUG("FriendCoreManager Close services\n");
 		if( fcm->fcm_ServiceManager != NULL )
 		{
@@ -411,7 +457,7 @@ void FriendCoreManagerShutdown( FriendCoreManager *fcm )
 		while( fc != NULL )
 		{
 			fc->fci_Shutdown = TRUE;
-			write( fc->fci_WriteCorePipe, "q", 1 );
+			FriendCoreWakeUp( fc );
 			
 			fc = (FriendCoreInstance *) fc->node.mln_Succ;
 		}
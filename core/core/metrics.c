@@ -0,0 +1,627 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ * 
+ *  Metrics body
+ *
+ *  Lock-free per thread counters and latency histograms, exported in
+ *  Prometheus text format.
+ *
+ *  @date created 10/2026
+ */
+
+#include <core/types.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <util/log/log.h>
+#include "metrics.h"
+
+static int metricsEnabled = 1;
+static int metricsSlowRequest = METRICS_SLOW_REQUEST_MS * 1000;	// microseconds
+static MetricsShard *metricsShards = NULL;
+static pthread_key_t metricsKey;
+static pthread_once_t metricsOnce = PTHREAD_ONCE_INIT;
+static FUQUAD metricsTraceCounter = 0;
+
+// routes are only added, name and stage are written before number is increased
+static char metricsRouteNames[ METRICS_ROUTES_MAX ][ METRICS_ROUTE_NAME_SIZE ];
+static int metricsRouteStages[ METRICS_ROUTES_MAX ];
+static int metricsRoutesNr = 0;
+static pthread_mutex_t metricsRoutesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread MetricsShard *metricsLocal = NULL;
+static __thread char metricsTrace[ METRICS_TRACE_ID_SIZE ];
+
+// only owner thread writes to shard, readers need values which are not torn
+#define METRICS_ADD( FIELD, VAL ) __atomic_store_n( &(FIELD), __atomic_load_n( &(FIELD), __ATOMIC_RELAXED ) + (VAL), __ATOMIC_RELAXED )
+#define METRICS_GET( FIELD ) __atomic_load_n( &(FIELD), __ATOMIC_RELAXED )
+
+static const char *metricsStageNames[ METRIC_STAGE_MAX ] = {
+	"accept",
+	"tls_handshake",
+	"header_parse",
+	"session_lookup",
+	"sql_checkout",
+	"sql_query",
+	"module_run",
+	"fsys_operation",
+	"response_write",
+	"http_request",
+	"ws_request"
+};
+
+static const char *metricsCounterNames[ METRIC_COUNTER_MAX ][ 2 ] = {
+	{ "friendcore_connections_total", "Accepted connections" },
+	{ "friendcore_http_requests_total", "Requests to system.library over HTTP" },
+	{ "friendcore_ws_requests_total", "Requests to system.library over websockets" },
+	{ "friendcore_response_bytes_total", "Bytes of HTTP responses written" },
+	{ "friendcore_slow_requests_total", "Requests slower than slow request threshold" }
+};
+
+// Prometheus buckets, microseconds
+static const FUQUAD metricsExportBuckets[] = {
+	100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 0
+};
+
+/**
+ * Release shard when thread which owned it finish
+ *
+ * @param p pointer to MetricsShard
+ */
+static void MetricsShardRelease( void *p )
+{
+	MetricsShard *ms = (MetricsShard *)p;
+	__atomic_store_n( &(ms->ms_InUse), 0, __ATOMIC_RELEASE );
+}
+
+/**
+ * Create key used to detect end of thread
+ */
+static void MetricsKeyCreate( void )
+{
+	pthread_key_create( &metricsKey, MetricsShardRelease );
+}
+
+/**
+ * Get shard of current thread. Shards of finished threads are reused,
+ * values are cumulative so nothing is lost.
+ *
+ * @return pointer to MetricsShard or NULL when memory cannot be allocated
+ */
+static MetricsShard *MetricsShardGet( void )
+{
+	if( metricsLocal != NULL )
+	{
+		return metricsLocal;
+	}
+	
+	pthread_once( &metricsOnce, MetricsKeyCreate );
+	
+	MetricsShard *ms = __atomic_load_n( &metricsShards, __ATOMIC_ACQUIRE );
+	while( ms != NULL )
+	{
+		int expected = 0;
+		if( __atomic_compare_exchange_n( &(ms->ms_InUse), &expected, 1, FALSE, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) )
+		{
+			break;
+		}
+		ms = ms->ms_Next;
+	}
+	
+	if( ms == NULL )
+	{
+		if( ( ms = FCalloc( 1, sizeof( MetricsShard ) ) ) == NULL )
+		{
+			return NULL;
+		}
+		ms->ms_InUse = 1;
+		ms->ms_Next = __atomic_load_n( &metricsShards, __ATOMIC_RELAXED );
+		while( !__atomic_compare_exchange_n( &metricsShards, &(ms->ms_Next), ms, FALSE, __ATOMIC_RELEASE, __ATOMIC_RELAXED ) );
+	}
+	
+	pthread_setspecific( metricsKey, ms );
+	metricsLocal = ms;
+	
+	return ms;
+}
+
+/**
+ * Setup metrics
+ *
+ * @param enabled 0 disable time measurement
+ * @param slowRequestMs requests slower than this (milliseconds) are logged with trace id
+ */
+void MetricsInit( int enabled, int slowRequestMs )
+{
+	metricsEnabled = enabled;
+	if( slowRequestMs > 0 )
+	{
+		metricsSlowRequest = slowRequestMs * 1000;
+	}
+}
+
+/**
+ * Get monotonic time
+ *
+ * @return time in microseconds, 0 when metrics are disabled
+ */
+FUQUAD MetricsTime( void )
+{
+	if( metricsEnabled == 0 )
+	{
+		return 0;
+	}
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (FUQUAD)ts.tv_sec * 1000000 + (FUQUAD)( ts.tv_nsec / 1000 );
+}
+
+/**
+ * Get index of histogram bucket
+ *
+ * @param usec value in microseconds
+ * @return bucket index
+ */
+int MetricsBucketIndex( FUQUAD usec )
+{
+	if( usec < METRICS_SUB_BUCKETS )
+	{
+		return (int)usec;
+	}
+	
+	int msb = 63 - __builtin_clzll( usec );
+	int shift = msb - METRICS_SUB_BUCKET_BITS;
+	int idx = ( shift + 1 ) * METRICS_SUB_BUCKETS + (int)( ( usec >> shift ) & ( METRICS_SUB_BUCKETS - 1 ) );
+	
+	return idx < METRICS_BUCKETS ? idx : METRICS_BUCKETS - 1;
+}
+
+/**
+ * Get upper bound of histogram bucket (exclusive)
+ *
+ * @param idx bucket index
+ * @return bound in microseconds
+ */
+FUQUAD MetricsBucketUpperBound( int idx )
+{
+	if( idx < METRICS_SUB_BUCKETS )
+	{
+		return (FUQUAD)idx + 1;
+	}
+	int shift = idx / METRICS_SUB_BUCKETS - 1;
+	int sub = idx % METRICS_SUB_BUCKETS;
+	return (FUQUAD)( METRICS_SUB_BUCKETS + sub + 1 ) << shift;
+}
+
+/**
+ * Store latency
+ *
+ * @param stage METRIC_STAGE_* value
+ * @param usec time in microseconds
+ */
+void MetricsRecord( int stage, FUQUAD usec )
+{
+	if( stage < 0 || stage >= METRIC_STAGE_MAX )
+	{
+		return;
+	}
+	
+	MetricsShard *ms = MetricsShardGet();
+	if( ms != NULL )
+	{
+		METRICS_ADD( ms->ms_Count[ stage ], 1 );
+		METRICS_ADD( ms->ms_Sum[ stage ], usec );
+		METRICS_ADD( ms->ms_Buckets[ stage ][ MetricsBucketIndex( usec ) ], 1 );
+		if( usec > ms->ms_Max[ stage ] )
+		{
+			__atomic_store_n( &(ms->ms_Max[ stage ]), usec, __ATOMIC_RELAXED );
+		}
+	}
+}
+
+/**
+ * Store time passed since provided moment
+ *
+ * @param stage METRIC_STAGE_* value
+ * @param start value returned by MetricsTime(), 0 is ignored
+ */
+void MetricsRecordSince( int stage, FUQUAD start )
+{
+	if( start == 0 )
+	{
+		return;
+	}
+	FUQUAD now = MetricsTime();
+	MetricsRecord( stage, now > start ? now - start : 0 );
+}
+
+/**
+ * Increase counter
+ *
+ * @param counter METRIC_COUNTER_* value
+ * @param value value added to counter
+ */
+void MetricsCounterAdd( int counter, FUQUAD value )
+{
+	if( counter < 0 || counter >= METRIC_COUNTER_MAX )
+	{
+		return;
+	}
+	
+	MetricsShard *ms = MetricsShardGet();
+	if( ms != NULL )
+	{
+		METRICS_ADD( ms->ms_Counters[ counter ], value );
+	}
+}
+
+/**
+ * Get index of route, new routes are registered until METRICS_ROUTES_MAX is reached
+ *
+ * @param stage METRIC_STAGE_HTTP_REQUEST or METRIC_STAGE_WS_REQUEST
+ * @param path called function
+ * @return route index or -1 when there is no free place for new route
+ */
+static int MetricsRouteIndex( int stage, const char *path )
+{
+	char name[ METRICS_ROUTE_NAME_SIZE ];
+	int i = 0, nr;
+	
+	// path comes from request, only safe characters are taken
+	if( path != NULL )
+	{
+		for( ; path[ i ] != 0 && i < METRICS_ROUTE_NAME_SIZE - 1 ; i++ )
+		{
+			char c = path[ i ];
+			if( !( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' ) || c == '-' || c == '_' || c == '.' ) )
+			{
+				break;
+			}
+			name[ i ] = c;
+		}
+	}
+	if( i == 0 )
+	{
+		strcpy( name, "unknown" );
+	}
+	else
+	{
+		name[ i ] = 0;
+	}
+	
+	nr = __atomic_load_n( &metricsRoutesNr, __ATOMIC_ACQUIRE );
+	for( i = 0 ; i < nr ; i++ )
+	{
+		if( metricsRouteStages[ i ] == stage && strcmp( metricsRouteNames[ i ], name ) == 0 )
+		{
+			return i;
+		}
+	}
+	
+	pthread_mutex_lock( &metricsRoutesMutex );
+	nr = metricsRoutesNr;
+	for( ; i < nr ; i++ )
+	{
+		if( metricsRouteStages[ i ] == stage && strcmp( metricsRouteNames[ i ], name ) == 0 )
+		{
+			break;
+		}
+	}
+	if( i == nr )
+	{
+		if( nr < METRICS_ROUTES_MAX )
+		{
+			strcpy( metricsRouteNames[ nr ], name );
+			metricsRouteStages[ nr ] = stage;
+			__atomic_store_n( &metricsRoutesNr, nr + 1, __ATOMIC_RELEASE );
+		}
+		else
+		{
+			i = -1;
+		}
+	}
+	pthread_mutex_unlock( &metricsRoutesMutex );
+	
+	return i;
+}
+
+/**
+ * Store latency of route
+ *
+ * @param stage METRIC_STAGE_HTTP_REQUEST or METRIC_STAGE_WS_REQUEST
+ * @param path called function
+ * @param usec time in microseconds
+ */
+static void MetricsRouteRecord( int stage, const char *path, FUQUAD usec )
+{
+	int r = MetricsRouteIndex( stage, path );
+	if( r < 0 )
+	{
+		return;
+	}
+	
+	MetricsShard *ms = MetricsShardGet();
+	if( ms == NULL )
+	{
+		return;
+	}
+	
+	MetricsRoute *mr = ms->ms_Routes[ r ];
+	if( mr == NULL )
+	{
+		if( ( mr = FCalloc( 1, sizeof( MetricsRoute ) ) ) == NULL )
+		{
+			return;
+		}
+		__atomic_store_n( &(ms->ms_Routes[ r ]), mr, __ATOMIC_RELEASE );
+	}
+	
+	METRICS_ADD( mr->mr_Count, 1 );
+	METRICS_ADD( mr->mr_Sum, usec );
+	METRICS_ADD( mr->mr_Buckets[ MetricsBucketIndex( usec ) ], 1 );
+	if( usec > mr->mr_Max )
+	{
+		__atomic_store_n( &(mr->mr_Max), usec, __ATOMIC_RELAXED );
+	}
+}
+
+/**
+ * Finish request measurement, slow requests are logged with their trace id
+ *
+ * @param stage METRIC_STAGE_HTTP_REQUEST or METRIC_STAGE_WS_REQUEST
+ * @param path called function
+ * @param start value returned by MetricsTime() when request started
+ */
+void MetricsRequestEnd( int stage, const char *path, FUQUAD start )
+{
+	MetricsCounterAdd( stage == METRIC_STAGE_WS_REQUEST ? METRIC_COUNTER_WS_REQUESTS : METRIC_COUNTER_HTTP_REQUESTS, 1 );
+	
+	if( start == 0 )
+	{
+		return;
+	}
+	
+	FUQUAD now = MetricsTime();
+	FUQUAD usec = now > start ? now - start : 0;
+	MetricsRecord( stage, usec );
+	MetricsRouteRecord( stage, path, usec );
+	
+	if( usec >= (FUQUAD)metricsSlowRequest )
+	{
+		MetricsCounterAdd( METRIC_COUNTER_SLOW_REQUESTS, 1 );
+		Log( FLOG_INFO, "[Metrics] Slow request %s took %lu ms, trace %s\n", path != NULL ? path : "", (unsigned long)( usec / 1000 ), metricsTrace );
+	}
+}
+
+/**
+ * Set trace id of request handled by current thread
+ *
+ * @param traceid id received with request, new one is generated when NULL
+ */
+void MetricsTraceSet( const char *traceid )
+{
+	int i = 0;
+	
+	if( traceid != NULL )
+	{
+		// id goes to logs and other servers, only safe characters are taken
+		for( ; traceid[ i ] != 0 && i < METRICS_TRACE_ID_SIZE - 1 ; i++ )
+		{
+			char c = traceid[ i ];
+			if( !( ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) || ( c >= '0' && c <= '9' ) || c == '-' || c == '_' || c == '.' ) )
+			{
+				break;
+			}
+			metricsTrace[ i ] = c;
+		}
+		metricsTrace[ i ] = 0;
+	}
+	
+	if( i == 0 )
+	{
+		FUQUAD nr = __atomic_add_fetch( &metricsTraceCounter, 1, __ATOMIC_RELAXED );
+		snprintf( metricsTrace, METRICS_TRACE_ID_SIZE, "%x-%lx-%llx", (unsigned int)getpid(), (unsigned long)time( NULL ), (unsigned long long)nr );
+	}
+}
+
+/**
+ * Get trace id of request handled by current thread
+ *
+ * @return trace id, empty string when not set
+ */
+const char *MetricsTraceGet( void )
+{
+	return metricsTrace;
+}
+
+/**
+ * Write histogram and its quantiles in Prometheus text format
+ *
+ * @param bs output for histogram
+ * @param quant output for quantiles, can be NULL
+ * @param name metric name without _seconds suffix
+ * @param label name of first label
+ * @param value value of first label, can contain further labels
+ * @param buckets summed fine grained buckets
+ * @param sum sum of values in microseconds
+ * @param max biggest value in microseconds
+ */
+static void MetricsHistogramWrite( BufString *bs, BufString *quant, const char *name, const char *label, const char *value, FUQUAD *buckets, FUQUAD sum, FUQUAD max )
+{
+	char tmp[ 512 ];
+	int len, i;
+	FUQUAD count = 0;
+	
+	// shards are read while threads write, count is taken from buckets so histogram is consistent
+	for( i = 0 ; i < METRICS_BUCKETS ; i++ )
+	{
+		count += buckets[ i ];
+	}
+	
+	int b = 0, e;
+	FUQUAD cumulative = 0;
+	for( e = 0 ; metricsExportBuckets[ e ] != 0 ; e++ )
+	{
+		while( b < METRICS_BUCKETS && MetricsBucketUpperBound( b ) <= metricsExportBuckets[ e ] + 1 )
+		{
+			cumulative += buckets[ b++ ];
+		}
+		len = snprintf( tmp, sizeof(tmp), "%s_seconds_bucket{%s=\"%s\",le=\"%g\"} %llu\n", name, label, value, (double)metricsExportBuckets[ e ] / 1000000.0, (unsigned long long)cumulative );
+		BufStringAddSize( bs, tmp, len );
+	}
+	len = snprintf( tmp, sizeof(tmp), "%s_seconds_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n%s_seconds_sum{%s=\"%s\"} %.6f\n%s_seconds_count{%s=\"%s\"} %llu\n", name, label, value, (unsigned long long)count, name, label, value, (double)sum / 1000000.0, name, label, value, (unsigned long long)count );
+	BufStringAddSize( bs, tmp, len );
+	
+	if( count > 0 && quant != NULL )
+	{
+		static const double quantiles[] = { 0.5, 0.9, 0.99 };
+		int q;
+		for( q = 0 ; q < 3 ; q++ )
+		{
+			FUQUAD rank = (FUQUAD)( quantiles[ q ] * (double)count + 0.5 );
+			if( rank < 1 ) rank = 1;
+			
+			cumulative = 0;
+			for( i = 0 ; i < METRICS_BUCKETS - 1 ; i++ )
+			{
+				cumulative += buckets[ i ];
+				if( cumulative >= rank )
+				{
+					break;
+				}
+			}
+			FUQUAD bound = MetricsBucketUpperBound( i );
+			if( bound > max ) bound = max;
+			
+			len = snprintf( tmp, sizeof(tmp), "%s_quantile_seconds{%s=\"%s\",quantile=\"%g\"} %.6f\n", name, label, value, quantiles[ q ], (double)bound / 1000000.0 );
+			BufStringAddSize( quant, tmp, len );
+		}
+		len = snprintf( tmp, sizeof(tmp), "%s_quantile_seconds{%s=\"%s\",quantile=\"1\"} %.6f\n", name, label, value, (double)max / 1000000.0 );
+		BufStringAddSize( quant, tmp, len );
+	}
+}
+
+/**
+ * Generate metrics in Prometheus text format
+ *
+ * @return new BufString with metrics or NULL when memory cannot be allocated
+ */
+BufString *MetricsPrometheus( void )
+{
+	BufString *bs = BufStringNew();
+	if( bs == NULL )
+	{
+		return NULL;
+	}
+	
+	FUQUAD *buckets = FCalloc( METRICS_BUCKETS, sizeof( FUQUAD ) );
+	if( buckets == NULL )
+	{
+		BufStringDelete( bs );
+		return NULL;
+	}
+	
+	char tmp[ 512 ];
+	int len, s, i;
+	MetricsShard *ms;
+	
+	for( i = 0 ; i < METRIC_COUNTER_MAX ; i++ )
+	{
+		FUQUAD total = 0;
+		for( ms = __atomic_load_n( &metricsShards, __ATOMIC_ACQUIRE ) ; ms != NULL ; ms = ms->ms_Next )
+		{
+			total += METRICS_GET( ms->ms_Counters[ i ] );
+		}
+		len = snprintf( tmp, sizeof(tmp), "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", metricsCounterNames[ i ][ 0 ], metricsCounterNames[ i ][ 1 ], metricsCounterNames[ i ][ 0 ], metricsCounterNames[ i ][ 0 ], (unsigned long long)total );
+		BufStringAddSize( bs, tmp, len );
+	}
+	
+	BufStringAdd( bs, "# HELP friendcore_stage_duration_seconds Time spent in request processing stages\n# TYPE friendcore_stage_duration_seconds histogram\n" );
+	
+	BufString *quant = BufStringNew();
+	BufStringAdd( quant, "# HELP friendcore_stage_duration_quantile_seconds Latency quantiles computed from fine grained histogram\n# TYPE friendcore_stage_duration_quantile_seconds gauge\n" );
+	
+	for( s = 0 ; s < METRIC_STAGE_MAX ; s++ )
+	{
+		FUQUAD sum = 0, max = 0;
+		memset( buckets, 0, METRICS_BUCKETS * sizeof( FUQUAD ) );
+		
+		for( ms = __atomic_load_n( &metricsShards, __ATOMIC_ACQUIRE ) ; ms != NULL ; ms = ms->ms_Next )
+		{
+			sum += METRICS_GET( ms->ms_Sum[ s ] );
+			FUQUAD m = METRICS_GET( ms->ms_Max[ s ] );
+			if( m > max ) max = m;
+			for( i = 0 ; i < METRICS_BUCKETS ; i++ )
+			{
+				buckets[ i ] += METRICS_GET( ms->ms_Buckets[ s ][ i ] );
+			}
+		}
+		
+		MetricsHistogramWrite( bs, quant, "friendcore_stage_duration", "stage", metricsStageNames[ s ], buckets, sum, max );
+	}
+	
+	BufStringAdd( bs, "# HELP friendcore_route_duration_seconds Time spent in system.library calls by route\n# TYPE friendcore_route_duration_seconds histogram\n" );
+	if( quant != NULL )
+	{
+		BufStringAdd( quant, "# HELP friendcore_route_duration_quantile_seconds Route latency quantiles computed from fine grained histogram\n# TYPE friendcore_route_duration_quantile_seconds gauge\n" );
+	}
+	
+	int routesNr = __atomic_load_n( &metricsRoutesNr, __ATOMIC_ACQUIRE );
+	for( s = 0 ; s < routesNr ; s++ )
+	{
+		FUQUAD sum = 0, max = 0;
+		memset( buckets, 0, METRICS_BUCKETS * sizeof( FUQUAD ) );
+		
+		for( ms = __atomic_load_n( &metricsShards, __ATOMIC_ACQUIRE ) ; ms != NULL ; ms = ms->ms_Next )
+		{
+			MetricsRoute *mr = __atomic_load_n( &(ms->ms_Routes[ s ]), __ATOMIC_ACQUIRE );
+			if( mr == NULL )
+			{
+				continue;
+			}
+			sum += METRICS_GET( mr->mr_Sum );
+			FUQUAD m = METRICS_GET( mr->mr_Max );
+			if( m > max ) max = m;
+			for( i = 0 ; i < METRICS_BUCKETS ; i++ )
+			{
+				buckets[ i ] += METRICS_GET( mr->mr_Buckets[ i ] );
+			}
+		}
+		
+		char labels[ 128 ];
+		snprintf( labels, sizeof(labels), "%s\",route=\"%s", metricsRouteStages[ s ] == METRIC_STAGE_WS_REQUEST ? "ws" : "http", metricsRouteNames[ s ] );
+		MetricsHistogramWrite( bs, quant, "friendcore_route_duration", "transport", labels, buckets, sum, max );
+	}
+	
+	if( quant != NULL )
+	{
+		BufStringAddSize( bs, quant->bs_Buffer, quant->bs_Size );
+		BufStringDelete( quant );
+	}
+	
+	FFree( buckets );
+	
+	return bs;
+}
@@ -0,0 +1,183 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ * 
+ *  Metrics definitions
+ *
+ *  Every thread updates its own shard of counters and latency histograms,
+ *  so recording a value never takes a lock. Shards are summed when
+ *  metrics are requested.
+ *
+ *  @date created 10/2026
+ */
+
+#ifndef __CORE_METRICS_H__
+#define __CORE_METRICS_H__
+
+#include <core/types.h>
+#include <util/buffered_string.h>
+
+//
+// Stages which latency is measured
+//
+
+enum
+{
+	METRIC_STAGE_ACCEPT = 0,		// accept() to socket added to event loop
+	METRIC_STAGE_TLS_HANDSHAKE,
+	METRIC_STAGE_HEADER_PARSE,
+	METRIC_STAGE_SESSION_LOOKUP,
+	METRIC_STAGE_SQL_CHECKOUT,		// waiting for mysql.library from pool
+	METRIC_STAGE_SQL_QUERY,
+	METRIC_STAGE_MODULE_RUN,
+	METRIC_STAGE_FSYS_OPERATION,
+	METRIC_STAGE_RESPONSE_WRITE,
+	METRIC_STAGE_HTTP_REQUEST,		// whole system.library call
+	METRIC_STAGE_WS_REQUEST,
+	METRIC_STAGE_MAX
+};
+
+//
+// Counters
+//
+
+enum
+{
+	METRIC_COUNTER_CONNECTIONS = 0,
+	METRIC_COUNTER_HTTP_REQUESTS,
+	METRIC_COUNTER_WS_REQUESTS,
+	METRIC_COUNTER_BYTES_WRITTEN,
+	METRIC_COUNTER_SLOW_REQUESTS,
+	METRIC_COUNTER_MAX
+};
+
+//
+// Histogram buckets are log-linear: 8 buckets for every power of two,
+// values are stored in microseconds with error below 12.5%
+//
+
+#define METRICS_SUB_BUCKET_BITS		3
+#define METRICS_SUB_BUCKETS			(1 << METRICS_SUB_BUCKET_BITS)
+#define METRICS_BUCKETS				256
+
+#define METRICS_TRACE_ID_SIZE		40
+#define METRICS_SLOW_REQUEST_MS		2000
+
+#define METRICS_ROUTES_MAX			64		// routes measured separately, further ones are only in stage histograms
+#define METRICS_ROUTE_NAME_SIZE		32
+
+//
+// Latency of one system.library route (http or websocket call of function)
+//
+
+typedef struct MetricsRoute
+{
+	FUQUAD						mr_Count;
+	FUQUAD						mr_Sum;
+	FUQUAD						mr_Max;
+	FUQUAD						mr_Buckets[ METRICS_BUCKETS ];
+}MetricsRoute;
+
+//
+//
+//
+
+typedef struct MetricsShard
+{
+	struct MetricsShard			*ms_Next;
+	int							ms_InUse;				// shard is owned by running thread
+	FUQUAD						ms_Count[ METRIC_STAGE_MAX ];
+	FUQUAD						ms_Sum[ METRIC_STAGE_MAX ];	// microseconds
+	FUQUAD						ms_Max[ METRIC_STAGE_MAX ];
+	FUQUAD						ms_Counters[ METRIC_COUNTER_MAX ];
+	FUQUAD						ms_Buckets[ METRIC_STAGE_MAX ][ METRICS_BUCKETS ];
+	MetricsRoute				*ms_Routes[ METRICS_ROUTES_MAX ];	// allocated when thread handles route first time
+}MetricsShard;
+
+//
+//
+//
+
+void MetricsInit( int enabled, int slowRequestMs );
+
+//
+//
+//
+
+FUQUAD MetricsTime( void );
+
+//
+//
+//
+
+void MetricsRecord( int stage, FUQUAD usec );
+
+//
+//
+//
+
+void MetricsRecordSince( int stage, FUQUAD start );
+
+//
+//
+//
+
+void MetricsCounterAdd( int counter, FUQUAD value );
+
+//
+//
+//
+
+void MetricsRequestEnd( int stage, const char *path, FUQUAD start );
+
+//
+//
+//
+
+void MetricsTraceSet( const char *traceid );
+
+//
+//
+//
+
+const char *MetricsTraceGet( void );
+
+//
+//
+//
+
+int MetricsBucketIndex( FUQUAD usec );
+
+//
+//
+//
+
+FUQUAD MetricsBucketUpperBound( int idx );
+
+//
+//
+//
+
+BufString *MetricsPrometheus( void );
+
+#endif // __CORE_METRICS_H__
@@ -49,8 +49,9 @@ typedef struct UserManagerInterface
 	FBOOL					(*UMUserIsAdminByAuthID)( UserManager *smgr, Http *r, char *auth );
 	User						*(*UMUserCheckExistsInMemory)( UserManager *smgr, User *u );
 	FBOOL					(*UMUserExistByNameDB)( UserManager *smgr, const char *name );
-	User					*(*UMGetUserByName)( UserManager *um, char *name );
-	User					*(*UMGetUserByID)( UserManager *um, FULONG id );
+	User					*(*UMGetUserByNameRef)( UserManager *um, const char *name );
+	User					*(*UMGetUserByIDRef)( UserManager *um, FULONG id );
+	void					(*UMReleaseUser)( UserManager *um, User *usr );
 	void					*(*UMUserGetByAuthIDDB)( UserManager *um, const char *authId );
 	User					*(*UMGetAllUsersDB)( UserManager *um );
 	int						(*UMAddUser)( UserManager *um,  User *usr );
@@ -84,8 +85,9 @@ inline void UserManagerInterfaceInit( UserManagerInterface *si )
 	si->UMUserIsAdminByAuthID = UMUserIsAdminByAuthID;
 	si->UMUserCheckExistsInMemory = UMUserCheckExistsInMemory;
 	si->UMUserExistByNameDB = UMUserExistByNameDB;
-	si->UMGetUserByName = UMGetUserByName;
-	si->UMGetUserByID = UMGetUserByID;
+	si->UMGetUserByNameRef = UMGetUserByNameRef;
+	si->UMGetUserByIDRef = UMGetUserByIDRef;
+	si->UMReleaseUser = UMReleaseUser;
 	si->UMUserGetByAuthIDDB = UMUserGetByAuthIDDB;
 	si->UMGetAllUsersDB = UMGetAllUsersDB;
 	si->UMAddUser = UMAddUser;
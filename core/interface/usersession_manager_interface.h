@@ -48,6 +48,8 @@ typedef struct UserSessionManagerInterface
 	UserSession				*(*USMUserSessionAdd)( UserSessionManager *smgr, UserSession *s );
 	int							(*USMUserSessionRemove)( UserSessionManager *smgr, UserSession *s );
 	int							(*USMSessionSaveDB)( UserSessionManager *smgr, UserSession *ses );
+	void						(*USMSessionTouch)( UserSessionManager *smgr, UserSession *ses );
+	int							(*USMSessionTouchFlush)( UserSessionManager *smgr );
 	char						*(*USMUserGetActiveSessionID)( UserSessionManager *smgr, User *usr );
 	void						(*USMDebugSessions)( UserSessionManager *smgr );
 	//UserSession					*(*UserGetByAuthID)( UserSessionManager *usm, const char *authId );
@@ -73,6 +75,8 @@ inline void UserSessionManagerInterfaceInit( UserSessionManagerInterface *si )
 	si->USMUserSessionAdd = USMUserSessionAdd;
 	si->USMUserSessionRemove = USMUserSessionRemove;
 	si->USMSessionSaveDB = USMSessionSaveDB;
+	si->USMSessionTouch = USMSessionTouch;
+	si->USMSessionTouchFlush = USMSessionTouchFlush;
 	si->USMUserGetActiveSessionID = USMUserGetActiveSessionID;
 	si->USMDebugSessions = USMDebugSessions;
 	//si->UserGetByAuthID = UserGetByAuthID;
@@ -51,8 +51,6 @@
 //
 //
 
-SystemBase *SLIB;                       ///< Global SystemBase structure
-
 FriendCoreManager *coreManager;         ///< Global FriendCoreManager structure
 
 /**
@@ -41,7 +41,10 @@
 #include <util/tagitem.h>
 #include <service/comm_msg.h>
 #include <system/systembase.h>
+#include <core/metrics.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 /**
  * sprintf function used by Http messages. (Pretty inefficient, but what the heck...)
@@ -373,7 +376,7 @@ int HttpParseInt( char* str )
  * @return http error code
  */
 
-int HttpParseHeader( Http* http, const char* request, unsigned int length )
+static int HttpParseHeaderFields( Http* http, const char* request, unsigned int length )
 {
 	// TODO: Better response codes
 	//
@@ -625,7 +628,20 @@ int HttpParseHeader( Http* http, const char* request, unsigned int length )
 							char *val = StringDuplicateEOL( lineStartPtr+16 );
 							if( val != NULL )
 							{
-								http->h_ContentLength = atoi( val );
+								char *end = NULL;
+								errno = 0;
+								long long len = strtoll( val, &end, 10 );
+								
+								// body is not read when length is not valid number
+								if( errno != 0 || end == val || len < 0 || ( *end != 0 && *end != ' ' && *end != '\t' ) )
+								{
+									FERROR("Wrong Content-Length: %s\n", val );
+									http->h_ContentLength = -1;
+								}
+								else
+								{
+									http->h_ContentLength = (FQUAD)len;
+								}
 								FFree( val );
 							}
 
@@ -815,6 +831,23 @@ int HttpParseHeader( Http* http, const char* request, unsigned int length )
 	return 1;
 }
 
+/**
+ * Parse Http header and measure time spent on it
+ *
+ * @param http pointer to Http where results will be stored.
+ * @param request http request represented by string
+ * @param length length of provided request
+ * @return http error code
+ */
+
+int HttpParseHeader( Http* http, const char* request, unsigned int length )
+{
+	FUQUAD start = MetricsTime();
+	int result = HttpParseHeaderFields( http, request, length );
+	MetricsRecordSince( METRIC_STAGE_HEADER_PARSE, start );
+	return result;
+}
+
 /**
  * Find string in data
  *
@@ -912,7 +945,7 @@ Content-Type: application/octet-stream
 				if( startOfFile != NULL )
 				{
 					FQUAD res;
-					res = FindInBinaryPOS( http->h_PartDivider, strlen(http->h_PartDivider), startOfFile, http->sizeOfContent ) - 2;
+					res = FindInBinaryPOS( http->h_PartDivider, strlen(http->h_PartDivider), startOfFile, http->sizeOfContent - ( startOfFile - http->content ) ) - 2;
 					
 					//res = (QUAD )FindInBinarySimple( http->h_PartDivider, strlen(http->h_PartDivider), startOfFile, http->sizeOfContent )-2;
 					
@@ -929,7 +962,8 @@ Content-Type: application/octet-stream
 							size = (endOfFile - startOfFile);
 							int fnamesize = (int)(fnameend - fname);
 						
-							HttpFile *newFile = HttpFileNew( fname, fnamesize, startOfFile, size );
+							// file data stays in request content, big uploads are not copied in memory
+							HttpFile *newFile = HttpFileNewShared( fname, fnamesize, startOfFile, size );
 							if( newFile != NULL )
 							{
 								//FERROR("TEMP POS %p END POS %p   size %d\n", startOfFile, endOfFile, (int)( endOfFile-startOfFile ) );
@@ -999,6 +1033,156 @@ Content-Type: application/octet-stream
 	return 0;
 }
 
+/**
+ * Parse request body which is already stored in http->content
+ *
+ * @param http http request
+ */
+
+static void HttpParseContent( Http* http )
+{
+	char *endDivider = strstr( http->content, "\r\n" );
+	memset( http->h_PartDivider, 0, 256*sizeof(char ) );
+	if( endDivider != NULL && ( endDivider - http->content ) < 256 )
+	{
+		strncpy( http->h_PartDivider, http->content, endDivider-http->content );
+	}
+	else
+	{
+		strcpy( http->h_PartDivider, "\n");
+	}
+	DEBUG("[HttpParsePartialRequest] Purge... Divider: %s\n", http->h_PartDivider );
+	
+	if( http->h_ContentType == HTTP_CONTENT_TYPE_MULTIPART )
+	{
+		DEBUG( "[HttpParsePartialRequest] Parsing multipart data!\n" );
+	
+		if( http->parsedPostContent )
+		{
+			HashmapFree( http->parsedPostContent );
+		}
+		ParseMultipart( http );
+		
+		DEBUG("MULTIPART\n");
+	}
+	else
+	{
+		DEBUG( "[HttpParsePartialRequest] Parsing post content!\n" );
+		if( http->parsedPostContent )
+		{
+			HashmapFree( http->parsedPostContent );
+		}
+		
+		http->parsedPostContent = UriParseQuery( http->content );
+	}
+}
+
+/**
+ * Map request body stored in temporary file into memory
+ *
+ * @param http http request
+ * @return 0 when success, otherwise error number
+ */
+
+static int HttpContentFileMap( Http* http )
+{
+	char pad[ HTTP_CONTENT_FILE_PAD ];
+	FILE *fp = http->h_ContentFile;
+	
+	if( fflush( fp ) != 0 )
+	{
+		return -1;
+	}
+	
+	off_t stored = ftello( fp );
+	if( stored != (off_t)http->h_ContentLength )
+	{
+		FERROR("Upload incomplete, received %lld bytes from %lld\n", (long long)stored, (long long)http->h_ContentLength );
+		return -2;
+	}
+	
+	// parsers use string functions, zeros after body stop them inside mapping
+	memset( pad, 0, sizeof( pad ) );
+	if( fwrite( pad, 1, sizeof( pad ), fp ) != sizeof( pad ) || fflush( fp ) != 0 )
+	{
+		return -3;
+	}
+	
+	void *map = mmap( NULL, stored + HTTP_CONTENT_FILE_PAD, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno( fp ), 0 );
+	if( map == MAP_FAILED )
+	{
+		FERROR("Cannot map uploaded content, size %ld\n", (long)stored );
+		return -4;
+	}
+	posix_madvise( map, stored + HTTP_CONTENT_FILE_PAD, POSIX_MADV_SEQUENTIAL );
+	
+	http->content = map;
+	http->sizeOfContent = stored;
+	
+	return 0;
+}
+
+/**
+ * Create temporary file which will hold request body.
+ * Data is written to h_ContentFile by reader, file is removed from disk when it is closed.
+ *
+ * @param http http request
+ * @return 0 when success, otherwise error number
+ */
+
+int HttpContentFileOpen( Http* http )
+{
+	char fname[ 64 ];
+	
+	if( http == NULL )
+	{
+		return -1;
+	}
+	
+	strcpy( fname, "/tmp/FriendUpload_XXXXXX" );
+	int fd = mkstemp( fname );
+	if( fd < 0 )
+	{
+		FERROR("Cannot create temporary file for upload\n");
+		return -2;
+	}
+	unlink( fname );
+	
+	if( ( http->h_ContentFile = fdopen( fd, "w+b" ) ) == NULL )
+	{
+		close( fd );
+		return -3;
+	}
+	
+	DEBUG("Request body will be stored in temporary file, size %lld\n", (long long)http->h_ContentLength );
+	
+	return 0;
+}
+
+/**
+ * Release request body
+ *
+ * @param http http request
+ */
+
+static void HttpFreeContent( Http* http )
+{
+	if( http->h_ContentFile != NULL )
+	{
+		if( http->content != NULL )
+		{
+			munmap( http->content, http->sizeOfContent + HTTP_CONTENT_FILE_PAD );
+		}
+		fclose( http->h_ContentFile );
+		http->h_ContentFile = NULL;
+	}
+	else if( http->content != NULL )
+	{
+		FFree( http->content );
+	}
+	http->content = NULL;
+}
+
 /**
  * Parse first part of the request
  *
@@ -1035,7 +1219,7 @@ inline int HttpParsePartialRequest( Http* http, char* data, unsigned int length
 		if( found )
 		{
 			int result = 0;
-			int size = 0;
+			FQUAD size = 0;
 			
 			if( http->gotHeader == FALSE )
 			{
@@ -1052,6 +1236,27 @@ inline int HttpParsePartialRequest( Http* http, char* data, unsigned int length
 				if( size > 0 )
 				{
 					http->expectBody = TRUE;
+					
+					// body was written to temporary file while it was received
+					if( http->h_ContentFile != NULL )
+					{
+						if( HttpContentFileMap( http ) != 0 )
+						{
+							http->sizeOfContent = 0;
+							http->expectBody = FALSE;
+							return result != 400;
+						}
+						HttpParseContent( http );
+						return 1;
+					}
+					
+					if( size > HTTP_CONTENT_MEMORY_MAX )
+					{
+						FERROR("Request body is too big to be kept in memory, size %lld\n", (long long)size );
+						http->sizeOfContent = 0;
+						http->expectBody = FALSE;
+						return result != 400;
+					}
 				
 					if( http->content )
 					{
@@ -1110,44 +1315,11 @@ inline int HttpParsePartialRequest( Http* http, char* data, unsigned int length
 		if( length > 0 )
 		{
 			memcpy( http->content, data, length );
-			
-			char *endDivider = strstr( http->content, "\r\n" );
-			memset( http->h_PartDivider, 0, 256*sizeof(char ) );
-			if( endDivider != NULL )
-			{
-				strncpy( http->h_PartDivider, http->content, endDivider-http->content );
-			}
-			else
-			{
-				strcpy( http->h_PartDivider, "\n");
-			}
-			DEBUG("[HttpParsePartialRequest] Purge... Divider: %s\n", http->h_PartDivider );
 		}
 	
 		if( length == http->sizeOfContent )
 		{
-			if( http->h_ContentType == HTTP_CONTENT_TYPE_MULTIPART )
-			{
-				DEBUG( "[HttpParsePartialRequest] Parsing multipart data!\n" );
-			
-				if( http->parsedPostContent )
-				{
-					HashmapFree( http->parsedPostContent );
-				}
-				int ret = ParseMultipart( http );
-				
-				DEBUG("MULTIPART\n");
-			}
-			else
-			{
-				DEBUG( "[HttpParsePartialRequest] Parsing post content!\n" );
-				if( http->parsedPostContent )
-				{
-					HashmapFree( http->parsedPostContent );
-				}
-				
-				http->parsedPostContent = UriParseQuery( http->content );
-			}
+			HttpParseContent( http );
 		}
 		return 1;
 	}
@@ -1342,10 +1514,8 @@ void HttpFree( Http* http )
 	{
 		FFree( http->response );
 	}
-	if( http->content )
-	{
-		FFree( http->content );
-	}
+	HttpFreeContent( http );
+	
 	if( http->parsedPostContent != NULL )
 	{
 		HashmapFree( http->parsedPostContent );
@@ -1398,10 +1568,9 @@ void HttpFreeRequest( Http* http )
 		FFree( http->version );
 		http->version = NULL;
 	}
-	if( http->content != NULL && http->sizeOfContent != 0 )
+	if( ( http->content != NULL && http->sizeOfContent != 0 ) || http->h_ContentFile != NULL )
 	{
-		FFree( http->content );
-		http->content = NULL;
+		HttpFreeContent( http );
 		http->sizeOfContent = 0;
 	}
 
@@ -1877,9 +2046,12 @@ void HttpWriteAndFree( Http* http, Socket *sock )
 	
 	//DEBUG("HTTP AND FREE\n");
 	
+	FUQUAD start = MetricsTime();
+	
 	if( http->h_WriteOnlyContent == TRUE )
 	{
 		SocketWrite( sock, http->content, http->sizeOfContent );
+		MetricsCounterAdd( METRIC_COUNTER_BYTES_WRITTEN, http->sizeOfContent );
 	}
 	else
 	{
@@ -1889,6 +2061,7 @@ void HttpWriteAndFree( Http* http, Socket *sock )
 			{
 				// Write to the socket!
 				SocketWrite( sock, http->response, http->responseLength );
+				MetricsCounterAdd( METRIC_COUNTER_BYTES_WRITTEN, http->responseLength );
 			}
 			else
 			{
@@ -1898,6 +2071,8 @@ void HttpWriteAndFree( Http* http, Socket *sock )
 		}
 	}
 	
+	MetricsRecordSince( METRIC_STAGE_RESPONSE_WRITE, start );
+	
 	HttpFree( http );
 }
 
@@ -2182,6 +2357,41 @@ HttpFile *HttpFileNew( char *filename, int fnamesize, char *data, FQUAD size )
 	return file;
 }
 
+/**
+ * Create new HttpFile which points to data owned by request
+ *
+ * @param filename file name of new file
+ * @param fnamesize file name string length
+ * @param data pointer to file data, must stay valid as long as HttpFile is used
+ * @param size size of provided data
+ * @return HttpFile or NULL when error appear
+ */
+
+HttpFile *HttpFileNewShared( char *filename, int fnamesize, char *data, FQUAD size )
+{
+	if( size <= 0 )
+	{
+		FERROR("Cannot upload empty file\n");
+		return NULL;
+	}
+	
+	HttpFile *file = FCalloc( 1, sizeof( HttpFile ) );
+	if( file == NULL )
+	{
+		FERROR("Cannot allocate memory for HTTP file\n");
+		return NULL;
+	}
+	
+	file->hf_Data = data;
+	file->hf_DataShared = TRUE;
+	strncpy( file->hf_FileName, filename, fnamesize < 511 ? fnamesize : 511 );
+	file->hf_FileSize = size;
+	
+	INFO("New file created %s size %lld\n", file->hf_FileName, file->hf_FileSize );
+	
+	return file;
+}
+
 /**
  * Delete Http File
  *
@@ -2192,7 +2402,7 @@ void HttpFileDelete( HttpFile *f )
 {
 	if( f != NULL )
 	{
-		if( f->hf_Data != NULL )
+		if( f->hf_Data != NULL && f->hf_DataShared == FALSE )
 		{
 			FFree( f->hf_Data );
 		}
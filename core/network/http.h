@@ -49,6 +49,10 @@
 #ifndef DOXYGEN
 #define HTTP_READ_BUFFER_DATA_SIZE 32768
 #define HTTP_READ_BUFFER_DATA_SIZE_ALLOC 32768+32
+#define HTTP_UPLOAD_MEMORY_LIMIT 4194304		// multipart bodies bigger than this are stored in temporary file
+#define HTTP_UPLOAD_WRITE_CHUNK 1048576		// uploaded files are passed to FileWrite in chunks of this size
+#define HTTP_CONTENT_FILE_PAD 8				// zero bytes added after body stored in file
+#define HTTP_CONTENT_MEMORY_MAX 0x7ffffff0	// bigger bodies must be stored in file
 #endif
 
 
@@ -76,6 +80,7 @@ enum {
 	HTTP_HEADER_ACCEPT,
 	HTTP_HEADER_METHOD,
 	HTTP_HEADER_REFERER,
+	HTTP_HEADER_TRANSFER_ENCODING,
 	HTTP_HEADER_END
 };
 
@@ -99,7 +104,8 @@ static const char *HEADERS[] = {
 	"origin",
 	"accept",
 	"method",
-	"referer"
+	"referer",
+	"transfer-encoding"
 };
 
 //
@@ -220,6 +226,7 @@ typedef struct HttpFile
 	char 		*hf_Data;
 	FQUAD		hf_FileSize;		// file size
 	FILE			*hf_FP;			// when file is stored on server disk
+	FBOOL		hf_DataShared;	// hf_Data points into request content and is not released with file
 	struct MinNode node;
 }HttpFile;
 
@@ -320,7 +327,7 @@ typedef struct Http
 	
 	char               h_PartDivider[ 256 ];
 	FBOOL           h_ContentType;
-	int                  h_ContentLength;
+	FQUAD                h_ContentLength;		// value of Content-Length header, -1 when it is not valid
 	HttpFile         *h_FileList;
 	
 	FBOOL           h_Stream;			// stream
@@ -335,6 +342,7 @@ typedef struct Http
 	FULONG         h_ResponseID;		// number used to compare http calls (unique number)
 	
 	FILE               *h_ContentFile;		// http content in FILE
+	FQUAD              h_ContentReceived;	// number of body bytes received so far
 	void                *h_PIDThread;    // PIDThread
 	void                *h_UserSession;  // user session
 	void                *h_SB; // SystemBase
@@ -497,10 +505,22 @@ void HttpWrite( Http* http, Socket *sock );
 
 HttpFile *HttpFileNew( char *filename, int fnamesize, char *data, FQUAD size );
 
+//
+// upload file, data is not copied
+//
+
+HttpFile *HttpFileNewShared( char *filename, int fnamesize, char *data, FQUAD size );
+
 //
 //
 //
 
 void HttpFileDelete( HttpFile *f );
 
+//
+// store request body in temporary file
+//
+
+int HttpContentFileOpen( Http *http );
+
 #endif // __NETWORK_HTTP_H__
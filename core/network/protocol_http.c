@@ -502,7 +502,9 @@ extern inline Http *ProtocolHttp( Socket* sock, char* data, unsigned int length
 						{
 							DEBUG( "%s\n", path->parts[1] );
 							DEBUG("------------------------------------------------------Calling SYSBASE via HTTP\n");
+							FUQUAD start = MetricsTime();
 							response = SLIB->SysWebRequest( SLIB, &(path->parts[1]), &request, NULL );
+							MetricsRequestEnd( METRIC_STAGE_HTTP_REQUEST, path->parts[1], start );
 						
 							if( response == NULL )
 							{
@@ -735,7 +737,7 @@ extern inline Http *ProtocolHttp( Socket* sock, char* data, unsigned int length
 								{
 									// We need to get the sessionId if we can!
 									// currently from table we read UserID
-									User *tuser = UMGetUserByID( SLIB->sl_UM, fs->fs_IDUser );
+									User *tuser = UMGetUserByIDRef( SLIB->sl_UM, fs->fs_IDUser );
 
 									if( tuser != NULL )
 									{
@@ -746,6 +748,7 @@ extern inline Http *ProtocolHttp( Socket* sock, char* data, unsigned int length
 											rootDev->f_SessionID = StringDuplicate( tuser->u_MainSessionID );
 											DEBUG("Session %s tusr ptr %p\n", sess, tuser );
 										}
+										UMReleaseUser( SLIB->sl_UM, tuser );
 									}
 									// Done fetching sessionid =)
 								
@@ -34,6 +34,8 @@
 #include <openssl/md5.h>
 #include <util/md5.h>
 #include <network/digcalc.h>
+#include <util/sha256.h>
+#include <pthread.h>
 
 extern SystemBase *SLIB;
 
@@ -59,11 +61,108 @@ void PrintNode( xmlNode *root )
 #define WEBDAV_SHARE_PATH "/webdav/devices/"
 #define WEBDAV_SHARE_PATH_LEN 16
 
+#define WEBDAV_STREAM_BUFFER 32768		// multistatus data is sent to socket when buffer reach this size
+
+#define WEBDAV_AUTH_CACHE_SIZE 256		// number of cached credentials
+#define WEBDAV_AUTH_CACHE_TTL 60		// seconds
+#define WEBDAV_AUTH_NAME_LEN 256
+
+//
+// verified credentials cache entry
+//
+
+typedef struct WebdavAuthEntry
+{
+	unsigned char		wae_Hash[ 32 ];		// SHA256 of authorization header
+	char				wae_UserName[ WEBDAV_AUTH_NAME_LEN ];
+	time_t				wae_Expires;
+}WebdavAuthEntry;
+
+static WebdavAuthEntry webdavAuthCache[ WEBDAV_AUTH_CACHE_SIZE ];
+static pthread_mutex_t webdavAuthMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Calculate hash of authorization header
+ *
+ * @param auth authorization header value
+ * @param hash pointer to 32 bytes buffer where hash will be stored
+ */
+static void WebdavAuthHash( char *auth, unsigned char *hash )
+{
+	FCSHA256_CTX ctx;
+	
+	Sha256Init( &ctx );
+	Sha256Update( &ctx, (unsigned char *)auth, strlen( auth ) );
+	Sha256Final( &ctx, hash );
+}
+
+/**
+ * Find verified credentials in cache
+ *
+ * @param hash hash of authorization header
+ * @param userName buffer (WEBDAV_AUTH_NAME_LEN) where user name will be copied
+ * @return TRUE when credentials were verified in last WEBDAV_AUTH_CACHE_TTL seconds, otherwise FALSE
+ */
+static FBOOL WebdavAuthCacheGet( unsigned char *hash, char *userName )
+{
+	FBOOL found = FALSE;
+	WebdavAuthEntry *e = &(webdavAuthCache[ ( hash[ 0 ] | ( hash[ 1 ] << 8 ) ) % WEBDAV_AUTH_CACHE_SIZE ]);
+	
+	pthread_mutex_lock( &webdavAuthMutex );
+	if( e->wae_Expires > time( NULL ) && memcmp( e->wae_Hash, hash, 32 ) == 0 )
+	{
+		strcpy( userName, e->wae_UserName );
+		found = TRUE;
+	}
+	pthread_mutex_unlock( &webdavAuthMutex );
+	
+	return found;
+}
+
+/**
+ * Store verified credentials in cache
+ *
+ * @param hash hash of authorization header
+ * @param userName name of authenticated user
+ */
+static void WebdavAuthCachePut( unsigned char *hash, char *userName )
+{
+	WebdavAuthEntry *e = &(webdavAuthCache[ ( hash[ 0 ] | ( hash[ 1 ] << 8 ) ) % WEBDAV_AUTH_CACHE_SIZE ]);
+	
+	if( strlen( userName ) >= WEBDAV_AUTH_NAME_LEN )
+	{
+		return;
+	}
+	
+	pthread_mutex_lock( &webdavAuthMutex );
+	memcpy( e->wae_Hash, hash, 32 );
+	strcpy( e->wae_UserName, userName );
+	e->wae_Expires = time( NULL ) + WEBDAV_AUTH_CACHE_TTL;
+	pthread_mutex_unlock( &webdavAuthMutex );
+}
+
+/**
+ * Send collected multistatus data to socket and clear buffer
+ *
+ * @param sock pointer to socket
+ * @param bs buffer with data
+ */
+static void WebdavFlush( Socket *sock, BufString *bs )
+{
+	if( bs->bs_Size > 0 )
+	{
+		SocketWrite( sock, bs->bs_Buffer, bs->bs_Size );
+		bs->bs_Size = 0;
+		bs->bs_Buffer[ 0 ] = 0;
+	}
+}
+
 //
 // convert json
+// if sock is provided, data is sent to socket every time buffer reach WEBDAV_STREAM_BUFFER
 //
 
-int ConvertToWebdav( char *url,  BufString *dbs, BufString *sbs, FBOOL *directory, FBOOL info )
+int ConvertToWebdav( char *url,  BufString *dbs, BufString *sbs, FBOOL *directory, FBOOL info, Socket *sock )
 {
 	int i = 0;
 	
@@ -104,15 +203,15 @@ int ConvertToWebdav( char *url,  BufString *dbs, BufString *sbs, FBOOL *director
 			
 			if( info == TRUE )
 			{
-				sprintf( buf, "<D:response>\n\t\t<D:href>http://localhost:6502%s</D:href>\n<D:propstat>\n<D:prop>\n", url );
+				snprintf( buf, sizeof( buf ), "<D:response>\n\t\t<D:href>http://localhost:6502%s</D:href>\n<D:propstat>\n<D:prop>\n", url );
 			}
 			else
 			{
 				if( url[ strlen( url )-1 ] == '/' )
 				{
-					sprintf( buf, "<D:response>\n\t\t<D:href>http://localhost:6502%s%s</D:href>\n<D:propstat>\n<D:prop>\n", url, lf->ff_Filename );
+					snprintf( buf, sizeof( buf ), "<D:response>\n\t\t<D:href>http://localhost:6502%s%s</D:href>\n<D:propstat>\n<D:prop>\n", url, lf->ff_Filename );
 				}else{
-					sprintf( buf, "<D:response>\n\t\t<D:href>http://localhost:6502%s/%s</D:href>\n<D:propstat>\n<D:prop>\n", url, lf->ff_Filename );
+					snprintf( buf, sizeof( buf ), "<D:response>\n\t\t<D:href>http://localhost:6502%s/%s</D:href>\n<D:propstat>\n<D:prop>\n", url, lf->ff_Filename );
 				}
 			}
 			
@@ -143,7 +242,7 @@ int ConvertToWebdav( char *url,  BufString *dbs, BufString *sbs, FBOOL *director
 
 			if( lf->ff_Filename[ 0 ] != 0 )
 			{
-				sprintf( buf, "<D:displayname>%s</D:displayname>\n", lf->ff_Filename );
+				snprintf( buf, sizeof( buf ), "<D:displayname>%s</D:displayname>\n", lf->ff_Filename );
 				BufStringAdd( dbs, buf );
 			}
                    
@@ -174,6 +273,11 @@ int ConvertToWebdav( char *url,  BufString *dbs, BufString *sbs, FBOOL *director
 </D:prop>\n \
 <D:status>HTTP/1.1 200 OK</D:status>\n \
 </D:propstat>\n </D:response> " );
+			
+			if( sock != NULL && dbs->bs_Size >= WEBDAV_STREAM_BUFFER )
+			{
+				WebdavFlush( sock, dbs );
+			}
 
 			FriendFile *rfile = lf;
 			lf = (FriendFile *)lf->node.mln_Succ;
@@ -299,9 +403,111 @@ int isError( char *val )
 	return 0;
 }
 
+/**
+ * Handle PROPFIND request
+ *
+ * Multistatus response is written to request socket while driver results are converted,
+ * entries from directory are added only when Depth is not 0.
+ *
+ * @param req http request
+ * @param rootDev pointer to device
+ * @param filePath path inside device
+ * @param url requested url
+ * @return http response
+ */
+static Http *WebdavPropfind( Http *req, File *rootDev, char *filePath, char *url )
+{
+	struct TagItem tags[] = {
+		{ HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicate( "text/xml" ) },
+		{	HTTP_HEADER_CONNECTION, (FULONG)StringDuplicate( "close" ) },
+		{TAG_DONE, TAG_DONE}
+	};
+	FHandler *actFS = (FHandler *)rootDev->f_FSys;
+	FBOOL directory = FALSE;
+	FBOOL listDirectory = TRUE;
+	Http *resp = NULL;
+	int lerror;
+	
+	if( filePath == NULL )
+	{
+		filePath = "";
+	}
+	
+	char *depth = HttpGetHeader( req, "depth", 0 );
+	if( depth != NULL && depth[ 0 ] == '0' )
+	{
+		listDirectory = FALSE;
+	}
+	
+	BufString *dirresp = actFS->Info( rootDev, filePath );
+	if( dirresp == NULL )
+	{
+		return HttpNewSimple( HTTP_404_NOT_FOUND,  tags );
+	}
+	
+	if( ( lerror =  isError(  &( dirresp->bs_Buffer[ 5 ] )  ) ) != 0 )
+	{
+		resp = HttpNewSimple( HTTP_404_NOT_FOUND,  tags );
+		BufString *bs = ReturnFileError( url, lerror );
+		
+		if( bs != NULL )
+		{
+			HttpAddTextContent( resp, bs->bs_Buffer );
+			
+			BufStringDelete( bs );
+		}
+		
+		BufStringDelete( dirresp );
+		return resp;
+	}
+	
+	resp = HttpNewSimple( HTTP_207_MULTI_STATUS,  tags );
+	
+	Socket *sock = req->h_Socket;
+	BufString *strResp = BufStringNewSize( WEBDAV_STREAM_BUFFER + 4096 );
+	
+	// headers go first, entries are sent when buffer is full
+	if( sock != NULL )
+	{
+		resp->h_Stream = TRUE;
+		HttpWrite( resp, sock );
+	}
+	
+	BufStringAdd( strResp, "<?xml version=\"1.0\" ?> \n <D:multistatus xmlns:D=\"DAV:\">\n" );
+	
+	ConvertToWebdav( url, strResp, dirresp, &directory, TRUE, sock );
+	BufStringDelete( dirresp );
+	
+	if( directory == TRUE && listDirectory == TRUE )
+	{
+		dirresp = actFS->Dir( rootDev, filePath );
+		if( dirresp != NULL )
+		{
+			ConvertToWebdav( url, strResp, dirresp, &directory, FALSE, sock );
+			BufStringDelete( dirresp );
+		}
+	}
+	
+	BufStringAdd( strResp, "</D:multistatus>\r\n" );
+	
+	if( sock != NULL )
+	{
+		WebdavFlush( sock, strResp );
+	}
+	else
+	{
+		HttpSetContent( resp, strResp->bs_Buffer, strResp->bs_Size );
+		strResp->bs_Buffer = NULL;
+	}
+	
+	BufStringDelete( strResp );
+	
+	return resp;
+}
+
 //#define DISABLE_WEBDAV
 //#define AUTH_DIGEST
-//#define AUTH_BASIC
+#define AUTH_BASIC
 //
 //
 //
@@ -352,7 +558,7 @@ Http *HandleWebDav( Http *req, char *data, int len )
 	}
 
 
-	User *usr = SLIB->sl_UM->um_Users;
+	User *usr = NULL;
 	//User *foundUsr = NULL;
 	File *rootDev = NULL;
 	char *devname = NULL;
@@ -444,20 +650,49 @@ Http *HandleWebDav( Http *req, char *data, int len )
 		return resp;
 	}
 
-	int decodedUserLen;
-	decodedUser = Base64Decode( (const unsigned char *)&(auth[ 6 ]), strlen( &(auth[ 6 ]) ), &decodedUserLen );
-	//DEBUG("-------->>>>LOGIN PASSWORD %s  -- auth %s   ---- size %d\n", decodedUser, &(auth[ 6 ]), strlen( &(auth[ 6 ]) )  );
+	// clients are sending same header with every request, verified credentials are cached for short time
+	
+	unsigned char authHash[ 32 ];
+	char cachedUserName[ WEBDAV_AUTH_NAME_LEN ];
+	FBOOL authCached = FALSE;
 	
-	userName = decodedUser;
-	for( i=0 ; i < (int)strlen( decodedUser ) ; i++ )
+	WebdavAuthHash( auth, authHash );
+	
+	if( WebdavAuthCacheGet( authHash, cachedUserName ) == TRUE )
 	{
-		if( decodedUser[ i ] == ':' )
+		userName = cachedUserName;
+		authCached = TRUE;
+	}
+	else if( strlen( auth ) > 6 )
+	{
+		int decodedUserLen;
+		decodedUser = Base64Decode( (const unsigned char *)&(auth[ 6 ]), strlen( &(auth[ 6 ]) ), &decodedUserLen );
+		//DEBUG("-------->>>>LOGIN PASSWORD %s  -- auth %s   ---- size %d\n", decodedUser, &(auth[ 6 ]), strlen( &(auth[ 6 ]) )  );
+		
+		if( decodedUser != NULL )
 		{
-			decodedUser[ i ] = 0;
-			userPassword = &(decodedUser[ i+1 ] );
-			break;
+			userName = decodedUser;
+			for( i=0 ; i < (int)strlen( decodedUser ) ; i++ )
+			{
+				if( decodedUser[ i ] == ':' )
+				{
+					decodedUser[ i ] = 0;
+					userPassword = &(decodedUser[ i+1 ] );
+					break;
+				}
+			}
 		}
 	}
+	
+	if( userName == NULL )
+	{
+		resp = HttpNewSimpleANOREQ(  HTTP_403_FORBIDDEN, HTTP_HEADER_CONNECTION, (FULONG)StringDuplicate( "close" ), TAG_DONE );
+		
+		if( decodedUser != NULL ){ free( decodedUser ); }
+		FFree( path );
+		FFree( fpath );
+		return resp;
+	}
 
 #else // (AUTH_DIGEST)
 	/*
@@ -685,13 +920,8 @@ b989d99b20a13a797be7611d2b574ba5-----end
 	
 	AuthMod *ulib = SLIB->AuthModuleGet( SLIB );
 
-	LIST_FOR_EACH( SLIB->sl_UM->um_Users, usr, User * )
-	{
-		if( strcmp( userName, usr->u_Name ) == 0 )
-		{
-			break;
-		}
-	}
+	// reference is released before every return below
+	usr = UMGetUserByNameRef( SLIB->sl_UM, userName );
 	
 	//SLIB->LibraryUserDrop( SLIB, ulib );
 	
@@ -708,11 +938,23 @@ b989d99b20a13a797be7611d2b574ba5-----end
 		
 		if( usr != NULL )
 		{
-			LIST_ADD_HEAD( SLIB->sl_UM->um_Users, usr );
+			UMAddUser( SLIB->sl_UM, usr );
 			
-			SLIB->UserDeviceMount( SLIB, sqll, usr, 0 );
+			// other thread could add same user in meantime, the one from list is used
+			User *lusr = UMGetUserByNameRef( SLIB->sl_UM, userName );
+			if( lusr != usr )
+			{
+				UserDelete( usr );
+			}
+			usr = lusr;
+			
+			if( usr != NULL && usr->u_InitialDevMount == FALSE )
+			{
+				SLIB->UserDeviceMount( SLIB, sqll, usr, 0 );
+			}
 		}
-		else
+		
+		if( usr == NULL )
 		{
 			SLIB->AuthModuleDrop( SLIB, ulib );
 			SLIB->LibraryMYSQLDrop( SLIB, sqll );
@@ -740,8 +982,11 @@ b989d99b20a13a797be7611d2b574ba5-----end
 	
 #ifdef AUTH_BASIC
 	
+	if( authCached == FALSE )
 	{
-		if( ( ulib->CheckPassword( ulib, usr, userPassword ) ) == FALSE )
+		FULONG blockTime = 0;
+		
+		if( usr == NULL || userPassword == NULL || ulib->CheckPassword( ulib, req, usr, userPassword, &blockTime ) == FALSE )
 		{
 			struct TagItem tagsauth[] = {
 				{ HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicate( "text/xml" ) },
@@ -759,8 +1004,11 @@ b989d99b20a13a797be7611d2b574ba5-----end
 			if( decodedUser != NULL ){ free( decodedUser ); }
 			FFree( path );
 			FFree( fpath );
+			UMReleaseUser( SLIB->sl_UM, usr );
 			return resp;
 		}
+		
+		WebdavAuthCachePut( authHash, usr->u_Name );
 	}
 #else		// AUTH DIGEST
 	{
@@ -771,6 +1019,7 @@ b989d99b20a13a797be7611d2b574ba5-----end
 			if( decodedUser != NULL ){ free( decodedUser ); }
 			FFree( path );
 			FFree( fpath );
+			UMReleaseUser( SLIB->sl_UM, usr );
 			return resp;
 		}
 	}
@@ -792,6 +1041,7 @@ b989d99b20a13a797be7611d2b574ba5-----end
 	if( rootDev == NULL )
 	{
 		FERROR("Device %s is not mounted\n", devname );
+		UMReleaseUser( SLIB->sl_UM, usr );
 		return resp;
 	}
 	
@@ -944,6 +1194,7 @@ b989d99b20a13a797be7611d2b574ba5-----end
 		
 		FFree( path );
 		FFree( fpath );
+		UMReleaseUser( SLIB->sl_UM, usr );
 		return resp;
 	}
 	/*
@@ -1005,6 +1256,15 @@ request.xml:1: parser error : Start tag expected, '<' not found
 
 		 */
 	
+	//
+	// PROPFIND, we always return same set of properties so request body is not parsed
+	//
+	
+	else if( strcmp( req->method, "PROPFIND" ) == 0 )
+	{
+		resp = WebdavPropfind( req, rootDev, filePath, fpath );
+	}
+	
 	//
 	// Parse WEBDAV XML request
 	//
@@ -1137,7 +1397,7 @@ request.xml:1: parser error : Start tag expected, '<' not found
 										//BufString *tempbs = BufStringNew();
 										
 										//if( ConvertToWebdav( fpath, tempbs, dirresp, &directory ) == 0 && directory == TRUE )
-										if( ConvertToWebdav( fpath, strResp, dirresp, &directory, TRUE ) == 0 && directory == TRUE )
+										if( ConvertToWebdav( fpath, strResp, dirresp, &directory, TRUE, NULL ) == 0 && directory == TRUE )
 										{
 											BufString *locdirresp;
 											
@@ -1150,7 +1410,7 @@ request.xml:1: parser error : Start tag expected, '<' not found
 												locdirresp = actFS->Dir( rootDev, filePath );
 											}
 											
-											if( ConvertToWebdav( fpath, strResp, locdirresp, &directory, FALSE ) == 0 )
+											if( ConvertToWebdav( fpath, strResp, locdirresp, &directory, FALSE, NULL ) == 0 )
 											{
 											
 												BufStringDelete( locdirresp );
@@ -1269,6 +1529,7 @@ Content-Length: xxxx
 	
 	FFree( path );
 	FFree( fpath );
+	UMReleaseUser( SLIB->sl_UM, usr );
 	//DEBUG("Webdav response returned  :  %s\n", resp->content );
 	
 #else
@@ -49,8 +49,15 @@
 
 #include "network/socket.h"
 #include <system/systembase.h>
+#include <core/metrics.h>
+#include "network/tls_tickets.h"
 #include <pthread.h>
 
+// For debug
+int _writes = 0;
+int _reads = 0;
+int _sockets = 0;
+
 static int ssl_session_ctx_id = 1;
 static int ssl_sockopt_on = 1;
 
@@ -60,7 +67,7 @@ static int ssl_sockopt_on = 1;
  * @param sb pointer to SystemBase
  * @param ssl ctionset to TRUE if you want to setup secured conne
  * @param port number on which connection will be set
- * @param type of connection, for server :SOCKET_TYPE_SERVER, for client: SOCKET_TYPE_CLIENT
+ * @param type of connection, for server :SOCKET_TYPE_SERVER or SOCKET_TYPE_SERVER_REUSEPORT, for client: SOCKET_TYPE_CLIENT
  * @return Socket structure when success, otherwise NULL
  */
 
@@ -74,7 +81,7 @@ Socket* SocketOpen( void *sb, FBOOL ssl, unsigned short port, int type )
 		return NULL;
 	}
 	
-	if( type == SOCKET_TYPE_SERVER )
+	if( type == SOCKET_TYPE_SERVER || type == SOCKET_TYPE_SERVER_REUSEPORT )
 	{
 		if( ( sock = (Socket *) FCalloc( 1, sizeof( Socket ) ) ) != NULL )
 		{
@@ -166,9 +173,12 @@ Socket* SocketOpen( void *sb, FBOOL ssl, unsigned short port, int type )
 			
 			SSL_CTX_set_mode( sock->s_Ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_AUTO_RETRY );
 			SSL_CTX_set_session_cache_mode( sock->s_Ctx, SSL_SESS_CACHE_BOTH ); // for now
-			SSL_CTX_set_options( sock->s_Ctx, SSL_OP_NO_SSLv3 | SSL_OP_NO_SSLv2 | SSL_OP_NO_TICKET | SSL_OP_ALL | SSL_OP_NO_COMPRESSION );
+			SSL_CTX_set_options( sock->s_Ctx, SSL_OP_NO_SSLv3 | SSL_OP_NO_SSLv2 | SSL_OP_ALL | SSL_OP_NO_COMPRESSION );
 		    SSL_CTX_set_session_id_context( sock->s_Ctx, (void *)&ssl_session_ctx_id, sizeof(ssl_session_ctx_id) );
 		    SSL_CTX_set_cipher_list( sock->s_Ctx, "HIGH:!aNULL:!MD5:!RC4" );
+		    
+		    // stateless resumption, ticket keys are shared by all listening sockets and nodes
+		    TLSTicketKeysSetup( sock->s_Ctx );
 		}
 		
 		if( setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, (char*)&ssl_sockopt_on, sizeof(ssl_sockopt_on) ) < 0 )
@@ -179,6 +189,20 @@ Socket* SocketOpen( void *sb, FBOOL ssl, unsigned short port, int type )
 			return NULL;
 		}
 		
+		// every reactor has its own listening socket on the same port, kernel balances connections between them
+		if( type == SOCKET_TYPE_SERVER_REUSEPORT )
+		{
+#ifdef SO_REUSEPORT
+			if( setsockopt( fd, SOL_SOCKET, SO_REUSEPORT, (char*)&ssl_sockopt_on, sizeof(ssl_sockopt_on) ) < 0 )
+#endif
+			{
+				FERROR( "[SOCKET] ERROR setsockopt(SO_REUSEPORT) failed\n");
+				close( fd );
+				SocketFree( sock );
+				return NULL;
+			}
+		}
+		
 		struct timeval t = { 60, 0 };
 		
 		if( setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, ( void *)&t, sizeof( t ) ) < 0 )
@@ -1196,78 +1220,12 @@ Socket* SocketAcceptPair( Socket* sock, struct AcceptPair *p )
 		
 		//DEBUG("Before loop\n");
 
-		 // setup SSL session 
-		int err = 0;
-		int retries = 0;
-		while( 1 )
+		// first step of handshake, it is continued by SocketAcceptHandshake when socket is ready
+		incoming->s_HandshakeStart = MetricsTime();
+		if( SocketAcceptHandshake( incoming ) < 0 )
 		{
-			//DEBUG( "[SocketAcceptPair] Going into SSL_accept..\n" );
-			
-			
-			if( ( err = SSL_accept( incoming->s_Ssl ) ) == 1 )
-			{
-				//DEBUG("Connection accepted %p\n", incoming );
-				break;
-			}
-
-			//DEBUG( "[SocketAcceptPair] SSL_accept..\n" );
-			if( err <= 0 || err == 2 )
-			{
-				int error = SSL_get_error( incoming->s_Ssl, err );
-		
-				//DEBUG("Error %d\n", error );
-	
-				switch( error )
-				{
-					case SSL_ERROR_NONE:
-						// NO error..
-						FERROR( "[SocketAcceptPair] No error\n" );
-						return incoming;
-					case SSL_ERROR_ZERO_RETURN:
-						FERROR("[SocketAcceptPair] SSL_ACCEPT error: Socket closed.\n" );
-						SocketClose( incoming );
-						return NULL;
-					case SSL_ERROR_WANT_READ:
-						//FERROR( "[SocketAcceptPair] Error want read.\n" );
-						/*
-						if( retries++ > 10000 )
-						{
-							SocketClose( incoming );
-							return NULL;
-						}
-						usleep( 50 );
-						*/
-						return incoming;
-					case SSL_ERROR_WANT_WRITE:
-						//FERROR( "[SocketAcceptPair] Error want write, retrying\n" );
-						/*
-						if( retries++ > 10000 )
-						{
-							SocketClose( incoming );
-							return NULL;
-						}
-						usleep( 50 );
-						*/
-						return incoming;
-					case SSL_ERROR_WANT_ACCEPT:
-						FERROR( "[SocketAcceptPair] Want accept\n" );
-						SocketClose( incoming );
-						return NULL;
-					case SSL_ERROR_WANT_X509_LOOKUP:
-						FERROR( "[SocketAcceptPair] Want 509 lookup\n" );
-						SocketClose( incoming );
-						return NULL;
-					case SSL_ERROR_SYSCALL:
-						FERROR( "[SocketAcceptPair] Error syscall.\n" ); //. Goodbye! %s.\n", ERR_error_string( ERR_get_error(), NULL ) );
-						SocketClose( incoming );
-						return NULL;
-					case SSL_ERROR_SSL:
-						FERROR( "[SocketAcceptPair] SSL_ERROR_SSL: %s.\n", ERR_error_string( ERR_get_error(), NULL ) );
-						SocketClose( incoming );
-						return NULL;
-				}
-			}
-			usleep( 0 );
+			SocketClose( incoming );
+			return NULL;
 		}
 		//DEBUG("Before end, fd %d\n", fd );
 	}
@@ -1277,6 +1235,62 @@ Socket* SocketAcceptPair( Socket* sock, struct AcceptPair *p )
 	return incoming;
 }
 
+/**
+ * Make one step of server side TLS handshake. Function never blocks,
+ * caller waits for event returned by function and calls it again.
+ *
+ * @param sock pointer to accepted socket
+ * @return SOCKET_HANDSHAKE_DONE when handshake is finished, SOCKET_HANDSHAKE_WANT_READ or SOCKET_HANDSHAKE_WANT_WRITE when handshake waits for socket, -1 when handshake failed
+ */
+
+int SocketAcceptHandshake( Socket *sock )
+{
+	if( sock == NULL )
+	{
+		return -1;
+	}
+	
+	if( sock->s_SSLEnabled == FALSE || sock->s_Ssl == NULL )
+	{
+		sock->s_HandshakeState = SOCKET_HANDSHAKE_DONE;
+		return SOCKET_HANDSHAKE_DONE;
+	}
+	
+	ERR_clear_error();
+	int err = SSL_accept( sock->s_Ssl );
+	if( err == 1 )
+	{
+		MetricsRecordSince( METRIC_STAGE_TLS_HANDSHAKE, sock->s_HandshakeStart );
+		sock->s_HandshakeStart = 0;
+		sock->s_HandshakeState = SOCKET_HANDSHAKE_DONE;
+		return SOCKET_HANDSHAKE_DONE;
+	}
+	
+	int error = SSL_get_error( sock->s_Ssl, err );
+	switch( error )
+	{
+		case SSL_ERROR_WANT_READ:
+			sock->s_HandshakeState = SOCKET_HANDSHAKE_WANT_READ;
+			return SOCKET_HANDSHAKE_WANT_READ;
+		case SSL_ERROR_WANT_WRITE:
+			sock->s_HandshakeState = SOCKET_HANDSHAKE_WANT_WRITE;
+			return SOCKET_HANDSHAKE_WANT_WRITE;
+		case SSL_ERROR_ZERO_RETURN:
+			FERROR("[SocketAcceptHandshake] SSL_ACCEPT error: Socket closed.\n" );
+			break;
+		case SSL_ERROR_SYSCALL:
+			FERROR( "[SocketAcceptHandshake] Error syscall.\n" );
+			break;
+		case SSL_ERROR_SSL:
+			FERROR( "[SocketAcceptHandshake] SSL_ERROR_SSL: %s.\n", ERR_error_string( ERR_get_error(), NULL ) );
+			break;
+		default:
+			FERROR( "[SocketAcceptHandshake] SSL_accept error %d\n", error );
+			break;
+	}
+	return -1;
+}
+
 /**
  * Read data from socket
  *
@@ -1326,6 +1340,12 @@ int SocketRead( Socket* sock, char* data, unsigned int length, unsigned int pass
 #ifndef NO_VALGRIND_STUFF	
 				VALGRIND_MAKE_MEM_DEFINED( data + read, res );
 #endif
+				// handshake which did not finish in SocketAcceptPair is done when first data arrive
+				if( sock->s_HandshakeStart != 0 )
+				{
+					MetricsRecordSince( METRIC_STAGE_TLS_HANDSHAKE, sock->s_HandshakeStart );
+					sock->s_HandshakeStart = 0;
+				}
 				read += res;
 				read_retries = retries = 0;
 				
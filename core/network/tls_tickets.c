@@ -0,0 +1,364 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+
+/** @file
+ *
+ *  TLS session tickets
+ *
+ *  Key file contains one or more keys, TLS_TICKET_KEY_SIZE bytes each
+ *  (name, HMAC secret, AES secret). It can be created by
+ *  "openssl rand 80 > ticket.key". New key should be put at the beginning
+ *  of the file, previous keys are still used to decrypt old tickets.
+ *
+ *  @date created 10/2026
+ */
+
+#include <core/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <util/log/log.h>
+#include <util/string.h>
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#else
+#include <openssl/hmac.h>
+#endif
+#include "tls_tickets.h"
+
+static TLSTicketKey tlsTicketKeys[ TLS_TICKET_KEYS_MAX ];
+static int tlsTicketKeysNumber = 0;
+static char *tlsTicketKeysPath = NULL;
+static time_t tlsTicketKeysModified = 0;	// modification time of loaded key file
+static time_t tlsTicketKeysRotated = 0;		// time when random key was generated
+static int tlsTicketLifetime = TLS_TICKET_LIFETIME;
+static FBOOL tlsTicketKeysInitialized = FALSE;
+static pthread_mutex_t tlsTicketKeysMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Load keys from file
+ *
+ * @param path path to key file
+ * @param mtime modification time of file
+ * @return 0 when success, otherwise error number
+ */
+static int TLSTicketKeysLoad( const char *path, time_t mtime )
+{
+	TLSTicketKey keys[ TLS_TICKET_KEYS_MAX ];
+	int number = 0;
+	
+	FILE *fp = fopen( path, "rb" );
+	if( fp == NULL )
+	{
+		FERROR("[TLSTicketKeysLoad] Cannot open key file %s\n", path );
+		return -1;
+	}
+	
+	while( number < TLS_TICKET_KEYS_MAX && fread( &keys[ number ], 1, TLS_TICKET_KEY_SIZE, fp ) == TLS_TICKET_KEY_SIZE )
+	{
+		number++;
+	}
+	fclose( fp );
+	
+	if( number == 0 )
+	{
+		FERROR("[TLSTicketKeysLoad] Key file %s must contain at least one key of %d bytes\n", path, TLS_TICKET_KEY_SIZE );
+		OPENSSL_cleanse( keys, sizeof( keys ) );
+		return -2;
+	}
+	
+	pthread_mutex_lock( &tlsTicketKeysMutex );
+	memcpy( tlsTicketKeys, keys, number * sizeof( TLSTicketKey ) );
+	tlsTicketKeysNumber = number;
+	tlsTicketKeysModified = mtime;
+	pthread_mutex_unlock( &tlsTicketKeysMutex );
+	
+	OPENSSL_cleanse( keys, sizeof( keys ) );
+	
+	INFO("[TLSTicketKeysLoad] Loaded %d ticket keys from %s\n", number, path );
+	return 0;
+}
+
+/**
+ * Generate new random key, previous keys are kept to decrypt old tickets
+ *
+ * @return 0 when success, otherwise error number
+ */
+static int TLSTicketKeysGenerate( void )
+{
+	TLSTicketKey key;
+	
+	if( RAND_bytes( (unsigned char *)&key, sizeof( key ) ) != 1 )
+	{
+		FERROR("[TLSTicketKeysGenerate] Cannot generate ticket key\n");
+		return -1;
+	}
+	
+	pthread_mutex_lock( &tlsTicketKeysMutex );
+	if( tlsTicketKeysNumber == TLS_TICKET_KEYS_MAX )
+	{
+		tlsTicketKeysNumber--;
+	}
+	memmove( &tlsTicketKeys[ 1 ], &tlsTicketKeys[ 0 ], tlsTicketKeysNumber * sizeof( TLSTicketKey ) );
+	memcpy( &tlsTicketKeys[ 0 ], &key, sizeof( key ) );
+	tlsTicketKeysNumber++;
+	tlsTicketKeysRotated = time( NULL );
+	pthread_mutex_unlock( &tlsTicketKeysMutex );
+	
+	OPENSSL_cleanse( &key, sizeof( key ) );
+	
+	DEBUG("[TLSTicketKeysGenerate] New ticket key generated\n");
+	return 0;
+}
+
+/**
+ * Initialize ticket keys
+ *
+ * @param path path to shared key file, when file does not exist random keys are used
+ * @param lifetime ticket lifetime in seconds
+ * @return 0 when success, otherwise error number
+ */
+int TLSTicketKeysInit( const char *path, int lifetime )
+{
+	struct stat st;
+	
+	if( lifetime > 0 )
+	{
+		tlsTicketLifetime = lifetime;
+	}
+	
+	if( path != NULL && stat( path, &st ) == 0 )
+	{
+		if( ( tlsTicketKeysPath = StringDuplicate( path ) ) != NULL && TLSTicketKeysLoad( path, st.st_mtime ) == 0 )
+		{
+			tlsTicketKeysInitialized = TRUE;
+			return 0;
+		}
+		FFree( tlsTicketKeysPath );
+		tlsTicketKeysPath = NULL;
+	}
+	
+	INFO("[TLSTicketKeysInit] Key file not found, ticket keys are generated. Resumption works only on this node.\n");
+	
+	if( TLSTicketKeysGenerate() != 0 )
+	{
+		return -1;
+	}
+	tlsTicketKeysInitialized = TRUE;
+	return 0;
+}
+
+/**
+ * Remove ticket keys from memory
+ */
+void TLSTicketKeysDelete( void )
+{
+	pthread_mutex_lock( &tlsTicketKeysMutex );
+	OPENSSL_cleanse( tlsTicketKeys, sizeof( tlsTicketKeys ) );
+	tlsTicketKeysNumber = 0;
+	if( tlsTicketKeysPath != NULL )
+	{
+		FFree( tlsTicketKeysPath );
+		tlsTicketKeysPath = NULL;
+	}
+	tlsTicketKeysInitialized = FALSE;
+	pthread_mutex_unlock( &tlsTicketKeysMutex );
+}
+
+/**
+ * Find ticket key and initialize cipher context
+ *
+ * @param name key name stored in ticket
+ * @param iv initialization vector
+ * @param ectx cipher context
+ * @param enc 1 when new ticket is created, 0 when ticket is decrypted
+ * @param key place where copy of key is stored, HMAC secret is used by caller
+ * @return index of key when success, -1 when key was not found, -2 on error
+ */
+static int TLSTicketCipherInit( unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx, int enc, TLSTicketKey *key )
+{
+	int i, found = -1;
+	
+	pthread_mutex_lock( &tlsTicketKeysMutex );
+	if( enc == 1 )
+	{
+		if( tlsTicketKeysNumber > 0 )
+		{
+			found = 0;
+		}
+	}
+	else
+	{
+		for( i = 0; i < tlsTicketKeysNumber; i++ )
+		{
+			if( memcmp( name, tlsTicketKeys[ i ].ttk_Name, TLS_TICKET_KEY_NAME_SIZE ) == 0 )
+			{
+				found = i;
+				break;
+			}
+		}
+	}
+	if( found >= 0 )
+	{
+		memcpy( key, &tlsTicketKeys[ found ], sizeof( TLSTicketKey ) );
+	}
+	pthread_mutex_unlock( &tlsTicketKeysMutex );
+	
+	if( found < 0 )
+	{
+		return -1;
+	}
+	
+	if( enc == 1 )
+	{
+		memcpy( name, key->ttk_Name, TLS_TICKET_KEY_NAME_SIZE );
+		if( RAND_bytes( iv, EVP_CIPHER_iv_length( EVP_aes_256_cbc() ) ) != 1 ||
+			EVP_EncryptInit_ex( ectx, EVP_aes_256_cbc(), NULL, key->ttk_AES, iv ) != 1 )
+		{
+			return -2;
+		}
+	}
+	else if( EVP_DecryptInit_ex( ectx, EVP_aes_256_cbc(), NULL, key->ttk_AES, iv ) != 1 )
+	{
+		return -2;
+	}
+	return found;
+}
+
+/**
+ * OpenSSL callback which encrypts and decrypts tickets
+ *
+ * @param ssl pointer to SSL connection
+ * @param name key name stored in ticket
+ * @param iv initialization vector
+ * @param ectx cipher context
+ * @param hctx HMAC context
+ * @param enc 1 when new ticket is created, 0 when ticket is decrypted
+ * @return 1 when success, 2 when ticket is valid but should be renewed, 0 when key was not found, -1 on error
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int TLSTicketKeyCallback( SSL *ssl, unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx, EVP_MAC_CTX *hctx, int enc )
+#else
+static int TLSTicketKeyCallback( SSL *ssl, unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *ectx, HMAC_CTX *hctx, int enc )
+#endif
+{
+	TLSTicketKey key;
+	
+	int found = TLSTicketCipherInit( name, iv, ectx, enc, &key );
+	if( found == -1 )
+	{
+		// no key, full handshake will be done
+		return enc == 1 ? -1 : 0;
+	}
+	
+	int ret = found >= 0 ? 1 : -1;
+	
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	OSSL_PARAM params[ 2 ];
+	params[ 0 ] = OSSL_PARAM_construct_utf8_string( OSSL_MAC_PARAM_DIGEST, "SHA256", 0 );
+	params[ 1 ] = OSSL_PARAM_construct_end();
+	
+	if( ret == 1 && EVP_MAC_init( hctx, key.ttk_HMAC, TLS_TICKET_KEY_HMAC_SIZE, params ) != 1 )
+#else
+	if( ret == 1 && HMAC_Init_ex( hctx, key.ttk_HMAC, TLS_TICKET_KEY_HMAC_SIZE, EVP_sha256(), NULL ) != 1 )
+#endif
+	{
+		ret = -1;
+	}
+	
+	OPENSSL_cleanse( &key, sizeof( key ) );
+	
+	// ticket encrypted by older key, client gets new one
+	if( ret == 1 && enc == 0 && found > 0 )
+	{
+		ret = 2;
+	}
+	return ret;
+}
+
+/**
+ * Enable session tickets on server SSL context
+ *
+ * @param ctx pointer to SSL context
+ * @return 0 when success, otherwise error number
+ */
+int TLSTicketKeysSetup( SSL_CTX *ctx )
+{
+	if( ctx == NULL )
+	{
+		return -1;
+	}
+	
+	if( tlsTicketKeysInitialized == FALSE )
+	{
+		TLSTicketKeysInit( NULL, 0 );
+	}
+	
+	SSL_CTX_clear_options( ctx, SSL_OP_NO_TICKET );
+	SSL_CTX_set_timeout( ctx, tlsTicketLifetime );
+	
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if( SSL_CTX_set_tlsext_ticket_key_evp_cb( ctx, TLSTicketKeyCallback ) != 1 )
+#else
+	if( SSL_CTX_set_tlsext_ticket_key_cb( ctx, TLSTicketKeyCallback ) != 1 )
+#endif
+	{
+		FERROR("[TLSTicketKeysSetup] Cannot set ticket key callback\n");
+		SSL_CTX_set_options( ctx, SSL_OP_NO_TICKET );
+		return -2;
+	}
+	return 0;
+}
+
+/**
+ * Event which reloads key file when it was changed or rotates random keys
+ *
+ * @param lsb pointer to SystemBase
+ * @return 0
+ */
+int TLSTicketKeysRefreshEvent( void *lsb )
+{
+	if( tlsTicketKeysInitialized == FALSE )
+	{
+		return 0;
+	}
+	
+	if( tlsTicketKeysPath != NULL )
+	{
+		struct stat st;
+		if( stat( tlsTicketKeysPath, &st ) == 0 && st.st_mtime != tlsTicketKeysModified )
+		{
+			TLSTicketKeysLoad( tlsTicketKeysPath, st.st_mtime );
+		}
+	}
+	else if( ( time( NULL ) - tlsTicketKeysRotated ) >= tlsTicketLifetime )
+	{
+		TLSTicketKeysGenerate();
+	}
+	return 0;
+}
@@ -0,0 +1,85 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+
+/** @file
+ *
+ *  TLS session tickets
+ *
+ *  Keys used to encrypt session tickets are shared by all server SSL
+ *  contexts. They can be loaded from file which is distributed to all
+ *  nodes, then resumption works on every node behind load balancer.
+ *  Without file keys are generated randomly and rotated periodically.
+ *
+ *  @date created 10/2026
+ */
+
+#ifndef __NETWORK_TLS_TICKETS_H__
+#define __NETWORK_TLS_TICKETS_H__
+
+#include <core/types.h>
+#include <openssl/ssl.h>
+
+#define TLS_TICKET_KEY_NAME_SIZE		16
+#define TLS_TICKET_KEY_HMAC_SIZE		32
+#define TLS_TICKET_KEY_AES_SIZE			32
+#define TLS_TICKET_KEY_SIZE				( TLS_TICKET_KEY_NAME_SIZE + TLS_TICKET_KEY_HMAC_SIZE + TLS_TICKET_KEY_AES_SIZE )
+#define TLS_TICKET_KEYS_MAX				4		// first key encrypts new tickets, all keys decrypt
+#define TLS_TICKET_LIFETIME				43200	// seconds, also time after which random key is rotated
+#define TLS_TICKET_CHECK_INTERVAL		60		// seconds between key file checks
+
+//
+// Ticket key
+//
+
+typedef struct TLSTicketKey
+{
+	unsigned char			ttk_Name[ TLS_TICKET_KEY_NAME_SIZE ];
+	unsigned char			ttk_HMAC[ TLS_TICKET_KEY_HMAC_SIZE ];
+	unsigned char			ttk_AES[ TLS_TICKET_KEY_AES_SIZE ];
+}TLSTicketKey;
+
+//
+//
+//
+
+int TLSTicketKeysInit( const char *path, int lifetime );
+
+//
+//
+//
+
+void TLSTicketKeysDelete( void );
+
+//
+//
+//
+
+int TLSTicketKeysSetup( SSL_CTX *ctx );
+
+//
+//
+//
+
+int TLSTicketKeysRefreshEvent( void *lsb );
+
+#endif // __NETWORK_TLS_TICKETS_H__
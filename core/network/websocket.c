@@ -52,6 +52,7 @@
 #include <system/json/jsmn.h>
 #include <private-libwebsockets.h>
 #include <system/user/user_session.h>
+#include <network/websocket_client.h>
 
 extern SystemBase *SLIB;
 
@@ -197,8 +198,7 @@ void WSThread( WSThreadData *data )
 	{
 		http->h_WSocket = fcd->fcd_WSClient;
 		
-		struct timeval start, stop;
-		gettimeofday(&start, NULL);
+		FUQUAD start = MetricsTime();
 		
 		http->content = queryrawbs->bs_Buffer;
 		queryrawbs->bs_Buffer = NULL;
@@ -207,10 +207,7 @@ void WSThread( WSThreadData *data )
 		
 		Http *response = SLIB->SysWebRequest( SLIB, &(pathParts[ 1 ]), &http, ses );
 		
-		gettimeofday(&stop, NULL);
-		double secs = (double)(stop.tv_usec - start.tv_usec) / 1000000 + (double)(stop.tv_sec - start.tv_sec);
-		
-		DEBUG("WS ->SysWebRequest took %f seconds\n", secs );
+		MetricsRequestEnd( METRIC_STAGE_WS_REQUEST, pathParts[ 1 ], start );
 		
 		if( response != NULL )
 		{
@@ -483,6 +480,83 @@ void WSThreadPing( WSThreadData *data )
 #endif
 
 
+/**
+ * Write messages queued for websocket connection
+ *
+ * Called by websocket thread when connection is writable. Messages are taken
+ * from queue one by one, so senders never wait for socket.
+ *
+ * @param wsi pointer to libwebsockets connection
+ * @param fcd pointer to connection data
+ * @return 0 when success, -1 when connection must be closed
+ */
+static int WebSocketWriteQueued( struct lws *wsi, FCWSData *fcd )
+{
+	int i;
+	
+	if( fcd == NULL )
+	{
+		return 0;
+	}
+	
+	for( i = 0 ; i < WS_CLIENT_WRITES_PER_CALLBACK ; i++ )
+	{
+		UserSession *us = (UserSession *)fcd->fcd_ActiveSession;
+		if( us == NULL )
+		{
+			return 0;
+		}
+		
+		// session mutex protects connection from being removed
+		pthread_mutex_lock( &us->us_WSMutex );
+		WebsocketClient *wsc = (WebsocketClient *)fcd->fcd_WSClient;
+		if( wsc == NULL )
+		{
+			pthread_mutex_unlock( &us->us_WSMutex );
+			return 0;
+		}
+		if( wsc->wc_Close == TRUE )
+		{
+			pthread_mutex_unlock( &us->us_WSMutex );
+			return -1;
+		}
+		
+		FBOOL more = FALSE;
+		int mode = LWS_WRITE_TEXT;
+		WebsocketPayload *wp = WebsocketClientDequeue( wsc, &more, &mode );
+		pthread_mutex_unlock( &us->us_WSMutex );
+		
+		if( wp == NULL )
+		{
+			return 0;
+		}
+		
+		int n = lws_write( wsi, wp->wp_Data, wp->wp_Size, (enum lws_write_protocol)mode );
+		WebsocketPayloadUnref( wp );
+		
+		if( n < 0 )
+		{
+			FERROR("[WS] Cannot write queued message\n");
+			return -1;
+		}
+		
+		if( more == FALSE )
+		{
+			return 0;
+		}
+		
+		if( lws_send_pipe_choked( wsi ) )
+		{
+			break;
+		}
+	}
+	
+	// rest of messages will be sent when socket will accept them
+	lws_callback_on_writable( wsi );
+	
+	return 0;
+}
+
 /**
  * Main FriendCore websocket callback
  *
@@ -567,9 +641,8 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 						
 						AppSessionRemByWebSocket( sb->sl_AppSessionManager->sl_AppSessions, owsc );
 						
-						owsc->wc_UserSession = NULL;
-						owsc->wc_Wsi = NULL;
-						FFree( owsc );
+						fcd->fcd_WSClient = NULL;
+						WebsocketClientDelete( owsc );
 						owsc = NULL;
 						DEBUG("[WS]: WS connection removed\n");
 					}
@@ -591,9 +664,8 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 								AppSessionRemByWebSocket( sb->sl_AppSessionManager->sl_AppSessions, nwsc );
 								
 								DEBUG("WS connection will be removed\n");
-								nwsc->wc_UserSession = NULL;
-								nwsc->wc_Wsi = NULL;
-								FFree( nwsc );
+								fcd->fcd_WSClient = NULL;
+								WebsocketClientDelete( nwsc );
 								nwsc = NULL;
 								
 								//fcd->fcd_ActiveSession = NULL;
@@ -1104,8 +1176,7 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 													{
 														http->h_WSocket = wsi;
 														
-														struct timeval start, stop;
-														gettimeofday(&start, NULL);
+														FUQUAD start = MetricsTime();
 														
 														http->content = queryrawbs->bs_Buffer;
 														queryrawbs->bs_Buffer = NULL;
@@ -1114,10 +1185,7 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 														
 														Http *response = SLIB->SysWebRequest( SLIB, &(pathParts[ 1 ]), &http, fcd->fcd_ActiveSession );
 														
-														gettimeofday(&stop, NULL);
-														double secs = (double)(stop.tv_usec - start.tv_usec) / 1000000 + (double)(stop.tv_sec - start.tv_sec);
-														
-														DEBUG("WS ->SysWebRequest took %f seconds\n", secs );
+														MetricsRequestEnd( METRIC_STAGE_WS_REQUEST, pathParts[ 1 ], start );
 						
 														if( response != NULL )
 														{
@@ -1477,8 +1545,7 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 														{
 															http->h_WSocket = wsi;
 														
-															struct timeval start, stop;
-															gettimeofday(&start, NULL);
+															FUQUAD start = MetricsTime();
 														
 															http->content = queryrawbs->bs_Buffer;
 															queryrawbs->bs_Buffer = NULL;
@@ -1487,10 +1554,7 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 															
 															Http *response = SLIB->SysWebRequest( SLIB, &(pathParts[ 1 ]), &http, fcd->fcd_ActiveSession );
 														
-															gettimeofday(&stop, NULL);
-															double secs = (double)(stop.tv_usec - start.tv_usec) / 1000000 + (double)(stop.tv_sec - start.tv_sec);
-														
-															DEBUG("\n\nWS ->SysWebRequest took %f seconds\n", secs );
+															MetricsRequestEnd( METRIC_STAGE_WS_REQUEST, pathParts[ 1 ], start );
 														
 															if( response != NULL )
 															{
@@ -1542,6 +1606,10 @@ int FC_Callback( struct lws *wsi, enum lws_callback_reasons reason, void *user,
 			
 		break;
 		
+		case LWS_CALLBACK_SERVER_WRITEABLE:
+			returnError = WebSocketWriteQueued( wsi, fcd );
+		break;
+		
 		case LWS_CALLBACK_OPENSSL_PERFORM_CLIENT_CERT_VERIFICATION:
 			DEBUG1("[WS]: LWS_CALLBACK_OPENSSL_PERFORM_CLIENT_CERT_VERIFICATION\n");
 			break;
@@ -1642,6 +1710,23 @@ int WebsocketThread( FThread *data )
 		//pthread_yield();
 		int n = lws_service( ws->ws_Context, 500 );
 		
+		// connections with new messages, lws_callback_on_writable must be called from this thread
+		pthread_mutex_lock( &(ws->ws_PendingMutex) );
+		WebsocketClient *wsc = ws->ws_PendingWrites;
+		ws->ws_PendingWrites = NULL;
+		while( wsc != NULL )
+		{
+			WebsocketClient *next = wsc->wc_PendingNext;
+			wsc->wc_PendingNext = NULL;
+			wsc->wc_WritePending = FALSE;
+			if( wsc->wc_Wsi != NULL )
+			{
+				lws_callback_on_writable( wsc->wc_Wsi );
+			}
+			wsc = next;
+		}
+		pthread_mutex_unlock( &(ws->ws_PendingMutex) );
+		
 		if( ws->ws_Quit == TRUE && nothreads <= 0 )
 		{
 			break;
@@ -1666,6 +1751,69 @@ int WebSocketStart( WebSocket *ws )
 	return 0;
 }
 
+/**
+ * Ask websocket thread to write messages queued for connection
+ *
+ * @param ws pointer to WebSocket structure
+ * @param wsc pointer to WebsocketClient which have messages in queue
+ */
+void WebSocketScheduleWrite( WebSocket *ws, WebsocketClient *wsc )
+{
+	FBOOL wake = FALSE;
+	
+	pthread_mutex_lock( &(ws->ws_PendingMutex) );
+	if( wsc->wc_WritePending == FALSE )
+	{
+		wsc->wc_WritePending = TRUE;
+		wsc->wc_PendingNext = ws->ws_PendingWrites;
+		ws->ws_PendingWrites = wsc;
+		wake = TRUE;
+	}
+	pthread_mutex_unlock( &(ws->ws_PendingMutex) );
+	
+	// break lws_service wait, function can be called from other threads
+	if( wake == TRUE && ws->ws_Context != NULL )
+	{
+		lws_cancel_service( ws->ws_Context );
+	}
+}
+
+/**
+ * Remove connection from list of connections waiting for write
+ *
+ * @param ws pointer to WebSocket structure
+ * @param wsc pointer to WebsocketClient which will be removed
+ */
+void WebSocketCancelWrite( WebSocket *ws, WebsocketClient *wsc )
+{
+	pthread_mutex_lock( &(ws->ws_PendingMutex) );
+	if( wsc->wc_WritePending == TRUE )
+	{
+		WebsocketClient *prev = NULL;
+		WebsocketClient *act = ws->ws_PendingWrites;
+		while( act != NULL )
+		{
+			if( act == wsc )
+			{
+				if( prev == NULL )
+				{
+					ws->ws_PendingWrites = act->wc_PendingNext;
+				}
+				else
+				{
+					prev->wc_PendingNext = act->wc_PendingNext;
+				}
+				break;
+			}
+			prev = act;
+			act = act->wc_PendingNext;
+		}
+		wsc->wc_WritePending = FALSE;
+		wsc->wc_PendingNext = NULL;
+	}
+	pthread_mutex_unlock( &(ws->ws_PendingMutex) );
+}
+
 /**
  * Create WebSocket structure
  *
@@ -1694,6 +1842,7 @@ WebSocket *WebSocketNew( void *sb,  int port, FBOOL sslOn )
 		ws->ws_InterfaceName[ 0 ] = 0;
 		memset( &(ws->ws_Info), 0, sizeof ws->ws_Info );
 		ws->ws_Interface = NULL;
+		pthread_mutex_init( &(ws->ws_PendingMutex), NULL );
 		
 		if( ws->ws_UseSSL == TRUE )
 		{
@@ -1756,6 +1905,7 @@ WebSocket *WebSocketNew( void *sb,  int port, FBOOL sslOn )
 		{
 			FERROR( "[WS]: libwebsocket init failed, cannot create context\n");
 
+			pthread_mutex_destroy( &(ws->ws_PendingMutex) );
 			FFree( ws );
 			return NULL;
 		}
@@ -1805,6 +1955,9 @@ void WebSocketDelete( WebSocket* ws )
 		}
 		
 		lws_context_destroy( ws->ws_Context );
+		ws->ws_Context = NULL;
+		
+		pthread_mutex_destroy( &(ws->ws_PendingMutex) );
 		
 		if( ws->ws_CertPath != NULL )
 		{
@@ -2341,8 +2494,7 @@ void WSThread( WSThreadData *data )
 										{
 											http->h_WSocket = wsi;
 											
-											struct timeval start, stop;
-											gettimeofday(&start, NULL);
+											FUQUAD start = MetricsTime();
 											
 											http->content = queryrawbs->bs_Buffer;
 											queryrawbs->bs_Buffer = NULL;
@@ -2351,10 +2503,7 @@ void WSThread( WSThreadData *data )
 											
 											Http *response = SLIB->SysWebRequest( SLIB, &(pathParts[ 1 ]), &http, fcd->fcd_ActiveSession );
 											
-											gettimeofday(&stop, NULL);
-											double secs = (double)(stop.tv_usec - start.tv_usec) / 1000000 + (double)(stop.tv_sec - start.tv_sec);
-											
-											DEBUG("WS ->SysWebRequest took %f seconds\n", secs );
+											MetricsRequestEnd( METRIC_STAGE_WS_REQUEST, pathParts[ 1 ], start );
 											
 											if( response != NULL )
 											{
@@ -2716,8 +2865,7 @@ void WSThread( WSThreadData *data )
 											{
 												http->h_WSocket = wsi;
 												
-												struct timeval start, stop;
-												gettimeofday(&start, NULL);
+												FUQUAD start = MetricsTime();
 												
 												http->content = queryrawbs->bs_Buffer;
 												queryrawbs->bs_Buffer = NULL;
@@ -2726,10 +2874,7 @@ void WSThread( WSThreadData *data )
 												
 												Http *response = SLIB->SysWebRequest( SLIB, &(pathParts[ 1 ]), &http, fcd->fcd_ActiveSession );
 												
-												gettimeofday(&stop, NULL);
-												double secs = (double)(stop.tv_usec - start.tv_usec) / 1000000 + (double)(stop.tv_sec - start.tv_sec);
-												
-												DEBUG("\n\nWS ->SysWebRequest took %f seconds\n", secs );
+												MetricsRequestEnd( METRIC_STAGE_WS_REQUEST, pathParts[ 1 ], start );
 												
 												if( response != NULL )
 												{
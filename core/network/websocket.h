@@ -48,6 +48,8 @@
 
 #define MAX_POLL_ELEMENTS 256
 
+struct WebsocketClient;
+
 //
 // main WebSocket structure
 //
@@ -78,6 +80,10 @@ typedef struct WebSocket
 	
 	FBOOL                                           ws_Quit;
 	void                                            *ws_FCM;
+	
+	// connections which have queued messages, websocket thread asks lws for writable callback
+	struct WebsocketClient                          *ws_PendingWrites;
+	pthread_mutex_t                                 ws_PendingMutex;
 } WebSocket;
 
 
@@ -113,6 +119,18 @@ void WebSocketDelete( WebSocket *ws );
 
 int WebSocketStart( WebSocket *ws );
 
+//
+//
+//
+
+void WebSocketScheduleWrite( WebSocket *ws, struct WebsocketClient *wsc );
+
+//
+//
+//
+
+void WebSocketCancelWrite( WebSocket *ws, struct WebsocketClient *wsc );
+
 #endif // __NETWORK_WEBSOCKET_H__
 
 
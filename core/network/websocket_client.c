@@ -0,0 +1,312 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ * 
+ *  Websocket client outbound queue
+ *
+ * Messages are queued by any thread and written by websocket thread
+ * when connection is writable.
+ *
+ *  @author PS (Pawel Stefanski)
+ *  @date created 2016
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <core/types.h>
+#include <network/websocket_client.h>
+#include <network/websocket.h>
+#include <util/log/log.h>
+
+/**
+ * Create new websocket payload
+ *
+ * @param msg message which will be sent, when NULL caller fills wp_Data
+ * @param len length of the message
+ * @return pointer to new WebsocketPayload with reference count 1, otherwise NULL
+ */
+
+WebsocketPayload *WebsocketPayloadNew( const char *msg, int len )
+{
+	WebsocketPayload *wp = FCalloc( 1, sizeof( WebsocketPayload ) + LWS_SEND_BUFFER_PRE_PADDING + len + LWS_SEND_BUFFER_POST_PADDING + 1 );
+	if( wp != NULL )
+	{
+		wp->wp_RefCount = 1;
+		wp->wp_Size = len;
+		wp->wp_Data = ((unsigned char *)wp) + sizeof( WebsocketPayload ) + LWS_SEND_BUFFER_PRE_PADDING;
+		if( msg != NULL )
+		{
+			memcpy( wp->wp_Data, msg, len );
+		}
+	}
+	return wp;
+}
+
+/**
+ * Take reference to websocket payload
+ *
+ * @param wp pointer to WebsocketPayload
+ */
+
+void WebsocketPayloadRef( WebsocketPayload *wp )
+{
+	__sync_fetch_and_add( &(wp->wp_RefCount), 1 );
+}
+
+/**
+ * Release reference to websocket payload, memory is released with last reference
+ *
+ * @param wp pointer to WebsocketPayload
+ */
+
+void WebsocketPayloadUnref( WebsocketPayload *wp )
+{
+	if( wp != NULL && __sync_sub_and_fetch( &(wp->wp_RefCount), 1 ) == 0 )
+	{
+		FFree( wp );
+	}
+}
+
+/**
+ * Create new websocket client
+ *
+ * @param wsi pointer to libwebsockets connection
+ * @return pointer to new WebsocketClient, otherwise NULL
+ */
+
+WebsocketClient *WebsocketClientNew( struct lws *wsi )
+{
+	WebsocketClient *wsc = FCalloc( 1, sizeof( WebsocketClient ) );
+	if( wsc != NULL )
+	{
+		wsc->wc_Wsi = wsi;
+		if( wsi != NULL )
+		{
+			wsc->wc_WebSocket = lws_context_user( lws_get_context( wsi ) );
+		}
+		wsc->wc_LastWrite = time( NULL );
+		pthread_mutex_init( &(wsc->wc_QueueMutex), NULL );
+	}
+	return wsc;
+}
+
+/**
+ * Delete websocket client and release messages which were not delivered
+ *
+ * @param wsc pointer to WebsocketClient which will be deleted
+ */
+
+void WebsocketClientDelete( WebsocketClient *wsc )
+{
+	if( wsc != NULL )
+	{
+		if( wsc->wc_WebSocket != NULL )
+		{
+			WebSocketCancelWrite( (WebSocket *)wsc->wc_WebSocket, wsc );
+		}
+		
+		pthread_mutex_lock( &(wsc->wc_QueueMutex) );
+		WebsocketQueueEntry *e = wsc->wc_QueueHead;
+		while( e != NULL )
+		{
+			WebsocketQueueEntry *rem = e;
+			e = e->wqe_Next;
+			
+			int i;
+			for( i = 0 ; i < rem->wqe_Count ; i++ )
+			{
+				WebsocketPayloadUnref( rem->wqe_Parts[ i ] );
+			}
+			FFree( rem );
+		}
+		wsc->wc_QueueHead = wsc->wc_QueueTail = NULL;
+		pthread_mutex_unlock( &(wsc->wc_QueueMutex) );
+		
+		if( wsc->wc_Dropped > 0 )
+		{
+			INFO("[WS] Connection %p lost %lu messages\n", wsc->wc_Wsi, wsc->wc_Dropped );
+		}
+		
+		pthread_mutex_destroy( &(wsc->wc_QueueMutex) );
+		wsc->wc_UserSession = NULL;
+		wsc->wc_Wsi = NULL;
+		FFree( wsc );
+	}
+}
+
+/**
+ * Queue message for websocket client
+ *
+ * @param wsc pointer to WebsocketClient
+ * @param wp pointer to payload, function takes own reference
+ * @return number of queued bytes, 0 when message was dropped, -1 when connection is closing
+ */
+
+int WebsocketClientEnqueue( WebsocketClient *wsc, WebsocketPayload *wp )
+{
+	return WebsocketClientEnqueueParts( wsc, &wp, 1 );
+}
+
+/**
+ * Queue message built from few payloads for websocket client
+ *
+ * Function can be called from any thread, message is written by websocket thread.
+ * Parts are sent as fragments of one websocket message, so common part of message
+ * sent to many recipients can be shared. When queue is full message is dropped,
+ * when client did not read anything for WS_CLIENT_STALL_TIMEOUT seconds connection is closed.
+ *
+ * @param wsc pointer to WebsocketClient
+ * @param parts table of payloads, function takes own references
+ * @param count number of payloads
+ * @return number of queued bytes, 0 when message was dropped, -1 when connection is closing
+ */
+
+int WebsocketClientEnqueueParts( WebsocketClient *wsc, WebsocketPayload **parts, int count )
+{
+	if( wsc == NULL || parts == NULL || count <= 0 || count > WS_MESSAGE_MAX_PARTS || wsc->wc_Wsi == NULL )
+	{
+		return -1;
+	}
+	
+	int ret = 0;
+	int i;
+	int size = 0;
+	FBOOL schedule = FALSE;
+	time_t now = time( NULL );
+	
+	for( i = 0 ; i < count ; i++ )
+	{
+		size += parts[ i ]->wp_Size;
+	}
+	
+	pthread_mutex_lock( &(wsc->wc_QueueMutex) );
+	
+	if( wsc->wc_Close == TRUE )
+	{
+		ret = -1;
+	}
+	else if( wsc->wc_QueueCount >= WS_CLIENT_QUEUE_MAX_MESSAGES || ( wsc->wc_QueueBytes + size ) > WS_CLIENT_QUEUE_MAX_BYTES )
+	{
+		wsc->wc_Dropped++;
+		
+		if( ( now - wsc->wc_LastWrite ) > WS_CLIENT_STALL_TIMEOUT )
+		{
+			FERROR("[WS] Connection %p do not read messages, queued %d, it will be closed\n", wsc->wc_Wsi, wsc->wc_QueueCount );
+			wsc->wc_Close = TRUE;
+			schedule = TRUE;
+			ret = -1;
+		}
+	}
+	else
+	{
+		WebsocketQueueEntry *e = FCalloc( 1, sizeof( WebsocketQueueEntry ) );
+		if( e != NULL )
+		{
+			for( i = 0 ; i < count ; i++ )
+			{
+				WebsocketPayloadRef( parts[ i ] );
+				e->wqe_Parts[ i ] = parts[ i ];
+			}
+			e->wqe_Count = count;
+			e->wqe_Size = size;
+			
+			if( wsc->wc_QueueTail != NULL )
+			{
+				wsc->wc_QueueTail->wqe_Next = e;
+			}
+			else
+			{
+				wsc->wc_QueueHead = e;
+				wsc->wc_LastWrite = now;		// waiting time is counted from first queued message
+			}
+			wsc->wc_QueueTail = e;
+			wsc->wc_QueueCount++;
+			wsc->wc_QueueBytes += size;
+			
+			schedule = TRUE;
+			ret = size;
+		}
+	}
+	
+	pthread_mutex_unlock( &(wsc->wc_QueueMutex) );
+	
+	if( schedule == TRUE && wsc->wc_WebSocket != NULL )
+	{
+		WebSocketScheduleWrite( (WebSocket *)wsc->wc_WebSocket, wsc );
+	}
+	
+	return ret;
+}
+
+/**
+ * Take next part of first message from websocket client queue
+ *
+ * @param wsc pointer to WebsocketClient
+ * @param more pointer to FBOOL which will be set to TRUE when queue still contain data
+ * @param writeMode pointer to int where lws_write mode for returned part will be stored
+ * @return pointer to payload (caller owns reference), otherwise NULL
+ */
+
+WebsocketPayload *WebsocketClientDequeue( WebsocketClient *wsc, FBOOL *more, int *writeMode )
+{
+	WebsocketPayload *wp = NULL;
+	
+	pthread_mutex_lock( &(wsc->wc_QueueMutex) );
+	
+	WebsocketQueueEntry *e = wsc->wc_QueueHead;
+	if( e != NULL )
+	{
+		wp = e->wqe_Parts[ e->wqe_Sent ];
+		WebsocketPayloadRef( wp );
+		
+		*writeMode = ( e->wqe_Sent == 0 ) ? LWS_WRITE_TEXT : LWS_WRITE_CONTINUATION;
+		if( ++e->wqe_Sent < e->wqe_Count )
+		{
+			*writeMode |= LWS_WRITE_NO_FIN;
+		}
+		else
+		{
+			wsc->wc_QueueHead = e->wqe_Next;
+			if( wsc->wc_QueueHead == NULL )
+			{
+				wsc->wc_QueueTail = NULL;
+			}
+			wsc->wc_QueueCount--;
+			wsc->wc_QueueBytes -= e->wqe_Size;
+			
+			int i;
+			for( i = 0 ; i < e->wqe_Count ; i++ )
+			{
+				WebsocketPayloadUnref( e->wqe_Parts[ i ] );
+			}
+			FFree( e );
+		}
+		wsc->wc_LastWrite = time( NULL );
+	}
+	*more = wsc->wc_QueueHead != NULL ? TRUE : FALSE;
+	
+	pthread_mutex_unlock( &(wsc->wc_QueueMutex) );
+	
+	return wp;
+}
@@ -27,14 +27,111 @@
 #include <core/types.h>
 #include <core/nodes.h>
 #include <libwebsockets.h>
+#include <pthread.h>
+#include <time.h>
 //#include <system/user/user.h>
 
+//
+// Outbound queue limits, slow consumers lose messages and are disconnected when they stop reading
+//
+
+#define WS_CLIENT_QUEUE_MAX_MESSAGES		1024
+#define WS_CLIENT_QUEUE_MAX_BYTES			(16*1024*1024)
+#define WS_CLIENT_STALL_TIMEOUT			30		// seconds without progress on full queue
+#define WS_CLIENT_WRITES_PER_CALLBACK		16
+#define WS_MESSAGE_MAX_PARTS					4		// message can be sent as fragments taken from different payloads
+
+//
+// Message prepared for websockets, shared between all connections which deliver it
+//
+
+typedef struct WebsocketPayload
+{
+	int										wp_RefCount;
+	int										wp_Size;
+	unsigned char						*wp_Data;			// message, LWS_SEND_BUFFER_PRE_PADDING bytes available before it
+}WebsocketPayload;
+
+//
+// Queued message, every part is written as separate websocket fragment
+//
+
+typedef struct WebsocketQueueEntry
+{
+	struct WebsocketQueueEntry	*wqe_Next;
+	WebsocketPayload				*wqe_Parts[ WS_MESSAGE_MAX_PARTS ];
+	int										wqe_Count;
+	int										wqe_Sent;				// parts already taken by writer
+	int										wqe_Size;				// size of all parts
+}WebsocketQueueEntry;
+
 typedef struct WebsocketClient
 {
 	struct MinNode 					node;
 	struct lws				 			*wc_Wsi;
 	void										*wc_UserSession;
 	void 										*wc_WebsocketsData;
+	void										*wc_WebSocket;			// WebSocket which serves connection
+	
+	pthread_mutex_t					wc_QueueMutex;
+	WebsocketQueueEntry			*wc_QueueHead;		// outbound messages, written by websocket thread
+	WebsocketQueueEntry			*wc_QueueTail;
+	int										wc_QueueCount;
+	FULONG								wc_QueueBytes;
+	FULONG								wc_Dropped;			// messages lost because queue was full
+	time_t									wc_LastWrite;			// last progress on queue
+	FBOOL									wc_Close;				// connection will be closed by websocket thread
+	
+	FBOOL									wc_WritePending;	// waiting in WebSocket pending list, protected by its mutex
+	struct WebsocketClient		*wc_PendingNext;
 }WebsocketClient;
 
+//
+//
+//
+
+WebsocketPayload *WebsocketPayloadNew( const char *msg, int len );
+
+//
+//
+//
+
+void WebsocketPayloadRef( WebsocketPayload *wp );
+
+//
+//
+//
+
+void WebsocketPayloadUnref( WebsocketPayload *wp );
+
+//
+//
+//
+
+WebsocketClient *WebsocketClientNew( struct lws *wsi );
+
+//
+//
+//
+
+void WebsocketClientDelete( WebsocketClient *wsc );
+
+//
+//
+//
+
+int WebsocketClientEnqueue( WebsocketClient *wsc, WebsocketPayload *wp );
+
+//
+//
+//
+
+int WebsocketClientEnqueueParts( WebsocketClient *wsc, WebsocketPayload **parts, int count );
+
+//
+//
+//
+
+WebsocketPayload *WebsocketClientDequeue( WebsocketClient *wsc, FBOOL *more, int *writeMode );
+
 #endif // __NETWORK_WEBSOCKET_CLIENT__
\ No newline at end of file
@@ -40,6 +40,7 @@
 #include "comm_msg.h"
 #include <util/log/log.h>
 #include <core/friendcore_manager.h>
+#include <core/metrics.h>
 
 /**
  * Generate DataFormGroup from tags
@@ -473,7 +474,6 @@ DFList *CreateListEntry( char *key, char *value )
 DataForm *DataFormFromHttp( Http *http )
 {
 	DataForm *df = NULL;
-	unsigned int i;
 	char *remoteurl = NULL;
 	char *remotehost = NULL;
 	int numberTags = 10;
@@ -540,9 +540,12 @@ DataForm *DataFormFromHttp( Http *http )
 	
 	if( http->parsedPostContent != NULL )
 	{
-		for( i = 0 ; i < http->parsedPostContent->table_size; i++ )
+		unsigned int iterator = 0;
+		HashmapElement *el;
+		
+		while( ( el = HashmapIterate( http->parsedPostContent, &iterator ) ) != NULL )
 		{
-			HashmapElement e = http->parsedPostContent->data[i];
+			HashmapElement e = *el;
 			
 			if( e.key != NULL && e.inUse == TRUE )
 			{
@@ -648,6 +651,27 @@ DataForm *DataFormFromHttp( Http *http )
 	
 	DEBUG("DataFormFromttp post entries parsed\n");
 	
+	// request trace id follows call to other FC
+	const char *traceid = MetricsTraceGet();
+	if( traceid[ 0 ] != 0 && ( http->parsedPostContent == NULL || HashmapGet( http->parsedPostContent, "traceid" ) == NULL ) )
+	{
+		DFList *ne = CreateListEntry( "traceid", (char *)traceid );
+		if( ne != NULL )
+		{
+			if( re == NULL )
+			{
+				re = ne;
+				le = ne;
+			}
+			else
+			{
+				le->n = ne;
+				le = ne;
+			}
+			numberTags++;
+		}
+	}
+	
 	DEBUG("RemoteURL %s RemoteHost %s\n", remoteurl, remotehost );
 	
 	if( remoteurl != NULL && remotehost != NULL && ( items = FCalloc( numberTags, sizeof(MsgItem) ) ) != NULL )
@@ -71,6 +71,7 @@ typedef FLONG ID;
 #define ID_UDRI MAKE_ID32('U','D','R','I')	// unregister drive
 #define ID_RUSR MAKE_ID32('R','U','S','R')	// register user
 #define ID_UUSR MAKE_ID32('U','U','S','R')	// unregister user
+#define ID_SDIR MAKE_ID32('S','D','I','R')	// user session directory events
 #define ID_CMMD MAKE_ID32('C','M','M','D')	// command
 
 #define ID_CORE MAKE_ID32('C','O','R','E')
@@ -135,6 +135,7 @@ typedef struct CommFCConnection
 	void 							*cfcc_Service;			// pointer to communication service
 	
 	int							cfcc_ReadCommPipe, cfcc_WriteCommPipe;
+	FBOOL 					cfcc_SessionsSynced;		// user session directory was sent
 	
 	MinNode					node;
 }CommFCConnection;
@@ -458,6 +458,12 @@ int ParseAndExecuteRequest( void *sb, CommFCConnection *con, DataForm *df )
 	
 	FULONG command = df->df_ID;
 	
+	// session directory entries are not key=value pairs
+	if( command == ID_SDIR )
+	{
+		return USDReceive( lsb->sl_USD, df+1 );
+	}
+	
 	Hashmap *paramhm = HashmapNew();
 	
 	/*
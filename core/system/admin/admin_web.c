@@ -385,9 +385,11 @@ Http *AdminWebRequest( void *m, char **urlpath, Http **request, UserSession *log
 			
 			int msgsndsize = 0; 
 			int pos = 0;
-			User *usr = l->sl_UM->um_Users;
-			while( usr != NULL )
+			unsigned int usersNr = 0, ui;
+			User **users = UMGetUsersRef( l->sl_UM, &usersNr );
+			for( ui = 0 ; ui < usersNr ; ui++ )
 			{
+				User *usr = users[ ui ];
 				DEBUG("Going through users, user: %s\n", usr->u_Name );
 				
 				UserSessList  *usl = usr->u_SessionsList;
@@ -430,8 +432,8 @@ Http *AdminWebRequest( void *m, char **urlpath, Http **request, UserSession *log
 					}
 					usl = (UserSessList *)usl->node.mln_Succ;
 				}
-				usr = (User *)usr->node.mln_Succ;
 			}
+			UMReleaseUsers( l->sl_UM, users, usersNr );
 			
 			BufStringAdd( bs, "]}");
 			
@@ -452,6 +454,44 @@ Http *AdminWebRequest( void *m, char **urlpath, Http **request, UserSession *log
 		
 		*result = 200;
 	}
+	
+	//
+	// Metrics in Prometheus text format
+	//
+	
+	else if( strcmp( urlpath[ 1 ], "metrics" ) == 0 )
+	{
+		if( UMUserIsAdmin( l->sl_UM, (*request), loggedSession->us_User ) == TRUE )
+		{
+			BufString *bs = MetricsPrometheus();
+			if( bs != NULL )
+			{
+				struct TagItem mtags[] = {
+					{ HTTP_HEADER_CONTENT_TYPE, (FULONG)StringDuplicate( "text/plain; version=0.0.4" ) },
+					{	HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ) },
+					{TAG_DONE, TAG_DONE}
+				};
+				
+				HttpFree( response );
+				response = HttpNewSimple( HTTP_200_OK, mtags );
+				
+				HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
+				bs->bs_Buffer = NULL;
+				
+				BufStringDelete( bs );
+			}
+			else
+			{
+				HttpAddTextContent( response, "fail<!--separate-->{\"result\":\"cannot generate metrics\"}" );
+			}
+		}
+		else
+		{
+			HttpAddTextContent( response, "fail<!--separate-->{\"result\":\"User dont have access to functionality\"}" );
+		}
+		
+		*result = 200;
+	}
 	error:
 	
 	return response;
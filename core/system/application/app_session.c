@@ -331,7 +331,66 @@ int AppSessionRemUsersession( AppSession *as, UserSession *u )
 	return -1;
 }
 
-#define WS_MESSAGE_TEMPLATE_USER "{\"type\":\"msg\",\"data\": { \"type\":\"%s\", \"data\":{\"type\":\"%llu\", \"data\":{ \"identity\":{\"username\":\"%s\"},\"data\": %s}}}}"
+//
+// User message template, envelope is created for every recipient, body with tail is shared
+//
+
+#define WS_MESSAGE_TEMPLATE_USER_HEAD "{\"type\":\"msg\",\"data\": { \"type\":\"%s\", \"data\":{\"type\":\"%llu\", \"data\":{ \"identity\":{\"username\":\"%s\"},\"data\": "
+#define WS_MESSAGE_TEMPLATE_USER_TAIL "}}}}"
+
+//
+// Recipient of message with its envelope
+//
+
+typedef struct ASRecipient
+{
+	UserSession			*usersession;
+	WebsocketPayload	*head;
+}ASRecipient;
+
+/**
+ * Create message envelope for recipient
+ *
+ * @param as application session
+ * @param authid authid of recipient
+ * @param usend sender
+ * @return new WebsocketPayload or NULL when error appear
+ */
+
+static WebsocketPayload *AppSessionMessageHeadNew( AppSession *as, const char *authid, User *usend )
+{
+	char head[ 1024 ];
+	
+	int size = snprintf( head, sizeof( head ), WS_MESSAGE_TEMPLATE_USER_HEAD, authid, as->as_ASSID, usend->u_Name );
+	if( size < 0 || size >= (int)sizeof( head ) )
+	{
+		FERROR("Message envelope is too long\n");
+		return NULL;
+	}
+	
+	return WebsocketPayloadNew( head, size );
+}
+
+/**
+ * Create message body which closes envelope created by AppSessionMessageHeadNew
+ *
+ * @param msg pointer to message
+ * @param length length of the message
+ * @return new WebsocketPayload or NULL when error appear
+ */
+
+static WebsocketPayload *AppSessionMessageBodyNew( const char *msg, int length )
+{
+	int tailsize = sizeof( WS_MESSAGE_TEMPLATE_USER_TAIL ) - 1;
+	
+	WebsocketPayload *wp = WebsocketPayloadNew( NULL, length + tailsize );
+	if( wp != NULL )
+	{
+		memcpy( wp->wp_Data, msg, length );
+		memcpy( wp->wp_Data + length, WS_MESSAGE_TEMPLATE_USER_TAIL, tailsize );
+	}
+	return wp;
+}
 
 /**
  * Remove user from application session
@@ -456,8 +515,6 @@ char *AppSessionAddUsersByName( AppSession *as, UserSession *loggedSession, char
 
 			for( i = 0 ; i < usersi ; i++ )
 			{
-				UserSession *usrses = l->sl_USM->usm_Sessions;
-
 				//
 				// we must check if  user is already in application session
 				//
@@ -488,71 +545,71 @@ char *AppSessionAddUsersByName( AppSession *as, UserSession *loggedSession, char
 
 				if( curgusr == NULL )
 				{
-					while( usrses != NULL )
+					// if user is not logged in he will not get invitation
+					User *invusr = UMGetUserByNameRef( l->sl_UM, upositions[ i ] );
+					if( invusr != NULL )
 					{
-						// if user is not logged in he will not get invitation
-						DEBUG("Going throug sessions userptr %p\n", usrses->us_User );
-
-						if( usrses->us_User != NULL )
+						UserSessList *usl = invusr->u_SessionsList;
+						while( usl != NULL )
 						{
-							DEBUG("share ---------------------- %s --- ptr to list %p\n", usrses->us_User->u_Name, usrses );
-
-							if( strcmp( upositions[ i ], usrses->us_User->u_Name ) == 0 )
+							UserSession *usrses = (UserSession *)usl->us;
+							usl = (UserSessList *)usl->node.mln_Succ;
+							if( usrses == NULL )
 							{
-								int err = 0;
-								char tmp[ 512 ];
+								continue;
+							}
+							
+							DEBUG("share ---------------------- %s --- ptr to list %p\n", invusr->u_Name, usrses );
+							
+							int err = 0;
+							char tmp[ 512 ];
 
-								if( usrses->us_WSConnections == NULL )
+							if( usrses->us_WSConnections == NULL )
+							{
+								int tmpsize = snprintf( tmp, sizeof(tmp), "{\"name\":\"%s\",\"deviceid\":\"%s\",\"result\":\"not invited\"}", usrses->us_User->u_Name, usrses->us_DeviceIdentity );
+								if( pos > 0  )
 								{
-									int tmpsize = snprintf( tmp, sizeof(tmp), "{\"name\":\"%s\",\"deviceid\":\"%s\",\"result\":\"not invited\"}", usrses->us_User->u_Name, usrses->us_DeviceIdentity );
-									if( pos > 0  )
-									{
-										strcat( userlistadded, "," );
-									}
-
-									strcat( userlistadded, tmp );
-									pos++;
+									strcat( userlistadded, "," );
 								}
 
-								//
-								// no working websockets
-								//
+								strcat( userlistadded, tmp );
+								pos++;
+							}
 
-								else
-								{
-									err = AppSessionAddUser( as, usrses, NULL );
+							//
+							// no working websockets
+							//
 
-									DEBUG("newsession will be added %p\n", usrses );
+							else
+							{
+								err = AppSessionAddUser( as, usrses, NULL );
 
-									if( err == 0 )
-									{
-										int tmpsize = snprintf( tmp, sizeof(tmp), "{\"name\":\"%s\",\"deviceid\":\"%s\",\"result\":\"invited\"}", usrses->us_User->u_Name, usrses->us_DeviceIdentity );
+								DEBUG("newsession will be added %p\n", usrses );
 
-										if( pos > 0  )
-										{
-											strcat( userlistadded, "," );
-										}
+								if( err == 0 )
+								{
+									int tmpsize = snprintf( tmp, sizeof(tmp), "{\"name\":\"%s\",\"deviceid\":\"%s\",\"result\":\"invited\"}", usrses->us_User->u_Name, usrses->us_DeviceIdentity );
 
-										DEBUG("New entry will be added: %s , currentlist size %d\n", tmp, (int)strlen(userlistadded ) );
+									if( pos > 0  )
+									{
+										strcat( userlistadded, "," );
+									}
 
-										strcat( userlistadded, tmp );
-										pos++;
+									DEBUG("New entry will be added: %s , currentlist size %d\n", tmp, (int)strlen(userlistadded ) );
 
-										char tmpmsg[ 2048 ];
-										int len = sprintf( tmpmsg, "{ \"type\":\"msg\", \"data\":{\"type\":\"sasid-request\",\"data\":{\"sasid\":\"%llu\",\"message\":\"%s\",\"owner\":\"%s\" ,\"appname\":\"%s\"}}}", as->as_ASSID, msg, loggedSession->us_User->u_Name , appname );
-										//TODO add application name
+									strcat( userlistadded, tmp );
+									pos++;
 
-										WebSocketSendMessageInt( usrses, tmpmsg, len );
-									}
+									char tmpmsg[ 2048 ];
+									int len = sprintf( tmpmsg, "{ \"type\":\"msg\", \"data\":{\"type\":\"sasid-request\",\"data\":{\"sasid\":\"%llu\",\"message\":\"%s\",\"owner\":\"%s\" ,\"appname\":\"%s\"}}}", as->as_ASSID, msg, loggedSession->us_User->u_Name , appname );
+									//TODO add application name
+
+									WebSocketSendMessageInt( usrses, tmpmsg, len );
 								}
 							}
-						}
-						else
-						{
-							DEBUG("Usersession is nott connected to user '%s' userid %lu\n", usrses->us_SessionID, usrses->us_UserID );
-						}
-						usrses  = (UserSession *)usrses->node.mln_Succ;
-					}	//while lusr
+						}	//while usl
+						UMReleaseUser( l->sl_UM, invusr );
+					}
 				}// if userfound
 				else
 				{
@@ -878,6 +935,10 @@ int AppSessionRemByWebSocket( AppSession *as,  void *lwsc )
 /**
  * Send message to all application session recipients
  *
+ * Message body is prepared once and shared by all recipients, only envelope with
+ * recipient authid is created per recipient. Messages are queued on websocket
+ * connections, so function does not wait for delivery.
+ *
  * @param as application session
  * @param sender user session which is sending message
  * @param msg pointer to message which will be sent
@@ -897,17 +958,38 @@ int AppSessionSendMessage( AppSession *as, UserSession *sender, char *msg, int l
 	DEBUG("Send message %s\n", msg );
 	
 	time_t ntime = time( NULL );
-	FERROR("OLD TIME %lld NEW TIME %lld\n", (long long)as->as_Timer, (long long)ntime );
 	if( ( ntime - as->as_Timer ) > TIMEOUT_APP_SESSION )
 	{
 		as->as_Obsolete = TRUE;
 	}
 	as->as_Timer = ntime;
 	
-	FERROR("DEBUG %s\n", msg );
+	WebsocketPayload *body = AppSessionMessageBodyNew( msg, length );
+	if( body == NULL )
+	{
+		FERROR("Cannot allocate memory for message\n");
+		return 0;
+	}
+	
+	User *usend = sender->us_User;
+	
+	// envelopes are created under lock, messages are queued when list is released
 	
+	pthread_mutex_lock( &as->as_SessionsMut );
+	
+	int count = 0;
 	ASUList *ali = as->as_UserSessionList;
 	while( ali != NULL )
+	{
+		count++;
+		ali = (ASUList *) ali->node.mln_Succ;
+	}
+	
+	ASRecipient *rcpt = FCalloc( count + 1, sizeof( ASRecipient ) );
+	int nrcpt = 0;
+	
+	ali = as->as_UserSessionList;
+	while( ali != NULL && rcpt != NULL )
 	{
 		if( ali->usersession == sender )
 		{
@@ -916,29 +998,41 @@ int AppSessionSendMessage( AppSession *as, UserSession *sender, char *msg, int l
 		}
 		else
 		{
-			char *newmsg = NULL;
+			DEBUG("Sendmessage AUTHID %s\n", ali->authid );
 			
-			if( ( newmsg = FCalloc( length+256, sizeof(char) ) ) != NULL )
-			{
-				User *usend = sender->us_User;
-				
-				DEBUG("Sendmessage AUTHID %s\n", ali->authid );
-				
-				int newmsgsize = sprintf( newmsg, WS_MESSAGE_TEMPLATE_USER, ali->authid, as->as_ASSID, usend->u_Name, msg );
-				
-				msgsndsize += WebSocketSendMessageInt( ali->usersession, newmsg, newmsgsize );
-				DEBUG("FROM %s  TO %s  MESSAGE SIZE %d\n", usend->u_Name, ali->usersession->us_User->u_Name, msgsndsize );
-				FFree( newmsg );
-			}
-			else
+			rcpt[ nrcpt ].usersession = ali->usersession;
+			rcpt[ nrcpt ].head = AppSessionMessageHeadNew( as, ali->authid, usend );
+			if( rcpt[ nrcpt ].head != NULL )
 			{
-				FERROR("Cannot allocate memory for message\n");
+				nrcpt++;
 			}
 		}
 			
 		ali = (ASUList *) ali->node.mln_Succ;
 	}
 	
+	pthread_mutex_unlock( &as->as_SessionsMut );
+	
+	int i;
+	for( i = 0 ; i < nrcpt ; i++ )
+	{
+		WebsocketPayload *parts[ 2 ] = { rcpt[ i ].head, body };
+		
+		msgsndsize += WebSocketSendPayloadParts( rcpt[ i ].usersession, parts, 2 );
+		WebsocketPayloadUnref( rcpt[ i ].head );
+	}
+	DEBUG("FROM %s  TO %d recipients  MESSAGE SIZE %d\n", usend->u_Name, nrcpt, msgsndsize );
+	
+	if( rcpt != NULL )
+	{
+		FFree( rcpt );
+	}
+	else
+	{
+		FERROR("Cannot allocate memory for recipients\n");
+	}
+	WebsocketPayloadUnref( body );
+	
 	return msgsndsize;
 }
 
@@ -962,34 +1056,35 @@ int AppSessionSendOwnerMessage( AppSession *as, UserSession *sender, char *msg,
 	}
 	
 	time_t ntime = time( NULL );
-	FERROR("OLD TIME %lld NEW TIME %lld\n", (long long)as->as_Timer, (long long)ntime );
 	if( ( ntime - as->as_Timer ) > TIMEOUT_APP_SESSION )
 	{
 		as->as_Obsolete = TRUE;
 	}
 	as->as_Timer = ntime;
 	
-	FERROR("SEND OWNER MESAGE\n");
-	DEBUG("Send message %s\n", msg );
+	DEBUG("Send owner message %s\n", msg );
 	
-	char *newmsg = NULL;
+	WebsocketPayload *parts[ 2 ];
+	User *usend = sender->us_User;
 	
-	if( ( newmsg = FCalloc( length+256, sizeof(char) ) ) != NULL )
+	parts[ 0 ] = AppSessionMessageHeadNew( as, as->as_AuthID, usend );
+	parts[ 1 ] = AppSessionMessageBodyNew( msg, length );
+	
+	if( parts[ 0 ] != NULL && parts[ 1 ] != NULL )
 	{
-		User *usend = sender->us_User;
 		DEBUG("AS POINTER %p SENDER %p\n", as, usend );
-		int newmsgsize = sprintf( newmsg, WS_MESSAGE_TEMPLATE_USER, as->as_AuthID, as->as_ASSID, usend->u_Name, msg );
-				
-		msgsndsize += WebSocketSendMessageInt( as->as_UserSessionList->usersession, newmsg, newmsgsize );
+		
+		msgsndsize += WebSocketSendPayloadParts( as->as_UserSessionList->usersession, parts, 2 );
 		DEBUG("FROM %s  TO %s  MESSAGE SIZE %d\n", usend->u_Name, as->as_UserSessionList->usersession->us_User->u_Name, msgsndsize );
-		//FERROR("Message sent to user %s size %d  to user %s\n", as->as_UserList->user->u_Name, msgsndsize, as->as_UserList->user->u_Name );
-		FFree( newmsg );
 	}
 	else
 	{
 		FERROR("Cannot allocate memory for message\n");
 	}
 	
+	WebsocketPayloadUnref( parts[ 0 ] );
+	WebsocketPayloadUnref( parts[ 1 ] );
+	
 	return msgsndsize;
 }
 
@@ -1014,6 +1109,14 @@ int AppSessionSendPureMessage( AppSession *as, UserSession *sender, char *msg, i
 	
 	DEBUG("Send message %s\n", msg );
 	
+	// one copy of message is shared by all recipients
+	WebsocketPayload *wp = WebsocketPayloadNew( msg, length );
+	if( wp == NULL )
+	{
+		FERROR("Cannot allocate memory for message\n");
+		return 0;
+	}
+	
 	ASUList *ali = as->as_UserSessionList;
 	while( ali != NULL )
 	{
@@ -1025,7 +1128,7 @@ int AppSessionSendPureMessage( AppSession *as, UserSession *sender, char *msg, i
 		{
 			if( ali->authid[ 0 ] == 0 )
 			{
-				msgsndsize += WebSocketSendMessageInt( ali->usersession, msg, length );
+				msgsndsize += WebSocketSendPayload( ali->usersession, wp );
 			}
 			DEBUG("Message sent to user %s size %d\n", ali->usersession->us_User->u_Name, msgsndsize );
 		}
@@ -1033,6 +1136,8 @@ int AppSessionSendPureMessage( AppSession *as, UserSession *sender, char *msg, i
 		ali = (ASUList *) ali->node.mln_Succ;
 	}
 	
+	WebsocketPayloadUnref( wp );
+	
 	return msgsndsize;
 }
 
@@ -80,6 +80,8 @@ typedef struct AppSession
 	pthread_mutex_t		as_VariablesMut;
 	
 	void 							*as_SB;
+	
+	struct AppSession		*as_HashNext;				// next session in AppSessionManager hash bucket
 }AppSession;
 
 //
@@ -34,6 +34,19 @@
 #include "app_session.h"
 #include <core/functions.h>
 
+/**
+ * Get hash bucket number for application session id
+ *
+ * @param id application session id
+ * @return position in sl_AppSessionsHash
+ */
+
+static inline unsigned int AppSessionHash( FUQUAD id )
+{
+	// ASSID is usually a pointer value, multiplication spreads aligned values over all buckets
+	return (unsigned int)( ( id * 0x9E3779B97F4A7C15ULL ) >> 32 ) & ( APP_SESSION_HASH_SIZE - 1 );
+}
+
 /**
  * Create application session manager
  *
@@ -46,7 +59,7 @@ AppSessionManager *AppSessionManagerNew()
 	
 	if( ( as = FCalloc( 1, sizeof( AppSessionManager ) ) ) != NULL )
 	{
-		
+		pthread_mutex_init( &as->sl_Mutex, NULL );
 	}
 	else
 	{
@@ -80,6 +93,8 @@ void AppSessionManagerDelete( AppSessionManager *as )
 			AppSessionDelete( oas );
 		}
 		
+		pthread_mutex_destroy( &as->sl_Mutex );
+		
 		FFree( as );
 	}
 }
@@ -96,30 +111,29 @@ int AppSessionManagerAddSession( AppSessionManager *as, AppSession *nas )
 {
 	if( as != NULL )
 	{
-		AppSession *las = NULL;
+		unsigned int pos = AppSessionHash( nas->as_ASSID );
 		
-		LIST_FOR_EACH( as->sl_AppSessions, las, AppSession * )
+		pthread_mutex_lock( &as->sl_Mutex );
+		
+		AppSession *las = as->sl_AppSessionsHash[ pos ];
+		while( las != NULL )
 		{
 			if( nas->as_ASSID == las->as_ASSID )
 			{
+				pthread_mutex_unlock( &as->sl_Mutex );
 				DEBUG("AppSession was already added to list\n");
 				return 0;
 			}
+			las = las->as_HashNext;
 		}
 		
-		AppSession *lastone = as->sl_AppSessions;
-		if( lastone == NULL )
-		{
-			as->sl_AppSessions = nas;
-		}
-		else
-		{
-			while( lastone->node.mln_Succ != NULL )
-			{
-				lastone = (AppSession *)lastone->node.mln_Succ;
-			}
-			lastone->node.mln_Succ = (MinNode *)nas;
-		}
+		nas->as_HashNext = as->sl_AppSessionsHash[ pos ];
+		as->sl_AppSessionsHash[ pos ] = nas;
+		
+		nas->node.mln_Succ = (MinNode *)as->sl_AppSessions;
+		as->sl_AppSessions = nas;
+		
+		pthread_mutex_unlock( &as->sl_Mutex );
 		
 		return 0;
 	}
@@ -138,37 +152,64 @@ int AppSessionManagerRemSession( AppSessionManager *as, AppSession *nas )
 {
 	if( as != NULL )
 	{
+		unsigned int pos = AppSessionHash( nas->as_ASSID );
 		AppSession *las = NULL;
-		AppSession *oas = as->sl_AppSessions;
+		AppSession *oas = NULL;
 		
-		LIST_FOR_EACH( as->sl_AppSessions, las, AppSession * )
+		pthread_mutex_lock( &as->sl_Mutex );
+		
+		las = as->sl_AppSessionsHash[ pos ];
+		while( las != NULL )
 		{
 			if( nas->as_ASSID == las->as_ASSID )
 			{
-				DEBUG("AppSession will be removed from list\n");
-				
-				if( nas == as->sl_AppSessions )
-				{
-					as->sl_AppSessions = (AppSession *) nas->node.mln_Succ;
-				}
-				else
-				{
-					oas->node.mln_Succ = (MinNode *)nas->node.mln_Succ;
-				}
-				
-				AppSessionDelete( nas );
-				
-				return 0;
+				break;
 			}
-			
 			oas = las;
+			las = las->as_HashNext;
 		}
+		
+		if( las == NULL )
+		{
+			pthread_mutex_unlock( &as->sl_Mutex );
+			return -2;
+		}
+		
+		DEBUG("AppSession will be removed from list\n");
+		
+		if( oas == NULL )
+		{
+			as->sl_AppSessionsHash[ pos ] = las->as_HashNext;
+		}
+		else
+		{
+			oas->as_HashNext = las->as_HashNext;
+		}
+		
+		if( las == as->sl_AppSessions )
+		{
+			as->sl_AppSessions = (AppSession *) las->node.mln_Succ;
+		}
+		else
+		{
+			oas = as->sl_AppSessions;
+			while( oas != NULL && oas->node.mln_Succ != (MinNode *)las )
+			{
+				oas = (AppSession *)oas->node.mln_Succ;
+			}
+			if( oas != NULL )
+			{
+				oas->node.mln_Succ = las->node.mln_Succ;
+			}
+		}
+		
+		pthread_mutex_unlock( &as->sl_Mutex );
+		
+		AppSessionDelete( las );
+		
+		return 0;
 	}
-	else
-	{
-		return -1;
-	}
-	return -2;
+	return -1;
 }
 
 /**
@@ -183,21 +224,22 @@ AppSession *AppSessionManagerGetSession( AppSessionManager *as, FUQUAD id )
 {
 	if( as != NULL )
 	{
-		AppSession *las = NULL;
+		pthread_mutex_lock( &as->sl_Mutex );
 		
-		LIST_FOR_EACH( as->sl_AppSessions, las, AppSession * )
+		AppSession *las = as->sl_AppSessionsHash[ AppSessionHash( id ) ];
+		while( las != NULL )
 		{
 			if( id == las->as_ASSID )
 			{
 				DEBUG("AppSession found\n");
-				
-				return las;
+				break;
 			}
+			las = las->as_HashNext;
 		}
-	}
-	else
-	{
-		return NULL;
+		
+		pthread_mutex_unlock( &as->sl_Mutex );
+		
+		return las;
 	}
 	return NULL;
 }
@@ -27,6 +27,8 @@
 #include <system/application/application.h>
 #include <system/application/app_session.h>
 
+#define APP_SESSION_HASH_SIZE		1024		// must be power of 2
+
 //
 // app session manager structure
 //
@@ -34,6 +36,8 @@
 typedef struct AppSessionManager
 {
 	AppSession						*sl_AppSessions;
+	AppSession						*sl_AppSessionsHash[ APP_SESSION_HASH_SIZE ];	// sessions by ASSID
+	pthread_mutex_t				sl_Mutex;
 }AppSessionManager;
 
 //
@@ -124,41 +124,11 @@ Http* ApplicationWebRequest( SystemBase *l, char **urlpath, Http* request, UserS
 		BufString *bs = BufStringNew();
 		if( bs != NULL )
 		{
-			int pos = 0;
-			Application *al = l->sl_apps;
-			
 			DEBUG("Application.library LIST\n");
 			
-			BufStringAdd( bs, " { \"Application\": [" );
-			
-			while( al != NULL )
-			{
-				if( pos > 0 )
-				{
-					BufStringAdd( bs, ", " );
-				}
-				else
-				{
-					//BufStringAdd( bs, "{" );
-				}
-				
-				BufString *lbs = GetJSONFromStructure( ApplicationDesc, al );
-				
-				if( lbs != NULL )
-				{
-					//DEBUG("Parse application entry %s !\n" , lbs->bs_Buffer );
-					
-					int msg = BufStringAddSize( bs, lbs->bs_Buffer, lbs->bs_Size );
-
-					BufStringDelete( lbs );
-				}
-
-				al = (Application *)al->node.mln_Succ;
-				pos++;
-			}
-			//INFO("JSON INFO 2: %s\n", bs->bs_Buffer );
-			
-			BufStringAdd( bs, "  ]}" );
+			BufStringAdd( bs, " { \"Application\": " );
+			JSONPlanWriteList( JSONPlanGet( ApplicationDesc ), bs, l->sl_apps );
+			BufStringAdd( bs, "}" );
 			
 			INFO("JSON INFO: %s\n", bs->bs_Buffer );
 
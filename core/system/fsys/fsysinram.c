@@ -48,6 +48,7 @@ typedef struct SpecialData
 {
 	INRAMFile *fp;
 	INRAMFile * root;
+	FUQUAD offset;		// position in opened file
 }SpecialData;
 
 
@@ -296,31 +297,38 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		
 		if( mode[ 0 ] == 'r' )
 		{
-			if( nf == NULL )
+			if( nf == NULL || nf->nf_Type != INRAM_FILE )
 			{
 				free( tmppath );
 				FERROR("Cannot open file %s\n", path );
 				return NULL;
 			}
-			nf->nf_Offset = 0;
 		}
 		else	// write
 		{
 			if( nf == NULL )
 			{
-				nf = INRAMFileNew( INRAM_FILE, tmppath, nameptr );
-				if( INRAMFileAddChild( directory, nf ) == 0 )
+				nf = INRAMFileNew( INRAM_FILE, (char *)path, nameptr );
+				if( nf == NULL || INRAMFileAddChild( directory, nf ) != 0 )
 				{
-					
+					INRAMFileDelete( nf );
+					free( tmppath );
+					return NULL;
 				}
 			}
-			else
+			else if( nf->nf_Type != INRAM_FILE )
 			{
-				
+				free( tmppath );
+				FERROR("Cannot open directory %s for writing\n", path );
+				return NULL;
+			}
+			else if( mode[ 0 ] == 'w' )
+			{
+				INRAMFileTruncate( nf );
 			}
 		}
 		
-		
+		free( tmppath );
 		
 		{
 			// Ready the file structure
@@ -336,19 +344,16 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 				if( sd )
 				{
 					sd->fp = nf;
+					// append mode continue at the end of file
+					sd->offset = mode[ 0 ] == 'a' ? nf->nf_Size : 0;
 				}
-				DEBUG("\nOffset set to %lld\n\n", nf->nf_Offset );
 				
 				DEBUG("File open, descriptor returned\n");
 				
 				return locfil;
 			}
 		}
-		/*
-		else
-		{
-			
-		}*/
+		return NULL;
 	}
 	free( tmppath );
 	DEBUG("File open end\n");
@@ -398,16 +403,8 @@ int FileRead( struct File *f, char *buffer, int rsize )
 	SpecialData *sd = (SpecialData *)f->f_SpecialData;
 	if( sd != NULL )
 	{
-		FULONG readsize = sd->fp->nf_Data->bs_Size - sd->fp->nf_Offset;
-		if( rsize < (int)readsize )
-		{
-			readsize = rsize;
-		}
-		//DEBUG(" readsize %d bssize %lld offset %d\n", readsize, sd->fp->nf_Data->bs_Size, sd->fp->nf_Offset );
-		
-		memcpy( buffer, &(sd->fp->nf_Data->bs_Buffer[ (long)sd->fp->nf_Offset ] ), readsize ); 
-		result = (int) readsize;
-		sd->fp->nf_Offset += readsize;
+		result = INRAMFileRead( sd->fp, sd->offset, buffer, rsize );
+		sd->offset += result;
 	}
 	DEBUG("File read %d\n", result );
 	
@@ -426,11 +423,10 @@ int FileWrite( struct File *f, char *buffer, int wsize )
 	SpecialData *sd = (SpecialData *)f->f_SpecialData;
 	if( sd )
 	{
-		DEBUG("File write %s\n", buffer );
-		result = BufStringAddSize( sd->fp->nf_Data, buffer, wsize );
-		 sd->fp->nf_Offset += result;
+		result = INRAMFileWrite( sd->fp, sd->offset, buffer, wsize );
+		sd->offset += result;
 	}
-	return wsize;
+	return result;
 }
 
 //
@@ -440,10 +436,10 @@ int FileWrite( struct File *f, char *buffer, int wsize )
 int FileSeek( struct File *s, int pos )
 {
 	SpecialData *sd = (SpecialData *)s->f_SpecialData;
-	if( sd != NULL )
+	if( sd != NULL && pos >= 0 )
 	{
-		sd->fp->nf_Offset += pos;
-		return pos;
+		sd->offset = pos;
+		return 0;
 	}
 	return -1;
 }
@@ -525,14 +521,16 @@ int Rename( struct File *s, const char *path, const char *nname )
 	int error = 0;
 	SpecialData *srd = (SpecialData *) s->f_SpecialData;
 	INRAMFile *dir =INRAMFileGetLastPath( srd->root, path, &error );
-	if( dir != NULL )
+	if( dir != NULL && dir != srd->root )
 	{
-		free( dir->nf_Name );
-		free( dir->nf_Path );
-		dir->nf_Name = StringDup( nname );
+		if( INRAMFileRename( dir, (char *)nname ) != 0 )
+		{
+			FERROR("Cannot allocate memory\n");
+			return -1;
+		}
 		
 		int len = strlen( path );
-		char *temp = calloc( len+512, sizeof(char) );
+		char *temp = calloc( len+strlen( nname )+2, sizeof(char) );
 		if( temp != NULL )
 		{
 			int i = len;
@@ -543,11 +541,20 @@ int Rename( struct File *s, const char *path, const char *nname )
 				if( temp[ i ] == '/' )
 				{
 					temp[ i+1 ] =  0;
+					break;
+				}
+				else if( i == 0 )
+				{
+					temp[ 0 ] = 0;
 				}
 			}
 			
 			strcat( temp, nname );
 			
+			if( dir->nf_Path != NULL )
+			{
+				free( dir->nf_Path );
+			}
 			dir->nf_Path = temp;
 		}
 		else
@@ -555,6 +562,10 @@ int Rename( struct File *s, const char *path, const char *nname )
 			FERROR("Cannot allocate memory\n");
 		}
 	}
+	else
+	{
+		res = -1;
+	}
 	
 	return res;
 }
@@ -641,7 +652,7 @@ void FillStat( BufString *bs, INRAMFile *nf, File *d, const char *path )
 	}
 	else
 	{
-		sprintf( tmp, "\"Filesize\": %d,",(int) nf->nf_Data->bs_Size );
+		sprintf( tmp, "\"Filesize\": %llu,", nf->nf_Size );
 		BufStringAdd( bs, tmp );
 		BufStringAdd( bs, "\"MetaType\":\"File\",\"Type\":\"File\" }" );
 	}
@@ -30,15 +30,17 @@
 #include <util/log/log.h>
 #include <sys/stat.h>
 #include <util/buffered_string.h>
-#include <dirent.h> 
+#include <util/murmurhash3.h>
+#include <dirent.h>
 #include <arpa/inet.h>
+#include <netdb.h>
 #include <libssh2_sftp.h>
 
 // ssh stuff
 
 //#include "libssh2_config.h"
 #include <libssh2.h>
- 
+
 #ifdef HAVE_WINSOCK2_H
 #include <winsock2.h>
 #endif
@@ -57,7 +59,7 @@
 #ifdef HAVE_ARPA_INET_H
 #include <arpa/inet.h>
 #endif
- 
+
 #include <sys/time.h>
 #include <sys/types.h>
 #include <stdlib.h>
@@ -70,47 +72,71 @@
 #define SUFFIX "fsys"
 #define PREFIX "ssh2"
 
+#define SSH2_POOL_MAX_SESSIONS			4			// sessions opened to one host with one credential
+#define SSH2_POOL_MOUNTS_PER_SESSION	8			// mounts sharing a session before next one is opened
+#define SSH2_POOL_IDLE_TIMEOUT			60			// seconds unused session stays in pool
+#define SSH2_READ_AHEAD_SIZE			262144		// bytes requested from server in one read
+#define SSH2_WRITE_BUFFER_SIZE			262144		// bytes collected before they are sent
+#define SSH2_STAT_CACHE_SIZE			256
+#define SSH2_STAT_CACHE_TTL				5			// seconds
+
 //int UnMount( struct FHandler *s, void *f, User *usr );
 
+//
+// Cached file attributes
+//
+
+typedef struct SSH2StatEntry
+{
+	char										*se_Path;			// remote path, without trailing slash
+	uint32_t									se_Hash;
+	time_t										se_Expire;
+	LIBSSH2_SFTP_ATTRIBUTES						se_Attrs;
+}SSH2StatEntry;
+
+//
+// Authenticated SFTP connection shared by mounts with same host and credentials
+//
+
+typedef struct SSH2Session
+{
+	char										*ss_Host;
+	int											ss_Port;
+	char										*ss_LoginUser;
+	char										*ss_LoginPass;
+	char										*ss_PrivKey;		// private key used for authentication
+	int											ss_Sock;
+	LIBSSH2_SESSION								*ss_Session;
+	LIBSSH2_SFTP								*ss_SFTP;
+	pthread_mutex_t								ss_Mutex;			// libssh2 session cannot be used by two threads
+	int											ss_RefCount;		// number of mounts using session
+	time_t										ss_IdleSince;
+	FBOOL										ss_Broken;			// connection lost, do not give it to new mounts
+	SSH2StatEntry								ss_StatCache[ SSH2_STAT_CACHE_SIZE ];
+	struct SSH2Session							*ss_Next;
+}SSH2Session;
+
 //
 // Special SSH data
 //
 
 typedef struct SpecialData
 {
-	
-    //const char *hostname = "127.0.0.1";
-    //const char *commandline = "uptime";
-   // const char *username;//    = "user";
-   // const char *password ;//   = "password";
-	unsigned long hostaddr;
-	int sock;
-	struct sockaddr_in sin;
-	const char *fingerprint;
-	LIBSSH2_SESSION *session;
-	LIBSSH2_CHANNEL *channel;
-	LIBSSH2_SFTP *sftp_session;
-	LIBSSH2_SFTP_HANDLE *sftp_handle;
-	int rc;
-	int exitcode;
-	char *exitsignal;//=(char *)"none";
-	int bytecount;// = 0;
-	size_t len;
-	LIBSSH2_KNOWNHOSTS *nh;
-	int type;
-	
-	char										*sd_LoginUser;		// login user
-	char										*sd_LoginPass;		// login password
-	int 										sd_Port;				// port
-	char										*sd_Host;			// host
-	SystemBase *sb;
-	LIBSSH2_SFTP_HANDLE *sd_FileHandle;
-	char                                     sd_privkeyFileName[ 512 ];
+	SSH2Session									*sd_Session;		// pooled connection
+	SystemBase									*sb;
+	LIBSSH2_SFTP_HANDLE							*sd_FileHandle;
+	char										*sd_FilePath;		// remote path of opened file
+	FBOOL										sd_Write;			// file was opened for writing
+	char										*sd_Buffer;			// read-ahead or write buffer
+	int											sd_BufferLen;		// bytes stored in buffer
+	int											sd_BufferPos;		// read position in buffer
+	FBOOL										sd_EOF;
 }SpecialData;
 
 typedef struct HandlerData
 {
-	pthread_mutex_t					hd_Mutex;
+	pthread_mutex_t					hd_Mutex;		// protects session pool
+	SSH2Session						*hd_Sessions;
 	int initialized;
 }HandlerData;
 
@@ -136,17 +162,532 @@ char* StringDup( const char* str )
 		//DEBUG("Cannot copy string!\n");
 		return NULL;
 	}
-	
+
 	int len = strlen( str );
 	char *res = NULL;
 	if( ( res = FCalloc( len+1, sizeof(char) ) ) != NULL )
 	{
 		strcpy( res, str );
 	}
-	
+
 	return res;
 }
 
+//
+// Compare strings which can be NULL
+//
+
+static inline FBOOL SSH2StrEq( const char *a, const char *b )
+{
+	if( a == NULL || b == NULL )
+	{
+		return a == b;
+	}
+	return strcmp( a, b ) == 0;
+}
+
+//
+// Stat cache
+//
+
+/**
+ * Find cache slot for remote path
+ *
+ * @param ss pointer to SSH2Session
+ * @param path remote path
+ * @param len length of path without trailing slash
+ * @param hash pointer where path hash will be stored
+ * @return pointer to cache slot
+ */
+static SSH2StatEntry *SSH2StatCacheSlot( SSH2Session *ss, const char *path, int len, uint32_t *hash )
+{
+	MurmurHash3_x86_32( path, len, 0, hash );
+	return &(ss->ss_StatCache[ *hash % SSH2_STAT_CACHE_SIZE ]);
+}
+
+static inline int SSH2PathLen( const char *path )
+{
+	int len = strlen( path );
+	while( len > 1 && path[ len-1 ] == '/' )
+	{
+		len--;
+	}
+	return len;
+}
+
+/**
+ * Get file attributes from cache. Session must be locked.
+ *
+ * @param ss pointer to SSH2Session
+ * @param path remote path
+ * @param attrs pointer where attributes will be copied
+ * @return TRUE when valid entry was found, otherwise FALSE
+ */
+static FBOOL SSH2StatCacheGet( SSH2Session *ss, const char *path, LIBSSH2_SFTP_ATTRIBUTES *attrs )
+{
+	uint32_t hash;
+	int len = SSH2PathLen( path );
+	SSH2StatEntry *se = SSH2StatCacheSlot( ss, path, len, &hash );
+
+	if( se->se_Path != NULL && se->se_Hash == hash && se->se_Expire > time( NULL ) && strncmp( se->se_Path, path, len ) == 0 && se->se_Path[ len ] == 0 )
+	{
+		*attrs = se->se_Attrs;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+ * Store file attributes in cache. Session must be locked.
+ *
+ * @param ss pointer to SSH2Session
+ * @param path remote path
+ * @param attrs pointer to attributes
+ */
+static void SSH2StatCachePut( SSH2Session *ss, const char *path, LIBSSH2_SFTP_ATTRIBUTES *attrs )
+{
+	uint32_t hash;
+	int len = SSH2PathLen( path );
+	SSH2StatEntry *se = SSH2StatCacheSlot( ss, path, len, &hash );
+
+	if( se->se_Path == NULL || se->se_Hash != hash || strncmp( se->se_Path, path, len ) != 0 || se->se_Path[ len ] != 0 )
+	{
+		if( se->se_Path != NULL )
+		{
+			FFree( se->se_Path );
+		}
+		if( ( se->se_Path = FCalloc( len + 1, sizeof( char ) ) ) == NULL )
+		{
+			return;
+		}
+		memcpy( se->se_Path, path, len );
+		se->se_Hash = hash;
+	}
+	se->se_Attrs = *attrs;
+	se->se_Expire = time( NULL ) + SSH2_STAT_CACHE_TTL;
+}
+
+/**
+ * Remove path and everything below it from cache. Session must be locked.
+ *
+ * @param ss pointer to SSH2Session
+ * @param path remote path
+ */
+static void SSH2StatCacheInvalidate( SSH2Session *ss, const char *path )
+{
+	int len = SSH2PathLen( path );
+	int i;
+
+	for( i = 0; i < SSH2_STAT_CACHE_SIZE; i++ )
+	{
+		SSH2StatEntry *se = &(ss->ss_StatCache[ i ]);
+		if( se->se_Path != NULL && strncmp( se->se_Path, path, len ) == 0 && ( se->se_Path[ len ] == 0 || se->se_Path[ len ] == '/' ) )
+		{
+			FFree( se->se_Path );
+			se->se_Path = NULL;
+		}
+	}
+}
+
+//
+// Mark session as broken when connection was lost
+//
+
+static void SSH2SessionCheck( SSH2Session *ss )
+{
+	int err = libssh2_session_last_errno( ss->ss_Session );
+
+	if( err == LIBSSH2_ERROR_SOCKET_SEND || err == LIBSSH2_ERROR_SOCKET_DISCONNECT || err == LIBSSH2_ERROR_SOCKET_TIMEOUT
+#ifdef LIBSSH2_ERROR_SOCKET_RECV
+		|| err == LIBSSH2_ERROR_SOCKET_RECV
+#endif
+	)
+	{
+		FERROR("SSH2 connection to %s lost, error %d\n", ss->ss_Host, err );
+		ss->ss_Broken = TRUE;
+	}
+}
+
+//
+// Close connection and release session
+//
+
+static void SSH2SessionDelete( SSH2Session *ss )
+{
+	int i;
+
+	if( ss->ss_Session != NULL )
+	{
+		if( ss->ss_SFTP != NULL )
+		{
+			libssh2_sftp_shutdown( ss->ss_SFTP );
+		}
+		libssh2_session_disconnect( ss->ss_Session,  "Normal Shutdown, Thank you for playing" );
+		libssh2_session_free( ss->ss_Session );
+	}
+
+	if( ss->ss_Sock >= 0 )
+	{
+		close( ss->ss_Sock );
+	}
+
+	for( i = 0; i < SSH2_STAT_CACHE_SIZE; i++ )
+	{
+		if( ss->ss_StatCache[ i ].se_Path != NULL )
+		{
+			FFree( ss->ss_StatCache[ i ].se_Path );
+		}
+	}
+
+	if( ss->ss_Host ){ FFree( ss->ss_Host ); }
+	if( ss->ss_LoginUser ){ FFree( ss->ss_LoginUser ); }
+	if( ss->ss_LoginPass ){ FFree( ss->ss_LoginPass ); }
+	if( ss->ss_PrivKey ){ FFree( ss->ss_PrivKey ); }
+
+	pthread_mutex_destroy( &ss->ss_Mutex );
+	FFree( ss );
+}
+
+/**
+ * Connect to SSH server and open authenticated SFTP session
+ *
+ * @param host server name or address
+ * @param port server port
+ * @param user login user
+ * @param pass login password or private key passphrase
+ * @param privkey private key or NULL
+ * @return new SSH2Session when success, otherwise NULL
+ */
+static SSH2Session *SSH2SessionNew( const char *host, int port, const char *user, const char *pass, const char *privkey )
+{
+	SSH2Session *ss = NULL;
+	struct addrinfo hints, *ai = NULL;
+	char portString[ 16 ];
+
+	if( host == NULL || user == NULL )
+	{
+		FERROR("Host and user must be provided\n");
+		return NULL;
+	}
+
+	if( ( ss = FCalloc( 1, sizeof( SSH2Session ) ) ) == NULL )
+	{
+		FERROR("Cannot allocate memory for SSH2 session\n");
+		return NULL;
+	}
+
+	ss->ss_Host = StringDup( host );
+	ss->ss_Port = port;
+	ss->ss_LoginUser = StringDup( user );
+	ss->ss_LoginPass = StringDup( pass );
+	ss->ss_PrivKey = StringDup( privkey );
+	ss->ss_Sock = -1;
+	pthread_mutex_init( &ss->ss_Mutex, NULL );
+
+	DEBUG("PORT %d HOST %s\n", port, host );
+
+	// getaddrinfo is reentrant, gethostbyname used before had to be called under global lock
+
+	memset( &hints, 0, sizeof( hints ) );
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf( portString, sizeof( portString ), "%d", port );
+
+	if( getaddrinfo( host, portString, &hints, &ai ) != 0 || ai == NULL )
+	{
+		FERROR( "Connect_client:: could not get host=[%s]\n", host );
+		goto shutdown;
+	}
+
+	ss->ss_Sock = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol );
+
+	// Set a timeout
+	struct timeval timeout;
+	timeout.tv_sec = 4; // 4 secs!
+	timeout.tv_usec = 0;
+	setsockopt( ss->ss_Sock, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof( timeout) );
+	setsockopt( ss->ss_Sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&timeout, sizeof( timeout ) );
+
+	if( ss->ss_Sock < 0 || connect( ss->ss_Sock, ai->ai_addr, ai->ai_addrlen ) != 0 )
+	{
+		freeaddrinfo( ai );
+		FERROR( "Connect_client:: could not connect to host=[%s]\n", host );
+		goto shutdown;
+	}
+	freeaddrinfo( ai );
+
+	// Create a session instance and start it up. This will trade welcome
+	// banners, exchange keys, and setup crypto, compression, and MAC layers
+	//
+
+	ss->ss_Session = libssh2_session_init();
+	if( ss->ss_Session == NULL )
+	{
+		goto shutdown;
+	}
+
+	libssh2_session_set_timeout( ss->ss_Session, 5000 );
+
+	if( libssh2_session_handshake( ss->ss_Session, ss->ss_Sock ) < 0 )
+	{
+		DEBUG("Failure establishing SSH session\n");
+		goto shutdown;
+	}
+
+	libssh2_keepalive_config( ss->ss_Session, 1, 5 );
+
+	// At this point we havn't authenticated. The first thing to do is check
+	// the hostkey's fingerprint against our known hosts Your app may have it
+	// hard coded, may go to a file, may present it to the user, that's your
+	// call
+	//
+
+	if( libssh2_hostkey_hash( ss->ss_Session, LIBSSH2_HOSTKEY_HASH_SHA1 ) == NULL )
+	{
+		DEBUG( "Failed to get fingerprint.\n" );
+		goto shutdown;
+	}
+
+	DEBUG( "Now going into userauthlist.\n" );
+
+	char *userauthlist = libssh2_userauth_list( ss->ss_Session, user, strlen( user ) );
+	DEBUG( "AUTHLIST %s\n", userauthlist );
+
+	int authpw = 0;
+	if( userauthlist != NULL )
+	{
+		if( strstr(userauthlist, "password") != NULL )
+		{
+			authpw |= 1;
+		}
+		if( strstr(userauthlist, "keyboard-interactive") != NULL )
+		{
+			authpw |= 2;
+		}
+		if( strstr(userauthlist, "publickey") != NULL )
+		{
+			authpw |= 4;
+		}
+	}
+
+	if ( authpw & 1 )
+	{
+		if( libssh2_userauth_password( ss->ss_Session, user, pass != NULL ? pass : "" ) != 0 )
+		{
+			FERROR("User not authenticated\n");
+			goto shutdown;
+		}
+	}
+	else if ( ( authpw & 4 ) && privkey != NULL )
+	{
+		// libssh2 reads key from file, it is removed as soon as authentication is done
+		char keyFileName[ 64 ];
+		int keyError = 1;
+		strcpy( keyFileName, "/tmp/ssh2_tke_XXXXXX" );
+
+		int fd = mkstemp( keyFileName );
+		if( fd >= 0 )
+		{
+			int len = strlen( privkey );
+			if( write( fd, privkey, len ) == len )
+			{
+				keyError = libssh2_userauth_publickey_fromfile( ss->ss_Session, user, keyFileName, NULL, pass );
+			}
+			close( fd );
+			remove( keyFileName );
+		}
+
+		if( keyError != 0 )
+		{
+			FERROR( "\tAuthentication by public key failed!\n");
+			goto shutdown;
+		}
+		DEBUG( "\tAuthentication by public key succeeded.\n");
+	}
+	else
+	{
+		FERROR( "No supported authentication methods found!\n");
+		goto shutdown;
+	}
+
+	DEBUG("Auth %s\n", user );
+
+	ss->ss_SFTP = libssh2_sftp_init( ss->ss_Session );
+
+	if( ss->ss_SFTP == NULL )
+	{
+		int err = libssh2_session_last_errno( ss->ss_Session );
+
+		FERROR("Unable to init SFTP session %d\n", err );
+		goto shutdown;
+	}
+
+	// Since we have not set non-blocking, tell libssh2 we are blocking
+	libssh2_session_set_blocking( ss->ss_Session, 1 );
+
+	return ss;
+
+shutdown:
+
+	SSH2SessionDelete( ss );
+	DEBUG("all done!\n");
+
+	return NULL;
+}
+
+//
+// Remove unused sessions which are broken or idle for too long. Pool must be locked.
+//
+
+static void SSH2PoolReap( HandlerData *hd, time_t now )
+{
+	SSH2Session *ss = hd->hd_Sessions;
+	SSH2Session *prev = NULL;
+
+	while( ss != NULL )
+	{
+		SSH2Session *next = ss->ss_Next;
+
+		if( ss->ss_RefCount <= 0 && ( ss->ss_Broken == TRUE || ( now - ss->ss_IdleSince ) >= SSH2_POOL_IDLE_TIMEOUT ) )
+		{
+			if( prev == NULL )
+			{
+				hd->hd_Sessions = next;
+			}
+			else
+			{
+				prev->ss_Next = next;
+			}
+			DEBUG("Closing unused SSH2 session to %s\n", ss->ss_Host );
+			SSH2SessionDelete( ss );
+		}
+		else
+		{
+			prev = ss;
+		}
+		ss = next;
+	}
+}
+
+/**
+ * Get session from pool or open new one. Session is shared with other mounts
+ * only when host, port and all credentials are the same.
+ *
+ * @param hd pointer to HandlerData
+ * @param host server name or address
+ * @param port server port
+ * @param user login user
+ * @param pass login password
+ * @param privkey private key or NULL
+ * @return SSH2Session with increased reference counter or NULL when connection failed
+ */
+static SSH2Session *SSH2PoolGet( HandlerData *hd, const char *host, int port, const char *user, const char *pass, const char *privkey )
+{
+	SSH2Session *ss = NULL;
+	SSH2Session *best = NULL;
+	int matching = 0;
+
+	pthread_mutex_lock( &hd->hd_Mutex );
+
+	SSH2PoolReap( hd, time( NULL ) );
+
+	for( ss = hd->hd_Sessions; ss != NULL; ss = ss->ss_Next )
+	{
+		if( ss->ss_Broken == FALSE && ss->ss_Port == port && SSH2StrEq( ss->ss_Host, host ) && SSH2StrEq( ss->ss_LoginUser, user ) && SSH2StrEq( ss->ss_LoginPass, pass ) && SSH2StrEq( ss->ss_PrivKey, privkey ) )
+		{
+			matching++;
+			if( best == NULL || ss->ss_RefCount < best->ss_RefCount )
+			{
+				best = ss;
+			}
+		}
+	}
+
+	if( best != NULL && ( best->ss_RefCount < SSH2_POOL_MOUNTS_PER_SESSION || matching >= SSH2_POOL_MAX_SESSIONS ) )
+	{
+		best->ss_RefCount++;
+		pthread_mutex_unlock( &hd->hd_Mutex );
+		DEBUG("Reusing SSH2 session to %s, users %d\n", host, best->ss_RefCount );
+		return best;
+	}
+
+	pthread_mutex_unlock( &hd->hd_Mutex );
+
+	// handshake and authentication take time, other mounts should not wait for them
+
+	if( ( ss = SSH2SessionNew( host, port, user, pass, privkey ) ) == NULL )
+	{
+		return NULL;
+	}
+
+	pthread_mutex_lock( &hd->hd_Mutex );
+	ss->ss_RefCount = 1;
+	ss->ss_Next = hd->hd_Sessions;
+	hd->hd_Sessions = ss;
+	pthread_mutex_unlock( &hd->hd_Mutex );
+
+	return ss;
+}
+
+//
+// Return session to pool
+//
+
+static void SSH2PoolRelease( HandlerData *hd, SSH2Session *ss )
+{
+	pthread_mutex_lock( &hd->hd_Mutex );
+
+	ss->ss_RefCount--;
+	if( ss->ss_RefCount <= 0 )
+	{
+		ss->ss_IdleSince = time( NULL );
+	}
+	SSH2PoolReap( hd, time( NULL ) );
+
+	pthread_mutex_unlock( &hd->hd_Mutex );
+}
+
+//
+// Take private key from mount configuration
+//
+
+static char *SSH2ConfigPrivKey( const char *config )
+{
+	if( config == NULL )
+	{
+		return NULL;
+	}
+
+	char *lockey = strstr( config, "PublicKey" );
+	if( lockey != NULL )
+	{
+		lockey += 12; // add "PublicKey":"
+		char *endptr = lockey;
+		char *lastchar = endptr;
+		while( TRUE )
+		{
+			if( *endptr == 0 )
+			{
+				break;
+			}
+
+			if( *lastchar != '\\' && *endptr == '\"' )
+			{
+				int len = endptr - lockey;
+				char *privkey = FCalloc( len + 1, sizeof(char) );
+				if( privkey != NULL )
+				{
+					memcpy( privkey, lockey, len*sizeof(char) );
+				}
+				return privkey;
+			}
+
+			lastchar = endptr;
+			endptr++;
+		}
+	}
+	return NULL;
+}
 
 //
 //
@@ -172,6 +713,18 @@ void init( struct FHandler *s )
 void deinit( struct FHandler *s )
 {
 	HandlerData *hd = (HandlerData *)s->fh_SpecialData;
+
+	pthread_mutex_lock( &hd->hd_Mutex );
+	SSH2Session *ss = hd->hd_Sessions;
+	while( ss != NULL )
+	{
+		SSH2Session *next = ss->ss_Next;
+		SSH2SessionDelete( ss );
+		ss = next;
+	}
+	hd->hd_Sessions = NULL;
+	pthread_mutex_unlock( &hd->hd_Mutex );
+
 	pthread_mutex_destroy( &hd->hd_Mutex );
 	libssh2_exit();
 	FFree( hd );
@@ -191,39 +744,22 @@ int UnMount( struct FHandler *s, void *f )
 		{
 			SpecialData *sdat = (SpecialData *) lf->f_SpecialData;
 			HandlerData *hd = (HandlerData *)s->fh_SpecialData;
-			
-			if( sdat->sock != 0 )
+
+			if( sdat->sd_Session != NULL )
 			{
-				close( sdat->sock );
+				SSH2PoolRelease( hd, sdat->sd_Session );
 			}
-			
-			pthread_mutex_lock( &hd->hd_Mutex );
-			
-			libssh2_sftp_shutdown( sdat->sftp_session );
-			
-			libssh2_session_disconnect( sdat->session,  "Normal Shutdown, Thank you for playing" );
-			libssh2_session_free( sdat->session );
-			
-			pthread_mutex_unlock( &hd->hd_Mutex );
-
-			close( sdat->sock );
 			DEBUG("all done!\n");
-			
-			if( sdat->sd_Host ){ FFree( sdat->sd_Host ); }
-			if( sdat->sd_LoginUser ){ FFree( sdat->sd_LoginUser ); }
-			if( sdat->sd_LoginPass ){ FFree( sdat->sd_LoginPass ); }
-			
-			remove( sdat->sd_privkeyFileName );
-			
+
 			FFree( lf->f_SpecialData );
 		}
-		
+
 		if( lf->f_Name ){ FFree( lf->f_Name ); }
 		if( lf->f_Path ){ FFree( lf->f_Path ); }
-		
+
 		//free( f );
 	}
-	
+
 	return 0;
 }
 
@@ -240,75 +776,88 @@ void *Mount( struct FHandler *s, struct TagItem *ti, User *usrs )
 	char *ulogin = NULL;
 	char *upass = NULL;
 	char *config = NULL;
-	//char *privkey = NULL;
 	int port = 22;
 	User *usr = NULL;
 	SystemBase *sb = NULL;
-	
+
 	if( s == NULL )
 	{
 		return NULL;
 	}
-	
+
 	HandlerData *hd = (HandlerData *)s->fh_SpecialData;
-	
+
 	DEBUG("Mounting ssh2 filesystem!\n");
-	
-	if( ( dev = FCalloc( sizeof( File ), 1 ) ) != NULL )
+
+	struct TagItem *lptr = ti;
+
+	//
+	// checking passed arguments
+
+	while( lptr->ti_Tag != TAG_DONE )
 	{
-		struct TagItem *lptr = ti;
-		
-		//
-		// checking passed arguments
-		
-		while( lptr->ti_Tag != TAG_DONE )
-		{
-			switch( lptr->ti_Tag )
-			{
-				case FSys_Mount_Path:
-					path = (char *)lptr->ti_Data;
-					DEBUG("Mount FS path set '%s'\n", path );
-					break;
-				case FSys_Mount_Server:
-					host = (char *)lptr->ti_Data;
-					break;
-				case FSys_Mount_Port:
-					port = atol( (char *)lptr->ti_Data );
-					break;
-				case FSys_Mount_Name:
-					name = (char *)lptr->ti_Data;
-					break;
-				case FSys_Mount_LoginUser:
-					ulogin = (char *)lptr->ti_Data;
-					break;
-				case FSys_Mount_LoginPass:
-					upass = (char *)lptr->ti_Data;
-					break;
-				case FSys_Mount_SysBase:
-					sb = (SystemBase *)lptr->ti_Data;
-					break;
-				case FSys_Mount_Config:
-					config = (char *)lptr->ti_Data;
-					break;
-			}
-		
-			lptr++;
-		}
-		
-		//
-		
-		if( path == NULL )
+		switch( lptr->ti_Tag )
 		{
-			DEBUG("[ERROR]: Path option not found!\n");
-			FFree( dev );
-			return NULL;
+			case FSys_Mount_Path:
+				path = (char *)lptr->ti_Data;
+				DEBUG("Mount FS path set '%s'\n", path );
+				break;
+			case FSys_Mount_Server:
+				host = (char *)lptr->ti_Data;
+				break;
+			case FSys_Mount_Port:
+				port = atol( (char *)lptr->ti_Data );
+				break;
+			case FSys_Mount_Name:
+				name = (char *)lptr->ti_Data;
+				break;
+			case FSys_Mount_LoginUser:
+				ulogin = (char *)lptr->ti_Data;
+				break;
+			case FSys_Mount_LoginPass:
+				upass = (char *)lptr->ti_Data;
+				break;
+			case FSys_Mount_SysBase:
+				sb = (SystemBase *)lptr->ti_Data;
+				break;
+			case FSys_Mount_Config:
+				config = (char *)lptr->ti_Data;
+				break;
 		}
-		
-		//init( s );
-		
+
+		lptr++;
+	}
+
+	//
+
+	if( path == NULL )
+	{
+		DEBUG("[ERROR]: Path option not found!\n");
+		return NULL;
+	}
+
+	//
+	// connection is taken from pool, mounts with same server and credentials share it
+	//
+
+	char *privkey = SSH2ConfigPrivKey( config );
+	SSH2Session *ss = SSH2PoolGet( hd, host, port, ulogin, upass, privkey );
+	if( privkey != NULL )
+	{
+		FFree( privkey );
+	}
+
+	if( ss == NULL )
+	{
+		FERROR("Cannot connect to SSH2 server %s\n", host );
+		return NULL;
+	}
+
+	if( ( dev = FCalloc( sizeof( File ), 1 ) ) != NULL )
+	{
 		// we are trying to open folder/connection
 		DEBUG("Mounting localfsys, Its directory FSYS: %s!\n", s->GetPrefix() );
-		
+
 		dev->f_Path = StringDup( path );
 		DEBUG("localfs path is ok '%s'\n", dev->f_Path );
 		dev->f_FSys = s;
@@ -317,265 +866,29 @@ void *Mount( struct FHandler *s, struct TagItem *ti, User *usrs )
 		dev->f_Position = 0;
 		dev->f_User = usr;
 		dev->f_Name = StringDup( name );
-		DEBUG("data filled, name of the drive: %s\n", dev->f_Name );
-		
-	}
-	
-	//
-	// we will hold here special data SSH2
-	//
-	
-	dev->f_SpecialData = FCalloc( sizeof(SpecialData), 1 );
-	SpecialData *sdat = (SpecialData *) dev->f_SpecialData;
-	if( sdat != NULL )
-	{
-		sdat->sd_Host = StringDup( host );
-		sdat->sd_Port = port;
-		sdat->sd_LoginUser = StringDup( ulogin );
-		sdat->sd_LoginPass = StringDup( upass );
-		sdat->sb = sb;
-		
-		// Ultra basic "connect to port 22 on localhost".  Your code is
-		//responsible for creating the socket establishing the connection
-		/// 
-		sdat->hostaddr = inet_addr( sdat->sd_Host );
-		
-		sdat->sock = socket( AF_INET, SOCK_STREAM, 0 );
- 
-		sdat->sin.sin_family = AF_INET;
-		sdat->sin.sin_port = htons( sdat->sd_Port );
-		//sdat->sin.sin_addr.s_addr = sdat->hostaddr;
-		
-		DEBUG("PORT %d HOST %s\n", sdat->sd_Port, sdat->sd_Host );
-		
-		#define h_addr h_addr_list[0]
-		
-		struct hostent *phe;
-		struct servent *pse;
-		struct protoent *ppe;
-		char *protocol;
-		
-		DEBUG("SFTP lock %p\n", &hd->hd_Mutex );
-		pthread_mutex_lock( &hd->hd_Mutex );
-
-		if ( (phe = (struct hostent *)gethostbyname(sdat->sd_Host) ) != NULL ) 
-		{
-			DEBUG("Gethostbyname used\n");
-			memcpy(&sdat->sin.sin_addr, phe->h_addr, phe->h_length);
-		}
-		else if( ( phe = gethostbyname2( sdat->sd_Host, AF_INET6 ) ) != NULL )
-		{
-			DEBUG("Gethostbyname2 used\n");
-			memcpy( &sdat->sin.sin_addr, phe->h_addr, phe->h_length);
-		}
-		else if ( (sdat->sin.sin_addr.s_addr = inet_addr(sdat->sd_Host)) == INADDR_NONE) 
-		{
-			FERROR( "Connect_client:: could not get host=[%s]\n", sdat->sd_Host);
-			goto shutdown;
-		}
-		
-		// Set a timeout
-		struct timeval timeout;      
-		timeout.tv_sec = 4; // 4 secs!
-		timeout.tv_usec = 0;
-		setsockopt( sdat->sock, SOL_SOCKET, SO_RCVTIMEO, (char *)&timeout, sizeof( timeout) );
-		setsockopt( sdat->sock, SOL_SOCKET, SO_SNDTIMEO, (char *)&timeout, sizeof( timeout ) );
-		
-		if( connect( sdat->sock, (struct sockaddr *)&(sdat->sin), sizeof(sdat->sin) ) != 0 ) 
-		{
-			close( sdat->sock );
-			FERROR( "Connect_client:: could not connect to host=[%s]\n", sdat->sd_Host);
-			goto shutdown;
-		}
-
-		// Create a session instance and start it up. This will trade welcome
-		// banners, exchange keys, and setup crypto, compression, and MAC layers
-		// 
-		
-		sdat->session = libssh2_session_init();
-		
-		libssh2_session_set_timeout( sdat->session, 5000 );
-		
-		if( libssh2_session_handshake( sdat->session, sdat->sock ) < 0 ) 
-		{
-			DEBUG("Failure establishing SSH session\n");
-			goto shutdown;
-		}
-		
-		libssh2_keepalive_config( sdat->session, 1, 5 );
- 
-		// At this point we havn't authenticated. The first thing to do is check
-		// the hostkey's fingerprint against our known hosts Your app may have it
-		// hard coded, may go to a file, may present it to the user, that's your
-		// call
-		// 
-		
-		sdat->fingerprint = libssh2_hostkey_hash( sdat->session, LIBSSH2_HOSTKEY_HASH_SHA1 );
-		
-		if( sdat->fingerprint == NULL )
-		{
-			DEBUG( "Failed to get fingerprint.\n" );
-			goto shutdown;
-		}
-		
-		/*
-		DEBUG("Fingerprint: ");
-		int i;
-		for(i = 0; i < 20; i++) 
-		{
-			DEBUG(  "%02X ", (unsigned char)sdat->fingerprint[i]);
-		}
-		DEBUG("\n");
-		*/
- 
- 		DEBUG( "Now going into userauthlist.\n" );
- 
-		char *userauthlist = NULL;
-		
-		userauthlist = libssh2_userauth_list( sdat->session, sdat->sd_LoginUser, strlen(sdat->sd_LoginUser) );
-		DEBUG( "AUTHLIST %s\n", userauthlist );
-		
-		int authpw = 0;
-		if( strstr(userauthlist, "password") != NULL )
-		{
-			authpw |= 1;
-		}
-		if( strstr(userauthlist, "keyboard-interactive") != NULL )
-		{
-			authpw |= 2;
-		}
-		if( strstr(userauthlist, "publickey") != NULL )
-		{
-			authpw |= 4;
-		}
-		
-		if( config != NULL )
-		{
-			int cfglen = strlen( config );
-			
-			char *lockey = strstr( config, "PublicKey" );
-			if( lockey != NULL )
-			{
-				lockey += 12; // add "PublicKey":"
-				char *endptr = lockey;
-				char *lastchar = endptr;
-				while( TRUE )
-				{
-					if( *endptr == 0 )
-					{
-						break;
-					}
-					
-					if( *lastchar != '\\' && *endptr == '\"' )
-					{
-						int len = endptr - lockey;
-						
-						snprintf( sdat->sd_privkeyFileName, sizeof(sdat->sd_privkeyFileName), "/tmp/%lu_tke_%d%d%d%d", (unsigned long)sdat, rand()%9999, rand()%9999, rand()%9999, rand()%9999 );
-						
-						FILE *fp;
-						if( ( fp = fopen( sdat->sd_privkeyFileName, "wb") ) != NULL )
-						{
-							fwrite( lockey, len, sizeof(char), fp);
-							fclose(fp);
-						}
-						
-						//if( ( privkey = FCalloc( len+10, sizeof(char) ) ) != NULL )
-						//{
-						//	memcpy( privkey, lockey, len*sizeof(char) );
-						//}
-						break;
-					}
-					
-					lastchar = endptr;
-					endptr++;
-				}
-			}
-		}
-		
-		if ( authpw & 1 )
-		{
-			sdat->rc = libssh2_userauth_password( sdat->session, sdat->sd_LoginUser, sdat->sd_LoginPass );
-			if( sdat->rc != 0 )
-			{
-				FERROR("User not authenticated\n");
-				goto shutdown;
-			}
-		}
-		else if ( authpw & 4 )
-		{
-			// Or by public key  
-			//if( libssh2_userauth_publickey_frommem( sdat->session, sdat->sd_LoginUser, strlen(sdat->sd_LoginUser), NULL, 0, privkey, strlen(privkey), NULL ) )
-			//{
-			if (libssh2_userauth_publickey_fromfile( sdat->session, sdat->sd_LoginUser, sdat->sd_privkeyFileName, NULL, sdat->sd_LoginPass ) ) 
-			{	
-				FERROR( "\tAuthentication by public key failed!\n");
-				goto shutdown;
-			}
-			else
-			{
-				DEBUG( "\tAuthentication by public key succeeded.\n");
-			}
-		}
-		else
-		{
-			FERROR( "No supported authentication methods found!\n");
-			goto shutdown;
-		}
-		
-		DEBUG("Auth %s %s ret %d\n", sdat->sd_LoginUser, sdat->sd_LoginPass, sdat->rc );
-
-		sdat->sftp_session = libssh2_sftp_init( sdat->session );
-
-		if (!sdat->sftp_session) 
-		{
-			int err = libssh2_session_last_errno( sdat->session );
-			
-			FERROR("Unable to init SFTP session %d\n", err );
-			goto shutdown;
-		}
- 
-		// Since we have not set non-blocking, tell libssh2 we are blocking 
-		libssh2_session_set_blocking( sdat->session, 1);
-		
-		pthread_mutex_unlock( &hd->hd_Mutex );
-		DEBUG("mount SFTP unlock %p\n", &hd->hd_Mutex );
-		
-		return dev;
-	}
-	
-shutdown:
+		DEBUG("data filled, name of the drive: %s\n", dev->f_Name );
 
-	if( dev->f_SpecialData )
-	{
+		//
+		// we will hold here special data SSH2
+		//
+
+		dev->f_SpecialData = FCalloc( sizeof(SpecialData), 1 );
 		SpecialData *sdat = (SpecialData *) dev->f_SpecialData;
-	
-		if( sdat->session != NULL )
-		{
-			libssh2_sftp_shutdown( sdat->sftp_session);
-	
-			libssh2_session_disconnect( sdat->session,  "Normal Shutdown, Thank you for playing");
-			libssh2_session_free(sdat->session);
-		}
-		
-		if( sdat->sock != 0 )
+		if( sdat != NULL )
 		{
-			close( sdat->sock);
+			sdat->sd_Session = ss;
+			sdat->sb = sb;
+
+			return dev;
 		}
-		DEBUG("all done!\n");
-		
-		pthread_mutex_unlock( &hd->hd_Mutex );
-		DEBUG("mount SFTP unlock %p\n", &hd->hd_Mutex );
-		
-		if( sdat->sd_Host ){ FFree( sdat->sd_Host ); }
-		if( sdat->sd_LoginUser ){ FFree( sdat->sd_LoginUser ); }
-		if( sdat->sd_LoginPass ){ FFree( sdat->sd_LoginPass ); }
-	
-		FFree( dev->f_SpecialData );
+
+		if( dev->f_Name ){ FFree( dev->f_Name ); }
+		if( dev->f_Path ){ FFree( dev->f_Path ); }
+		FFree( dev );
 	}
 
-	if( dev->f_Name ){ FFree( dev->f_Name ); }
-	if( dev->f_Path ){ FFree( dev->f_Path ); }
-	
+	SSH2PoolRelease( hd, ss );
+
 	return NULL;
 }
 
@@ -588,48 +901,88 @@ int Release( struct FHandler *s, void *f )
 	if( f != NULL )
 	{
 		File *lf = (File *)f;
-		
+
 		if( lf->f_SpecialData )
 		{
 			SpecialData *sdat = (SpecialData *) lf->f_SpecialData;
 			HandlerData *hd = (HandlerData *)s->fh_SpecialData;
-			
-			DEBUG("release locked %p\n", &hd->hd_Mutex );
-			pthread_mutex_lock( &hd->hd_Mutex );
-			
-			libssh2_sftp_shutdown( sdat->sftp_session);
-			
-			libssh2_session_disconnect( sdat->session,  "Normal Shutdown, Thank you for playing");
-			libssh2_session_free( sdat->session );
-			
-			pthread_mutex_unlock( &hd->hd_Mutex );
-			DEBUG("release unlocked %p\n", &hd->hd_Mutex );
-			
-			//pthread_mutex_destroy( &hd->hd_Mutex );
 
-			//close( sdat->sock);
-			DEBUG("all done!\n");
-			//libssh2_exit();
-			
-			if( sdat->sock != 0 )
+			if( sdat->sd_Session != NULL )
 			{
-				close( sdat->sock);
-				DEBUG("socket closed\n");
+				SSH2PoolRelease( hd, sdat->sd_Session );
 			}
-			
-			if( sdat->sd_Host ){ FFree( sdat->sd_Host ); }
-			if( sdat->sd_LoginUser ){ FFree( sdat->sd_LoginUser ); }
-			if( sdat->sd_LoginPass ){ FFree( sdat->sd_LoginPass ); }
-			
-			remove( sdat->sd_privkeyFileName );
-			
+			DEBUG("all done!\n");
+
 			FFree( lf->f_SpecialData );
 		}
-		
+
 		if( lf->f_Name ){ FFree( lf->f_Name ); }
 		if( lf->f_Path ){ FFree( lf->f_Path ); }
 	}
-	
+
+	return 0;
+}
+
+//
+// Read until buffer is full or end of file. libssh2 keeps several read requests in flight for big buffers.
+//
+
+static int SSH2ReadAll( LIBSSH2_SFTP_HANDLE *handle, char *buffer, int size )
+{
+	int result = 0;
+
+	while( result < size )
+	{
+		ssize_t rc = libssh2_sftp_read( handle, buffer + result, size - result );
+		if( rc <= 0 )
+		{
+			if( rc < 0 && result == 0 )
+			{
+				return -1;
+			}
+			break;
+		}
+		result += rc;
+	}
+	return result;
+}
+
+//
+// Write whole buffer. libssh2 sends big buffers as several pipelined write requests.
+//
+
+static int SSH2WriteAll( LIBSSH2_SFTP_HANDLE *handle, const char *buffer, int size )
+{
+	int result = 0;
+
+	while( result < size )
+	{
+		ssize_t rc = libssh2_sftp_write( handle, buffer + result, size - result );
+		if( rc <= 0 )
+		{
+			return -1;
+		}
+		result += rc;
+	}
+	return result;
+}
+
+//
+// Send data collected in write buffer. Session must be locked.
+//
+
+static int SSH2FlushBuffer( SpecialData *sd )
+{
+	if( sd->sd_Write == TRUE && sd->sd_BufferLen > 0 )
+	{
+		int rc = SSH2WriteAll( sd->sd_FileHandle, sd->sd_Buffer, sd->sd_BufferLen );
+		sd->sd_BufferLen = 0;
+		if( rc < 0 )
+		{
+			SSH2SessionCheck( sd->sd_Session );
+			return -1;
+		}
+	}
 	return 0;
 }
 
@@ -654,21 +1007,23 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 			commClean[in++] = path[ii];
 		}
 	}
-	
+
 	SpecialData *sdat = (SpecialData *)s->f_SpecialData;
-	
+	SSH2Session *ss = sdat->sd_Session;
+
 	if( imode != 1 )
 	{
 		strcpy( commClean, path );
 	}
-	
+
 	int spath = strlen( commClean );
 	int rspath = strlen( s->f_Path );
 	File *locfil = NULL;
 	char *comm = FCalloc( rspath + spath + 5, sizeof( char ) );
-	
+	FBOOL readMode = ( strcmp( mode, "rs" ) == 0 || strcmp( mode, "rb" ) == 0 || strcmp( mode, "r" ) == 0 );
+
 	DEBUG(" comm---size %d\n", rspath + spath + 5 );
-	
+
 	// Remove the filename from commclean in a clean path
 	char *cleanPath = NULL;
 	il = strlen( commClean ); imode = 0, ii = il;
@@ -682,7 +1037,7 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		}
 	}
 	if( imode == 1 ) sprintf( cleanPath, "%.*s", il, commClean );
-	
+
 	// Create a string that has the real file path of the file
 	if( comm != NULL )
 	{
@@ -694,43 +1049,34 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		{
 			sprintf( comm, "%s/%s", s->f_Path, commClean );
 		}
-		
-		// Make the directories that do not exist
-		int slashes = 0, i = 0; for( ; i < spath; i++ )
-		{
-			if( commClean[i] == '/' )
-			{
-				slashes++;
-			}
-		}
-		
-		FHandler *fh = (FHandler *)s->f_FSys;
-		HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
-		
-		DEBUG("open1 locked %p\n", &hd->hd_Mutex );
-		pthread_mutex_lock( &hd->hd_Mutex );
-		int off = 0, slash = 0;
-		for( i = 0; i < spath; i++ )
+
+		DEBUG("open locked %p\n", &ss->ss_Mutex );
+		pthread_mutex_lock( &ss->ss_Mutex );
+
+		// Make the directories that do not exist, only needed when file is written
+
+		int i;
+		if( readMode == FALSE )
 		{
-			if( path[i] == '/' )
+			for( i = 0; i < spath; i++ )
 			{
-				int alsize = rspath + i + 1;
-				DEBUG("Allocate %d\n", alsize );
-				char *directory = FCalloc( alsize , sizeof( char ) );
-				if( directory != NULL )
+				if( path[i] == '/' )
 				{
-					snprintf( directory, alsize, "%s%.*s", s->f_Path, i, cleanPath );
-					
-					int err =libssh2_sftp_mkdir( sdat->sftp_session, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
-					
-					FFree( directory );
+					int alsize = rspath + i + 1;
+					DEBUG("Allocate %d\n", alsize );
+					char *directory = FCalloc( alsize , sizeof( char ) );
+					if( directory != NULL )
+					{
+						snprintf( directory, alsize, "%s%.*s", s->f_Path, i, cleanPath );
+
+						libssh2_sftp_mkdir( ss->ss_SFTP, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
+
+						FFree( directory );
+					}
 				}
-				slash++;
 			}
 		}
-		pthread_mutex_unlock( &hd->hd_Mutex );
-		DEBUG("open1 locked %p\n", &hd->hd_Mutex );
-		
+
 		FFree( commClean );
 		if( cleanPath != NULL )
 		{
@@ -738,64 +1084,73 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		}
 		commClean = NULL;
 		cleanPath = NULL;
-		
+
 		DEBUG("FileOpen in progress\n");
-		
+
 		//
-		// Only go on if we can find the file and open it 
+		// Only go on if we can find the file and open it
 		//
-		
+
 		//
 		// read stream
 		//
 		LIBSSH2_SFTP_HANDLE *handle = NULL;
-		
-		DEBUG("open locked %p\n", &hd->hd_Mutex );
-		pthread_mutex_lock( &hd->hd_Mutex );
-		
-		if( strcmp( mode, "rs" ) == 0 || strcmp( mode, "rb" ) == 0 || strcmp( mode, "r" ) == 0 )
+
+		if( readMode == TRUE )
 		{
-			handle = libssh2_sftp_open( sdat->sftp_session, comm, LIBSSH2_FXF_READ, 0 );
+			handle = libssh2_sftp_open( ss->ss_SFTP, comm, LIBSSH2_FXF_READ, 0 );
 		}
 		else
 		{
-			handle = libssh2_sftp_open( sdat->sftp_session, comm,
+			handle = libssh2_sftp_open( ss->ss_SFTP, comm,
 				LIBSSH2_FXF_WRITE|LIBSSH2_FXF_CREAT|LIBSSH2_FXF_TRUNC,
 				LIBSSH2_SFTP_S_IRUSR|LIBSSH2_SFTP_S_IWUSR|
 				LIBSSH2_SFTP_S_IRGRP|LIBSSH2_SFTP_S_IROTH );
+
+			SSH2StatCacheInvalidate( ss, comm );
 		}
-		
-		pthread_mutex_unlock( &hd->hd_Mutex );
-		DEBUG("open unlocked %p\n", &hd->hd_Mutex );
-		
+
+		if( handle == NULL )
+		{
+			SSH2SessionCheck( ss );
+		}
+
+		pthread_mutex_unlock( &ss->ss_Mutex );
+		DEBUG("open unlocked %p\n", &ss->ss_Mutex );
+
 		if( handle != NULL )
 		{
 			// Ready the file structure
 			if( ( locfil = FCalloc( sizeof( File ), 1 ) ) != NULL )
 			{
 				locfil->f_Path = StringDup( path );
-				
+
 				locfil->f_SpecialData = FCalloc( sizeof( SpecialData ), 1 );
-				
+
 				locfil->f_Stream = s->f_Stream;
 				locfil->f_FSys  = s->f_FSys;
 				locfil->f_RootDevice = s;
-				
+
 				SpecialData *sd = (SpecialData *)locfil->f_SpecialData;
-				
+
 				if( sd )
 				{
-					SpecialData *locsd = (SpecialData *)s->f_SpecialData;
-					sd->sb = locsd->sb;
+					sd->sb = sdat->sb;
+					sd->sd_Session = ss;
 					sd->sd_FileHandle = handle;
+					sd->sd_FilePath = comm;
+					sd->sd_Write = readMode == TRUE ? FALSE : TRUE;
+					sd->sd_Buffer = FCalloc( readMode == TRUE ? SSH2_READ_AHEAD_SIZE : SSH2_WRITE_BUFFER_SIZE, sizeof( char ) );
 				}
 				DEBUG("FileOpened, memory allocated for ssh2fs\n");
-				
-				// Free temp string
-				FFree( comm );
-				
+
 				return locfil;
 			}
+
+			pthread_mutex_lock( &ss->ss_Mutex );
+			libssh2_sftp_close( handle );
+			pthread_mutex_unlock( &ss->ss_Mutex );
+
 			FFree( comm );
 			return NULL;
 		}
@@ -805,7 +1160,7 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		}
 		FFree( comm );
 	}
-	
+
 	// Free commClean
 	if( commClean )
 	{
@@ -816,7 +1171,7 @@ void *FileOpen( struct File *s, const char *path, char *mode )
 		FFree( cleanPath );
 	}
 	FERROR("Cannot open file %s\n", path );
-	
+
 	return NULL;
 }
 
@@ -828,33 +1183,41 @@ int FileClose( struct File *s, void *fp )
 {
 	if( fp != NULL )
 	{
-		SpecialData *sdat = (SpecialData *)s->f_SpecialData;
-		FHandler *fh = (FHandler *)s->f_FSys;
-		HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
 		int close = 0;
-		
+
 		File *lfp = ( File *)fp;
-		
+
 		if( lfp->f_SpecialData )
 		{
 			SpecialData *sd = ( SpecialData *)lfp->f_SpecialData;
-			
-			pthread_mutex_lock( &hd->hd_Mutex );
+			SSH2Session *ss = sd->sd_Session;
+
+			pthread_mutex_lock( &ss->ss_Mutex );
+			if( SSH2FlushBuffer( sd ) != 0 )
+			{
+				close = -1;
+			}
 			libssh2_sftp_close( sd->sd_FileHandle );
-			pthread_mutex_unlock( &hd->hd_Mutex );
-			
+			if( sd->sd_Write == TRUE && sd->sd_FilePath != NULL )
+			{
+				SSH2StatCacheInvalidate( ss, sd->sd_FilePath );
+			}
+			pthread_mutex_unlock( &ss->ss_Mutex );
+
+			if( sd->sd_FilePath ) FFree( sd->sd_FilePath );
+			if( sd->sd_Buffer ) FFree( sd->sd_Buffer );
 			FFree( lfp->f_SpecialData );
 		}
-		
+
 		if( lfp->f_Path ) FFree( lfp->f_Path );
 		if( lfp->f_Buffer ) FFree( lfp->f_Buffer );
 		FFree( lfp );
-		
+
 		DEBUG( "FileClose: Closing file pointer.\n" );
-		
+
 		return close;
 	}
-	
+
 	return - 1;
 }
 
@@ -864,43 +1227,88 @@ int FileClose( struct File *s, void *fp )
 
 int FileRead( struct File *f, char *buffer, int rsize )
 {
-	int result = -2;
-	
+	int result = 0;
+
 	SpecialData *sd = (SpecialData *)f->f_SpecialData;
-	
-	if( sd != NULL )
+
+	if( sd != NULL && sd->sd_Session != NULL )
 	{
-		FHandler *fh = NULL;
-		HandlerData *hd = NULL;
-		
-		fh = (FHandler *)f->f_FSys;
-		if( fh != NULL )
-		{
-			hd = (HandlerData *)fh->fh_SpecialData;
-		}
-		
-		if( hd != NULL )
+		SSH2Session *ss = sd->sd_Session;
+
+		pthread_mutex_lock( &ss->ss_Mutex );
+
+		while( result < rsize )
 		{
-			pthread_mutex_lock( &hd->hd_Mutex );
+			int avail = sd->sd_BufferLen - sd->sd_BufferPos;
+
+			if( avail <= 0 )
+			{
+				int rc;
+
+				if( sd->sd_EOF == TRUE )
+				{
+					break;
+				}
+
+				// big requests go directly to caller buffer
+
+				if( sd->sd_Buffer == NULL || ( rsize - result ) >= SSH2_READ_AHEAD_SIZE )
+				{
+					rc = SSH2ReadAll( sd->sd_FileHandle, buffer + result, rsize - result );
+					if( rc < ( rsize - result ) )
+					{
+						sd->sd_EOF = TRUE;
+					}
+					if( rc > 0 )
+					{
+						result += rc;
+					}
+					else if( rc < 0 )
+					{
+						SSH2SessionCheck( ss );
+					}
+					break;
+				}
+
+				// read ahead, next calls are served from buffer
+
+				rc = SSH2ReadAll( sd->sd_FileHandle, sd->sd_Buffer, SSH2_READ_AHEAD_SIZE );
+				if( rc < SSH2_READ_AHEAD_SIZE )
+				{
+					sd->sd_EOF = TRUE;
+				}
+				if( rc <= 0 )
+				{
+					if( rc < 0 )
+					{
+						SSH2SessionCheck( ss );
+					}
+					break;
+				}
+				sd->sd_BufferLen = rc;
+				sd->sd_BufferPos = 0;
+				avail = rc;
+			}
+
+			int len = avail < ( rsize - result ) ? avail : ( rsize - result );
+			memcpy( buffer + result, sd->sd_Buffer + sd->sd_BufferPos, len );
+			sd->sd_BufferPos += len;
+			result += len;
 		}
-		result = libssh2_sftp_read( sd->sd_FileHandle, buffer, rsize );
-		
+
+		pthread_mutex_unlock( &ss->ss_Mutex );
+
 		if( f->f_Stream == TRUE && result > 0 )
 		{
 			sd->sb->sl_SocketInterface.SocketWrite( f->f_Socket, buffer, result );
 		}
-		
-		if( hd != NULL )
-		{
-			pthread_mutex_unlock( &hd->hd_Mutex );
-		}
 	}
 	DEBUG("FileRead %d\n", result );
 	if( result <= 0 )
 	{
 		return -1;
 	}
-	
+
 	return result;
 }
 
@@ -911,40 +1319,45 @@ int FileRead( struct File *f, char *buffer, int rsize )
 int FileWrite( struct File *f, char *buffer, int wsize )
 {
 	int result = 0;
-	char *bufptr = buffer;
-	
+
 	SpecialData *sd = (SpecialData *)f->f_SpecialData;
-	if( sd )
+	if( sd != NULL && sd->sd_Session != NULL && wsize > 0 )
 	{
-		FHandler *fh = NULL;
-		HandlerData *hd = NULL;
-		fh = (FHandler *)f->f_FSys;
-		if( fh != NULL )
-		{
-			hd = (HandlerData *)fh->fh_SpecialData;
-		}
-		
-		if( hd != NULL )
+		SSH2Session *ss = sd->sd_Session;
+
+		pthread_mutex_lock( &ss->ss_Mutex );
+
+		// small writes are collected and sent together
+
+		if( sd->sd_Buffer != NULL && ( sd->sd_BufferLen + wsize ) <= SSH2_WRITE_BUFFER_SIZE )
 		{
-			pthread_mutex_lock( &hd->hd_Mutex );
+			memcpy( sd->sd_Buffer + sd->sd_BufferLen, buffer, wsize );
+			sd->sd_BufferLen += wsize;
+			result = wsize;
 		}
-		do
+		else if( SSH2FlushBuffer( sd ) == 0 )
 		{
-			int rc = libssh2_sftp_write( sd->sd_FileHandle, bufptr, wsize );
-			if( rc < 0 )
+			if( sd->sd_Buffer == NULL || wsize >= SSH2_WRITE_BUFFER_SIZE )
 			{
-				break;
+				int rc = SSH2WriteAll( sd->sd_FileHandle, buffer, wsize );
+				if( rc > 0 )
+				{
+					result = rc;
+				}
+				else
+				{
+					SSH2SessionCheck( ss );
+				}
+			}
+			else
+			{
+				memcpy( sd->sd_Buffer, buffer, wsize );
+				sd->sd_BufferLen = wsize;
+				result = wsize;
 			}
-			bufptr += rc;
-			wsize -= rc;
-			result += rc;
-		}
-		while( wsize );
-		
-		if( hd != NULL )
-		{
-			pthread_mutex_unlock( &hd->hd_Mutex );
 		}
+
+		pthread_mutex_unlock( &ss->ss_Mutex );
 	}
 	DEBUG("FileWrite %d\n", result );
 	return result;
@@ -956,14 +1369,24 @@ int FileWrite( struct File *f, char *buffer, int wsize )
 
 int FileSeek( struct File *s, int pos )
 {
-	int result = -1;
-	
 	SpecialData *sd = (SpecialData *)s->f_SpecialData;
-	if( sd )
+	if( sd != NULL && sd->sd_Session != NULL )
 	{
-		libssh2_sftp_seek( sd->sd_FileHandle, pos );
+		SSH2Session *ss = sd->sd_Session;
+
+		pthread_mutex_lock( &ss->ss_Mutex );
+
+		// pending writes go to old position, buffered data is not valid after seek
+		SSH2FlushBuffer( sd );
+		sd->sd_BufferLen = 0;
+		sd->sd_BufferPos = 0;
+		sd->sd_EOF = FALSE;
+
+		libssh2_sftp_seek64( sd->sd_FileHandle, (libssh2_uint64_t)pos );
+
+		pthread_mutex_unlock( &ss->ss_Mutex );
 	}
-	DEBUG("Seek %d\n", result );
+	DEBUG("Seek %d\n", pos );
 	return pos;
 }
 
@@ -975,100 +1398,98 @@ int MakeDir( struct File *s, const char *path )
 {
 	INFO("MakeDir!\n");
 	int error = 0;
-	
+
 	int rspath = strlen( s->f_Path );
-	int spath = strlen( path )+1;
 	char *newPath;
-	
+
+	if( path == NULL )
+	{
+		return -1;
+	}
+	int spath = strlen( path )+1;
+
 	if( ( newPath = FCalloc( rspath+10, sizeof(char) ) ) == NULL )
 	{
 		FERROR("Cannot allocate memory for new path\n");
 		return -2;
 	}
 	SpecialData *sdat = (SpecialData *)s->f_SpecialData;
-	FHandler *fh = (FHandler *)s->f_FSys;
-	HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
-	
+	SSH2Session *ss = sdat->sd_Session;
+
 	strcpy( newPath, s->f_Path );
 	if( s->f_Path[ rspath-1 ] != '/' )
 	{
 		strcat( newPath, "/" );
 	}
-	
-	pthread_mutex_lock( &hd->hd_Mutex );
+
 	// Create a string that has the real file path of the file
-	if( path != NULL )
+	char *directory = FCalloc( rspath + spath + 10, sizeof( char ) );
+	if( directory != NULL )
 	{
-		char *directory = FCalloc( rspath + spath, sizeof( char ) );
-		if( directory != NULL )
+		pthread_mutex_lock( &ss->ss_Mutex );
+
+		// Make the directories that do not exist
+		int slashes = 0, i = 0; for( ; i < spath; i++ )
 		{
-			// Make the directories that do not exist
-			int slashes = 0, i = 0; for( ; i < spath; i++ )
+			if( path[i] == '/' )
 			{
-				if( path[i] == '/' )
-				{
-					slashes++;
-				}
+				slashes++;
 			}
-			
-			if( slashes > 0 )
+		}
+
+		if( slashes > 0 )
+		{
+			for( i = 0; i < spath; i++ )
 			{
-				int off = 0, slash = 0;
-				for( i = 0; i < spath; i++ )
+				if( path[i] == '/' )
 				{
-					if( path[i] == '/' )
+					sprintf( directory, "%s%.*s", newPath, i, path );
+
+					FERROR("PATH CREATED %s   NPATH %s   PATH %s\n", directory,  newPath, path );
+
+					int err =libssh2_sftp_mkdir( ss->ss_SFTP, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
+
+					// Create if not exist!
+					if( err != 0 )
 					{
-						sprintf( directory, "%s%.*s", newPath, i, path );
-						
-						FERROR("PATH CREATED %s   NPATH %s   PATH %s\n", directory,  newPath, path );
-						
-						int err =libssh2_sftp_mkdir( sdat->sftp_session, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
-						
-						// Create if not exist!
-						if( err != 0 )
-						{
-							FERROR( "Cannot create directory: %s\n", directory );
-							error = 1;
-						}
+						FERROR( "Cannot create directory: %s\n", directory );
+						error = 1;
 					}
-					slash++;
 				}
 			}
-			//
-			// We created directories to sign '/'
-			// Now we create directory for fullpath
-			
-			struct stat filest;
-			
-			sprintf( directory, "%s%s", newPath, path );
-			error =libssh2_sftp_mkdir( sdat->sftp_session, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
-
-			FFree( directory );
 		}
-		FFree( newPath );
-		return error;
+		//
+		// We created directories to sign '/'
+		// Now we create directory for fullpath
+
+		sprintf( directory, "%s%s", newPath, path );
+		error =libssh2_sftp_mkdir( ss->ss_SFTP, directory, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH );
+		SSH2StatCacheInvalidate( ss, directory );
+
+		pthread_mutex_unlock( &ss->ss_Mutex );
+
+		FFree( directory );
 	}
-	pthread_mutex_unlock( &hd->hd_Mutex );
 	FFree( newPath );
-	
-	return -1;
+
+	return error;
 }
 
 //
 // rm files/dirs
 //
 
-int RemoveDirectory( SpecialData *sdat, const char *path )
+int RemoveDirectory( SSH2Session *ss, const char *path )
 {
 	LIBSSH2_SFTP_HANDLE *sftphandle;
 	int r = 0;
-	
-	// Request a dir listing via SFTP 
-	sftphandle = libssh2_sftp_opendir( sdat->sftp_session, path );
+
+	// Request a dir listing via SFTP
+	sftphandle = libssh2_sftp_opendir( ss->ss_SFTP, path );
 	int pathlen = strlen( path );
-	
+
 	//DEBUG("DELETE: %s handle %p\n", path, sftphandle );
-	
+
 	if ( sftphandle != NULL )	// this is directory
 	{
 		do
@@ -1077,47 +1498,47 @@ int RemoveDirectory( SpecialData *sdat, const char *path )
 			char longentry[512];
 			LIBSSH2_SFTP_ATTRIBUTES attrs;
 			int r2 = 0;
-			
+
 			//DEBUG("Loop dir\n");
-		
+
 			// loop until we fail *
 			int rc = libssh2_sftp_readdir_ex( sftphandle, mem, sizeof(mem), longentry, sizeof(longentry), &attrs);
 			if( rc > 0 )//&&  > 0 && strcmp( mem, ".." ) > 0 )
 			{
 				if( strcmp( mem, ".") == 0 ){ continue; }
-			
+
 				if( strcmp( mem, "..") == 0 ){ continue; }
-				
+
 				//DEBUG("File: %s\n", longentry );
-			
+
 				int isDir = 0;
 				if( longentry[ 0 ] == 'd' )
 				{
 					isDir = 1;
 				}
-			
-				int len = pathlen + strlen( path ) + strlen( mem ); 
+
+				int len = pathlen + strlen( path ) + strlen( mem );
 				char *buf = FCalloc( len , sizeof(char) );
-			
+
 				if ( buf != NULL )
 				{
 					snprintf( buf, len, "%s/%s", path, mem );
 					//DEBUG("Buf '%s'  --> %d  memstrlen %d\n", buf, isDir, strlen(mem) );
-				
+
 					if ( isDir == 1 )
 					{
-						r2 = RemoveDirectory( sdat, buf );
-						libssh2_sftp_rmdir( sdat->sftp_session, buf );
+						r2 = RemoveDirectory( ss, buf );
+						libssh2_sftp_rmdir( ss->ss_SFTP, buf );
 						//DEBUG("Delete dir\n");
 					}
 					else
 					{
-						r2 = libssh2_sftp_unlink( sdat->sftp_session, buf );
+						r2 = libssh2_sftp_unlink( ss->ss_SFTP, buf );
 						//DEBUG("Delete file\n");
 					}
 					FFree(buf);
 				}
-			
+
 				if( r2 != 0 )
 				{
 					break;
@@ -1127,18 +1548,18 @@ int RemoveDirectory( SpecialData *sdat, const char *path )
 			{
 				break;
 			}
-		
+
 		} while (1);
-	
+
 		libssh2_sftp_closedir( sftphandle );
-		
-		libssh2_sftp_rmdir( sdat->sftp_session, path );
+
+		libssh2_sftp_rmdir( ss->ss_SFTP, path );
 	}
 	else
 	{
-		r = libssh2_sftp_unlink( sdat->sftp_session, path );
+		r = libssh2_sftp_unlink( ss->ss_SFTP, path );
 	}
-	
+
 	return r;
 }
 
@@ -1149,47 +1570,47 @@ int RemoveDirectory( SpecialData *sdat, const char *path )
 int Delete( struct File *s, const char *path )
 {
 	DEBUG("Delete!\n");
-	
+
 	//BufString *bs = BufStringNew();
 	int spath = strlen( path );
 	int rspath = strlen( s->f_Path );
-	
+
 	SpecialData *sdat = (SpecialData *)s->f_SpecialData;
-	
+
 	char *comm = NULL;
-	
+
 	DEBUG("Delete new path size %d\n", rspath + spath );
-	
+
 	if( ( comm = FCalloc( rspath + spath + 10, sizeof(char) ) ) != NULL )
 	{
 		strcpy( comm, s->f_Path );
-		
+
 		if( comm[ strlen( comm ) -1] != '/' )
 		{
 			strcat( comm, "/" );
 		}
 		strcat( comm, path );
-		
+
 		if( comm[ strlen( comm ) -1] == '/' )
 		{
 			comm[ strlen( comm ) -1] = 0;
 		}
-		
+
 		DEBUG("Delete file or directory '%s'\n", comm );
-		
-		FHandler *fh = (FHandler *)s->f_FSys;
-		HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
-		
-		pthread_mutex_lock( &hd->hd_Mutex );
-		int ret = RemoveDirectory( sdat, comm );
-		pthread_mutex_unlock( &hd->hd_Mutex );
-		
+
+		SSH2Session *ss = sdat->sd_Session;
+
+		pthread_mutex_lock( &ss->ss_Mutex );
+		int ret = RemoveDirectory( ss, comm );
+		SSH2StatCacheInvalidate( ss, comm );
+		pthread_mutex_unlock( &ss->ss_Mutex );
+
 		FFree( comm );
 		return ret;
 	}
-	
+
 	DEBUG("Delete END\n");
-	
+
 	return 0;
 }
 
@@ -1200,13 +1621,12 @@ int Delete( struct File *s, const char *path )
 int Rename( struct File *s, const char *path, const char *nname )
 {
 	DEBUG("Rename!  from %s to %s\n", path, nname );
-	char *newname = NULL;
 	int spath = strlen( path );
 	int rspath = strlen( s->f_Path );
-	
+
 	// 1a. is the source a folder? If so, remove trailing /
 	char *targetPath = NULL;
-	
+
 	if( path[spath-1] == '/' )
 	{
 		targetPath = FCalloc( spath, sizeof( char ) );
@@ -1214,10 +1634,10 @@ int Rename( struct File *s, const char *path, const char *nname )
 	}
 	else
 	{
-		targetPath = FCalloc( spath + 1, sizeof( char ) ); 
+		targetPath = FCalloc( spath + 1, sizeof( char ) );
 		sprintf( targetPath, "%.*s", spath, path );
 	}
-	
+
 	// 1b. Do we have a sub folder in path?
 	int hasSubFolder = 0;
 	int off = 0;
@@ -1230,13 +1650,12 @@ int Rename( struct File *s, const char *path, const char *nname )
 		}
 	}
 	SpecialData *sdat = (SpecialData *)s->f_SpecialData;
-	FHandler *fh = (FHandler *)s->f_FSys;
-	HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
-	
+	SSH2Session *ss = sdat->sd_Session;
+
 	// 2. Full path of source
 	char *source = FCalloc( rspath + spath + 1, sizeof( char ) );
 	sprintf( source, "%s%s", s->f_Path, targetPath );
-	
+
 	// 3. Ok if we have sub folder or not, add it to our destination
 	char *dest = NULL;
 	if( hasSubFolder > 0 )
@@ -1246,24 +1665,26 @@ int Rename( struct File *s, const char *path, const char *nname )
 		sprintf( dest + rspath, "%.*s", off, targetPath );
 		sprintf( dest + rspath + off, "%s", nname );
 	}
-	else 
+	else
 	{
 		dest = FCalloc( rspath + strlen( nname ) + 1, sizeof( char ) );
 		sprintf( dest, "%s", s->f_Path );
 		sprintf( dest + rspath, "%s", nname );
 	}
-	
-	pthread_mutex_lock( &hd->hd_Mutex );
+
+	pthread_mutex_lock( &ss->ss_Mutex );
 	// 4. Execute!
 	DEBUG( "executing: rename %s %s\n", source, dest );
-	int res = libssh2_sftp_rename( sdat->sftp_session, source, dest );// rename( source, dest );
-	pthread_mutex_unlock( &hd->hd_Mutex );
-	
+	int res = libssh2_sftp_rename( ss->ss_SFTP, source, dest );// rename( source, dest );
+	SSH2StatCacheInvalidate( ss, source );
+	SSH2StatCacheInvalidate( ss, dest );
+	pthread_mutex_unlock( &ss->ss_Mutex );
+
 	// 5. Free up
 	FFree( source );
 	FFree( dest );
 	FFree( targetPath );
-	
+
 	return res;
 }
 
@@ -1318,9 +1739,9 @@ char *GetFileName( const char *path )
 BufString *Info( File *s, const char *path )
 {
 	DEBUG("Info!\n");
-	
+
 	BufString *bs = BufStringNew();
-	
+
 	int spath = 0;
 	if( path != NULL )
 	{
@@ -1328,30 +1749,28 @@ BufString *Info( File *s, const char *path )
 	}
 	int rspath = strlen( s->f_Path );
 	SpecialData *sdat = (SpecialData *)s->f_SpecialData;
-	
-	if( sdat == NULL || sdat->sftp_session == NULL )
+
+	if( sdat == NULL || sdat->sd_Session == NULL )
 	{
 		BufStringAdd( bs, "fail<!--separate-->Could not open directory.");
-		
+
 		return bs;
 	}
-	
+
 	BufStringAdd( bs, "ok<!--separate-->");
-	
+
 	DEBUG("Info!\n");
-	
+
 	// user is trying to get access to not his directory
 	DEBUG("Check access for path '%s' in root path '%s'  name '%s'\n", path, s->f_Path, s->f_Name );
-	
-	int doub = strlen( s->f_Name );
-	
+
 	char *comm = NULL;
-	char *tempString = FCalloc( rspath +512, sizeof(char) );
-	
+	char *tempString = FCalloc( rspath + spath + 512, sizeof(char) );
+
 	if( ( comm = FCalloc( rspath + spath + 512, sizeof(char) ) ) != NULL )
 	{
 		strcpy( comm, s->f_Path );
-		
+
 		if( comm[ strlen( comm ) -1 ] != '/' )
 		{
 			strcat( comm, "/" );
@@ -1361,130 +1780,107 @@ BufString *Info( File *s, const char *path )
 		{
 			strcat( comm, path );
 		}
-		
-		FHandler *fh = (FHandler *)s->f_FSys;
-		HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
-		
-		DEBUG("info lock %p\n", &hd->hd_Mutex );
-		pthread_mutex_lock( &hd->hd_Mutex );
-		
+
+		SSH2Session *ss = sdat->sd_Session;
+		LIBSSH2_SFTP_ATTRIBUTES attrs;
+		int err = 0;
+
+		DEBUG("info lock %p\n", &ss->ss_Mutex );
+		pthread_mutex_lock( &ss->ss_Mutex );
+
 		DEBUG("PATH created %s\n", comm );
-		
-		LIBSSH2_SFTP_HANDLE *handle = libssh2_sftp_open( sdat->sftp_session, comm, LIBSSH2_FXF_READ, 0 );
-		if( handle != NULL )
+
+		// attributes are often known from last directory listing, otherwise one stat request is enough
+
+		if( SSH2StatCacheGet( ss, comm, &attrs ) == FALSE )
 		{
-			LIBSSH2_SFTP_ATTRIBUTES attrs;
-			
-			int err = libssh2_sftp_fstat( handle, &attrs);
-			if( err != 0 )
+			err = libssh2_sftp_stat( ss->ss_SFTP, comm, &attrs );
+			if( err == 0 )
 			{
-				BufStringAdd( bs, "{ \"Filename\":\"");
+				SSH2StatCachePut( ss, comm, &attrs );
+			}
+			else
+			{
+				SSH2SessionCheck( ss );
+			}
+		}
+
+		pthread_mutex_unlock( &ss->ss_Mutex );
+		DEBUG("intfo SFTP unlock %p\n", &ss->ss_Mutex );
+
+		if( err == 0 && path != NULL )
+		{
+			BufStringAdd( bs, "{ \"Filename\":\"");
 
-				char *fname = (char *)path;
-				int i;
-				for( i=spath ; i >= 0 ; i-- )
+			char *fname = (char *)path;
+			int i;
+			for( i=spath ; i >= 0 ; i-- )
+			{
+				if( path[ i ] == '/' )
 				{
-					if( path[ i ] == '/' )
-					{
-						fname = (char *)&path[ i+1 ];
-					}
+					fname = (char *)&path[ i+1 ];
 				}
-				BufStringAdd( bs, fname );
+			}
+			BufStringAdd( bs, fname );
+			BufStringAdd( bs, "\",");
+
+			int isDir = LIBSSH2_SFTP_S_ISDIR( attrs.permissions ) ? 1 : 0;
+
+			DEBUG("FSSH2: is dir %d\n", isDir );
+
+			BufStringAdd( bs, " \"Path\":\"");
+
+			int size = 0;
+			if( path[ 0 ] == '/' )
+			{
+				size = sprintf( tempString, "%s", &path[ 1 ] );
+			}
+			else
+			{
+				size = sprintf( tempString, "%s", path );
+			}
+			BufStringAddSize( bs, tempString, size );
+
+			if( isDir == 1 )
+			{
+				BufStringAdd( bs, "/\",");
+			}
+			else
+			{
 				BufStringAdd( bs, "\",");
-				
-				int isDir = LIBSSH2_SFTP_S_ISDIR( attrs.permissions ) ? 1 : 0;
-				
-				DEBUG("FSSH2: is dir %d\n", isDir );
-				
-				BufStringAdd( bs, " \"Path\":\"");
-				if( isDir == 1 )
-				{
-					//sprintf( tmp, "\"Path\":\"%s/\",", &path[ strlen( d->f_Path ) ] );
-					int size = 0;
-					if( path[ 0 ] == '/' )
-					{
-						size = sprintf( tempString, "%s", &path[ 1 ] );
-					}
-					else
-					{
-						size = sprintf( tempString, "%s", path );
-					}
-					BufStringAddSize( bs, tempString, size );
-					BufStringAdd( bs, "/\",");
-				}
-				else
-				{
-					int size = 0;
-					if( path[ 0 ] == '/' )
-					{
-						size = sprintf( tempString, "%s", &path[ 1 ] );
-					}
-					else
-					{
-						size = sprintf( tempString, "%s", path );
-					}
-					BufStringAddSize( bs, tempString, size );
-					BufStringAdd( bs, tempString );
-					BufStringAdd( bs, "\",");
-				}
-				
-				DEBUG("ISDIR %d\n", isDir );
-				
-				char tmp[ 256 ];
-				//BufStringAdd( bs, tmp );
-				sprintf( tmp, "\"Filesize\": %d,",(int) attrs.filesize );
-				BufStringAdd( bs, tmp );
-				
-				char *timeStr = FCalloc( 40, sizeof( char ) );
-				strftime( timeStr, 36, "%Y-%m-%d %H:%M:%S", localtime( (const time_t *)&(attrs.mtime) ) );
-				sprintf( tmp, "\"DateModified\": \"%s\",", timeStr );
-				BufStringAdd( bs, tmp );
-				FFree( timeStr );
-				//BufStringAdd( bs, "\"DateModified\": \"\"," );
-				
-				if( isDir )
-				{
-					BufStringAdd( bs,  "\"MetaType\":\"Directory\",\"Type\":\"Directory\" }" );
-				}
-				else
-				{
-					BufStringAdd( bs, "\"MetaType\":\"File\",\"Type\":\"File\" }" );
-				}
 			}
-			
-			libssh2_sftp_close_handle( handle );
-		}
-		
-		pthread_mutex_unlock( &hd->hd_Mutex );
-		DEBUG("intfo SFTP unlock %p\n", &hd->hd_Mutex );
 
-		/*
-		struct stat ls;
-		
-		if( stat( comm, &ls ) == 0 )
-		{
-			DEBUG("LOCAL file stat %s\n", comm );
-			FillStat( bs, &ls, s, comm );
-		}
-		else
-		{
-			DEBUG("LOCAL file stat FAIL %s\n", comm );
-			BufStringAdd( bs, "{ \"response\": \"File or directory do not exist\"}" );
+			DEBUG("ISDIR %d\n", isDir );
+
+			char tmp[ 256 ];
+			//BufStringAdd( bs, tmp );
+			sprintf( tmp, "\"Filesize\": %d,",(int) attrs.filesize );
+			BufStringAdd( bs, tmp );
+
+			char *timeStr = FCalloc( 40, sizeof( char ) );
+			time_t mtime = (time_t)attrs.mtime;
+			strftime( timeStr, 36, "%Y-%m-%d %H:%M:%S", localtime( &mtime ) );
+			sprintf( tmp, "\"DateModified\": \"%s\",", timeStr );
+			BufStringAdd( bs, tmp );
+			FFree( timeStr );
+			//BufStringAdd( bs, "\"DateModified\": \"\"," );
+
+			if( isDir )
+			{
+				BufStringAdd( bs,  "\"MetaType\":\"Directory\",\"Type\":\"Directory\" }" );
+			}
+			else
+			{
+				BufStringAdd( bs, "\"MetaType\":\"File\",\"Type\":\"File\" }" );
+			}
 		}
-		*/
-		
+
 		FFree( comm );
 	}
 	FFree( tempString );
-	
+
 	DEBUG("Info END\n");
-	
-	/*
-	LIBSSH2_API int libssh2_sftp_fstat_ex(LIBSSH2_SFTP_HANDLE *handle,
-										  LIBSSH2_SFTP_ATTRIBUTES *attrs,
-									   int setstat);
-	*/
-	
+
 	return bs;
 }
 
@@ -1543,19 +1939,28 @@ BufString *Dir( File *s, const char *path )
 		LIBSSH2_SFTP_HANDLE *sftphandle;
 		
 		SpecialData *sd = (SpecialData *)s->f_SpecialData;
-		FHandler *fh = (FHandler *)s->f_FSys;
-		HandlerData *hd = (HandlerData *)fh->fh_SpecialData;
 		
-		DEBUG("locking %p\n", &hd->hd_Mutex );
+		if( sd == NULL || sd->sd_Session == NULL )
+		{
+			BufStringAdd( bs, "fail<!--separate-->Could not open directory.");
+			
+			FFree( comm );
+			FFree( tempString );
+			return bs;
+		}
+		
+		SSH2Session *ss = sd->sd_Session;
+		int commlen = strlen( comm );
 		
-		pthread_mutex_lock( &hd->hd_Mutex );
+		DEBUG("locking %p\n", &ss->ss_Mutex );
 		
-		DEBUG("lock passed %p %p\n", sd, sd->sftp_session );
+		pthread_mutex_lock( &ss->ss_Mutex );
+		
+		DEBUG("lock passed %p %p\n", sd, ss->ss_SFTP );
 		
-		if( sd != NULL && sd->sftp_session != NULL )
 		{
-			// Request a dir listing via SFTP 
-			sftphandle = libssh2_sftp_opendir( sd->sftp_session, comm );
+			// Request a dir listing via SFTP, server returns entries with their attributes in batches
+			sftphandle = libssh2_sftp_opendir( ss->ss_SFTP, comm );
 			DEBUG("Dir opened\n");
 			
 			if ( sftphandle == NULL)
@@ -1563,21 +1968,17 @@ BufString *Dir( File *s, const char *path )
 				FERROR( "Unable to open dir with SFTP: %s\n", comm );
 				BufStringAdd( bs, "fail<!--separate-->Could not open directory.");
 				
-				pthread_mutex_unlock( &hd->hd_Mutex );
+				SSH2SessionCheck( ss );
+				pthread_mutex_unlock( &ss->ss_Mutex );
+				FFree( comm );
+				FFree( tempString );
 				return bs;
 			}
 			else
 			{
 				
 			}
-			FERROR( "libssh2_sftp_opendir() is done, now receive listing!\n");
-		}
-		else
-		{
-			BufStringAdd( bs, "fail<!--separate-->Could not open directory.");
-			
-			pthread_mutex_unlock( &hd->hd_Mutex );
-			return bs;
+			DEBUG( "libssh2_sftp_opendir() is done, now receive listing!\n");
 		}
 		int pos = 0;
 		
@@ -1608,6 +2009,14 @@ BufString *Dir( File *s, const char *path )
 					continue;
 				}
 				
+				// remember attributes, Info calls which follow listing will not ask server again
+				if( ( attrs.flags & LIBSSH2_SFTP_ATTR_PERMISSIONS ) && ( commlen + (int)strlen( mem ) ) < ( rspath + 512 ) )
+				{
+					strcpy( tempString, comm );
+					strcat( tempString, mem );
+					SSH2StatCachePut( ss, tempString, &attrs );
+				}
+				
 				if( pos == 0 )
 				{
 					BufStringAdd( bs, "{ \"Filename\":\"");
@@ -1662,7 +2071,8 @@ BufString *Dir( File *s, const char *path )
 				BufStringAdd( bs, tmp );
 				
 				char *timeStr = FCalloc( 40, sizeof( char ) );
-				strftime( timeStr, 36, "%Y-%m-%d %H:%M:%S", localtime( (const time_t *)&(attrs.mtime) ) );
+				time_t mtime = (time_t)attrs.mtime;
+				strftime( timeStr, 36, "%Y-%m-%d %H:%M:%S", localtime( &mtime ) );
 				sprintf( tmp, "\"DateModified\": \"%s\",", timeStr );
 				BufStringAdd( bs, tmp );
 				FFree( timeStr );
@@ -1713,7 +2123,7 @@ BufString *Dir( File *s, const char *path )
 		} while (1);
 		
 		libssh2_sftp_closedir( sftphandle );
-		pthread_mutex_unlock( &hd->hd_Mutex );
+		pthread_mutex_unlock( &ss->ss_Mutex );
 		
 		BufStringAdd( bs, "]" );
 		
@@ -217,14 +217,16 @@ int CheckAndMountWorkgroupDrive( SystemBase *l, char *type, User *usr, FUQUAD id
 	if( type && strcmp( type, "SQLWorkgroupDrive" ) == 0 )
 	{
 		//DEBUG( "[MountFS] -- Refreshing all user drives for others than %s..\n", usr->u_Name );
-		User *tmpUser = l->sl_UM->um_Users;
-		while( tmpUser != NULL )
+		unsigned int usersNr = 0, ui;
+		User **users = UMGetUsersRef( l->sl_UM, &usersNr );
+		for( ui = 0 ; ui < usersNr ; ui++ )
 		{
+			User *tmpUser = users[ ui ];
+			
 			// Skip current user
 			if( tmpUser->u_ID == usr->u_ID )
 			{
 				//DEBUG( "[MountFS] -- Skipping owner of drive %d (%s).\n", usr->u_ID, usr->u_Name );
-				tmpUser = (User *)tmpUser->node.mln_Succ;
 				continue;
 			}
 			
@@ -278,14 +280,15 @@ int CheckAndMountWorkgroupDrive( SystemBase *l, char *type, User *usr, FUQUAD id
 				if( pthread_mutex_lock( &l->sl_InternalMutex ) != 0 )
 				{
 					DEBUG("Go to error\n");
+					UMReleaseUsers( l->sl_UM, users, usersNr );
 					goto merror;
 				}
 				DEBUG("lock set\n");
 				// Tell user!
 				UserNotifyFSEvent2( l, tmpUser, "refresh", "Mountlist:" );
 			}
-			tmpUser = (User *)tmpUser->node.mln_Succ;
 		}
+		UMReleaseUsers( l->sl_UM, users, usersNr );
 	}
 }
 */
@@ -713,11 +716,15 @@ int MountFS( SystemBase *l, struct TagItem *tl, File **mfile, User *usr )
 				retFile->f_Visible = visible ? 1 : 0;
 				retFile->f_Execute = StringDuplicate( execute );
 				retFile->f_FSysName = StringDuplicate( type );
+				retFile->f_LastAccess = time( NULL );
 				
 				//DEBUG("\n\n\n\n\n  ----%s  type %s\n\n\n", retFile->f_FSysName, type  );
 		 
 				if( usr != NULL )
 				{
+					// door is mounted now, descriptor is not needed anymore
+					UserDeviceDescriptorDelete( UserRemDeviceDescriptor( usr, NULL, id ) );
+					
 					File *lfile = usr->u_MountedDevs;
 					
 					// Macro way - less understandable! (for me) m0ns00n
@@ -760,14 +767,17 @@ int MountFS( SystemBase *l, struct TagItem *tl, File **mfile, User *usr )
 				if( type && strcmp( type, "SQLWorkgroupDrive" ) == 0 )
 				{
 					//DEBUG( "[MountFS] -- Refreshing all user drives for others than %s..\n", usr->u_Name );
-					User *tmpUser = l->sl_UM->um_Users;
-					while( tmpUser != NULL )
+					// users are referenced, so they can be used when sl_InternalMutex is unlocked
+					unsigned int usersNr = 0, ui;
+					User **users = UMGetUsersRef( l->sl_UM, &usersNr );
+					for( ui = 0 ; ui < usersNr ; ui++ )
 					{
+						User *tmpUser = users[ ui ];
+						
 						// Skip current user
 						if( tmpUser->u_ID == usr->u_ID )
 						{
 							//DEBUG( "[MountFS] -- Skipping owner of drive %d (%s).\n", usr->u_ID, usr->u_Name );
-							tmpUser = (User *)tmpUser->node.mln_Succ;
 							continue;
 						}
 						
@@ -821,14 +831,15 @@ int MountFS( SystemBase *l, struct TagItem *tl, File **mfile, User *usr )
 							if( pthread_mutex_lock( &l->sl_InternalMutex ) != 0 )
 							{
 								DEBUG("Go to error\n");
+								UMReleaseUsers( l->sl_UM, users, usersNr );
 								goto merror;
 							}
 							DEBUG("lock set\n");
 							// Tell user!
 							UserNotifyFSEvent2( l, tmpUser, "refresh", "Mountlist:" );
 						}
-						tmpUser = (User *)tmpUser->node.mln_Succ;
 					}
+					UMReleaseUsers( l->sl_UM, users, usersNr );
 				}
 		
 				INFO( "[MountFS] %s - Device '%s' mounted successfully\n", usr->u_Name, name );
@@ -1259,11 +1270,15 @@ int UnMountFS( struct SystemBase *l, struct TagItem *tl, UserSession *usrs )
 				if( unmID > 0 && unmType != NULL && strcmp( unmType, "SQLWorkgroupDrive" ) == 0 )
 				{
 					DEBUG( "[UnMountFS] Refreshing all user drives for unmount.\n" );
-					User *tmpUser = l->sl_UM->um_Users;
-					while( tmpUser != NULL )
+					unsigned int usersNr = 0, ui;
+					User **users = UMGetUsersRef( l->sl_UM, &usersNr );
+					for( ui = 0 ; ui < usersNr ; ui++ )
 					{
+						User *tmpUser = users[ ui ];
 						if( tmpUser->u_ID != usr->u_ID )
 						{
+							UserDeviceDescriptorDelete( UserRemDeviceDescriptor( tmpUser, name, 0 ) );
+							
 							// Add also to this user
 							File *search = tmpUser->u_MountedDevs;
 							File *prev = NULL;
@@ -1334,8 +1349,8 @@ int UnMountFS( struct SystemBase *l, struct TagItem *tl, UserSession *usrs )
 								search = (File *) search->node.mln_Succ;
 							}
 						}
-						tmpUser = (User *)tmpUser->node.mln_Succ;
 					}
+					UMReleaseUsers( l->sl_UM, users, usersNr );
 				}
 				if( unmType ) FFree( unmType );
 		
@@ -1349,8 +1364,29 @@ int UnMountFS( struct SystemBase *l, struct TagItem *tl, UserSession *usrs )
 		}
 		else
 		{
-			pthread_mutex_unlock( &l->sl_InternalMutex );
-			return FSys_Error_DeviceNotFound;
+			// door could be registered but not mounted yet
+			UserDeviceDescriptor *udd = UserRemDeviceDescriptor( usr, name, 0 );
+			if( udd != NULL )
+			{
+				DEBUG("[UnMountFS] Door %s was not mounted yet, descriptor removed\n", name );
+				UserDeviceDescriptorDelete( udd );
+				UserNotifyFSEvent2( l, usr, "refresh", "Mountlist:" );
+			}
+			else
+			{
+				// descriptor which is being mounted is not removed
+				udd = usr->u_DeviceDescriptors;
+				while( udd != NULL )
+				{
+					if( udd->udd_Name != NULL && strcmp( udd->udd_Name, name ) == 0 )
+					{
+						break;
+					}
+					udd = (UserDeviceDescriptor *)udd->node.mln_Succ;
+				}
+				pthread_mutex_unlock( &l->sl_InternalMutex );
+				return udd != NULL ? FSys_Error_OpsInProgress : FSys_Error_DeviceNotFound;
+			}
 		}
 	
 		DEBUG("[UnMountFS] UnMount device END\n");
@@ -1412,6 +1448,16 @@ File *GetFileByPath( User *usr, char **dstpath, const char *path )
 	
 		ldr = (File *) ldr->node.mln_Succ;
 	}
+	
+	if( fhand == NULL )
+	{
+		fhand = UserDeviceMountOnDemand( SLIB, usr, ddrivename );
+	}
+	
+	if( fhand != NULL )
+	{
+		fhand->f_LastAccess = time( NULL );
+	}
 	return fhand;
 }
 
@@ -1614,7 +1660,7 @@ File *GetUserDeviceByUserID( SystemBase *l, MYSQLLibrary *sqllib, FULONG uid, co
 
 		// We need to get the sessionId if we can!
 		
-		User *tuser = UMGetUserByID( l->sl_UM, uid );
+		User *tuser = UMGetUserByIDRef( l->sl_UM, uid );
 		
 		// Done fetching sessionid =)
 		
@@ -1653,6 +1699,7 @@ File *GetUserDeviceByUserID( SystemBase *l, MYSQLLibrary *sqllib, FULONG uid, co
 			{
 				//FERROR( "Cannot set device mounted state. Device = NULL (%s).\n", row[0] );
 			}
+			UMReleaseUser( l->sl_UM, tuser );
 		}
 		else
 		{
@@ -2207,3 +2254,253 @@ int RefreshUserDrives( SystemBase *l, User *u, BufString *bs )
 		
 	return 0;
 }
+
+/**
+ * Check if door should be mounted on first access instead of at login
+ *
+ * @param l pointer to SystemBase
+ * @param type door type (DOSDriver name)
+ * @param config door configuration (JSON)
+ * @return TRUE when door should be mounted on demand, otherwise FALSE
+ */
+FBOOL DeviceMountOnDemand( SystemBase *l, const char *type, const char *config )
+{
+	if( l->sl_MountOnDemand == FALSE || type == NULL )
+	{
+		return FALSE;
+	}
+	
+	// door can force old behaviour by "EagerMount":true in its config
+	if( config != NULL )
+	{
+		char *eager = strstr( config, "\"EagerMount\"" );
+		if( eager != NULL )
+		{
+			eager += 12;
+			while( *eager == ' ' || *eager == ':' || *eager == '"' )
+			{
+				eager++;
+			}
+			if( strncmp( eager, "true", 4 ) == 0 || *eager == '1' )
+			{
+				return FALSE;
+			}
+		}
+	}
+	
+	DOSDriver *ddrive = (DOSDriver *)l->sl_DOSDrivers;
+	while( ddrive != NULL )
+	{
+		if( strcmp( type, ddrive->dd_Name ) == 0 )
+		{
+			return ddrive->dd_MountOnDemand;
+		}
+		ddrive = (DOSDriver *)ddrive->node.mln_Succ;
+	}
+	return FALSE;
+}
+
+/**
+ * Mount door which was registered at login but not mounted yet
+ *
+ * @param l pointer to SystemBase
+ * @param usr pointer to User to which door belong
+ * @param name name of door
+ * @return pointer to mounted door or NULL when door is not avaiable
+ */
+File *UserDeviceMountOnDemand( SystemBase *l, User *usr, const char *name )
+{
+	if( l == NULL || usr == NULL || name == NULL || usr->u_DeviceDescriptors == NULL )
+	{
+		return NULL;
+	}
+	
+	UserDeviceDescriptor *udd = NULL;
+	int wait = 0;
+	
+	while( TRUE )
+	{
+		if( pthread_mutex_lock( &l->sl_InternalMutex ) != 0 )
+		{
+			return NULL;
+		}
+		
+		// other thread could mount door in meantime
+		File *dev = usr->u_MountedDevs;
+		while( dev != NULL )
+		{
+			if( dev->f_Name != NULL && strcmp( dev->f_Name, name ) == 0 )
+			{
+				pthread_mutex_unlock( &l->sl_InternalMutex );
+				return dev;
+			}
+			dev = (File *)dev->node.mln_Succ;
+		}
+		
+		udd = usr->u_DeviceDescriptors;
+		while( udd != NULL )
+		{
+			if( udd->udd_Name != NULL && strcmp( udd->udd_Name, name ) == 0 )
+			{
+				break;
+			}
+			udd = (UserDeviceDescriptor *)udd->node.mln_Succ;
+		}
+		
+		if( udd == NULL || ( udd->udd_MountFailed > 0 && ( time( NULL ) - udd->udd_MountFailed ) < DEVICE_MOUNT_RETRY_TIME ) )
+		{
+			pthread_mutex_unlock( &l->sl_InternalMutex );
+			return NULL;
+		}
+		
+		if( udd->udd_Mounting == FALSE )
+		{
+			udd->udd_Mounting = TRUE;
+			break;
+		}
+		
+		// other request is mounting this door, wait for it
+		pthread_mutex_unlock( &l->sl_InternalMutex );
+		if( wait++ >= DEVICE_MOUNT_WAIT_LOOPS )
+		{
+			FERROR("[UserDeviceMountOnDemand] Timeout while waiting for door %s\n", name );
+			return NULL;
+		}
+		usleep( 100000 );
+	}
+	
+	FULONG id = udd->udd_ID;
+	int mount = udd->udd_Mount;
+	char *path = StringDuplicate( udd->udd_Path );
+	char *type = StringDuplicate( udd->udd_Type );
+	char *dname = StringDuplicate( udd->udd_Name );
+	
+	pthread_mutex_unlock( &l->sl_InternalMutex );
+	
+	Log( FLOG_INFO, "[UserDeviceMountOnDemand] Mounting door %s for user %s\n", name, usr->u_Name );
+	
+	struct TagItem tags[] = {
+		{ FSys_Mount_Path,    (FULONG)path },
+		{ FSys_Mount_Server,  (FULONG)NULL },
+		{ FSys_Mount_Port,    (FULONG)NULL },
+		{ FSys_Mount_Type,    (FULONG)type },
+		{ FSys_Mount_Name,    (FULONG)dname },
+		{ FSys_Mount_UserName, (FULONG)usr->u_Name },
+		{ FSys_Mount_Owner,   (FULONG)NULL },
+		{ FSys_Mount_ID,      (FULONG)id },
+		{ FSys_Mount_Mount,   (FULONG)mount },
+		{ FSys_Mount_SysBase, (FULONG)l },
+		{ FSys_Mount_Visible, (FULONG)1 },
+		{TAG_DONE, TAG_DONE}
+	};
+	
+	File *device = NULL;
+	int err = MountFS( l, (struct TagItem *)&tags, &device, usr );
+	
+	if( path != NULL ) FFree( path );
+	if( type != NULL ) FFree( type );
+	if( dname != NULL ) FFree( dname );
+	
+	if( pthread_mutex_lock( &l->sl_InternalMutex ) == 0 )
+	{
+		if( ( err != 0 && err != FSys_Error_DeviceAlreadyMounted ) || device == NULL )
+		{
+			// network door could be not avaiable for a moment, keep descriptor and try again later
+			Log( FLOG_ERROR, "[UserDeviceMountOnDemand] Cannot mount door %s for user %s, error %d\n", name, usr->u_Name, err );
+			udd->udd_Mounting = FALSE;
+			udd->udd_MountFailed = time( NULL );
+			device = NULL;
+		}
+		else
+		{
+			udd->udd_Mounting = FALSE;
+			UserDeviceDescriptorDelete( UserRemDeviceDescriptor( usr, NULL, id ) );
+			
+			device->f_Mounted = TRUE;
+			device->f_MountOnDemand = TRUE;
+			device->f_LastAccess = time( NULL );
+		}
+		pthread_mutex_unlock( &l->sl_InternalMutex );
+	}
+	
+	return device;
+}
+
+/**
+ * Unmount doors which were mounted on demand and are not used
+ *
+ * @param lsb pointer to SystemBase
+ * @return 0 when success, otherwise error number
+ */
+int UserDeviceUnmountIdle( void *lsb )
+{
+	SystemBase *l = (SystemBase *)lsb;
+	if( l == NULL || l->sl_UM == NULL )
+	{
+		return -1;
+	}
+	
+	time_t now = time( NULL );
+	int unmounted = 0;
+	
+	unsigned int usersNr = 0, ui;
+	User **users = UMGetUsersRef( l->sl_UM, &usersNr );
+	
+	if( pthread_mutex_lock( &l->sl_InternalMutex ) == 0 )
+	{
+		for( ui = 0 ; ui < usersNr ; ui++ )
+		{
+			User *usr = users[ ui ];
+			File *dev = usr->u_MountedDevs;
+			while( dev != NULL )
+			{
+				File *remdev = dev;
+				dev = (File *)dev->node.mln_Succ;
+				
+				if( remdev->f_MountOnDemand == FALSE || remdev->f_Operations > 0 || ( now - remdev->f_LastAccess ) < DEVICE_IDLE_TIMEOUT )
+				{
+					continue;
+				}
+				
+				int error = 0;
+				if( UserRemDeviceByName( usr, remdev->f_Name, &error ) != remdev || error != 0 )
+				{
+					continue;
+				}
+				
+				// door goes back to descriptor, so it will be mounted again when needed
+				UserDeviceDescriptor *udd = UserDeviceDescriptorNew( remdev->f_ID, remdev->f_Name, remdev->f_FSysName, remdev->f_Path, remdev->f_Config, remdev->f_Execute, remdev->f_Mounted );
+				if( udd != NULL )
+				{
+					udd->node.mln_Succ = (MinNode *)usr->u_DeviceDescriptors;
+					usr->u_DeviceDescriptors = udd;
+				}
+				
+				DEBUG("[UserDeviceUnmountIdle] Unmount idle door %s user %s\n", remdev->f_Name, usr->u_Name );
+				
+				FHandler *fsys = (FHandler *)remdev->f_FSys;
+				if( fsys != NULL )
+				{
+					fsys->UnMount( fsys, remdev, usr );
+				}
+				
+				if( remdev->f_SessionID ) FFree( remdev->f_SessionID );
+				if( remdev->f_Config ) FFree( remdev->f_Config );
+				if( remdev->f_FSysName ) FFree( remdev->f_FSysName );
+				if( remdev->f_Execute ) FFree( remdev->f_Execute );
+				FFree( remdev );
+				
+				unmounted++;
+			}
+		}
+		pthread_mutex_unlock( &l->sl_InternalMutex );
+	}
+	UMReleaseUsers( l->sl_UM, users, usersNr );
+	
+	if( unmounted > 0 )
+	{
+		INFO("[UserDeviceUnmountIdle] Idle doors unmounted: %d\n", unmounted );
+	}
+	
+	return 0;
+}
@@ -109,6 +109,29 @@ int CheckAndMountWorkgroupDrive( SystemBase *l, char *type, User *usr, FUQUAD id
 
 int RefreshUserDrives( SystemBase *l, User *u, BufString *bs );
 
+//
+// doors mounted on first access
+//
+
+#define DEVICE_IDLE_TIMEOUT			600		// seconds after which unused door is unmounted
+#define DEVICE_IDLE_CHECK_INTERVAL	60
+#define DEVICE_MOUNT_RETRY_TIME		30		// seconds between attempts to mount door which failed
+#define DEVICE_MOUNT_WAIT_LOOPS		300		// 100ms each, when other thread is mounting door
+
+FBOOL DeviceMountOnDemand( SystemBase *l, const char *type, const char *config );
+
+//
+//
+//
+
+File *UserDeviceMountOnDemand( SystemBase *l, User *usr, const char *name );
+
+//
+//
+//
+
+int UserDeviceUnmountIdle( void *lsb );
+
 //
 // find comma and return position
 //
@@ -171,6 +194,7 @@ inline File *GetRootDeviceByName( User *usr, char *devname )
 			{
 				actDev = lDev->f_SharedFile;
 			}
+			lDev->f_LastAccess = time( NULL );
 			INFO("Found file name '%s' path '%s' (%s)\n", actDev->f_Name, actDev->f_Path, actDev->f_FSysName );
 			break;
 		}
@@ -178,6 +202,11 @@ inline File *GetRootDeviceByName( User *usr, char *devname )
 		lDev = (File *)lDev->node.mln_Succ;
 	}
 	
+	if( actDev == NULL && ( lDev = UserDeviceMountOnDemand( SLIB, usr, devname ) ) != NULL )
+	{
+		actDev = lDev->f_SharedFile != NULL ? lDev->f_SharedFile : lDev;
+	}
+	
 	if( actDev == NULL )
 	{
 		FERROR( "Cannot find mounted device by name: %s\n", devname );
@@ -889,15 +889,7 @@ Http *DeviceMWebRequest( void *m, char **urlpath, Http* request, UserSession *lo
 			// first we must find user
 			//  to which user we will share our device
 			
-			User *user = NULL;
-			
-			LIST_FOR_EACH( l->sl_UM->um_Users, user, User * )
-			{
-				if( strcmp( username, user->u_Name ) == 0 )
-				{
-					break;
-				}
-			}
+			User *user = UMGetUserByNameRef( l->sl_UM, username );
 			
 			if( user == NULL )
 			{
@@ -905,9 +897,17 @@ Http *DeviceMWebRequest( void *m, char **urlpath, Http* request, UserSession *lo
 				user = UMUserGetByNameDB( l->sl_UM, username );
 				if( user != NULL )
 				{
-					LIST_ADD_HEAD( l->sl_UM->um_Users, user );
+					UMAddUser( l->sl_UM, user );
+					// other thread could add same user in meantime, the one from list is used
+					User *luser = UMGetUserByNameRef( l->sl_UM, username );
+					if( luser != user )
+					{
+						UserDelete( user );
+					}
+					user = luser;
 				}
-				else
+				
+				if( user == NULL )
 				{
 					FERROR("Cannot find user with name %s in database\n", username );
 					HttpAddTextContent( response, "ok<!--separate-->{ \"response\": \"User account do not exists\"}" );
@@ -981,6 +981,11 @@ Http *DeviceMWebRequest( void *m, char **urlpath, Http* request, UserSession *lo
 				//return response;
 			}
 			
+			if( user != NULL )
+			{
+				UMReleaseUser( l->sl_UM, user );
+			}
+			
 			//char tmp[ 100 ];
 			//char temptext[ 512 ];
 			//sprintf( tmp, "ok<!--separate-->Mouting error: %d (already mounted)\n", l->GetError( l ) );
@@ -1029,6 +1034,8 @@ Http *DeviceMWebRequest( void *m, char **urlpath, Http* request, UserSession *lo
 			if( curusr != NULL )
 			{
 				File *dev = curusr->u_MountedDevs;
+				UserDeviceDescriptor *udd = curusr->u_DeviceDescriptors;
+				File descdev;
 				BufString *bs = BufStringNew();
 				BufStringAdd( bs, "ok<!--separate-->[" );
 				int devnr = 0;
@@ -1036,8 +1043,34 @@ Http *DeviceMWebRequest( void *m, char **urlpath, Http* request, UserSession *lo
 				char *executeCmd = NULL;
 				char *configEscaped = NULL;
 				
-				while( dev != NULL )
+				while( dev != NULL || udd != NULL )
 				{
+					// doors which will be mounted on first access are listed like mounted ones
+					if( dev == NULL )
+					{
+						memset( &descdev, 0, sizeof( File ) );
+						descdev.f_ID = udd->udd_ID;
+						descdev.f_Name = udd->udd_Name;
+						descdev.f_Path = udd->udd_Path;
+						descdev.f_Config = udd->udd_Config;
+						descdev.f_Execute = udd->udd_Execute;
+						descdev.f_FSysName = udd->udd_Type != NULL ? udd->udd_Type : "";
+						
+						DOSDriver *ddrive = (DOSDriver *)l->sl_DOSDrivers;
+						while( ddrive != NULL )
+						{
+							if( udd->udd_Type != NULL && strcmp( udd->udd_Type, ddrive->dd_Name ) == 0 )
+							{
+								descdev.f_FSys = ddrive->dd_Handler;
+								break;
+							}
+							ddrive = (DOSDriver *)ddrive->node.mln_Succ;
+						}
+						
+						udd = (UserDeviceDescriptor *)udd->node.mln_Succ;
+						dev = &descdev;
+					}
+					
 					FHandler *sys = (FHandler *)dev->f_FSys;
 					
 					// Escape config
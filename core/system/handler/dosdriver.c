@@ -99,6 +99,10 @@ DOSDriver *DOSDriverCreate( SystemBase *sl, const char *path, char *name )
 				
 				ddrive->dd_Type = StringDuplicateN( type, strlen( type ) );
 				
+				// local disks are cheap to mount, everything else is mounted when user touch it
+				char *mount = plib->ReadString( prop, "DOSDriver:mount", strcmp( handler, "local" ) == 0 ? "login" : "ondemand" );
+				ddrive->dd_MountOnDemand = ( mount != NULL && strcmp( mount, "ondemand" ) == 0 ) ? TRUE : FALSE;
+				
 				DEBUG("DDriver check fs\n");
 				
 				FHandler *efsys = sl->sl_Filesystems;
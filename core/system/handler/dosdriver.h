@@ -34,6 +34,7 @@ typedef struct DOSDriver{
 	FHandler						*dd_Handler;
 	char								*dd_Name;
 	char								*dd_Type;
+	FBOOL							dd_MountOnDemand;	// doors are mounted on first access, not at login
 }DOSDriver;
 
 //int RescanDOSDrivers( void *l );
@@ -32,6 +32,8 @@
 #include <system/user/user_session.h>
 #include <system/handler/device_handling.h>
 #include <system/json/jsmn.h>
+#include <system/json/json_converter.h>
+#include <z/zlibrary.h>
 
 /**
  * Create new File
@@ -966,3 +968,314 @@ int FileDownloadFilesOrFolder( Http *request, void *us, const char *dst, char *s
 	return 0;
 }
 
+
+/**
+ * Get file properties from JSON object returned by Info or Dir
+ *
+ * @param buffer JSON string
+ * @param tokens JSON tokens
+ * @param entr number of tokens
+ * @param obj index of object token
+ * @param name pointer where file name will be stored (pointer to buffer, not terminated)
+ * @param nameSize pointer where length of file name will be stored
+ * @param isDir pointer where directory flag will be stored
+ * @param size pointer where file size will be stored
+ * @param mtime pointer where modification time will be stored
+ * @return index of first token after object
+ */
+
+static unsigned int FileZipStreamParseObject( char *buffer, jsmntok_t *tokens, unsigned int entr, unsigned int obj, char **name, int *nameSize, FBOOL *isDir, FQUAD *size, time_t *mtime )
+{
+	unsigned int j = obj + 1;
+	
+	*name = NULL;
+	*nameSize = 0;
+	*isDir = FALSE;
+	*size = -1;
+	*mtime = time( NULL );
+	
+	while( j + 1 < entr && tokens[ j ].start < tokens[ obj ].end )
+	{
+		jsmntok_t *key = &tokens[ j ];
+		jsmntok_t *val = &tokens[ j+1 ];
+		char *vstr = buffer + val->start;
+		int vlen = val->end - val->start;
+		
+		if( jsoneq( buffer, key, "Filename" ) == 0 )
+		{
+			*name = vstr;
+			*nameSize = vlen;
+		}
+		else if( jsoneq( buffer, key, "Type" ) == 0 )
+		{
+			*isDir = ( vlen == 9 && strncmp( "Directory", vstr, 9 ) == 0 );
+		}
+		else if( jsoneq( buffer, key, "Filesize" ) == 0 )
+		{
+			*size = strtoll( vstr, NULL, 10 );
+		}
+		else if( jsoneq( buffer, key, "DateModified" ) == 0 && vlen > 0 && vlen < 32 )
+		{
+			char date[ 32 ];
+			struct tm tm;
+			
+			memset( &tm, 0, sizeof( tm ) );
+			strncpy( date, vstr, vlen );
+			date[ vlen ] = 0;
+			if( strptime( date, "%Y-%m-%d %H:%M:%S", &tm ) != NULL )
+			{
+				tm.tm_isdst = -1;
+				*mtime = mktime( &tm );
+			}
+		}
+		
+		// skip value, it could be array or object
+		unsigned int k = j + 2;
+		while( k < entr && tokens[ k ].start < val->end )
+		{
+			k++;
+		}
+		j = k;
+	}
+	
+	// sizes above 2GB can be reported as negative numbers, they will be treated as unknown
+	if( *size < 0 )
+	{
+		*size = -1;
+	}
+	
+	return j;
+}
+
+/**
+ * Function which scans Friend folder and adds it to streamed zip archive
+ *
+ * @param zlib pointer to ZLibrary
+ * @param zs pointer to ZipStream
+ * @param srcdev pointer to source Friend root File
+ * @param src path to directory on device (must end with '/' or be empty)
+ * @param name directory name inside archive (must end with '/' or be empty)
+ * @param numberFiles pointer to counter of added files
+ * @return 0 when success, otherwise error number
+ */
+
+static int FileZipStreamDirectoryRec( ZLibrary *zlib, ZipStream *zs, File *srcdev, const char *src, const char *name, int *numberFiles )
+{
+	FHandler *fsys = srcdev->f_FSys;
+	int error = 0;
+	
+	BufString *bsdir = fsys->Dir( srcdev, src );
+	if( bsdir == NULL )
+	{
+		return 1;
+	}
+	
+	if( bsdir->bs_Size > 17 && strncmp( "ok<!--separate-->", bsdir->bs_Buffer, 17 ) == 0 )
+	{
+		char *buffer = &bsdir->bs_Buffer[ 17 ];
+		unsigned int entr = 0;
+		jsmntok_t *tokens = JSONTokenise( buffer, &entr );
+		
+		if( tokens != NULL )
+		{
+			int srclen = strlen( src );
+			int namelen = strlen( name );
+			unsigned int i = 0;
+			
+			while( i < entr && error == 0 )
+			{
+				if( tokens[ i ].type != JSMN_OBJECT )
+				{
+					i++;
+					continue;
+				}
+				
+				char *fname;
+				int fnameSize;
+				FBOOL isDir;
+				FQUAD size;
+				time_t mtime;
+				
+				i = FileZipStreamParseObject( buffer, tokens, entr, i, &fname, &fnameSize, &isDir, &size, &mtime );
+				if( fname == NULL || fnameSize <= 0 )
+				{
+					continue;
+				}
+				
+				char *newsrc = FCalloc( srclen + fnameSize + 2, sizeof(char) );
+				char *newname = FCalloc( namelen + fnameSize + 2, sizeof(char) );
+				if( newsrc != NULL && newname != NULL )
+				{
+					memcpy( newsrc, src, srclen );
+					memcpy( newsrc + srclen, fname, fnameSize );
+					memcpy( newname, name, namelen );
+					memcpy( newname + namelen, fname, fnameSize );
+					
+					if( isDir == TRUE )
+					{
+						newsrc[ srclen + fnameSize ] = '/';
+						newname[ namelen + fnameSize ] = '/';
+						
+						error = zlib->ZipStreamAddDirectory( zs, newname, mtime );
+						if( error == 0 )
+						{
+							error = FileZipStreamDirectoryRec( zlib, zs, srcdev, newsrc, newname, numberFiles );
+						}
+					}
+					else
+					{
+						error = zlib->ZipStreamAddFile( zs, srcdev, newsrc, newname, size, mtime );
+						(*numberFiles)++;
+					}
+				}
+				else
+				{
+					error = 2;
+				}
+				
+				if( newsrc != NULL )
+				{
+					FFree( newsrc );
+				}
+				if( newname != NULL )
+				{
+					FFree( newname );
+				}
+			}
+			FFree( tokens );
+		}
+	}
+	
+	BufStringDelete( bsdir );
+	
+	return error;
+}
+
+/**
+ * Function which adds Friend file or folder to streamed zip archive
+ *
+ * @param zlib pointer to ZLibrary
+ * @param zs pointer to ZipStream
+ * @param srcdev pointer to source Friend root File
+ * @param src path to file or directory on device (without device name)
+ * @param numberFiles pointer to counter of added files
+ * @return 0 when success, otherwise error number
+ */
+
+int FileZipStreamFileOrFolder( void *zlib, void *zs, File *srcdev, const char *src, int *numberFiles )
+{
+	ZLibrary *lzlib = (ZLibrary *)zlib;
+	FHandler *fsys = srcdev->f_FSys;
+	int error = 0;
+	
+	*numberFiles = 0;
+	
+	// root of device
+	if( src == NULL || src[ 0 ] == 0 )
+	{
+		char *name = FCalloc( strlen( srcdev->f_Name ) + 2, sizeof(char) );
+		if( name == NULL )
+		{
+			return 2;
+		}
+		sprintf( name, "%s/", srcdev->f_Name );
+		
+		if( ( error = lzlib->ZipStreamAddDirectory( zs, name, time( NULL ) ) ) == 0 )
+		{
+			error = FileZipStreamDirectoryRec( lzlib, zs, srcdev, "", name, numberFiles );
+		}
+		FFree( name );
+		return error;
+	}
+	
+	BufString *bs = fsys->Info( srcdev, src );
+	if( bs == NULL )
+	{
+		return 1;
+	}
+	
+	if( bs->bs_Size > 17 && strncmp( "ok<!--separate-->", bs->bs_Buffer, 17 ) == 0 )
+	{
+		char *buffer = &bs->bs_Buffer[ 17 ];
+		unsigned int entr = 0;
+		jsmntok_t *tokens = JSONTokenise( buffer, &entr );
+		
+		if( tokens != NULL && entr > 0 && tokens[ 0 ].type == JSMN_OBJECT )
+		{
+			char *fname;
+			int fnameSize;
+			FBOOL isDir;
+			FQUAD size;
+			time_t mtime;
+			
+			FileZipStreamParseObject( buffer, tokens, entr, 0, &fname, &fnameSize, &isDir, &size, &mtime );
+			
+			// name is taken from path, drivers do not always return Filename for directories
+			int srclen = strlen( src );
+			int end = srclen;
+			while( end > 0 && src[ end-1 ] == '/' )
+			{
+				end--;
+			}
+			int start = end;
+			while( start > 0 && src[ start-1 ] != '/' )
+			{
+				start--;
+			}
+			fnameSize = end - start;
+			
+			char *name = NULL;
+			if( fnameSize > 0 && ( name = FCalloc( fnameSize + 2, sizeof(char) ) ) != NULL )
+			{
+				memcpy( name, &src[ start ], fnameSize );
+				
+				if( isDir == TRUE )
+				{
+					char *dirsrc = FCalloc( srclen + 2, sizeof(char) );
+					if( dirsrc != NULL )
+					{
+						strcpy( dirsrc, src );
+						if( src[ srclen-1 ] != '/' )
+						{
+							dirsrc[ srclen ] = '/';
+						}
+						name[ fnameSize ] = '/';
+						
+						if( ( error = lzlib->ZipStreamAddDirectory( zs, name, mtime ) ) == 0 )
+						{
+							error = FileZipStreamDirectoryRec( lzlib, zs, srcdev, dirsrc, name, numberFiles );
+						}
+						FFree( dirsrc );
+					}
+				}
+				else
+				{
+					error = lzlib->ZipStreamAddFile( zs, srcdev, src, name, size, mtime );
+					(*numberFiles)++;
+				}
+				FFree( name );
+			}
+			else
+			{
+				error = 1;
+			}
+		}
+		else
+		{
+			error = 1;
+		}
+		
+		if( tokens != NULL )
+		{
+			FFree( tokens );
+		}
+	}
+	else
+	{
+		error = 1;
+	}
+	
+	BufStringDelete( bs );
+	
+	return error;
+}
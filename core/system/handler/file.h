@@ -96,6 +96,9 @@ typedef struct File
 	int													f_Operations;				// operation counter
 	
 	int													f_OperationMode; // read, write, etc.
+	
+	time_t												f_LastAccess;			// last time when device was used
+	FBOOL												f_MountOnDemand;		// device was mounted on first access and can be unmounted when idle
 } File;
 
 
@@ -193,5 +196,11 @@ int FileUploadFileOrDirectory( Http *request, void *us, const char *dst, const c
 
 int FileDownloadFilesOrFolder( Http *request, void *us, const char *dst, char *src, int *numberFiles );
 
+//
+//
+//
+
+int FileZipStreamFileOrFolder( void *zlib, void *zs, File *srcdev, const char *src, int *numberFiles );
+
 
 #endif // __HANDLER_FILE_H__
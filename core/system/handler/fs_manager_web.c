@@ -35,6 +35,89 @@
 #include <system/handler/door_notification.h>
 #include <stdlib.h>
 
+//
+// Zip archive or file streamed to client
+//
+
+typedef struct FSMDownload
+{
+	Socket			*dl_Socket;
+	FBOOL			dl_Chunked;			// use chunked transfer encoding
+	FBOOL			*dl_ShutdownPtr;
+}FSMDownload;
+
+/**
+ * Write part of zip archive or file to socket
+ *
+ * @param data pointer to FSMDownload
+ * @param buffer pointer to data
+ * @param size size of data
+ * @return number of bytes written or -1 when error appear
+ */
+
+static int FSMDownloadWrite( void *data, const char *buffer, int size )
+{
+	FSMDownload *dl = (FSMDownload *)data;
+	
+	if( dl->dl_ShutdownPtr != NULL && *(dl->dl_ShutdownPtr) == TRUE )
+	{
+		return -1;
+	}
+	
+	if( dl->dl_Chunked == TRUE )
+	{
+		char head[ 16 ];
+		int len = snprintf( head, sizeof(head), "%x\r\n", size );
+		
+		if( SocketWrite( dl->dl_Socket, head, len ) != len )
+		{
+			return -1;
+		}
+		if( SocketWrite( dl->dl_Socket, (char *)buffer, size ) != size )
+		{
+			return -1;
+		}
+		if( SocketWrite( dl->dl_Socket, "\r\n", 2 ) != 2 )
+		{
+			return -1;
+		}
+		return size;
+	}
+	
+	if( SocketWrite( dl->dl_Socket, (char *)buffer, size ) != size )
+	{
+		return -1;
+	}
+	return size;
+}
+
+#define FS_HEADERS_END_MARKER "---http-headers-end---\n"
+
+/**
+ * Find size of headers which file system could put before file data
+ *
+ * @param buffer pointer to first part of file
+ * @param size size of data in buffer
+ * @return number of bytes which must be skipped, 0 when there are no headers
+ */
+
+static int FSMEmbeddedHeadersSize( const char *buffer, int size )
+{
+	int mlen = sizeof( FS_HEADERS_END_MARKER ) - 1;
+	const char *ptr = buffer;
+	const char *last = buffer + size - mlen;
+	
+	while( ptr <= last && ( ptr = memchr( ptr, '-', ( last - ptr ) + 1 ) ) != NULL )
+	{
+		if( memcmp( ptr, FS_HEADERS_END_MARKER, mlen ) == 0 )
+		{
+			return ( ptr - buffer ) + mlen;
+		}
+		ptr++;
+	}
+	return 0;
+}
+
 /**
  * Filesystem web calls handler
  *
@@ -768,157 +851,148 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 							// Success?
 							if( fp != NULL )
 							{
-								int dataread = 0;
-							
-								//struct stringPart *head = NULL;
-								//struct stringPart *curr = NULL;
-							
 								fp->f_Raw = 0;
 								if( strcmp( mode, "rb" ) == 0 )
 								{
 									fp->f_Raw = 1;
 								}
 							
-								//we want to read only part of data
 #define FS_READ_BUFFER 262144
 
-								int totalBytes = 0;
+								// -1 means whole file
+								int bytesLeft = -1;
 								
-								ListString *ls = ListStringNew();
-							
+								//we want to read only part of data
 								if( offset != NULL && bytes != NULL )
 								{
-									int offsetint = atoi( offset );
-									int bytesint = atoi( bytes );
-								
-									if( actFS->FileSeek( fp, offsetint ) != -1 )
+									bytesLeft = atoi( bytes );
+									if( bytesLeft < 0 || actFS->FileSeek( fp, atoi( offset ) ) == -1 )
 									{
-										int readbytes = FS_READ_BUFFER;
-										if( bytesint < readbytes )
-										{
-											readbytes = bytesint;
-										}
-									
-										char *dataBuffer = FCalloc( readbytes, sizeof( char ) );
-									
-										while( ( dataread = actFS->FileRead( fp, dataBuffer, readbytes ) ) != -1 )
-										{
-											if( request->h_ShutdownPtr != NULL && *(request->h_ShutdownPtr) == TRUE )
-											{
-												break;
-											}
-											
-											if( dataread == 0 )
-											{
-												continue;
-											}
-										
-											ListStringAdd( ls, dataBuffer, dataread );
-										
-											// Make sure we only read as much as we need
-											bytesint -= dataread;
-											if( bytesint > 0 ) 
-											{
-												break;
-											}
-											if( bytesint < readbytes )
-											{
-												readbytes = bytesint;
-											}
-											totalBytes += readbytes;
-										}
-										
-										if( dataBuffer )
-										{
-											FFree( dataBuffer );
-										}
+										bytesLeft = 0;
 									}
 								}
-							
-								//
-								// we want to read whole file
-								//
-							
-								else 
+								
+								// http clients get file in chunks as it is read, memory use does not depend on file size
+								// websocket and other FC requests need whole content in response
+								FSMDownload dl;
+								dl.dl_Socket = request->h_Socket;
+								dl.dl_Chunked = TRUE;
+								dl.dl_ShutdownPtr = request->h_ShutdownPtr;
+								
+								FBOOL streamToSocket = ( request->h_RequestSource == HTTP_SOURCE_HTTP && request->h_Socket != NULL );
+								BufString *bs = NULL;
+								if( streamToSocket == FALSE )
 								{
-									int readbytes = FS_READ_BUFFER;
-									char *dataBuffer = FCalloc( readbytes, sizeof( char ) ); 
+									bs = BufStringNew();
+								}
 								
-									while( ( dataread = actFS->FileRead( fp, dataBuffer, FS_READ_BUFFER ) ) != -1 )
+								FQUAD totalBytes = 0;
+								FBOOL firstPart = TRUE;
+								FBOOL headersSent = FALSE;
+								FBOOL writeError = FALSE;
+								int dataread = 0;
+								char *dataBuffer = NULL;
+								if( streamToSocket == TRUE || bs != NULL )
+								{
+									dataBuffer = FCalloc( FS_READ_BUFFER, sizeof( char ) );
+								}
+								
+								while( dataBuffer != NULL && bytesLeft != 0 )
+								{
+									// Make sure we only read as much as we need
+									int readbytes = FS_READ_BUFFER;
+									if( bytesLeft > 0 && bytesLeft < readbytes )
 									{
-										if( request->h_ShutdownPtr != NULL && *(request->h_ShutdownPtr) == TRUE )
+										readbytes = bytesLeft;
+									}
+									
+									if( ( dataread = actFS->FileRead( fp, dataBuffer, readbytes ) ) == -1 )
+									{
+										break;
+									}
+									
+									if( request->h_ShutdownPtr != NULL && *(request->h_ShutdownPtr) == TRUE )
+									{
+										break;
+									}
+									
+									if( dataread == 0 )
+									{
+										continue;
+									}
+									
+									if( bytesLeft > 0 )
+									{
+										bytesLeft -= dataread;
+									}
+									
+									char *data = dataBuffer;
+									int size = dataread;
+									
+									// Try to skip embedded headers, file system puts them at the beginning
+									if( firstPart == TRUE )
+									{
+										int skip = FSMEmbeddedHeadersSize( data, size );
+										data += skip;
+										size -= skip;
+										firstPart = FALSE;
+									}
+									
+									if( size <= 0 )
+									{
+										continue;
+									}
+									
+									if( bs != NULL )
+									{
+										BufStringAddSize( bs, data, size );
+									}
+									else
+									{
+										// headers are sent with first part of data, size is not known
+										if( headersSent == FALSE )
 										{
-											break;
+											headersSent = TRUE;
+											HttpAddHeader( response, HTTP_HEADER_TRANSFER_ENCODING, StringDuplicateN( "chunked", 7 ) );
+											response->h_RequestSource = request->h_RequestSource;
+											response->h_Stream = TRUE;
+											response->h_ResponseID = request->h_ResponseID;
+											HttpWrite( response, request->h_Socket );
 										}
 										
-										if( dataread == 0 )
+										if( FSMDownloadWrite( &dl, data, size ) != size )
 										{
-											continue;
+											writeError = TRUE;
+											break;
 										}
-									
-										ListStringAdd( ls, dataBuffer, dataread );
-										totalBytes += dataread;
-									}
-									
-									if( dataBuffer )
-									{
-										FFree( dataBuffer );
 									}
-								}	// end of reading part or whole file
+									totalBytes += size;
+								}
+								
+								if( dataBuffer != NULL )
+								{
+									FFree( dataBuffer );
+								}
 							
 								// Close the file
 								actFS->FileClose( actDev, fp );
 							
-								if( ls->ls_Size > 0 && totalBytes > 0 )
+								if( headersSent == TRUE )
 								{
-									// Combine all parts into one buffer
-									
-									ListStringJoin( ls );
-									
-									char *finalBuffer = ls->ls_Data;
-									ls->ls_Data = NULL;
-									char *outputBuf = finalBuffer;
-									
-									int offBuf = 0;
-								
-									// Try to skip embedded headers
-									char *ptr = strstr( finalBuffer, "---http-headers-end---\n" );
-									if( ptr != NULL )
+									if( writeError == FALSE )
 									{
-										// With the diff, move offset and set correct size
-										int diff = ( ptr - finalBuffer ) + 23;
-										totalBytes = (int)( ( (FULONG)finalBuffer) - diff) + 1;
-										outputBuf = FCalloc( totalBytes, sizeof( char ) );
-										memcpy( outputBuf, ptr + 23, totalBytes );
-										FFree( finalBuffer );
+										SocketWrite( request->h_Socket, "0\r\n\r\n", 5 );
 									}
-								
-								/*
-								 *								// Correct mime from data
-								 *								const char *mime = NULL;
-								 *								char *fallbackMime = NULL;
-								 *								
-								 *								
-								 *								if( l->sl_Magic != NULL && outputBuf != NULL )
-								 *								{
-								 *									//INFO("FILE READ BYTE %c %c %c %c\n", outputBuf[ 0 ], outputBuf[ 1 ], outputBuf[ 2 ], outputBuf[ 3 ] );
-								 *									int bytes = totalBytes;
-								 # *define MAGIC_SIZE (1024*6)
-								 
-								 if( bytes > MAGIC_SIZE ){ bytes = MAGIC_SIZE; }
-								 mime = magic_buffer( l->sl_Magic, outputBuf, bytes );
-								 DEBUG( "Ok, reading file as %s\n", mime == NULL ? "text/plain" : mime );
-								 //FERROR("\n\n\n\n\n\n\nHELLO\n");
-							}
-							// Just in case!
-							if( mime == NULL )
-							{
-							fallbackMime = getMIMEByFilename( path );
-							}
-							
-							INFO("READ RETURN BYTES %d  - %s\n", totalBytes, mime );
-							*/
-									HttpSetContent( response, outputBuf, totalBytes );
+									else
+									{
+										FERROR("[FSMWebRequest] File %s was not sent, connection was closed\n", path );
+									}
+									DEBUG("[FSMWebRequest] File %s sent, bytes %lld\n", path, (long long)totalBytes );
+								}
+								else if( bs != NULL && totalBytes > 0 )
+								{
+									HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
+									bs->bs_Buffer = NULL;
 								}
 								else
 								{
@@ -932,7 +1006,7 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 									HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"Cannot allocate memory for file.\" }" );
 								}
 								
-								ListStringDelete( ls );
+								BufStringDelete( bs );
 							}
 							else
 							{
@@ -1224,7 +1298,7 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 						// Mind situations where hf_FileName is uploaded filename, where
 						// path has target filename built in..
 						FBOOL fileNameIsTmpPath = FALSE;
-						if( file->hf_FileName && strlen( file->hf_FileName ) > 5 )
+						if( file != NULL && strlen( file->hf_FileName ) > 5 )
 						{
 							char *tmpF = FCalloc( 1, 6 );
 							sprintf( tmpF, "%.*s", 5, file->hf_FileName );
@@ -1266,10 +1340,27 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 								File *fp = (File *)actFS->FileOpen( actDev, tmpPath, "wb" );
 								if( fp != NULL )
 								{
-									actFS->FileWrite( fp, file->hf_Data, file->hf_FileSize );
+									// big files are passed to driver in parts, they can be bigger than FileWrite size argument
+									FQUAD written = 0;
+									while( written < file->hf_FileSize )
+									{
+										FQUAD left = file->hf_FileSize - written;
+										int chunk = left > HTTP_UPLOAD_WRITE_CHUNK ? HTTP_UPLOAD_WRITE_CHUNK : (int)left;
+										
+										int wrote = actFS->FileWrite( fp, file->hf_Data + written, chunk );
+										if( wrote <= 0 )
+										{
+											FERROR("Cannot write file %s, stored %lld bytes\n", tmpPath, written );
+											break;
+										}
+										written += wrote;
+									}
 									actFS->FileClose( actDev, fp );
 								
-									uploadedFiles++;
+									if( written == file->hf_FileSize )
+									{
+										uploadedFiles++;
+									}
 								}
 								else
 								{
@@ -1786,6 +1877,108 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 					}
 				}
 				
+				//
+				// download file or directory as zip archive, archive is created while it is sent
+				//
+				
+				else if( strcmp( urlpath[ 1 ], "zipdownload" ) == 0 )
+				{
+					FBOOL have = FSManagerCheckAccess( l->sl_FSM, path, actDev->f_ID, loggedSession->us_User, "-R----" );
+					ZLibrary *zlib = NULL;
+					
+					if( have == TRUE && ( zlib = l->LibraryZGet( l ) ) != NULL )
+					{
+						char temp[ 512 ];
+						char *name = actDev->f_Name;
+						int end = strlen( path );
+						
+						while( end > 0 && path[ end-1 ] == '/' )
+						{
+							end--;
+						}
+						int start = end;
+						while( start > 0 && path[ start-1 ] != '/' )
+						{
+							start--;
+						}
+						if( end > start )
+						{
+							name = &path[ start ];
+						}
+						snprintf( temp, sizeof( temp ), "attachment; filename=\"%.*s.zip\"", end > start ? end - start : (int)strlen( name ), name );
+						
+						FSMDownload dl;
+						dl.dl_Socket = request->h_Socket;
+						dl.dl_Chunked = ( request->h_RequestSource != HTTP_SOURCE_FC );
+						dl.dl_ShutdownPtr = request->h_ShutdownPtr;
+						
+						// size of archive is not known, headers are sent first and data in chunks
+						
+						if( dl.dl_Chunked == TRUE )
+						{
+							response = HttpNewSimpleA( HTTP_200_OK, request,  
+												   HTTP_HEADER_CONTENT_TYPE, (FULONG)StringDuplicate( "application/zip" ),
+												   HTTP_HEADER_CONTENT_DISPOSITION, (FULONG)StringDuplicate( temp ),
+												   HTTP_HEADER_TRANSFER_ENCODING, (FULONG)StringDuplicateN( "chunked", 7 ),
+												   HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),
+												   TAG_DONE, TAG_DONE );
+						}
+						else
+						{
+							response = HttpNewSimpleA( HTTP_200_OK, request,  
+												   HTTP_HEADER_CONTENT_TYPE, (FULONG)StringDuplicate( "application/zip" ),
+												   HTTP_HEADER_CONTENT_DISPOSITION, (FULONG)StringDuplicate( temp ),
+												   HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),
+												   TAG_DONE, TAG_DONE );
+						}
+						
+						response->h_RequestSource = request->h_RequestSource;
+						response->h_Stream = TRUE;
+						response->h_ResponseID = request->h_ResponseID;
+						HttpWrite( response, request->h_Socket );
+						
+						ZipStream *zs = zlib->ZipStreamNew( FSMDownloadWrite, &dl, 0 );
+						if( zs != NULL )
+						{
+							int numberOfFiles = 0;
+							
+							actDev->f_Operations++;
+							int error = FileZipStreamFileOrFolder( zlib, zs, actDev, path, &numberOfFiles );
+							actDev->f_Operations--;
+							
+							// archive is closed even after errors, so client receive valid part of it
+							if( zlib->ZipStreamFinish( zs ) != 0 || error != 0 )
+							{
+								FERROR("[FSMWebRequest] Zip archive of %s was not completed, error %d\n", path, error );
+							}
+							zlib->ZipStreamDelete( zs );
+							
+							DEBUG("[FSMWebRequest] Zip archive of %s sent, files %d\n", path, numberOfFiles );
+						}
+						
+						if( dl.dl_Chunked == TRUE )
+						{
+							SocketWrite( request->h_Socket, "0\r\n\r\n", 5 );
+						}
+						
+						l->LibraryZDrop( l, zlib );
+					}
+					else
+					{
+						response = HttpNewSimpleA( HTTP_200_OK, request,  HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicateN( DEFAULT_CONTENT_TYPE, 24 ),
+							HTTP_HEADER_CONNECTION, (FULONG)StringDuplicateN( "close", 5 ),TAG_DONE, TAG_DONE );
+						
+						if( have == TRUE )
+						{
+							HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"Cannot get z.library\"}" );
+						}
+						else
+						{
+							HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"No access to directory\" }" );
+						}
+					}
+				}
+				
 				//
 				// compress files or directories
 				//
@@ -1997,15 +2190,10 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 						
 						mkdir( dirname, S_IRWXU|S_IRWXG|S_IROTH|S_IXOTH );
 						
-						char *dstname = FCalloc( 1024, sizeof(char ) );
-						snprintf( dstname, 1024, "%s.target", dirname );
-						
-						mkdir( dstname, S_IRWXU|S_IRWXG|S_IROTH|S_IXOTH );
-						
 						char *tmpfilename = FCalloc( 1024, sizeof(char ) );
 						snprintf( tmpfilename, 1024, "%s/%d%d.zip", dirname, rand()%9999, rand()%9999 );
 
-						DEBUG("[FSMWebRequest] dirname %s dstname %s tmpfilename %s\n", dirname, dstname, tmpfilename );
+						DEBUG("[FSMWebRequest] dirname %s tmpfilename %s\n", dirname, tmpfilename );
 						
 						//SendProcessMessage( request, "Decompress start", 16 );
 						
@@ -2083,14 +2271,30 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 								
 								if( strcmp( archiver, "zip" ) == 0 )
 								{
-									 ZLibrary *zlib = l->LibraryZGet( l );
-									 if( zlib != NULL )
+									ZLibrary *zlib = l->LibraryZGet( l );
+									if( zlib != NULL )
 									{
-										DEBUG("[FSMWebRequest] Unpack archive %s to %s  requestus %p  loggedsession %p\n", tmpfilename, dstname, request->h_UserSession, loggedSession );
-										filesExtracted = zlib->Unpack( zlib, tmpfilename, dstname, NULL, request );
-									 
-										DEBUG("[FSMWebRequest] Unpack return %d\n", filesExtracted );
-									 
+										// files are extracted next to archive, directly on device
+										char *dstpath = StringDuplicate( path );
+										if( dstpath != NULL )
+										{
+											char *slash = strrchr( dstpath, '/' );
+											if( slash != NULL )
+											{
+												slash[ 1 ] = 0;
+											}
+											else
+											{
+												dstpath[ 0 ] = 0;
+											}
+											
+											DEBUG("[FSMWebRequest] Unpack archive %s to %s  requestus %p  loggedsession %p\n", tmpfilename, dstpath, request->h_UserSession, loggedSession );
+											filesExtracted = zlib->UnpackToDevice( zlib, tmpfilename, actDev, dstpath, NULL, request );
+											
+											DEBUG("[FSMWebRequest] Unpack return %d\n", filesExtracted );
+											FFree( dstpath );
+										}
+										
 										l->LibraryZDrop( l, zlib );
 									}
 								}
@@ -2117,10 +2321,6 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 										}
 									}
 									
-									DEBUG("[FSMWebRequest] File upload %s\n", dsttmp );
-									
-									int error = FileUploadFileOrDirectory( request, loggedSession, dsttmp, dstname, filesExtracted );
-								
 									int err2 = DoorNotificationCommunicateChanges( l, loggedSession, actDev, dsttmp );
 									
 									FFree( dsttmp );
@@ -2141,10 +2341,8 @@ Http *FSMWebRequest( void *m, char **urlpath, Http *request, UserSession *logged
 						// remove created directories
 						
 						LocFileDeleteWithSubs( dirname );
-						LocFileDeleteWithSubs( dstname );
 						
 						FFree( dirname );
-						FFree( dstname );
 						FFree( tmpfilename );
 					}
 					else
@@ -34,6 +34,179 @@
 #include <stdlib.h>
 #include <string.h>
 #include <util/string.h>
+#include <util/murmurhash3.h>
+
+#define INRAM_HASH_SEED 0x494e5241
+
+/**
+ * Calculate hash of entry name
+ *
+ * @param name entry name
+ * @param len length of name
+ * @return hash value
+ */
+static inline unsigned int INRAMHash( const char *name, int len )
+{
+	uint32_t hash;
+	MurmurHash3_x86_32( name, len, INRAM_HASH_SEED, &hash );
+	return hash;
+}
+
+/**
+ * Invalidate all resolved paths stored by root of entry
+ *
+ * @param nf pointer to any INRAMFile in tree
+ */
+static void INRAMFileInvalidatePaths( INRAMFile *nf )
+{
+	while( nf != NULL && nf->nf_Parent != NULL )
+	{
+		nf = nf->nf_Parent;
+	}
+	if( nf != NULL && nf->nf_PathCache != NULL )
+	{
+		nf->nf_PathCache->pc_Generation++;
+	}
+}
+
+/**
+ * Put entry into parent hash table, table is resized when needed
+ *
+ * @param root parent entry
+ * @param nf entry which will be added
+ */
+static void INRAMFileHashAdd( INRAMFile *root, INRAMFile *nf )
+{
+	unsigned int pos;
+	
+	if( root->nf_ChildHash == NULL || root->nf_ChildCount >= root->nf_ChildHashSize )
+	{
+		int newSize = root->nf_ChildHashSize > 0 ? root->nf_ChildHashSize * 2 : INRAM_CHILD_HASH_SIZE;
+		INRAMFile **nhash = FCalloc( newSize, sizeof( INRAMFile *) );
+		
+		if( nhash != NULL )
+		{
+			int i;
+			for( i = 0 ; i < root->nf_ChildHashSize ; i++ )
+			{
+				INRAMFile *f = root->nf_ChildHash[ i ];
+				while( f != NULL )
+				{
+					INRAMFile *next = f->nf_HashNext;
+					pos = INRAMHash( f->nf_Name, strlen( f->nf_Name ) ) & ( newSize - 1 );
+					f->nf_HashNext = nhash[ pos ];
+					nhash[ pos ] = f;
+					f = next;
+				}
+			}
+			if( root->nf_ChildHash != NULL )
+			{
+				FFree( root->nf_ChildHash );
+			}
+			root->nf_ChildHash = nhash;
+			root->nf_ChildHashSize = newSize;
+		}
+		else if( root->nf_ChildHash == NULL )
+		{
+			FERROR("Cannot allocate memory for INRAMFile hash\n");
+			return;
+		}
+	}
+	
+	pos = INRAMHash( nf->nf_Name, strlen( nf->nf_Name ) ) & ( root->nf_ChildHashSize - 1 );
+	nf->nf_HashNext = root->nf_ChildHash[ pos ];
+	root->nf_ChildHash[ pos ] = nf;
+	root->nf_ChildCount++;
+}
+
+/**
+ * Remove entry from parent hash table
+ *
+ * @param root parent entry
+ * @param nf entry which will be removed
+ */
+static void INRAMFileHashRemove( INRAMFile *root, INRAMFile *nf )
+{
+	if( root->nf_ChildHash == NULL )
+	{
+		return;
+	}
+	
+	unsigned int pos = INRAMHash( nf->nf_Name, strlen( nf->nf_Name ) ) & ( root->nf_ChildHashSize - 1 );
+	INRAMFile **prev = &(root->nf_ChildHash[ pos ]);
+	
+	while( *prev != NULL )
+	{
+		if( *prev == nf )
+		{
+			*prev = nf->nf_HashNext;
+			nf->nf_HashNext = NULL;
+			root->nf_ChildCount--;
+			return;
+		}
+		prev = &((*prev)->nf_HashNext);
+	}
+}
+
+/**
+ * Find child by name
+ *
+ * @param root parent entry
+ * @param name name of entry
+ * @param len length of name
+ * @return pointer to entry or NULL
+ */
+static INRAMFile *INRAMFileHashGet( INRAMFile *root, const char *name, int len )
+{
+	if( root->nf_ChildHash == NULL )
+	{
+		return NULL;
+	}
+	
+	INRAMFile *f = root->nf_ChildHash[ INRAMHash( name, len ) & ( root->nf_ChildHashSize - 1 ) ];
+	while( f != NULL )
+	{
+		if( strncmp( f->nf_Name, name, len ) == 0 && f->nf_Name[ len ] == 0 )
+		{
+			return f;
+		}
+		f = f->nf_HashNext;
+	}
+	return NULL;
+}
+
+/**
+ * Remove entry from parent children list and hash table
+ *
+ * @param root parent entry
+ * @param f entry which will be removed
+ */
+static void INRAMFileUnlink( INRAMFile *root, INRAMFile *f )
+{
+	INRAMFile *next = (INRAMFile *) f->node.mln_Succ;
+	INRAMFile *prev = (INRAMFile *) f->node.mln_Pred;
+	
+	if( f == root->nf_Children )
+	{
+		root->nf_Children = next;
+	}
+	else if( prev != NULL )
+	{
+		prev->node.mln_Succ = (MinNode *)next;
+	}
+	
+	if( next != NULL )
+	{
+		next->node.mln_Pred = (MinNode *)prev;
+	}
+	
+	f->node.mln_Succ = NULL;
+	f->node.mln_Pred = NULL;
+	
+	INRAMFileHashRemove( root, f );
+	INRAMFileInvalidatePaths( root );
+	f->nf_Parent = NULL;
+}
 
 /**
  * Function create INRAMFile
@@ -60,10 +233,13 @@ INRAMFile *INRAMFileNew( int type, char *path, char *name )
 		if( type == INRAM_FILE )
 		{
 			DEBUG("File created\n");
-			nf->nf_Data = BufStringNewSize( 64 );
 		}
 		else
 		{
+			if( type == INRAM_ROOT )
+			{
+				nf->nf_PathCache = FCalloc( 1, sizeof( INRAMPathCache ) );
+			}
 			DEBUG("Directory created\n");
 		}
 	}
@@ -86,12 +262,26 @@ void INRAMFileDelete( INRAMFile *nf )
 	{
 		if( nf->nf_Type == INRAM_FILE )
 		{
-			if( nf->nf_Data != NULL )
+			INRAMFileTruncate( nf );
+		}
+		
+		if( nf->nf_PathCache != NULL )
+		{
+			int i;
+			for( i = 0 ; i < INRAM_PATH_CACHE_SIZE ; i++ )
 			{
-				BufStringDelete( nf->nf_Data );
+				if( nf->nf_PathCache->pc_Entries[ i ].pce_Path != NULL )
+				{
+					FFree( nf->nf_PathCache->pc_Entries[ i ].pce_Path );
+				}
 			}
+			FFree( nf->nf_PathCache );
 		}
 		
+		if( nf->nf_ChildHash )
+		{
+			FFree( nf->nf_ChildHash );
+		}
 		if( nf->nf_Path )
 		{
 			FFree( nf->nf_Path );
@@ -116,8 +306,15 @@ int INRAMFileAddChild( INRAMFile *root, INRAMFile *toadd )
 	if( root != NULL && toadd != NULL )
 	{
 		toadd->node.mln_Succ = (MinNode *) root->nf_Children;
+		toadd->node.mln_Pred = NULL;
+		if( root->nf_Children != NULL )
+		{
+			root->nf_Children->node.mln_Pred = (MinNode *)toadd;
+		}
 		root->nf_Children = toadd;
 		toadd->nf_Parent = root;
+		
+		INRAMFileHashAdd( root, toadd );
 	}
 	else
 	{
@@ -136,21 +333,7 @@ int INRAMFileAddChild( INRAMFile *root, INRAMFile *toadd )
  */
 INRAMFile *INRAMFileGetChildByName( INRAMFile *root, char *name )
 {
-	INRAMFile *f = root->nf_Children;
-	DEBUG("INRAMFileGetChildByName\n");
-	
-	while( f != NULL )
-	{
-		INRAMFile *ret = NULL;
-		if( strcmp( f->nf_Name, name ) == 0 )
-		{
-			DEBUG("Found name %s\n", name );
-			return f;
-		}
-		
-		f = (INRAMFile *)f->node.mln_Succ;
-	}
-	return NULL;
+	return INRAMFileHashGet( root, name, strlen( name ) );
 }
 
 /**
@@ -162,41 +345,12 @@ INRAMFile *INRAMFileGetChildByName( INRAMFile *root, char *name )
  */
 INRAMFile *INRAMFileRemoveChild( INRAMFile *root, INRAMFile *rem )
 {
-	INRAMFile *f = root->nf_Children;
 	DEBUG("Remove child\n");
 	
-	while( f != NULL )
+	if( rem != NULL && rem->nf_Parent == root )
 	{
-		if( f == rem )
-		{
-			// remove entry from list and return
-			
-			if( f == root->nf_Children )
-			{
-				root->nf_Children = (INRAMFile *)root->nf_Children->node.mln_Succ;
-				if( root->nf_Children != NULL )
-				{
-					root->nf_Children->node.mln_Pred = NULL;
-				}
-				DEBUG(" entry removed\n");
-			}
-			else if( f->node.mln_Succ == NULL )
-			{
-				INRAMFile *nf = (INRAMFile *)f->node.mln_Pred;
-				nf->node.mln_Succ = NULL;
-			}
-			else
-			{
-				INRAMFile *next = (INRAMFile *) f->node.mln_Succ;
-				INRAMFile *prev = (INRAMFile *) f->node.mln_Pred;
-				next->node.mln_Pred = (MinNode *)prev;
-				prev->node.mln_Succ = (MinNode *)next;
-			}
-			
-			return f;
-		}
-		
-		f = (INRAMFile *)f->node.mln_Succ;
+		INRAMFileUnlink( root, rem );
+		return rem;
 	}
 	return NULL;
 }
@@ -210,47 +364,22 @@ INRAMFile *INRAMFileRemoveChild( INRAMFile *root, INRAMFile *rem )
  */
 INRAMFile *INRAMFileRemove( INRAMFile *root, INRAMFile *rem )
 {
-	INRAMFile *f = root->nf_Children;
+	INRAMFile *f = rem;
 	
-	while( f != NULL )
+	// entry is removed only when it is placed somewhere below root
+	
+	while( f != NULL && f != root )
 	{
-		INRAMFile *ret = NULL;
-		if( f->nf_Type == INRAM_DIR )
-		{
-			if( ( ret = INRAMFileRemove( f, rem ) ) != NULL )
-			{
-				return ret;
-			}
-		}
-		
-		if( f== rem )
-		{
-			// remove entry from list and return
-			
-			if( f == root->nf_Children )
-			{
-				root->nf_Children = (INRAMFile *)root->nf_Children->node.mln_Succ;
-				root->nf_Children->node.mln_Pred = NULL;
-			}
-			else if( f->node.mln_Succ == NULL )
-			{
-				INRAMFile *nf = (INRAMFile *)f->node.mln_Pred;
-				nf->node.mln_Succ = NULL;
-			}
-			else
-			{
-				INRAMFile *next = (INRAMFile *) f->node.mln_Succ;
-				INRAMFile *prev = (INRAMFile *) f->node.mln_Pred;
-				next->node.mln_Pred = (MinNode *)prev;
-				prev->node.mln_Succ = (MinNode *)next;
-			}
-			
-			return f;
-		}
-		
-		f = (INRAMFile *)f->node.mln_Succ;
+		f = f->nf_Parent;
 	}
-	return NULL;
+	
+	if( f == NULL || rem == root )
+	{
+		return NULL;
+	}
+	
+	INRAMFileUnlink( rem->nf_Parent, rem );
+	return rem;
 }
 
 /**
@@ -266,28 +395,9 @@ INRAMFile *INRAMFileRemoveChildByPath( INRAMFile *root, char *path )
 	
 	while( f != NULL )
 	{
-		if( strcmp( path, f->nf_Path ) == 0 )
+		if( f->nf_Path != NULL && strcmp( path, f->nf_Path ) == 0 )
 		{
-			// remove entry from list and return
-			
-			if( f == root->nf_Children )
-			{
-				root->nf_Children = (INRAMFile *)root->nf_Children->node.mln_Succ;
-				root->nf_Children->node.mln_Pred = NULL;
-			}
-			else if( f->node.mln_Succ == NULL )
-			{
-				INRAMFile *nf = (INRAMFile *)f->node.mln_Pred;
-				nf->node.mln_Succ = NULL;
-			}
-			else
-			{
-				INRAMFile *next = (INRAMFile *) f->node.mln_Succ;
-				INRAMFile *prev = (INRAMFile *) f->node.mln_Pred;
-				next->node.mln_Pred = (MinNode *)prev;
-				prev->node.mln_Succ = (MinNode *)next;
-			}
-			
+			INRAMFileUnlink( root, f );
 			return f;
 		}
 		
@@ -318,28 +428,9 @@ INRAMFile *INRAMFileRemoveByPath( INRAMFile *root, char *path )
 			}
 		}
 		
-		if( strcmp( path, f->nf_Path ) == 0 )
+		if( f->nf_Path != NULL && strcmp( path, f->nf_Path ) == 0 )
 		{
-			// remove entry from list and return
-			
-			if( f == root->nf_Children )
-			{
-				root->nf_Children = (INRAMFile *)root->nf_Children->node.mln_Succ;
-				root->nf_Children->node.mln_Pred = NULL;
-			}
-			else if( f->node.mln_Succ == NULL )
-			{
-				INRAMFile *nf = (INRAMFile *)f->node.mln_Pred;
-				nf->node.mln_Succ = NULL;
-			}
-			else
-			{
-				INRAMFile *next = (INRAMFile *) f->node.mln_Succ;
-				INRAMFile *prev = (INRAMFile *) f->node.mln_Pred;
-				next->node.mln_Pred = (MinNode *)prev;
-				prev->node.mln_Succ = (MinNode *)next;
-			}
-			
+			INRAMFileUnlink( root, f );
 			return f;
 		}
 		
@@ -369,6 +460,14 @@ void INRAMFileDeleteAll( INRAMFile *root )
 		
 		INRAMFileDelete( del );
 	}
+	
+	root->nf_Children = NULL;
+	root->nf_ChildCount = 0;
+	if( root->nf_ChildHash != NULL )
+	{
+		memset( root->nf_ChildHash, 0, root->nf_ChildHashSize * sizeof( INRAMFile *) );
+	}
+	INRAMFileInvalidatePaths( root );
 }
 
 /**
@@ -384,7 +483,6 @@ void INRAMFileDeleteAll( INRAMFile *root )
  */
 INRAMFile *INRAMFileGetLastPath( INRAMFile *root, const char *path, int *error )
 {
-	int pathlen = strlen( path );
 	//
 	// path is NULL return error
 	if( path == NULL )
@@ -393,6 +491,8 @@ INRAMFile *INRAMFileGetLastPath( INRAMFile *root, const char *path, int *error )
 		*error = INRAM_ERROR_PATH_DEFAULT;
 		return root;
 	}
+	
+	int pathlen = strlen( path );
 	 
 	// directory is empty return error
 	if( pathlen < 1 )
@@ -402,85 +502,78 @@ INRAMFile *INRAMFileGetLastPath( INRAMFile *root, const char *path, int *error )
 		return root;
 	}
 	
-	// going through path
-	//DEBUG("\n\n\n\nChecking path %s\n", path );
-	INRAMFile *f = root->nf_Children;
-	int i;
-	for( i=0 ; i < pathlen; i++ )
+	// check already resolved paths
+	
+	INRAMPathCache *pc = root->nf_PathCache;
+	INRAMPathCacheEntry *pce = NULL;
+	
+	if( pc != NULL )
 	{
-		if( path[ i ] == '/' )
+		pce = &(pc->pc_Entries[ INRAMHash( path, pathlen ) % INRAM_PATH_CACHE_SIZE ]);
+		if( pce->pce_Path != NULL && pce->pce_Generation == pc->pc_Generation && strcmp( pce->pce_Path, path ) == 0 )
 		{
-			i++;
-			break;
+			*error = pce->pce_File->nf_Type == INRAM_FILE ? INRAM_ERROR_FILE_FOUND : INRAM_ERROR_DIRECTORY_FOUND;
+			return pce->pce_File;
 		}
 	}
 	
-	int entryFound = 0;
+	// going through path, one hash lookup per path part
 	
-	while( f != NULL )
+	INRAMFile *f = root;
+	int start = 0;
+	int i;
+	
+	for( i = 0 ; i <= pathlen ; i++ )
 	{
-		DEBUG("Going through children: %s\n", f->nf_Name );
-		
-		// we found something what could be our target
-		
-		if( strncmp( f->nf_Name, path, i-1 ) == 0 )
+		if( path[ i ] == '/' || path[ i ] == 0 )
 		{
-			DEBUG("File name found %s\n", path );
-			if( f->nf_Type == INRAM_DIR )
+			if( i > start )
 			{
-				// if name is equal then we found our entry (directory)
-				
-				if( strcmp( f->nf_Name, path ) == 0 )
-				{
-					*error = INRAM_ERROR_DIRECTORY_FOUND;
-					return f;
-				}
-				
-				// it was not our directory, checking children
-				
-				INRAMFile *ret = INRAMFileGetLastPath( f, &(path[ i ] ), error );
-				if( ret != NULL )
+				if( f->nf_Type == INRAM_FILE )
 				{
-					DEBUG("Found entry, return\n");
-					return ret;
+					*error = INRAM_ERROR_PATH_WRONG;
+					return NULL;
 				}
 				
-				// got a problem, return
-				
-				if( *error != 0 )
+				f = INRAMFileHashGet( f, &(path[ start ]), i - start );
+				if( f == NULL )
 				{
+					DEBUG("Check path %d %d %s\n", i, pathlen, path );
+					if( i != pathlen )
+					{
+						*error = INRAM_ERROR_PATH_WRONG;
+					}
 					return NULL;
 				}
 			}
-			else
-			{
-				if( strcmp( f->nf_Name, path ) == 0 )
-				{
-					*error = INRAM_ERROR_FILE_FOUND;
-					DEBUG("File found, name: %s\n", f->nf_Name );
-					return f;
-				}
-			}
+			start = i + 1;
 		}
-		
-		f = (INRAMFile *)f->node.mln_Succ;
 	}
 	
-	DEBUG("Check path %d %d %s\n", i, pathlen, path );
-	if( i != pathlen )
+	if( f == root )
 	{
-		*error = INRAM_ERROR_PATH_WRONG;
+		*error = INRAM_ERROR_PATH_DO_NOT_EXIST;
+		return root;
 	}
-	/*for( ;i < pathlen; i++ )
+	
+	*error = f->nf_Type == INRAM_FILE ? INRAM_ERROR_FILE_FOUND : INRAM_ERROR_DIRECTORY_FOUND;
+	
+	if( pce != NULL )
 	{
-		if( path[ i ] == '/' )
+		char *npath = StringDuplicate( (char *)path );
+		if( npath != NULL )
 		{
-			*error = INRAM_ERROR_PATH_WRONG;
-			break;
+			if( pce->pce_Path != NULL )
+			{
+				FFree( pce->pce_Path );
+			}
+			pce->pce_Path = npath;
+			pce->pce_File = f;
+			pce->pce_Generation = pc->pc_Generation;
 		}
-	}*/
+	}
 	
-	return NULL;
+	return f;
 }
 
 /**
@@ -493,7 +586,6 @@ INRAMFile *INRAMFileGetLastPath( INRAMFile *root, const char *path, int *error )
  */
 INRAMFile *INRAMFileMakedirPath( INRAMFile *root, char *path, int *error )
 {
-		int pathlen = strlen( path );
 	//
 	// path is NULL return error
 	if( path == NULL )
@@ -502,6 +594,8 @@ INRAMFile *INRAMFileMakedirPath( INRAMFile *root, char *path, int *error )
 		*error = INRAM_ERROR_PATH_DEFAULT;
 		return root;
 	}
+	
+	int pathlen = strlen( path );
 	 
 	// directory is empty return error
 	if( pathlen < 1 )
@@ -511,104 +605,245 @@ INRAMFile *INRAMFileMakedirPath( INRAMFile *root, char *path, int *error )
 		return NULL;
 	}
 	
-	// going through path
-	DEBUG("Checking path\n");
-	INRAMFile *f = root->nf_Children;
-	int i;
-	for( i=0 ; i < pathlen; i++ )
+	char *npath = FCalloc( pathlen+2, sizeof(char) );
+	if( npath == NULL )
 	{
-		if( path[ i ] == '/' )
-		{
-			i++;
-			break;
-		}
+		FERROR("Cannot allocate memory for path\n");
+		*error = INRAM_ERROR_PATH_DEFAULT;
+		return NULL;
 	}
 	
-	int entryFound = 0;
+	// going through path, missing directories are created
 	
-	while( f != NULL )
+	INRAMFile *f = root;
+	int start = 0;
+	int i;
+	
+	*error = INRAM_ERROR_DIRECTORY_FOUND;
+	
+	for( i = 0 ; i <= pathlen ; i++ )
 	{
-		DEBUG("Going through children: %s\n", f->nf_Name );
-		
-		// we found something what could be our target
-		
-		if( strncmp( f->nf_Name, path, i-1 ) == 0 )
+		if( path[ i ] == '/' || path[ i ] == 0 )
 		{
-			DEBUG("File name found %s\n", path );
-			if( f->nf_Type == INRAM_DIR )
+			if( i > start )
 			{
-				// if name is equal then we found our entry (directory)
-				
-				if( strcmp( f->nf_Name, path ) == 0 )
+				INRAMFile *nd = INRAMFileHashGet( f, &(path[ start ]), i - start );
+				if( nd == NULL )
 				{
-					*error = INRAM_ERROR_DIRECTORY_FOUND;
-					return f;
+					memcpy( npath, path, i );
+					npath[ i ] = '/';
+					npath[ i+1 ] = 0;
+					
+					// name is taken from path copy
+					nd = INRAMFileNew( INRAM_DIR, npath, "" );
+					if( nd == NULL )
+					{
+						FFree( npath );
+						*error = INRAM_ERROR_PATH_DEFAULT;
+						return NULL;
+					}
+					FFree( nd->nf_Name );
+					nd->nf_Name = StringDuplicateN( (char *)&(path[ start ]), i - start );
+					
+					INRAMFileAddChild( f, nd );
+					*error = INRAM_ERROR_NO;
+					DEBUG("Directory created %s\n", npath );
 				}
-				
-				// it was not our directory, checking children
-				
-				INRAMFile *ret = INRAMFileMakedirPath( f, &(path[ i ] ), error );
-				if( ret != NULL )
-				{
-					DEBUG("Found entry, return\n");
-					return ret;
-				}
-				
-				// got a problem, return
-				
-				if( *error != 0 )
+				else if( nd->nf_Type == INRAM_FILE )
 				{
+					FFree( npath );
+					*error = INRAM_ERROR_PATH_WRONG;
 					return NULL;
 				}
+				f = nd;
 			}
+			start = i + 1;
 		}
+	}
+	
+	FFree( npath );
+	
+	return f;
+}
+
+/**
+ * Change entry name
+ *
+ * @param nf pointer to INRAMFile
+ * @param name new name
+ * @return 0 when success, otherwise error number
+ */
+int INRAMFileRename( INRAMFile *nf, char *name )
+{
+	char *nname = StringDuplicate( name );
+	if( nname == NULL )
+	{
+		return 1;
+	}
+	
+	INRAMFile *parent = nf->nf_Parent;
+	if( parent != NULL )
+	{
+		INRAMFileHashRemove( parent, nf );
+	}
+	
+	if( nf->nf_Name != NULL )
+	{
+		FFree( nf->nf_Name );
+	}
+	nf->nf_Name = nname;
+	
+	if( parent != NULL )
+	{
+		INRAMFileHashAdd( parent, nf );
+	}
+	INRAMFileInvalidatePaths( nf );
+	
+	return 0;
+}
+
+/**
+ * Read data from file
+ *
+ * @param nf pointer to INRAMFile
+ * @param offset position in file from which data will be read
+ * @param data pointer to buffer where data will be stored
+ * @param size size of buffer
+ * @return number of bytes read
+ */
+int INRAMFileRead( INRAMFile *nf, FUQUAD offset, char *data, int size )
+{
+	int read = 0;
+	
+	if( offset >= nf->nf_Size || size <= 0 )
+	{
+		return 0;
+	}
+	
+	if( (FUQUAD)size > nf->nf_Size - offset )
+	{
+		size = (int)( nf->nf_Size - offset );
+	}
+	
+	while( read < size )
+	{
+		FULONG chunk = (FULONG)( offset / INRAM_CHUNK_SIZE );
+		int chunkpos = (int)( offset % INRAM_CHUNK_SIZE );
+		int len = INRAM_CHUNK_SIZE - chunkpos;
 		
-		f = (INRAMFile *)f->node.mln_Succ;
+		if( len > size - read )
+		{
+			len = size - read;
+		}
+		
+		if( nf->nf_Chunks[ chunk ] != NULL )
+		{
+			memcpy( &(data[ read ]), &(nf->nf_Chunks[ chunk ][ chunkpos ]), len );
+		}
+		else
+		{
+			memset( &(data[ read ]), 0, len );
+		}
+		
+		read += len;
+		offset += len;
+	}
+	
+	return read;
+}
+
+/**
+ * Write data to file
+ *
+ * @param nf pointer to INRAMFile
+ * @param offset position in file where data will be stored
+ * @param data pointer to data
+ * @param size size of data
+ * @return number of bytes stored
+ */
+int INRAMFileWrite( INRAMFile *nf, FUQUAD offset, char *data, int size )
+{
+	int written = 0;
+	
+	if( size <= 0 )
+	{
+		return 0;
 	}
 	
-	DEBUG("Check path %d %d %s\n", i, pathlen, path );
-	if( i != pathlen )
+	FULONG needed = (FULONG)( ( offset + size + INRAM_CHUNK_SIZE - 1 ) / INRAM_CHUNK_SIZE );
+	if( needed > nf->nf_ChunksMax )
 	{
-		char *npath = FCalloc( pathlen+10, sizeof(char) );
-		strncpy( npath, path, pathlen );
-		strcat( npath, "/" );
-		int oldpos = i = 0;
-		for( ; i < pathlen+1 ; i++ )
+		FULONG newMax = nf->nf_ChunksMax > 0 ? nf->nf_ChunksMax : 16;
+		while( newMax < needed )
 		{
-			if( npath[ i ] == '/' || npath[ i ] == 0 )
-			{
-				npath[ i ] = 0;
-				DEBUG("founded i %d len %d path %s\n", i, pathlen, &npath[ oldpos ] );
-				INRAMFile *nd = INRAMFileNew( INRAM_DIR, NULL, &npath[ oldpos ] );
-				
-				INRAMFileAddChild( root, nd );
-				INRAMFile *oldnd = nd->nf_Parent;
-				DEBUG("---parent %s\n", oldnd->nf_Name );
-				
-				root = nd;
-				
-				oldpos = i+1;
-				//break;
-			}
+			newMax *= 2;
 		}
-		FFree( npath );
+		
+		char **nchunks = realloc( nf->nf_Chunks, newMax * sizeof( char *) );
+		if( nchunks == NULL )
+		{
+			FERROR("Cannot allocate memory for INRAMFile data\n");
+			return 0;
+		}
+		memset( &(nchunks[ nf->nf_ChunksMax ]), 0, ( newMax - nf->nf_ChunksMax ) * sizeof( char *) );
+		nf->nf_Chunks = nchunks;
+		nf->nf_ChunksMax = newMax;
 	}
-	else
+	
+	while( written < size )
 	{
-		char *npath = FCalloc( pathlen+10, sizeof(char) );
-		if( npath != NULL )
+		FULONG chunk = (FULONG)( offset / INRAM_CHUNK_SIZE );
+		int chunkpos = (int)( offset % INRAM_CHUNK_SIZE );
+		int len = INRAM_CHUNK_SIZE - chunkpos;
+		
+		if( len > size - written )
 		{
-			strncpy( npath, path, pathlen );
-			strcat( npath, "/" );
+			len = size - written;
+		}
 		
-			DEBUG("One directory created\n");
-			INRAMFile *nd = INRAMFileNew( INRAM_DIR, npath, path );
-				
-			INRAMFileAddChild( root, nd );
-			
-			FFree( npath );
+		if( nf->nf_Chunks[ chunk ] == NULL )
+		{
+			if( ( nf->nf_Chunks[ chunk ] = FCalloc( INRAM_CHUNK_SIZE, sizeof( char ) ) ) == NULL )
+			{
+				FERROR("Cannot allocate memory for INRAMFile data\n");
+				break;
+			}
 		}
+		
+		memcpy( &(nf->nf_Chunks[ chunk ][ chunkpos ]), &(data[ written ]), len );
+		
+		written += len;
+		offset += len;
+	}
+	
+	if( offset > nf->nf_Size )
+	{
+		nf->nf_Size = offset;
 	}
 	
-	return root;
+	return written;
+}
+
+/**
+ * Remove file content
+ *
+ * @param nf pointer to INRAMFile
+ */
+void INRAMFileTruncate( INRAMFile *nf )
+{
+	if( nf->nf_Chunks != NULL )
+	{
+		FULONG i;
+		for( i = 0 ; i < nf->nf_ChunksMax ; i++ )
+		{
+			if( nf->nf_Chunks[ i ] != NULL )
+			{
+				FFree( nf->nf_Chunks[ i ] );
+			}
+		}
+		FFree( nf->nf_Chunks );
+		nf->nf_Chunks = NULL;
+	}
+	nf->nf_ChunksMax = 0;
+	nf->nf_Size = 0;
 }
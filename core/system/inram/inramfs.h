@@ -36,7 +36,6 @@
 #include <core/nodes.h>
 #include <stddef.h>
 #include <time.h>
-#include <util/buffered_string.h>
 
 //
 // type of file
@@ -71,18 +70,48 @@
 		BufStringAdd( bs, "\"MetaType\":\"File\",\"Type\":\"File\" }" );
  */
 
+#define INRAM_CHUNK_SIZE			4096		// file data is stored in chunks of this size
+#define INRAM_CHILD_HASH_SIZE		16			// initial size of directory hash table
+#define INRAM_PATH_CACHE_SIZE		256			// number of resolved paths remembered by root
+
+struct INRAMFile;
+
+//
+// resolved path cache, owned by root entry
+//
+
+typedef struct INRAMPathCacheEntry
+{
+	char 					*pce_Path;
+	struct INRAMFile		*pce_File;
+	FULONG					pce_Generation;
+}INRAMPathCacheEntry;
+
+typedef struct INRAMPathCache
+{
+	FULONG					pc_Generation;		// increased when entry is removed or renamed
+	INRAMPathCacheEntry		pc_Entries[ INRAM_PATH_CACHE_SIZE ];
+}INRAMPathCache;
+
 typedef struct INRAMFile
 {
 	MinNode node;
 	int 						nf_Type;
 	char 					*nf_Name;
 	char 					*nf_Path;
-	BufString 			*nf_Data;
-	FUQUAD 				nf_Offset;
 	time_t 					*nf_CreateTime;
 	
+	char					**nf_Chunks;		// file data chunks (INRAM_CHUNK_SIZE), NULL chunk is a hole filled with zeros
+	FULONG					nf_ChunksMax;		// size of nf_Chunks table
+	FUQUAD					nf_Size;			// file size
+	
 	struct INRAMFile	*nf_Parent;
 	struct INRAMFile	*nf_Children;
+	struct INRAMFile	**nf_ChildHash;		// children by name
+	int						nf_ChildHashSize;
+	int						nf_ChildCount;
+	struct INRAMFile	*nf_HashNext;		// next entry in parent hash bucket
+	INRAMPathCache			*nf_PathCache;		// only root have it
 }INRAMFile;
 
 //
@@ -151,4 +180,28 @@ INRAMFile *INRAMFileGetLastPath( INRAMFile *root, const char *path, int *error )
 
 INRAMFile *INRAMFileMakedirPath( INRAMFile *root, char *path, int *error );
 
+//
+// change entry name
+//
+
+int INRAMFileRename( INRAMFile *nf, char *name );
+
+//
+// read data from file
+//
+
+int INRAMFileRead( INRAMFile *nf, FUQUAD offset, char *data, int size );
+
+//
+// write data to file
+//
+
+int INRAMFileWrite( INRAMFile *nf, FUQUAD offset, char *data, int size );
+
+//
+// remove file content
+//
+
+void INRAMFileTruncate( INRAMFile *nf );
+
 #endif //__SYSTEM_INRAM_INRAM_H__
\ No newline at end of file
@@ -30,6 +30,9 @@
 
 #include "json_converter.h"
 #include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
 #include "json.h"
 #include <core/nodes.h>
 #include <util/string.h>
@@ -171,125 +174,541 @@ static void process_value(json_value* value, int depth)
         }
 }
 
+//
+// Compiled serializers
+//
+
+static JSONPlan *jsonPlans = NULL;
+static pthread_mutex_t jsonPlansMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char jsonDigits[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const char jsonHex[] = "0123456789abcdef";
+
+#define JSON_INT_MAX_SIZE		11		// "-2147483648"
+#define JSON_TIMESTAMP_SIZE		21		// "YYYY-MM-DD HH:MM:SS" with quotes
+
 /**
- * Function convert C structure to JSON (char *)
+ * Write integer as text, two digits in one step
  *
- * @param desc pointer to taglist which describe "to C conversion"
- * @param jsondata json data in string
- * @return new "C" structure or NULL when error will happen
+ * @param p pointer to output
+ * @param val value
+ * @return pointer to first byte after written number
  */
-BufString *GetJSONFromStructure( FULONG *descr, void *data )
+static inline char *JSONWriteInt( char *p, int val )
 {
-	BufString *bs = BufStringNew();
-	if( bs == NULL )
+	char tmp[ JSON_INT_MAX_SIZE ];
+	char *t = tmp + sizeof( tmp );
+	unsigned int v = val < 0 ? 0u - (unsigned int)val : (unsigned int)val;
+	
+	while( v >= 100 )
+	{
+		unsigned int r = ( v % 100 ) << 1;
+		v /= 100;
+		*--t = jsonDigits[ r + 1 ];
+		*--t = jsonDigits[ r ];
+	}
+	if( v >= 10 )
+	{
+		*--t = jsonDigits[ ( v << 1 ) + 1 ];
+		*--t = jsonDigits[ v << 1 ];
+	}
+	else
+	{
+		*--t = (char)( '0' + v );
+	}
+	if( val < 0 )
+	{
+		*--t = '-';
+	}
+	
+	int len = (int)( tmp + sizeof( tmp ) - t );
+	memcpy( p, t, len );
+	return p + len;
+}
+
+/**
+ * Write number as exactly two digits, values outside 0..99 are clamped
+ *
+ * @param p pointer to output
+ * @param val value
+ * @return pointer to first byte after written digits
+ */
+static inline char *JSONWrite2Digits( char *p, int val )
+{
+	unsigned int v = val < 0 ? 0 : ( val > 99 ? 99 : (unsigned int)val );
+	p[ 0 ] = jsonDigits[ v << 1 ];
+	p[ 1 ] = jsonDigits[ ( v << 1 ) + 1 ];
+	return p + 2;
+}
+
+/**
+ * Write timestamp as "YYYY-MM-DD HH:MM:SS", always JSON_TIMESTAMP_SIZE bytes
+ *
+ * @param p pointer to output
+ * @param tp pointer to time structure
+ * @return pointer to first byte after written timestamp
+ */
+static inline char *JSONWriteTimestamp( char *p, const struct tm *tp )
+{
+	int year = tp->tm_year < 0 ? 0 : ( tp->tm_year > 9999 ? 9999 : tp->tm_year );
+	
+	*p++ = '"';
+	p = JSONWrite2Digits( p, year / 100 );
+	p = JSONWrite2Digits( p, year % 100 );
+	*p++ = '-';
+	p = JSONWrite2Digits( p, tp->tm_mon );
+	*p++ = '-';
+	p = JSONWrite2Digits( p, tp->tm_mday );
+	*p++ = ' ';
+	p = JSONWrite2Digits( p, tp->tm_hour );
+	*p++ = ':';
+	p = JSONWrite2Digits( p, tp->tm_min );
+	*p++ = ':';
+	p = JSONWrite2Digits( p, tp->tm_sec );
+	*p++ = '"';
+	return p;
+}
+
+/**
+ * Check if any of 8 bytes is control character, quote or backslash
+ *
+ * @param w 8 bytes of string
+ * @return TRUE when escaping is needed, otherwise FALSE
+ */
+static inline FBOOL JSONNeedsEscape8( uint64_t w )
+{
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t high = 0x8080808080808080ULL;
+	uint64_t quote = w ^ ( ones * '"' );
+	uint64_t bslash = w ^ ( ones * '\\' );
+	
+	uint64_t res = ( ( w - ones * 0x20 ) & ~w ) |
+		( ( quote - ones ) & ~quote ) |
+		( ( bslash - ones ) & ~bslash );
+	
+	return ( res & high ) != 0;
+}
+
+/**
+ * Write string with quotes and escaped characters. Bytes which do not need escaping are checked 8 at once.
+ *
+ * @param p pointer to output, must have space for 2 + 6 * len bytes
+ * @param s string
+ * @param len string length
+ * @return pointer to first byte after written string
+ */
+static inline char *JSONWriteString( char *p, const char *s, size_t len )
+{
+	const char *end = s + len;
+	const char *run = s;
+	
+	*p++ = '"';
+	
+	while( s < end )
+	{
+		if( end - s >= 8 )
+		{
+			uint64_t w;
+			memcpy( &w, s, sizeof( w ) );
+			if( JSONNeedsEscape8( w ) == FALSE )
+			{
+				s += 8;
+				continue;
+			}
+		}
+		
+		unsigned char c = (unsigned char)*s;
+		if( c >= 0x20 && c != '"' && c != '\\' )
+		{
+			s++;
+			continue;
+		}
+		
+		memcpy( p, run, s - run );
+		p += s - run;
+		
+		*p++ = '\\';
+		switch( c )
+		{
+			case '"': *p++ = '"'; break;
+			case '\\': *p++ = '\\'; break;
+			case '\n': *p++ = 'n'; break;
+			case '\r': *p++ = 'r'; break;
+			case '\t': *p++ = 't'; break;
+			case '\b': *p++ = 'b'; break;
+			case '\f': *p++ = 'f'; break;
+			default:
+				*p++ = 'u';
+				*p++ = '0';
+				*p++ = '0';
+				*p++ = jsonHex[ c >> 4 ];
+				*p++ = jsonHex[ c & 15 ];
+			break;
+		}
+		run = ++s;
+	}
+	
+	memcpy( p, run, s - run );
+	p += s - run;
+	*p++ = '"';
+	
+	return p;
+}
+
+/**
+ * Compile description to serialization plan
+ *
+ * @param descr pointer to taglist which describe "to C conversion"
+ * @return new JSONPlan or NULL when error appear
+ */
+static JSONPlan *JSONPlanNew( FULONG *descr )
+{
+	JSONPlan *jp = FCalloc( 1, sizeof( JSONPlan ) );
+	if( jp == NULL )
 	{
-		FERROR("ERROR: bufstring is null\n");
 		return NULL;
 	}
 	
-	DEBUG("[GetJSONFromStructure] \n");
+	FULONG *dptr;
+	int fields = 0;
 	
-	if( descr == NULL || data == NULL )
+	for( dptr = &descr[ SQL_DATA_STRUCT_START ] ; dptr[0] != SQLT_END ; dptr += 3 )
 	{
-		BufStringDelete( bs );
-		FERROR("Data structure or description was not provided!\n");
-		return 0;
+		fields++;
 	}
 	
-	if( descr[ 0 ] != SQLT_TABNAME )
+	if( fields > 0 && ( jp->jp_Fields = FCalloc( fields, sizeof( JSONField ) ) ) == NULL )
+	{
+		FFree( jp );
+		return NULL;
+	}
+	
+	jp->jp_Descr = descr;
+	jp->jp_NodeOffset = -1;
+	jp->jp_FixedSize = 2;	// {}
+	
+	for( dptr = &descr[ SQL_DATA_STRUCT_START ] ; dptr[0] != SQLT_END ; dptr += 3 )
+	{
+		int valueSize;
+		
+		switch( dptr[ 0 ] )
+		{
+			case SQLT_IDINT:
+			case SQLT_INT:
+				valueSize = JSON_INT_MAX_SIZE;
+			break;
+			
+			case SQLT_STR:
+				valueSize = 0;		// counted for every object
+			break;
+			
+			case SQLT_TIMESTAMP:
+				valueSize = JSON_TIMESTAMP_SIZE;
+			break;
+			
+			case SQLT_NODE:
+				jp->jp_NodeOffset = (long)dptr[ 2 ];
+				continue;
+				
+			default:
+				continue;
+		}
+		
+		JSONField *jf = &( jp->jp_Fields[ jp->jp_FieldsNr ] );
+		int keySize = strlen( (char *)dptr[ 1 ] ) + 4;
+		
+		if( ( jf->jf_Key = FCalloc( keySize + 1, sizeof( char ) ) ) == NULL )
+		{
+			continue;
+		}
+		jf->jf_KeySize = snprintf( jf->jf_Key, keySize + 1, ",\"%s\":", (char *)dptr[ 1 ] );
+		jf->jf_Type = dptr[ 0 ];
+		jf->jf_Offset = dptr[ 2 ];
+		
+		jp->jp_FixedSize += jf->jf_KeySize + valueSize;
+		jp->jp_FieldsNr++;
+	}
+	
+	return jp;
+}
+
+/**
+ * Get serialization plan for description. Plan is created on first use and kept until JSONPlanDeleteAll is called.
+ *
+ * @param descr pointer to taglist which describe "to C conversion"
+ * @return pointer to JSONPlan or NULL when error appear
+ */
+JSONPlan *JSONPlanGet( FULONG *descr )
+{
+	if( descr == NULL || descr[ 0 ] != SQLT_TABNAME )
 	{
-		BufStringDelete( bs );
 		FERROR("SQLT_TABNAME was not provided!\n");
-		return 0;
+		return NULL;
+	}
+	
+	pthread_mutex_lock( &jsonPlansMutex );
+	
+	JSONPlan *jp = jsonPlans;
+	while( jp != NULL )
+	{
+		if( jp->jp_Descr == descr )
+		{
+			break;
+		}
+		jp = (JSONPlan *)jp->node.mln_Succ;
+	}
+	
+	if( jp == NULL && ( jp = JSONPlanNew( descr ) ) != NULL )
+	{
+		jp->node.mln_Succ = (MinNode *)jsonPlans;
+		jsonPlans = jp;
 	}
 	
-	DEBUG("JSONParse\n");
+	pthread_mutex_unlock( &jsonPlansMutex );
+	
+	return jp;
+}
 
-	FULONG *dptr = &descr[ SQL_DATA_STRUCT_START ];		// first 2 entries inform about table, rest information provided is about columns
-	unsigned char *strptr = (unsigned char *)data;	// pointer to structure to which will will insert data
-	int opt = 0;
+/**
+ * Delete all serialization plans
+ */
+void JSONPlanDeleteAll( void )
+{
+	pthread_mutex_lock( &jsonPlansMutex );
+	
+	JSONPlan *jp = jsonPlans;
+	while( jp != NULL )
+	{
+		JSONPlan *rem = jp;
+		jp = (JSONPlan *)jp->node.mln_Succ;
+		
+		int i;
+		for( i = 0 ; i < rem->jp_FieldsNr ; i++ )
+		{
+			FFree( rem->jp_Fields[ i ].jf_Key );
+		}
+		FFree( rem->jp_Fields );
+		FFree( rem );
+	}
+	jsonPlans = NULL;
 	
-	BufStringAdd( bs, "{" );
+	pthread_mutex_unlock( &jsonPlansMutex );
+}
+
+/**
+ * Return maximum size of serialized structure
+ *
+ * @param jp pointer to JSONPlan
+ * @param data pointer to structure
+ * @return number of bytes
+ */
+static inline size_t JSONPlanSize( JSONPlan *jp, void *data )
+{
+	unsigned char *strptr = (unsigned char *)data;
+	size_t size = jp->jp_FixedSize;
+	int i;
 	
-	while( dptr[0] != SQLT_END )
+	for( i = 0 ; i < jp->jp_FieldsNr ; i++ )
 	{
-		//DEBUG("Found on pos %d tag %d   row %s\n", i, dptr[ 0 ], row[ i ] ); 
+		if( jp->jp_Fields[ i ].jf_Type == SQLT_STR )
+		{
+			char *tmpchar;
+			memcpy( &tmpchar, strptr + jp->jp_Fields[ i ].jf_Offset, sizeof( char *) );
+			if( tmpchar != NULL )
+			{
+				size += 2 + ( strlen( tmpchar ) * 6 );
+			}
+		}
+	}
+	return size;
+}
 
-		switch( dptr[ 0 ] )
+/**
+ * Serialize structure, output buffer must be big enough (see JSONPlanSize)
+ *
+ * @param jp pointer to JSONPlan
+ * @param p pointer to output
+ * @param data pointer to structure
+ * @return pointer to first byte after written object
+ */
+static char *JSONPlanWriteObject( JSONPlan *jp, char *p, void *data )
+{
+	unsigned char *strptr = (unsigned char *)data;
+	char *start = p;
+	int i;
+	
+	*p++ = '{';
+	
+	for( i = 0 ; i < jp->jp_FieldsNr ; i++ )
+	{
+		JSONField *jf = &( jp->jp_Fields[ i ] );
+		char *tmpchar = NULL;
+		
+		if( jf->jf_Type == SQLT_STR )
 		{
-			case SQLT_IDINT:	// primary key
+			memcpy( &tmpchar, strptr + jf->jf_Offset, sizeof( char *) );
+			if( tmpchar == NULL )
+			{
+				continue;
+			}
+		}
+		
+		// comma is not needed before first field
+		int skip = ( p == start + 1 ) ? 1 : 0;
+		memcpy( p, jf->jf_Key + skip, jf->jf_KeySize - skip );
+		p += jf->jf_KeySize - skip;
+		
+		switch( jf->jf_Type )
+		{
+			case SQLT_IDINT:
 			case SQLT_INT:
 				{
-					char tmp[ 256 ];
 					int tmpint;
-					memcpy( &tmpint, strptr + dptr[2], sizeof( int ) );
-					
-					if( opt == 0 )
-					{
-						sprintf( tmp, "\"%s\": %d ", (char *)dptr[ 1 ], tmpint );
-						BufStringAdd( bs, tmp );
-					}
-					else
-					{
-						sprintf( tmp, ", \"%s\": %d ", (char *)dptr[ 1 ], tmpint );
-						BufStringAdd( bs, tmp );
-					}
-					
-					opt++;
+					memcpy( &tmpint, strptr + jf->jf_Offset, sizeof( int ) );
+					p = JSONWriteInt( p, tmpint );
 				}
-				break;
-				
+			break;
+			
 			case SQLT_STR:
-				{
-					char tmp[ 512 ];
-					char *tmpchar;
-					memcpy( &tmpchar, strptr+dptr[2], sizeof( char *) );
-					
-					if( tmpchar != NULL )
-					{
-						if( opt == 0 )
-						{
-							sprintf( tmp, "\"%s\": \"%s\" ", (char *)dptr[ 1 ], tmpchar );
-							BufStringAdd( bs, tmp );
-						}
-						else
-						{
-							sprintf( tmp, ", \"%s\": \"%s\" ", (char *)dptr[ 1 ], tmpchar );
-							BufStringAdd( bs, tmp );
-						}
-					}
-					
-					opt++;
-				}
-				break;
-				
+				p = JSONWriteString( p, tmpchar, strlen( tmpchar ) );
+			break;
+			
 			case SQLT_TIMESTAMP:
-				{
-					// '2015-08-10 16:28:31'
-					char date[ 512 ];
-
-					struct tm *tp = (struct tm *)( strptr+dptr[2]);
-					if( opt == 0 )
-					{
-						sprintf( date, "\"%s\": \"%4d-%2d-%2d %2d:%2d:%2d\" ", (char *)dptr[ 1 ], tp->tm_year, tp->tm_mon, tp->tm_mday, tp->tm_hour, tp->tm_min, tp->tm_sec );
-						BufStringAdd( bs, date );
-					}
-					else
-					{
-						sprintf( date, ", \"%s\": \"%4d-%2d-%2d %2d:%2d:%2d\" ", (char *)dptr[ 1 ], tp->tm_year, tp->tm_mon, tp->tm_mday, tp->tm_hour, tp->tm_min, tp->tm_sec );
-						BufStringAdd( bs, date );
-					}
-					
-					opt++;
-				}
+				p = JSONWriteTimestamp( p, (struct tm *)( strptr + jf->jf_Offset ) );
 			break;
 		}
-		
-		dptr += 3;
 	}
 	
-	BufStringAdd( bs, "}" );
-	//DEBUG("Object to JSON parse end %s\n", bs->bs_Buffer );
+	*p++ = '}';
+	
+	return p;
+}
+
+/**
+ * Add structure as JSON object to buffer
+ *
+ * @param jp pointer to JSONPlan
+ * @param bs pointer to BufString where object will be added
+ * @param data pointer to structure
+ * @return 0 when success, otherwise error number
+ */
+int JSONPlanWrite( JSONPlan *jp, BufString *bs, void *data )
+{
+	if( jp == NULL || bs == NULL || data == NULL )
+	{
+		return 1;
+	}
+	
+	if( BufStringReserve( bs, (int)JSONPlanSize( jp, data ) ) != 0 )
+	{
+		return 2;
+	}
+	
+	char *p = JSONPlanWriteObject( jp, bs->bs_Buffer + bs->bs_Size, data );
+	*p = 0;
+	bs->bs_Size = (int)( p - bs->bs_Buffer );
+	
+	return 0;
+}
+
+/**
+ * Add list of structures as JSON array to buffer. Size of whole list is counted first,
+ * so buffer is extended only once.
+ *
+ * @param jp pointer to JSONPlan, description must contain SQLT_NODE
+ * @param bs pointer to BufString where array will be added
+ * @param data pointer to first structure in list, can be NULL
+ * @return 0 when success, otherwise error number
+ */
+int JSONPlanWriteList( JSONPlan *jp, BufString *bs, void *data )
+{
+	if( jp == NULL || bs == NULL )
+	{
+		return 1;
+	}
+	
+	if( jp->jp_NodeOffset < 0 )
+	{
+		FERROR("Description does not contain SQLT_NODE\n");
+		return 1;
+	}
+	
+	size_t size = 2;	// []
+	void *entry = data;
+	while( entry != NULL )
+	{
+		size += JSONPlanSize( jp, entry ) + 1;
+		entry = ( (MinNode *)( (unsigned char *)entry + jp->jp_NodeOffset ) )->mln_Succ;
+	}
+	
+	if( size > INT_MAX || BufStringReserve( bs, (int)size ) != 0 )
+	{
+		return 2;
+	}
+	
+	char *p = bs->bs_Buffer + bs->bs_Size;
+	*p++ = '[';
+	
+	entry = data;
+	while( entry != NULL )
+	{
+		if( entry != data )
+		{
+			*p++ = ',';
+		}
+		p = JSONPlanWriteObject( jp, p, entry );
+		entry = ( (MinNode *)( (unsigned char *)entry + jp->jp_NodeOffset ) )->mln_Succ;
+	}
+	
+	*p++ = ']';
+	*p = 0;
+	bs->bs_Size = (int)( p - bs->bs_Buffer );
+	
+	return 0;
+}
+
+/**
+ * Function convert C structure to JSON (char *)
+ *
+ * @param desc pointer to taglist which describe "to C conversion"
+ * @param jsondata json data in string
+ * @return new "C" structure or NULL when error will happen
+ */
+BufString *GetJSONFromStructure( FULONG *descr, void *data )
+{
+	DEBUG("[GetJSONFromStructure] \n");
+	
+	if( descr == NULL || data == NULL )
+	{
+		FERROR("Data structure or description was not provided!\n");
+		return NULL;
+	}
+	
+	JSONPlan *jp = JSONPlanGet( descr );
+	if( jp == NULL )
+	{
+		return NULL;
+	}
+	
+	BufString *bs = BufStringNewSize( (int)JSONPlanSize( jp, data ) + 1 );
+	if( bs == NULL )
+	{
+		FERROR("ERROR: bufstring is null\n");
+		return NULL;
+	}
+	
+	JSONPlanWrite( jp, bs, data );
 	
 	return bs;
 }
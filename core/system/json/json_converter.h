@@ -32,10 +32,37 @@
 #define __JSON_JSON_CONVERTER_H__
 
 #include <core/types.h>
+#include <core/nodes.h>
 #include <mysql/sql_defs.h>
 #include <util/buffered_string.h>
 #include "jsmn.h"
 
+//
+// Field of compiled description
+//
+
+typedef struct JSONField
+{
+	FULONG				jf_Type;		// SQLT_*
+	FULONG				jf_Offset;		// position in structure
+	char				*jf_Key;		// ,"name": - comma is skipped for first field in object
+	int					jf_KeySize;
+}JSONField;
+
+//
+// Description compiled to JSON serialization plan
+//
+
+typedef struct JSONPlan
+{
+	MinNode				node;
+	FULONG				*jp_Descr;		// description from which plan was made
+	JSONField			*jp_Fields;
+	int					jp_FieldsNr;
+	int					jp_FixedSize;	// maximum size of object without strings
+	long				jp_NodeOffset;	// position of MinNode in structure or -1
+}JSONPlan;
+
 //
 //
 //
@@ -52,6 +79,30 @@ BufString *GetJSONFromStructure( FULONG *desc, void *data );
 //
 //
 
+JSONPlan *JSONPlanGet( FULONG *descr );
+
+//
+//
+//
+
+void JSONPlanDeleteAll( void );
+
+//
+//
+//
+
+int JSONPlanWrite( JSONPlan *jp, BufString *bs, void *data );
+
+//
+//
+//
+
+int JSONPlanWriteList( JSONPlan *jp, BufString *bs, void *data );
+
+//
+//
+//
+
 void *GetStructureFromJSON( FULONG *desc, const char *data );
 
 #endif // __JSON_JSON_CONVERTER_H__
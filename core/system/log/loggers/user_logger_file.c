@@ -144,3 +144,37 @@ int StoreInformation( struct UserLogger *s, UserSession *session, char *actions,
 	return 0;
 }
 
+
+/**
+ * Store list of entries, file is flushed once per batch
+ *
+ * @param s pointer to UserLogger
+ * @param entries list of UserLog entries connected by node
+ * @return 0 when success, otherwise error number
+ */
+
+int StoreInformationBatch( struct UserLogger *s, UserLog *entries )
+{
+	SpecialData *sd = s->ul_SD;
+	if( sd->sd_FP == NULL )
+	{
+		return 1;
+	}
+	
+	UserLog *ul = entries;
+	while( ul != NULL )
+	{
+		struct tm tm;
+		char datestring[ 64 ];
+		
+		localtime_r( &ul->ul_CreatedTime, &tm );
+		strftime( datestring, sizeof(datestring), "%c", &tm );
+		
+		fprintf( sd->sd_FP, "Date: %s, UserID: %llu, UserSessionID: %s, Action: %s, Information: %s\n",  datestring, ul->ul_UserID, ul->ul_UserSessionID, ul->ul_Action, ul->ul_Information );
+		
+		ul = (UserLog *)ul->node.mln_Succ;
+	}
+	fflush( sd->sd_FP );
+	
+	return 0;
+}
@@ -32,6 +32,7 @@
 #include "user_logger_sql.h"
 #include <system/log/user_logger.h>
 #include <system/systembase.h>
+#include <util/buffered_string.h>
 
 typedef struct SpecialData
 {
@@ -159,3 +160,80 @@ int StoreInformation( struct UserLogger *s, UserSession *session, char *actions,
 	return 0;
 }
 
+
+//
+// append escaped string value or NULL to query
+//
+
+static void AppendSQLString( MYSQLLibrary *sqllib, BufString *bs, char *str )
+{
+	char *esc = sqllib->MakeEscapedString( sqllib, str );
+	if( esc != NULL )
+	{
+		BufStringAddSize( bs, "'", 1 );
+		BufStringAdd( bs, esc );
+		BufStringAddSize( bs, "'", 1 );
+		FFree( esc );
+	}
+	else
+	{
+		BufStringAddSize( bs, "NULL", 4 );
+	}
+}
+
+/**
+ * Store list of entries, multi-row inserts are used to save round trips
+ *
+ * @param s pointer to UserLogger
+ * @param entries list of UserLog entries connected by node
+ * @return 0 when success, otherwise error number
+ */
+
+int StoreInformationBatch( struct UserLogger *s, UserLog *entries )
+{
+	SpecialData *sd = s->ul_SD;
+	if( sd->sd_LibSQL == NULL )
+	{
+		return 1;
+	}
+	
+	int error = 0;
+	UserLog *ul = entries;
+	
+	while( ul != NULL )
+	{
+		BufString *bs = BufStringNew();
+		if( bs == NULL )
+		{
+			return 2;
+		}
+		BufStringAdd( bs, "INSERT INTO FUserLog (UsersessiondID,UserID,Action,Information,CreatedTime) VALUES " );
+		
+		int rows = 0;
+		while( ul != NULL && rows < USER_LOGGER_SQL_BATCH_ROWS )
+		{
+			char tmp[ 64 ];
+			
+			BufStringAddSize( bs, rows == 0 ? "(" : ",(", rows == 0 ? 1 : 2 );
+			AppendSQLString( sd->sd_LibSQL, bs, ul->ul_UserSessionID );
+			int len = snprintf( tmp, sizeof(tmp), ",%llu,", (unsigned long long)ul->ul_UserID );
+			BufStringAddSize( bs, tmp, len );
+			AppendSQLString( sd->sd_LibSQL, bs, ul->ul_Action );
+			BufStringAddSize( bs, ",", 1 );
+			AppendSQLString( sd->sd_LibSQL, bs, ul->ul_Information );
+			len = snprintf( tmp, sizeof(tmp), ",%ld)", (long)ul->ul_CreatedTime );
+			BufStringAddSize( bs, tmp, len );
+			
+			rows++;
+			ul = (UserLog *)ul->node.mln_Succ;
+		}
+		
+		if( sd->sd_LibSQL->QueryWithoutResults( sd->sd_LibSQL, bs->bs_Buffer ) != 0 )
+		{
+			FERROR("[UserLoggerSQL] Cannot store %d entries\n", rows );
+			error = 3;
+		}
+		BufStringDelete( bs );
+	}
+	return error;
+}
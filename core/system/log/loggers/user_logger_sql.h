@@ -34,6 +34,8 @@
 #include <system/log/user_logger.h>
 #include <mysql/mysqllibrary.h>
 
+#define USER_LOGGER_SQL_BATCH_ROWS	256		// rows stored by one INSERT
+
 //
 //
 //
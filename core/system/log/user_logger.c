@@ -71,6 +71,7 @@ UserLogger *UserLoggerCreate( void *sb, const char *path, const char *name )
 			ulogger->deinit = dlsym( ulogger->handle, "deinit");
 			
 			ulogger->StoreInformation = dlsym( ulogger->handle, "StoreInformation");
+			ulogger->StoreInformationBatch = dlsym( ulogger->handle, "StoreInformationBatch");
 		}
 		else
 		{
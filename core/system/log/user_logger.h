@@ -79,6 +79,7 @@ typedef struct UserLogger
 	void                    (*deinit)( struct UserLogger *s );
 	
 	int                     (*StoreInformation)( struct UserLogger *s, UserSession *session, char *actions, char *information );
+	int                     (*StoreInformationBatch)( struct UserLogger *s, UserLog *entries );	// optional, list of entries connected by node
 	void                   *ul_SD;  // special data
 	void                   *ul_SB; // system base
 }UserLogger;
@@ -38,6 +38,108 @@
 #include <sys/stat.h>
 #include <util/buffered_string.h>
 #include <dirent.h>
+#include <errno.h>
+#include <time.h>
+
+//
+// release list of entries
+//
+
+static void UserLogListDelete( UserLog *ul )
+{
+	while( ul != NULL )
+	{
+		UserLog *next = (UserLog *)ul->node.mln_Succ;
+		FFree( ul );		// strings are allocated together with entry
+		ul = next;
+	}
+}
+
+/**
+ * Store entries by active logger
+ *
+ * @param ulm pointer to UserLoggerManager
+ * @param entries list of entries
+ */
+
+static void UserLoggerManagerFlush( UserLoggerManager *ulm, UserLog *entries )
+{
+	UserLogger *logger = ulm->ulm_ActiveLogger;
+	
+	if( logger->StoreInformationBatch != NULL )
+	{
+		logger->StoreInformationBatch( logger, entries );
+	}
+	else
+	{
+		// loggers without batch support get entries one by one
+		UserSession ses;
+		UserLog *ul = entries;
+		
+		while( ul != NULL )
+		{
+			memset( &ses, 0, sizeof( UserSession ) );
+			ses.us_UserID = ul->ul_UserID;
+			ses.us_SessionID = ul->ul_UserSessionID;
+			logger->StoreInformation( logger, &ses, ul->ul_Action, ul->ul_Information );
+			ul = (UserLog *)ul->node.mln_Succ;
+		}
+	}
+}
+
+/**
+ * Background writer, stores queued entries when there is enough of them or when time passed
+ *
+ * @param data pointer to FThread
+ */
+
+static void *UserLoggerManagerWriter( void *data )
+{
+	FThread *thread = (FThread *)data;
+	UserLoggerManager *ulm = (UserLoggerManager *)thread->t_Data;
+	
+	pthread_mutex_lock( &ulm->ulm_Mutex );
+	while( TRUE )
+	{
+		struct timespec ts;
+		clock_gettime( CLOCK_REALTIME, &ts );
+		ts.tv_sec += USER_LOGGER_FLUSH_INTERVAL;
+		
+		while( ulm->ulm_QueueSize < USER_LOGGER_FLUSH_SIZE && thread->t_Quit == FALSE )
+		{
+			if( pthread_cond_timedwait( &ulm->ulm_Cond, &ulm->ulm_Mutex, &ts ) == ETIMEDOUT )
+			{
+				break;
+			}
+		}
+		
+		UserLog *entries = ulm->ulm_Queue;
+		int count = ulm->ulm_QueueSize;
+		ulm->ulm_Queue = ulm->ulm_QueueTail = NULL;
+		ulm->ulm_QueueSize = 0;
+		FBOOL quit = thread->t_Quit;
+		pthread_mutex_unlock( &ulm->ulm_Mutex );
+		
+		if( entries != NULL )
+		{
+			UserLoggerManagerFlush( ulm, entries );
+			UserLogListDelete( entries );
+		}
+		
+		pthread_mutex_lock( &ulm->ulm_Mutex );
+		ulm->ulm_Stored += count;
+		
+		if( quit == TRUE && ulm->ulm_Queue == NULL )
+		{
+			break;
+		}
+	}
+	pthread_mutex_unlock( &ulm->ulm_Mutex );
+	
+	DEBUG("[UserLoggerManager] Writer quit, stored %llu dropped %llu\n", ulm->ulm_Stored, ulm->ulm_Dropped );
+	
+	return NULL;
+}
 
 //
 //
@@ -125,6 +227,14 @@ UserLoggerManager *UserLoggerManagerNew( void *sb )
 			
 			LibraryClose( plib );
 		}
+		
+		pthread_mutex_init( &ulm->ulm_Mutex, NULL );
+		pthread_cond_init( &ulm->ulm_Cond, NULL );
+		
+		if( ulm->ulm_ActiveLogger != NULL )
+		{
+			ulm->ulm_Thread = ThreadNew( UserLoggerManagerWriter, ulm, TRUE );
+		}
 	}
 	
 	return ulm;
@@ -139,6 +249,22 @@ void UserLoggerManagerDelete( UserLoggerManager *ulm )
 	DEBUG("UserLoggerManagerDelete\n");
 	if( ulm != NULL )
 	{
+		// writer stores everything what is in queue before it quits
+		if( ulm->ulm_Thread != NULL )
+		{
+			pthread_mutex_lock( &ulm->ulm_Mutex );
+			ulm->ulm_Thread->t_Quit = TRUE;
+			pthread_cond_signal( &ulm->ulm_Cond );
+			pthread_mutex_unlock( &ulm->ulm_Mutex );
+			
+			ThreadDelete( ulm->ulm_Thread );
+			ulm->ulm_Thread = NULL;
+		}
+		UserLogListDelete( ulm->ulm_Queue );
+		
+		pthread_cond_destroy( &ulm->ulm_Cond );
+		pthread_mutex_destroy( &ulm->ulm_Mutex );
+		
 		UserLogger *ul = ulm->ulm_Loggers;
 		UserLogger *dl = ul;
 		
@@ -152,4 +278,81 @@ void UserLoggerManagerDelete( UserLoggerManager *ulm )
 		
 		FFree( ulm );
 	}
-}
\ No newline at end of file
+}
+
+/**
+ * Add user action to log. Entry is copied and stored later by background writer.
+ *
+ * @param ulm pointer to UserLoggerManager
+ * @param ses session which made action
+ * @param path action
+ * @param information additional information
+ */
+
+void UserLoggerStore( UserLoggerManager *ulm, UserSession *ses, char *path, char *information )
+{
+	if( ulm == NULL || ulm->ulm_ActiveLogger == NULL || ulm->ulm_Thread == NULL || ses == NULL )
+	{
+		return;
+	}
+	
+	int sesLen = ses->us_SessionID != NULL ? strlen( ses->us_SessionID ) + 1 : 0;
+	int pathLen = path != NULL ? strlen( path ) + 1 : 0;
+	int infoLen = information != NULL ? strlen( information ) + 1 : 0;
+	
+	// entry and strings are kept in one allocation
+	UserLog *ul = FMalloc( sizeof( UserLog ) + sesLen + pathLen + infoLen );
+	if( ul == NULL )
+	{
+		return;
+	}
+	
+	char *str = (char *)( ul + 1 );
+	memset( ul, 0, sizeof( UserLog ) );
+	ul->ul_UserID = ses->us_UserID;
+	ul->ul_CreatedTime = time( NULL );
+	if( sesLen > 0 )
+	{
+		ul->ul_UserSessionID = memcpy( str, ses->us_SessionID, sesLen );
+		str += sesLen;
+	}
+	if( pathLen > 0 )
+	{
+		ul->ul_Action = memcpy( str, path, pathLen );
+		str += pathLen;
+	}
+	if( infoLen > 0 )
+	{
+		ul->ul_Information = memcpy( str, information, infoLen );
+	}
+	
+	pthread_mutex_lock( &ulm->ulm_Mutex );
+	if( ulm->ulm_QueueSize >= USER_LOGGER_QUEUE_MAX )
+	{
+		// logger cannot keep up, requests should not wait for it
+		if( ( ulm->ulm_Dropped++ % 1000 ) == 0 )
+		{
+			FERROR("[UserLoggerManager] Queue is full, entries dropped: %llu\n", ulm->ulm_Dropped );
+		}
+		pthread_mutex_unlock( &ulm->ulm_Mutex );
+		FFree( ul );
+		return;
+	}
+	
+	if( ulm->ulm_QueueTail != NULL )
+	{
+		ulm->ulm_QueueTail->node.mln_Succ = (MinNode *)ul;
+	}
+	else
+	{
+		ulm->ulm_Queue = ul;
+	}
+	ulm->ulm_QueueTail = ul;
+	ulm->ulm_QueueSize++;
+	
+	if( ulm->ulm_QueueSize == USER_LOGGER_FLUSH_SIZE )
+	{
+		pthread_cond_signal( &ulm->ulm_Cond );
+	}
+	pthread_mutex_unlock( &ulm->ulm_Mutex );
+}
@@ -36,6 +36,12 @@
 #include <stdlib.h>
 #include "user_logger.h"
 #include <util/log/log.h>
+#include <core/thread.h>
+#include <pthread.h>
+
+#define USER_LOGGER_QUEUE_MAX			8192		// entries above this limit are dropped
+#define USER_LOGGER_FLUSH_SIZE			256			// writer is woken up when queue has that many entries
+#define USER_LOGGER_FLUSH_INTERVAL		2			// seconds, maximum time entry waits in queue
 
 //
 // definition
@@ -46,6 +52,17 @@ typedef struct UserLoggerManager
 	void                         *ulm_SB; // pointer to SystemBase
 	UserLogger             *ulm_Loggers;
 	UserLogger             *ulm_ActiveLogger;
+	
+	// entries are stored by background writer
+	pthread_mutex_t        ulm_Mutex;
+	pthread_cond_t         ulm_Cond;
+	UserLog                  *ulm_Queue;
+	UserLog                  *ulm_QueueTail;
+	int                         ulm_QueueSize;
+	FThread                 *ulm_Thread;
+	
+	FUQUAD                 ulm_Stored;		// counters
+	FUQUAD                 ulm_Dropped;
 }UserLoggerManager;
 
 //
@@ -64,14 +81,7 @@ void UserLoggerManagerDelete( UserLoggerManager *ulm );
 //
 //
 
-inline void UserLoggerStore( UserLoggerManager *ulm, UserSession *ses, char *path, char *information )
-{
-	DEBUG("SESSION %p\n", ses );
-	if( ulm->ulm_ActiveLogger != NULL && ses != NULL )
-	{
-		ulm->ulm_ActiveLogger->StoreInformation( ulm->ulm_ActiveLogger, ses, path, information );
-	}
-}
+void UserLoggerStore( UserLoggerManager *ulm, UserSession *ses, char *path, char *information );
 
 
 #endif // __UTIL_USER_LOGGER_MANAGER_H__
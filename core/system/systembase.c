@@ -57,6 +57,8 @@
 #include <util/md5.h>
 #include <network/digcalc.h>
 #include <network/mime.h>
+#include <network/tls_tickets.h>
+#include <system/json/json_converter.h>
 #include <private-libwebsockets.h>
 #include <system/handler/door_notification.h>
 
@@ -541,6 +543,12 @@ SystemBase *SystemInit( void )
 		Log( FLOG_ERROR, "Cannot initialize USMNew\n");
 	}
 	
+	l->sl_USD = USDNew( l );
+	if( l->sl_USD == NULL )
+	{
+		Log( FLOG_ERROR, "Cannot initialize USDNew\n");
+	}
+	
 	l->sl_UM = UMNew( l );
 	if( l->sl_UM == NULL )
 	{
@@ -603,11 +611,15 @@ SystemBase *SystemInit( void )
 	#define MINS60 MINS6*10
 	#define MINS360 6*MINS60
 
-	CoreEvent *nce = EventAdd( l->sl_EventManager, DoorNotificationRemoveEntries, l, time( NULL )+MINS30, MINS30, -1 );
-	nce = EventAdd( l->sl_EventManager, USMRemoveOldSessions, l, time( NULL )+MINS360, MINS360, -1 );
+	EventAdd( l->sl_EventManager, DoorNotificationRemoveEntries, l, time( NULL )+MINS30, MINS30, -1 );
+	EventAdd( l->sl_EventManager, USMRemoveOldSessions, l, time( NULL )+MINS360, MINS360, -1 );
 	//TODO test, to remove
-	//nce = EventAdd( l->sl_EventManager, USMRemoveOldSessions, l, time( NULL )+130, 130, -1 );
-	nce = EventAdd( l->sl_EventManager, PIDThreadManagerRemoveThreads, l->sl_PIDTM, time( NULL )+MINS60, MINS60, -1 );
+	//EventAdd( l->sl_EventManager, USMRemoveOldSessions, l, time( NULL )+130, 130, -1 );
+	EventAdd( l->sl_EventManager, PIDThreadManagerRemoveThreads, l->sl_PIDTM, time( NULL )+MINS60, MINS60, -1 );
+	EventAdd( l->sl_EventManager, USMSessionTouchFlushEvent, l, time( NULL )+USM_TOUCH_FLUSH_INTERVAL, USM_TOUCH_FLUSH_INTERVAL, -1 );
+	EventAdd( l->sl_EventManager, USDFlushEvent, l, time( NULL )+USD_FLUSH_INTERVAL, USD_FLUSH_INTERVAL, -1 );
+	EventAdd( l->sl_EventManager, UserDeviceUnmountIdle, l, time( NULL )+DEVICE_IDLE_CHECK_INTERVAL, DEVICE_IDLE_CHECK_INTERVAL, -1 );
+	EventAdd( l->sl_EventManager, TLSTicketKeysRefreshEvent, l, time( NULL )+TLS_TICKET_CHECK_INTERVAL, TLS_TICKET_CHECK_INTERVAL, -1 );
 	
 	l->sl_USM->usm_UM = l->sl_UM;
 	l->sl_UM->um_USM = l->sl_USM;
@@ -684,6 +696,8 @@ void SystemClose( SystemBase *l )
 		l->sl_Dictionary = NULL;
 	}
 	
+	JSONPlanDeleteAll();
+	
 	// Close image library
 	l->LibraryImageDrop( l, l->ilib );
 	
@@ -697,11 +711,28 @@ void SystemClose( SystemBase *l )
 		DEBUG("[SystemBase] Remove module %s\n", remm->Name );
 		EModuleDelete( remm );
 	}
+	
+	if( l->sl_UserSnapshotThread != NULL )
+	{
+		ThreadDelete( l->sl_UserSnapshotThread );
+		l->sl_UserSnapshotThread = NULL;
+	}
+	
+	if( l->sl_UserSnapshotPath != NULL )
+	{
+		UserSnapshotSave( l, l->sl_UserSnapshotPath );
+		FFree( l->sl_UserSnapshotPath );
+		l->sl_UserSnapshotPath = NULL;
+	}
 
 	if( l->sl_USM != NULL )
 	{
 		USMDelete( l->sl_USM );
 	}
+	if( l->sl_USD != NULL )
+	{
+		USDDelete( l->sl_USD );
+	}
 	if( l->sl_UM != NULL )
 	{
 		UMDelete(  l->sl_UM );
@@ -878,9 +909,19 @@ int SystemInitExternal( SystemBase *l )
 	
 		time_t timestamp = time ( NULL );
 	
-		Log( FLOG_INFO,  "[SystemBase] Loading groups from DB\n");
-	
-		l->sl_UM->um_UserGroups = LoadGroups( l );
+		// snapshot from previous run is used when it is valid, database is checked later in background
+		
+		FBOOL snapshotLoaded = FALSE;
+		if( l->sl_UserSnapshotPath != NULL && UserSnapshotLoad( l, l->sl_UserSnapshotPath, LOGOUT_TIME ) == 0 )
+		{
+			snapshotLoaded = TRUE;
+		}
+		else
+		{
+			Log( FLOG_INFO,  "[SystemBase] Loading groups from DB\n");
+		
+			l->sl_UM->um_UserGroups = LoadGroups( l );
+		}
 		
 		//
 		// get sentinel
@@ -933,8 +974,12 @@ int SystemInitExternal( SystemBase *l )
 		// get all user sessions from DB
 		//
 	
-		l->sl_USM->usm_Sessions = USMGetSessionsByTimeout( l->sl_USM, LOGOUT_TIME );
-		UserSession *usess = l->sl_USM->usm_Sessions;
+		if( snapshotLoaded == FALSE )
+		{
+			l->sl_USM->usm_Sessions = USMGetSessionsByTimeout( l->sl_USM, LOGOUT_TIME );
+		}
+		// sessions from snapshot are already connected to users
+		UserSession *usess = snapshotLoaded == FALSE ? l->sl_USM->usm_Sessions : NULL;
 		DEBUG("[SystemBase] Got users by timeout\n");
 		
 		while( usess != NULL )
@@ -942,16 +987,12 @@ int SystemInitExternal( SystemBase *l )
 			DEBUG("[SystemBase] Assigning sessions to users by ID %ld\n", usess->us_ID );
 			
 			// checking if user exist, if not it is created
-			User *usr = l->sl_UM->um_Users;
-			while( usr != NULL )
+			User *usr = UMGetUserByIDRef( l->sl_UM, usess->us_UserID );
+			if( usr != NULL )
 			{
-				// if user is provided we only setup link
-				if( usess->us_UserID == usr->u_ID )
-				{
-					usess->us_User = usr;
-					break;
-				}
-				usr = (User *) usr->node.mln_Succ;
+				// if user is provided we only setup link, user stays in list
+				usess->us_User = usr;
+				UMReleaseUser( l->sl_UM, usr );
 			}
 		
 			if( usr == NULL )
@@ -962,8 +1003,7 @@ int SystemInitExternal( SystemBase *l )
 			
 				if( usr != NULL )
 				{
-					usr->node.mln_Succ = (MinNode *)l->sl_UM->um_Users;
-					l->sl_UM->um_Users = usr;
+					UMAddUser( l->sl_UM, usr );
 			
 					UserAddSession( usr, usess );
 					usess->us_User = usr;
@@ -996,7 +1036,7 @@ int SystemInitExternal( SystemBase *l )
 		{
 			DEBUG("[SystemBase] Sentinel!= NULL\n");
 			FBOOL fromMem = FALSE;
-			User *sentuser = UMGetUserByName( l->sl_UM, l->sl_Sentinel->s_ConfigUsername );
+			User *sentuser = UMGetUserByNameRef( l->sl_UM, l->sl_Sentinel->s_ConfigUsername );
 			if( sentuser == NULL )
 			{
 				sentuser = UMGetUserByNameDB( l->sl_UM, l->sl_Sentinel->s_ConfigUsername );
@@ -1011,8 +1051,12 @@ int SystemInitExternal( SystemBase *l )
 				// add user to list
 				if( fromMem == FALSE )
 				{
-					sentuser->node.mln_Succ = (MinNode *)l->sl_UM->um_Users;
-					l->sl_UM->um_Users = sentuser;
+					UMAddUser( l->sl_UM, sentuser );
+				}
+				else
+				{
+					// user stays in list
+					UMReleaseUser( l->sl_UM, sentuser );
 				}
 				
 				DEBUG("[SystemBase] Sentinel user is avaiable\n");
@@ -1107,18 +1151,33 @@ int SystemInitExternal( SystemBase *l )
 			}
 		}
 	
-		User *tmpUser = l->sl_UM->um_Users;
-		while( tmpUser != NULL )
+		if( snapshotLoaded == TRUE )
 		{
-			DEBUG( "[SystemBase] FINDING DRIVES FOR USER %s.....\n\n", tmpUser->u_Name );
-			UserDeviceMount( l, sqllib, tmpUser, 1 );
-			DEBUG( "[SystemBase] DONE FINDING DRIVES FOR USER %s.....\n\n", tmpUser->u_Name );
-			tmpUser = (User *)tmpUser->node.mln_Succ;
+			// doors, groups and applications are loaded by reconcile thread
+			l->sl_UserSnapshotThread = UserSnapshotReconcileStart( l );
+		}
+		else
+		{
+			unsigned int usersNr = 0, ui;
+			User **users = UMGetUsersRef( l->sl_UM, &usersNr );
+			for( ui = 0 ; ui < usersNr ; ui++ )
+			{
+				User *tmpUser = users[ ui ];
+				DEBUG( "[SystemBase] FINDING DRIVES FOR USER %s.....\n\n", tmpUser->u_Name );
+				UserDeviceMount( l, sqllib, tmpUser, 1 );
+				DEBUG( "[SystemBase] DONE FINDING DRIVES FOR USER %s.....\n\n", tmpUser->u_Name );
+			}
+			UMReleaseUsers( l->sl_UM, users, usersNr );
 		}
 		
 		l->LibraryMYSQLDrop( l, sqllib );
 	}
 	
+	if( l->sl_UserSnapshotPath != NULL )
+	{
+		EventAdd( l->sl_EventManager, UserSnapshotSaveEvent, l, time( NULL )+USER_SNAPSHOT_INTERVAL, USER_SNAPSHOT_INTERVAL, -1 );
+	}
+	
 	
 	// mount INRAM drive
 	/*
@@ -1399,7 +1458,7 @@ int UserDeviceMount( SystemBase *l, MYSQLLibrary *sqllib, User *usr, int force )
 		return -1;
 	}
 	
-	if( usr->u_MountedDevs != NULL && force == 0 )
+	if( ( usr->u_MountedDevs != NULL || usr->u_DeviceDescriptors != NULL ) && force == 0 )
 	{
 		DEBUG("[UserDeviceMount] Devices are already mounted\n");
 		return 0;
@@ -1409,7 +1468,7 @@ int UserDeviceMount( SystemBase *l, MYSQLLibrary *sqllib, User *usr, int force )
 
 	sqllib->SNPrintF( sqllib, temptext, sizeof(temptext) ,"\
 		SELECT \
-			`Name`, `Type`, `Server`, `Port`, `Path`, `Mounted`, `UserID`, `ID`\
+			`Name`, `Type`, `Server`, `Port`, `Path`, `Mounted`, `UserID`, `ID`, `Config`, `Execute`\
 		FROM `Filesystem` f\
 		WHERE\
 		(\
@@ -1445,6 +1504,36 @@ int UserDeviceMount( SystemBase *l, MYSQLLibrary *sqllib, User *usr, int force )
 			int mount = atoi( row[ 5 ] );
 			int id = atol( row[ 7 ] );
 			User *owner = NULL;
+			
+			// network doors are only registered here and mounted when user touch them
+			if( DeviceMountOnDemand( l, row[ 1 ], row[ 8 ] ) == TRUE )
+			{
+				FBOOL known = FALSE;
+				File *ldev = usr->u_MountedDevs;
+				while( ldev != NULL && known == FALSE )
+				{
+					if( ldev->f_ID == (FULONG)id ) known = TRUE;
+					ldev = (File *)ldev->node.mln_Succ;
+				}
+				UserDeviceDescriptor *ludd = usr->u_DeviceDescriptors;
+				while( ludd != NULL && known == FALSE )
+				{
+					if( ludd->udd_ID == (FULONG)id ) known = TRUE;
+					ludd = (UserDeviceDescriptor *)ludd->node.mln_Succ;
+				}
+				
+				if( known == FALSE )
+				{
+					UserDeviceDescriptor *udd = UserDeviceDescriptorNew( id, row[ 0 ], row[ 1 ], row[ 4 ], row[ 8 ], row[ 9 ], mount );
+					if( udd != NULL )
+					{
+						DEBUG("[UserDeviceMount] \tDoor %s will be mounted on demand\n", row[ 0 ] );
+						udd->node.mln_Succ = (MinNode *)usr->u_DeviceDescriptors;
+						usr->u_DeviceDescriptors = udd;
+					}
+				}
+				continue;
+			}
 
 			struct TagItem tags[] = {
 				{ FSys_Mount_Path,    (FULONG)row[ 4 ] },
@@ -1676,6 +1765,7 @@ MYSQLLibrary *LibraryMYSQLGet( SystemBase *l )
 	int timer = 0;
 	int retries = 0;
 	int usingSleep = 0;
+	FUQUAD start = MetricsTime();
 	
 	while( TRUE )
 	{
@@ -1742,6 +1832,8 @@ MYSQLLibrary *LibraryMYSQLGet( SystemBase *l )
 		*/
 	}
 	
+	MetricsRecordSince( METRIC_STAGE_SQL_CHECKOUT, start );
+	
 	return retlib;
 }
 
@@ -1984,55 +2076,20 @@ Sentinel* GetSentinelUser(SystemBase* l)
 /**
  * Send message via websockets
  *
+ * Message is queued on every connection of user session and written by websocket thread.
+ *
  * @param l pointer to SystemBase
  * @param usersession recipient of 
  * @param msg message which will be send
  * @param len length of the message
- * @return 0 if message was sent otherwise error number
+ * @return number of queued bytes
  */
 
 int WebSocketSendMessage( SystemBase *l, UserSession *usersession, char *msg, int len )
 {
-	unsigned char *buf;
-	int bytes = 0;
-	
-	//DEBUG("\n\n\nWebSocketSendMessage start %p device %s\n", usersession, usersession->us_DeviceIdentity );
+	int bytes = WebSocketSendMessageInt( usersession, msg, len );
 	
-	if( pthread_mutex_lock( &usersession->us_WSMutex ) == 0 )
-	{
-		buf = (unsigned char *)FCalloc( LWS_SEND_BUFFER_PRE_PADDING + len + LWS_SEND_BUFFER_POST_PADDING + 128, sizeof( unsigned char ) );
-		if( buf != NULL )
-		{
-			memcpy( buf + LWS_SEND_BUFFER_PRE_PADDING, msg,  len );
-		
-			DEBUG("[SystemBase] Writing to websockets, string '%s' size %d\n",msg, len );
-
-			WebsocketClient *wsc = usersession->us_WSConnections;
-			while( wsc != NULL )
-			{
-				DEBUG("[SystemBase] Writing to websockets, pointer to ws %p\n", wsc->wc_Wsi );
-				if( wsc->wc_Wsi != NULL )
-				{
-					bytes += lws_write( wsc->wc_Wsi , buf + LWS_SEND_BUFFER_PRE_PADDING , len, LWS_WRITE_TEXT );
-				}
-				else
-				{
-					DEBUG("[SystemBase] User session do not have WS connection\n");
-				}
-				wsc = (WebsocketClient *)wsc->node.mln_Succ;
-			}
-		
-			FFree( buf );
-		}
-		else
-		{
-			Log( FLOG_ERROR,"Cannot allocate memory for message\n");
-			pthread_mutex_unlock( &usersession->us_WSMutex );
-			return 0;
-		}
-		pthread_mutex_unlock( &usersession->us_WSMutex );
-	}
-	DEBUG("[SystemBase] WebSocketSendMessage end, wrote %d bytes\n", bytes );
+	DEBUG("[SystemBase] WebSocketSendMessage end, queued %d bytes\n", bytes );
 	
 	return bytes;
 }
@@ -2043,44 +2100,80 @@ int WebSocketSendMessage( SystemBase *l, UserSession *usersession, char *msg, in
  * @param usersession recipient of 
  * @param msg message which will be send
  * @param len length of the message
- * @return 0 if message was sent otherwise error number
+ * @return number of queued bytes
  */
 
 int WebSocketSendMessageInt( UserSession *usersession, char *msg, int len )
 {
-	unsigned char *buf;
+	WebsocketPayload *wp = WebsocketPayloadNew( msg, len );
+	if( wp == NULL )
+	{
+		Log( FLOG_ERROR,"Cannot allocate memory for message\n");
+		return 0;
+	}
+	
+	DEBUG("[SystemBase] Writing to websockets, string '%s' size %d\n", msg, len );
+	
+	int bytes = WebSocketSendPayload( usersession, wp );
+	WebsocketPayloadUnref( wp );
+	
+	return bytes;
+}
+
+/**
+ * Send prepared message via websockets
+ *
+ * Payload is shared by all connections, so message sent to many sessions is prepared only once.
+ *
+ * @param usersession recipient of 
+ * @param wp pointer to payload, caller keeps own reference
+ * @return number of queued bytes
+ */
+
+int WebSocketSendPayload( UserSession *usersession, WebsocketPayload *wp )
+{
+	return WebSocketSendPayloadParts( usersession, &wp, 1 );
+}
+
+/**
+ * Send message built from few prepared payloads via websockets
+ *
+ * Parts are delivered as fragments of one websocket message.
+ *
+ * @param usersession recipient of 
+ * @param parts table of payloads, caller keeps own references
+ * @param count number of payloads
+ * @return number of queued bytes
+ */
+
+int WebSocketSendPayloadParts( UserSession *usersession, WebsocketPayload **parts, int count )
+{
 	int bytes = 0;
 	
+	if( usersession == NULL || parts == NULL )
+	{
+		return 0;
+	}
+	
+	// mutex only protects list of connections, nothing is written to sockets here
 	if( pthread_mutex_lock( &usersession->us_WSMutex ) == 0 )
 	{
-		buf = (unsigned char *)FCalloc( LWS_SEND_BUFFER_PRE_PADDING + len + LWS_SEND_BUFFER_POST_PADDING + 128+24, sizeof( unsigned char ) );
-		if( buf != NULL )
+		WebsocketClient *wsc = usersession->us_WSConnections;
+		while( wsc != NULL )
 		{
-			memcpy( buf + LWS_SEND_BUFFER_PRE_PADDING, msg,  len );
-
-			WebsocketClient *wsc = usersession->us_WSConnections;
-		
-			DEBUG("[SystemBase] Writing to websockets, string '%s' size %d ptr to websocket connection %p\n",msg, len, wsc );
-		
-			while( wsc != NULL )
+			if( wsc->wc_Wsi != NULL )
 			{
-				DEBUG("[SystemBase] send message to user session %p, pointer to websocket connection %p\n", usersession, wsc->wc_Wsi );
-				if( wsc->wc_Wsi != NULL )
+				int queued = WebsocketClientEnqueueParts( wsc, parts, count );
+				if( queued > 0 )
 				{
-					bytes += lws_write( wsc->wc_Wsi , buf + LWS_SEND_BUFFER_PRE_PADDING , len, LWS_WRITE_TEXT );
+					bytes += queued;
 				}
-				wsc = (WebsocketClient *)wsc->node.mln_Succ;
 			}
-		
-			FFree( buf );
-		}
-		else
-		{
-			Log( FLOG_ERROR,"Cannot allocate memory for message\n");
-		
-			pthread_mutex_unlock( &usersession->us_WSMutex );
-		
-			return 0;
+			else
+			{
+				DEBUG("[SystemBase] User session do not have WS connection\n");
+			}
+			wsc = (WebsocketClient *)wsc->node.mln_Succ;
 		}
 		pthread_mutex_unlock( &usersession->us_WSMutex );
 	}
@@ -2169,11 +2262,10 @@ int AddWebSocketConnection( SystemBase *l, struct lws *wsi, const char *sessioni
 		return 1;
 	}
 	
-	WebsocketClient *nwsc = FCalloc( 1, sizeof( WebsocketClient ) );
+	WebsocketClient *nwsc = WebsocketClientNew( wsi );
 	if( nwsc != NULL )
 	{
 		DEBUG("[SystemBase] AddWSCon new connection created\n");
-		nwsc->wc_Wsi = wsi;
 		nwsc->node.mln_Succ = (MinNode *)actUserSess->us_WSConnections;
 		actUserSess->us_WSConnections = nwsc;
 		
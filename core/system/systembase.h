@@ -66,6 +66,8 @@
 #include <system/user/user_session.h>
 #include <system/user/user_sessionmanager.h>
 #include <system/user/user_manager.h>
+#include <system/user/user_snapshot.h>
+#include <system/user/user_session_directory.h>
 #include <system/user/remote_user.h>
 #include <system/handler/fs_manager.h>
 #include <hardware/usb/usb_manager.h>
@@ -84,6 +86,7 @@
 #include <interface/comm_service_interface.h>
 #include <interface/comm_service_remote_interface.h>
 #include <core/event_manager.h>
+#include <core/metrics.h>
 
 #define DEFAULT_SESSION_ID_SIZE 256
 
@@ -194,6 +197,7 @@ typedef struct SystemBase
 
 	AppSessionManager						*sl_AppSessionManager;		// application sessions
 	UserSessionManager					*sl_USM;			// user session manager
+	UserSessionDirectory				*sl_USD;			// sessions of all FriendCores in cluster
 	UserManager								*sl_UM;		// user database manager
 	FSManager									*sl_FSM;		// filesystem manager
 	USBManager								*sl_USB;		// usb manager
@@ -252,7 +256,13 @@ typedef struct SystemBase
 	int												sl_SocketTimeout;
 	FBOOL 										sl_CacheFiles;
 	FBOOL											sl_UnMountDevicesInDB;
+	FBOOL											sl_MountOnDemand;			// network doors are mounted on first access
+	int												sl_UploadMemoryLimit;		// multipart bodies bigger than this are stored in temporary file
+	int												sl_UploadsActive;			// uploads being received now
+	FUQUAD											sl_UploadBytesReceived;	// body bytes received by all uploads
 	Sentinel 										*sl_Sentinel;
+	char											*sl_UserSnapshotPath;		// snapshot of users and sessions, NULL when disabled
+	FThread										*sl_UserSnapshotThread;	// reconcile of snapshot with database
 
 	void (*SystemClose)( struct SystemBase *l );
 
@@ -456,6 +466,18 @@ int WebSocketSendMessageInt( UserSession *usersession, char *msg, int len );
 //
 //
 
+int WebSocketSendPayload( UserSession *usersession, WebsocketPayload *wp );
+
+//
+//
+//
+
+int WebSocketSendPayloadParts( UserSession *usersession, WebsocketPayload **parts, int count );
+
+//
+//
+//
+
 int UserDeviceMount( SystemBase *l, MYSQLLibrary *sqllib, User *usr, int force );
 
 //
@@ -223,6 +223,12 @@ Webreq func: %s\n \
 	char sessionid[ DEFAULT_SESSION_ID_SIZE ];
 	sessionid[ 0 ] = 0;
 	
+	// trace id can come from client or other FC node, it is forwarded with remote calls and written in logs
+	HashmapElement *traceel = GetHEReq( *request, "traceid" );
+	MetricsTraceSet( traceel != NULL ? (char *)traceel->data : NULL );
+	
+	FUQUAD sessionLookupStart = MetricsTime();
+	
 	// Check for sessionid by sessionid specificly or authid
 	if( strcmp( urlpath[ 0 ], "login" ) != 0 && loggedSession == NULL )
 	{
@@ -454,6 +460,19 @@ Webreq func: %s\n \
 					}
 					curusrsess = (UserSession *)curusrsess->node.mln_Succ;
 				}
+				
+				//
+				// session could be created on other FriendCore in cluster
+				//
+				
+				if( loggedSession == NULL )
+				{
+					loggedSession = USDSessionAttach( l->sl_USD, sessionid );
+					if( loggedSession != NULL )
+					{
+						userAdded = TRUE;		// there is no need to free resources
+					}
+				}
 			}
 		}
 		
@@ -482,46 +501,12 @@ Webreq func: %s\n \
 		else
 		{
 			//
-			// we  update timestamp for all users
+			// we  update timestamp for all users, database is updated by background writer
 			//
 			
-			time_t timestamp = time ( NULL );
-			
-			loggedSession->us_LoggedTime = timestamp;
-			if( loggedSession->us_User != NULL )
-			{
-				loggedSession->us_User->u_LoggedTime = timestamp;
-			}
+			USMSessionTouch( l->sl_USM, loggedSession );
 			
-			MYSQLLibrary *sqllib  = l->LibraryMYSQLGet( l );
-			if( sqllib != NULL )
-			{
-				char *tmpQuery = FCalloc( 1025, sizeof( char ) );
-				if( tmpQuery )
-				{
-					//sqllib->SNPrintF( sqllib, tmpQuery, 1024, "UPDATE FUser SET `LoggedTime` = '%lu' WHERE `SessionID` = '%s'", timestamp, sessionid );
-					//sprintf( tmpQuery, "UPDATE FUser SET `LoggedTime` = '%ld' WHERE `SessionID` = '%s'", timestamp, sessionid );
-					//sqllib->SimpleQuery( sqllib, tmpQuery );
-					
-					//DEBUG("QUERY: %s\n", tmpQuery );
-				
-					// there is no need to "try to mount devices" for users every call
-					// it looks like that FC fill devices structure later then Workspace is reading it
-					//UserDeviceMount( l, sqllib, loggedSession->us_User, 0 );
-				
-					//memset( tmpQuery, '\0', 255 );
-					sqllib->SNPrintF( sqllib, tmpQuery, 1024, "UPDATE FUserSession SET `LoggedTime` = '%ld' WHERE `SessionID` = '%s'", timestamp, sessionid );
-					//sprintf( tmpQuery, "UPDATE FUserSession SET `LoggedTime` = '%ld' WHERE `SessionID` = '%s'", timestamp, sessionid );
-					sqllib->QueryWithoutResults( sqllib, tmpQuery );
-				
-					
-					
-					FERROR("Logged time updated: %lu\n", timestamp );
-				
-					FFree( tmpQuery );
-				}
-				l->LibraryMYSQLDrop( l, sqllib );
-			}
+			MetricsRecordSince( METRIC_STAGE_SESSION_LOOKUP, sessionLookupStart );
 		}
 	}
 	
@@ -838,15 +823,12 @@ Webreq func: %s\n \
 							if( loggedSession->us_User == NULL )
 							{
 								DEBUG("User is not attached to session %lu\n", loggedSession->us_UserID );
-								User *lusr = l->sl_UM->um_Users;
-								while( lusr != NULL )
+								User *lusr = UMGetUserByIDRef( l->sl_UM, loggedSession->us_UserID );
+								if( lusr != NULL )
 								{
-									if( loggedSession->us_UserID == lusr->u_ID )
-									{
-										loggedSession->us_User = lusr;
-										break;
-									}
-									lusr = (User *)lusr->node.mln_Succ;
+									// session points to user kept in UserManager list
+									loggedSession->us_User = lusr;
+									UMReleaseUser( l->sl_UM, lusr );
 								}
 							}
 						
@@ -1149,7 +1131,9 @@ Webreq func: %s\n \
 								char *allArgsNew = GetArgsAndReplaceSession( *request, loggedSession );
 
 								// Execute
+								FUQUAD modStart = MetricsTime();
 								data = l->RunMod( l, modType, modulePath, allArgsNew, &dataLength );
+								MetricsRecordSince( METRIC_STAGE_MODULE_RUN, modStart );
 								
 								// We don't use them now
 								FFree( allArgsNew );
@@ -1360,7 +1344,9 @@ Webreq func: %s\n \
 	else if( strcmp( urlpath[ 0 ], "file" ) == 0 )
 	{
 #ifdef ENABLE_WEBSOCKETS_THREADS
+		FUQUAD fsysStart = MetricsTime();
 		response = FSMWebRequest( l, urlpath, *request, loggedSession, &result );
+		MetricsRecordSince( METRIC_STAGE_FSYS_OPERATION, fsysStart );
 #else
 		DEBUG("Systembase pointer %p\n", l );
 		if( detachTask == TRUE )
@@ -1381,7 +1367,9 @@ Webreq func: %s\n \
 		}
 		else
 		{
+			FUQUAD fsysStart = MetricsTime();
 			response = FSMWebRequest( l, urlpath, *request, loggedSession, &result );
+			MetricsRecordSince( METRIC_STAGE_FSYS_OPERATION, fsysStart );
 		}
 #endif
 	}
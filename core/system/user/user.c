@@ -202,9 +202,9 @@ void UserRemoveSession( User *usr, void *ls )
 				if( data != NULL )
 				{
 					data->fcd_ActiveSession = NULL;
+					data->fcd_WSClient = NULL;
 				}
-				rws->wc_UserSession = NULL;
-				FFree( rws );
+				WebsocketClientDelete( rws );
 				rws = NULL;
 			}
 		}
@@ -304,6 +304,15 @@ void UserDelete( User *usr )
 			FFree( usr->u_MainSessionID );
 		}
 		
+		UserDeviceDescriptor *udd = usr->u_DeviceDescriptors;
+		while( udd != NULL )
+		{
+			UserDeviceDescriptor *rem = udd;
+			udd = (UserDeviceDescriptor *)udd->node.mln_Succ;
+			UserDeviceDescriptorDelete( rem );
+		}
+		usr->u_DeviceDescriptors = NULL;
+		
 		FFree( usr );
 	}
 }
@@ -506,3 +515,86 @@ int UserRegenerateSessionID( User *usr, char *newsess )
 	return 0;
 }
 
+/**
+ * Create new door descriptor
+ *
+ * @param id Filesystem ID
+ * @param name door name
+ * @param type DOSDriver name
+ * @param path door path
+ * @param config door configuration
+ * @param execute door execute field
+ * @param mount Filesystem Mounted value
+ * @return new UserDeviceDescriptor structure when success, otherwise NULL
+ */
+UserDeviceDescriptor *UserDeviceDescriptorNew( FULONG id, const char *name, const char *type, const char *path, const char *config, const char *execute, int mount )
+{
+	UserDeviceDescriptor *udd;
+	if( ( udd = FCalloc( 1, sizeof( UserDeviceDescriptor ) ) ) != NULL )
+	{
+		udd->udd_ID = id;
+		udd->udd_Name = StringDuplicate( name );
+		udd->udd_Type = StringDuplicate( type );
+		udd->udd_Path = StringDuplicate( path );
+		udd->udd_Config = StringDuplicate( config );
+		udd->udd_Execute = StringDuplicate( execute );
+		udd->udd_Mount = mount;
+	}
+	return udd;
+}
+
+/**
+ * Delete door descriptor
+ *
+ * @param udd pointer to UserDeviceDescriptor which will be deleted
+ */
+void UserDeviceDescriptorDelete( UserDeviceDescriptor *udd )
+{
+	if( udd != NULL )
+	{
+		if( udd->udd_Name != NULL ) FFree( udd->udd_Name );
+		if( udd->udd_Type != NULL ) FFree( udd->udd_Type );
+		if( udd->udd_Path != NULL ) FFree( udd->udd_Path );
+		if( udd->udd_Config != NULL ) FFree( udd->udd_Config );
+		if( udd->udd_Execute != NULL ) FFree( udd->udd_Execute );
+		FFree( udd );
+	}
+}
+
+/**
+ * Remove door descriptor from User. Descriptors which are being mounted are not removed.
+ *
+ * @param usr pointer to User from which descriptor will be removed
+ * @param name name of door or NULL when id should be used
+ * @param id Filesystem ID, used when name is NULL
+ * @return pointer to removed descriptor or NULL when it was not found
+ */
+UserDeviceDescriptor *UserRemDeviceDescriptor( User *usr, const char *name, FULONG id )
+{
+	if( usr == NULL )
+	{
+		return NULL;
+	}
+	
+	UserDeviceDescriptor *udd = usr->u_DeviceDescriptors;
+	UserDeviceDescriptor *prev = NULL;
+	while( udd != NULL )
+	{
+		if( udd->udd_Mounting == FALSE && ( ( name != NULL && udd->udd_Name != NULL && strcmp( udd->udd_Name, name ) == 0 ) || ( name == NULL && udd->udd_ID == id ) ) )
+		{
+			if( prev == NULL )
+			{
+				usr->u_DeviceDescriptors = (UserDeviceDescriptor *)udd->node.mln_Succ;
+			}
+			else
+			{
+				prev->node.mln_Succ = udd->node.mln_Succ;
+			}
+			udd->node.mln_Succ = NULL;
+			return udd;
+		}
+		prev = udd;
+		udd = (UserDeviceDescriptor *)udd->node.mln_Succ;
+	}
+	return NULL;
+}
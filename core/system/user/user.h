@@ -117,6 +117,24 @@ CREATE TABLE IF NOT EXISTS `FriendMaster.FUser` (
 
 */
 
+//
+// Door registered at login, mounted on first access
+//
+
+typedef struct UserDeviceDescriptor
+{
+	MinNode							node;
+	FULONG							udd_ID;				// Filesystem.ID
+	char								*udd_Name;
+	char								*udd_Type;			// DOSDriver name
+	char								*udd_Path;
+	char								*udd_Config;
+	char								*udd_Execute;
+	int								udd_Mount;			// Filesystem.Mounted
+	FBOOL							udd_Mounting;		// mount in progress
+	time_t							udd_MountFailed;	// time of last failed mount
+}UserDeviceDescriptor;
+
 typedef struct UserSessList
 {
 	void 					*us;
@@ -144,6 +162,7 @@ typedef struct User
 	
 	File								*u_MountedDevs;     // root file]
 	int								u_MountedDevsNr;		// number of mounted devices
+	UserDeviceDescriptor		*u_DeviceDescriptors;	// doors which will be mounted on first access
 	File								*u_WebDAVDevs;		// shared webdav resources 
 	int								u_WebDAVDevsNr;		// number of mounted webdav drives
 	
@@ -161,6 +180,10 @@ typedef struct User
 	
 	RemoteUser					*u_RemoteUsers; //user which use this account to have access to resources
 	FBOOL							u_IsAdmin;		//is user administrator
+	
+	struct User					*u_NameHashNext;	// next user in UserManager name index
+	struct User					*u_IDHashNext;		// next user in UserManager id index
+	int								u_RefCount;			// one reference is held by UserManager list, others by UMGetUserBy*Ref callers
 } User;
 
 static FULONG UserDesc[] = { 
@@ -237,6 +260,24 @@ File *UserRemDeviceByName( User *usr, const char *name, int *error );
 //
 //
 
+UserDeviceDescriptor *UserDeviceDescriptorNew( FULONG id, const char *name, const char *type, const char *path, const char *config, const char *execute, int mount );
+
+//
+//
+//
+
+void UserDeviceDescriptorDelete( UserDeviceDescriptor *udd );
+
+//
+//
+//
+
+UserDeviceDescriptor *UserRemDeviceDescriptor( User *usr, const char *name, FULONG id );
+
+//
+//
+//
+
 int UserRegenerateSessionID( User *usr, char *newsess );
 
 
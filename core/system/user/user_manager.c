@@ -36,6 +36,148 @@
 #include <system/systembase.h>
 #include <util/sha256.h>
 
+/**
+ * Hash of user name (FNV-1a)
+ *
+ * @param name user name
+ * @return hash value
+ */
+static inline FULONG UMNameHash( const char *name )
+{
+	FULONG h = 14695981039346656037ULL;
+	while( *name )
+	{
+		h ^= (unsigned char)*name++;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+/**
+ * Hash of user id, ids are sequential so bits must be mixed
+ *
+ * @param id user id
+ * @return hash value
+ */
+static inline FULONG UMIDHash( FULONG id )
+{
+	id ^= id >> 33;
+	id *= 0xff51afd7ed558ccdULL;
+	id ^= id >> 33;
+	return id;
+}
+
+/**
+ * Put user into name and id indexes, um_UsersLock must be locked for writing
+ *
+ * @param um pointer to UserManager
+ * @param usr pointer to User
+ */
+static void UMIndexInsert( UserManager *um, User *usr )
+{
+	unsigned int mask = um->um_UsersHashSize - 1;
+	unsigned int pos;
+	
+	if( usr->u_Name != NULL )
+	{
+		pos = UMNameHash( usr->u_Name ) & mask;
+		usr->u_NameHashNext = um->um_UsersByName[ pos ];
+		um->um_UsersByName[ pos ] = usr;
+	}
+	else
+	{
+		usr->u_NameHashNext = NULL;
+	}
+	
+	pos = UMIDHash( usr->u_ID ) & mask;
+	usr->u_IDHashNext = um->um_UsersByID[ pos ];
+	um->um_UsersByID[ pos ] = usr;
+}
+
+/**
+ * Remove user from name index, um_UsersLock must be locked for writing
+ *
+ * @param um pointer to UserManager
+ * @param usr pointer to User
+ * @return TRUE when user was found in index, otherwise FALSE
+ */
+static FBOOL UMIndexRemoveName( UserManager *um, User *usr )
+{
+	if( usr->u_Name == NULL )
+	{
+		return FALSE;
+	}
+	
+	User **ptr = &( um->um_UsersByName[ UMNameHash( usr->u_Name ) & ( um->um_UsersHashSize - 1 ) ] );
+	while( *ptr != NULL )
+	{
+		if( *ptr == usr )
+		{
+			*ptr = usr->u_NameHashNext;
+			usr->u_NameHashNext = NULL;
+			return TRUE;
+		}
+		ptr = &( (*ptr)->u_NameHashNext );
+	}
+	return FALSE;
+}
+
+/**
+ * Remove user from name and id indexes, um_UsersLock must be locked for writing
+ *
+ * @param um pointer to UserManager
+ * @param usr pointer to User
+ */
+static void UMIndexRemove( UserManager *um, User *usr )
+{
+	UMIndexRemoveName( um, usr );
+	
+	User **ptr = &( um->um_UsersByID[ UMIDHash( usr->u_ID ) & ( um->um_UsersHashSize - 1 ) ] );
+	while( *ptr != NULL )
+	{
+		if( *ptr == usr )
+		{
+			*ptr = usr->u_IDHashNext;
+			usr->u_IDHashNext = NULL;
+			break;
+		}
+		ptr = &( (*ptr)->u_IDHashNext );
+	}
+}
+
+/**
+ * Make indexes bigger when there are more users than buckets, um_UsersLock must be locked for writing
+ *
+ * @param um pointer to UserManager
+ */
+static void UMIndexGrow( UserManager *um )
+{
+	unsigned int size = um->um_UsersHashSize << 1;
+	User **byName = FCalloc( size, sizeof( User *) );
+	User **byID = FCalloc( size, sizeof( User *) );
+	
+	if( byName == NULL || byID == NULL )
+	{
+		// lookups are slower but still work
+		FFree( byName );
+		FFree( byID );
+		return;
+	}
+	
+	FFree( um->um_UsersByName );
+	FFree( um->um_UsersByID );
+	um->um_UsersByName = byName;
+	um->um_UsersByID = byID;
+	um->um_UsersHashSize = size;
+	
+	User *usr = um->um_Users;
+	while( usr != NULL )
+	{
+		UMIndexInsert( um, usr );
+		usr = (User *)usr->node.mln_Succ;
+	}
+}
+
 /**
  * Create UserManager
  *
@@ -50,6 +192,18 @@ UserManager *UMNew( void *sb )
 	{
 		sm->um_SB = sb;
 		
+		sm->um_UsersHashSize = UM_USERS_HASH_SIZE;
+		sm->um_UsersByName = FCalloc( sm->um_UsersHashSize, sizeof( User *) );
+		sm->um_UsersByID = FCalloc( sm->um_UsersHashSize, sizeof( User *) );
+		if( sm->um_UsersByName == NULL || sm->um_UsersByID == NULL )
+		{
+			FFree( sm->um_UsersByName );
+			FFree( sm->um_UsersByID );
+			FFree( sm );
+			return NULL;
+		}
+		pthread_rwlock_init( &(sm->um_UsersLock), NULL );
+		
 		return sm;
 	}
 	return NULL;
@@ -122,6 +276,10 @@ void UMDelete( UserManager *smgr )
 	}
 	
 	smgr->um_Users = NULL;
+	smgr->um_UsersNr = 0;
+	FFree( smgr->um_UsersByName );
+	FFree( smgr->um_UsersByID );
+	pthread_rwlock_destroy( &(smgr->um_UsersLock) );
 	
 	RemoteUserDeleteAll( smgr->um_RemoteUsers );
 	
@@ -533,13 +691,11 @@ User * UMUserGetByNameDB( UserManager *um, const char *name )
 	}
 
 	User *user = NULL;
-	char tmpQuery[ 1024 ];
-	//snprintf( tmpQuery, sizeof(tmpQuery)," Name = '%s'", name );
-	sqlLib->SNPrintF( sqlLib, tmpQuery, sizeof(tmpQuery)," Name = '%s'", name );
+	FULONG params[] = { SQLT_STR, (FULONG)name, SQLT_END };
 	
 	DEBUG( "Loading user.\n" );
 	int entries;
-	user = sqlLib->Load( sqlLib, UserDesc, tmpQuery, &entries );
+	user = sqlLib->LoadBind( sqlLib, UserDesc, " Name = ?", params, &entries );
 	
 	DEBUG("User poitner %p  number of entries %d\n", user, entries );
 	// No need for sql lib anymore here
@@ -582,13 +738,11 @@ User * UMUserGetByIDDB( UserManager *um, FULONG id )
 	}
 
 	User *user = NULL;
-	char tmpQuery[ 1024 ];
-	//snprintf( tmpQuery, sizeof(tmpQuery)," ID = '%lu'", id );
-	sqlLib->SNPrintF( sqlLib, tmpQuery, sizeof(tmpQuery)," ID = '%lu'", id );
+	FULONG params[] = { SQLT_INT, id, SQLT_END };
 	
 	DEBUG( "Loading user, pointer to sqllib %p.\n", sqlLib );
 	int entries = 0;
-	user = sqlLib->Load( sqlLib, UserDesc, tmpQuery, &entries );
+	user = sqlLib->LoadBind( sqlLib, UserDesc, " ID = ?", params, &entries );
 	
 	DEBUG("User poitner %p  number of entries %d\n", user, entries );
 	// No need for sql lib anymore here
@@ -810,16 +964,16 @@ User *UMUserCheckExistsInMemory( UserManager *smgr, User *u )
 	{
 		return NULL;
 	}
-	User *sess = smgr->um_Users;
-	while( sess != NULL )
+	// Found a duplicate, use it, clean up u (not needed), return
+	User *lu = UMGetUserByIDRef( smgr, u->u_ID );
+	if( lu != NULL )
 	{
-		// Found a duplicate, use it, clean up u (not needed), return
-		if( sess == u )
+		UMReleaseUser( smgr, lu );
+		if( lu == u )
 		{
 			FERROR( "[UserInit] User already exists.\n" );
 			return u;
 		}
-		sess = ( User *)sess->node.mln_Succ;
 	}
 	return NULL;
 }
@@ -855,49 +1009,175 @@ FBOOL UMUserExistByNameDB( UserManager *smgr, const char *name )
 }
 
 /**
- * Get User structure from FC user list by his name
+ * Get User structure from FC user list by his name and take reference to it.
+ * User is not released from memory until UMReleaseUser is called.
  *
  * @param um pointer to UserManager
  * @param name user name
  * @return User structure when success, otherwise NULL
  */
 
-User *UMGetUserByName( UserManager *um, char *name )
+User *UMGetUserByNameRef( UserManager *um, const char *name )
 {
-	User *tuser = um->um_Users;
+	if( name == NULL )
+	{
+		return NULL;
+	}
+	
+	pthread_rwlock_rdlock( &(um->um_UsersLock) );
+	User *tuser = um->um_UsersByName[ UMNameHash( name ) & ( um->um_UsersHashSize - 1 ) ];
 	while( tuser != NULL )
 	{
-		// Check both username and password
-		if( strcmp( name, tuser->u_Name ) == 0 )
+		if( tuser->u_Name != NULL && strcmp( name, tuser->u_Name ) == 0 )
 		{
-			return tuser;
+			__sync_add_and_fetch( &(tuser->u_RefCount), 1 );
+			break;
 		}
-		tuser = (User *)tuser->node.mln_Succ;
+		tuser = tuser->u_NameHashNext;
 	}
-	return NULL;
+	pthread_rwlock_unlock( &(um->um_UsersLock) );
+	
+	return tuser;
 }
 
 /**
- * Get User structure from FC user list by user id
+ * Get User structure from FC user list by user id and take reference to it.
+ * User is not released from memory until UMReleaseUser is called.
  *
  * @param um pointer to UserManager
  * @param id user id
  * @return User structure when success, otherwise NULL
  */
 
-User *UMGetUserByID( UserManager *um, FULONG id )
+User *UMGetUserByIDRef( UserManager *um, FULONG id )
 {
-	User *tuser = um->um_Users;
+	pthread_rwlock_rdlock( &(um->um_UsersLock) );
+	User *tuser = um->um_UsersByID[ UMIDHash( id ) & ( um->um_UsersHashSize - 1 ) ];
 	while( tuser != NULL )
 	{
-		// Check both username and password
 		if( tuser->u_ID == id )
 		{
-			return tuser;
+			__sync_add_and_fetch( &(tuser->u_RefCount), 1 );
+			break;
 		}
-		tuser = (User *)tuser->node.mln_Succ;
+		tuser = tuser->u_IDHashNext;
 	}
-	return NULL;
+	pthread_rwlock_unlock( &(um->um_UsersLock) );
+	
+	return tuser;
+}
+
+/**
+ * Release reference to User taken by UMGetUserByNameRef or UMGetUserByIDRef.
+ * When user was removed from FC user list and this is last reference, user is deleted.
+ *
+ * @param um pointer to UserManager
+ * @param usr pointer to User, can be NULL
+ */
+
+void UMReleaseUser( UserManager *um, User *usr )
+{
+	if( usr == NULL )
+	{
+		return;
+	}
+	
+	if( __sync_sub_and_fetch( &(usr->u_RefCount), 1 ) == 0 )
+	{
+		DEBUG("User will be removed from memory\n");
+		UserDelete( usr );
+	}
+}
+
+/**
+ * Get all users from FC user list and take reference to every one of them.
+ * Users can be used without um_UsersLock, array must be released by UMReleaseUsers.
+ *
+ * @param um pointer to UserManager
+ * @param count pointer to place where number of users will be stored
+ * @return array of users or NULL when list is empty or memory is not available
+ */
+
+User **UMGetUsersRef( UserManager *um, unsigned int *count )
+{
+	User **users = NULL;
+	unsigned int pos = 0;
+	
+	pthread_rwlock_rdlock( &(um->um_UsersLock) );
+	if( um->um_UsersNr > 0 && ( users = FMalloc( um->um_UsersNr * sizeof( User *) ) ) != NULL )
+	{
+		User *usr = um->um_Users;
+		while( usr != NULL && pos < um->um_UsersNr )
+		{
+			__sync_add_and_fetch( &(usr->u_RefCount), 1 );
+			users[ pos++ ] = usr;
+			usr = (User *)usr->node.mln_Succ;
+		}
+	}
+	pthread_rwlock_unlock( &(um->um_UsersLock) );
+	
+	*count = pos;
+	return users;
+}
+
+/**
+ * Release users taken by UMGetUsersRef
+ *
+ * @param um pointer to UserManager
+ * @param users array returned by UMGetUsersRef, can be NULL
+ * @param count number of users in array
+ */
+
+void UMReleaseUsers( UserManager *um, User **users, unsigned int count )
+{
+	unsigned int i;
+	
+	if( users == NULL )
+	{
+		return;
+	}
+	
+	for( i = 0 ; i < count ; i++ )
+	{
+		UMReleaseUser( um, users[ i ] );
+	}
+	FFree( users );
+}
+
+/**
+ * Change name of User and update name index
+ *
+ * @param um pointer to UserManager
+ * @param usr pointer to User
+ * @param name new name, function takes ownership of it
+ * @return 0 when success, otherwise error number
+ */
+
+int UMUserRename( UserManager *um, User *usr, char *name )
+{
+	if( usr == NULL || name == NULL )
+	{
+		return -1;
+	}
+	
+	pthread_rwlock_wrlock( &(um->um_UsersLock) );
+	FBOOL indexed = UMIndexRemoveName( um, usr );
+	
+	if( usr->u_Name != NULL )
+	{
+		FFree( usr->u_Name );
+	}
+	usr->u_Name = name;
+	
+	if( indexed == TRUE )
+	{
+		unsigned int pos = UMNameHash( usr->u_Name ) & ( um->um_UsersHashSize - 1 );
+		usr->u_NameHashNext = um->um_UsersByName[ pos ];
+		um->um_UsersByName[ pos ] = usr;
+	}
+	pthread_rwlock_unlock( &(um->um_UsersLock) );
+	
+	return 0;
 }
 
 /**
@@ -916,8 +1196,6 @@ User *UMGetUserByNameDB( UserManager *um, const char *name )
 {
 	SystemBase *sb = (SystemBase *)um->um_SB;
 	MYSQLLibrary *sqlLib = sb->LibraryMYSQLGet( sb );
-	char where[ 128 ];
-	where[ 0 ] = 0;
 	
 	DEBUG("UMGetUserByNameDB start\n");
 	
@@ -926,13 +1204,12 @@ User *UMGetUserByNameDB( UserManager *um, const char *name )
 		FERROR("Cannot get user, mysql.library was not open\n");
 		return NULL;
 	}
-	//snprintf( where, sizeof(where), " `Name` = '%s'", name );
-	sqlLib->SNPrintF( sqlLib, where, sizeof(where), " `Name` = '%s'", name );
+	FULONG params[] = { SQLT_STR, (FULONG)name, SQLT_END };
 	
 	struct User *user = NULL;
 	int entries;
 	
-	user = ( struct User *)sqlLib->Load( sqlLib, UserDesc, where, &entries );
+	user = ( struct User *)sqlLib->LoadBind( sqlLib, UserDesc, " `Name` = ?", params, &entries );
 	sb->LibraryMYSQLDrop( sb, sqlLib );
 	
 	User *tmp = user;
@@ -1056,26 +1333,51 @@ User *UMGetAllUsersDB( UserManager *um )
 
 int UMAddUser( UserManager *um,  User *usr )
 {
-	User *lu =  UMGetUserByID( um, usr->u_ID );
+	if( usr == NULL )
+	{
+		return -1;
+	}
+	
+	pthread_rwlock_wrlock( &(um->um_UsersLock) );
+	
+	User *lu = um->um_UsersByID[ UMIDHash( usr->u_ID ) & ( um->um_UsersHashSize - 1 ) ];
+	while( lu != NULL && lu->u_ID != usr->u_ID )
+	{
+		lu = lu->u_IDHashNext;
+	}
+	
 	if( lu == NULL  )
 	{
+		usr->node.mln_Pred = NULL;
 		usr->node.mln_Succ  = (MinNode *) um->um_Users;
 		if( um->um_Users != NULL )
 		{
 			um->um_Users->node.mln_Pred = (MinNode *)usr;
 		}
 		um->um_Users = usr;
+		usr->u_RefCount = 1;	// reference held by list
+		
+		if( ++(um->um_UsersNr) > ( um->um_UsersHashSize << 1 ) )
+		{
+			UMIndexGrow( um );
+		}
+		else
+		{
+			UMIndexInsert( um, usr );
+		}
 	}
 	else
 	{
 		INFO("User found, will not be added\n");
 	}
 	
+	pthread_rwlock_unlock( &(um->um_UsersLock) );
+	
 	return  0;
 }
 
 /**
- * Remove user from FC user list
+ * Remove user from FC user list. User is deleted when nobody holds reference to it.
  *
  * @param um pointer to UserManager
  * @param usr user which will be removed from FC user list
@@ -1084,26 +1386,54 @@ int UMAddUser( UserManager *um,  User *usr )
 
 int UMRemoveUser( UserManager *um, User *usr )
 {
-	User *lusr = um->um_Users;
-	User *prevusr = lusr;
+	User *lusr = NULL;
+	
+	if( usr == NULL )
+	{
+		return -1;
+	}
+	
+	pthread_rwlock_wrlock( &(um->um_UsersLock) );
+	
+	// user is in the list only when it is in id index
+	lusr = um->um_UsersByID[ UMIDHash( usr->u_ID ) & ( um->um_UsersHashSize - 1 ) ];
+	while( lusr != NULL && lusr != usr )
+	{
+		lusr = lusr->u_IDHashNext;
+	}
 	
-	while( lusr != NULL )
+	if( lusr != NULL )
 	{
-		if( lusr == usr )
+		User *prev = (User *)lusr->node.mln_Pred;
+		User *next = (User *)lusr->node.mln_Succ;
+		
+		DEBUG("UserManagerRemove: user removed\n");
+		
+		if( prev != NULL )
 		{
-			DEBUG("UserManagerRemove: user removed\n");
-			break;
+			prev->node.mln_Succ = (MinNode *)next;
+		}
+		else
+		{
+			um->um_Users = next;
 		}
-		prevusr = lusr;
-		lusr = (User *)lusr->node.mln_Succ;
+		if( next != NULL )
+		{
+			next->node.mln_Pred = (MinNode *)prev;
+		}
+		lusr->node.mln_Succ = NULL;
+		lusr->node.mln_Pred = NULL;
+		
+		UMIndexRemove( um, lusr );
+		um->um_UsersNr--;
 	}
 	
+	pthread_rwlock_unlock( &(um->um_UsersLock) );
+	
 	if( lusr != NULL )
 	{
-		prevusr->node.mln_Succ = lusr->node.mln_Succ;
-		DEBUG("User will be removed from memory\n");
-		UserDelete( lusr );
-		
+		// drop reference held by list
+		UMReleaseUser( um, lusr );
 		return 0;
 	}
 	
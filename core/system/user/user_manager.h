@@ -38,6 +38,9 @@
 #include "user_group.h"
 #include "user.h"
 #include "remote_user.h"
+#include <pthread.h>
+
+#define UM_USERS_HASH_SIZE		1024		// initial number of buckets in user indexes, power of 2
 
 //
 // User Session Manager structure
@@ -48,6 +51,11 @@ typedef struct UserManager
 	void										*um_SB;
 	
 	User										*um_Users; 						// logged users with mounted devices
+	User										**um_UsersByName;		// hash index of um_Users by name
+	User										**um_UsersByID;			// hash index of um_Users by id
+	unsigned int							um_UsersHashSize;		// number of buckets in indexes
+	unsigned int							um_UsersNr;				// number of users in um_Users
+	pthread_rwlock_t					um_UsersLock;				// protects um_Users and indexes
 	UserGroup							*um_UserGroups;			// all user groups
 	void 										*um_USM;
 	RemoteUser							*um_RemoteUsers;		// remote users and their connections
@@ -138,19 +146,43 @@ FBOOL UMUserExistByNameDB( UserManager *smgr, const char *name );
 //
 //
 
-User *UMGetUserByName( UserManager *um, char *name );
+User *UMGetUserByNameDB( UserManager *um, const char *name );
+
+//
+// User found in memory stays there until UMReleaseUser is called
+//
+
+User *UMGetUserByNameRef( UserManager *um, const char *name );
 
 //
 //
 //
 
-User *UMGetUserByNameDB( UserManager *um, const char *name );
+User *UMGetUserByIDRef( UserManager *um, FULONG id );
+
+//
+//
+//
+
+void UMReleaseUser( UserManager *um, User *usr );
+
+//
+// All users in FC user list with references, used to go through users without um_UsersLock
+//
+
+User **UMGetUsersRef( UserManager *um, unsigned int *count );
+
+//
+//
+//
+
+void UMReleaseUsers( UserManager *um, User **users, unsigned int count );
 
 //
 //
 //
 
-User *UMGetUserByID( UserManager *um, FULONG id );
+int UMUserRename( UserManager *um, User *usr, char *name );
 
 //
 //
@@ -221,7 +221,6 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 		
 		response = HttpNewSimple( HTTP_200_OK,  tags );
 		
-		User *logusr = l->sl_UM->um_Users;
 		FULONG id = 0;
 		FBOOL userFromSession = FALSE;
 		
@@ -246,12 +245,13 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 					
 					if( ( tmpQuery = FCalloc( querysize, sizeof(char) ) ) != NULL )
 					{
-						User * usr = UMGetUserByID( l->sl_UM, id );
+						User * usr = UMGetUserByIDRef( l->sl_UM, id );
 						if( usr != NULL )
 						{
 							UserDeviceUnMount( l, sqllib, usr );
 							
 							UMRemoveUser( l->sl_UM, usr );
+							UMReleaseUser( l->sl_UM, usr );
 						}
 						// DELETE `FPermLink` WHERE PermissionID in( SELECT * FROM `FFilePermission` WHERE Path = '%s'  )
 						
@@ -312,7 +312,7 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 		
 		response = HttpNewSimple( HTTP_200_OK,  tags );
 		
-		User *logusr = l->sl_UM->um_Users;
+		User *logusr = NULL;
 		char *usrname = NULL;
 		char *usrpass = NULL;
 		
@@ -332,25 +332,20 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 		
 		if( usrname != NULL && usrpass != NULL )
 		{
-			while( logusr != NULL )
+			logusr = UMGetUserByNameRef( l->sl_UM, usrname );
+			if( logusr != NULL )
 			{
-				if( strcmp( logusr->u_Name, usrname ) == 0 )
+				if( 0 == l->sl_ActiveAuthModule->UpdatePassword( l->sl_ActiveAuthModule, request, logusr, usrpass ) )
 				{
-					if( 0 == l->sl_ActiveAuthModule->UpdatePassword( l->sl_ActiveAuthModule, request, logusr, usrpass ) )
-					{
-						HttpAddTextContent( response, "ok<!--separate-->{ \"updatepassword\": \"success!\"}" );
-					}
-					else
-					{
-						HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"Password not changed!\"}" );
-					}
-					
-					break;
+					HttpAddTextContent( response, "ok<!--separate-->{ \"updatepassword\": \"success!\"}" );
+				}
+				else
+				{
+					HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"Password not changed!\"}" );
 				}
-				logusr = (User *)logusr->node.mln_Succ;
+				UMReleaseUser( l->sl_UM, logusr );
 			}
-			
-			if( logusr == NULL )
+			else
 			{
 				HttpAddTextContent( response, "fail<!--separate-->{ \"response\": \"User not found!\"}" );
 			}
@@ -385,7 +380,8 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 		
 		response = HttpNewSimple( HTTP_200_OK,  tags );
 		
-		User *logusr = l->sl_UM->um_Users;
+		User *logusr = NULL;
+		FBOOL userRef = FALSE;
 		char *usrname = NULL;
 		char *usrpass = NULL;
 		char *fullname = NULL;
@@ -414,15 +410,11 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 		
 		if( id > 0 && imAdmin == TRUE )
 		{
-			while( logusr != NULL )
+			if( ( logusr = UMGetUserByIDRef( l->sl_UM, id ) ) != NULL )
 			{
-				if( logusr->u_ID == id  )
-				{
-					userFromSession = TRUE;
-					DEBUG("[UMWebRequest] Found session, update\n");
-					break;
-				}
-				logusr = (User *)logusr->node.mln_Succ;
+				userFromSession = TRUE;
+				userRef = TRUE;
+				DEBUG("[UMWebRequest] Found session, update\n");
 			}
 		}
 		else if( id > 0 && imAdmin == FALSE )
@@ -461,8 +453,7 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 				{
 					if( usrname != NULL && logusr->u_Name != NULL )
 					{
-						FFree( logusr->u_Name );
-						logusr->u_Name = usrname;
+						UMUserRename( l->sl_UM, logusr, usrname );
 					}
 				}
 			}
@@ -551,6 +542,10 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 				{
 					UserDelete( logusr );
 				}
+				else if( userRef == TRUE )
+				{
+					UMReleaseUser( l->sl_UM, logusr );
+				}
 			}
 		}
 		
@@ -630,7 +625,7 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 		
 		response = HttpNewSimple( HTTP_200_OK,  tags );
 		
-		User *logusr = l->sl_UM->um_Users;
+		User *logusr = NULL;
 		char *usrname = NULL;
 		
 		DEBUG( "[UMWebRequest] get sessionlist!!\n" );
@@ -643,57 +638,53 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 		
 		if( usrname != NULL )
 		{
-			int numberOfSessions = 0;
-			while( logusr != NULL )
+			logusr = UMGetUserByNameRef( l->sl_UM, usrname );
+			if( logusr != NULL )
 			{
-				if( strcmp( logusr->u_Name, usrname ) == 0 )
+				BufString *bs = BufStringNew();
+				
+				UserSessList *sessions = logusr->u_SessionsList;
+				BufStringAdd( bs, "ok<!--separate-->[" );
+				int pos = 0;
+				unsigned long t = time( NULL );
+				
+				while( sessions != NULL )
 				{
-					BufString *bs = BufStringNew();
-					
-					UserSessList *sessions = logusr->u_SessionsList;
-					BufStringAdd( bs, "ok<!--separate-->[" );
-					int pos = 0;
-					unsigned long t = time( NULL );
+					char temp[ 1024 ];
+					UserSession *us = (UserSession *) sessions->us;
 					
-					while( sessions != NULL )
+					//if( (us->us_LoggedTime - t) > LOGOUT_TIME )
+					//if( us->us_WSConnections != NULL )
 					{
-						char temp[ 1024 ];
-						UserSession *us = (UserSession *) sessions->us;
-						
-						//if( (us->us_LoggedTime - t) > LOGOUT_TIME )
-						//if( us->us_WSConnections != NULL )
+						int size = 0;
+						if( pos == 0 )
 						{
-							int size = 0;
-							if( pos == 0 )
-							{
-								size = snprintf( temp, sizeof(temp), "{ \"id\":\"%lu\",\"deviceidentity\":\"%s\",\"sessionid\":\"%s\",\"time\":\"%llu\"}", us->us_ID, us->us_DeviceIdentity, us->us_SessionID, (long long unsigned int)us->us_LoggedTime );
-							}
-							else
-							{
-								size = snprintf( temp, sizeof(temp), ",{ \"id\":\"%lu\",\"deviceidentity\":\"%s\",\"sessionid\":\"%s\",\"time\":\"%llu\"}", us->us_ID, us->us_DeviceIdentity, us->us_SessionID, (long long unsigned int)us->us_LoggedTime );
-							}
-							
-							BufStringAddSize( bs, temp, size );
-							
-							pos++;
+							size = snprintf( temp, sizeof(temp), "{ \"id\":\"%lu\",\"deviceidentity\":\"%s\",\"sessionid\":\"%s\",\"time\":\"%llu\"}", us->us_ID, us->us_DeviceIdentity, us->us_SessionID, (long long unsigned int)us->us_LoggedTime );
+						}
+						else
+						{
+							size = snprintf( temp, sizeof(temp), ",{ \"id\":\"%lu\",\"deviceidentity\":\"%s\",\"sessionid\":\"%s\",\"time\":\"%llu\"}", us->us_ID, us->us_DeviceIdentity, us->us_SessionID, (long long unsigned int)us->us_LoggedTime );
 						}
-						sessions = (UserSessList *) sessions->node.mln_Succ;
+						
+						BufStringAddSize( bs, temp, size );
+						
+						pos++;
 					}
-					
-					BufStringAdd( bs, "]" );
-					
-					HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
-					
-					DEBUG("[UMWebRequest] Sessions %s\n", bs->bs_Buffer );
-					bs->bs_Buffer = NULL;
-					
-					BufStringDelete( bs );
-					numberOfSessions++;
+					sessions = (UserSessList *) sessions->node.mln_Succ;
 				}
-				logusr = (User *)logusr->node.mln_Succ;
+				
+				BufStringAdd( bs, "]" );
+				
+				HttpSetContent( response, bs->bs_Buffer, bs->bs_Size );
+				
+				DEBUG("[UMWebRequest] Sessions %s\n", bs->bs_Buffer );
+				bs->bs_Buffer = NULL;
+				
+				BufStringDelete( bs );
+				
+				UMReleaseUser( l->sl_UM, logusr );
 			}
-			
-			if( logusr == NULL && numberOfSessions == 0 )
+			else
 			{
 				HttpAddTextContent( response, "fail<!--separate-->{\"response\":\"User not found!\"}" );
 			}
@@ -774,7 +765,7 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 		else if( deviceid != NULL && usrname != NULL )
 		{
 			DEBUG("[UMWebRequest] Remove session by deviceid and username %s - %s\n", deviceid, usrname );
-			User *u = UMGetUserByName( l->sl_UM, usrname );
+			User *u = UMGetUserByNameRef( l->sl_UM, usrname );
 			if( u != NULL )
 			{
 				UserSessList *usl = u->u_SessionsList;
@@ -789,6 +780,7 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 					
 					usl = (UserSessList *)usl->node.mln_Succ;
 				}
+				UMReleaseUser( l->sl_UM, u );
 			}
 			else
 			{
@@ -868,6 +860,7 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 			time_t  timestamp = time( NULL );
 			
 			int pos = 0;
+			pthread_rwlock_rdlock( &(l->sl_UM->um_UsersLock) );
 			User *usr = l->sl_UM->um_Users;
 			while( usr != NULL )
 			{
@@ -922,6 +915,7 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 				}
 				usr = (User *)usr->node.mln_Succ;
 			}
+			pthread_rwlock_unlock( &(l->sl_UM->um_UsersLock) );
 			
 			BufStringAdd( bs, "]}");
 			
@@ -973,6 +967,7 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 			time_t  timestamp = time( NULL );
 			
 			int pos = 0;
+			pthread_rwlock_rdlock( &(l->sl_UM->um_UsersLock) );
 			User *usr = l->sl_UM->um_Users;
 			while( usr != NULL )
 			{
@@ -1028,6 +1023,7 @@ Http *UMWebRequest( void *m, char **urlpath, Http* request, UserSession *loggedS
 				}
 				usr = (User *)usr->node.mln_Succ;
 			}
+			pthread_rwlock_unlock( &(l->sl_UM->um_UsersLock) );
 			
 			BufStringAdd( bs, "]}");
 			
@@ -77,7 +77,13 @@ void UserSessionDelete( UserSession *us )
 				nwsc = (WebsocketClient *)nwsc->node.mln_Succ;
 				
 				DEBUG("Remove websockets\n");
-				FFree( rws );
+				FCWSData *data = rws->wc_WebsocketsData;
+				if( data != NULL )
+				{
+					data->fcd_ActiveSession = NULL;
+					data->fcd_WSClient = NULL;
+				}
+				WebsocketClientDelete( rws );
 				rws = NULL;
 			}
 		}
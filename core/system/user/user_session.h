@@ -87,6 +87,11 @@ typedef struct UserSession
 	char                           us_UserActionInfo[ 512 ];
 	FULONG                    us_NRConnections;
 	
+	FULONG                    us_TouchGeneration;	// batch in which LoggedTime is waiting for write
+	int                              us_TouchIndex;			// position in that batch
+	
+	FBOOL                         us_FromDirectory;		// created from cluster directory, creation is not published again
+	
 }UserSession;
 
 static FULONG UserSessionDesc[] = { 
@@ -0,0 +1,794 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ *
+ *  User session directory
+ *
+ *  Events are coalesced per session and sent every USD_FLUSH_INTERVAL as
+ *  ID_SDIR command to all CommService connections. Every parameter of
+ *  message is one session:  <event>=<sessionid>\t<userid>\t<loggedtime>\t<deviceid>
+ *  Connection which did not get full directory yet receives it before
+ *  normal events.
+ *
+ *  @date created 10/2026
+ */
+
+#include "user_session_directory.h"
+#include <system/systembase.h>
+#include <core/friendcore_manager.h>
+#include <service/comm_service.h>
+
+/**
+ * Create new UserSessionDirectory
+ *
+ * @param sb pointer to SystemBase
+ * @return new UserSessionDirectory structure when success, otherwise NULL
+ */
+
+UserSessionDirectory *USDNew( void *sb )
+{
+	UserSessionDirectory *usd = NULL;
+
+	if( ( usd = FCalloc( 1, sizeof( UserSessionDirectory ) ) ) != NULL )
+	{
+		usd->usd_SB = sb;
+		usd->usd_Sessions = HashmapNew();
+		usd->usd_Pending = HashmapNew();
+
+		if( usd->usd_Sessions == NULL || usd->usd_Pending == NULL )
+		{
+			if( usd->usd_Sessions != NULL )
+			{
+				HashmapFree( usd->usd_Sessions );
+			}
+			if( usd->usd_Pending != NULL )
+			{
+				HashmapFree( usd->usd_Pending );
+			}
+			FFree( usd );
+			return NULL;
+		}
+
+		pthread_rwlock_init( &(usd->usd_Lock), NULL );
+		pthread_mutex_init( &(usd->usd_PendingMutex), NULL );
+	}
+
+	return usd;
+}
+
+/**
+ * Delete UserSessionDirectory
+ *
+ * @param usd pointer to UserSessionDirectory which will be deleted
+ */
+
+void USDDelete( UserSessionDirectory *usd )
+{
+	if( usd == NULL )
+	{
+		return;
+	}
+
+	HashmapFree( usd->usd_Sessions );
+	HashmapFree( usd->usd_Pending );
+
+	pthread_rwlock_destroy( &(usd->usd_Lock) );
+	pthread_mutex_destroy( &(usd->usd_PendingMutex) );
+
+	FFree( usd );
+}
+
+/**
+ * Put copy of entry to map or update entry which is already there
+ *
+ * @param hm map to which entry will be stored
+ * @param entry entry to store
+ * @return TRUE when map was changed, otherwise FALSE
+ */
+
+static FBOOL USDStore( Hashmap *hm, USDEntry *entry )
+{
+	USDEntry *old = HashmapGetData( hm, entry->ude_SessionID );
+	if( old != NULL )
+	{
+		if( old->ude_UserID == entry->ude_UserID && old->ude_LoggedTime >= entry->ude_LoggedTime &&
+			strcmp( old->ude_DeviceIdentity, entry->ude_DeviceIdentity ) == 0 )
+		{
+			return FALSE;
+		}
+
+		time_t loggedTime = old->ude_LoggedTime > entry->ude_LoggedTime ? old->ude_LoggedTime : entry->ude_LoggedTime;
+		*old = *entry;
+		old->ude_LoggedTime = loggedTime;
+		return TRUE;
+	}
+
+	USDEntry *ne = FMalloc( sizeof( USDEntry ) );
+	char *key = StringDuplicate( entry->ude_SessionID );
+	if( ne == NULL || key == NULL )
+	{
+		FFree( ne );
+		FFree( key );
+		return FALSE;
+	}
+	*ne = *entry;
+
+	if( HashmapPut( hm, key, ne ) == FALSE )
+	{
+		FFree( ne );
+		FFree( key );
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Fill directory entry from user session
+ *
+ * @param entry pointer to entry which will be filled
+ * @param ses session from which data are taken
+ * @return TRUE when session can be stored in directory, otherwise FALSE
+ */
+
+static FBOOL USDEntryFromSession( USDEntry *entry, UserSession *ses )
+{
+	if( ses->us_SessionID == NULL || ses->us_SessionID[ 0 ] == 0 || ses->us_UserID == 0 )
+	{
+		return FALSE;
+	}
+
+	// remote sessions belong to one FriendCore
+	if( ses->us_DeviceIdentity != NULL && strcmp( ses->us_DeviceIdentity, "remote" ) == 0 )
+	{
+		return FALSE;
+	}
+
+	// fields are separated by tabs in messages
+	if( strlen( ses->us_SessionID ) >= USD_SESSIONID_SIZE || strchr( ses->us_SessionID, '\t' ) != NULL )
+	{
+		return FALSE;
+	}
+	if( ses->us_DeviceIdentity != NULL && ( strlen( ses->us_DeviceIdentity ) >= USD_DEVICEID_SIZE || strchr( ses->us_DeviceIdentity, '\t' ) != NULL ) )
+	{
+		return FALSE;
+	}
+
+	strcpy( entry->ude_SessionID, ses->us_SessionID );
+	if( ses->us_DeviceIdentity != NULL )
+	{
+		strcpy( entry->ude_DeviceIdentity, ses->us_DeviceIdentity );
+	}
+	else
+	{
+		entry->ude_DeviceIdentity[ 0 ] = 0;
+	}
+	entry->ude_UserID = ses->us_UserID;
+	entry->ude_LoggedTime = ses->us_LoggedTime > 0 ? ses->us_LoggedTime : time( NULL );
+
+	return TRUE;
+}
+
+/**
+ * Publish session event to other FriendCores
+ *
+ * Local directory is updated immediately, event is sent with next flush.
+ * Events which do not change directory are not sent.
+ *
+ * @param usd pointer to UserSessionDirectory
+ * @param event USD_EVENT_CREATE, USD_EVENT_TOUCH or USD_EVENT_EXPIRE
+ * @param ses session which was created, used or removed
+ */
+
+void USDPublish( UserSessionDirectory *usd, int event, UserSession *ses )
+{
+	if( usd == NULL || ses == NULL )
+	{
+		return;
+	}
+
+	USDEntry entry;
+	if( USDEntryFromSession( &entry, ses ) == FALSE )
+	{
+		return;
+	}
+	entry.ude_Event = event;
+
+	FBOOL changed = FALSE;
+
+	pthread_rwlock_wrlock( &(usd->usd_Lock) );
+	if( event == USD_EVENT_EXPIRE )
+	{
+		changed = HashmapRemove( usd->usd_Sessions, entry.ude_SessionID );
+	}
+	else
+	{
+		changed = USDStore( usd->usd_Sessions, &entry );
+	}
+	pthread_rwlock_unlock( &(usd->usd_Lock) );
+
+	if( changed == FALSE )
+	{
+		return;
+	}
+
+	pthread_mutex_lock( &(usd->usd_PendingMutex) );
+	USDEntry *pending = HashmapGetData( usd->usd_Pending, entry.ude_SessionID );
+	if( pending != NULL )
+	{
+		// create followed by touch is still create
+		if( event == USD_EVENT_TOUCH && pending->ude_Event == USD_EVENT_CREATE )
+		{
+			entry.ude_Event = USD_EVENT_CREATE;
+		}
+		*pending = entry;
+	}
+	else
+	{
+		USDStore( usd->usd_Pending, &entry );
+	}
+	pthread_mutex_unlock( &(usd->usd_PendingMutex) );
+}
+
+/**
+ * Get session from directory
+ *
+ * @param usd pointer to UserSessionDirectory
+ * @param sessionid session id
+ * @param entry place where copy of entry will be stored
+ * @return TRUE when session was found, otherwise FALSE
+ */
+
+FBOOL USDGet( UserSessionDirectory *usd, const char *sessionid, USDEntry *entry )
+{
+	if( usd == NULL || sessionid == NULL )
+	{
+		return FALSE;
+	}
+
+	FBOOL found = FALSE;
+
+	pthread_rwlock_rdlock( &(usd->usd_Lock) );
+	USDEntry *e = HashmapGetData( usd->usd_Sessions, (char *)sessionid );
+	if( e != NULL )
+	{
+		*entry = *e;
+		found = TRUE;
+	}
+	pthread_rwlock_unlock( &(usd->usd_Lock) );
+
+	return found;
+}
+
+/**
+ * Create local session from session created on other FriendCore
+ *
+ * @param usd pointer to UserSessionDirectory
+ * @param sessionid session id
+ * @return pointer to UserSession when session is known in cluster, otherwise NULL
+ */
+
+UserSession *USDSessionAttach( UserSessionDirectory *usd, const char *sessionid )
+{
+	USDEntry entry;
+
+	if( USDGet( usd, sessionid, &entry ) == FALSE )
+	{
+		return NULL;
+	}
+
+	SystemBase *sb = (SystemBase *)usd->usd_SB;
+
+	DEBUG("[USDSessionAttach] Session %s of user %lu found in cluster directory\n", entry.ude_SessionID, entry.ude_UserID );
+
+	UserSession *ses = UserSessionNew( entry.ude_SessionID, entry.ude_DeviceIdentity );
+	if( ses == NULL )
+	{
+		return NULL;
+	}
+	ses->us_UserID = entry.ude_UserID;
+	ses->us_LoggedTime = entry.ude_LoggedTime;
+	ses->us_FromDirectory = TRUE;
+
+	UserSession *added = USMUserSessionAdd( sb->sl_USM, ses );
+	if( added != ses )
+	{
+		// same user and device already have session on this node
+		UserSessionDelete( ses );
+	}
+
+	if( added == NULL || added->us_User == NULL )
+	{
+		return NULL;
+	}
+
+	User *usr = added->us_User;
+	if( usr->u_InitialDevMount == FALSE )
+	{
+		UMAddUser( sb->sl_UM, usr );
+
+		MYSQLLibrary *sqllib = sb->LibraryMYSQLGet( sb );
+		if( sqllib != NULL )
+		{
+			UserDeviceMount( sb, sqllib, usr, 0 );
+			sb->LibraryMYSQLDrop( sb, sqllib );
+		}
+		else
+		{
+			FERROR("[USDSessionAttach] Cannot get mysql.library slot\n");
+		}
+	}
+
+	return added;
+}
+
+/**
+ * Parse one session entry from message
+ *
+ * @param data entry text, not terminated by zero
+ * @param size size of text
+ * @param entry place where parsed entry will be stored
+ * @return TRUE when entry is valid, otherwise FALSE
+ */
+
+static FBOOL USDEntryParse( const char *data, FULONG size, USDEntry *entry )
+{
+	char line[ USD_SESSIONID_SIZE + USD_DEVICEID_SIZE + 64 ];
+
+	if( size < 3 || size >= sizeof( line ) || data[ 1 ] != '=' )
+	{
+		return FALSE;
+	}
+	memcpy( line, data, size );
+	line[ size ] = 0;
+
+	entry->ude_Event = line[ 0 ];
+	if( entry->ude_Event != USD_EVENT_CREATE && entry->ude_Event != USD_EVENT_TOUCH && entry->ude_Event != USD_EVENT_EXPIRE )
+	{
+		return FALSE;
+	}
+
+	char *field[ 4 ];
+	char *ptr = &(line[ 2 ]);
+	int i;
+
+	for( i=0 ; i < 4 ; i++ )
+	{
+		field[ i ] = ptr;
+		if( i < 3 )
+		{
+			if( ( ptr = strchr( ptr, '\t' ) ) == NULL )
+			{
+				return FALSE;
+			}
+			*ptr++ = 0;
+		}
+	}
+
+	if( field[ 0 ][ 0 ] == 0 || strlen( field[ 0 ] ) >= USD_SESSIONID_SIZE || strlen( field[ 3 ] ) >= USD_DEVICEID_SIZE )
+	{
+		return FALSE;
+	}
+
+	strcpy( entry->ude_SessionID, field[ 0 ] );
+	entry->ude_UserID = strtoul( field[ 1 ], NULL, 0 );
+	entry->ude_LoggedTime = (time_t)strtoll( field[ 2 ], NULL, 0 );
+	strcpy( entry->ude_DeviceIdentity, field[ 3 ] );
+
+	return TRUE;
+}
+
+/**
+ * Delete session which was detached because it expired on other FriendCore
+ *
+ * Session is not on any list anymore, websocket requests which still use it
+ * are finished first, same as when websocket connection is closed.
+ *
+ * @param ses session removed from UserSessionManager
+ */
+
+static void USDSessionRelease( UserSession *ses )
+{
+	while( ses->us_NRConnections > 0 )
+	{
+		usleep( 10000 );
+	}
+	UserSessionDelete( ses );
+}
+
+/**
+ * Apply events received from other FriendCore
+ *
+ * Received events are not sent further, every FriendCore sends its own events
+ * to all connected FriendCores.
+ *
+ * @param usd pointer to UserSessionDirectory
+ * @param df pointer to ID_PARM DataForm which contains entries
+ * @return 0 when success, otherwise error number
+ */
+
+int USDReceive( UserSessionDirectory *usd, DataForm *df )
+{
+	if( usd == NULL || df == NULL || df->df_ID != ID_PARM )
+	{
+		FERROR("[USDReceive] Parameters not found\n");
+		return -1;
+	}
+
+	if( df->df_Size < COMM_MSG_HEADER_SIZE )
+	{
+		return 0;
+	}
+
+	SystemBase *sb = (SystemBase *)usd->usd_SB;
+	FBYTE *data = (FBYTE *)df + COMM_MSG_HEADER_SIZE;
+	FBYTE *end = data + df->df_Size - COMM_MSG_HEADER_SIZE;		// size contains end of group header which is not written
+	int received = 0;
+
+	while( data + COMM_MSG_HEADER_SIZE <= end )
+	{
+		DataForm *item = (DataForm *)data;
+		if( item->df_ID != ID_PRMT )
+		{
+			break;
+		}
+		data += COMM_MSG_HEADER_SIZE;
+		if( data + item->df_Size > end )
+		{
+			FERROR("[USDReceive] Entry is out of message\n");
+			break;
+		}
+
+		USDEntry entry;
+		if( USDEntryParse( (char *)data, item->df_Size, &entry ) == TRUE )
+		{
+			if( entry.ude_Event == USD_EVENT_EXPIRE )
+			{
+				pthread_rwlock_wrlock( &(usd->usd_Lock) );
+				HashmapRemove( usd->usd_Sessions, entry.ude_SessionID );
+				pthread_rwlock_unlock( &(usd->usd_Lock) );
+
+				// session ended on other node, its expire event was already removed from directory so it is not sent again
+				UserSessionManager *usm = sb->sl_USM;
+				UserSession *detached = NULL;
+				pthread_mutex_lock( &(usm->usm_Mutex) );
+				UserSession *ses = usm->usm_Sessions;
+				while( ses != NULL )
+				{
+					if( ses->us_SessionID != NULL && strcmp( ses->us_SessionID, entry.ude_SessionID ) == 0 )
+					{
+						if( ses->us_User != NULL )
+						{
+							USMUserSessionRemove( usm, ses );
+							detached = ses;
+						}
+						break;
+					}
+					ses = (UserSession *)ses->node.mln_Succ;
+				}
+				pthread_mutex_unlock( &(usm->usm_Mutex) );
+
+				if( detached != NULL )
+				{
+					USDSessionRelease( detached );
+				}
+			}
+			else
+			{
+				pthread_rwlock_wrlock( &(usd->usd_Lock) );
+				USDStore( usd->usd_Sessions, &entry );
+				pthread_rwlock_unlock( &(usd->usd_Lock) );
+
+				// keep local copy alive, database is updated by node which was used
+				UserSession *ses = USMGetSessionBySessionID( sb->sl_USM, entry.ude_SessionID );
+				if( ses != NULL && ses->us_LoggedTime < entry.ude_LoggedTime )
+				{
+					ses->us_LoggedTime = entry.ude_LoggedTime;
+					if( ses->us_User != NULL && ses->us_User->u_LoggedTime < entry.ude_LoggedTime )
+					{
+						ses->us_User->u_LoggedTime = entry.ude_LoggedTime;
+					}
+				}
+			}
+			received++;
+		}
+		data += item->df_Size;
+	}
+
+	DEBUG("[USDReceive] Received %d session events\n", received );
+
+	return 0;
+}
+
+/**
+ * Set message item
+ */
+
+static inline void USDSetTag( MsgItem *mi, FULONG tag, FULONG size, FULONG data )
+{
+	mi->mi_Tag = tag;
+	mi->mi_Size = size;
+	mi->mi_Data = data;
+}
+
+/**
+ * Send entries to FriendCores
+ *
+ * @param usd pointer to UserSessionDirectory
+ * @param target connection to which message will be sent, NULL sends to all connections
+ * @param entries table of pointers to entries
+ * @param count number of entries, no more then USD_BATCH_SIZE
+ * @return number of connections to which message was sent
+ */
+
+static int USDSendBatch( UserSessionDirectory *usd, CommFCConnection *target, USDEntry **entries, int count )
+{
+	SystemBase *sb = (SystemBase *)usd->usd_SB;
+	FriendCoreManager *fcm = sb->fcm;
+
+	if( count <= 0 || fcm == NULL || fcm->fcm_CommService == NULL )
+	{
+		return 0;
+	}
+
+	MsgItem *tags = FCalloc( count + 9, sizeof( MsgItem ) );
+	char *texts = FMalloc( count * ( USD_SESSIONID_SIZE + USD_DEVICEID_SIZE + 64 ) );
+	if( tags == NULL || texts == NULL )
+	{
+		FFree( tags );
+		FFree( texts );
+		FERROR("[USDSendBatch] Cannot allocate memory for message\n");
+		return 0;
+	}
+
+	int pos = 0;
+	USDSetTag( &(tags[ pos++ ]), ID_FCRE, 0, MSG_GROUP_START );
+	USDSetTag( &(tags[ pos++ ]), ID_FCID, FRIEND_CORE_MANAGER_ID_SIZE, (FULONG)fcm->fcm_ID );
+	USDSetTag( &(tags[ pos++ ]), ID_FRID, 0, MSG_INTEGER_VALUE );
+	USDSetTag( &(tags[ pos++ ]), ID_CMMD, 0, MSG_INTEGER_VALUE );
+	USDSetTag( &(tags[ pos++ ]), ID_SDIR, 0, MSG_INTEGER_VALUE );
+	USDSetTag( &(tags[ pos++ ]), ID_PARM, 0, MSG_GROUP_START );
+
+	char *text = texts;
+	int i;
+	for( i=0 ; i < count ; i++ )
+	{
+		USDEntry *e = entries[ i ];
+		int len = sprintf( text, "%c=%s\t%lu\t%lld\t%s", e->ude_Event, e->ude_SessionID, e->ude_UserID, (long long)e->ude_LoggedTime, e->ude_DeviceIdentity );
+
+		USDSetTag( &(tags[ pos++ ]), ID_PRMT, len, (FULONG)text );
+		text += len;
+	}
+
+	USDSetTag( &(tags[ pos++ ]), MSG_GROUP_END, 0, 0 );
+	USDSetTag( &(tags[ pos++ ]), TAG_DONE, TAG_DONE, TAG_DONE );
+
+	int sent = 0;
+	DataForm *df = DataFormNew( tags );
+	if( df != NULL )
+	{
+		CommFCConnection *con = target != NULL ? target : fcm->fcm_CommService->s_Connections;
+		while( con != NULL )
+		{
+			if( con->cfcc_Socket != NULL )
+			{
+				BufString *bs = SendMessageAndWait( con, df );
+				if( bs != NULL )
+				{
+					BufStringDelete( bs );
+					sent++;
+				}
+				else
+				{
+					FERROR("[USDSendBatch] No response from %s\n", con->cfcc_Address != NULL ? con->cfcc_Address : "" );
+				}
+			}
+
+			if( target != NULL )
+			{
+				break;
+			}
+			con = (CommFCConnection *)con->node.mln_Succ;
+		}
+		DataFormDelete( df );
+	}
+
+	FFree( tags );
+	FFree( texts );
+
+	return sent;
+}
+
+/**
+ * Send all sessions known on this node to new connection
+ *
+ * @param usd pointer to UserSessionDirectory
+ * @param con connection which will receive directory
+ */
+
+static void USDSyncConnection( UserSessionDirectory *usd, CommFCConnection *con )
+{
+	SystemBase *sb = (SystemBase *)usd->usd_SB;
+	UserSessionManager *usm = sb->sl_USM;
+
+	// sessions loaded from database or snapshot were never published
+
+	pthread_mutex_lock( &(usm->usm_Mutex) );
+	pthread_rwlock_wrlock( &(usd->usd_Lock) );
+	UserSession *ses = usm->usm_Sessions;
+	while( ses != NULL )
+	{
+		USDEntry entry;
+		if( USDEntryFromSession( &entry, ses ) == TRUE )
+		{
+			USDStore( usd->usd_Sessions, &entry );
+		}
+		ses = (UserSession *)ses->node.mln_Succ;
+	}
+	pthread_rwlock_unlock( &(usd->usd_Lock) );
+	pthread_mutex_unlock( &(usm->usm_Mutex) );
+
+	// copy is sent, directory is not locked while we wait for response
+
+	pthread_rwlock_rdlock( &(usd->usd_Lock) );
+	int count = HashmapLength( usd->usd_Sessions );
+	USDEntry *copy = count > 0 ? FMalloc( count * sizeof( USDEntry ) ) : NULL;
+	int nr = 0;
+	if( copy != NULL )
+	{
+		unsigned int iterator = 0;
+		HashmapElement *el = NULL;
+		while( ( el = HashmapIterate( usd->usd_Sessions, &iterator ) ) != NULL )
+		{
+			copy[ nr ] = *((USDEntry *)el->data);
+			copy[ nr ].ude_Event = USD_EVENT_CREATE;
+			nr++;
+		}
+	}
+	pthread_rwlock_unlock( &(usd->usd_Lock) );
+
+	if( copy == NULL )
+	{
+		return;
+	}
+
+	USDEntry *batch[ USD_BATCH_SIZE ];
+	int i, n = 0;
+	for( i=0 ; i < nr ; i++ )
+	{
+		batch[ n++ ] = &(copy[ i ]);
+		if( n == USD_BATCH_SIZE || i == nr-1 )
+		{
+			USDSendBatch( usd, con, batch, n );
+			n = 0;
+		}
+	}
+
+	INFO("[USDSyncConnection] %d sessions sent to %s\n", nr, con->cfcc_Address != NULL ? con->cfcc_Address : "" );
+
+	FFree( copy );
+}
+
+/**
+ * Send pending events and synchronize new connections
+ *
+ * @param usd pointer to UserSessionDirectory
+ * @return number of events sent
+ */
+
+int USDFlush( UserSessionDirectory *usd )
+{
+	if( usd == NULL )
+	{
+		return 0;
+	}
+
+	SystemBase *sb = (SystemBase *)usd->usd_SB;
+
+	// pending events are taken out under lock, sessions can be published while we send
+
+	Hashmap *pending = NULL;
+	Hashmap *empty = HashmapNew();
+	if( empty == NULL )
+	{
+		return 0;
+	}
+
+	pthread_mutex_lock( &(usd->usd_PendingMutex) );
+	if( HashmapLength( usd->usd_Pending ) > 0 )
+	{
+		pending = usd->usd_Pending;
+		usd->usd_Pending = empty;
+		empty = NULL;
+	}
+	pthread_mutex_unlock( &(usd->usd_PendingMutex) );
+
+	if( empty != NULL )
+	{
+		HashmapFree( empty );
+	}
+
+	if( sb->fcm == NULL || sb->fcm->fcm_CommService == NULL )
+	{
+		if( pending != NULL )
+		{
+			HashmapFree( pending );
+		}
+		return 0;
+	}
+
+	// new connections get whole directory, it already contains pending events
+
+	CommFCConnection *con = sb->fcm->fcm_CommService->s_Connections;
+	while( con != NULL )
+	{
+		if( con->cfcc_SessionsSynced == FALSE && con->cfcc_Socket != NULL )
+		{
+			USDSyncConnection( usd, con );
+			con->cfcc_SessionsSynced = TRUE;
+		}
+		con = (CommFCConnection *)con->node.mln_Succ;
+	}
+
+	int sent = 0;
+	if( pending != NULL )
+	{
+		USDEntry *batch[ USD_BATCH_SIZE ];
+		int n = 0;
+		int count = HashmapLength( pending );
+		unsigned int iterator = 0;
+		HashmapElement *el = NULL;
+
+		while( ( el = HashmapIterate( pending, &iterator ) ) != NULL )
+		{
+			batch[ n++ ] = (USDEntry *)el->data;
+			sent++;
+			if( n == USD_BATCH_SIZE || sent == count )
+			{
+				USDSendBatch( usd, NULL, batch, n );
+				n = 0;
+			}
+		}
+
+		HashmapFree( pending );
+
+		DEBUG("[USDFlush] %d session events sent\n", sent );
+	}
+
+	return sent;
+}
+
+/**
+ * Event function which send pending session events
+ *
+ * @param lsb pointer to SystemBase
+ * @return 0
+ */
+
+int USDFlushEvent( void *lsb )
+{
+	SystemBase *sb = (SystemBase *)lsb;
+
+	USDFlush( sb->sl_USD );
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ *
+ *  User session directory
+ *
+ *  Sessions created, used and removed on this FriendCore are sent to other
+ *  FriendCores connected by CommService. Every node keeps copy of all
+ *  sessions in cluster, so session lookup never leaves the node.
+ *
+ *  @date created 10/2026
+ */
+
+#ifndef __SYSTEM_USER_USER_SESSION_DIRECTORY_H__
+#define __SYSTEM_USER_USER_SESSION_DIRECTORY_H__
+
+#include <core/types.h>
+#include <util/hashmap.h>
+#include <service/comm_msg.h>
+#include <system/user/user_session.h>
+#include <pthread.h>
+
+#define USD_FLUSH_INTERVAL				1		// seconds between sending pending events
+#define USD_BATCH_SIZE					256		// events in one message
+#define USD_SESSIONID_SIZE				256
+#define USD_DEVICEID_SIZE				256
+
+//
+// Event types, first character of every entry in message
+//
+
+#define USD_EVENT_CREATE				'c'
+#define USD_EVENT_TOUCH					't'
+#define USD_EVENT_EXPIRE				'e'
+
+//
+// Session known in cluster
+//
+
+typedef struct USDEntry
+{
+	char							ude_SessionID[ USD_SESSIONID_SIZE ];
+	char							ude_DeviceIdentity[ USD_DEVICEID_SIZE ];
+	FULONG							ude_UserID;
+	time_t							ude_LoggedTime;
+	int								ude_Event;			// last event, used by pending entries
+}USDEntry;
+
+//
+// Directory
+//
+
+typedef struct UserSessionDirectory
+{
+	void							*usd_SB;
+	Hashmap							*usd_Sessions;		// sessionid -> USDEntry
+	pthread_rwlock_t				usd_Lock;
+	Hashmap							*usd_Pending;		// events waiting for flush, one per session
+	pthread_mutex_t					usd_PendingMutex;
+}UserSessionDirectory;
+
+//
+//
+//
+
+UserSessionDirectory *USDNew( void *sb );
+
+//
+//
+//
+
+void USDDelete( UserSessionDirectory *usd );
+
+//
+//
+//
+
+void USDPublish( UserSessionDirectory *usd, int event, UserSession *ses );
+
+//
+//
+//
+
+FBOOL USDGet( UserSessionDirectory *usd, const char *sessionid, USDEntry *entry );
+
+//
+//
+//
+
+UserSession *USDSessionAttach( UserSessionDirectory *usd, const char *sessionid );
+
+//
+//
+//
+
+int USDReceive( UserSessionDirectory *usd, DataForm *df );
+
+//
+//
+//
+
+int USDFlush( UserSessionDirectory *usd );
+
+//
+//
+//
+
+int USDFlushEvent( void *lsb );
+
+#endif // __SYSTEM_USER_USER_SESSION_DIRECTORY_H__
@@ -50,8 +50,10 @@ UserSessionManager *USMNew( void *sb )
 	if( ( sm = FCalloc( 1, sizeof( UserSessionManager ) ) ) != NULL )
 	{
 		sm->usm_SB = sb;
+		sm->usm_TouchGeneration = 1;
 		
 		pthread_mutex_init( &(sm->usm_Mutex), NULL );
+		pthread_mutex_init( &(sm->usm_TouchMutex), NULL );
 
 		return sm;
 	}
@@ -68,6 +70,9 @@ void USMDelete( UserSessionManager *smgr )
 {
 	if( smgr != NULL )
 	{
+		// pending LoggedTime updates must reach database before sessions go away
+		USMSessionTouchFlush( smgr );
+		
 		UserSession  *ls = smgr->usm_Sessions;
 		while( ls != NULL )
 		{
@@ -77,6 +82,12 @@ void USMDelete( UserSessionManager *smgr )
 			UserSessionDelete( rem );
 		}
 		
+		if( smgr->usm_TouchEntries != NULL )
+		{
+			FFree( smgr->usm_TouchEntries );
+		}
+		
+		pthread_mutex_destroy( &(smgr->usm_TouchMutex) );
 		pthread_mutex_destroy( &(smgr->usm_Mutex) );
 		
 		FFree( smgr );
@@ -174,7 +185,6 @@ UserSession *USMGetSessionByDeviceIDandUserDB( UserSessionManager *smgr, const c
 	SystemBase *sb = (SystemBase *)smgr->usm_SB;
 	MYSQLLibrary *sqlLib = sb->LibraryMYSQLGet( sb );
 	struct UserSession *usersession = NULL;
-	char tmpQuery[ 1024 ];
 	
 	if( sqlLib == NULL )
 	{
@@ -183,15 +193,11 @@ UserSession *USMGetSessionByDeviceIDandUserDB( UserSessionManager *smgr, const c
 	}
 	
 	int entries = 0;
-	//snprintf( tmpQuery, sizeof(tmpQuery)," ( DeviceIdentity='%s' AND UserID = %ld )", devid, uid );
-	sqlLib->SNPrintF( sqlLib, tmpQuery, sizeof(tmpQuery)," ( DeviceIdentity='%s' AND UserID = %ld )", devid, uid );
-	
-	DEBUG( "[USMGetSessionsByTimeout] Sending query: %s...\n", tmpQuery );
+	FULONG params[] = { SQLT_STR, (FULONG)devid, SQLT_INT, uid, SQLT_END };
 	
-	// You added 'where' and on the end you did not used it??
+	DEBUG( "[USMGetSessionByDeviceIDandUserDB] Sending query, device %s user %lu\n", devid, uid );
 	
-	//usersession = ( UserSession *)sqlLib->Load( sqlLib, UserSessionDesc, NULL, &entries );
-	usersession = ( struct UserSession *)sqlLib->Load( sqlLib, UserSessionDesc, tmpQuery, &entries );
+	usersession = ( struct UserSession *)sqlLib->LoadBind( sqlLib, UserSessionDesc, " ( DeviceIdentity = ? AND UserID = ? )", params, &entries );
 	sb->LibraryMYSQLDrop( sb, sqlLib );
 	
 	DEBUG("UserGetByTimeout end\n");
@@ -235,6 +241,7 @@ void USMLogUsersAndDevices( UserSessionManager *usm )
 {
 	SystemBase *sb = (SystemBase *)usm->usm_SB;
 	UserManager *um = (UserManager *)sb->sl_UM;
+	pthread_rwlock_rdlock( &(um->um_UsersLock) );
 	User *lu =um->um_Users;
 	while( lu != NULL )
 	{
@@ -249,6 +256,7 @@ void USMLogUsersAndDevices( UserSessionManager *usm )
 	
 		lu = (User *)lu->node.mln_Succ;
 	}
+	pthread_rwlock_unlock( &(um->um_UsersLock) );
 }
 
 /**
@@ -464,10 +472,13 @@ UserSession *USMUserSessionAdd( UserSessionManager *smgr, UserSession *s )
 	
 	DEBUG("Checking session id %lu\n",  s->us_UserID );
 	
+	FBOOL sessionAdded = !duplicateMasterSession;
+	
 	if( s->us_UserID != 0 )
 	{
 		UserManager *um = (UserManager *)smgr->usm_UM;
-		User *locusr = um->um_Users;
+		User *locusr = NULL;
+		FBOOL locusrRef = FALSE;	// reference taken from UserManager, released when session is attached
 		
 		if( s->us_User != NULL )
 		{
@@ -475,41 +486,37 @@ UserSession *USMUserSessionAdd( UserSessionManager *smgr, UserSession *s )
 		}
 		else
 		{
-			while( locusr != NULL )
+			locusr = UMGetUserByIDRef( um, s->us_UserID );
+			if( locusr != NULL )
 			{
-				//DEBUG("list  user id %lu  find usr id %lu\n", locusr->u_ID, s->us_UserID );
-				if( locusr->u_ID == s->us_UserID )
+				locusrRef = TRUE;
+				DEBUG("User found in memory, pointer to sessions %p and number %d\n", locusr->u_SessionsList, locusr->u_SessionsNr );
+				
+				if( locusr->u_SessionsNr > 0 )
 				{
-					DEBUG("User found in memory, pointer to sessions %p and number %d\n", locusr->u_SessionsList, locusr->u_SessionsNr );
-					
-					if( locusr->u_SessionsNr > 0 )
+					userHaveMoreSessions = TRUE;
+					// now we must update master session
+					/*
+					UserSessList *sli = locusr->u_SessionsList;
+					while( sli != NULL )
 					{
-						userHaveMoreSessions = TRUE;
-						// now we must update master session
-						/*
-						UserSessList *sli = locusr->u_SessionsList;
-						while( sli != NULL )
+						if( sli->us != NULL )
 						{
-							if( sli->us != NULL )
+							UserSession *mus = (UserSession *)sli->us;
+							if( mus != NULL )
 							{
-								UserSession *mus = (UserSession *)sli->us;
-								if( mus != NULL )
+								if( mus->us_MasterSession != NULL )
 								{
-									if( mus->us_MasterSession != NULL )
-									{
-										FFree( mus->us_MasterSession );
-									}
-									
-									mus->us_MasterSession = s->us_MasterSession;
+									FFree( mus->us_MasterSession );
 								}
+								
+								mus->us_MasterSession = s->us_MasterSession;
 							}
-							sli = (UserSessList *)sli->node.mln_Succ;
 						}
-						*/
+						sli = (UserSessList *)sli->node.mln_Succ;
 					}
-					break;
+					*/
 				}
-				locusr  = (User *)locusr->node.mln_Succ;
 			}
 		}
 		
@@ -586,6 +593,11 @@ UserSession *USMUserSessionAdd( UserSessionManager *smgr, UserSession *s )
 				*/
 			}
 			pthread_mutex_unlock( &(smgr->usm_Mutex) );
+			
+			if( locusrRef == TRUE )
+			{
+				UMReleaseUser( um, locusr );
+			}
 		}
 	}
 	else
@@ -596,6 +608,13 @@ UserSession *USMUserSessionAdd( UserSessionManager *smgr, UserSession *s )
 	}
 	
 	//pthread_mutex_unlock( &(smgr->usm_Mutex) );
+	
+	// sessions attached from directory are already known in cluster
+	if( sessionAdded == TRUE && s->us_FromDirectory == FALSE )
+	{
+		SystemBase *sb = (SystemBase *)smgr->usm_SB;
+		USDPublish( sb->sl_USD, USD_EVENT_CREATE, s );
+	}
 	return s;
 }
 
@@ -654,8 +673,10 @@ int USMUserSessionRemove( UserSessionManager *smgr, UserSession *remsess )
 	if( sessionRemoved == TRUE )
 	{
 		User *usr = remsess->us_User;
+		SystemBase *sb = (SystemBase *)smgr->usm_SB;
 		
 		DEBUG("Remove session %p\n", remsess );
+		USDPublish( sb->sl_USD, USD_EVENT_EXPIRE, remsess );
 		// remove session from user
 		UserRemoveSession( remsess->us_User, remsess );
 		//sess->us_User = NULL;
@@ -797,10 +818,206 @@ int USMSessionSaveDB( UserSessionManager *smgr, UserSession *ses )
 		else
 		{
 			DEBUG("Session already exist in DB\n");
+			USMSessionTouch( smgr, ses );
+		}
+		
+		sb->LibraryMYSQLDrop( sb, sqllib );
+	}
+	
+	return 0;
+}
+
+/**
+ * Update session LoggedTime in memory and queue it for database
+ *
+ * Entries are written by USMSessionTouchFlush. A session touched many times
+ * between two flushes occupies one entry.
+ *
+ * @param smgr pointer to UserSessionManager
+ * @param ses pointer to user session which was used
+ */
+
+void USMSessionTouch( UserSessionManager *smgr, UserSession *ses )
+{
+	if( smgr == NULL || ses == NULL )
+	{
+		return;
+	}
+	
+	time_t timestamp = time( NULL );
+	
+	ses->us_LoggedTime = timestamp;
+	if( ses->us_User != NULL )
+	{
+		ses->us_User->u_LoggedTime = timestamp;
+	}
+	
+	if( ses->us_SessionID == NULL )
+	{
+		return;
+	}
+	
+	SystemBase *sb = (SystemBase *)smgr->usm_SB;
+	USDPublish( sb->sl_USD, USD_EVENT_TOUCH, ses );
+	
+	pthread_mutex_lock( &(smgr->usm_TouchMutex) );
+	
+	if( ses->us_TouchGeneration == smgr->usm_TouchGeneration && ses->us_TouchIndex < smgr->usm_TouchCount &&
+		strcmp( smgr->usm_TouchEntries[ ses->us_TouchIndex ].ute_SessionID, ses->us_SessionID ) == 0 )
+	{
+		smgr->usm_TouchEntries[ ses->us_TouchIndex ].ute_LoggedTime = timestamp;
+		pthread_mutex_unlock( &(smgr->usm_TouchMutex) );
+		return;
+	}
+	
+	if( smgr->usm_TouchCount >= smgr->usm_TouchSize )
+	{
+		int newSize = smgr->usm_TouchSize > 0 ? smgr->usm_TouchSize * 2 : USM_TOUCH_BATCH_SIZE;
+		USMTouchEntry *ne = FCalloc( newSize, sizeof( USMTouchEntry ) );
+		if( ne == NULL )
+		{
+			pthread_mutex_unlock( &(smgr->usm_TouchMutex) );
+			FERROR("Cannot allocate memory for session touch entries\n");
+			return;
+		}
+		if( smgr->usm_TouchEntries != NULL )
+		{
+			memcpy( ne, smgr->usm_TouchEntries, smgr->usm_TouchCount * sizeof( USMTouchEntry ) );
+			FFree( smgr->usm_TouchEntries );
+		}
+		smgr->usm_TouchEntries = ne;
+		smgr->usm_TouchSize = newSize;
+	}
+	
+	char *sid = StringDuplicate( ses->us_SessionID );
+	if( sid != NULL )
+	{
+		USMTouchEntry *e = &(smgr->usm_TouchEntries[ smgr->usm_TouchCount ]);
+		e->ute_SessionID = sid;
+		e->ute_LoggedTime = timestamp;
+		
+		ses->us_TouchGeneration = smgr->usm_TouchGeneration;
+		ses->us_TouchIndex = smgr->usm_TouchCount++;
+	}
+	
+	pthread_mutex_unlock( &(smgr->usm_TouchMutex) );
+}
+
+/**
+ * Write queued LoggedTime updates to database
+ *
+ * Pending entries are taken out under lock, so sessions can be touched while
+ * database is busy. Every USM_TOUCH_BATCH_SIZE sessions are stored by one UPDATE.
+ *
+ * @param smgr pointer to UserSessionManager
+ * @return number of sessions written to database
+ */
+
+int USMSessionTouchFlush( UserSessionManager *smgr )
+{
+	if( smgr == NULL )
+	{
+		return 0;
+	}
+	
+	pthread_mutex_lock( &(smgr->usm_TouchMutex) );
+	USMTouchEntry *entries = smgr->usm_TouchEntries;
+	int count = smgr->usm_TouchCount;
+	
+	smgr->usm_TouchEntries = NULL;
+	smgr->usm_TouchCount = 0;
+	smgr->usm_TouchSize = 0;
+	smgr->usm_TouchGeneration++;
+	pthread_mutex_unlock( &(smgr->usm_TouchMutex) );
+	
+	if( entries == NULL )
+	{
+		return 0;
+	}
+	
+	int written = 0;
+	SystemBase *sb = (SystemBase *) smgr->usm_SB;
+	MYSQLLibrary *sqllib  = sb->LibraryMYSQLGet( sb );
+	
+	if( sqllib != NULL )
+	{
+		char temptext[ 512 ];
+		int start = 0;
+		
+		while( start < count )
+		{
+			int end = start + USM_TOUCH_BATCH_SIZE;
+			if( end > count )
+			{
+				end = count;
+			}
+			
+			BufString *bs = BufStringNewSize( ( end - start ) * 256 );
+			if( bs == NULL )
+			{
+				break;
+			}
+			
+			// UPDATE ... SET LoggedTime = CASE SessionID WHEN 'a' THEN 1 ... END WHERE SessionID IN ('a',...)
+			BufStringAdd( bs, "UPDATE `FUserSession` SET `LoggedTime` = CASE `SessionID`" );
+			int j;
+			for( j = start ; j < end ; j++ )
+			{
+				int size = sqllib->SNPrintF( sqllib, temptext, sizeof(temptext), " WHEN '%s' THEN %ld", entries[ j ].ute_SessionID, entries[ j ].ute_LoggedTime );
+				BufStringAddSize( bs, temptext, size < (int)sizeof(temptext) ? size : (int)sizeof(temptext)-1 );
+			}
+			BufStringAdd( bs, " ELSE `LoggedTime` END WHERE `SessionID` IN (" );
+			for( j = start ; j < end ; j++ )
+			{
+				int size = sqllib->SNPrintF( sqllib, temptext, sizeof(temptext), j == start ? "'%s'" : ",'%s'", entries[ j ].ute_SessionID );
+				BufStringAddSize( bs, temptext, size < (int)sizeof(temptext) ? size : (int)sizeof(temptext)-1 );
+			}
+			BufStringAdd( bs, ")" );
+			
+			if( sqllib->QueryWithoutResults( sqllib, bs->bs_Buffer ) == 0 )
+			{
+				written += end - start;
+			}
+			else
+			{
+				FERROR("Cannot store LoggedTime for %d sessions\n", end - start );
+			}
+			
+			BufStringDelete( bs );
+			start = end;
 		}
 		
 		sb->LibraryMYSQLDrop( sb, sqllib );
 	}
+	else
+	{
+		FERROR("Cannot get mysql.library slot, %d LoggedTime updates lost\n", count );
+	}
+	
+	int i;
+	for( i = 0 ; i < count ; i++ )
+	{
+		FFree( entries[ i ].ute_SessionID );
+	}
+	FFree( entries );
+	
+	DEBUG("LoggedTime stored for %d sessions\n", written );
+	
+	return written;
+}
+
+/**
+ * Event function which writes queued LoggedTime updates
+ *
+ * @param lsb pointer to SystemBase
+ * @return 0
+ */
+
+int USMSessionTouchFlushEvent( void *lsb )
+{
+	SystemBase *sb = (SystemBase *)lsb;
+	
+	USMSessionTouchFlush( sb->sl_USM );
 	
 	return 0;
 }
@@ -29,6 +29,23 @@
 #include "user_group.h"
 #include "user.h"
 
+//
+// LoggedTime touches are kept in memory and written in batches
+//
+
+#define USM_TOUCH_FLUSH_INTERVAL		15		// seconds between background writes
+#define USM_TOUCH_BATCH_SIZE			256		// sessions updated by one statement
+
+//
+// Pending LoggedTime update
+//
+
+typedef struct USMTouchEntry
+{
+	char									*ute_SessionID;		// copy of session id
+	time_t								ute_LoggedTime;
+} USMTouchEntry;
+
 //
 // User Session Manager structure
 //
@@ -40,6 +57,12 @@ typedef struct UserSessionManager
 	void 										*usm_UM;
 	
 	pthread_mutex_t					usm_Mutex;		// mutex
+	
+	USMTouchEntry					*usm_TouchEntries;		// pending LoggedTime updates
+	int										usm_TouchCount;
+	int										usm_TouchSize;
+	FULONG								usm_TouchGeneration;	// changed on every flush
+	pthread_mutex_t					usm_TouchMutex;
 } UserSessionManager;
 
 
@@ -137,6 +160,24 @@ int USMSessionSaveDB( UserSessionManager *smgr, UserSession *ses );
 //
 //
 
+void USMSessionTouch( UserSessionManager *smgr, UserSession *ses );
+
+//
+//
+//
+
+int USMSessionTouchFlush( UserSessionManager *smgr );
+
+//
+//
+//
+
+int USMSessionTouchFlushEvent( void *lsb );
+
+//
+//
+//
+
 char *USMUserGetActiveSessionID( UserSessionManager *smgr, User *usr );
 
 //
@@ -164,9 +205,9 @@ int USMRemoveOldSessionsinDB( void *lsb );
 // get user by auth id
 UserSession *UserGetByAuthID( UserSessionManager *usm, const char *authId );
 // get users by timeout
-User								*(*UserGetByTimeout)( UserSessionManager *usm, const FULONG timeout );
+//User								*(*UserGetByTimeout)( UserSessionManager *usm, const FULONG timeout );
 // get by user id
-User 							*(*UserGetByID)( UserSessionManager *usm, FULONG id );
+//User 							*(*UserGetByID)( UserSessionManager *usm, FULONG id );
 // get user by his name
 //void								*(*UserGetByName)( UserSessionManager *usm, const char *name );
 
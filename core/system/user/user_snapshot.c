@@ -0,0 +1,854 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ *
+ *  User snapshot
+ *
+ *  Structures are stored field by field using the same descriptions which
+ *  mysql.library uses (UserDesc, UserSessionDesc, GroupDesc), so snapshot
+ *  contains exactly what would be loaded from database.
+ *
+ *  @date created 10/2026
+ */
+
+#include "user_snapshot.h"
+#include <system/systembase.h>
+#include <util/murmurhash3.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+
+#define USER_SNAPSHOT_NULL_STRING	0xffffffff
+
+//
+// Reader over mapped data
+//
+
+typedef struct SnapshotReader
+{
+	const FUBYTE					*sr_Pos;
+	const FUBYTE					*sr_End;
+	int							sr_Error;
+}SnapshotReader;
+
+//
+// write helpers
+//
+
+static inline void SnapshotWriteU32( BufString *bs, uint32_t val )
+{
+	BufStringAddSize( bs, (char *)&val, sizeof( uint32_t ) );
+}
+
+static inline void SnapshotWriteU64( BufString *bs, uint64_t val )
+{
+	BufStringAddSize( bs, (char *)&val, sizeof( uint64_t ) );
+}
+
+//
+// read helpers, on error reader is marked and zero is returned
+//
+
+static inline const FUBYTE *SnapshotReadBytes( SnapshotReader *r, uint64_t size )
+{
+	if( r->sr_Error != 0 || (uint64_t)( r->sr_End - r->sr_Pos ) < size )
+	{
+		r->sr_Error = 1;
+		return NULL;
+	}
+	const FUBYTE *ptr = r->sr_Pos;
+	r->sr_Pos += size;
+	return ptr;
+}
+
+static inline uint32_t SnapshotReadU32( SnapshotReader *r )
+{
+	uint32_t val = 0;
+	const FUBYTE *ptr = SnapshotReadBytes( r, sizeof( uint32_t ) );
+	if( ptr != NULL )
+	{
+		memcpy( &val, ptr, sizeof( uint32_t ) );
+	}
+	return val;
+}
+
+static inline uint64_t SnapshotReadU64( SnapshotReader *r )
+{
+	uint64_t val = 0;
+	const FUBYTE *ptr = SnapshotReadBytes( r, sizeof( uint64_t ) );
+	if( ptr != NULL )
+	{
+		memcpy( &val, ptr, sizeof( uint64_t ) );
+	}
+	return val;
+}
+
+/**
+ * Write structure fields described by SQL description
+ *
+ * @param bs output buffer
+ * @param desc structure description
+ * @param data pointer to structure
+ */
+
+static void SnapshotWriteStruct( BufString *bs, FULONG *desc, void *data )
+{
+	FUBYTE *strptr = (FUBYTE *)data;
+	FULONG *dptr = &desc[ SQL_DATA_STRUCT_START ];
+
+	while( dptr[ 0 ] != SQLT_END )
+	{
+		switch( dptr[ 0 ] )
+		{
+			case SQLT_IDINT:
+			case SQLT_INT:
+			{
+				// same width as mysql.library Load uses
+				int tmp;
+				memcpy( &tmp, strptr + dptr[ 2 ], sizeof( int ) );
+				SnapshotWriteU32( bs, (uint32_t)tmp );
+			}
+			break;
+
+			case SQLT_STR:
+			{
+				char *str;
+				memcpy( &str, strptr + dptr[ 2 ], sizeof( char * ) );
+				if( str != NULL )
+				{
+					uint32_t len = strlen( str );
+					SnapshotWriteU32( bs, len );
+					BufStringAddSize( bs, str, len );
+				}
+				else
+				{
+					SnapshotWriteU32( bs, USER_SNAPSHOT_NULL_STRING );
+				}
+			}
+			break;
+		}
+		dptr += 3;
+	}
+}
+
+/**
+ * Read structure fields described by SQL description
+ *
+ * @param r reader
+ * @param desc structure description
+ * @return new structure or NULL when error appear
+ */
+
+static void *SnapshotReadStruct( SnapshotReader *r, FULONG *desc )
+{
+	FUBYTE *data = FCalloc( 1, desc[ SQL_DATA_STRUCTURE_SIZE ] );
+	if( data == NULL )
+	{
+		r->sr_Error = 1;
+		return NULL;
+	}
+
+	FULONG *dptr = &desc[ SQL_DATA_STRUCT_START ];
+
+	while( dptr[ 0 ] != SQLT_END && r->sr_Error == 0 )
+	{
+		switch( dptr[ 0 ] )
+		{
+			case SQLT_IDINT:
+			case SQLT_INT:
+			{
+				int tmp = (int)SnapshotReadU32( r );
+				memcpy( data + dptr[ 2 ], &tmp, sizeof( int ) );
+			}
+			break;
+
+			case SQLT_STR:
+			{
+				uint32_t len = SnapshotReadU32( r );
+				if( len != USER_SNAPSHOT_NULL_STRING )
+				{
+					const FUBYTE *src = SnapshotReadBytes( r, len );
+					if( src != NULL )
+					{
+						char *str = FMalloc( len + 1 );
+						if( str != NULL )
+						{
+							memcpy( str, src, len );
+							str[ len ] = 0;
+							memcpy( data + dptr[ 2 ], &str, sizeof( char * ) );
+						}
+						else
+						{
+							r->sr_Error = 1;
+						}
+					}
+				}
+			}
+			break;
+		}
+		dptr += 3;
+	}
+	return data;
+}
+
+/**
+ * Calculate hash of structure descriptions and sizes. Snapshot made by build with other layout is not used.
+ *
+ * @return layout hash
+ */
+
+static uint32_t SnapshotLayoutHash( )
+{
+	FULONG *descs[] = { GroupDesc, UserDesc, UserSessionDesc, NULL };
+	uint32_t hash = 0;
+	int i;
+
+	BufString *bs = BufStringNew();
+	if( bs == NULL )
+	{
+		return 0;
+	}
+
+	for( i = 0 ; descs[ i ] != NULL ; i++ )
+	{
+		FULONG *dptr = &descs[ i ][ SQL_DATA_STRUCT_START ];
+
+		SnapshotWriteU64( bs, descs[ i ][ SQL_DATA_STRUCTURE_SIZE ] );
+		while( dptr[ 0 ] != SQLT_END )
+		{
+			SnapshotWriteU64( bs, dptr[ 0 ] );
+			SnapshotWriteU64( bs, dptr[ 2 ] );
+			BufStringAdd( bs, (char *)dptr[ 1 ] );
+			dptr += 3;
+		}
+	}
+
+	MurmurHash3_x86_32( bs->bs_Buffer, (int)bs->bs_Size, USER_SNAPSHOT_VERSION, &hash );
+	BufStringDelete( bs );
+
+	return hash;
+}
+
+/**
+ * Write snapshot of groups, users and sessions to file
+ *
+ * @param lsb pointer to SystemBase
+ * @param path path to snapshot file
+ * @return 0 when success, otherwise error number
+ */
+
+int UserSnapshotSave( void *lsb, const char *path )
+{
+	SystemBase *sb = (SystemBase *)lsb;
+	UserManager *um = sb->sl_UM;
+	UserSessionManager *usm = sb->sl_USM;
+	UserSnapshotHeader hdr;
+
+	if( path == NULL || um == NULL || usm == NULL )
+	{
+		return 1;
+	}
+
+	BufString *bs = BufStringNew();
+	if( bs == NULL )
+	{
+		return 2;
+	}
+
+	memset( &hdr, 0, sizeof( UserSnapshotHeader ) );
+
+	UserGroup *ug = um->um_UserGroups;
+	while( ug != NULL )
+	{
+		SnapshotWriteStruct( bs, GroupDesc, ug );
+		hdr.ush_Groups++;
+		ug = (UserGroup *)ug->node.mln_Succ;
+	}
+
+	pthread_rwlock_rdlock( &(um->um_UsersLock) );
+	User *usr = um->um_Users;
+	while( usr != NULL )
+	{
+		int i;
+
+		SnapshotWriteStruct( bs, UserDesc, usr );
+		SnapshotWriteU32( bs, usr->u_GroupsNr );
+		for( i = 0 ; i < usr->u_GroupsNr ; i++ )
+		{
+			SnapshotWriteU64( bs, usr->u_Groups[ i ] != NULL ? usr->u_Groups[ i ]->ug_ID : 0 );
+		}
+		hdr.ush_Users++;
+		usr = (User *)usr->node.mln_Succ;
+	}
+	pthread_rwlock_unlock( &(um->um_UsersLock) );
+
+	pthread_mutex_lock( &(usm->usm_Mutex) );
+	UserSession *ses = usm->usm_Sessions;
+	while( ses != NULL )
+	{
+		SnapshotWriteStruct( bs, UserSessionDesc, ses );
+		hdr.ush_Sessions++;
+		ses = (UserSession *)ses->node.mln_Succ;
+	}
+	pthread_mutex_unlock( &(usm->usm_Mutex) );
+
+	memcpy( hdr.ush_Magic, USER_SNAPSHOT_MAGIC, sizeof( USER_SNAPSHOT_MAGIC ) );
+	hdr.ush_Version = USER_SNAPSHOT_VERSION;
+	hdr.ush_Layout = SnapshotLayoutHash();
+	hdr.ush_Created = time( NULL );
+	hdr.ush_DataSize = bs->bs_Size;
+	MurmurHash3_x64_128( bs->bs_Buffer, (int)bs->bs_Size, USER_SNAPSHOT_VERSION, hdr.ush_Checksum );
+
+	//
+	// new snapshot is written to temporary file and replaces old one when it is complete
+	//
+
+	int error = 0;
+	size_t size = sizeof( UserSnapshotHeader ) + bs->bs_Size;
+	int tmplen = strlen( path ) + 8;
+	char *tmppath = FCalloc( tmplen, sizeof( char ) );
+	if( tmppath == NULL )
+	{
+		BufStringDelete( bs );
+		return 2;
+	}
+	snprintf( tmppath, tmplen, "%s.tmp", path );
+
+	int fd = open( tmppath, O_RDWR | O_CREAT | O_TRUNC, 0600 );	// contains password hashes and session ids
+	if( fd >= 0 )
+	{
+		if( ftruncate( fd, size ) == 0 )
+		{
+			FUBYTE *map = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+			if( map != MAP_FAILED )
+			{
+				memcpy( map, &hdr, sizeof( UserSnapshotHeader ) );
+				memcpy( map + sizeof( UserSnapshotHeader ), bs->bs_Buffer, bs->bs_Size );
+				if( msync( map, size, MS_SYNC ) != 0 )
+				{
+					error = 4;
+				}
+				munmap( map, size );
+			}
+			else
+			{
+				error = 4;
+			}
+		}
+		else
+		{
+			error = 4;
+		}
+		close( fd );
+
+		if( error == 0 && rename( tmppath, path ) != 0 )
+		{
+			error = 5;
+		}
+		if( error != 0 )
+		{
+			unlink( tmppath );
+		}
+	}
+	else
+	{
+		error = 3;
+	}
+
+	if( error != 0 )
+	{
+		FERROR("[UserSnapshotSave] Cannot write snapshot %s, error %d\n", path, error );
+	}
+	else
+	{
+		DEBUG("[UserSnapshotSave] Snapshot stored, groups %u users %u sessions %u size %lu\n", hdr.ush_Groups, hdr.ush_Users, hdr.ush_Sessions, (unsigned long)size );
+	}
+
+	FFree( tmppath );
+	BufStringDelete( bs );
+
+	return error;
+}
+
+/**
+ * Periodic snapshot write, called by EventManager
+ *
+ * @param lsb pointer to SystemBase
+ * @return 0 when success, otherwise error number
+ */
+
+int UserSnapshotSaveEvent( void *lsb )
+{
+	SystemBase *sb = (SystemBase *)lsb;
+
+	return UserSnapshotSave( sb, sb->sl_UserSnapshotPath );
+}
+
+/**
+ * Load snapshot and put groups, users and sessions into managers.
+ * Nothing is changed when snapshot is missing, old or damaged, then database should be used.
+ *
+ * @param lsb pointer to SystemBase
+ * @param path path to snapshot file
+ * @param maxAge snapshots older then this number of seconds are not used
+ * @return 0 when success, otherwise error number
+ */
+
+int UserSnapshotLoad( void *lsb, const char *path, time_t maxAge )
+{
+	SystemBase *sb = (SystemBase *)lsb;
+	struct stat st;
+
+	if( path == NULL )
+	{
+		return 1;
+	}
+
+	int fd = open( path, O_RDONLY );
+	if( fd < 0 )
+	{
+		DEBUG("[UserSnapshotLoad] Snapshot %s not found\n", path );
+		return 1;
+	}
+
+	if( fstat( fd, &st ) != 0 || st.st_size < (off_t)sizeof( UserSnapshotHeader ) )
+	{
+		close( fd );
+		return 2;
+	}
+
+	size_t size = st.st_size;
+	FUBYTE *map = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+	if( map == MAP_FAILED )
+	{
+		return 2;
+	}
+
+	//
+	// validate header
+	//
+
+	UserSnapshotHeader hdr;
+	uint64_t checksum[ 2 ];
+	time_t now = time( NULL );
+	memcpy( &hdr, map, sizeof( UserSnapshotHeader ) );
+
+	if( memcmp( hdr.ush_Magic, USER_SNAPSHOT_MAGIC, sizeof( USER_SNAPSHOT_MAGIC ) ) != 0 || hdr.ush_Version != USER_SNAPSHOT_VERSION || hdr.ush_Layout != SnapshotLayoutHash() )
+	{
+		Log( FLOG_INFO, "[UserSnapshotLoad] Snapshot format is not compatible, database will be used\n");
+		munmap( map, size );
+		return 3;
+	}
+
+	if( hdr.ush_DataSize != size - sizeof( UserSnapshotHeader ) || hdr.ush_DataSize > INT_MAX )
+	{
+		FERROR("[UserSnapshotLoad] Snapshot size is wrong\n");
+		munmap( map, size );
+		return 3;
+	}
+
+	if( (time_t)hdr.ush_Created > now || ( now - (time_t)hdr.ush_Created ) > maxAge )
+	{
+		Log( FLOG_INFO, "[UserSnapshotLoad] Snapshot is too old, database will be used\n");
+		munmap( map, size );
+		return 4;
+	}
+
+	MurmurHash3_x64_128( map + sizeof( UserSnapshotHeader ), (int)hdr.ush_DataSize, USER_SNAPSHOT_VERSION, checksum );
+	if( checksum[ 0 ] != hdr.ush_Checksum[ 0 ] || checksum[ 1 ] != hdr.ush_Checksum[ 1 ] )
+	{
+		FERROR("[UserSnapshotLoad] Snapshot checksum is wrong\n");
+		munmap( map, size );
+		return 5;
+	}
+
+	//
+	// read entries, they are connected to managers only when everything was read
+	//
+
+	SnapshotReader r;
+	r.sr_Pos = map + sizeof( UserSnapshotHeader );
+	r.sr_End = map + size;
+	r.sr_Error = 0;
+
+	UserGroup *groups = NULL, *lastGroup = NULL;
+	User *users = NULL, *lastUser = NULL;
+	UserSession *sessions = NULL, *lastSession = NULL;
+	uint32_t i, j;
+
+	for( i = 0 ; i < hdr.ush_Groups && r.sr_Error == 0 ; i++ )
+	{
+		UserGroup *ug = SnapshotReadStruct( &r, GroupDesc );
+		if( ug == NULL )
+		{
+			break;
+		}
+		if( lastGroup == NULL )
+		{
+			groups = ug;
+		}
+		else
+		{
+			lastGroup->node.mln_Succ = (MinNode *)ug;
+		}
+		lastGroup = ug;
+	}
+
+	for( i = 0 ; i < hdr.ush_Users && r.sr_Error == 0 ; i++ )
+	{
+		User *usr = SnapshotReadStruct( &r, UserDesc );
+		if( usr == NULL )
+		{
+			break;
+		}
+		if( lastUser == NULL )
+		{
+			users = usr;
+		}
+		else
+		{
+			lastUser->node.mln_Succ = (MinNode *)usr;
+		}
+		lastUser = usr;
+
+		uint32_t groupsNr = SnapshotReadU32( &r );
+		if( groupsNr > hdr.ush_Groups )
+		{
+			r.sr_Error = 1;
+			break;
+		}
+		if( groupsNr > 0 && ( usr->u_Groups = FCalloc( groupsNr, sizeof( UserGroup *) ) ) == NULL )
+		{
+			r.sr_Error = 1;
+			break;
+		}
+
+		for( j = 0 ; j < groupsNr && r.sr_Error == 0 ; j++ )
+		{
+			FULONG gid = SnapshotReadU64( &r );
+			UserGroup *ug = groups;
+			while( ug != NULL )
+			{
+				if( ug->ug_ID == gid )
+				{
+					if( ug->ug_Name != NULL && strcmp( ug->ug_Name, "Admin" ) == 0 )
+					{
+						usr->u_IsAdmin = TRUE;
+					}
+					usr->u_Groups[ usr->u_GroupsNr++ ] = ug;
+					break;
+				}
+				ug = (UserGroup *)ug->node.mln_Succ;
+			}
+		}
+	}
+
+	for( i = 0 ; i < hdr.ush_Sessions && r.sr_Error == 0 ; i++ )
+	{
+		UserSession *ses = SnapshotReadStruct( &r, UserSessionDesc );
+		if( ses == NULL )
+		{
+			break;
+		}
+		pthread_mutex_init( &ses->us_WSMutex, NULL );
+
+		if( lastSession == NULL )
+		{
+			sessions = ses;
+		}
+		else
+		{
+			lastSession->node.mln_Succ = (MinNode *)ses;
+		}
+		lastSession = ses;
+	}
+
+	munmap( map, size );
+
+	if( r.sr_Error != 0 || r.sr_Pos != r.sr_End )
+	{
+		FERROR("[UserSnapshotLoad] Snapshot data is damaged, database will be used\n");
+
+		UserDeleteAll( users );
+		while( groups != NULL )
+		{
+			UserGroup *rem = groups;
+			groups = (UserGroup *)groups->node.mln_Succ;
+			UserGroupDelete( rem );
+			FFree( rem );
+		}
+		while( sessions != NULL )
+		{
+			UserSession *rem = sessions;
+			sessions = (UserSession *)sessions->node.mln_Succ;
+			UserSessionDelete( rem );
+		}
+		return 6;
+	}
+
+	//
+	// put users into manager, connect sessions to them
+	//
+
+	sb->sl_UM->um_UserGroups = groups;
+	while( users != NULL )
+	{
+		User *usr = users;
+		users = (User *)users->node.mln_Succ;
+		UMAddUser( sb->sl_UM, usr );
+	}
+
+	UserSession *ses = sessions;
+	lastSession = NULL;
+	while( ses != NULL )
+	{
+		UserSession *next = (UserSession *)ses->node.mln_Succ;
+		User *usr = UMGetUserByIDRef( sb->sl_UM, ses->us_UserID );
+		if( usr != NULL )
+		{
+			UserAddSession( usr, ses );
+			UMReleaseUser( sb->sl_UM, usr );
+		}
+		
+		// session without user cannot be used
+		if( usr == NULL )
+		{
+			if( lastSession == NULL )
+			{
+				sessions = next;
+			}
+			else
+			{
+				lastSession->node.mln_Succ = (MinNode *)next;
+			}
+			UserSessionDelete( ses );
+		}
+		else
+		{
+			lastSession = ses;
+		}
+		ses = next;
+	}
+
+	pthread_mutex_lock( &(sb->sl_USM->usm_Mutex) );
+	sb->sl_USM->usm_Sessions = sessions;
+	pthread_mutex_unlock( &(sb->sl_USM->usm_Mutex) );
+
+	Log( FLOG_INFO, "[UserSnapshotLoad] Snapshot loaded, groups %u users %u sessions %u, created %lu seconds ago\n", hdr.ush_Groups, hdr.ush_Users, hdr.ush_Sessions, (unsigned long)( now - (time_t)hdr.ush_Created ) );
+
+	return 0;
+}
+
+/**
+ * Reconcile sessions loaded from snapshot with database
+ *
+ * @param sb pointer to SystemBase
+ */
+
+static void UserSnapshotReconcileSessions( SystemBase *sb )
+{
+	UserSessionManager *usm = sb->sl_USM;
+	UserManager *um = sb->sl_UM;
+
+	UserSession *dbSessions = USMGetSessionsByTimeout( usm, LOGOUT_TIME );
+
+	//
+	// sessions which are not in database anymore (logged out or expired when FC was down) are removed
+	//
+
+	pthread_mutex_lock( &(usm->usm_Mutex) );
+	UserSession *ses = usm->usm_Sessions;
+	while( ses != NULL )
+	{
+		UserSession *next = (UserSession *)ses->node.mln_Succ;
+		FBOOL found = FALSE;
+
+		if( sb->sl_Sentinel != NULL && ses->us_User == sb->sl_Sentinel->s_User && ses->us_DeviceIdentity != NULL && strcmp( ses->us_DeviceIdentity, "remote" ) == 0 )
+		{
+			found = TRUE;		// sentinel remote session exist only in memory
+		}
+		else if( ses->us_SessionID != NULL )
+		{
+			UserSession *dbses = dbSessions;
+			while( dbses != NULL )
+			{
+				if( dbses->us_SessionID != NULL && strcmp( dbses->us_SessionID, ses->us_SessionID ) == 0 )
+				{
+					found = TRUE;
+					break;
+				}
+				dbses = (UserSession *)dbses->node.mln_Succ;
+			}
+		}
+
+		if( found == FALSE && ses->us_User != NULL )
+		{
+			DEBUG("[UserSnapshotReconcile] Session %s is not valid anymore\n", ses->us_SessionID );
+			// session is only detached, same as in USMRemoveOldSessions
+			USMUserSessionRemove( usm, ses );
+		}
+		ses = next;
+	}
+	pthread_mutex_unlock( &(usm->usm_Mutex) );
+
+	//
+	// sessions created when snapshot was written are added
+	//
+
+	while( dbSessions != NULL )
+	{
+		UserSession *dbses = dbSessions;
+		dbSessions = (UserSession *)dbSessions->node.mln_Succ;
+		dbses->node.mln_Succ = NULL;
+
+		if( dbses->us_SessionID == NULL || USMGetSessionBySessionID( usm, dbses->us_SessionID ) != NULL )
+		{
+			UserSessionDelete( dbses );
+			continue;
+		}
+
+		User *usr = UMGetUserByIDRef( um, dbses->us_UserID );
+		if( usr == NULL )
+		{
+			if( ( usr = UMUserGetByIDDB( um, dbses->us_UserID ) ) == NULL )
+			{
+				UserSessionDelete( dbses );
+				continue;
+			}
+			UMAddUser( um, usr );
+			User *lusr = UMGetUserByIDRef( um, dbses->us_UserID );
+			if( lusr != usr )
+			{
+				UserDelete( usr );
+			}
+			if( ( usr = lusr ) == NULL )
+			{
+				UserSessionDelete( dbses );
+				continue;
+			}
+		}
+
+		UserAddSession( usr, dbses );
+		UMReleaseUser( um, usr );
+
+		pthread_mutex_lock( &(usm->usm_Mutex) );
+		dbses->node.mln_Succ = (MinNode *)usm->usm_Sessions;
+		usm->usm_Sessions = dbses;
+		pthread_mutex_unlock( &(usm->usm_Mutex) );
+	}
+}
+
+/**
+ * Reconcile groups loaded from snapshot with database, new groups are added
+ *
+ * @param sb pointer to SystemBase
+ */
+
+static void UserSnapshotReconcileGroups( SystemBase *sb )
+{
+	UserManager *um = sb->sl_UM;
+	UserGroup *dbGroups = LoadGroups( sb );
+
+	while( dbGroups != NULL )
+	{
+		UserGroup *dbug = dbGroups;
+		dbGroups = (UserGroup *)dbGroups->node.mln_Succ;
+
+		UserGroup *ug = um->um_UserGroups;
+		while( ug != NULL )
+		{
+			if( ug->ug_ID == dbug->ug_ID )
+			{
+				break;
+			}
+			ug = (UserGroup *)ug->node.mln_Succ;
+		}
+
+		if( ug == NULL )
+		{
+			dbug->node.mln_Succ = (MinNode *)um->um_UserGroups;
+			um->um_UserGroups = dbug;
+		}
+		else
+		{
+			UserGroupDelete( dbug );
+			FFree( dbug );
+		}
+	}
+}
+
+/**
+ * Background reconcile of state loaded from snapshot. Sessions are checked first,
+ * then groups, applications and doors are loaded for every user.
+ *
+ * @param data pointer to FThread
+ */
+
+static void *UserSnapshotReconcile( void *data )
+{
+	FThread *thread = (FThread *)data;
+	SystemBase *sb = (SystemBase *)thread->t_Data;
+	time_t start = time( NULL );
+	int users = 0;
+
+	UserSnapshotReconcileSessions( sb );
+	UserSnapshotReconcileGroups( sb );
+
+	MYSQLLibrary *sqllib = sb->LibraryMYSQLGet( sb );
+	if( sqllib != NULL )
+	{
+		unsigned int usersNr = 0, ui;
+		User **list = UMGetUsersRef( sb->sl_UM, &usersNr );
+		for( ui = 0 ; ui < usersNr && thread->t_Quit == FALSE ; ui++ )
+		{
+			User *usr = list[ ui ];
+			UMAssignGroupToUser( sb->sl_UM, usr );
+			UMAssignApplicationsToUser( sb->sl_UM, usr );
+			// doors could be already mounted by login
+			UserDeviceMount( sb, sqllib, usr, 0 );
+
+			users++;
+		}
+		UMReleaseUsers( sb->sl_UM, list, usersNr );
+		sb->LibraryMYSQLDrop( sb, sqllib );
+	}
+
+	Log( FLOG_INFO, "[UserSnapshotReconcile] Reconcile with database finished, users %d, time %lu seconds\n", users, (unsigned long)( time( NULL ) - start ) );
+
+	return NULL;
+}
+
+/**
+ * Start background reconcile with database
+ *
+ * @param lsb pointer to SystemBase
+ * @return pointer to thread or NULL when error appear
+ */
+
+FThread *UserSnapshotReconcileStart( void *lsb )
+{
+	return ThreadNew( UserSnapshotReconcile, lsb, TRUE );
+}
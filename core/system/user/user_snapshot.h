@@ -0,0 +1,88 @@
+/*©mit**************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+* Copyright 2014-2017 Friend Software Labs AS                                  *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* MIT License for more details.                                                *
+*                                                                              *
+*****************************************************************************©*/
+
+/** @file
+ *
+ *  User snapshot
+ *
+ *  Groups, users and sessions kept in memory are written periodically to
+ *  memory mapped file. On startup snapshot is loaded instead of database
+ *  and then reconciled with database in background.
+ *
+ *  @date created 10/2026
+ */
+
+#ifndef __SYSTEM_USER_USER_SNAPSHOT_H__
+#define __SYSTEM_USER_USER_SNAPSHOT_H__
+
+#include <core/types.h>
+#include <core/thread.h>
+#include <stdint.h>
+
+#define USER_SNAPSHOT_MAGIC				"FCUSNAP"
+#define USER_SNAPSHOT_VERSION			1
+#define USER_SNAPSHOT_FILE				"cache/usersnapshot.bin"
+#define USER_SNAPSHOT_INTERVAL			60		// seconds between writes
+
+//
+// File header, data follows it
+//
+
+typedef struct UserSnapshotHeader
+{
+	char							ush_Magic[ 8 ];
+	uint32_t						ush_Version;
+	uint32_t						ush_Layout;			// hash of structures descriptions, changes when format is incompatible
+	uint64_t						ush_Created;		// time when snapshot was made
+	uint64_t						ush_DataSize;
+	uint64_t						ush_Checksum[ 2 ];	// murmurhash3 of data
+	uint32_t						ush_Groups;			// number of entries
+	uint32_t						ush_Users;
+	uint32_t						ush_Sessions;
+	uint32_t						ush_Reserved;
+}UserSnapshotHeader;
+
+//
+//
+//
+
+int UserSnapshotSave( void *sb, const char *path );
+
+//
+//
+//
+
+int UserSnapshotSaveEvent( void *lsb );
+
+//
+//
+//
+
+int UserSnapshotLoad( void *sb, const char *path, time_t maxAge );
+
+//
+//
+//
+
+FThread *UserSnapshotReconcileStart( void *sb );
+
+#endif // __SYSTEM_USER_USER_SNAPSHOT_H__
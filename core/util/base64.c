@@ -24,102 +24,79 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
 #include <util/log/log.h>
 #include "util/base64.h"
 #include <core/types.h>
 #include <string.h>
 
-
-//                   0000000000000000111111111111111122222222222222223333333333333333
-//                   0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF0123456789ABCDEF
-
-
-const char* CHARS = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-
-static char encoding_table[] = { 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
-                                 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
-                                 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
-                                 'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
-                                 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n',
-                                 'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
-                                 'w', 'x', 'y', 'z', '0', '1', '2', '3',
-                                 '4', '5', '6', '7', '8', '9', '+', '/' };
-static char *decoding_table = NULL;
-static int mod_table[] = { 0, 2, 1 };
+static const char encoding_table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
 //
-//
+// Decoding tables, one per character position in group of four. Value is
+// already shifted to its place in 24 bit group, so group is decoded with
+// three ORs. Characters which are not part of alphabet have bit 24 set.
 //
 
-void build_decoding_table()
-{
-	decoding_table = FCalloc( 1, 256 );
-	
-    for( int i = 0; i < 64; i++ )
-	{
-		decoding_table[ ( unsigned char ) encoding_table[ i ] ] = i;
-	}
-}
+#define B64_VAL( C ) ( ( (C) >= 'A' && (C) <= 'Z' ) ? (C) - 'A' : ( (C) >= 'a' && (C) <= 'z' ) ? (C) - 'a' + 26 : \
+	( (C) >= '0' && (C) <= '9' ) ? (C) - '0' + 52 : (C) == '+' ? 62 : (C) == '/' ? 63 : -1 )
+#define B64_DEC( C, S ) ( B64_VAL( C ) < 0 ? 0x01000000u : (FUINT)B64_VAL( C ) << (S) )
+#define B64_DEC4( C, S ) B64_DEC( (C), S ), B64_DEC( (C) + 1, S ), B64_DEC( (C) + 2, S ), B64_DEC( (C) + 3, S )
+#define B64_DEC16( C, S ) B64_DEC4( (C), S ), B64_DEC4( (C) + 4, S ), B64_DEC4( (C) + 8, S ), B64_DEC4( (C) + 12, S )
+#define B64_DEC64( C, S ) B64_DEC16( (C), S ), B64_DEC16( (C) + 16, S ), B64_DEC16( (C) + 32, S ), B64_DEC16( (C) + 48, S )
+#define B64_TABLE( S ) { B64_DEC64( 0, S ), B64_DEC64( 64, S ), B64_DEC64( 128, S ), B64_DEC64( 192, S ) }
+#define B64_INVALID( V ) ( (V) > 0xFFFFFF )
 
-//
-//
-//
-
-void base64_cleanup()
-{
-    FFree( decoding_table );
-    decoding_table = NULL;
-}
+static const FUINT decoding_table0[ 256 ] = B64_TABLE( 18 );
+static const FUINT decoding_table1[ 256 ] = B64_TABLE( 12 );
+static const FUINT decoding_table2[ 256 ] = B64_TABLE( 6 );
+static const FUINT decoding_table3[ 256 ] = B64_TABLE( 0 );
 
 //
-//
+// Encode data, 3 bytes are turned into 4 characters
 //
 
 char *Base64Encode( const unsigned char* data, int length )
 {
-	int outSize = (int)ceil( (float)length / 3.0f ) << 2;
-	int reminder = length % 3;
-	int padding = reminder ? 3 - reminder : 0;
-	int encSize = outSize - padding;
-
-	unsigned char c1 = 0, c2 = 0, c3 = 0;
-	int j = 0, i;
+	int outSize = ( ( length + 2 ) / 3 ) << 2;
+	int i;
 
-	char* encoded = FCalloc( outSize + 1, sizeof( char ) );
+	char* encoded = FMalloc( outSize + 1 );
 	if( encoded == NULL )
 	{
 		FERROR("Cannot allocate memory in Base64Encode\n");
 		return NULL;
 	}
+	
+	char *dst = encoded;
+	int full = length - ( length % 3 );
 
-	for( i = 0; i < encSize; i++ )
+	for( i = 0; i < full; i += 3 )
 	{
-		switch( i & 3 )
+		FUINT triple = ( (FUINT)data[ i ] << 16 ) | ( (FUINT)data[ i + 1 ] << 8 ) | data[ i + 2 ];
+		
+		dst[ 0 ] = encoding_table[ ( triple >> 18 ) & 0x3F ];
+		dst[ 1 ] = encoding_table[ ( triple >> 12 ) & 0x3F ];
+		dst[ 2 ] = encoding_table[ ( triple >> 6 ) & 0x3F ];
+		dst[ 3 ] = encoding_table[ triple & 0x3F ];
+		dst += 4;
+	}
+
+	// remaining 1 or 2 bytes are padded
+	if( i < length )
+	{
+		FUINT triple = (FUINT)data[ i ] << 16;
+		if( i + 1 < length )
 		{
-			case 0:	
-				c1 = data[ j++ ];
-				encoded[i] = CHARS[ c1 >> 2 ];
-				break;
-			case 1:
-				c2 = ( j < length ) ? data[ j++ ] : 0;
-				encoded[i] = CHARS[ ( ( c1 << 4 ) | ( c2 >> 4 ) ) & 0x3F ];
-				break;
-			case 2:
-				c3 = ( j < length ) ? data[ j++ ] : 0;
-				encoded[i] = CHARS[ ( ( c2 << 2 ) | ( c3 >> 6 ) ) & 0x3F ];
-				break;
-			case 3:
-				encoded[i] = CHARS[ c3 & 0x3F ];
-				break;
+			triple |= (FUINT)data[ i + 1 ] << 8;
 		}
+		
+		dst[ 0 ] = encoding_table[ ( triple >> 18 ) & 0x3F ];
+		dst[ 1 ] = encoding_table[ ( triple >> 12 ) & 0x3F ];
+		dst[ 2 ] = ( i + 1 < length ) ? encoding_table[ ( triple >> 6 ) & 0x3F ] : '=';
+		dst[ 3 ] = '=';
+		dst += 4;
 	}
-
-	if( padding > 0 )
-		encoded[i++] = '=';
-	if( padding > 1 )
-		encoded[i++] = '=';
-	encoded[i] = 0;
+	*dst = 0;
 
 	return encoded;
 }
@@ -127,74 +104,105 @@ char *Base64Encode( const unsigned char* data, int length )
 // Single argument version
 char *Base64EncodeString( const unsigned char *chr )
 {
-	return Base64Encode( chr, strlen( chr ) );
+	return Base64Encode( chr, strlen( (const char *)chr ) );
 }
 
 // Mark the base64 encoded string and return it
 char *MarkAndBase64EncodeString( const char *chr )
 {
-	char *str = Base64EncodeString( (const unsigned char *)chr );
+	int len = strlen( chr );
+	int outSize = ( ( len + 2 ) / 3 ) << 2;
+	
 	// 13 length <!--base64-->, +1 for terminator
-	char *fin = FCalloc( strlen( str ) + 14, sizeof( char ) );
-	if( fin != NULL )
+	char *fin = FMalloc( outSize + 14 );
+	if( fin == NULL )
 	{
-		sprintf( fin, "%s%s", "<!--base64-->", str );
-		FFree( str );
-		return fin;
+		return NULL;
 	}
+	
+	char *str = Base64Encode( (const unsigned char *)chr, len );
+	if( str == NULL )
+	{
+		FFree( fin );
+		return NULL;
+	}
+	memcpy( fin, "<!--base64-->", 13 );
+	memcpy( fin + 13, str, outSize + 1 );
 	FFree( str );
-	return NULL;
+	
+	return fin;
 }
 
 //
-//
+// Decode data, returned buffer is null terminated
 //
 
-/* Unstable code! Please test! */
 char *Base64Decode( const unsigned char* data, int length, int *finalLength )
 {
-	if( decoding_table == NULL ) build_decoding_table();
-
-	if( length % 4 != 0 )
+	if( data == NULL || length <= 0 || ( length & 3 ) != 0 )
 	{
 		FERROR("Cannot decode entry, beacouse size is incorect\n");
 		return NULL;
 	}
 
+	int padding = 0;
+	if( data[ length - 1 ] == '=' ) padding++;
+	if( data[ length - 2 ] == '=' ) padding++;
+	
 	// Length / 4 * 3
-	int output_length = ( ( ( length >> 4 ) + ( length >> 4 ) ) );
-	output_length += output_length << 1;
-    
-	if( data[ length - 1 ] == '=' ) ( output_length )--;
-	if( data[ length - 2 ] == '=' ) ( output_length )--;
-
-	unsigned char *decoded_data = FCalloc( output_length + 1, sizeof( char ) );
-    
-	if( decoded_data == NULL ) return NULL;
+	int outputLength = ( length >> 2 ) * 3 - padding;
 
-
-	for( int i = 0, j = 0; i < length; )
+	unsigned char *decoded = FMalloc( outputLength + 1 );
+	if( decoded == NULL )
 	{
-		unsigned long long sextet_a = data[i] == '=' ? 0 & i++ : decoding_table[data[i++]];
-		unsigned long long sextet_b = data[i] == '=' ? 0 & i++ : decoding_table[data[i++]];
-		unsigned long long sextet_c = data[i] == '=' ? 0 & i++ : decoding_table[data[i++]];
-		unsigned long long sextet_d = data[i] == '=' ? 0 & i++ : decoding_table[data[i++]];
-
-		unsigned long long triple =   ( sextet_a << 18 )  // 3 * 6
-									+ ( sextet_b << 12 )  // 2 * 6
-									+ ( sextet_c << 6  )  // 1 * 6
-									+ ( sextet_d       ); // 0 * 6
-
-		if( j < output_length) decoded_data[j++] = (triple >> 16 ) & 0xFF; // 2 * 8
-		if( j < output_length) decoded_data[j++] = (triple >> 8  ) & 0xFF; // 1 * 8
-		if( j < output_length) decoded_data[j++] = (triple       ) & 0xFF; // 0 * 8
+		FERROR("Cannot allocate memory in Base64Decode\n");
+		return NULL;
 	}
 	
-	*finalLength = output_length;
-
-	// Clean up and return
-	base64_cleanup();
+	const unsigned char *src = data;
+	const unsigned char *end = data + length - ( padding ? 4 : 0 );
+	unsigned char *dst = decoded;
+	
+	for( ; src < end; src += 4 )
+	{
+		FUINT triple = decoding_table0[ src[ 0 ] ] | decoding_table1[ src[ 1 ] ] | decoding_table2[ src[ 2 ] ] | decoding_table3[ src[ 3 ] ];
+		
+		if( B64_INVALID( triple ) )
+		{
+			break;
+		}
+		
+		dst[ 0 ] = ( triple >> 16 ) & 0xFF;
+		dst[ 1 ] = ( triple >> 8 ) & 0xFF;
+		dst[ 2 ] = triple & 0xFF;
+		dst += 3;
+	}
+	
+	// last group with padding
+	if( src == end && padding > 0 )
+	{
+		FUINT triple = decoding_table0[ src[ 0 ] ] | decoding_table1[ src[ 1 ] ] | ( padding == 1 ? decoding_table2[ src[ 2 ] ] : 0 );
+		
+		if( !B64_INVALID( triple ) )
+		{
+			*dst++ = ( triple >> 16 ) & 0xFF;
+			if( padding == 1 )
+			{
+				*dst++ = ( triple >> 8 ) & 0xFF;
+			}
+			src += 4;
+		}
+	}
 	
-	return (char *)decoded_data;
+	if( src != data + length )
+	{
+		FERROR("Cannot decode entry, invalid character at position %d\n", (int)( src - data ) );
+		FFree( decoded );
+		return NULL;
+	}
+	
+	*dst = 0;
+	*finalLength = outputLength;
+	
+	return (char *)decoded;
 }
-
@@ -259,3 +259,32 @@ int BufStringAddSize( BufString *bs, const char *ntext, int len )
 	return 0;
 }
 
+//
+// extend buffer so size bytes can be added without reallocation
+//
+
+int BufStringReserve( BufString *bs, int size )
+{
+	int newsize = bs->bs_Size + size;
+	
+	if( newsize <= bs->bs_Bufsize )
+	{
+		return 0;
+	}
+	
+	int allsize = ( (newsize / bs->bs_MAX_SIZE) + 1) * bs->bs_MAX_SIZE;
+	char *tmp;
+	
+	if( ( tmp = FCalloc( allsize + 10, sizeof(char) ) ) != NULL )
+	{
+		memcpy( tmp, bs->bs_Buffer, bs->bs_Size );
+		bs->bs_Bufsize = allsize;
+		
+		FFree( bs->bs_Buffer );
+		bs->bs_Buffer = tmp;
+		return 0;
+	}
+	
+	FERROR("Cannot allocate memory for buffer!\n");
+	return -1;
+}
@@ -73,5 +73,11 @@ int BufStringAdd( BufString *bs, const char *add );
 
 int BufStringAddSize( BufString *bs, const char *add, int size );
 
+//
+// Make sure that buffer can take more data without reallocation
+//
+
+int BufStringReserve( BufString *bs, int size );
+
 
 #endif //__BUFFERED_STRING_H__
@@ -22,21 +22,30 @@
 
 /*
  * Generic map implementation.
+ *
+ * Open addressing table with linear probing. Every slot has one control
+ * byte which is HASHMAP_CTRL_EMPTY or top 7 bits of key hash, lookups compare
+ * HASHMAP_GROUP_SIZE control bytes at once and call strcmp only on candidates.
+ * Removal shifts following entries back, so table never contains tombstones.
+ * Small maps (most request headers and parameters) keep entries inline in
+ * Hashmap structure and do not allocate table at all.
  */
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include "util/hashmap.h"
 #include <util/log/log.h>
+#include <util/murmurhash3.h>
 #include <core/types.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-#define INITIAL_SIZE (256)
-#define MAX_CHAIN_LENGTH (8)
+#define HASHMAP_CTRL_EMPTY		0x80
+#define HASHMAP_INITIAL_TABLE	64			// table size used when map leaves small mode
+#define HASHMAP_SEED			0x9747b28c
 
-#define MAP_MISSING -3 // No such element
-#define MAP_FULL -2    // Hashmap is full
-#define MAP_OMEM -1    // Out of Memory
-#define MAP_OK 0       // OK
+#define HASHMAP_H2( HASH ) ( (FUBYTE)( (HASH) >> 25 ) )
 
 #include "string.h"
 
@@ -54,265 +63,253 @@ Hashmap* HashmapNew()
 		return NULL;
 	}
 
-	m->data = (HashmapElement*) FCalloc( INITIAL_SIZE, sizeof( HashmapElement ) );
-	
-	if( !m->data )
-	{
-		FFree( m );
-		return NULL;
-	}
-
-	m->table_size = INITIAL_SIZE;
+	memset( m->small_ctrl, HASHMAP_CTRL_EMPTY, HASHMAP_SMALL_SIZE );
+	m->data = m->small;
+	m->ctrl = m->small_ctrl;
+	m->table_size = HASHMAP_SMALL_SIZE;
 	m->size = 0;
 
 	return m;
 }
 
-// TODO: Replace CRC32 with MurmurHash3!
-/* The implementation here was originally done by Gary S. Brown.  I have
-   borrowed the tables directly, and made some minor changes to the
-   crc32-function (including changing the interface). //ylo */
-
-  /* ============================================================= */
-  /*  COPYRIGHT (C) 1986 Gary S. Brown.  You may use this program, or       */
-  /*  code or tables extracted from it, as desired without restriction.     */
-  /*                                                                        */
-  /*  First, the polynomial itself and its table of feedback terms.  The    */
-  /*  polynomial is                                                         */
-  /*  X^32+X^26+X^23+X^22+X^16+X^12+X^11+X^10+X^8+X^7+X^5+X^4+X^2+X^1+X^0   */
-  /*                                                                        */
-  /*  Note that we take it "backwards" and put the highest-order term in    */
-  /*  the lowest-order bit.  The X^32 term is "implied"; the LSB is the     */
-  /*  X^31 term, etc.  The X^0 term (usually shown as "+1") results in      */
-  /*  the MSB being 1.                                                      */
-  /*                                                                        */
-  /*  Note that the usual hardware shift register implementation, which     */
-  /*  is what we're using (we're merely optimizing it by doing eight-bit    */
-  /*  chunks at a time) shifts bits into the lowest-order term.  In our     */
-  /*  implementation, that means shifting towards the right.  Why do we     */
-  /*  do it this way?  Because the calculated CRC must be transmitted in    */
-  /*  order from highest-order term to lowest-order term.  UARTs transmit   */
-  /*  characters in order from LSB to MSB.  By storing the CRC this way,    */
-  /*  we hand it to the UART in the order low-byte to high-byte; the UART   */
-  /*  sends each low-bit to hight-bit; and the result is transmission bit   */
-  /*  by bit from highest- to lowest-order term without requiring any bit   */
-  /*  shuffling on our part.  Reception works similarly.                    */
-  /*                                                                        */
-  /*  The feedback terms table consists of 256, 32-bit entries.  Notes:     */
-  /*                                                                        */
-  /*      The table can be generated at runtime if desired; code to do so   */
-  /*      is shown later.  It might not be obvious, but the feedback        */
-  /*      terms simply represent the results of eight shift/xor opera-      */
-  /*      tions for all combinations of data and CRC register values.       */
-  /*                                                                        */
-  /*      The values must be right-shifted by eight bits by the "updcrc"    */
-  /*      logic; the shift must be unsigned (bring in zeroes).  On some     */
-  /*      hardware you could probably optimize the shift in assembler by    */
-  /*      using byte-swap instructions.                                     */
-  /*      polynomial $edb88320                                              */
-  /*                                                                        */
-  /*  --------------------------------------------------------------------  */
-
-static unsigned long crc32_tab[] = {
-      0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
-      0x706af48fL, 0xe963a535L, 0x9e6495a3L, 0x0edb8832L, 0x79dcb8a4L,
-      0xe0d5e91eL, 0x97d2d988L, 0x09b64c2bL, 0x7eb17cbdL, 0xe7b82d07L,
-      0x90bf1d91L, 0x1db71064L, 0x6ab020f2L, 0xf3b97148L, 0x84be41deL,
-      0x1adad47dL, 0x6ddde4ebL, 0xf4d4b551L, 0x83d385c7L, 0x136c9856L,
-      0x646ba8c0L, 0xfd62f97aL, 0x8a65c9ecL, 0x14015c4fL, 0x63066cd9L,
-      0xfa0f3d63L, 0x8d080df5L, 0x3b6e20c8L, 0x4c69105eL, 0xd56041e4L,
-      0xa2677172L, 0x3c03e4d1L, 0x4b04d447L, 0xd20d85fdL, 0xa50ab56bL,
-      0x35b5a8faL, 0x42b2986cL, 0xdbbbc9d6L, 0xacbcf940L, 0x32d86ce3L,
-      0x45df5c75L, 0xdcd60dcfL, 0xabd13d59L, 0x26d930acL, 0x51de003aL,
-      0xc8d75180L, 0xbfd06116L, 0x21b4f4b5L, 0x56b3c423L, 0xcfba9599L,
-      0xb8bda50fL, 0x2802b89eL, 0x5f058808L, 0xc60cd9b2L, 0xb10be924L,
-      0x2f6f7c87L, 0x58684c11L, 0xc1611dabL, 0xb6662d3dL, 0x76dc4190L,
-      0x01db7106L, 0x98d220bcL, 0xefd5102aL, 0x71b18589L, 0x06b6b51fL,
-      0x9fbfe4a5L, 0xe8b8d433L, 0x7807c9a2L, 0x0f00f934L, 0x9609a88eL,
-      0xe10e9818L, 0x7f6a0dbbL, 0x086d3d2dL, 0x91646c97L, 0xe6635c01L,
-      0x6b6b51f4L, 0x1c6c6162L, 0x856530d8L, 0xf262004eL, 0x6c0695edL,
-      0x1b01a57bL, 0x8208f4c1L, 0xf50fc457L, 0x65b0d9c6L, 0x12b7e950L,
-      0x8bbeb8eaL, 0xfcb9887cL, 0x62dd1ddfL, 0x15da2d49L, 0x8cd37cf3L,
-      0xfbd44c65L, 0x4db26158L, 0x3ab551ceL, 0xa3bc0074L, 0xd4bb30e2L,
-      0x4adfa541L, 0x3dd895d7L, 0xa4d1c46dL, 0xd3d6f4fbL, 0x4369e96aL,
-      0x346ed9fcL, 0xad678846L, 0xda60b8d0L, 0x44042d73L, 0x33031de5L,
-      0xaa0a4c5fL, 0xdd0d7cc9L, 0x5005713cL, 0x270241aaL, 0xbe0b1010L,
-      0xc90c2086L, 0x5768b525L, 0x206f85b3L, 0xb966d409L, 0xce61e49fL,
-      0x5edef90eL, 0x29d9c998L, 0xb0d09822L, 0xc7d7a8b4L, 0x59b33d17L,
-      0x2eb40d81L, 0xb7bd5c3bL, 0xc0ba6cadL, 0xedb88320L, 0x9abfb3b6L,
-      0x03b6e20cL, 0x74b1d29aL, 0xead54739L, 0x9dd277afL, 0x04db2615L,
-      0x73dc1683L, 0xe3630b12L, 0x94643b84L, 0x0d6d6a3eL, 0x7a6a5aa8L,
-      0xe40ecf0bL, 0x9309ff9dL, 0x0a00ae27L, 0x7d079eb1L, 0xf00f9344L,
-      0x8708a3d2L, 0x1e01f268L, 0x6906c2feL, 0xf762575dL, 0x806567cbL,
-      0x196c3671L, 0x6e6b06e7L, 0xfed41b76L, 0x89d32be0L, 0x10da7a5aL,
-      0x67dd4accL, 0xf9b9df6fL, 0x8ebeeff9L, 0x17b7be43L, 0x60b08ed5L,
-      0xd6d6a3e8L, 0xa1d1937eL, 0x38d8c2c4L, 0x4fdff252L, 0xd1bb67f1L,
-      0xa6bc5767L, 0x3fb506ddL, 0x48b2364bL, 0xd80d2bdaL, 0xaf0a1b4cL,
-      0x36034af6L, 0x41047a60L, 0xdf60efc3L, 0xa867df55L, 0x316e8eefL,
-      0x4669be79L, 0xcb61b38cL, 0xbc66831aL, 0x256fd2a0L, 0x5268e236L,
-      0xcc0c7795L, 0xbb0b4703L, 0x220216b9L, 0x5505262fL, 0xc5ba3bbeL,
-      0xb2bd0b28L, 0x2bb45a92L, 0x5cb36a04L, 0xc2d7ffa7L, 0xb5d0cf31L,
-      0x2cd99e8bL, 0x5bdeae1dL, 0x9b64c2b0L, 0xec63f226L, 0x756aa39cL,
-      0x026d930aL, 0x9c0906a9L, 0xeb0e363fL, 0x72076785L, 0x05005713L,
-      0x95bf4a82L, 0xe2b87a14L, 0x7bb12baeL, 0x0cb61b38L, 0x92d28e9bL,
-      0xe5d5be0dL, 0x7cdcefb7L, 0x0bdbdf21L, 0x86d3d2d4L, 0xf1d4e242L,
-      0x68ddb3f8L, 0x1fda836eL, 0x81be16cdL, 0xf6b9265bL, 0x6fb077e1L,
-      0x18b74777L, 0x88085ae6L, 0xff0f6a70L, 0x66063bcaL, 0x11010b5cL,
-      0x8f659effL, 0xf862ae69L, 0x616bffd3L, 0x166ccf45L, 0xa00ae278L,
-      0xd70dd2eeL, 0x4e048354L, 0x3903b3c2L, 0xa7672661L, 0xd06016f7L,
-      0x4969474dL, 0x3e6e77dbL, 0xaed16a4aL, 0xd9d65adcL, 0x40df0b66L,
-      0x37d83bf0L, 0xa9bcae53L, 0xdebb9ec5L, 0x47b2cf7fL, 0x30b5ffe9L,
-      0xbdbdf21cL, 0xcabac28aL, 0x53b39330L, 0x24b4a3a6L, 0xbad03605L,
-      0xcdd70693L, 0x54de5729L, 0x23d967bfL, 0xb3667a2eL, 0xc4614ab8L,
-      0x5d681b02L, 0x2a6f2b94L, 0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL,
-      0x2d02ef8dL
-   };
-
-//
-// Return a 32-bit CRC of the contents of the buffer.
-//
-   
-unsigned long lcrc32( const unsigned char *s, unsigned int len )
+//
+// Hash a string
+//
+
+static inline FUINT HashmapHashKey( const char *key )
 {
-	unsigned int i;
-	unsigned long crc32val;
+	FUINT hash;
+	MurmurHash3_x86_32( key, (int)strlen( key ), HASHMAP_SEED, &hash );
+	return hash;
+}
+
+//
+// Return bitmask of control bytes in group equal to byte
+//
 
-	crc32val = 0;
-	for (i = 0;  i < len;  i ++)
+static inline unsigned int HashmapGroupMatch( const FUBYTE *ctrl, FUBYTE b )
+{
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128( (const __m128i *)ctrl );
+	return (unsigned int)_mm_movemask_epi8( _mm_cmpeq_epi8( group, _mm_set1_epi8( (char)b ) ) );
+#else
+	unsigned int mask = 0;
+	int i;
+	for( i = 0; i < HASHMAP_GROUP_SIZE; i++ )
 	{
-		//DEBUG("pos %d tabsize %d hash\n", len, sizeof( crc32_tab ) );
-		crc32val = crc32_tab[(crc32val ^ s[i]) & 0xff] ^ (crc32val >> 8);
+		mask |= (unsigned int)( ctrl[ i ] == b ) << i;
 	}
-	return crc32val;
+	return mask;
+#endif
 }
 
 //
-// Hash a string
+// Return bitmask of empty slots in group
 //
 
-unsigned int HashmapHashInt( Hashmap* in, char* key )
+static inline unsigned int HashmapGroupEmpty( const FUBYTE *ctrl )
 {
-    unsigned long hash = lcrc32( (unsigned char*) key, strlen( key ) );
-
-	// Robert Jenkins' 32 bit Mix Function
-	hash += (hash << 12);
-	hash ^= (hash >> 22);
-	hash += (hash << 4);
-	hash ^= (hash >> 9);
-	hash += (hash << 10);
-	hash ^= (hash >> 2);
-	hash += (hash << 7);
-	hash ^= (hash >> 12);
-
-	// Knuth's Multiplicative Method
-	hash = (hash >> 3) * 2654435761;
-
-	return hash % in->table_size;
+#ifdef __SSE2__
+	// only empty slots have top bit set
+	return (unsigned int)_mm_movemask_epi8( _mm_loadu_si128( (const __m128i *)ctrl ) );
+#else
+	return HashmapGroupMatch( ctrl, HASHMAP_CTRL_EMPTY );
+#endif
 }
 
 //
- // Return the integer of the location in data
- // to store the point to the item, or MAP_FULL.
- //
- 
-int HashmapHash( Hashmap* in, char* key )
+// Set control byte, first group is mirrored after end of table so
+// groups can be loaded from any position without wrapping
+//
+
+static inline void HashmapSetCtrl( Hashmap *in, unsigned int i, FUBYTE v )
 {
-	// If full, return immediately
-	if( in->size >= ( in->table_size >> 1 ) )
+	in->ctrl[ i ] = v;
+	if( in->data != in->small && i < HASHMAP_GROUP_SIZE )
 	{
-		FERROR("Hashmap is full!\n");
-		return MAP_FULL;
+		in->ctrl[ in->table_size + i ] = v;
 	}
+}
 
-	// Find the best index
-	unsigned int curr = HashmapHashInt( in, key );
+//
+// Return slot index of key or -1 when key is not in hashmap
+//
 
-	/* Linear probing */
-	for( unsigned int i = 0; i < MAX_CHAIN_LENGTH; i++ )
+static int HashmapFind( Hashmap* in, const char* key, FUINT hash )
+{
+	FUBYTE h2 = HASHMAP_H2( hash );
+	unsigned int m;
+	
+	// small map: all entries are in one group
+	if( in->data == in->small )
 	{
-		if( in->data[curr].inUse == 0 )
+		m = HashmapGroupMatch( in->ctrl, h2 );
+		while( m != 0 )
 		{
-			return curr;
+			int i = __builtin_ctz( m );
+			if( in->data[ i ].hash == hash && strcmp( in->data[ i ].key, key ) == 0 )
+			{
+				return i;
+			}
+			m &= m - 1;
 		}
-
-		if( in->data[curr].inUse == TRUE && ( strcmp( in->data[curr].key, key ) == 0 ) )
+		return -1;
+	}
+	
+	unsigned int mask = in->table_size - 1;
+	unsigned int pos = hash & mask;
+	
+	while( TRUE )
+	{
+		const FUBYTE *group = in->ctrl + pos;
+		
+		m = HashmapGroupMatch( group, h2 );
+		while( m != 0 )
 		{
-			return curr;
+			unsigned int i = ( pos + __builtin_ctz( m ) ) & mask;
+			if( in->data[ i ].hash == hash && strcmp( in->data[ i ].key, key ) == 0 )
+			{
+				return (int)i;
+			}
+			m &= m - 1;
 		}
-
-		curr = ( curr + 1 ) % in->table_size;
+		
+		// probe chain ends on first empty slot
+		if( HashmapGroupEmpty( group ) != 0 )
+		{
+			return -1;
+		}
+		pos = ( pos + HASHMAP_GROUP_SIZE ) & mask;
 	}
-
-	return MAP_FULL;
+	return -1;
 }
 
 //
-// Doubles the size of the hashmap, and rehashes all the elements
+// Put new entry into first free slot, key must not be in hashmap and there must be free space
 //
 
-int HashmapRehash( Hashmap* in )
+static void HashmapInsertNew( Hashmap* in, char* key, void* value, FUINT hash )
 {
-	// Setup the new elements
-	HashmapElement* temp = (HashmapElement*) calloc( in->table_size << 1, sizeof( HashmapElement ) );
-	if(!temp)
+	unsigned int i;
+	
+	if( in->data == in->small )
 	{
-		FERROR("Cannot allocate memory for temporary hashmap\n");
-		return 0;
+		i = in->size;
 	}
-
-	// Update the array
-	HashmapElement* curr = in->data;
-	in->data = temp;
-
-	// Update the size
-	unsigned int old_size = in->table_size;
-	in->table_size = in->table_size << 1;
-	in->size = 0;
-
-	// Rehash the elements
-	for( unsigned int i = 0; i < old_size; i++ )
+	else
 	{
-		if( !curr[i].inUse )
+		unsigned int mask = in->table_size - 1;
+		unsigned int pos = hash & mask;
+		unsigned int m;
+		
+		while( ( m = HashmapGroupEmpty( in->ctrl + pos ) ) == 0 )
 		{
-			continue;
+			pos = ( pos + HASHMAP_GROUP_SIZE ) & mask;
 		}
+		i = ( pos + __builtin_ctz( m ) ) & mask;
+	}
+	
+	HashmapSetCtrl( in, i, HASHMAP_H2( hash ) );
+	in->data[ i ].key = key;
+	in->data[ i ].data = value;
+	in->data[ i ].hash = hash;
+	in->data[ i ].inUse = TRUE;
+	in->size++;
+}
 
-		if( HashmapPut( in, curr[i].key, curr[i].data ) )
+//
+// Move all elements to new table with provided size (power of two)
+//
+
+static FBOOL HashmapResize( Hashmap* in, unsigned int size )
+{
+	// slots and control bytes are kept in one allocation
+	HashmapElement *table = (HashmapElement *)FCalloc( 1, size * sizeof( HashmapElement ) + size + HASHMAP_GROUP_SIZE );
+	if( table == NULL )
+	{
+		FERROR("Cannot allocate memory for hashmap table\n");
+		return FALSE;
+	}
+	
+	HashmapElement *old = in->data;
+	unsigned int oldSize = in->table_size;
+	unsigned int i;
+	
+	in->data = table;
+	in->ctrl = (FUBYTE *)( table + size );
+	memset( in->ctrl, HASHMAP_CTRL_EMPTY, size + HASHMAP_GROUP_SIZE );
+	in->table_size = size;
+	in->size = 0;
+	
+	for( i = 0; i < oldSize; i++ )
+	{
+		if( old[ i ].inUse == TRUE )
 		{
-			return 1;
+			HashmapInsertNew( in, old[ i ].key, old[ i ].data, old[ i ].hash );
 		}
 	}
-
-	FFree( curr );
-
-	return 1;
+	
+	if( old != in->small )
+	{
+		FFree( old );
+	}
+	else
+	{
+		memset( in->small, 0, sizeof( in->small ) );
+	}
+	return TRUE;
 }
 
 //
 // Add a pointer to the hashmap with some key
-// No data is copied!
+// No data is copied! Hashmap takes ownership of key and value,
+// when key already exists previous key and value are released.
 //
 
 FBOOL HashmapPut( Hashmap* in, char* key, void* value )
 {
-	// Find a place to put our value
-	int index = HashmapHash( in, key );
-	while( index == MAP_FULL )
+	if( in == NULL || key == NULL )
+	{
+		return FALSE;
+	}
+	
+	FUINT hash = HashmapHashKey( key );
+	int index = HashmapFind( in, key, hash );
+	
+	// Replace the data
+	if( index >= 0 )
 	{
-		if( !HashmapRehash( in ) )
+		HashmapElement *e = &in->data[ index ];
+		if( e->data != NULL && e->data != value )
+		{
+			FFree( e->data );
+		}
+		if( e->key != key )
+		{
+			FFree( e->key );
+			e->key = key;
+		}
+		e->data = value;
+		return TRUE;
+	}
+	
+	// Keep load factor under 3/4
+	if( in->data == in->small )
+	{
+		if( in->size >= HASHMAP_SMALL_SIZE && HashmapResize( in, HASHMAP_INITIAL_TABLE ) == FALSE )
 		{
 			return FALSE;
 		}
-		index = HashmapHash( in, key );
 	}
-
-	// Set the data
-	if( in->data[index].data ) free( in->data[index].data );
-	in->data[index].data = value;
-	if( in->data[index].key ) free( in->data[index].key );
-	in->data[index].key = key;
-	in->data[index].inUse = TRUE;
-	in->size++; 
+	else if( ( in->size + 1 ) > ( in->table_size - ( in->table_size >> 2 ) ) )
+	{
+		if( HashmapResize( in, in->table_size << 1 ) == FALSE )
+		{
+			return FALSE;
+		}
+	}
+	
+	HashmapInsertNew( in, key, value, hash );
 
 	return TRUE;
 }
@@ -329,18 +326,10 @@ HashmapElement* HashmapGet( Hashmap* in, char* key )
 		return NULL;
 	}
 	
-	// Find data location
-	unsigned int curr = HashmapHashInt( in, key );
-
-	// Linear probing, if necessary
-	for( unsigned int i = 0; i < MAX_CHAIN_LENGTH; i++ )
+	int index = HashmapFind( in, key, HashmapHashKey( key ) );
+	if( index >= 0 )
 	{
-		//DEBUG("---------->key %s ----------- data %s \n", key, in->data[curr].data );
-		if( in->data[curr].inUse && strcmp( in->data[curr].key, key ) == 0 )
-		{
-			return &in->data[curr];
-		}
-		curr = (curr + 1) % in->table_size;
+		return &in->data[ index ];
 	}
 
 	// Not found
@@ -353,28 +342,10 @@ HashmapElement* HashmapGet( Hashmap* in, char* key )
 
 void* HashmapGetData( Hashmap* in, char* key )
 {
-	// We need data!
-	if( in == NULL || key == NULL )
+	HashmapElement *e = HashmapGet( in, key );
+	if( e != NULL )
 	{
-		return NULL;
-	}
-	
-	// Find data location
-	unsigned int curr = HashmapHashInt( in, key );
-	
-	// Linear probing, if necessary
-	for( unsigned int i = 0; i < MAX_CHAIN_LENGTH; i++ )
-	{
-		//DEBUG("---------->key %s ----------- data %s \n", key, in->data[curr].data );
-		if( in->data[curr].inUse && strcmp( in->data[curr].key, key ) == 0 )
-		{
-			//if( &in->data[curr] != NULL )
-			//{
-				return (in->data[curr].data);
-			//}
-			
-		}
-		curr = (curr + 1) % in->table_size;
+		return e->data;
 	}
 	
 	// Not found
@@ -407,6 +378,70 @@ HashmapElement* HashmapIterate( Hashmap* in, unsigned int* iterator )
 	return NULL;
 }
 
+//
+// Remove an element with that key from the map
+//
+
+FBOOL HashmapRemove( Hashmap* in, char* key )
+{
+	if( in == NULL || key == NULL )
+	{
+		return FALSE;
+	}
+	
+	int index = HashmapFind( in, key, HashmapHashKey( key ) );
+	if( index < 0 )
+	{
+		return FALSE;
+	}
+	
+	unsigned int i = (unsigned int)index;
+	
+	if( in->data[ i ].data != NULL ) FFree( in->data[ i ].data );
+	if( in->data[ i ].key != NULL ) FFree( in->data[ i ].key );
+	
+	if( in->data == in->small )
+	{
+		// keep small map packed, last entry fills the hole
+		unsigned int last = in->size - 1;
+		if( i != last )
+		{
+			in->data[ i ] = in->data[ last ];
+			in->ctrl[ i ] = in->ctrl[ last ];
+		}
+		i = last;
+	}
+	else
+	{
+		// backward shift: move following entries of probe chain into the hole
+		// when their home slot is not between hole and their position
+		unsigned int mask = in->table_size - 1;
+		unsigned int j = i;
+		
+		while( TRUE )
+		{
+			j = ( j + 1 ) & mask;
+			if( in->ctrl[ j ] == HASHMAP_CTRL_EMPTY )
+			{
+				break;
+			}
+			
+			unsigned int home = in->data[ j ].hash & mask;
+			if( ( ( j - home ) & mask ) >= ( ( j - i ) & mask ) )
+			{
+				in->data[ i ] = in->data[ j ];
+				HashmapSetCtrl( in, i, in->ctrl[ j ] );
+				i = j;
+			}
+		}
+	}
+	
+	memset( &in->data[ i ], 0, sizeof( HashmapElement ) );
+	HashmapSetCtrl( in, i, HASHMAP_CTRL_EMPTY );
+	in->size--;
+	
+	return TRUE;
+}
 
 //
 // Deallocate the hashmap
@@ -414,28 +449,27 @@ HashmapElement* HashmapIterate( Hashmap* in, unsigned int* iterator )
 
 void HashmapFree( Hashmap* in )
 {
-	HashmapElement e;
 	unsigned int i = 0;
 	
-	//FERROR("remove hashmap===============\n");
+	if( in == NULL )
+	{
+		return;
+	}
 	
 	for( ; i < in->table_size; i++ )
 	{
-		e = in->data[i];
-		if( e.inUse == TRUE )
+		HashmapElement *e = &in->data[i];
+		if( e->inUse == TRUE )
 		{
-			//DEBUG("Remove key %s\n", e.data );
-		
-			if( e.data != NULL ) FFree( e.data );
-			if( e.key  != NULL ) FFree( e.key );
+			if( e->data != NULL ) FFree( e->data );
+			if( e->key  != NULL ) FFree( e->key );
 		}
 	}
-	//DEBUG("hashmap free data\n");
-	if( in->data != NULL )
+
+	if( in->data != in->small )
 	{
 		FFree( in->data );
 	}
-	//DEBUG("Free hashmap\n");
 	FFree( in );
 }
 
@@ -453,22 +487,27 @@ int HashmapLength( Hashmap* in )
 }
 
 //
-// Hashmap clone
+// Hashmap clone, values are expected to be strings
 //
 
 Hashmap *HashmapClone( Hashmap *in )
 {
 	Hashmap *hn = HashmapNew();
-	if( hn != NULL )
+	if( hn != NULL && in != NULL )
 	{
-		unsigned int i;
+		unsigned int iterator = 0;
+		HashmapElement *e;
 		
-		// Linear probing, if necessary
-		for( i = 0; i < INITIAL_SIZE; i++ )
+		while( ( e = HashmapIterate( in, &iterator ) ) != NULL )
 		{
-			hn->data[ i ].inUse = in->data[ i ].inUse;
-			hn->data[ i ].key = StringDuplicate( in->data[ i ].key );
-			hn->data[ i ].data = StringDuplicate( in->data[ i ].key );
+			char *key = StringDuplicate( e->key );
+			char *data = StringDuplicate( e->data );
+			
+			if( key == NULL || HashmapPut( hn, key, data ) == FALSE )
+			{
+				if( key != NULL ) FFree( key );
+				if( data != NULL ) FFree( data );
+			}
 		}
 	}
 	return hn;
@@ -487,45 +526,3 @@ int HashmapAdd( Hashmap *src, Hashmap *hm )
 	
 	return 0;
 }
-
-/*
- * Remove an element with that key from the map
- */
- /*
-TODO: IMPLEMENT ME!!!
-int hashmap_remove(Map_t in, char* key){
-	int i;
-	int curr;
-	hashmap_map* m;
-
-	// Cast the hashmap
-	m = (hashmap_map *) in;
-
-	// Find key
-	curr = hashmap_hash_int(m, key);
-
-	// Linear probing, if necessary
-	for(i = 0; i<MAX_CHAIN_LENGTH; i++){
-
-        int inUse = m->data[curr].inUse;
-        if (inUse == 1){
-            if (strcmp(m->data[curr].key,key)==0){
-                // Blank out the fields
-                m->data[curr].inUse = 0;
-                m->data[curr].data = NULL;
-                m->data[curr].key = NULL;
-
-                // Reduce the size
-                m->size--;
-                return MAP_OK;
-            }
-		}
-		curr = (curr + 1) % m->table_size;
-	}
-
-	// Data not found
-	return MAP_MISSING;
-}
-*/
-
-
@@ -25,8 +25,18 @@ typedef struct HashmapElement{
 	char* key;
 	FBOOL inUse;
 	void* data;
+	FUINT hash;			// full hash of key, used to find home slot when entries are moved
 } HashmapElement;
 
+//
+// Maps with up to HASHMAP_SMALL_SIZE entries keep them inline and are
+// searched with one control byte group, bigger ones use open addressing
+// table with linear probing. Table size is always power of two.
+//
+
+#define HASHMAP_SMALL_SIZE 16
+#define HASHMAP_GROUP_SIZE 16
+
 //
 // The hashmap
 //
@@ -35,6 +45,9 @@ typedef struct Hashmap{
 	unsigned int table_size;
 	unsigned int size;
 	HashmapElement *data;
+	FUBYTE *ctrl;		// control byte per slot: HASHMAP_CTRL_EMPTY or 7 bits of hash
+	FUBYTE small_ctrl[ HASHMAP_SMALL_SIZE ];
+	HashmapElement small[ HASHMAP_SMALL_SIZE ];
 } Hashmap;
 
 //
@@ -80,7 +93,7 @@ Hashmap *HashmapClone( Hashmap *hm );
 int HashmapAdd( Hashmap *src, Hashmap *hm );
 
 //
-// UNIMPLEMENTED!!!
+// Remove an element from the hashmap, key and data are released. Returns false when key was not found
 //
 
 FBOOL HashmapRemove( Hashmap* in, char* key );
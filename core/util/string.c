@@ -733,7 +733,7 @@ inline void preKmp(char *x, int m, int kmpNext[]) {
 
 char *FindInBinary(char *x, int m, char *y, int n) 
 {
-	int i, j, kmpNext[ m ];
+	int i, j, kmpNext[ m + 1 ];
 	if( y == NULL )
 	{
 		return NULL;
@@ -770,7 +770,7 @@ char *FindInBinary(char *x, int m, char *y, int n)
 FQUAD FindInBinaryPOS(char *x, int m, char *y, FUQUAD n) 
 {
 	FQUAD i, j;
-	int kmpNext[ m ];
+	int kmpNext[ m + 1 ];
 
 	// Preprocessing 
 	preKmp(x, m, kmpNext);
@@ -0,0 +1,587 @@
+/*©lpgl*************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify         *
+* it under the terms of the GNU Lesser General Public License as published by  *
+* the Free Software Foundation, either version 3 of the License, or            *
+* (at your option) any later version.                                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* GNU Affero General Public License for more details.                          *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+*                                                                              *
+*****************************************************************************©*/
+
+/*
+
+	Image derivative cache
+
+	Derivatives (thumbnails) are addressed by key created from source description.
+	They are kept in memory (LRU, limited size) and on disk. Missing derivatives are
+	generated by small pool of workers, concurrent requests for same key wait for
+	one job.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <core/types.h>
+#include <util/log/log.h>
+#include <util/murmurhash3.h>
+#include <util/string.h>
+#include "image_cache.h"
+
+//
+// bucket for key
+//
+
+static inline unsigned int ImageCacheBucket( const char *key )
+{
+	unsigned int h = 0;
+	int i;
+	for( i = 0 ; i < 8 ; i++ )
+	{
+		h = ( h << 4 ) | ( key[ i ] <= '9' ? key[ i ] - '0' : key[ i ] - 'a' + 10 );
+	}
+	return h & ( IMAGE_CACHE_HASH_SIZE - 1 );
+}
+
+//
+// remove entry from LRU list, lock must be held
+//
+
+static void ImageCacheUnlinkLRU( ImageCache *ic, ImageCacheEntry *e )
+{
+	if( e->ice_Prev != NULL )
+	{
+		e->ice_Prev->ice_Next = e->ice_Next;
+	}
+	else
+	{
+		ic->ic_LRUHead = e->ice_Next;
+	}
+	if( e->ice_Next != NULL )
+	{
+		e->ice_Next->ice_Prev = e->ice_Prev;
+	}
+	else
+	{
+		ic->ic_LRUTail = e->ice_Prev;
+	}
+	e->ice_Prev = e->ice_Next = NULL;
+}
+
+//
+// put entry on LRU head, lock must be held
+//
+
+static void ImageCachePushLRU( ImageCache *ic, ImageCacheEntry *e )
+{
+	e->ice_Prev = NULL;
+	e->ice_Next = ic->ic_LRUHead;
+	if( ic->ic_LRUHead != NULL )
+	{
+		ic->ic_LRUHead->ice_Prev = e;
+	}
+	ic->ic_LRUHead = e;
+	if( ic->ic_LRUTail == NULL )
+	{
+		ic->ic_LRUTail = e;
+	}
+}
+
+//
+// remove entry from memory, lock must be held
+//
+
+static void ImageCacheRemoveEntry( ImageCache *ic, ImageCacheEntry *e )
+{
+	unsigned int pos = ImageCacheBucket( e->ice_Key );
+	ImageCacheEntry *act = ic->ic_Hash[ pos ];
+	ImageCacheEntry *prev = NULL;
+	
+	while( act != NULL && act != e )
+	{
+		prev = act;
+		act = act->ice_HashNext;
+	}
+	if( act != NULL )
+	{
+		if( prev == NULL )
+		{
+			ic->ic_Hash[ pos ] = e->ice_HashNext;
+		}
+		else
+		{
+			prev->ice_HashNext = e->ice_HashNext;
+		}
+	}
+	
+	ImageCacheUnlinkLRU( ic, e );
+	ic->ic_MemorySize -= e->ice_Size;
+	
+	FFree( e->ice_Data );
+	FFree( e );
+}
+
+//
+// find entry in memory and copy its data, lock must be held
+//
+
+static char *ImageCacheMemoryGet( ImageCache *ic, const char *key, int *size )
+{
+	ImageCacheEntry *e = ic->ic_Hash[ ImageCacheBucket( key ) ];
+	while( e != NULL )
+	{
+		if( strcmp( e->ice_Key, key ) == 0 )
+		{
+			char *data = FMalloc( e->ice_Size );
+			if( data != NULL )
+			{
+				memcpy( data, e->ice_Data, e->ice_Size );
+				*size = e->ice_Size;
+				
+				ImageCacheUnlinkLRU( ic, e );
+				ImageCachePushLRU( ic, e );
+			}
+			return data;
+		}
+		e = e->ice_HashNext;
+	}
+	return NULL;
+}
+
+//
+// store copy of data in memory, lock must be held
+//
+
+static void ImageCacheMemoryPut( ImageCache *ic, const char *key, const char *data, int size )
+{
+	if( (FULONG)size > ic->ic_MemoryMax / 4 )
+	{
+		return;
+	}
+	
+	unsigned int pos = ImageCacheBucket( key );
+	ImageCacheEntry *e = ic->ic_Hash[ pos ];
+	while( e != NULL )
+	{
+		if( strcmp( e->ice_Key, key ) == 0 )
+		{
+			return;
+		}
+		e = e->ice_HashNext;
+	}
+	
+	while( ic->ic_LRUTail != NULL && ( ic->ic_MemorySize + size ) > ic->ic_MemoryMax )
+	{
+		ImageCacheRemoveEntry( ic, ic->ic_LRUTail );
+	}
+	
+	if( ( e = FCalloc( 1, sizeof( ImageCacheEntry ) ) ) != NULL )
+	{
+		if( ( e->ice_Data = FMalloc( size ) ) != NULL )
+		{
+			memcpy( e->ice_Data, data, size );
+			e->ice_Size = size;
+			strcpy( e->ice_Key, key );
+			
+			e->ice_HashNext = ic->ic_Hash[ pos ];
+			ic->ic_Hash[ pos ] = e;
+			ImageCachePushLRU( ic, e );
+			ic->ic_MemorySize += size;
+		}
+		else
+		{
+			FFree( e );
+		}
+	}
+}
+
+//
+// read derivative from disk
+//
+
+static char *ImageCacheDiskGet( ImageCache *ic, const char *key, int *size )
+{
+	if( ic->ic_Path == NULL )
+	{
+		return NULL;
+	}
+	
+	char path[ 1024 ];
+	snprintf( path, sizeof( path ), "%s/%s", ic->ic_Path, key );
+	
+	char *data = NULL;
+	FILE *fp = fopen( path, "rb" );
+	if( fp != NULL )
+	{
+		struct stat st;
+		if( fstat( fileno( fp ), &st ) == 0 && st.st_size > 0 && ( data = FMalloc( st.st_size ) ) != NULL )
+		{
+			if( fread( data, 1, st.st_size, fp ) == (size_t)st.st_size )
+			{
+				*size = (int)st.st_size;
+			}
+			else
+			{
+				FFree( data );
+				data = NULL;
+			}
+		}
+		fclose( fp );
+	}
+	return data;
+}
+
+//
+// write derivative to disk, file appear under final name only when it is complete
+//
+
+static void ImageCacheDiskPut( ImageCache *ic, const char *key, const char *data, int size )
+{
+	if( ic->ic_Path == NULL )
+	{
+		return;
+	}
+	
+	char path[ 1024 ];
+	char tmppath[ 1024 ];
+	snprintf( path, sizeof( path ), "%s/%s", ic->ic_Path, key );
+	snprintf( tmppath, sizeof( tmppath ), "%s/.%s_XXXXXX", ic->ic_Path, key );
+	
+	int fd = mkstemp( tmppath );
+	if( fd < 0 )
+	{
+		FERROR("Cannot create image cache file %s\n", tmppath );
+		return;
+	}
+	
+	FBOOL ok = ( write( fd, data, size ) == size ) ? TRUE : FALSE;
+	close( fd );
+	
+	if( ok == FALSE || rename( tmppath, path ) != 0 )
+	{
+		FERROR("Cannot store image cache file %s\n", path );
+		unlink( tmppath );
+	}
+}
+
+//
+// worker thread
+//
+
+static void *ImageCacheThread( void *arg )
+{
+	ImageCache *ic = (ImageCache *)arg;
+	
+	pthread_mutex_lock( &ic->ic_Mutex );
+	while( TRUE )
+	{
+		while( ic->ic_Queue == NULL && ic->ic_Quit == FALSE )
+		{
+			pthread_cond_wait( &ic->ic_QueueCond, &ic->ic_Mutex );
+		}
+		if( ic->ic_Quit == TRUE )
+		{
+			break;
+		}
+		
+		ImageCacheJob *job = ic->ic_Queue;
+		ic->ic_Queue = job->icj_Next;
+		if( ic->ic_Queue == NULL )
+		{
+			ic->ic_QueueTail = NULL;
+		}
+		job->icj_Next = ic->ic_Running;
+		ic->ic_Running = job;
+		
+		pthread_mutex_unlock( &ic->ic_Mutex );
+		
+		int size = 0;
+		char *result = job->icj_Generate( job->icj_GenerateData, &size );
+		
+		if( result != NULL )
+		{
+			ImageCacheDiskPut( ic, job->icj_Key, result, size );
+		}
+		
+		pthread_mutex_lock( &ic->ic_Mutex );
+		
+		if( result != NULL )
+		{
+			ImageCacheMemoryPut( ic, job->icj_Key, result, size );
+		}
+		
+		ImageCacheJob *prev = NULL;
+		ImageCacheJob *act = ic->ic_Running;
+		while( act != NULL && act != job )
+		{
+			prev = act;
+			act = act->icj_Next;
+		}
+		if( prev == NULL )
+		{
+			ic->ic_Running = job->icj_Next;
+		}
+		else
+		{
+			prev->icj_Next = job->icj_Next;
+		}
+		
+		job->icj_Result = result;
+		job->icj_ResultSize = size;
+		job->icj_Done = TRUE;
+		pthread_cond_broadcast( &job->icj_Cond );
+	}
+	pthread_mutex_unlock( &ic->ic_Mutex );
+	
+	return NULL;
+}
+
+/**
+ * Create image derivative cache
+ *
+ * @param path directory where derivatives are stored, NULL when only memory should be used
+ * @param memoryMax maximum number of bytes kept in memory
+ * @return pointer to new ImageCache or NULL when error appear
+ */
+
+ImageCache *ImageCacheNew( const char *path, FULONG memoryMax )
+{
+	ImageCache *ic = FCalloc( 1, sizeof( ImageCache ) );
+	if( ic == NULL )
+	{
+		FERROR("Cannot allocate memory for ImageCache\n");
+		return NULL;
+	}
+	
+	ic->ic_MemoryMax = memoryMax;
+	pthread_mutex_init( &ic->ic_Mutex, NULL );
+	pthread_cond_init( &ic->ic_QueueCond, NULL );
+	
+	if( path != NULL )
+	{
+		struct stat st;
+		if( stat( path, &st ) != 0 )
+		{
+			mkdir( path, 0755 );
+		}
+		if( stat( path, &st ) == 0 && S_ISDIR( st.st_mode ) )
+		{
+			ic->ic_Path = StringDuplicate( path );
+		}
+		else
+		{
+			FERROR("Image cache directory %s is not available, derivatives will be kept only in memory\n", path );
+		}
+	}
+	
+	int i;
+	for( i = 0 ; i < IMAGE_CACHE_THREADS ; i++ )
+	{
+		if( pthread_create( &ic->ic_Threads[ ic->ic_NumberThreads ], NULL, ImageCacheThread, ic ) == 0 )
+		{
+			ic->ic_NumberThreads++;
+		}
+	}
+	
+	if( ic->ic_NumberThreads == 0 )
+	{
+		FERROR("Cannot start image cache workers\n");
+		ImageCacheDelete( ic );
+		return NULL;
+	}
+	
+	return ic;
+}
+
+/**
+ * Delete image derivative cache
+ *
+ * @param ic pointer to ImageCache which will be deleted
+ */
+
+void ImageCacheDelete( ImageCache *ic )
+{
+	if( ic == NULL )
+	{
+		return;
+	}
+	
+	pthread_mutex_lock( &ic->ic_Mutex );
+	ic->ic_Quit = TRUE;
+	pthread_cond_broadcast( &ic->ic_QueueCond );
+	pthread_mutex_unlock( &ic->ic_Mutex );
+	
+	int i;
+	for( i = 0 ; i < ic->ic_NumberThreads ; i++ )
+	{
+		pthread_join( ic->ic_Threads[ i ], NULL );
+	}
+	
+	// jobs which were not started are finished without result
+	pthread_mutex_lock( &ic->ic_Mutex );
+	ImageCacheJob *job = ic->ic_Queue;
+	while( job != NULL )
+	{
+		job->icj_Done = TRUE;
+		pthread_cond_broadcast( &job->icj_Cond );
+		job = job->icj_Next;
+	}
+	ic->ic_Queue = ic->ic_QueueTail = NULL;
+	
+	while( ic->ic_LRUHead != NULL )
+	{
+		ImageCacheRemoveEntry( ic, ic->ic_LRUHead );
+	}
+	pthread_mutex_unlock( &ic->ic_Mutex );
+	
+	pthread_cond_destroy( &ic->ic_QueueCond );
+	pthread_mutex_destroy( &ic->ic_Mutex );
+	
+	if( ic->ic_Path != NULL )
+	{
+		FFree( ic->ic_Path );
+	}
+	FFree( ic );
+}
+
+/**
+ * Create cache key from source description
+ *
+ * @param key buffer for key, at least IMAGE_CACHE_KEY_SIZE bytes
+ * @param desc description of derivative (source path, modification time, size, dimensions)
+ * @param len length of description
+ */
+
+void ImageCacheKey( char *key, const char *desc, int len )
+{
+	uint64_t hash[ 2 ];
+	MurmurHash3_x64_128( desc, len, 0x46524945, hash );
+	snprintf( key, IMAGE_CACHE_KEY_SIZE, "%016llx%016llx", (unsigned long long)hash[ 0 ], (unsigned long long)hash[ 1 ] );
+}
+
+/**
+ * Get derivative from cache, generate it when it is not available
+ *
+ * Generation is done by cache workers, so number of images decoded at the same time is
+ * limited. When the same derivative is already generated caller waits for that job.
+ *
+ * @param ic pointer to ImageCache
+ * @param key derivative key created by ImageCacheKey
+ * @param gen function which creates derivative
+ * @param data data passed to gen function, must be valid until function returns
+ * @param size pointer to int where size of returned data will be stored
+ * @return allocated copy of derivative (caller must release it), otherwise NULL
+ */
+
+char *ImageCacheGet( ImageCache *ic, const char *key, ImageCacheGenerate gen, void *data, int *size )
+{
+	char *result = NULL;
+	
+	pthread_mutex_lock( &ic->ic_Mutex );
+	result = ImageCacheMemoryGet( ic, key, size );
+	pthread_mutex_unlock( &ic->ic_Mutex );
+	
+	if( result != NULL )
+	{
+		return result;
+	}
+	
+	if( ( result = ImageCacheDiskGet( ic, key, size ) ) != NULL )
+	{
+		pthread_mutex_lock( &ic->ic_Mutex );
+		ImageCacheMemoryPut( ic, key, result, *size );
+		pthread_mutex_unlock( &ic->ic_Mutex );
+		
+		return result;
+	}
+	
+	pthread_mutex_lock( &ic->ic_Mutex );
+	
+	// join job which is already generating this derivative
+	
+	ImageCacheJob *job = NULL;
+	ImageCacheJob *lists[ 2 ] = { ic->ic_Running, ic->ic_Queue };
+	int i;
+	for( i = 0 ; i < 2 && job == NULL ; i++ )
+	{
+		ImageCacheJob *act = lists[ i ];
+		while( act != NULL )
+		{
+			if( strcmp( act->icj_Key, key ) == 0 )
+			{
+				job = act;
+				break;
+			}
+			act = act->icj_Next;
+		}
+	}
+	
+	if( job == NULL )
+	{
+		// derivative could be stored while lock was released
+		if( ( result = ImageCacheMemoryGet( ic, key, size ) ) != NULL || ic->ic_Quit == TRUE )
+		{
+			pthread_mutex_unlock( &ic->ic_Mutex );
+			return result;
+		}
+		
+		if( ( job = FCalloc( 1, sizeof( ImageCacheJob ) ) ) == NULL )
+		{
+			pthread_mutex_unlock( &ic->ic_Mutex );
+			return NULL;
+		}
+		strcpy( job->icj_Key, key );
+		job->icj_Generate = gen;
+		job->icj_GenerateData = data;
+		pthread_cond_init( &job->icj_Cond, NULL );
+		
+		if( ic->ic_QueueTail != NULL )
+		{
+			ic->ic_QueueTail->icj_Next = job;
+		}
+		else
+		{
+			ic->ic_Queue = job;
+		}
+		ic->ic_QueueTail = job;
+		pthread_cond_signal( &ic->ic_QueueCond );
+	}
+	
+	job->icj_Waiters++;
+	while( job->icj_Done == FALSE )
+	{
+		pthread_cond_wait( &job->icj_Cond, &ic->ic_Mutex );
+	}
+	
+	if( job->icj_Result != NULL && ( result = FMalloc( job->icj_ResultSize ) ) != NULL )
+	{
+		memcpy( result, job->icj_Result, job->icj_ResultSize );
+		*size = job->icj_ResultSize;
+	}
+	
+	// last waiter releases job
+	if( --job->icj_Waiters == 0 )
+	{
+		if( job->icj_Result != NULL )
+		{
+			FFree( job->icj_Result );
+		}
+		pthread_cond_destroy( &job->icj_Cond );
+		FFree( job );
+	}
+	
+	pthread_mutex_unlock( &ic->ic_Mutex );
+	
+	return result;
+}
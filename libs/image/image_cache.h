@@ -0,0 +1,122 @@
+/*©lpgl*************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify         *
+* it under the terms of the GNU Lesser General Public License as published by  *
+* the Free Software Foundation, either version 3 of the License, or            *
+* (at your option) any later version.                                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* GNU Affero General Public License for more details.                          *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+*                                                                              *
+*****************************************************************************©*/
+
+/*
+
+	Image derivative cache
+
+*/
+
+#ifndef __IMAGE_CACHE_H_
+#define __IMAGE_CACHE_H_
+
+#include <core/types.h>
+#include <pthread.h>
+
+#define IMAGE_CACHE_KEY_SIZE		33					// 128bit hash as hex string
+#define IMAGE_CACHE_HASH_SIZE		1024				// must be power of 2
+#define IMAGE_CACHE_MEMORY_MAX		(32*1024*1024)
+#define IMAGE_CACHE_THREADS			2
+
+//
+// derivative stored in memory
+//
+
+typedef struct ImageCacheEntry
+{
+	struct ImageCacheEntry		*ice_HashNext;
+	struct ImageCacheEntry		*ice_Prev;			// LRU list, head is most recently used
+	struct ImageCacheEntry		*ice_Next;
+	char								ice_Key[ IMAGE_CACHE_KEY_SIZE ];
+	char								*ice_Data;
+	int								ice_Size;
+}ImageCacheEntry;
+
+//
+// function which creates derivative, returns allocated buffer
+//
+
+typedef char *(*ImageCacheGenerate)( void *data, int *size );
+
+//
+// derivative which is generated or waiting for worker, requests for same key share it
+//
+
+typedef struct ImageCacheJob
+{
+	struct ImageCacheJob			*icj_Next;
+	char								icj_Key[ IMAGE_CACHE_KEY_SIZE ];
+	ImageCacheGenerate			icj_Generate;
+	void								*icj_GenerateData;	// owned by first requester, which waits for result
+	char								*icj_Result;
+	int								icj_ResultSize;
+	int								icj_Waiters;
+	FBOOL							icj_Done;
+	pthread_cond_t				icj_Cond;
+}ImageCacheJob;
+
+//
+// cache
+//
+
+typedef struct ImageCache
+{
+	pthread_mutex_t				ic_Mutex;
+	ImageCacheEntry				*ic_Hash[ IMAGE_CACHE_HASH_SIZE ];
+	ImageCacheEntry				*ic_LRUHead;
+	ImageCacheEntry				*ic_LRUTail;
+	FULONG							ic_MemorySize;
+	FULONG							ic_MemoryMax;
+	
+	char								*ic_Path;				// directory for derivatives on disk, NULL if disabled
+	
+	ImageCacheJob					*ic_Queue;			// jobs waiting for worker
+	ImageCacheJob					*ic_QueueTail;
+	ImageCacheJob					*ic_Running;			// jobs processed by workers
+	pthread_cond_t				ic_QueueCond;
+	pthread_t						ic_Threads[ IMAGE_CACHE_THREADS ];
+	int								ic_NumberThreads;
+	FBOOL							ic_Quit;
+}ImageCache;
+
+//
+//
+//
+
+ImageCache *ImageCacheNew( const char *path, FULONG memoryMax );
+
+//
+//
+//
+
+void ImageCacheDelete( ImageCache *ic );
+
+//
+//
+//
+
+void ImageCacheKey( char *key, const char *desc, int len );
+
+//
+//
+//
+
+char *ImageCacheGet( ImageCache *ic, const char *key, ImageCacheGenerate gen, void *data, int *size );
+
+#endif	// __IMAGE_CACHE_H_
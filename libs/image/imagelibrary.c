@@ -37,6 +37,10 @@
 #include <util/buffered_string.h>
 #include <ctype.h>
 #include <system/systembase.h>
+#ifndef USE_IMAGE_MAGICK
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
 
 #define LIB_NAME "image.library"
 #define LIB_VERSION			1
@@ -64,11 +68,25 @@ void *libInit( void *sb )
 	l->ResizeImage               = dlsym( l->l_Handle, "FResizeImage");
 	l->ImageRead               = dlsym( l->l_Handle, "ImageRead");
 	l->ImageWrite               = dlsym( l->l_Handle, "ImageWrite");
+	l->WebRequest               = dlsym( l->l_Handle, "WebRequest");
 	
 	l->sb = sb;
 
 #ifdef USE_IMAGE_MAGICK
 	MagickWandGenesis();
+#else
+	l->ThumbnailGet               = dlsym( l->l_Handle, "ThumbnailGet");
+	
+	// thumbnails are stored in FriendCore cache directory
+	char *cachePath = NULL;
+	char *home = getenv( "FRIEND_HOME" );
+	int len = ( home != NULL ? strlen( home ) : 0 ) + 64;
+	if( ( cachePath = FCalloc( len, sizeof( char ) ) ) != NULL )
+	{
+		snprintf( cachePath, len, "%scache/thumbnails", home != NULL ? home : "" );
+		l->il_Cache = ImageCacheNew( cachePath, IMAGE_CACHE_MEMORY_MAX );
+		FFree( cachePath );
+	}
 #endif
 
 	return ( void *)l;
@@ -82,6 +100,12 @@ void libClose( struct ImageLibrary *l )
 {
 #ifdef USE_IMAGE_MAGICK
 	MagickWandTerminus();
+#else
+	if( l->il_Cache != NULL )
+	{
+		ImageCacheDelete( (ImageCache *)l->il_Cache );
+		l->il_Cache = NULL;
+	}
 #endif
 	
 	DEBUG("image library close\n");
@@ -228,70 +252,228 @@ int FResizeImage( struct ImageLibrary *im, Image **image, int w, int h )
 
 
 //
+// JPEG decoder errors must not terminate process
 //
+
+typedef struct ImageJpegError
+{
+	struct jpeg_error_mgr	pub;
+	jmp_buf					jmp;
+}ImageJpegError;
+
+static void ImageJpegErrorExit( j_common_ptr cinfo )
+{
+	longjmp( ((ImageJpegError *)cinfo->err)->jmp, 1 );
+}
+
+static void ImageJpegOutputMessage( j_common_ptr cinfo )
+{
+}
+
+//
+// Decode JPEG, DCT scaling is used when image is much bigger then requested size
 //
 
-gdImagePtr ImageRead( struct ImageLibrary *im, File *rootDev, const char *path )
+static gdImagePtr ImageDecodeJpegScaled( const unsigned char *data, int size, int w, int h )
 {
-	gdImagePtr img = NULL;
-	FHandler *fh = rootDev->f_FSys;
-	File *rfp = (File *)fh->FileOpen( rootDev, path, "rb" );
-	if( rfp != NULL )
+	struct jpeg_decompress_struct cinfo;
+	ImageJpegError jerr;
+	gdImagePtr volatile img = NULL;
+	JSAMPROW volatile row = NULL;
+	
+	cinfo.err = jpeg_std_error( &jerr.pub );
+	jerr.pub.error_exit = ImageJpegErrorExit;
+	jerr.pub.output_message = ImageJpegOutputMessage;
+	
+	if( setjmp( jerr.jmp ) )
 	{
-		BufString *bs = BufStringNew( );
-		char buffer[ 20048 ];
-		int len = 0;
-
-		while( ( len = fh->FileRead( rfp, buffer, 20048 ) ) > 0 )
+		// not supported color space (CMYK) or broken file, gd decoder will be used
+		jpeg_destroy_decompress( &cinfo );
+		if( img != NULL )
 		{
-			BufStringAddSize( bs, buffer, len );
+			gdImageDestroy( img );
+		}
+		if( row != NULL )
+		{
+			FFree( row );
 		}
+		return NULL;
+	}
+	
+	jpeg_create_decompress( &cinfo );
+	jpeg_mem_src( &cinfo, (unsigned char *)data, size );
+	jpeg_read_header( &cinfo, TRUE );
+	
+	// decoder can scale by 1/2, 1/4, 1/8 almost for free
+	unsigned int denom = 1;
+	while( denom < 8 && ( cinfo.image_width / ( denom * 2 ) ) >= (unsigned int)w && ( cinfo.image_height / ( denom * 2 ) ) >= (unsigned int)h )
+	{
+		denom *= 2;
+	}
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = denom;
+	cinfo.out_color_space = JCS_RGB;
+	
+	jpeg_start_decompress( &cinfo );
+	
+	img = gdImageCreateTrueColor( cinfo.output_width, cinfo.output_height );
+	row = FCalloc( cinfo.output_width * cinfo.output_components, sizeof( JSAMPLE ) );
+	if( img == NULL || row == NULL )
+	{
+		longjmp( jerr.jmp, 1 );
+	}
+	
+	while( cinfo.output_scanline < cinfo.output_height )
+	{
+		unsigned int y = cinfo.output_scanline;
+		JSAMPROW rows[ 1 ] = { row };
 		
-		img = gdImageCreateFromJpegPtr( bs->bs_Size, (void *)bs->bs_Buffer ) ;
-		if( img == NULL )
+		jpeg_read_scanlines( &cinfo, rows, 1 );
+		
+		unsigned int x;
+		for( x = 0 ; x < cinfo.output_width ; x++ )
 		{
+			img->tpixels[ y ][ x ] = gdTrueColor( row[ x*3 ], row[ x*3+1 ], row[ x*3+2 ] );
+		}
+	}
+	
+	jpeg_finish_decompress( &cinfo );
+	jpeg_destroy_decompress( &cinfo );
+	FFree( row );
+	
+	return img;
+}
+
+//
+// Recognize image format by file header
+//
+
+int ImageDetectFormat( const unsigned char *data, FULONG size )
+{
+	if( size >= 3 && data[ 0 ] == 0xFF && data[ 1 ] == 0xD8 && data[ 2 ] == 0xFF )
+	{
+		return IMAGE_FORMAT_JPEG;
+	}
+	if( size >= 8 && memcmp( data, "\x89PNG\r\n\x1a\n", 8 ) == 0 )
+	{
+		return IMAGE_FORMAT_PNG;
+	}
+	if( size >= 6 && ( memcmp( data, "GIF87a", 6 ) == 0 || memcmp( data, "GIF89a", 6 ) == 0 ) )
+	{
+		return IMAGE_FORMAT_GIF;
+	}
+	if( size >= 2 && data[ 0 ] == 'B' && data[ 1 ] == 'M' )
+	{
+		return IMAGE_FORMAT_BMP;
+	}
+	if( size >= 4 && ( memcmp( data, "II*\0", 4 ) == 0 || memcmp( data, "MM\0*", 4 ) == 0 ) )
+	{
+		return IMAGE_FORMAT_TIFF;
+	}
+	if( size >= 12 && memcmp( data, "RIFF", 4 ) == 0 && memcmp( data + 8, "WEBP", 4 ) == 0 )
+	{
+		return IMAGE_FORMAT_WEBP;
+	}
+	return IMAGE_FORMAT_UNKNOWN;
+}
+
+//
+// Decode image from memory, w and h are size which will be used later (0 - full size)
+//
+
+gdImagePtr ImageDecode( const unsigned char *data, int size, int w, int h )
+{
+	gdImagePtr img = NULL;
+	void *ptr = (void *)data;
+	
+	switch( ImageDetectFormat( data, size ) )
+	{
+		case IMAGE_FORMAT_JPEG:
+			if( w > 0 && h > 0 )
+			{
+				img = ImageDecodeJpegScaled( data, size, w, h );
+			}
 			if( img == NULL )
 			{
-				img = gdImageCreateFromBmpPtr( bs->bs_Size, (void *)bs->bs_Buffer ) ;
-				if( img == NULL )
-				{
-					img = gdImageCreateFromGifPtr( bs->bs_Size, (void *)bs->bs_Buffer ) ;
-					if( img == NULL )
-					{
-						img = gdImageCreateFromPngPtr( bs->bs_Size, (void *)bs->bs_Buffer ) ;
-						if( img == NULL )
-						{
-							img = gdImageCreateFromTgaPtr( bs->bs_Size, (void *)bs->bs_Buffer ) ;
-							if( img == NULL )
-							{
-								img = gdImageCreateFromTiffPtr( bs->bs_Size, (void *)bs->bs_Buffer ) ;
-								if( img == NULL )
-								{
-									img = gdImageCreateFromWBMPPtr( bs->bs_Size, (void *)bs->bs_Buffer ) ;
-									if( img == NULL )
-									{
-										img = gdImageCreateFromWebpPtr( bs->bs_Size, (void *)bs->bs_Buffer ) ;
-									}
-								}
-							}
-						}
-					}
-				}
+				img = gdImageCreateFromJpegPtr( size, ptr );
 			}
+		break;
+		case IMAGE_FORMAT_PNG:
+			img = gdImageCreateFromPngPtr( size, ptr );
+		break;
+		case IMAGE_FORMAT_GIF:
+			img = gdImageCreateFromGifPtr( size, ptr );
+		break;
+		case IMAGE_FORMAT_BMP:
+			img = gdImageCreateFromBmpPtr( size, ptr );
+		break;
+		case IMAGE_FORMAT_TIFF:
+			img = gdImageCreateFromTiffPtr( size, ptr );
+		break;
+		case IMAGE_FORMAT_WEBP:
+			img = gdImageCreateFromWebpPtr( size, ptr );
+		break;
+		default:
+			// TGA and WBMP do not have reliable signatures
+			img = gdImageCreateFromTgaPtr( size, ptr );
+			if( img == NULL )
+			{
+				img = gdImageCreateFromWBMPPtr( size, ptr );
+			}
+		break;
+	}
+	
+	return img;
+}
+
+//
+// Read whole file into memory
+//
+
+static BufString *ImageReadFile( File *rootDev, const char *path )
+{
+	FHandler *fh = rootDev->f_FSys;
+	File *rfp = (File *)fh->FileOpen( rootDev, path, "rb" );
+	if( rfp == NULL )
+	{
+		FERROR("Cannot open file: %s to read\n", path );
+		return NULL;
+	}
+	
+	BufString *bs = BufStringNewSize( 65536 );
+	if( bs != NULL )
+	{
+		char buffer[ 65536 ];
+		int len = 0;
+
+		while( ( len = fh->FileRead( rfp, buffer, sizeof( buffer ) ) ) > 0 )
+		{
+			BufStringAddSize( bs, buffer, len );
 		}
-		
+	}
+	
+	fh->FileClose( rootDev, rfp );
+	
+	return bs;
+}
+
+//
+//
+//
+
+gdImagePtr ImageRead( struct ImageLibrary *im, File *rootDev, const char *path )
+{
+	gdImagePtr img = NULL;
+	BufString *bs = ImageReadFile( rootDev, path );
+	if( bs != NULL )
+	{
+		img = ImageDecode( (unsigned char *)bs->bs_Buffer, bs->bs_Size, 0, 0 );
 		if( img == NULL )
 		{
 			FERROR("Graphics format not recognized\n");
 		}
 		
 		BufStringDelete( bs );
-		
-		fh->FileClose( rootDev, rfp );
-	}
-	else
-	{
-		FERROR("Cannot open file: %s to read\n", path );
 	}
 	return img;
 }
@@ -371,11 +553,13 @@ int FResizeImage( struct ImageLibrary *im, gdImagePtr *image, int w, int h )
 {
 	if( *image != NULL )
 	{
-		gdImagePtr newImage  = gdImageCreate( w, h );
+		gdImagePtr newImage  = gdImageCreateTrueColor( w, h );
 
 		if( newImage != NULL )
 		{
-			gdImageCopyResized( newImage, *image, 0, 0, 0, 0, newImage->sx, newImage->sy, (*image)->sx, (*image)->sy ); 
+			gdImageAlphaBlending( newImage, 0 );
+			gdImageSaveAlpha( newImage, 1 );
+			gdImageCopyResampled( newImage, *image, 0, 0, 0, 0, newImage->sx, newImage->sy, (*image)->sx, (*image)->sy ); 
 			gdImageDestroy( *image );
 			*image = newImage;
 		}
@@ -389,6 +573,188 @@ int FResizeImage( struct ImageLibrary *im, gdImagePtr *image, int w, int h )
 	return 0;
 }
 
+//
+// Thumbnail request, valid until ImageCacheGet returns
+//
+
+typedef struct ThumbnailRequest
+{
+	File				*tr_RootDev;
+	const char		*tr_Path;
+	int				tr_Width;
+	int				tr_Height;
+}ThumbnailRequest;
+
+//
+// Create thumbnail, called by image cache worker
+//
+
+static char *ThumbnailGenerate( void *data, int *size )
+{
+	ThumbnailRequest *tr = (ThumbnailRequest *)data;
+	char *result = NULL;
+	
+	BufString *bs = ImageReadFile( tr->tr_RootDev, tr->tr_Path );
+	if( bs == NULL )
+	{
+		return NULL;
+	}
+	
+	int format = ImageDetectFormat( (unsigned char *)bs->bs_Buffer, bs->bs_Size );
+	gdImagePtr img = ImageDecode( (unsigned char *)bs->bs_Buffer, bs->bs_Size, tr->tr_Width, tr->tr_Height );
+	BufStringDelete( bs );
+	
+	if( img == NULL )
+	{
+		FERROR("Cannot create thumbnail, graphics format not recognized: %s\n", tr->tr_Path );
+		return NULL;
+	}
+	
+	// keep aspect ratio, never enlarge
+	int w = img->sx;
+	int h = img->sy;
+	if( w > tr->tr_Width || h > tr->tr_Height )
+	{
+		if( (FQUAD)w * tr->tr_Height > (FQUAD)h * tr->tr_Width )
+		{
+			h = (int)( (FQUAD)h * tr->tr_Width / w );
+			w = tr->tr_Width;
+		}
+		else
+		{
+			w = (int)( (FQUAD)w * tr->tr_Height / h );
+			h = tr->tr_Height;
+		}
+		if( w < 1 ) w = 1;
+		if( h < 1 ) h = 1;
+		
+		FResizeImage( NULL, &img, w, h );
+	}
+	
+	// formats which can be transparent are stored as PNG
+	int length = 0;
+	void *buffer = NULL;
+	if( format == IMAGE_FORMAT_PNG || format == IMAGE_FORMAT_GIF || format == IMAGE_FORMAT_WEBP )
+	{
+		gdImageSaveAlpha( img, 1 );
+		buffer = gdImagePngPtr( img, &length );
+	}
+	else
+	{
+		buffer = gdImageJpegPtr( img, &length, IMAGE_THUMBNAIL_JPEG_QUALITY );
+	}
+	gdImageDestroy( img );
+	
+	if( buffer != NULL )
+	{
+		if( ( result = FMalloc( length ) ) != NULL )
+		{
+			memcpy( result, buffer, length );
+			*size = length;
+		}
+		gdFree( buffer );
+	}
+	
+	return result;
+}
+
+//
+// Find value of JSON key in file information
+//
+
+static int ThumbnailInfoValue( const char *info, const char *key, char *dst, int dstSize )
+{
+	const char *pos = strstr( info, key );
+	if( pos == NULL )
+	{
+		return 0;
+	}
+	pos += strlen( key );
+	while( *pos == ' ' || *pos == ':' || *pos == '"' )
+	{
+		pos++;
+	}
+	
+	int i = 0;
+	while( pos[ i ] != 0 && pos[ i ] != '"' && pos[ i ] != ',' && pos[ i ] != '}' && i < dstSize-1 )
+	{
+		dst[ i ] = pos[ i ];
+		i++;
+	}
+	dst[ i ] = 0;
+	
+	return i;
+}
+
+//
+// Get thumbnail of image, returns allocated buffer with JPEG or PNG data
+//
+
+char *ThumbnailGet( struct ImageLibrary *im, File *rootDev, const char *path, int w, int h, int *size )
+{
+	ThumbnailRequest tr;
+	
+	if( rootDev == NULL || path == NULL || w <= 0 || h <= 0 )
+	{
+		return NULL;
+	}
+	
+	if( w > IMAGE_THUMBNAIL_MAX_SIZE ) w = IMAGE_THUMBNAIL_MAX_SIZE;
+	if( h > IMAGE_THUMBNAIL_MAX_SIZE ) h = IMAGE_THUMBNAIL_MAX_SIZE;
+	
+	tr.tr_RootDev = rootDev;
+	tr.tr_Path = path;
+	tr.tr_Width = w;
+	tr.tr_Height = h;
+	
+	ImageCache *ic = (ImageCache *)im->il_Cache;
+	if( ic == NULL )
+	{
+		return ThumbnailGenerate( &tr, size );
+	}
+	
+	// key is created from path, modification time and size, so changed files get new thumbnails
+	
+	char mtime[ 64 ];
+	char fsize[ 32 ];
+	FBOOL found = FALSE;
+	FHandler *fh = rootDev->f_FSys;
+	
+	BufString *info = fh->Info( rootDev, path );
+	if( info != NULL )
+	{
+		if( info->bs_Buffer != NULL && strncmp( info->bs_Buffer, "ok", 2 ) == 0 &&
+			ThumbnailInfoValue( info->bs_Buffer, "\"DateModified\"", mtime, sizeof( mtime ) ) > 0 &&
+			ThumbnailInfoValue( info->bs_Buffer, "\"Filesize\"", fsize, sizeof( fsize ) ) > 0 )
+		{
+			found = TRUE;
+		}
+		BufStringDelete( info );
+	}
+	
+	if( found == FALSE )
+	{
+		return ThumbnailGenerate( &tr, size );
+	}
+	
+	char key[ IMAGE_CACHE_KEY_SIZE ];
+	BufString *desc = BufStringNew();
+	if( desc == NULL )
+	{
+		return NULL;
+	}
+	char tmp[ 64 ];
+	BufStringAdd( desc, rootDev->f_Name );
+	BufStringAdd( desc, ":" );
+	BufStringAdd( desc, path );
+	snprintf( tmp, sizeof( tmp ), "|%s|%s|%dx%d", mtime, fsize, w, h );
+	BufStringAdd( desc, tmp );
+	ImageCacheKey( key, desc->bs_Buffer, desc->bs_Size );
+	BufStringDelete( desc );
+	
+	return ImageCacheGet( ic, key, ThumbnailGenerate, &tr, size );
+}
+
 //
 // find comma and return position
 //
@@ -480,6 +846,7 @@ Http*  WebRequest( struct ImageLibrary *l, UserSession *usr, char **urlpath, Htt
 		
 		HttpAddTextContent( response, \
 			"resize - resize image on filesystem\n \
+			thumbnail - get thumbnail of image (path, width, height)\n \
 			" );			// out of memory/user not found
 		
 		//HttpWriteAndFree( response );
@@ -609,6 +976,76 @@ Http*  WebRequest( struct ImageLibrary *l, UserSession *usr, char **urlpath, Htt
 			//HttpWriteAndFree( response );
 		}
 	}
+	else if( strcmp( urlpath[ 0 ], "thumbnail" ) == 0 )
+	{
+		char *path = NULL, *oPath = NULL;
+		File *pathRoot = NULL;
+		int width = 0, height = 0;
+		char *data = NULL;
+		int size = 0;
+		int format = IMAGE_FORMAT_UNKNOWN;
+		
+		HashmapElement *tst = HashmapGet( request->parsedPostContent, "path" );
+		if( tst == NULL ) tst = HashmapGet( request->query, "path" );
+		if( tst != NULL  )
+		{
+			path = UrlDecodeToMem(  (char *) tst->data );
+			pathRoot = GetRootDeviceByPath( usr->us_User, &oPath, path );
+		}
+		
+		tst = HashmapGet( request->parsedPostContent, "width" );
+		if( tst == NULL ) tst = HashmapGet( request->query, "width" );
+		if( tst != NULL  )
+		{
+			width = atoi(  (char *) tst->data );
+		}
+		
+		tst = HashmapGet( request->parsedPostContent, "height" );
+		if( tst == NULL ) tst = HashmapGet( request->query, "height" );
+		if( tst != NULL  )
+		{
+			height = atoi(  (char *) tst->data );
+		}
+		
+		if( pathRoot != NULL && width > 0 && height > 0 )
+		{
+			data = l->ThumbnailGet( l, pathRoot, oPath, width, height, &size );
+			if( data != NULL )
+			{
+				format = ImageDetectFormat( (unsigned char *)data, size );
+			}
+		}
+		
+		if( data != NULL )
+		{
+			struct TagItem tags[] = {
+				{ HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicate( format == IMAGE_FORMAT_PNG ? "image/png" : "image/jpeg" ) },
+				{	HTTP_HEADER_CONNECTION, (FULONG)StringDuplicate( "close" ) },
+				{TAG_DONE, TAG_DONE}
+			};
+			
+			response = HttpNewSimple( HTTP_200_OK,  tags );
+			HttpSetContent( response, data, size );
+		}
+		else
+		{
+			struct TagItem tags[] = {
+				{ HTTP_HEADER_CONTENT_TYPE, (FULONG)  StringDuplicate( "text/html" ) },
+				{	HTTP_HEADER_CONNECTION, (FULONG)StringDuplicate( "close" ) },
+				{TAG_DONE, TAG_DONE}
+			};
+			
+			response = HttpNewSimple( HTTP_200_OK,  tags );
+			
+			FERROR("Cannot create thumbnail for path %s\n", path );
+			HttpAddTextContent( response, "fail<!--separate-->{ \"ErrorMessage\": \"Cannot create thumbnail\"}" );
+		}
+		
+		if( path != NULL )
+		{
+			free( path );
+		}
+	}
 	else
 	{
 		struct TagItem tags[] = {
@@ -38,9 +38,27 @@
 #include <wand/magick_wand.h>
 #else
 #include <gd.h>
+#include "image_cache.h"
 #endif
 //#include <ImageMagick-6/wand/magick_wand.h>
 
+//
+// image formats recognized by file header
+//
+
+enum {
+	IMAGE_FORMAT_UNKNOWN = 0,
+	IMAGE_FORMAT_JPEG,
+	IMAGE_FORMAT_PNG,
+	IMAGE_FORMAT_GIF,
+	IMAGE_FORMAT_BMP,
+	IMAGE_FORMAT_TIFF,
+	IMAGE_FORMAT_WEBP
+};
+
+#define IMAGE_THUMBNAIL_MAX_SIZE		1024		// maximum width and height of thumbnail
+#define IMAGE_THUMBNAIL_JPEG_QUALITY	85
+
 //
 //	library
 //
@@ -66,8 +84,11 @@ typedef struct ImageLibrary
 	gdImagePtr 			(*ImageRead)( struct ImageLibrary *im, File *rootDev, const char *path );
 	int 						(*ImageWrite)( struct ImageLibrary *im, File *rootDev, gdImagePtr img, const char *path );
 	int 						(*ResizeImage)( struct ImageLibrary *im, gdImagePtr *image, int w, int h );
+	char						*(*ThumbnailGet)( struct ImageLibrary *im, File *rootDev, const char *path, int w, int h, int *size );
 #endif
 	Http 					*(*WebRequest)( struct ImageLibrary *l, UserSession *usr, char **func, Http* request );
+	
+	void						*il_Cache;		// ImageCache with thumbnails
 
 	
 } ImageLibrary;
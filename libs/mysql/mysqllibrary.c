@@ -40,11 +40,24 @@
 #include <time.h>
 #include <system/systembase.h>
 #include <ctype.h>
+#include <errmsg.h>
+#include <mysqld_error.h>
+
+// MySQL 8.0 client library uses bool in MYSQL_BIND and does not define my_bool any more
+#if !defined( MARIADB_BASE_VERSION ) && !defined( MARIADB_VERSION_ID ) && defined( MYSQL_VERSION_ID ) && MYSQL_VERSION_ID >= 80001
+typedef bool my_bool;
+#endif
 
 #define LIB_NAME "mysql.library"
 #define LIB_VERSION 1
 #define LIB_REVISION 0
 
+// metrics are provided by FriendCore, library can be loaded by tools which do not have them
+#pragma weak MetricsTime
+#pragma weak MetricsRecordSince
+#define SQL_METRICS_START() ( MetricsTime != NULL ? MetricsTime() : 0 )
+#define SQL_METRICS_END( START ) if( (START) != 0 ){ MetricsRecordSince( METRIC_STAGE_SQL_QUERY, (START) ); }
+
 /**
  * return version of library
  *
@@ -65,6 +78,626 @@ long GetRevision(void)
 	return LIB_REVISION;
 }
 
+/**
+ * Convert struct tm used in structures to MYSQL_TIME
+ *
+ * @param t pointer to MYSQL_TIME which will be filled
+ * @param tp pointer to struct tm, year and month are stored without offsets
+ */
+static inline void StatementTimeFromTm( MYSQL_TIME *t, const struct tm *tp )
+{
+	memset( t, 0, sizeof( MYSQL_TIME ) );
+	t->year = tp->tm_year;
+	t->month = tp->tm_mon;
+	t->day = tp->tm_mday;
+	t->hour = tp->tm_hour;
+	t->minute = tp->tm_min;
+	t->second = tp->tm_sec;
+	t->time_type = MYSQL_TIMESTAMP_DATETIME;
+}
+
+/**
+ * Convert MYSQL_TIME to struct tm used in structures
+ *
+ * @param tp pointer to struct tm which will be filled, year and month are stored without offsets
+ * @param t pointer to MYSQL_TIME
+ */
+static inline void StatementTimeToTm( struct tm *tp, const MYSQL_TIME *t )
+{
+	memset( tp, 0, sizeof( struct tm ) );
+	tp->tm_year = t->year;
+	tp->tm_mon = t->month;
+	tp->tm_mday = t->day;
+	tp->tm_hour = t->hour;
+	tp->tm_min = t->minute;
+	tp->tm_sec = t->second;
+}
+
+/**
+ * Close all prepared statements of connection
+ *
+ * @param l pointer to mysql.library structure
+ */
+static void StatementCacheFlush( struct MYSQLLibrary *l )
+{
+	SQLStatement *ss = l->con.sql_Statements;
+	while( ss != NULL )
+	{
+		SQLStatement *rem = ss;
+		ss = (SQLStatement *)ss->node.mln_Succ;
+		
+		mysql_stmt_close( rem->ss_Stmt );
+		if( rem->ss_Where != NULL )
+		{
+			FFree( rem->ss_Where );
+		}
+		FFree( rem );
+	}
+	l->con.sql_Statements = NULL;
+	l->con.sql_StatementsNr = 0;
+}
+
+/**
+ * Check if statement error was caused by lost connection or by statement which is not valid on server anymore.
+ * If yes, cached statements are closed and connection is restored.
+ *
+ * @param l pointer to mysql.library structure
+ * @param err error number returned by statement call
+ * @return TRUE when call should be repeated, otherwise FALSE
+ */
+static FBOOL StatementRecover( struct MYSQLLibrary *l, unsigned int err )
+{
+	if( err == CR_SERVER_GONE_ERROR || err == CR_SERVER_LOST || err == ER_UNKNOWN_STMT_HANDLER || err == ER_NEED_REPREPARE )
+	{
+		DEBUG("[MYSQLLibrary] Statements are not valid anymore, error %u\n", err );
+		StatementCacheFlush( l );
+		mysql_ping( l->con.sql_Con );
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/**
+ * Find prepared statement in connection cache
+ *
+ * @param l pointer to mysql.library structure
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @param type operation (SQL_STMT_*)
+ * @param mask columns used by statement
+ * @param where where part of query or NULL
+ * @return pointer to MYSQL_STMT when statement was found, otherwise NULL
+ */
+static MYSQL_STMT *StatementFind( struct MYSQLLibrary *l, const FULONG *descr, int type, FULONG mask, const char *where )
+{
+	// statements do not survive reconnection
+	if( l->con.sql_Statements != NULL && mysql_thread_id( l->con.sql_Con ) != l->con.sql_StatementsThreadID )
+	{
+		StatementCacheFlush( l );
+		return NULL;
+	}
+	
+	SQLStatement *prev = NULL;
+	SQLStatement *ss = l->con.sql_Statements;
+	while( ss != NULL )
+	{
+		if( ss->ss_Descr == descr && ss->ss_Type == type && ss->ss_Mask == mask &&
+			( ss->ss_Where == where || ( ss->ss_Where != NULL && where != NULL && strcmp( ss->ss_Where, where ) == 0 ) ) )
+		{
+			// least recently used statements stay at the end of list
+			if( prev != NULL )
+			{
+				prev->node.mln_Succ = ss->node.mln_Succ;
+				ss->node.mln_Succ = (MinNode *)l->con.sql_Statements;
+				l->con.sql_Statements = ss;
+			}
+			return ss->ss_Stmt;
+		}
+		prev = ss;
+		ss = (SQLStatement *)ss->node.mln_Succ;
+	}
+	return NULL;
+}
+
+/**
+ * Prepare statement and put it into connection cache
+ *
+ * @param l pointer to mysql.library structure
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @param type operation (SQL_STMT_*)
+ * @param mask columns used by statement
+ * @param where where part of query or NULL
+ * @param query full query with '?' in place of values
+ * @return pointer to MYSQL_STMT when success, otherwise NULL
+ */
+static MYSQL_STMT *StatementAdd( struct MYSQLLibrary *l, const FULONG *descr, int type, FULONG mask, const char *where, const char *query )
+{
+	MYSQL_STMT *stmt = NULL;
+	int attempt;
+	
+	for( attempt = 0 ; attempt < 2 ; attempt++ )
+	{
+		if( ( stmt = mysql_stmt_init( l->con.sql_Con ) ) == NULL )
+		{
+			FERROR("Cannot create statement\n");
+			return NULL;
+		}
+		
+		// lets Load allocate buffers once for all rows
+		char updateMaxLength = 1;
+		mysql_stmt_attr_set( stmt, STMT_ATTR_UPDATE_MAX_LENGTH, &updateMaxLength );
+		
+		if( mysql_stmt_prepare( stmt, query, strlen( query ) ) == 0 )
+		{
+			break;
+		}
+		
+		unsigned int err = mysql_stmt_errno( stmt );
+		FERROR("Cannot prepare statement '%s', error: %s\n", query, mysql_stmt_error( stmt ) );
+		mysql_stmt_close( stmt );
+		stmt = NULL;
+		
+		if( attempt > 0 || StatementRecover( l, err ) == FALSE )
+		{
+			return NULL;
+		}
+	}
+	
+	SQLStatement *ss = FCalloc( 1, sizeof( SQLStatement ) );
+	if( ss == NULL )
+	{
+		mysql_stmt_close( stmt );
+		return NULL;
+	}
+	
+	ss->ss_Descr = descr;
+	ss->ss_Type = type;
+	ss->ss_Mask = mask;
+	ss->ss_Where = StringDuplicate( where );
+	ss->ss_Stmt = stmt;
+	
+	if( l->con.sql_Statements == NULL )
+	{
+		l->con.sql_StatementsThreadID = mysql_thread_id( l->con.sql_Con );
+	}
+	ss->node.mln_Succ = (MinNode *)l->con.sql_Statements;
+	l->con.sql_Statements = ss;
+	
+	// remove least recently used statement
+	if( ++(l->con.sql_StatementsNr) > SQL_STMT_CACHE_MAX )
+	{
+		SQLStatement *prev = ss;
+		while( prev->node.mln_Succ != NULL && prev->node.mln_Succ->mln_Succ != NULL )
+		{
+			prev = (SQLStatement *)prev->node.mln_Succ;
+		}
+		SQLStatement *rem = (SQLStatement *)prev->node.mln_Succ;
+		prev->node.mln_Succ = NULL;
+		
+		mysql_stmt_close( rem->ss_Stmt );
+		if( rem->ss_Where != NULL )
+		{
+			FFree( rem->ss_Where );
+		}
+		FFree( rem );
+		l->con.sql_StatementsNr--;
+	}
+	
+	return stmt;
+}
+
+/**
+ * Execute prepared statement. When connection was lost cache is cleared and caller must prepare statement again.
+ *
+ * @param l pointer to mysql.library structure
+ * @param stmt pointer to MYSQL_STMT with bound parameters
+ * @param retry TRUE when call can be repeated
+ * @return 0 when success, -1 when call should be repeated, otherwise error number from server
+ */
+static int StatementExecute( struct MYSQLLibrary *l, MYSQL_STMT *stmt, FBOOL retry )
+{
+	FUQUAD start = SQL_METRICS_START();
+	
+	int err = mysql_stmt_execute( stmt );
+	SQL_METRICS_END( start );
+	
+	if( err == 0 )
+	{
+		return 0;
+	}
+	
+	unsigned int errnum = mysql_stmt_errno( stmt );
+	FERROR("mysql_stmt_execute failed %s\n", mysql_stmt_error( stmt ) );
+	
+	if( retry == TRUE && StatementRecover( l, errnum ) == TRUE )
+	{
+		return -1;
+	}
+	return errnum != 0 ? (int)errnum : 1;
+}
+
+/**
+ * Add list of column names from description to query
+ *
+ * @param bs pointer to BufString where names will be added
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @param mask columns which will be added
+ * @param suffix string added after every column name, can be NULL
+ * @return number of added columns
+ */
+static int StatementAddColumns( BufString *bs, const FULONG *descr, FULONG mask, const char *suffix )
+{
+	const FULONG *dptr = &descr[ SQL_DATA_STRUCT_START ];
+	int col = 0;
+	int added = 0;
+	
+	for( ; dptr[0] != SQLT_END ; dptr += 3, col++ )
+	{
+		if( dptr[0] == SQLT_NODE || ( mask & ( 1ULL << col ) ) == 0 )
+		{
+			continue;
+		}
+		
+		if( added > 0 )
+		{
+			BufStringAddSize( bs, ",", 1 );
+		}
+		BufStringAddSize( bs, "`", 1 );
+		BufStringAdd( bs, (char *)dptr[ 1 ] );
+		BufStringAddSize( bs, "`", 1 );
+		if( suffix != NULL )
+		{
+			BufStringAdd( bs, suffix );
+		}
+		added++;
+	}
+	return added;
+}
+
+/**
+ * Load data from database using prepared statement. Statement is kept in connection cache,
+ * values are passed as parameters so they do not have to be escaped.
+ *
+ * @param l pointer to mysql.library structure
+ * @param descr pointer to taglist which represent DB to C structure conversion
+ * @param where pointer to string which represent "where" part of query with '?' in place of values. If value is equal to NULL all data are taken from db.
+ * @param params pointer to taglist with values for every '?' in where, can be NULL
+ * @param entries pointer to interger where number of loaded entries will be returned
+ * @return pointer to new structure or list of structures.
+ */
+void *LoadBind( struct MYSQLLibrary *l, const FULONG *descr, const char *where, const FULONG *params, int *entries )
+{
+	void *firstObject = NULL;
+	DEBUG("[MYSQLLibrary] LoadBind\n");
+	
+	if( descr == NULL  )
+	{
+		FERROR("Data description was not provided!\n");
+		return NULL;
+	}
+	
+	if( descr[ 0 ] != SQLT_TABNAME )
+	{
+		FERROR("SQLT_TABNAME was not provided!\n");
+		return NULL;
+	}
+	
+	MYSQL_BIND pbind[ SQL_STMT_MAX_COLUMNS ];
+	unsigned long plengths[ SQL_STMT_MAX_COLUMNS ];
+	int pnr = 0;
+	
+	memset( pbind, 0, sizeof( pbind ) );
+	
+	if( params != NULL )
+	{
+		const FULONG *pptr;
+		for( pptr = params ; pptr[ 0 ] != SQLT_END ; pptr += 2 )
+		{
+			if( pnr >= SQL_STMT_MAX_COLUMNS )
+			{
+				FERROR("Too many parameters\n");
+				return NULL;
+			}
+			
+			switch( pptr[ 0 ] )
+			{
+				case SQLT_IDINT:
+				case SQLT_INT:
+				case SQLT_QUAD:
+					pbind[ pnr ].buffer_type = MYSQL_TYPE_LONGLONG;
+					pbind[ pnr ].buffer = (void *)&pptr[ 1 ];
+				break;
+				
+				case SQLT_STR:
+					if( pptr[ 1 ] != 0 )
+					{
+						plengths[ pnr ] = strlen( (char *)pptr[ 1 ] );
+						pbind[ pnr ].buffer_type = MYSQL_TYPE_STRING;
+						pbind[ pnr ].buffer = (void *)pptr[ 1 ];
+						pbind[ pnr ].length = &plengths[ pnr ];
+					}
+					else
+					{
+						pbind[ pnr ].buffer_type = MYSQL_TYPE_NULL;
+					}
+				break;
+				
+				default:
+					FERROR("Parameter type %lu is not supported\n", pptr[ 0 ] );
+					return NULL;
+			}
+			pnr++;
+		}
+	}
+	
+	const FULONG *dptr;
+	int cols = 0;
+	
+	for( dptr = &descr[ SQL_DATA_STRUCT_START ] ; dptr[0] != SQLT_END ; dptr += 3 )
+	{
+		if( dptr[0] != SQLT_NODE )
+		{
+			cols++;
+		}
+	}
+	
+	if( cols > SQL_STMT_MAX_COLUMNS )
+	{
+		FERROR("Too many columns in description of table %s\n", (char *)descr[ 1 ] );
+		return NULL;
+	}
+	
+	MYSQL_STMT *stmt = NULL;
+	int attempt, err = 0;
+	
+	for( attempt = 0 ; attempt < 2 ; attempt++ )
+	{
+		if( ( stmt = StatementFind( l, descr, SQL_STMT_LOAD, 0, where ) ) == NULL )
+		{
+			BufString *bs = BufStringNew();
+			
+			BufStringAdd( bs, "SELECT " );
+			StatementAddColumns( bs, descr, ~0ULL, NULL );
+			BufStringAdd( bs, " FROM " );
+			BufStringAdd( bs, (char *)descr[ 1 ] );
+			if( where != NULL )
+			{
+				BufStringAdd( bs, " WHERE " );
+				BufStringAdd( bs, where );
+			}
+			
+			DEBUG("SQL SELECT QUERY '%s'\n", bs->bs_Buffer );
+			stmt = StatementAdd( l, descr, SQL_STMT_LOAD, 0, where, bs->bs_Buffer );
+			BufStringDelete( bs );
+			
+			if( stmt == NULL )
+			{
+				return NULL;
+			}
+		}
+		
+		if( mysql_stmt_param_count( stmt ) != (unsigned long)pnr )
+		{
+			FERROR("Number of parameters %d does not match query on table %s\n", pnr, (char *)descr[ 1 ] );
+			return NULL;
+		}
+		
+		if( pnr > 0 && mysql_stmt_bind_param( stmt, pbind ) != 0 )
+		{
+			FERROR("Cannot bind parameters %s\n", mysql_stmt_error( stmt ) );
+			return NULL;
+		}
+		
+		if( ( err = StatementExecute( l, stmt, attempt == 0 ) ) != -1 )
+		{
+			break;
+		}
+	}
+	
+	if( err != 0 )
+	{
+		return NULL;
+	}
+	
+	if( mysql_stmt_store_result( stmt ) != 0 )
+	{
+		FERROR("Cannot receive results %s\n", mysql_stmt_error( stmt ) );
+		mysql_stmt_free_result( stmt );
+		return NULL;
+	}
+	
+	MYSQL_RES *meta = mysql_stmt_result_metadata( stmt );
+	if( meta == NULL )
+	{
+		DEBUG("Query return empty results\n");
+		mysql_stmt_free_result( stmt );
+		return NULL;
+	}
+	MYSQL_FIELD *fields = mysql_fetch_fields( meta );
+	
+	//
+	// values are received in binary form, strings are stored in buffers big enough for longest value
+	//
+	
+	MYSQL_BIND rbind[ SQL_STMT_MAX_COLUMNS ];
+	unsigned long rlengths[ SQL_STMT_MAX_COLUMNS ];
+	int rints[ SQL_STMT_MAX_COLUMNS ];
+	FQUAD rquads[ SQL_STMT_MAX_COLUMNS ];
+	MYSQL_TIME rtimes[ SQL_STMT_MAX_COLUMNS ];
+	my_bool rnulls[ SQL_STMT_MAX_COLUMNS ];		// client library sets flags through pointers in rbind, they must point to our memory
+	my_bool rerrors[ SQL_STMT_MAX_COLUMNS ];
+	int col = 0;
+	
+	memset( rbind, 0, sizeof( rbind ) );
+	memset( rnulls, 0, sizeof( rnulls ) );
+	
+	for( dptr = &descr[ SQL_DATA_STRUCT_START ] ; dptr[0] != SQLT_END ; dptr += 3 )
+	{
+		switch( dptr[ 0 ] )
+		{
+			case SQLT_NODE:
+				continue;
+				
+			case SQLT_IDINT:	// primary key
+			case SQLT_INT:
+				rbind[ col ].buffer_type = MYSQL_TYPE_LONG;
+				rbind[ col ].buffer = &rints[ col ];
+			break;
+			
+			case SQLT_QUAD:
+				rbind[ col ].buffer_type = MYSQL_TYPE_LONGLONG;
+				rbind[ col ].buffer = &rquads[ col ];
+			break;
+			
+			case SQLT_TIMESTAMP:
+				rbind[ col ].buffer_type = MYSQL_TYPE_DATETIME;
+				rbind[ col ].buffer = &rtimes[ col ];
+			break;
+			
+			case SQLT_STR:
+			case SQLT_BLOB:
+				rbind[ col ].buffer_type = dptr[ 0 ] == SQLT_STR ? MYSQL_TYPE_STRING : MYSQL_TYPE_BLOB;
+				rbind[ col ].buffer_length = fields[ col ].max_length + 1;
+				rbind[ col ].buffer = FCalloc( rbind[ col ].buffer_length, sizeof( char ) );
+			break;
+			
+			default:
+				// column is not used, value is skipped
+				rbind[ col ].buffer_type = MYSQL_TYPE_NULL;
+			break;
+		}
+		rbind[ col ].length = &rlengths[ col ];
+		rbind[ col ].is_null = &rnulls[ col ];
+		rbind[ col ].error = &rerrors[ col ];
+		col++;
+	}
+	
+	if( mysql_stmt_bind_result( stmt, rbind ) != 0 )
+	{
+		FERROR("Cannot bind results %s\n", mysql_stmt_error( stmt ) );
+	}
+	else
+	{
+		MinNode *node = NULL;
+		int res;
+		
+		*entries = 0;
+		
+		//
+		// Receiving data as linked list of objects
+		//
+		
+		while( ( res = mysql_stmt_fetch( stmt ) ) == 0 || res == MYSQL_DATA_TRUNCATED )
+		{
+			void *data = FCalloc( 1, descr[ SQL_DATA_STRUCTURE_SIZE ] );
+			if( data == NULL )
+			{
+				FERROR("Cannot allocate memory for entry\n");
+				break;
+			}
+			(*entries)++;
+			
+			int dataUsed = 0; // Tell if we need to free data..
+			
+			// Link the first object (which holds the start of the data)
+			if( firstObject == NULL ) firstObject = data;
+			
+			FUBYTE *strptr = (FUBYTE *)data;	// pointer to structure to which will will insert data
+			col = 0;
+			
+			for( dptr = &descr[ SQL_DATA_STRUCT_START ] ; dptr[0] != SQLT_END ; dptr += 3 )
+			{
+				if( dptr[ 0 ] == SQLT_NODE )
+				{
+					dataUsed = 1;
+					MinNode *locnode = (MinNode *)( strptr + dptr[ 2 ] );
+					if( node != NULL )
+					{
+						node->mln_Succ = (MinNode *)data;
+					}
+					node = locnode;
+					continue;
+				}
+				
+				if( rnulls[ col ] )
+				{
+					col++;
+					continue;
+				}
+				
+				switch( dptr[ 0 ] )
+				{
+					case SQLT_IDINT:	// primary key
+					case SQLT_INT:
+						memcpy( strptr + dptr[ 2 ], &rints[ col ], sizeof( int ) );
+					break;
+					
+					case SQLT_QUAD:
+						memcpy( strptr + dptr[ 2 ], &rquads[ col ], sizeof( FQUAD ) );
+					break;
+					
+					case SQLT_TIMESTAMP:
+						StatementTimeToTm( (struct tm *)( strptr + dptr[ 2 ] ), &rtimes[ col ] );
+					break;
+					
+					case SQLT_STR:
+						{
+							char *tmpval = FCalloc( rlengths[ col ] + 1, sizeof( char ) );
+							if( tmpval != NULL )
+							{
+								memcpy( tmpval, rbind[ col ].buffer, rlengths[ col ] );
+								memcpy( strptr + dptr[ 2 ], &tmpval, sizeof( char * ) );
+							}
+						}
+					break;
+					
+					case SQLT_BLOB:
+						{
+							ListString *ls = ListStringNew();
+							if( ls != NULL )
+							{
+								ListStringAdd( ls, rbind[ col ].buffer, rlengths[ col ] );
+								ListStringJoin( ls );
+							}
+							else
+							{
+								FERROR("Cannot allocate memory for BLOB\n");
+							}
+							
+							// copy pointer to this list
+							memcpy( strptr + dptr[ 2 ], &ls, sizeof( ListString * ) );
+						}
+					break;
+				}
+				col++;
+			}
+			
+			// We allocated memory without using it..
+			if( dataUsed == 0 ) 
+			{
+				if( data == firstObject )
+				{
+					firstObject = NULL;
+				}
+				FFree( data );
+			}
+		}
+	}
+	
+	for( col = 0 ; col < cols ; col++ )
+	{
+		if( rbind[ col ].buffer_type == MYSQL_TYPE_STRING || rbind[ col ].buffer_type == MYSQL_TYPE_BLOB )
+		{
+			FFree( rbind[ col ].buffer );
+		}
+	}
+	
+	mysql_free_result( meta );
+	mysql_stmt_free_result( stmt );
+	DEBUG("[MYSQLLibrary] LoadBind END\n");
+	
+	return firstObject;
+}
+
 /**
  * Load data from database
  *
@@ -76,6 +709,12 @@ long GetRevision(void)
  */
 void *Load( struct MYSQLLibrary *l, FULONG *descr, char *where, int *entries )
 {
+	// without "where" query never changes, cached statement can be used
+	if( where == NULL )
+	{
+		return LoadBind( l, descr, NULL, NULL, entries );
+	}
+	
 	//char tmpQuery[ 1024 ];
 	BufString *tmpQuerybs = BufStringNew();
 	void *firstObject = NULL;
@@ -316,251 +955,147 @@ void *Load( struct MYSQLLibrary *l, FULONG *descr, char *where, int *entries )
  */
 int Update( struct MYSQLLibrary *l, FULONG *descr, void *data )
 {
-	BufString *querybs = BufStringNew();
-	char tmpQuery[ 2048 ];
-	int primaryId = -1;
-	char *primaryIdName = NULL;
 	DEBUG("[MYSQLLibrary] Update\n");
 	
 	if( descr == NULL || data == NULL )
 	{
-		BufStringDelete( querybs );
 		DEBUG("Data structure or description was not provided!\n");
 		return 0;
 	}
 	
 	if( descr[ 0 ] != SQLT_TABNAME )
 	{
-		BufStringDelete( querybs );
 		DEBUG("SQLT_TABNAME was not provided!\n");
 		return 0;
 	}
 	
-	char *whereColName = NULL;
-	int whereColValue = -1;
-	FULONG *dptr = &descr[ SQL_DATA_STRUCT_START ];
-	unsigned char *strptr = (unsigned char *)data;	// pointer to structure to which will will insert data
+	unsigned char *strptr = (unsigned char *)data;	// pointer to structure from which data will be taken
+	MYSQL_BIND bind[ SQL_STMT_MAX_COLUMNS + 1 ];
+	unsigned long lengths[ SQL_STMT_MAX_COLUMNS ];
+	MYSQL_TIME times[ SQL_STMT_MAX_COLUMNS ];
+	char *primaryIdName = NULL;
+	void *primaryId = NULL;
+	FULONG mask = 0;
+	int params = 0;
+	int col = 0;
+	FULONG *dptr;
+	
+	memset( bind, 0, sizeof( bind ) );
 	
-	while( dptr[0] != SQLT_END )
+	for( dptr = &descr[ SQL_DATA_STRUCT_START ] ; dptr[0] != SQLT_END ; dptr += 3, col++ )
 	{
-		switch( dptr[ 0 ] )
-		{
-			case SQLT_IDINT:	// primary key
-				{
-					memcpy( &whereColValue, strptr + dptr[ 2 ], sizeof( int ) );
-					whereColName = (char *) dptr[ 1 ];		// data field name
-					break;
-				}
-		}
-		if( whereColName != NULL )
+		if( col >= SQL_STMT_MAX_COLUMNS )
 		{
-			break;
+			FERROR("Too many columns in description of table %s\n", (char *)descr[ 1 ] );
+			return 2;
 		}
 		
-		dptr += 3;
-	}
-
-	//"UPDATE %s set SessionID = '%s', LoggedTime = '%lld' where Name = '%s'"
-	
-	int lsize = sprintf( tmpQuery, "UPDATE %s set ", (char *)descr[ 1 ] );
-	BufStringAddSize( querybs, tmpQuery, lsize );
-
-	DEBUG("Update SQL: %s\n", tmpQuery );
-	
-	dptr = &descr[ SQL_DATA_STRUCT_START ];		// first 2 entries inform about table, rest information provided is about columns
-	
-	int cols = 0;
-	
-	while( dptr[0] != SQLT_END )
-	{
-		DEBUG("Update POINTER %p\n", strptr );
-		
 		switch( dptr[ 0 ] )
 		{
-			case SQLT_IDINT:	// primary key
-				{
-					// we just skip that in update
-					
-					int tmpint;
-					memcpy( &tmpint, strptr + dptr[ 2 ], sizeof( int ) );
-					primaryId = tmpint;
-					primaryIdName = ( char *)dptr[ 1 ];
-					
-					DEBUG("[MYSQLLibrary] : we dont update PRIMARY KEY %d\n", primaryId );
-				}
-				break;
-				
-			case SQLT_INT:
+			case SQLT_IDINT:	// primary key, we dont update it
+				if( primaryIdName == NULL )
 				{
-					char tmp[ 256 ];
-					int tmpint;
-					int sprintfsize = 0;
-					
-					memcpy( &tmpint, strptr + dptr[ 2 ], sizeof( int ) );
-					if( cols == 0 )
-					{
-						sprintfsize = sprintf( tmp, " %s = %d", (char *)dptr[ 1 ], tmpint );
-					}
-					else
-					{
-						sprintfsize = sprintf( tmp, ", %s = %d", (char *)dptr[ 1 ], tmpint );
-					}
-					//strcat( tmpQuery, tmp );
-					BufStringAddSize( querybs, tmp, sprintfsize );
-					cols++;
-
-					DEBUG("[MYSQLLibrary] update set int %d to %s\n", tmpint, (char *)dptr[ 1 ] );
+					primaryIdName = (char *)dptr[ 1 ];
+					primaryId = strptr + dptr[ 2 ];
 				}
-				break;
-				
+			break;
+			
+			case SQLT_INT:
+				bind[ params ].buffer_type = MYSQL_TYPE_LONG;
+				bind[ params ].buffer = strptr + dptr[ 2 ];
+				mask |= ( 1ULL << col );
+				params++;
+			break;
+			
 			case SQLT_STR:
 				{
-					char tmp[ 256 ];
 					char *tmpchar;
 					memcpy( &tmpchar, strptr + dptr[ 2 ], sizeof( char *) );
-					DEBUG("[MYSQLLibrary] update, pointer %p\n", tmpchar );
-					int sprintfsize = 0;
 					
 					if( tmpchar != NULL )
 					{
-						char *ttext = NULL;
-						char *esctext = NULL;
-						
-						int tmpcharsize = strlen( tmpchar );
-						int ttextsize = strlen( (char *)dptr[ 1 ] ) + ( tmpcharsize << 1 ) + 256;
-						
-						if( ( ttext = FCalloc( ttextsize, sizeof(char) ) ) != NULL )
-						{
-							if( ( esctext = FCalloc( (tmpcharsize << 1 ) + 1, sizeof(char) ) ) != NULL )
-							{
-								mysql_real_escape_string( l->con.sql_Con, esctext, tmpchar, tmpcharsize );
-								
-								if( cols == 0 )
-								{
-									sprintfsize = sprintf( ttext, " %s = '%s'", (char *)dptr[ 1 ], esctext );
-								}
-								else
-								{
-									sprintfsize = sprintf( ttext, ", %s = '%s'", (char *)dptr[ 1 ], esctext );
-								}
-								//strcat( tmpQuery, tmp );
-								BufStringAddSize( querybs, ttext, sprintfsize );
-								FFree( esctext );
-							}
-							FFree( ttext );
-						}
-						
-						DEBUG("[MYSQLLibrary] update set string %s to %s\n", tmpchar, (char *)dptr[ 1 ] );
-						
-						cols++;
+						lengths[ params ] = strlen( tmpchar );
+						bind[ params ].buffer_type = MYSQL_TYPE_STRING;
+						bind[ params ].buffer = tmpchar;
+						bind[ params ].length = &lengths[ params ];
 					}
 					else	// string was set to NULL
 					{
-						if( cols == 0 )
-						{
-							sprintfsize = sprintf( tmp, " %s = NULL", (char *)dptr[ 1 ] );
-						}
-						else
-						{
-							sprintfsize = sprintf( tmp, ", %s = NULL", (char *)dptr[ 1 ] );
-						}
-						BufStringAddSize( querybs, tmp, sprintfsize );
-						//strcat( tmpQuery, tmp );
-						
-						cols++;
-					}
-						
-				}
-				break;
-				
-				case SQLT_TIMESTAMP:
-				{
-					int sprintfsize = 0;
-					// '2015-08-10 16:28:31'
-					char date[ 64 ];
-					char tmp[ 256 ];
-					
-					DEBUG("TIMESTAMP update\n");
-				
-					struct tm *tp = (struct tm *)( strptr+dptr[2]);
-					//struct tm tp;
-					//memcpy( &tp, strptr+dptr[2], sizeof( struct tm ) );	// copy timestamp pointer
-					
-					DEBUG("TIMESTAMP update 1\n");
-					
-					//if( tp != NULL )
-					{
-						sprintf( date, "%4d-%2d-%2d %2d:%2d:%2d", tp->tm_year, tp->tm_mon, tp->tm_mday, tp->tm_hour, tp->tm_min, tp->tm_sec );
-						//sprintf( date, "%04d-%02d-%02d %02d:%02d:%02d", tp.tm_year, tp.tm_mon, tp.tm_mday, (int)tp.tm_hour, (int)tp.tm_min, (int)tp.tm_sec );
-						
-						DEBUG("DATE serialised %s\n", date );
-					
-						if( cols == 0 )
-						{
-							sprintfsize = sprintf( tmp, " %s = '%s'", (char *)dptr[ 1 ], date );
-						}
-						else
-						{
-							sprintfsize = sprintf( tmp, ", %s = '%s'", (char *)dptr[ 1 ], date );
-						}
-						BufStringAddSize( querybs, tmp, sprintfsize );
-						//strcat( tmpQuery, tmp );
-						cols++;
-					}
-					
-					/*
-					MYSQL_TIME *tp;
-					memcpy( &tp, strptr+dptr[2], sizeof( MYSQL_TIME *) );	// copy timestamp pointer
-				
-					if( tp != NULL )
-					{
-						sprintf( date, "%4d-%2d-%2d %2d:%2d:%2d", tp->year, tp->month, tp->day, tp->hour, tp->minute, tp->minute );
-					
-						if( cols == 0 )
-						{
-							sprintf( tmp, " %s = '%s'", (char *)dptr[ 1 ], date );
-						}
-						else
-						{
-							sprintf( tmp, ", %s = '%s'", (char *)dptr[ 1 ], date );
-						}
-						strcat( tmpQuery, tmp );
+						bind[ params ].buffer_type = MYSQL_TYPE_NULL;
 					}
-					*/
+					mask |= ( 1ULL << col );
+					params++;
 				}
 			break;
+			
+			case SQLT_TIMESTAMP:
+				StatementTimeFromTm( &times[ params ], (struct tm *)( strptr + dptr[ 2 ] ) );
+				bind[ params ].buffer_type = MYSQL_TYPE_DATETIME;
+				bind[ params ].buffer = &times[ params ];
+				mask |= ( 1ULL << col );
+				params++;
+			break;
 		}
-		
-		//cols++;
-		dptr += 3;
 	}
 	
-	DEBUG("UPDATE FIRST PART %s\n", tmpQuery );
-	
 	if( primaryIdName != NULL )
 	{
-		char tmpvar[ 256 ];
-		int sprintfsize = sprintf( tmpvar, " where %s = %d", primaryIdName, primaryId );
-		//DEBUG("SQL update %s\n", tmpQuery );
-		//strcat( tmpQuery, tmpvar );
-		BufStringAddSize( querybs, tmpvar, sprintfsize );
+		bind[ params ].buffer_type = MYSQL_TYPE_LONG;
+		bind[ params ].buffer = primaryId;
+		params++;
 	}
-	DEBUG("UPDATE QUERY '%s'\n", tmpQuery );
 	
-	if( mysql_query( l->con.sql_Con, querybs->bs_Buffer ) )
+	MYSQL_STMT *stmt = NULL;
+	int attempt, err = 0;
+	
+	for( attempt = 0 ; attempt < 2 ; attempt++ )
 	{
-		FERROR("Query error!\n");
-		BufStringDelete( querybs );
+		if( ( stmt = StatementFind( l, descr, SQL_STMT_UPDATE, mask, NULL ) ) == NULL )
+		{
+			BufString *bs = BufStringNew();
+			
+			BufStringAdd( bs, "UPDATE " );
+			BufStringAdd( bs, (char *)descr[ 1 ] );
+			BufStringAdd( bs, " SET " );
+			StatementAddColumns( bs, descr, mask, " = ?" );
+			if( primaryIdName != NULL )
+			{
+				BufStringAdd( bs, " WHERE `" );
+				BufStringAdd( bs, primaryIdName );
+				BufStringAdd( bs, "` = ?" );
+			}
+			
+			DEBUG("UPDATE QUERY '%s'\n", bs->bs_Buffer );
+			stmt = StatementAdd( l, descr, SQL_STMT_UPDATE, mask, NULL, bs->bs_Buffer );
+			BufStringDelete( bs );
+			
+			if( stmt == NULL )
+			{
+				return 2;
+			}
+		}
+		
+		if( mysql_stmt_bind_param( stmt, bind ) != 0 )
+		{
+			FERROR("Cannot bind parameters %s\n", mysql_stmt_error( stmt ) );
+			return 2;
+		}
 		
+		if( ( err = StatementExecute( l, stmt, attempt == 0 ) ) != -1 )
+		{
+			break;
+		}
+	}
+	
+	if( err != 0 )
+	{
+		FERROR("Query error!\n");
 		return 2;
 	}
-	BufStringDelete( querybs );
 	
 	return 0;
 }
 
-#define FRIEND_MAX_BIND 256
-
 /**
  * Save data in database. Primary ID will be stored in structure
  *
@@ -571,269 +1106,157 @@ int Update( struct MYSQLLibrary *l, FULONG *descr, void *data )
  */
 int Save( struct MYSQLLibrary *l, const FULONG *descr, void *data )
 {
-	char *finalQuery = NULL;
-	BufString *tablequerybs = BufStringNew();
-	BufString *dataquerybs = BufStringNew();
-	
 	DEBUG("[MYSQLLibrary] Save\n");
 	
 	if( descr == NULL || data == NULL )
 	{
-		BufStringDelete( tablequerybs );
-		BufStringDelete( dataquerybs );
 		FERROR("Data structure or description was not provided!\n");
 		return 0;
 	}
 	
 	if( descr[ 0 ] != SQLT_TABNAME )
 	{
-		BufStringDelete( tablequerybs );
-		BufStringDelete( dataquerybs );
 		FERROR("SQLT_TABNAME was not provided!\n");
 		return 0;
 	}
-
-	FULONG *dptr = (FULONG *)&descr[ SQL_DATA_STRUCT_START ];		// first 2 entries inform about table, rest information provided is about columns
-	unsigned char *strptr = (unsigned char *)data;	// pointer to structure to which will will insert data
-	int opt = 0;
-	int *primaryid = NULL;
-	//int entries = 0;
-	int statementEntry = 0;
 	
-	MYSQL_STMT *stmt;
-	MYSQL_BIND bindTable[ FRIEND_MAX_BIND ];
-	long bindLength[ FRIEND_MAX_BIND ];
-	ListString *bindData[ FRIEND_MAX_BIND ];
+	unsigned char *strptr = (unsigned char *)data;	// pointer to structure from which data will be taken
+	MYSQL_BIND bind[ SQL_STMT_MAX_COLUMNS ];
+	unsigned long lengths[ SQL_STMT_MAX_COLUMNS ];
+	MYSQL_TIME times[ SQL_STMT_MAX_COLUMNS ];
+	void *primaryid = NULL;
+	FULONG mask = 0;
+	int params = 0;
+	int col = 0;
+	const FULONG *dptr;
 	
-	memset( bindTable, 0, sizeof(bindTable) );
+	memset( bind, 0, sizeof( bind ) );
 	
-	stmt = mysql_stmt_init( l->con.sql_Con );
-	if( stmt != NULL )
-	{
-		// we calculate how many entries we will have
+	// empty strings and blobs are not stored, every combination of columns gets own statement
 	
-		while( dptr[0] != SQLT_END )
+	for( dptr = &descr[ SQL_DATA_STRUCT_START ] ; dptr[0] != SQLT_END ; dptr += 3, col++ )
+	{
+		if( col >= SQL_STMT_MAX_COLUMNS )
+		{
+			FERROR("Too many columns in description of table %s\n", (char *)descr[ 1 ] );
+			return 4;
+		}
+		
+		switch( dptr[ 0 ] )
 		{
-			//DEBUG("Size %d column name %s\n", dptr[2] ,  (char *)dptr[ 1 ] );
+			case SQLT_IDINT:	// primary key, we just skip that in save
+				primaryid = strptr + dptr[ 2 ];
+			break;
 			
-			//DEBUG("Found on pos %d tag %d   row %s\n", i, dptr[ 0 ], row[ i ] ); 
-			switch( dptr[ 0 ] )
-			{
-				case SQLT_IDINT:	// primary key
-				{
-					// we just skip that in save
-					//strptr += 8;
-					//DEBUG("[MYSQLLibrary] : we dont save\n");
-					
-					primaryid = (int *)(strptr + dptr[ 2 ]);
-					//opt++;
-				}
-				break;
-				
-				case SQLT_INT:
-				{
-					char tmp[ 256 ];
-					int tmpint;
-					memcpy( &tmpint, strptr + dptr[2], sizeof( int ) );
-					int locsize = sprintf( tmp, " %d", tmpint );
-					
-					if( opt > 0 )
-					{
-						BufStringAddSize( tablequerybs, ",", 1 );
-						BufStringAddSize( dataquerybs, ",", 1 );
-					}
-					BufStringAdd( tablequerybs, (char *)dptr[ 1 ]  );
-					BufStringAddSize( dataquerybs, tmp, locsize );
-					
-					//DEBUG("[MYSQLLibrary] save set int %d to %s\n", tmpint, (char *)dptr[ 1 ] );
-					
-					opt++;
-				}
-				break;
-				
-				case SQLT_STR:
+			case SQLT_INT:
+				bind[ params ].buffer_type = MYSQL_TYPE_LONG;
+				bind[ params ].buffer = strptr + dptr[ 2 ];
+				mask |= ( 1ULL << col );
+				params++;
+			break;
+			
+			case SQLT_STR:
 				{
 					char *tmpchar;
-					
-					//DEBUG("Size %d tABNAME %s\n", dptr[2] ,  (char *)dptr[ 1 ] );
-					memcpy( &tmpchar, strptr+dptr[2], sizeof( char *) );
-					
-					//DEBUG("[MYSQLLibrary] save  pointer to text %p - tabname %s\n", tmpchar, (char *)dptr[ 1 ] );
+					memcpy( &tmpchar, strptr + dptr[ 2 ], sizeof( char *) );
 					
 					if( tmpchar != NULL )
 					{
-						if( opt > 0 )
-						{
-							BufStringAddSize( tablequerybs, ",", 1 );
-							BufStringAddSize( dataquerybs, ",", 1 );
-						}
-
-						BufStringAddSize( dataquerybs, "'", 1 );
-						BufStringAdd( tablequerybs, (char *)dptr[ 1 ] );
-						//DEBUG("[MYSQLLibrary] save before cat, column name %s\n", (char *)dptr[ 1 ] );
-
-						char *esctext;
-						int tmpcharsize = strlen( tmpchar );
-						if( ( esctext = FCalloc( (tmpcharsize << 1 ) + 1, sizeof(char) ) ) != NULL )
-						{
-							mysql_real_escape_string( l->con.sql_Con, esctext, tmpchar, tmpcharsize );
-							//BufStringAdd( dataquerybs, tmpchar );
-							BufStringAdd( dataquerybs, esctext );
-							
-							FFree( esctext );
-						}
-						BufStringAddSize( dataquerybs, "'", 1 );
-						
-						//DEBUG("[MYSQLLibrary] save set string %s to %s\n", tmpchar, (char *)dptr[ 1 ] );
-					}
-					
-					opt++;
-				}
-				break;
-				
-				case SQLT_TIMESTAMP:
-				{
-					// '2015-08-10 16:28:31'
-					char date[ 64 ];
-					
-					//DEBUG("SQLTimestamp SAVE\n");
-				
-					struct tm *tp = (struct tm *)( strptr+dptr[2]);
-					//memcpy( &tp, strptr+dptr[2], sizeof( MYSQL_TIME *) );	// copy timestamp pointer
-				
-					//if( tp != NULL )
-					{
-						//sprintf( date, "%04d-%02d-%02d %02d:%02d:%02d", tp.tm_year, tp.tm_mon, tp.tm_mday, (int)tp.tm_hour, (int)tp.tm_min, (int)tp.tm_sec );
-						sprintf( date, "%4d-%2d-%2d %2d:%2d:%2d", tp->tm_year, tp->tm_mon, tp->tm_mday, tp->tm_hour, tp->tm_min, tp->tm_sec );
-					
-						if( opt > 0 )
-						{
-							BufStringAddSize( tablequerybs, ",", 1 );
-							BufStringAddSize( dataquerybs, ",", 1 );
-						}
-
-						BufStringAddSize( dataquerybs, "'", 1 );
-						BufStringAdd( tablequerybs, (char *)dptr[ 1 ] );
-						//DEBUG("[MYSQLLibrary] save before cat, column name %s\n", (char *)dptr[ 1 ] );
-
-						BufStringAdd( dataquerybs, date );
-						BufStringAddSize( dataquerybs, "'", 1 );
-
+						lengths[ params ] = strlen( tmpchar );
+						bind[ params ].buffer_type = MYSQL_TYPE_STRING;
+						bind[ params ].buffer = tmpchar;
+						bind[ params ].length = &lengths[ params ];
+						mask |= ( 1ULL << col );
+						params++;
 					}
-					opt++;
 				}
-				break;
-				
-				case SQLT_BLOB:
+			break;
+			
+			case SQLT_TIMESTAMP:
+				StatementTimeFromTm( &times[ params ], (struct tm *)( strptr + dptr[ 2 ] ) );
+				bind[ params ].buffer_type = MYSQL_TYPE_DATETIME;
+				bind[ params ].buffer = &times[ params ];
+				mask |= ( 1ULL << col );
+				params++;
+			break;
+			
+			case SQLT_BLOB:
 				{
 					ListString *ls = NULL;
-
-					memcpy( &ls, strptr+dptr[2], sizeof( ListString *) );
+					memcpy( &ls, strptr + dptr[ 2 ], sizeof( ListString *) );
 					
 					if( ls != NULL && ls->ls_Data != NULL )
 					{
-						if( opt > 0 )
-						{
-							BufStringAddSize( tablequerybs, ",", 1 );
-							BufStringAddSize( dataquerybs, ",", 1 );
-						}
-					
-						BufStringAdd( tablequerybs, (char *)dptr[ 1 ] );
-						BufStringAddSize( dataquerybs, "?", 1 );
-					
-						bindData[ statementEntry ] = ls;
-						bindTable[ statementEntry ].buffer_type = MYSQL_TYPE_STRING;
-						bindTable[ statementEntry ].buffer         = (void *) &(bindData[ statementEntry ]->ls_Data);
-						bindTable[ statementEntry ].is_unsigned    = 1;
-						bindTable[ statementEntry ].length= (long unsigned int *) bindLength[ statementEntry ];
-						bindTable[ statementEntry ].is_null= 0;
-					
-						//DEBUG("--------STORE----%ld\n", bindData[ statementEntry ]->ls_Size );
-					
-						statementEntry++;
+						lengths[ params ] = ls->ls_Size;
+						bind[ params ].buffer_type = MYSQL_TYPE_BLOB;
+						bind[ params ].buffer = ls->ls_Data;
+						bind[ params ].length = &lengths[ params ];
+						mask |= ( 1ULL << col );
+						params++;
 					}
 					else
 					{
 						FERROR("Cannot store blob, buffer is empty!\n");
 					}
-					opt++;
 				}
-				break;
-			}	// end switch
-		
-			dptr += 3;
-		}	// end of while, end of table
-		// end of if( statement init)
+			break;
+		}
+	}
 	
-		int finalqsize = tablequerybs->bs_Size + dataquerybs->bs_Size + 256;
-		
-		if( ( finalQuery = FCalloc( finalqsize, sizeof(char) ) ) != NULL )
+	MYSQL_STMT *stmt = NULL;
+	int attempt, err = 0;
+	
+	for( attempt = 0 ; attempt < 2 ; attempt++ )
+	{
+		if( ( stmt = StatementFind( l, descr, SQL_STMT_SAVE, mask, NULL ) ) == NULL )
 		{
+			BufString *bs = BufStringNew();
+			int i;
 			
-			sprintf( finalQuery, "INSERT INTO %s ( %s ) VALUES( %s )", (char *)descr[ 1 ], tablequerybs->bs_Buffer, dataquerybs->bs_Buffer );
-			DEBUG("SQL: %s  entries %d\n", finalQuery, statementEntry );
-	
-			if (mysql_stmt_prepare(stmt, finalQuery, strlen(finalQuery)))
-			{
-				FERROR( "\n mysql_stmt_prepare(), INSERT failed");
-				FERROR( "\n %s", mysql_stmt_error(stmt));
-				mysql_stmt_close( stmt ); // Free
-				BufStringDelete( tablequerybs );
-				BufStringDelete( dataquerybs );
-				FFree( finalQuery );
-				return 3;
-			}
-	
-			// Bind the buffers 
-			if (mysql_stmt_bind_param( stmt, bindTable ) )
-			{
-				FERROR("param bind failed! ");
-				FERROR(" %s\n", mysql_stmt_error(stmt) );
-				mysql_stmt_close( stmt ); // Free
-				BufStringDelete( tablequerybs );
-				BufStringDelete( dataquerybs );
-				FFree( finalQuery );
-				return 1;
-			}
-
-			if( statementEntry > 0 )
+			BufStringAdd( bs, "INSERT INTO " );
+			BufStringAdd( bs, (char *)descr[ 1 ] );
+			BufStringAdd( bs, " ( " );
+			StatementAddColumns( bs, descr, mask, NULL );
+			BufStringAdd( bs, " ) VALUES( " );
+			for( i = 0 ; i < params ; i++ )
 			{
-				int i;
-		
-				for( i=0; i < statementEntry ; i++ )
-				{
-					DEBUG("STORE FILE / SIZE %ld\n", bindData[ i ]->ls_Size );
-					// Supply data in chunks to server 
-					if (mysql_stmt_send_long_data(stmt, i, bindData[ i ]->ls_Data , bindData[ i ]->ls_Size ) )
-					{
-						FERROR( " send_long_data failed %s\n", mysql_stmt_error(stmt));
-					}
-				}
+				BufStringAddSize( bs, i == 0 ? "?" : ",?", i == 0 ? 1 : 2 );
 			}
-
-			// Now, execute the query 
-			if ( mysql_stmt_execute(stmt) )
+			BufStringAdd( bs, " )" );
+			
+			DEBUG("SQL: %s  entries %d\n", bs->bs_Buffer, params );
+			stmt = StatementAdd( l, descr, SQL_STMT_SAVE, mask, NULL, bs->bs_Buffer );
+			BufStringDelete( bs );
+			
+			if( stmt == NULL )
 			{
-				FERROR("mysql_stmt_execute failed %s\n", mysql_stmt_error(stmt));
+				return 3;
 			}
+		}
 		
-			// Free up!
-			mysql_stmt_close( stmt );
-			
-			FFree( finalQuery );
+		if( params > 0 && mysql_stmt_bind_param( stmt, bind ) != 0 )
+		{
+			FERROR("param bind failed! %s\n", mysql_stmt_error( stmt ) );
+			return 1;
 		}
-
-		if( primaryid != NULL )
+		
+		if( ( err = StatementExecute( l, stmt, attempt == 0 ) ) != -1 )
 		{
-			FULONG uid = mysql_insert_id( l->con.sql_Con );
-			memcpy( primaryid, &uid, sizeof( FULONG ) );
-			DEBUG("NEW ENTRY ID %lu\n", uid );
+			break;
 		}
-
-		//DEBUG("[MYSQLLibrary]: insert %s\n", finalQuery );
 	}
-	BufStringDelete( tablequerybs );
-	BufStringDelete( dataquerybs );
+	
+	if( err != 0 )
+	{
+		return 2;
+	}
+	
+	if( primaryid != NULL )
+	{
+		FULONG uid = mysql_stmt_insert_id( stmt );
+		memcpy( primaryid, &uid, sizeof( FULONG ) );
+		DEBUG("NEW ENTRY ID %lu\n", uid );
+	}
 	
 	return 0;
 }
@@ -847,26 +1270,38 @@ int Save( struct MYSQLLibrary *l, const FULONG *descr, void *data )
  */
 void Delete( struct MYSQLLibrary *l, FULONG *descr, void *data )
 {
-	char tmpQuery[ 1024 ];
-	int *strptr = (int *)data;		// we are sure that first element in a structure is our SQLT_IDINT
-
-	// we should go trough for structure to find SQLT_IDINT
-
-	sprintf( tmpQuery, "delete from %s where ID = '%d'", (char *)descr[1], *strptr );
-
-	if( mysql_query( l->con.sql_Con, tmpQuery ) )
+	MYSQL_BIND bind[ 1 ];
+	MYSQL_STMT *stmt = NULL;
+	int attempt;
+	
+	memset( bind, 0, sizeof( bind ) );
+	bind[ 0 ].buffer_type = MYSQL_TYPE_LONG;
+	bind[ 0 ].buffer = data;		// we are sure that first element in a structure is our SQLT_IDINT
+	
+	for( attempt = 0 ; attempt < 2 ; attempt++ )
 	{
-		return;
+		if( ( stmt = StatementFind( l, descr, SQL_STMT_DELETE, 0, NULL ) ) == NULL )
+		{
+			char tmpQuery[ 1024 ];
+			snprintf( tmpQuery, sizeof(tmpQuery), "DELETE FROM %s WHERE ID = ?", (char *)descr[1] );
+			
+			if( ( stmt = StatementAdd( l, descr, SQL_STMT_DELETE, 0, NULL, tmpQuery ) ) == NULL )
+			{
+				return;
+			}
+		}
+		
+		if( mysql_stmt_bind_param( stmt, bind ) != 0 )
+		{
+			FERROR("Cannot bind parameters %s\n", mysql_stmt_error( stmt ) );
+			return;
+		}
+		
+		if( StatementExecute( l, stmt, attempt == 0 ) != -1 )
+		{
+			break;
+		}
 	}
-
-	MYSQL_RES *result = mysql_store_result( l->con.sql_Con );
-  
-	if (result == NULL) 
-	{
-		return;
- 	}
-
-	mysql_free_result( result );
 }
 
 /**
@@ -924,15 +1359,53 @@ int NumberOfRecords( struct MYSQLLibrary *l, FULONG *descr, char *where )
 		return -2;
 	}
 
-	if( where != NULL )
+	if( where == NULL )
 	{
-		sprintf( tmpQuery, "select count(*) from %s", where );
-	}
-	else
-	{
-		sprintf( tmpQuery, "select count(*) from %s", (char *)descr[ 1 ] );
+		MYSQL_STMT *stmt = NULL;
+		int attempt, err = 0;
+		
+		for( attempt = 0 ; attempt < 2 ; attempt++ )
+		{
+			if( ( stmt = StatementFind( l, descr, SQL_STMT_COUNT, 0, NULL ) ) == NULL )
+			{
+				snprintf( tmpQuery, sizeof(tmpQuery), "SELECT COUNT(*) FROM %s", (char *)descr[ 1 ] );
+				
+				if( ( stmt = StatementAdd( l, descr, SQL_STMT_COUNT, 0, NULL, tmpQuery ) ) == NULL )
+				{
+					return -3;
+				}
+			}
+			
+			if( ( err = StatementExecute( l, stmt, attempt == 0 ) ) != -1 )
+			{
+				break;
+			}
+		}
+		
+		if( err != 0 )
+		{
+			return -3;
+		}
+		
+		long long count = 0;
+		MYSQL_BIND rbind[ 1 ];
+		
+		memset( rbind, 0, sizeof( rbind ) );
+		rbind[ 0 ].buffer_type = MYSQL_TYPE_LONGLONG;
+		rbind[ 0 ].buffer = &count;
+		
+		if( mysql_stmt_bind_result( stmt, rbind ) == 0 && mysql_stmt_fetch( stmt ) == 0 )
+		{
+			intRet = (int)count;
+		}
+		mysql_stmt_free_result( stmt );
+		
+		DEBUG("[MYSQLLibrary] NumberOfRecords END\n");
+		return intRet;
 	}
 	
+	sprintf( tmpQuery, "select count(*) from %s", where );
+	
 	if( mysql_query( l->con.sql_Con, tmpQuery ) )
 	{
 		FERROR("Cannot run query: '%s'\n", tmpQuery );
@@ -1010,9 +1483,11 @@ int NumberOfRecordsCustomQuery( struct MYSQLLibrary *l, const char *query )
 MYSQL_RES *Query( struct MYSQLLibrary *l, const char *sel )
 {
 	MYSQL_RES *result = NULL;
+	FUQUAD start = SQL_METRICS_START();
 	
 	if( mysql_query( l->con.sql_Con, sel ) )
 	{
+		SQL_METRICS_END( start );
 		FERROR("Cannot run query: '%s'\n", sel );
 		const char *err = mysql_error( l->con.sql_Con );
 		FERROR( "%s\n", err );
@@ -1028,6 +1503,8 @@ MYSQL_RES *Query( struct MYSQLLibrary *l, const char *sel )
 	DEBUG("SELECT QUERY %s\n", sel );
 
 	result = mysql_store_result( l->con.sql_Con );
+	
+	SQL_METRICS_END( start );
 
 	return result;
 }
@@ -1045,6 +1522,7 @@ int QueryWithoutResults( struct MYSQLLibrary *l, const char *sel )
 	{
 		if( l->con.sql_Con != NULL )
 		{
+			FUQUAD start = SQL_METRICS_START();
 			int err = mysql_query( l->con.sql_Con, sel );
 
 			if( err != 0 )
@@ -1066,6 +1544,8 @@ int QueryWithoutResults( struct MYSQLLibrary *l, const char *sel )
 					mysql_free_result( results );
 				}
 			}
+			
+			SQL_METRICS_END( start );
 
 			return err;
 		}
@@ -1772,6 +2252,8 @@ char* StringDuplicate( const char* str )
  */
 int Reconnect( struct MYSQLLibrary *l )
 {
+	StatementCacheFlush( l );
+	
 	void *connection = mysql_real_connect( l->con.sql_Con, l->con.sql_Host, l->con.sql_DBName, l->con.sql_User, l->con.sql_Pass, l->con.sql_Port, NULL, 0 );
 	if( connection == NULL )
 	{
@@ -1843,6 +2325,7 @@ int Disconnect( struct MYSQLLibrary *l )
 	if( l->con.sql_User != NULL ){ FFree( l->con.sql_User );  l->con.sql_User = NULL; }
 	if( l->con.sql_Pass != NULL ){ FFree( l->con.sql_Pass );  l->con.sql_Pass = NULL; }
 	
+	StatementCacheFlush( l );
 	mysql_close( l->con.sql_Con );
 	return 0;
 }
@@ -1910,6 +2393,7 @@ void *libInit( void *sb )
 	l->FreeResult = dlsym ( l->l_Handle, "FreeResult");
 	l->DeleteWhere = dlsym ( l->l_Handle, "DeleteWhere");
 	l->QueryWithoutResults = dlsym ( l->l_Handle, "QueryWithoutResults");
+	l->LoadBind = LoadBind;
 	l->SNPrintF = SNPrintF;
 	l->Connect = Connect;
 	l->Disconnect = Disconnect;
@@ -1935,6 +2419,7 @@ void libClose( struct MYSQLLibrary *l )
 		if( l->con.sql_Pass != NULL ){ FFree( l->con.sql_Pass );  l->con.sql_Pass = NULL; }
 		
 		DEBUG( "MYSQL library closed connection.\n" );
+		StatementCacheFlush( l );
 		mysql_close( l->con.sql_Con );
 		l->con.sql_Con = NULL;
 	}
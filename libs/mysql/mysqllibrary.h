@@ -30,11 +30,41 @@
 #include <time.h>
 #include <core/types.h>
 #include <core/library.h>
+#include <core/nodes.h>
 //#include <mysql/mysqllibrary.h>
 #include <mysql.h>
 
 #include "sql_defs.h"
 
+#define SQL_STMT_CACHE_MAX		64		// prepared statements kept per connection
+#define SQL_STMT_MAX_COLUMNS	64		// columns in description which can be used with statements
+
+//
+// Operations which use prepared statements
+//
+
+enum {
+	SQL_STMT_LOAD = 1,
+	SQL_STMT_SAVE,
+	SQL_STMT_UPDATE,
+	SQL_STMT_DELETE,
+	SQL_STMT_COUNT
+};
+
+//
+// Prepared statement, cached per connection
+//
+
+typedef struct SQLStatement
+{
+	MinNode			node;
+	const FULONG	*ss_Descr;		// description from which statement was created
+	int				ss_Type;		// SQL_STMT_*
+	FULONG			ss_Mask;		// columns used by statement (SQL_STMT_SAVE)
+	char			*ss_Where;		// where part of query (SQL_STMT_LOAD)
+	MYSQL_STMT		*ss_Stmt;
+}SQLStatement;
+
 typedef struct SQLConnection
 {
 	char 			*sql_Host;		// host
@@ -45,6 +75,10 @@ typedef struct SQLConnection
 
 	MYSQL 		*sql_Con;			// sql connection
 	FBOOL			sql_Recconect;	// should I reconnect
+	
+	SQLStatement	*sql_Statements;	// prepared statements, most recently used first
+	int				sql_StatementsNr;
+	unsigned long	sql_StatementsThreadID;	// server connection on which statements were prepared
 }SQLConnection;
 
 //
@@ -56,6 +90,10 @@ typedef struct SQLConnection
 // 
 // FULONG d[] = { SQLT_TABNAME, "FriendUser", SQLT_IDINT, "ID", SQLT_STR, "NAME", SQLT_END };
 //
+// Parameters for LoadBind, one for every '?' in where
+//
+// FULONG p[] = { SQLT_STR, (FULONG)name, SQLT_INT, id, SQLT_END };
+//
 
 //
 //	library
@@ -93,6 +131,9 @@ typedef struct MYSQLLibrary
 
 	SQLConnection con;
 	
+	// members added later are appended here, so modules built against older structure still work
+	void						*(*LoadBind)( struct MYSQLLibrary *l, const FULONG *descr, const char *where, const FULONG *params, int *entries );
+	
 } MYSQLLibrary;
 
 // 
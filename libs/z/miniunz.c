@@ -659,9 +659,14 @@ int UnpackZip( const char *zipfilename, const char *dirname, const char *passwor
         }
         */
 		
+		// number of entries is stored in end of central directory, no need to walk archive
 		int count = 0;
+		unz_global_info64 gi;
 		
-		CountFilesInArchiveZip( zipfilename, password, &count );
+		if( unzGetGlobalInfo64( uf, &gi ) == UNZ_OK )
+		{
+			count = (int)gi.number_entry;
+		}
 
         if (filename_to_extract == NULL)
 		{
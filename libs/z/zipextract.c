@@ -0,0 +1,490 @@
+/*©lpgl*************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify         *
+* it under the terms of the GNU Lesser General Public License as published by  *
+* the Free Software Foundation, either version 3 of the License, or            *
+* (at your option) any later version.                                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* GNU Affero General Public License for more details.                          *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+*                                                                              *
+*****************************************************************************©*/
+
+/*
+
+	Parallel zip extraction to device
+
+	Central directory is read once, directories are created first and
+	then files are inflated by worker threads. Every worker has its own
+	archive handle and writes directly to destination device.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <util/log/log.h>
+#include <util/string.h>
+#include <system/handler/fsys.h>
+#include <system/systembase.h>
+#include "zipextract.h"
+
+/**
+ * Check if name from archive can be used as path
+ *
+ * @param name entry name
+ * @return TRUE when name is safe
+ */
+
+static FBOOL ZipExtractNameValid( const char *name )
+{
+	if( name[ 0 ] == 0 || name[ 0 ] == '/' || name[ 0 ] == '\\' || strchr( name, ':' ) != NULL )
+	{
+		return FALSE;
+	}
+
+	// entries cannot leave destination directory
+	const char *p = name;
+	while( *p != 0 )
+	{
+		if( p[ 0 ] == '.' && p[ 1 ] == '.' && ( p[ 2 ] == '/' || p[ 2 ] == '\\' || p[ 2 ] == 0 ) )
+		{
+			return FALSE;
+		}
+		while( *p != 0 && *p != '/' && *p != '\\' )
+		{
+			p++;
+		}
+		while( *p == '/' || *p == '\\' )
+		{
+			p++;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Create path on destination device
+ *
+ * @param ze pointer to ZipExtract
+ * @param name name inside archive
+ * @return new allocated string
+ */
+
+static char *ZipExtractPath( ZipExtract *ze, const char *name )
+{
+	int plen = strlen( ze->ze_Path );
+	char *dst = FCalloc( plen + strlen( name ) + 2, sizeof(char) );
+	if( dst != NULL )
+	{
+		strcpy( dst, ze->ze_Path );
+		if( plen > 0 && ze->ze_Path[ plen-1 ] != '/' && ze->ze_Path[ plen-1 ] != ':' )
+		{
+			strcat( dst, "/" );
+		}
+		strcat( dst, name );
+
+		char *p;
+		for( p = dst ; *p != 0 ; p++ )
+		{
+			if( *p == '\\' )
+			{
+				*p = '/';
+			}
+		}
+	}
+	return dst;
+}
+
+//
+// sort directories, parents are always before children
+//
+
+static int ZipExtractDirCompare( const void *a, const void *b )
+{
+	return strcmp( *(char * const *)a, *(char * const *)b );
+}
+
+/**
+ * Create all directories needed by archive entries
+ *
+ * @param ze pointer to ZipExtract
+ * @param dirs directories found in archive (entry names ending with '/')
+ * @param dirsCount number of directories
+ */
+
+static void ZipExtractMakeDirs( ZipExtract *ze, char **dirs, int dirsCount )
+{
+	FHandler *fh = ze->ze_Device->f_FSys;
+	int size = dirsCount + 16, count = 0;
+	char **all = FCalloc( size, sizeof(char *) );
+	int i;
+
+	if( all == NULL )
+	{
+		return;
+	}
+
+	// parents of files, some archives do not store directories at all
+	for( i = 0 ; i < dirsCount + ze->ze_EntriesCount ; i++ )
+	{
+		const char *name = i < dirsCount ? dirs[ i ] : ze->ze_Entries[ i - dirsCount ].zee_Name;
+		int len = strlen( name );
+		int j;
+
+		for( j = 1 ; j < len ; j++ )
+		{
+			if( name[ j ] != '/' && name[ j ] != '\\' )
+			{
+				continue;
+			}
+			if( count >= size )
+			{
+				char **tmp = FCalloc( size * 2, sizeof(char *) );
+				if( tmp == NULL )
+				{
+					break;
+				}
+				memcpy( tmp, all, count * sizeof(char *) );
+				FFree( all );
+				all = tmp;
+				size *= 2;
+			}
+			all[ count++ ] = StringDuplicateN( (char *)name, j );
+		}
+	}
+
+	qsort( all, count, sizeof(char *), ZipExtractDirCompare );
+
+	for( i = 0 ; i < count ; i++ )
+	{
+		if( all[ i ] != NULL && ( i == 0 || all[ i-1 ] == NULL || strcmp( all[ i ], all[ i-1 ] ) != 0 ) )
+		{
+			char *dst = ZipExtractPath( ze, all[ i ] );
+			if( dst != NULL )
+			{
+				fh->MakeDir( ze->ze_Device, dst );
+				FFree( dst );
+			}
+		}
+	}
+
+	for( i = 0 ; i < count ; i++ )
+	{
+		if( all[ i ] != NULL )
+		{
+			FFree( all[ i ] );
+		}
+	}
+	FFree( all );
+}
+
+/**
+ * Send progress to user
+ *
+ * @param ze pointer to ZipExtract
+ * @param name name of extracted file
+ */
+
+static void ZipExtractProgress( ZipExtract *ze, const char *name )
+{
+	if( ze->ze_Request == NULL )
+	{
+		return;
+	}
+
+	int per = 100;
+
+	pthread_mutex_lock( &ze->ze_Mutex );
+	ze->ze_Done++;
+	if( ze->ze_EntriesCount > 0 )
+	{
+		per = (int)( (FQUAD)ze->ze_Done * 100 / ze->ze_EntriesCount );
+	}
+	// one message per percent is enough
+	if( per == ze->ze_LastProgress )
+	{
+		pthread_mutex_unlock( &ze->ze_Mutex );
+		return;
+	}
+	ze->ze_LastProgress = per;
+	pthread_mutex_unlock( &ze->ze_Mutex );
+
+	SystemBase *sb = (SystemBase *)ze->ze_Request->h_SB;
+	char message[ 1024 ];
+	int size = snprintf( message, sizeof(message), "\"action\":\"decompress\",\"filename\":\"%.*s\",\"progress\":%d", 512, name, per );
+
+	sb->SendProcessMessage( ze->ze_Request, message, size );
+}
+
+/**
+ * Extract one entry to device
+ *
+ * @param ze pointer to ZipExtract
+ * @param uf archive handle
+ * @param entry entry which will be extracted
+ * @param buffer buffer used to read data
+ * @return 0 when success, otherwise error number
+ */
+
+static int ZipExtractEntryWrite( ZipExtract *ze, unzFile uf, ZipExtractEntry *entry, char *buffer )
+{
+	FHandler *fh = ze->ze_Device->f_FSys;
+	int err;
+
+	if( ( err = unzGoToFilePos64( uf, &entry->zee_Pos ) ) != UNZ_OK )
+	{
+		return err;
+	}
+	if( ( err = unzOpenCurrentFilePassword( uf, ze->ze_Password ) ) != UNZ_OK )
+	{
+		FERROR("[ZipExtract] Cannot open entry %s, error %d\n", entry->zee_Name, err );
+		return err;
+	}
+
+	char *dst = ZipExtractPath( ze, entry->zee_Name );
+	File *fp = NULL;
+	if( dst != NULL )
+	{
+		fp = (File *)fh->FileOpen( ze->ze_Device, dst, "wb" );
+	}
+
+	if( fp != NULL )
+	{
+		int len;
+		while( ( len = unzReadCurrentFile( uf, buffer, ZIP_EXTRACT_BUFFER_SIZE ) ) > 0 )
+		{
+			if( fh->FileWrite( fp, buffer, len ) != len )
+			{
+				FERROR("[ZipExtract] Cannot write %s\n", dst );
+				err = UNZ_ERRNO;
+				break;
+			}
+		}
+		if( len < 0 )
+		{
+			FERROR("[ZipExtract] Cannot read entry %s, error %d\n", entry->zee_Name, len );
+			err = len;
+		}
+		fh->FileClose( ze->ze_Device, fp );
+	}
+	else
+	{
+		FERROR("[ZipExtract] Cannot create file %s\n", dst != NULL ? dst : entry->zee_Name );
+		err = UNZ_ERRNO;
+	}
+
+	if( unzCloseCurrentFile( uf ) != UNZ_OK && err == UNZ_OK )
+	{
+		// CRC mismatch
+		err = UNZ_CRCERROR;
+	}
+
+	if( dst != NULL )
+	{
+		FFree( dst );
+	}
+
+	return err;
+}
+
+/**
+ * Worker thread
+ *
+ * @param data pointer to ZipExtract
+ */
+
+static void *ZipExtractWorker( void *data )
+{
+	ZipExtract *ze = (ZipExtract *)data;
+	unzFile uf = unzOpen64( ze->ze_ArchiveName );
+	char *buffer = FMalloc( ZIP_EXTRACT_BUFFER_SIZE );
+
+	if( uf != NULL && buffer != NULL )
+	{
+		while( TRUE )
+		{
+			int i = __sync_fetch_and_add( &ze->ze_Next, 1 );
+			if( i >= ze->ze_EntriesCount )
+			{
+				break;
+			}
+
+			if( ZipExtractEntryWrite( ze, uf, &ze->ze_Entries[ i ], buffer ) != UNZ_OK )
+			{
+				__sync_fetch_and_add( &ze->ze_Errors, 1 );
+			}
+
+			ZipExtractProgress( ze, ze->ze_Entries[ i ].zee_Name );
+		}
+	}
+	else
+	{
+		FERROR("[ZipExtract] Cannot open archive %s\n", ze->ze_ArchiveName );
+	}
+
+	if( buffer != NULL )
+	{
+		FFree( buffer );
+	}
+	if( uf != NULL )
+	{
+		unzClose( uf );
+	}
+	return NULL;
+}
+
+/**
+ * Unpack zip archive to device
+ *
+ * @param zipfilename path to local archive
+ * @param dev destination device
+ * @param path destination directory on device
+ * @param password archive password or NULL
+ * @param request http request used to report progress or NULL
+ * @param threads number of threads, 0 - default
+ * @return number of extracted files or -1 when error appear
+ */
+
+int UnpackZipToDevice( const char *zipfilename, File *dev, const char *path, const char *password, Http *request, int threads )
+{
+	unz_global_info64 gi;
+	ZipExtract ze;
+	char **dirs = NULL;
+	int dirsCount = 0;
+	int err;
+
+	unzFile uf = unzOpen64( zipfilename );
+	if( uf == NULL )
+	{
+		FERROR("[ZipExtract] Cannot open %s\n", zipfilename );
+		return -1;
+	}
+
+	if( unzGetGlobalInfo64( uf, &gi ) != UNZ_OK )
+	{
+		unzClose( uf );
+		return -1;
+	}
+
+	memset( &ze, 0, sizeof( ze ) );
+	ze.ze_ArchiveName = zipfilename;
+	ze.ze_Password = password;
+	ze.ze_Device = dev;
+	ze.ze_Path = path != NULL ? path : "";
+	ze.ze_Request = request;
+	ze.ze_LastProgress = -1;
+
+	// central directory is read only once, number of entries is known from end record
+
+	ze.ze_Entries = FCalloc( gi.number_entry + 1, sizeof( ZipExtractEntry ) );
+	dirs = FCalloc( gi.number_entry + 1, sizeof( char * ) );
+	if( ze.ze_Entries == NULL || dirs == NULL )
+	{
+		if( ze.ze_Entries != NULL ) FFree( ze.ze_Entries );
+		if( dirs != NULL ) FFree( dirs );
+		unzClose( uf );
+		return -1;
+	}
+
+	err = unzGoToFirstFile( uf );
+	while( err == UNZ_OK && (ZPOS64_T)( ze.ze_EntriesCount + dirsCount ) < gi.number_entry )
+	{
+		unz_file_info64 info;
+		char name[ 4096 ];
+
+		if( unzGetCurrentFileInfo64( uf, &info, name, sizeof( name ), NULL, 0, NULL, 0 ) == UNZ_OK )
+		{
+			int len = strlen( name );
+
+			if( ZipExtractNameValid( name ) == FALSE )
+			{
+				FERROR("[ZipExtract] Entry name not allowed: %s\n", name );
+			}
+			else if( name[ len-1 ] == '/' || name[ len-1 ] == '\\' )
+			{
+				dirs[ dirsCount++ ] = StringDuplicate( name );
+			}
+			else
+			{
+				ZipExtractEntry *entry = &ze.ze_Entries[ ze.ze_EntriesCount ];
+				if( unzGetFilePos64( uf, &entry->zee_Pos ) == UNZ_OK )
+				{
+					entry->zee_Name = StringDuplicate( name );
+					entry->zee_Size = info.uncompressed_size;
+					ze.ze_EntriesCount++;
+				}
+			}
+		}
+		err = unzGoToNextFile( uf );
+	}
+	unzClose( uf );
+
+	DEBUG("[ZipExtract] Archive %s, files %d directories %d\n", zipfilename, ze.ze_EntriesCount, dirsCount );
+
+	ZipExtractMakeDirs( &ze, dirs, dirsCount );
+
+	int i;
+	for( i = 0 ; i < dirsCount ; i++ )
+	{
+		FFree( dirs[ i ] );
+	}
+	FFree( dirs );
+
+	// extraction
+
+	pthread_mutex_init( &ze.ze_Mutex, NULL );
+
+	if( threads <= 0 )
+	{
+		threads = (int)sysconf( _SC_NPROCESSORS_ONLN );
+	}
+	if( threads > ZIP_EXTRACT_MAX_THREADS )
+	{
+		threads = ZIP_EXTRACT_MAX_THREADS;
+	}
+	if( threads > ze.ze_EntriesCount )
+	{
+		threads = ze.ze_EntriesCount;
+	}
+
+	pthread_t tids[ ZIP_EXTRACT_MAX_THREADS ];
+	int started = 0;
+	for( i = 1 ; i < threads ; i++ )
+	{
+		if( pthread_create( &tids[ started ], NULL, ZipExtractWorker, &ze ) == 0 )
+		{
+			started++;
+		}
+	}
+
+	// caller thread is also working
+	ZipExtractWorker( &ze );
+
+	for( i = 0 ; i < started ; i++ )
+	{
+		pthread_join( tids[ i ], NULL );
+	}
+
+	pthread_mutex_destroy( &ze.ze_Mutex );
+
+	int extracted = ze.ze_EntriesCount - ze.ze_Errors;
+
+	for( i = 0 ; i < ze.ze_EntriesCount ; i++ )
+	{
+		FFree( ze.ze_Entries[ i ].zee_Name );
+	}
+	FFree( ze.ze_Entries );
+
+	DEBUG("[ZipExtract] Extracted %d files, errors %d\n", extracted, ze.ze_Errors );
+
+	return extracted;
+}
@@ -0,0 +1,77 @@
+/*©lpgl*************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify         *
+* it under the terms of the GNU Lesser General Public License as published by  *
+* the Free Software Foundation, either version 3 of the License, or            *
+* (at your option) any later version.                                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* GNU Affero General Public License for more details.                          *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+*                                                                              *
+*****************************************************************************©*/
+
+/*
+
+	Parallel zip extraction to device
+
+*/
+
+#ifndef __Z_ZIPEXTRACT_H_
+#define __Z_ZIPEXTRACT_H_
+
+#include <core/types.h>
+#include <pthread.h>
+#include <network/http.h>
+#include <system/handler/file.h>
+#include "unzip.h"
+
+#define ZIP_EXTRACT_MAX_THREADS		4
+#define ZIP_EXTRACT_BUFFER_SIZE		262144
+
+//
+// Archive entry, taken from central directory
+//
+
+typedef struct ZipExtractEntry
+{
+	char							*zee_Name;
+	unz64_file_pos				zee_Pos;
+	FUQUAD						zee_Size;
+}ZipExtractEntry;
+
+//
+// Extraction job shared by workers
+//
+
+typedef struct ZipExtract
+{
+	const char					*ze_ArchiveName;		// local archive path
+	const char					*ze_Password;
+	File							*ze_Device;				// destination device
+	const char					*ze_Path;				// destination directory on device
+	Http							*ze_Request;			// used to report progress
+
+	ZipExtractEntry				*ze_Entries;
+	int							ze_EntriesCount;
+	int							ze_Next;				// next entry to extract
+	int							ze_Done;
+	int							ze_Errors;
+	int							ze_LastProgress;
+
+	pthread_mutex_t				ze_Mutex;
+}ZipExtract;
+
+//
+//
+//
+
+int UnpackZipToDevice( const char *zipfilename, File *dev, const char *path, const char *password, Http *request, int threads );
+
+#endif	// __Z_ZIPEXTRACT_H_
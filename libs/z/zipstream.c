@@ -0,0 +1,894 @@
+/*©lpgl*************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify         *
+* it under the terms of the GNU Lesser General Public License as published by  *
+* the Free Software Foundation, either version 3 of the License, or            *
+* (at your option) any later version.                                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* GNU Affero General Public License for more details.                          *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+*                                                                              *
+*****************************************************************************©*/
+
+/*
+
+	Streaming zip writer
+
+	Small files are read and compressed by worker threads, results are
+	written in the same order in which they were added. Big files are
+	compressed by caller thread and use data descriptors, so they never
+	have to be kept in memory.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <util/log/log.h>
+#include <util/string.h>
+#include <system/handler/fsys.h>
+#include "zipstream.h"
+
+#define ZIP_LOCAL_HEADER_SIG			0x04034b50
+#define ZIP_CENTRAL_HEADER_SIG		0x02014b50
+#define ZIP_DESCRIPTOR_SIG			0x08074b50
+#define ZIP_END_SIG					0x06054b50
+#define ZIP64_END_SIG					0x06064b50
+#define ZIP64_LOCATOR_SIG				0x07064b50
+
+#define ZIP_FLAG_DESCRIPTOR			0x0008
+#define ZIP_FLAG_UTF8					0x0800
+
+#define ZIP_VERSION_DEFAULT			20
+#define ZIP_VERSION_ZIP64				45
+#define ZIP_VERSION_MADE_BY			( ( 3 << 8 ) | ZIP_VERSION_ZIP64 )		// unix
+
+#define ZIP_METHOD_STORE				0
+#define ZIP_METHOD_DEFLATE			8
+
+#define ZIP_32BIT_MAX					0xffffffffULL
+
+//
+// extensions of files which are already compressed
+//
+
+static const char *ZipStreamStoredExtensions[] = {
+	"jpg", "jpeg", "png", "gif", "webp", "heic",
+	"mp3", "mp4", "m4a", "m4v", "aac", "ogg", "ogv", "oga", "flac", "opus", "mkv", "avi", "mov", "webm",
+	"zip", "gz", "tgz", "bz2", "xz", "7z", "rar", "lz", "zst",
+	"docx", "xlsx", "pptx", "odt", "ods", "odp", "jar", "apk", "epub",
+	NULL
+};
+
+//
+// write little endian values
+//
+
+static inline char *ZipPut16( char *p, unsigned int v )
+{
+	p[ 0 ] = v & 0xff; p[ 1 ] = ( v >> 8 ) & 0xff;
+	return p + 2;
+}
+
+static inline char *ZipPut32( char *p, FULONG v )
+{
+	p[ 0 ] = v & 0xff; p[ 1 ] = ( v >> 8 ) & 0xff; p[ 2 ] = ( v >> 16 ) & 0xff; p[ 3 ] = ( v >> 24 ) & 0xff;
+	return p + 4;
+}
+
+static inline char *ZipPut64( char *p, FUQUAD v )
+{
+	p = ZipPut32( p, (FULONG)( v & 0xffffffff ) );
+	return ZipPut32( p, (FULONG)( v >> 32 ) );
+}
+
+/**
+ * Check if file should be stored without compression
+ *
+ * @param name file name
+ * @return TRUE when file is already compressed
+ */
+
+static FBOOL ZipStreamIsCompressed( const char *name )
+{
+	const char *ext = strrchr( name, '.' );
+	if( ext == NULL )
+	{
+		return FALSE;
+	}
+	ext++;
+
+	int i;
+	for( i = 0 ; ZipStreamStoredExtensions[ i ] != NULL ; i++ )
+	{
+		if( strcasecmp( ext, ZipStreamStoredExtensions[ i ] ) == 0 )
+		{
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * Convert time to MSDOS format
+ *
+ * @param t time
+ * @param dtime pointer where time will be stored
+ * @param ddate pointer where date will be stored
+ */
+
+static void ZipStreamDosTime( time_t t, unsigned int *dtime, unsigned int *ddate )
+{
+	struct tm tm;
+
+	localtime_r( &t, &tm );
+	if( tm.tm_year < 80 )
+	{
+		*dtime = 0;
+		*ddate = ( 1 << 5 ) | 1;		// 1980-01-01
+		return;
+	}
+	*dtime = ( tm.tm_hour << 11 ) | ( tm.tm_min << 5 ) | ( tm.tm_sec >> 1 );
+	*ddate = ( ( tm.tm_year - 80 ) << 9 ) | ( ( tm.tm_mon + 1 ) << 5 ) | tm.tm_mday;
+}
+
+/**
+ * Flush output buffer
+ *
+ * @param zs pointer to ZipStream
+ * @return 0 when success, otherwise error number
+ */
+
+static int ZipStreamFlush( ZipStream *zs )
+{
+	if( zs->zs_BufferSize > 0 && zs->zs_Error == 0 )
+	{
+		if( zs->zs_Write( zs->zs_WriteData, zs->zs_Buffer, zs->zs_BufferSize ) < 0 )
+		{
+			FERROR("[ZipStream] Cannot write data\n");
+			zs->zs_Error = 1;
+		}
+	}
+	zs->zs_BufferSize = 0;
+	return zs->zs_Error;
+}
+
+/**
+ * Add data to archive
+ *
+ * @param zs pointer to ZipStream
+ * @param data pointer to data
+ * @param size size of data
+ * @return 0 when success, otherwise error number
+ */
+
+static int ZipStreamOutput( ZipStream *zs, const char *data, FQUAD size )
+{
+	zs->zs_Offset += size;
+
+	while( size > 0 && zs->zs_Error == 0 )
+	{
+		int space = ZIP_STREAM_BUFFER_SIZE - zs->zs_BufferSize;
+		int len = size > space ? space : (int)size;
+
+		memcpy( zs->zs_Buffer + zs->zs_BufferSize, data, len );
+		zs->zs_BufferSize += len;
+		data += len;
+		size -= len;
+
+		if( zs->zs_BufferSize >= ZIP_STREAM_BUFFER_SIZE )
+		{
+			ZipStreamFlush( zs );
+		}
+	}
+	return zs->zs_Error;
+}
+
+/**
+ * Write local file header
+ *
+ * @param zs pointer to ZipStream
+ * @param name name of entry
+ * @param mtime modification time
+ * @param method compression method
+ * @param flags additional flags
+ * @param crc crc32 (0 when data descriptor is used)
+ * @param csize compressed size (0 when data descriptor is used)
+ * @param usize uncompressed size (0 when data descriptor is used)
+ * @param zip64 TRUE when local header must contain zip64 extra field
+ * @return offset of local header
+ */
+
+static FQUAD ZipStreamLocalHeader( ZipStream *zs, const char *name, time_t mtime, int method, int flags, FULONG crc, FQUAD csize, FQUAD usize, FBOOL zip64 )
+{
+	char header[ 30 + 20 ];
+	char *p = header;
+	unsigned int dtime, ddate;
+	int nameLen = strlen( name );
+	FQUAD offset = zs->zs_Offset;
+
+	ZipStreamDosTime( mtime, &dtime, &ddate );
+
+	p = ZipPut32( p, ZIP_LOCAL_HEADER_SIG );
+	p = ZipPut16( p, zip64 ? ZIP_VERSION_ZIP64 : ZIP_VERSION_DEFAULT );
+	p = ZipPut16( p, flags | ZIP_FLAG_UTF8 );
+	p = ZipPut16( p, method );
+	p = ZipPut16( p, dtime );
+	p = ZipPut16( p, ddate );
+	p = ZipPut32( p, crc );
+	p = ZipPut32( p, zip64 ? ZIP_32BIT_MAX : (FULONG)csize );
+	p = ZipPut32( p, zip64 ? ZIP_32BIT_MAX : (FULONG)usize );
+	p = ZipPut16( p, nameLen );
+	p = ZipPut16( p, zip64 ? 20 : 0 );
+
+	ZipStreamOutput( zs, header, 30 );
+	ZipStreamOutput( zs, name, nameLen );
+
+	if( zip64 )
+	{
+		p = header;
+		p = ZipPut16( p, 0x0001 );
+		p = ZipPut16( p, 16 );
+		p = ZipPut64( p, usize );
+		p = ZipPut64( p, csize );
+		ZipStreamOutput( zs, header, 20 );
+	}
+
+	return offset;
+}
+
+/**
+ * Add entry to central directory
+ *
+ * @param zs pointer to ZipStream
+ * @param name name of entry
+ * @param mtime modification time
+ * @param method compression method
+ * @param flags flags used in local header
+ * @param crc crc32
+ * @param csize compressed size
+ * @param usize uncompressed size
+ * @param offset offset of local header
+ * @param dir TRUE when entry is directory
+ */
+
+static void ZipStreamCentralEntry( ZipStream *zs, const char *name, time_t mtime, int method, int flags, FULONG crc, FQUAD csize, FQUAD usize, FQUAD offset, FBOOL dir )
+{
+	char header[ 46 + 28 ];
+	char *p = header;
+	unsigned int dtime, ddate;
+	int nameLen = strlen( name );
+	FBOOL zip64 = ( (FUQUAD)csize >= ZIP_32BIT_MAX || (FUQUAD)usize >= ZIP_32BIT_MAX || (FUQUAD)offset >= ZIP_32BIT_MAX );
+	FULONG attr = dir ? ( ( 040755UL << 16 ) | 0x10 ) : ( 0100644UL << 16 );
+
+	ZipStreamDosTime( mtime, &dtime, &ddate );
+
+	p = ZipPut32( p, ZIP_CENTRAL_HEADER_SIG );
+	p = ZipPut16( p, ZIP_VERSION_MADE_BY );
+	p = ZipPut16( p, zip64 ? ZIP_VERSION_ZIP64 : ZIP_VERSION_DEFAULT );
+	p = ZipPut16( p, flags | ZIP_FLAG_UTF8 );
+	p = ZipPut16( p, method );
+	p = ZipPut16( p, dtime );
+	p = ZipPut16( p, ddate );
+	p = ZipPut32( p, crc );
+	p = ZipPut32( p, zip64 ? ZIP_32BIT_MAX : (FULONG)csize );
+	p = ZipPut32( p, zip64 ? ZIP_32BIT_MAX : (FULONG)usize );
+	p = ZipPut16( p, nameLen );
+	p = ZipPut16( p, zip64 ? 28 : 0 );
+	p = ZipPut16( p, 0 );			// comment
+	p = ZipPut16( p, 0 );			// disk
+	p = ZipPut16( p, 0 );			// internal attributes
+	p = ZipPut32( p, attr );
+	p = ZipPut32( p, zip64 ? ZIP_32BIT_MAX : (FULONG)offset );
+
+	BufStringAddSize( zs->zs_Central, header, 46 );
+	BufStringAddSize( zs->zs_Central, name, nameLen );
+
+	if( zip64 )
+	{
+		p = header;
+		p = ZipPut16( p, 0x0001 );
+		p = ZipPut16( p, 24 );
+		p = ZipPut64( p, usize );
+		p = ZipPut64( p, csize );
+		p = ZipPut64( p, offset );
+		BufStringAddSize( zs->zs_Central, header, 28 );
+	}
+
+	zs->zs_Entries++;
+}
+
+/**
+ * Read and compress file in memory
+ *
+ * @param job entry which will be compressed
+ */
+
+static void ZipStreamJobCompress( ZipStreamJob *job )
+{
+	FHandler *fh = job->zsj_Device->f_FSys;
+	File *fp = (File *)fh->FileOpen( job->zsj_Device, job->zsj_Path, "rb" );
+	if( fp == NULL )
+	{
+		FERROR("[ZipStream] Cannot open file %s\n", job->zsj_Path );
+		job->zsj_Error = 1;
+		return;
+	}
+
+	BufString *bs = BufStringNewSize( job->zsj_Size > 0 ? job->zsj_Size + 1 : ZIP_STREAM_BUFFER_SIZE );
+	if( bs != NULL )
+	{
+		char *buffer = FMalloc( ZIP_STREAM_BUFFER_SIZE );
+		if( buffer != NULL )
+		{
+			int len;
+			while( ( len = fh->FileRead( fp, buffer, ZIP_STREAM_BUFFER_SIZE ) ) > 0 )
+			{
+				BufStringAddSize( bs, buffer, len );
+			}
+			FFree( buffer );
+		}
+	}
+	fh->FileClose( job->zsj_Device, fp );
+
+	if( bs == NULL )
+	{
+		job->zsj_Error = 1;
+		return;
+	}
+
+	job->zsj_Size = bs->bs_Size;
+	job->zsj_CRC = crc32( 0L, (const Bytef *)bs->bs_Buffer, bs->bs_Size );
+	job->zsj_Method = ZIP_METHOD_STORE;
+
+	if( bs->bs_Size > 0 && ZipStreamIsCompressed( job->zsj_Name ) == FALSE )
+	{
+		z_stream z;
+		memset( &z, 0, sizeof( z ) );
+
+		if( deflateInit2( &z, ZIP_STREAM_LEVEL, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) == Z_OK )
+		{
+			uLong bound = deflateBound( &z, bs->bs_Size );
+			char *out = FMalloc( bound );
+			if( out != NULL )
+			{
+				z.next_in = (Bytef *)bs->bs_Buffer;
+				z.avail_in = bs->bs_Size;
+				z.next_out = (Bytef *)out;
+				z.avail_out = bound;
+
+				// compressed data is used only when it is really smaller
+				if( deflate( &z, Z_FINISH ) == Z_STREAM_END && z.total_out < bs->bs_Size )
+				{
+					job->zsj_Method = ZIP_METHOD_DEFLATE;
+					job->zsj_Data = out;
+					job->zsj_DataSize = z.total_out;
+				}
+				else
+				{
+					FFree( out );
+				}
+			}
+			deflateEnd( &z );
+		}
+	}
+
+	if( job->zsj_Method == ZIP_METHOD_STORE )
+	{
+		// take buffer from BufString, no copy needed
+		job->zsj_Data = bs->bs_Buffer;
+		job->zsj_DataSize = bs->bs_Size;
+		bs->bs_Buffer = NULL;
+	}
+
+	BufStringDelete( bs );
+}
+
+/**
+ * Worker thread
+ *
+ * @param data pointer to ZipStream
+ */
+
+static void *ZipStreamWorker( void *data )
+{
+	ZipStream *zs = (ZipStream *)data;
+
+	pthread_mutex_lock( &zs->zs_Mutex );
+	while( zs->zs_Quit == FALSE )
+	{
+		ZipStreamJob *job = zs->zs_Jobs;
+		while( job != NULL && job->zsj_State != ZIP_STREAM_JOB_WAITING )
+		{
+			job = job->zsj_Next;
+		}
+
+		if( job == NULL )
+		{
+			pthread_cond_wait( &zs->zs_Cond, &zs->zs_Mutex );
+			continue;
+		}
+
+		job->zsj_State = ZIP_STREAM_JOB_RUNNING;
+		pthread_mutex_unlock( &zs->zs_Mutex );
+
+		ZipStreamJobCompress( job );
+
+		pthread_mutex_lock( &zs->zs_Mutex );
+		job->zsj_State = ZIP_STREAM_JOB_DONE;
+		pthread_cond_broadcast( &zs->zs_Cond );
+	}
+	pthread_mutex_unlock( &zs->zs_Mutex );
+
+	return NULL;
+}
+
+/**
+ * Release job
+ *
+ * @param job pointer to job
+ */
+
+static void ZipStreamJobDelete( ZipStreamJob *job )
+{
+	if( job->zsj_Name != NULL )
+	{
+		FFree( job->zsj_Name );
+	}
+	if( job->zsj_Path != NULL )
+	{
+		FFree( job->zsj_Path );
+	}
+	if( job->zsj_Data != NULL )
+	{
+		FFree( job->zsj_Data );
+	}
+	FFree( job );
+}
+
+/**
+ * Wait for first job in queue and write it to archive
+ *
+ * @param zs pointer to ZipStream
+ * @return 0 when success, otherwise error number
+ */
+
+static int ZipStreamWriteFirstJob( ZipStream *zs )
+{
+	pthread_mutex_lock( &zs->zs_Mutex );
+	ZipStreamJob *job = zs->zs_Jobs;
+	if( job == NULL )
+	{
+		pthread_mutex_unlock( &zs->zs_Mutex );
+		return zs->zs_Error;
+	}
+	while( job->zsj_State != ZIP_STREAM_JOB_DONE )
+	{
+		pthread_cond_wait( &zs->zs_Cond, &zs->zs_Mutex );
+	}
+	zs->zs_Jobs = job->zsj_Next;
+	if( zs->zs_Jobs == NULL )
+	{
+		zs->zs_JobsTail = NULL;
+	}
+	zs->zs_JobsCount--;
+	pthread_mutex_unlock( &zs->zs_Mutex );
+
+	// files which cannot be read are skipped, archive is still valid
+	if( job->zsj_Error == 0 && zs->zs_Error == 0 )
+	{
+		FQUAD offset = ZipStreamLocalHeader( zs, job->zsj_Name, job->zsj_ModTime, job->zsj_Method, 0, job->zsj_CRC, job->zsj_DataSize, job->zsj_Size, FALSE );
+		ZipStreamOutput( zs, job->zsj_Data, job->zsj_DataSize );
+		ZipStreamCentralEntry( zs, job->zsj_Name, job->zsj_ModTime, job->zsj_Method, 0, job->zsj_CRC, job->zsj_DataSize, job->zsj_Size, offset, FALSE );
+	}
+
+	ZipStreamJobDelete( job );
+
+	return zs->zs_Error;
+}
+
+/**
+ * Write all queued jobs
+ *
+ * @param zs pointer to ZipStream
+ * @return 0 when success, otherwise error number
+ */
+
+static int ZipStreamWriteJobs( ZipStream *zs )
+{
+	while( zs->zs_Jobs != NULL )
+	{
+		ZipStreamWriteFirstJob( zs );
+	}
+	return zs->zs_Error;
+}
+
+/**
+ * Compress file in caller thread and write it directly to archive
+ *
+ * @param zs pointer to ZipStream
+ * @param dev device from which file will be read
+ * @param path path to file on device
+ * @param name name inside archive
+ * @param size expected file size
+ * @param mtime modification time
+ * @return 0 when success, otherwise error number
+ */
+
+static int ZipStreamWriteFile( ZipStream *zs, File *dev, const char *path, const char *name, FQUAD size, time_t mtime )
+{
+	FHandler *fh = dev->f_FSys;
+	File *fp = (File *)fh->FileOpen( dev, path, "rb" );
+	if( fp == NULL )
+	{
+		FERROR("[ZipStream] Cannot open file %s\n", path );
+		return 0;
+	}
+
+	int method = ZipStreamIsCompressed( name ) ? ZIP_METHOD_STORE : ZIP_METHOD_DEFLATE;
+	FBOOL zip64 = ( size < 0 || (FUQUAD)size >= ( ZIP_32BIT_MAX - ZIP_STREAM_BUFFER_SIZE ) );
+	char *in = FMalloc( ZIP_STREAM_BUFFER_SIZE );
+	char *out = FMalloc( ZIP_STREAM_BUFFER_SIZE );
+	z_stream z;
+	FULONG crc = crc32( 0L, Z_NULL, 0 );
+	FQUAD usize = 0, csize = 0;
+
+	memset( &z, 0, sizeof( z ) );
+	if( in == NULL || out == NULL || ( method == ZIP_METHOD_DEFLATE && deflateInit2( &z, ZIP_STREAM_LEVEL, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) )
+	{
+		if( in != NULL ) FFree( in );
+		if( out != NULL ) FFree( out );
+		fh->FileClose( dev, fp );
+		return ( zs->zs_Error = 1 );
+	}
+
+	FQUAD offset = ZipStreamLocalHeader( zs, name, mtime, method, ZIP_FLAG_DESCRIPTOR, 0, 0, 0, zip64 );
+
+	int len;
+	int flush = Z_NO_FLUSH;
+	while( zs->zs_Error == 0 )
+	{
+		len = fh->FileRead( fp, in, ZIP_STREAM_BUFFER_SIZE );
+		if( len <= 0 )
+		{
+			len = 0;
+			flush = Z_FINISH;
+		}
+
+		crc = crc32( crc, (const Bytef *)in, len );
+		usize += len;
+
+		if( method == ZIP_METHOD_STORE )
+		{
+			ZipStreamOutput( zs, in, len );
+			csize += len;
+		}
+		else
+		{
+			z.next_in = (Bytef *)in;
+			z.avail_in = len;
+			do
+			{
+				z.next_out = (Bytef *)out;
+				z.avail_out = ZIP_STREAM_BUFFER_SIZE;
+				deflate( &z, flush );
+				int have = ZIP_STREAM_BUFFER_SIZE - z.avail_out;
+				ZipStreamOutput( zs, out, have );
+				csize += have;
+			}
+			while( z.avail_out == 0 && zs->zs_Error == 0 );
+		}
+
+		if( flush == Z_FINISH )
+		{
+			break;
+		}
+	}
+
+	if( method == ZIP_METHOD_DEFLATE )
+	{
+		deflateEnd( &z );
+	}
+	fh->FileClose( dev, fp );
+	FFree( in );
+	FFree( out );
+
+	if( zip64 == FALSE && ( (FUQUAD)usize >= ZIP_32BIT_MAX || (FUQUAD)csize >= ZIP_32BIT_MAX ) )
+	{
+		FERROR("[ZipStream] File %s grew over 4GB while archive was created\n", path );
+		zs->zs_Error = 1;
+	}
+
+	// data descriptor
+
+	char desc[ 24 ];
+	char *p = desc;
+	p = ZipPut32( p, ZIP_DESCRIPTOR_SIG );
+	p = ZipPut32( p, crc );
+	if( zip64 )
+	{
+		p = ZipPut64( p, csize );
+		p = ZipPut64( p, usize );
+	}
+	else
+	{
+		p = ZipPut32( p, (FULONG)csize );
+		p = ZipPut32( p, (FULONG)usize );
+	}
+	ZipStreamOutput( zs, desc, p - desc );
+
+	ZipStreamCentralEntry( zs, name, mtime, method, ZIP_FLAG_DESCRIPTOR, crc, csize, usize, offset, FALSE );
+
+	return zs->zs_Error;
+}
+
+/**
+ * Create new streaming zip writer
+ *
+ * @param wfunc function which will receive archive data
+ * @param wdata data passed to wfunc
+ * @param threads number of compression threads, 0 - number of CPUs
+ * @return new ZipStream structure when success, otherwise NULL
+ */
+
+ZipStream *ZipStreamNew( ZipStreamWriteFunc wfunc, void *wdata, int threads )
+{
+	ZipStream *zs;
+
+	if( ( zs = FCalloc( 1, sizeof( ZipStream ) ) ) == NULL )
+	{
+		return NULL;
+	}
+
+	zs->zs_Write = wfunc;
+	zs->zs_WriteData = wdata;
+	zs->zs_Buffer = FMalloc( ZIP_STREAM_BUFFER_SIZE );
+	zs->zs_Central = BufStringNew();
+	if( zs->zs_Buffer == NULL || zs->zs_Central == NULL )
+	{
+		ZipStreamDelete( zs );
+		return NULL;
+	}
+
+	pthread_mutex_init( &zs->zs_Mutex, NULL );
+	pthread_cond_init( &zs->zs_Cond, NULL );
+
+	if( threads <= 0 )
+	{
+		threads = (int)sysconf( _SC_NPROCESSORS_ONLN );
+	}
+	if( threads > ZIP_STREAM_MAX_THREADS )
+	{
+		threads = ZIP_STREAM_MAX_THREADS;
+	}
+
+	int i;
+	for( i = 0 ; i < threads ; i++ )
+	{
+		if( pthread_create( &zs->zs_Threads[ zs->zs_ThreadsCount ], NULL, ZipStreamWorker, zs ) == 0 )
+		{
+			zs->zs_ThreadsCount++;
+		}
+	}
+
+	DEBUG("[ZipStream] New archive stream, compression threads %d\n", zs->zs_ThreadsCount );
+
+	return zs;
+}
+
+/**
+ * Delete streaming zip writer
+ *
+ * @param zs pointer to ZipStream
+ */
+
+void ZipStreamDelete( ZipStream *zs )
+{
+	if( zs == NULL )
+	{
+		return;
+	}
+
+	if( zs->zs_Buffer != NULL && zs->zs_Central != NULL )
+	{
+		pthread_mutex_lock( &zs->zs_Mutex );
+		zs->zs_Quit = TRUE;
+		pthread_cond_broadcast( &zs->zs_Cond );
+		pthread_mutex_unlock( &zs->zs_Mutex );
+
+		int i;
+		for( i = 0 ; i < zs->zs_ThreadsCount ; i++ )
+		{
+			pthread_join( zs->zs_Threads[ i ], NULL );
+		}
+
+		while( zs->zs_Jobs != NULL )
+		{
+			ZipStreamJob *job = zs->zs_Jobs;
+			zs->zs_Jobs = job->zsj_Next;
+			ZipStreamJobDelete( job );
+		}
+
+		pthread_cond_destroy( &zs->zs_Cond );
+		pthread_mutex_destroy( &zs->zs_Mutex );
+	}
+
+	if( zs->zs_Central != NULL )
+	{
+		BufStringDelete( zs->zs_Central );
+	}
+	if( zs->zs_Buffer != NULL )
+	{
+		FFree( zs->zs_Buffer );
+	}
+	FFree( zs );
+}
+
+/**
+ * Add directory entry to archive
+ *
+ * @param zs pointer to ZipStream
+ * @param name name of directory inside archive (must end with '/')
+ * @param mtime modification time
+ * @return 0 when success, otherwise error number
+ */
+
+int ZipStreamAddDirectory( ZipStream *zs, const char *name, time_t mtime )
+{
+	if( ZipStreamWriteJobs( zs ) != 0 )
+	{
+		return zs->zs_Error;
+	}
+
+	FQUAD offset = ZipStreamLocalHeader( zs, name, mtime, ZIP_METHOD_STORE, 0, 0, 0, 0, FALSE );
+	ZipStreamCentralEntry( zs, name, mtime, ZIP_METHOD_STORE, 0, 0, 0, 0, offset, TRUE );
+
+	return zs->zs_Error;
+}
+
+/**
+ * Add file to archive
+ *
+ * @param zs pointer to ZipStream
+ * @param dev device from which file will be read
+ * @param path path to file on device
+ * @param name name inside archive
+ * @param size file size or -1 when not known
+ * @param mtime modification time
+ * @return 0 when success, otherwise error number
+ */
+
+int ZipStreamAddFile( ZipStream *zs, File *dev, const char *path, const char *name, FQUAD size, time_t mtime )
+{
+	if( zs->zs_Error != 0 )
+	{
+		return zs->zs_Error;
+	}
+
+	// big files are streamed, order of entries must be kept
+	if( zs->zs_ThreadsCount == 0 || size < 0 || size > ZIP_STREAM_PARALLEL_MAX )
+	{
+		if( ZipStreamWriteJobs( zs ) != 0 )
+		{
+			return zs->zs_Error;
+		}
+		return ZipStreamWriteFile( zs, dev, path, name, size, mtime );
+	}
+
+	// do not keep too many compressed files in memory
+	while( zs->zs_JobsCount >= zs->zs_ThreadsCount * ZIP_STREAM_MAX_PENDING )
+	{
+		if( ZipStreamWriteFirstJob( zs ) != 0 )
+		{
+			return zs->zs_Error;
+		}
+	}
+
+	ZipStreamJob *job = FCalloc( 1, sizeof( ZipStreamJob ) );
+	if( job == NULL )
+	{
+		return ( zs->zs_Error = 1 );
+	}
+	job->zsj_Name = StringDuplicate( name );
+	job->zsj_Path = StringDuplicate( path );
+	job->zsj_Device = dev;
+	job->zsj_ModTime = mtime;
+	job->zsj_Size = size;
+
+	pthread_mutex_lock( &zs->zs_Mutex );
+	if( zs->zs_JobsTail != NULL )
+	{
+		zs->zs_JobsTail->zsj_Next = job;
+	}
+	else
+	{
+		zs->zs_Jobs = job;
+	}
+	zs->zs_JobsTail = job;
+	zs->zs_JobsCount++;
+	pthread_cond_broadcast( &zs->zs_Cond );
+	pthread_mutex_unlock( &zs->zs_Mutex );
+
+	return 0;
+}
+
+/**
+ * Write remaining entries and central directory
+ *
+ * @param zs pointer to ZipStream
+ * @return 0 when success, otherwise error number
+ */
+
+int ZipStreamFinish( ZipStream *zs )
+{
+	if( ZipStreamWriteJobs( zs ) != 0 )
+	{
+		return zs->zs_Error;
+	}
+
+	FQUAD cdOffset = zs->zs_Offset;
+	FQUAD cdSize = zs->zs_Central->bs_Size;
+
+	ZipStreamOutput( zs, zs->zs_Central->bs_Buffer, cdSize );
+
+	char end[ 56 + 20 + 22 ];
+	char *p = end;
+
+	if( zs->zs_Entries >= 0xffff || (FUQUAD)cdOffset >= ZIP_32BIT_MAX || (FUQUAD)cdSize >= ZIP_32BIT_MAX )
+	{
+		FQUAD endOffset = zs->zs_Offset;
+
+		p = ZipPut32( p, ZIP64_END_SIG );
+		p = ZipPut64( p, 44 );
+		p = ZipPut16( p, ZIP_VERSION_MADE_BY );
+		p = ZipPut16( p, ZIP_VERSION_ZIP64 );
+		p = ZipPut32( p, 0 );
+		p = ZipPut32( p, 0 );
+		p = ZipPut64( p, zs->zs_Entries );
+		p = ZipPut64( p, zs->zs_Entries );
+		p = ZipPut64( p, cdSize );
+		p = ZipPut64( p, cdOffset );
+
+		p = ZipPut32( p, ZIP64_LOCATOR_SIG );
+		p = ZipPut32( p, 0 );
+		p = ZipPut64( p, endOffset );
+		p = ZipPut32( p, 1 );
+
+		p = ZipPut32( p, ZIP_END_SIG );
+		p = ZipPut16( p, 0 );
+		p = ZipPut16( p, 0 );
+		p = ZipPut16( p, 0xffff );
+		p = ZipPut16( p, 0xffff );
+		p = ZipPut32( p, ZIP_32BIT_MAX );
+		p = ZipPut32( p, ZIP_32BIT_MAX );
+		p = ZipPut16( p, 0 );
+	}
+	else
+	{
+		p = ZipPut32( p, ZIP_END_SIG );
+		p = ZipPut16( p, 0 );
+		p = ZipPut16( p, 0 );
+		p = ZipPut16( p, (unsigned int)zs->zs_Entries );
+		p = ZipPut16( p, (unsigned int)zs->zs_Entries );
+		p = ZipPut32( p, (FULONG)cdSize );
+		p = ZipPut32( p, (FULONG)cdOffset );
+		p = ZipPut16( p, 0 );
+	}
+
+	ZipStreamOutput( zs, end, p - end );
+	ZipStreamFlush( zs );
+
+	DEBUG("[ZipStream] Archive finished, entries %lld size %lld\n", (long long)zs->zs_Entries, (long long)zs->zs_Offset );
+
+	return zs->zs_Error;
+}
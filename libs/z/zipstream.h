@@ -0,0 +1,138 @@
+/*©lpgl*************************************************************************
+*                                                                              *
+* This file is part of FRIEND UNIFYING PLATFORM.                               *
+*                                                                              *
+* This program is free software: you can redistribute it and/or modify         *
+* it under the terms of the GNU Lesser General Public License as published by  *
+* the Free Software Foundation, either version 3 of the License, or            *
+* (at your option) any later version.                                          *
+*                                                                              *
+* This program is distributed in the hope that it will be useful,              *
+* but WITHOUT ANY WARRANTY; without even the implied warranty of               *
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the                 *
+* GNU Affero General Public License for more details.                          *
+*                                                                              *
+* You should have received a copy of the GNU Lesser General Public License     *
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.        *
+*                                                                              *
+*****************************************************************************©*/
+
+/*
+
+	Streaming zip writer
+
+	Archive is produced sequentially (local headers, data, central directory)
+	and passed to write callback, nothing is stored on disk.
+
+*/
+
+#ifndef __Z_ZIPSTREAM_H_
+#define __Z_ZIPSTREAM_H_
+
+#include <core/types.h>
+#include <pthread.h>
+#include <time.h>
+#include <util/buffered_string.h>
+#include <system/handler/file.h>
+
+#define ZIP_STREAM_MAX_THREADS			8
+#define ZIP_STREAM_PARALLEL_MAX		(4*1024*1024)		// bigger files are compressed by caller thread
+#define ZIP_STREAM_MAX_PENDING			4					// entries waiting to be written per worker
+#define ZIP_STREAM_BUFFER_SIZE			65536
+#define ZIP_STREAM_LEVEL				6
+
+//
+// write callback, returns number of bytes written or < 0 on error
+//
+
+typedef int (*ZipStreamWriteFunc)( void *data, const char *buffer, int size );
+
+//
+// entry states
+//
+
+enum {
+	ZIP_STREAM_JOB_WAITING = 0,
+	ZIP_STREAM_JOB_RUNNING,
+	ZIP_STREAM_JOB_DONE
+};
+
+//
+// Entry compressed by worker
+//
+
+typedef struct ZipStreamJob
+{
+	char							*zsj_Name;			// name inside archive
+	char							*zsj_Path;			// path on device
+	File							*zsj_Device;
+	time_t						zsj_ModTime;
+	int							zsj_State;
+	int							zsj_Error;
+	int							zsj_Method;			// 0 - stored, 8 - deflated
+	FULONG						zsj_CRC;
+	FQUAD						zsj_Size;			// uncompressed size
+	char							*zsj_Data;			// compressed (or stored) data
+	FQUAD						zsj_DataSize;
+	struct ZipStreamJob		*zsj_Next;
+}ZipStreamJob;
+
+//
+// Streaming zip writer
+//
+
+typedef struct ZipStream
+{
+	ZipStreamWriteFunc			zs_Write;
+	void							*zs_WriteData;
+
+	char							*zs_Buffer;			// output buffer
+	int							zs_BufferSize;
+
+	FQUAD						zs_Offset;			// bytes written so far
+	FQUAD						zs_Entries;
+	BufString					*zs_Central;			// central directory
+	int							zs_Error;
+
+	pthread_mutex_t				zs_Mutex;
+	pthread_cond_t				zs_Cond;
+	ZipStreamJob					*zs_Jobs;			// jobs in archive order
+	ZipStreamJob					*zs_JobsTail;
+	int							zs_JobsCount;
+
+	pthread_t					zs_Threads[ ZIP_STREAM_MAX_THREADS ];
+	int							zs_ThreadsCount;
+	FBOOL						zs_Quit;
+}ZipStream;
+
+//
+//
+//
+
+ZipStream *ZipStreamNew( ZipStreamWriteFunc wfunc, void *wdata, int threads );
+
+//
+//
+//
+
+void ZipStreamDelete( ZipStream *zs );
+
+//
+//
+//
+
+int ZipStreamAddDirectory( ZipStream *zs, const char *name, time_t mtime );
+
+//
+//
+//
+
+int ZipStreamAddFile( ZipStream *zs, File *dev, const char *path, const char *name, FQUAD size, time_t mtime );
+
+//
+//
+//
+
+int ZipStreamFinish( ZipStream *zs );
+
+#endif	// __Z_ZIPSTREAM_H_
@@ -88,6 +88,20 @@ int Unpack( struct ZLibrary *l, const char *name, const char *dir, const char *p
 	return UnpackZip( name, dir, pass, request );
 }
 
+//
+// unpack archive directly to device, files are extracted in parallel
+//
+
+int UnpackToDevice( struct ZLibrary *l, const char *name, File *dev, const char *path, const char *pass, Http *request )
+{
+	if( request != NULL )
+	{
+		request->h_SB = l->sb;
+	}
+	DEBUG("Call unzip to device\n");
+	return UnpackZipToDevice( name, dev, path, pass, request, 0 );
+}
+
 //
 //
 //
@@ -121,8 +135,15 @@ void *libInit( void *sb )
 	l->GetRevision = GetRevision;//dlsym( l->l_Handle, "GetRevision");
 
 	l->Unpack = Unpack; //dlsym ( l->l_Handle, "UnpackZIP");
+	l->UnpackToDevice = UnpackToDevice;
 	l->Pack = Pack;//dlsym ( l->l_Handle, "PackToZIP");
 	
+	l->ZipStreamNew = ZipStreamNew;
+	l->ZipStreamDelete = ZipStreamDelete;
+	l->ZipStreamAddDirectory = ZipStreamAddDirectory;
+	l->ZipStreamAddFile = ZipStreamAddFile;
+	l->ZipStreamFinish = ZipStreamFinish;
+	
 	DEBUG("Pack function pointer %p\n", l->Pack );
 	DEBUG("Unpack function pointer %p\n", l->Unpack );
 
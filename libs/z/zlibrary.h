@@ -34,6 +34,8 @@
 #include <network/socket.h>
 #include <network/http.h>
 #include <system/user/user_session.h>
+#include "zipstream.h"
+#include "zipextract.h"
 
 //
 //	library
@@ -52,6 +54,14 @@ typedef struct ZLibrary
 	
 	int                (*Pack)( struct ZLibrary *l, const char *name, const char *dir, int cutfilename, const char *pass, Http *request, int numberOfFiles );
 	int                (*Unpack)( struct ZLibrary *l, const char *name, const char *dir, const char *pass, Http *request );
+	int                (*UnpackToDevice)( struct ZLibrary *l, const char *name, File *dev, const char *path, const char *pass, Http *request );
+	
+	// streamed archives
+	ZipStream       *(*ZipStreamNew)( ZipStreamWriteFunc wfunc, void *wdata, int threads );
+	void               (*ZipStreamDelete)( ZipStream *zs );
+	int                (*ZipStreamAddDirectory)( ZipStream *zs, const char *name, time_t mtime );
+	int                (*ZipStreamAddFile)( ZipStream *zs, File *dev, const char *path, const char *name, FQUAD size, time_t mtime );
+	int                (*ZipStreamFinish)( ZipStream *zs );
 	
 	Http              *(*ZWebRequest)( struct ZLibrary *l, char* func, Http* request );
 } ZLibrary;